@@ -0,0 +1,24 @@
+/*
+** The author of this program disclaims copyright.
+**
+** Sums and differences.  This module and term.y import each other.
+*/
+
+%export expr.
+%export term.
+
+%import "../expr/term.y"
+
+%type expr {int}
+
+expr(A) ::= expr(B) PLUS term(C). {
+    A = B + C;
+}
+
+expr(A) ::= expr(B) MINUS term(C). {
+    A = B - C;
+}
+
+expr(A) ::= term(B). {
+    A = B;
+}
@@ -0,0 +1,30 @@
+/*
+** The author of this program disclaims copyright.
+**
+** Products and factors.  A factor may be an expression in parentheses,
+** which is defined by expr.y, so this module imports expr.y back.
+*/
+
+%export term.
+%export expr.
+
+%import "../expr/expr.y"
+
+%type term {int}
+%type factor {int}
+
+term(A) ::= term(B) TIMES factor(C). {
+    A = B * C;
+}
+
+term(A) ::= factor(B). {
+    A = B;
+}
+
+factor(A) ::= INTEGER(B). {
+    A = B;
+}
+
+factor(A) ::= LP expr(B) RP. {
+    A = B;
+}
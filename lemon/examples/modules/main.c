@@ -0,0 +1,57 @@
+/*
+** The author of this program disclaims copyright.
+*/
+
+/* Parse the program in zIn and return the value of its last PRINT
+** statement, or -1 after a syntax error */
+static int run(const char *zIn)
+{
+    void* pParser = ParseAlloc (malloc);
+    int result = 0;
+    const char *z = zIn;
+
+    while (*z) {
+        switch (*z) {
+        case ' ': z++; continue;
+        case 'p': Parse (pParser, PRINT, 0, &result); z += 5; continue;
+        case ';': Parse (pParser, SEMI, 0, &result); break;
+        case '+': Parse (pParser, PLUS, 0, &result); break;
+        case '-': Parse (pParser, MINUS, 0, &result); break;
+        case '*': Parse (pParser, TIMES, 0, &result); break;
+        case '(': Parse (pParser, LP, 0, &result); break;
+        case ')': Parse (pParser, RP, 0, &result); break;
+        default:
+            Parse (pParser, INTEGER, (int)strtol (z, (char**)&z, 10), &result);
+            continue;
+        }
+        z++;
+    }
+    Parse (pParser, 0, 0, &result);
+    ParseFree(pParser, free);
+    return result;
+}
+
+static const struct {
+    const char *zIn;
+    int expected;
+} aTest[] = {
+    { "print 2 + 3 * 4;",                 14 },
+    { "print (2 + 3) * 4;",               20 },
+    { "print 1; print 10 - (2 - 3) * 2;", 12 },
+    { "print 2 + ;",                      -1 },
+};
+
+int main()
+{
+    int i, nFail = 0;
+
+    for (i = 0; i < (int)(sizeof(aTest)/sizeof(aTest[0])); i++) {
+        int result = run (aTest[i].zIn);
+        printf ("%-34s => %d\n", aTest[i].zIn, result);
+        if (result != aTest[i].expected) {
+            printf ("  expected %d\n", aTest[i].expected);
+            nFail++;
+        }
+    }
+    return nFail != 0;
+}
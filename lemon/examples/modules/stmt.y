@@ -0,0 +1,33 @@
+/*
+** The author of this program disclaims copyright.
+**
+** The main grammar file.  The expressions are in two modules under
+** expr/ that import each other, and the same module is imported here
+** under two different names.  The start symbol is "program", the first
+** rule of this file, even though the modules are read before it.
+*/
+
+%include {
+#include <stdio.h>
+#include <stdlib.h> /* malloc, free */
+#include "stmt.h"
+}
+
+%token_type {int}
+%extra_argument {int *pResult}
+
+%syntax_error {
+    *pResult = -1;
+}
+
+%import "expr/expr.y"
+%import "./expr/expr.y"
+
+program ::= stmts.
+
+stmts ::= stmts stmt.
+stmts ::= .
+
+stmt ::= PRINT expr(A) SEMI. {
+    *pResult = A;
+}
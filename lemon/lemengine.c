@@ -0,0 +1,554 @@
+/*
+** 2026-10-18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** The shared parser engine of the LEMON parser generator.
+**
+** This is the driver of "lempar.c", taken out of the template so that
+** one copy of it can run the parsers of any number of grammars generated
+** with "lemon -G".  Everything that "lempar.c" decides at compile time
+** from the macros of the grammar is read from its lemonGrammar object
+** instead.  Compile this file once, with NDEBUG if the parsers will never
+** be traced, and link it with the generated parsers.
+*/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lemengine.h"
+
+/* The part of a stack entry that the engine knows about.  The minor
+** value follows, pGrammar->iMinorOfst bytes into the entry. */
+typedef struct lemonStackEntry lemonStackEntry;
+struct lemonStackEntry {
+  unsigned short stateno;   /* The state-number, or reduce action */
+  unsigned short major;     /* The major token value */
+};
+
+/* The stack entry at P, and the entry N entries above it */
+#define yyEntry(P)      ((lemonStackEntry*)(P))
+#define yyAbove(P,N)    ((P) + (N)*(ptrdiff_t)p->pGrammar->szEntry)
+
+#ifndef NDEBUG
+/* The stream for tracing grammar g, or NULL if not tracing */
+static FILE *yyTraceStream(const lemonGrammar *g){
+  return g->ppTraceFILE ? *g->ppTraceFILE : 0;
+}
+#define yyTraceFILE   yyTraceStream(g)
+#define yyTracePrompt (*g->pzTracePrompt)
+#endif
+
+/*
+** Allocate, resize or release memory for the stack of p, with its
+** allocator if it has one.
+*/
+static void *yyStackMem(lemonParser *p, void *pOld, size_t nOld, size_t nNew){
+  if( p->xMem ) return p->xMem(p->pMemCtx, pOld, nOld, nNew);
+  if( nNew==0 ){
+    free(pOld);
+    return 0;
+  }
+  return realloc(pOld, nNew);
+}
+
+/*
+** Move the stack of p to newSize entries, which hold at least the
+** entries up to the top of the stack: back into the entries of the
+** parser object if they are enough, or to the heap otherwise.  Return
+** the number of errors, which leave the stack unchanged.  Return 0 on
+** success.
+*/
+static int yyResizeStack(lemonParser *p, int newSize){
+  const lemonGrammar *g = p->pGrammar;
+  ptrdiff_t idx = p->yytos - p->yystack;   /* Offset of the top entry */
+  size_t nCopy;                            /* Bytes to keep */
+  char *pNew;
+
+  if( newSize<=p->nStk0 ){
+    newSize = p->nStk0;
+    pNew = (char*)p->yystk0;
+  }else if( p->yystack!=(char*)p->yystk0 ){
+    pNew = yyStackMem(p, p->yystack, p->yystksz*g->szEntry,
+                      newSize*g->szEntry);
+    if( pNew==0 ) return 1;
+    p->yystack = pNew;
+  }else{
+    pNew = yyStackMem(p, 0, 0, newSize*g->szEntry);
+    if( pNew==0 ) return 1;
+  }
+  if( pNew!=p->yystack ){
+    nCopy = idx + g->szEntry;
+    if( nCopy>p->yystksz*g->szEntry ) nCopy = p->yystksz*g->szEntry;
+    memcpy(pNew, p->yystack, nCopy);
+    if( p->yystack!=(char*)p->yystk0 ){
+      yyStackMem(p, p->yystack, p->yystksz*g->szEntry, 0);
+    }
+  }
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sStack %s from %d to %d entries.\n",
+            yyTracePrompt, newSize>p->yystksz ? "grows" : "shrinks",
+            p->yystksz, newSize);
+  }
+#endif
+  p->yystack = pNew;
+  p->yytos = &pNew[idx];
+  p->yystackEnd = yyAbove(pNew, newSize-1);
+  p->yystksz = newSize;
+  return 0;
+}
+
+/*
+** Try to increase the size of the parser stack.  Return the number
+** of errors.  Return 0 on success.
+*/
+static int yyGrowStack(lemonParser *p){
+  const lemonGrammar *g = p->pGrammar;
+  int newSize;
+
+  newSize = g->xStackGrowth(p->yystksz);
+  if( g->nStackLimit>0 && newSize>g->nStackLimit ) newSize = g->nStackLimit;
+  if( newSize<=p->yystksz ) return 1;
+  return yyResizeStack(p, newSize);
+}
+
+/*
+** Initialize the parser p for grammar g.  aStack[] is the stack in the
+** parser object of the grammar, of nStack entries.  If bGrow is true,
+** the stack moves to the heap when it outgrows aStack[], with memory
+** from xMem, or from the C library if xMem is NULL.
+*/
+void lemonEngineInit(
+  lemonParser *p,
+  const lemonGrammar *g,
+  void *aStack,
+  int nStack,
+  int bGrow,
+  void *(*xMem)(void*,void*,size_t,size_t),
+  void *pMemCtx
+){
+  p->pGrammar = g;
+  p->xMem = xMem;
+  p->pMemCtx = pMemCtx;
+  p->yyhwm = 0;
+  p->yyerrcnt = -1;
+  p->yystk0 = aStack;
+  p->nStk0 = nStack;
+  p->bGrow = bGrow;
+  p->yystack = (char*)aStack;
+  p->yystksz = nStack;
+  p->yystackEnd = yyAbove(p->yystack, p->yystksz-1);
+  p->yytos = p->yystack;
+  yyEntry(p->yystack)->stateno = 0;
+  yyEntry(p->yystack)->major = 0;
+}
+
+/*
+** Pop the parser's stack once, calling the destructor of the value
+** popped.
+*/
+static void yy_pop_parser_stack(lemonParser *p){
+  const lemonGrammar *g = p->pGrammar;
+  char *yytos;
+  assert( p->yytos!=0 );
+  assert( p->yytos > p->yystack );
+  yytos = p->yytos;
+  p->yytos = yyAbove(yytos, -1);
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sPopping %s\n",
+      yyTracePrompt,
+      g->azTokenName[yyEntry(yytos)->major]);
+  }
+#endif
+  g->xDestructor(p, yyEntry(yytos)->major, yytos + g->iMinorOfst);
+}
+
+/* Return the peak depth of the stack of p */
+int lemonEngineStackPeak(lemonParser *p){
+  return (int)(p->yyhwm/(ptrdiff_t)p->pGrammar->szEntry);
+}
+
+/* Pop everything off the stack of p */
+void lemonEnginePopAll(lemonParser *p){
+  while( p->yytos>p->yystack ) yy_pop_parser_stack(p);
+}
+
+/*
+** Clear all secondary memory allocations from the parser
+*/
+void lemonEngineFinalize(lemonParser *p){
+  lemonEnginePopAll(p);
+  if( p->yystack!=(char*)p->yystk0 ){
+    yyStackMem(p, p->yystack, p->yystksz*p->pGrammar->szEntry, 0);
+  }
+}
+
+/* Give back the memory of the stack of p beyond the entries in use */
+void lemonEngineShrink(lemonParser *p){
+  int n = (int)((p->yytos - p->yystack)/(ptrdiff_t)p->pGrammar->szEntry) + 1;
+  if( p->yystack!=(char*)p->yystk0 && n<p->yystksz ) yyResizeStack(p, n);
+}
+
+/* Return the bytes of the stack of p on the heap */
+size_t lemonEngineMemoryUsed(lemonParser *p){
+  if( p->yystack==(char*)p->yystk0 ) return 0;
+  return p->yystksz*p->pGrammar->szEntry;
+}
+
+/*
+** Find the appropriate action for a parser given the terminal
+** look-ahead token iLookAhead.
+*/
+static unsigned int yy_find_shift_action(
+  const lemonGrammar *g,    /* The grammar */
+  int iLookAhead,           /* The look-ahead token */
+  unsigned int stateno      /* Current state number */
+){
+  int i;
+
+  if( stateno>(unsigned int)g->iMaxShift ) return stateno;
+  do{
+    assert( iLookAhead!=g->iNoCode );
+    assert( iLookAhead < g->nToken );
+    assert( g->aShiftOfst[stateno]>=0 );
+    assert( g->aShiftOfst[stateno]<=g->nActtab );
+    i = g->aShiftOfst[stateno] + iLookAhead;
+    if( g->aLookahead[i]!=iLookAhead ){
+      if( g->aFallback ){
+        int iFallback = g->aFallback[iLookAhead];   /* Fallback token */
+        if( iFallback!=0 ){
+#ifndef NDEBUG
+          if( yyTraceFILE ){
+            fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
+               yyTracePrompt, g->azTokenName[iLookAhead],
+               g->azTokenName[iFallback]);
+          }
+#endif
+          assert( g->aFallback[iFallback]==0 ); /* Fallback loop must end */
+          iLookAhead = iFallback;
+          continue;
+        }
+      }
+      if( g->iWildcard ){
+        int j = g->aShiftOfst[stateno] + g->iWildcard;
+        if( g->aLookahead[j]==g->iWildcard && iLookAhead>0 ){
+#ifndef NDEBUG
+          if( yyTraceFILE ){
+            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
+               yyTracePrompt, g->azTokenName[iLookAhead],
+               g->azTokenName[g->iWildcard]);
+          }
+#endif /* NDEBUG */
+          return g->aAction[j];
+        }
+      }
+      return g->aDefault[stateno];
+    }else{
+      assert( i>=0 && i<g->nActtab );
+      return g->aAction[i];
+    }
+  }while(1);
+}
+
+/*
+** Find the appropriate action for a parser given the non-terminal
+** look-ahead token iLookAhead.
+*/
+static unsigned int yy_find_reduce_action(
+  const lemonGrammar *g,    /* The grammar */
+  unsigned int stateno,     /* Current state number */
+  int iLookAhead            /* The look-ahead token */
+){
+  int i;
+  assert( iLookAhead!=g->iNoCode );
+  if( g->iErrorSymbol ){
+    if( stateno>(unsigned int)g->iReduceCount ){
+      return g->aDefault[stateno];
+    }
+  }
+  assert( stateno<=(unsigned int)g->iReduceCount );
+  i = g->aReduceOfst[stateno];
+  i += iLookAhead;
+  if( g->iErrorSymbol ){
+    if( i<0 || i>=g->nActtab || g->aLookahead[i]!=iLookAhead ){
+      return g->aDefault[stateno];
+    }
+  }
+  assert( i>=0 && i<g->nActtab );
+  assert( g->aLookahead[i]==iLookAhead );
+  return g->aAction[i];
+}
+
+/*
+** Print tracing information for a SHIFT action
+*/
+#ifndef NDEBUG
+static void yyTraceShift(lemonParser *p, int yyNewState, const char *zTag){
+  const lemonGrammar *g = p->pGrammar;
+  if( yyTraceFILE ){
+    if( yyNewState<=g->iMaxShift ){
+      fprintf(yyTraceFILE,"%s%s '%s', go to state %d\n",
+         yyTracePrompt, zTag, g->azTokenName[yyEntry(p->yytos)->major],
+         yyNewState);
+    }else{
+      fprintf(yyTraceFILE,"%s%s '%s', pending reduce %d\n",
+         yyTracePrompt, zTag, g->azTokenName[yyEntry(p->yytos)->major],
+         yyNewState - g->iMinReduce);
+    }
+  }
+}
+#else
+# define yyTraceShift(X,Y,Z)
+#endif
+
+/*
+** Perform a shift action.  pMinor points to a YYMINORTYPE holding the
+** value of the token.
+*/
+static void yy_shift(
+  lemonParser *p,               /* The parser to be shifted */
+  unsigned int yyNewState,      /* The new state to shift in */
+  int yyMajor,                  /* The major token to shift in */
+  void *pMinor                  /* The minor token to shift in */
+){
+  const lemonGrammar *g = p->pGrammar;
+  char *yytos;
+  p->yytos = yyAbove(p->yytos, 1);
+  if( p->yytos - p->yystack>p->yyhwm ){
+    p->yyhwm = p->yytos - p->yystack;
+  }
+  if( p->yytos>p->yystackEnd ){
+    if( !p->bGrow || yyGrowStack(p) ){
+      p->yytos = yyAbove(p->yytos, -1);
+      g->xStackOverflow(p);
+      return;
+    }
+  }
+  if( yyNewState > (unsigned int)g->iMaxShift ){
+    yyNewState += g->iMinReduce - g->iMinShiftReduce;
+  }
+  yytos = p->yytos;
+  yyEntry(yytos)->stateno = (unsigned short)yyNewState;
+  yyEntry(yytos)->major = (unsigned short)yyMajor;
+  memcpy(yytos + g->iMinorOfst, pMinor, g->szToken);
+  yyTraceShift(p, yyNewState, "Shift");
+}
+
+/*
+** Perform a reduce action and the shift that must immediately
+** follow the reduce.
+*/
+static unsigned int yy_reduce(
+  lemonParser *p,              /* The parser */
+  unsigned int yyruleno,       /* Number of the rule by which to reduce */
+  int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+  void *pLookahead             /* Value of the lookahead token */
+){
+  const lemonGrammar *g = p->pGrammar;
+  int yygoto;                     /* The next state */
+  unsigned int yyact;             /* The next action */
+  char *yymsp;                    /* The top of the parser's stack */
+  int yysize;                     /* Amount to pop the stack */
+
+  yymsp = p->yytos;
+  g->xReduce(p, yyruleno, yymsp, yyLookahead, pLookahead);
+  yygoto = g->aRuleLhs[yyruleno];
+  yysize = g->aRuleNRhs[yyruleno];
+  yyact = yy_find_reduce_action(g, yyEntry(yyAbove(yymsp, yysize))->stateno,
+                                yygoto);
+
+  /* There are no SHIFTREDUCE actions on nonterminals because the table
+  ** generator has simplified them to pure REDUCE actions. */
+  assert( !(yyact>(unsigned int)g->iMaxShift
+            && yyact<=(unsigned int)g->iMaxShiftReduce) );
+
+  /* It is not possible for a REDUCE to be followed by an error */
+  assert( yyact!=(unsigned int)g->iErrorAction );
+
+  yymsp = yyAbove(yymsp, yysize+1);
+  p->yytos = yymsp;
+  yyEntry(yymsp)->stateno = (unsigned short)yyact;
+  yyEntry(yymsp)->major = (unsigned short)yygoto;
+  yyTraceShift(p, yyact, "... then shift");
+  return yyact;
+}
+
+/*
+** The parse fails.  Pop the stack and run the %parse_failure code.
+*/
+static void yy_parse_failed(lemonParser *p){
+  p->pGrammar->xParseFailed(p);
+  p->yyerrcnt = -1;
+}
+
+/*
+** Run the parser p on one token.  pMinor points to a YYMINORTYPE of the
+** grammar, holding the value of the token.  This is Parse() of
+** "lempar.c", without the %extra_argument, which the generated Parse()
+** has already stored.
+*/
+void lemonEngineParse(
+  lemonParser *p,              /* The parser */
+  int yymajor,                 /* The major token code number */
+  void *pMinor                 /* The value for the token */
+){
+  const lemonGrammar *g = p->pGrammar;
+  unsigned int yyact;   /* The parser action. */
+  int yyendofinput;     /* True if we are at the end of input */
+  int yyerrorhit = 0;   /* True if yymajor has invoked an error */
+
+  assert( p->yytos!=0 );
+  yyendofinput = (yymajor==0);
+
+  yyact = yyEntry(p->yytos)->stateno;
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    if( yyact < (unsigned int)g->iMinReduce ){
+      fprintf(yyTraceFILE,"%sInput '%s' in state %d\n",
+              yyTracePrompt,g->azTokenName[yymajor],yyact);
+    }else{
+      fprintf(yyTraceFILE,"%sInput '%s' with pending reduce %d\n",
+              yyTracePrompt,g->azTokenName[yymajor],yyact-g->iMinReduce);
+    }
+  }
+#endif
+
+  while(1){ /* Exit by "break" */
+    assert( p->yytos>=p->yystack );
+    assert( yyact==yyEntry(p->yytos)->stateno );
+    yyact = yy_find_shift_action(g, yymajor, yyact);
+    if( yyact >= (unsigned int)g->iMinReduce ){
+      unsigned int yyruleno = yyact - g->iMinReduce; /* Reduce by this rule */
+#ifndef NDEBUG
+      if( yyTraceFILE ){
+        int yysize = g->aRuleNRhs[yyruleno];
+        if( yysize ){
+          fprintf(yyTraceFILE, "%sReduce %d [%s]%s, pop back to state %d.\n",
+            yyTracePrompt,
+            yyruleno, g->azRuleName[yyruleno],
+            (int)yyruleno<g->nRuleWithAction ? "" : " without external action",
+            yyEntry(yyAbove(p->yytos, yysize))->stateno);
+        }else{
+          fprintf(yyTraceFILE, "%sReduce %d [%s]%s.\n",
+            yyTracePrompt, yyruleno, g->azRuleName[yyruleno],
+            (int)yyruleno<g->nRuleWithAction ? "" : " without external action");
+        }
+      }
+#endif /* NDEBUG */
+
+      /* Check that the stack is large enough to grow by a single entry
+      ** if the RHS of the rule is empty.  This ensures that there is room
+      ** enough on the stack to push the LHS value */
+      if( g->aRuleNRhs[yyruleno]==0 ){
+        if( p->yytos - p->yystack>p->yyhwm ){
+          p->yyhwm = p->yytos - p->yystack;
+        }
+        if( p->yytos>=p->yystackEnd ){
+          if( !p->bGrow || yyGrowStack(p) ){
+            g->xStackOverflow(p);
+            break;
+          }
+        }
+      }
+      yyact = yy_reduce(p, yyruleno, yymajor, pMinor);
+    }else if( yyact <= (unsigned int)g->iMaxShiftReduce ){
+      yy_shift(p, yyact, yymajor, pMinor);
+      p->yyerrcnt--;
+      break;
+    }else if( yyact==(unsigned int)g->iAcceptAction ){
+      p->yytos = yyAbove(p->yytos, -1);
+      p->yyerrcnt = -1;
+      assert( p->yytos==p->yystack );
+      g->xAccept(p);
+      return;
+    }else{
+      assert( yyact==(unsigned int)g->iErrorAction );
+#ifndef NDEBUG
+      if( yyTraceFILE ){
+        fprintf(yyTraceFILE,"%sSyntax Error!\n",yyTracePrompt);
+      }
+#endif
+      if( g->iErrorSymbol ){
+        /* A syntax error has occurred, and the grammar defines an error
+        ** token.  Call the %syntax_error function, pop the stack until
+        ** the error symbol can be shifted, and shift it.  No new error
+        ** processing occurs until three tokens have been shifted.
+        */
+        int yymx;
+        if( p->yyerrcnt<0 ){
+          g->xSyntaxError(p, yymajor, pMinor);
+        }
+        yymx = yyEntry(p->yytos)->major;
+        if( yymx==g->iErrorSymbol || yyerrorhit ){
+#ifndef NDEBUG
+          if( yyTraceFILE ){
+            fprintf(yyTraceFILE,"%sDiscard input token %s\n",
+               yyTracePrompt,g->azTokenName[yymajor]);
+          }
+#endif
+          g->xDestructor(p, yymajor, pMinor);
+          yymajor = g->iNoCode;
+        }else{
+          while( p->yytos > p->yystack ){
+            yyact = yy_find_reduce_action(g, yyEntry(p->yytos)->stateno,
+                                          g->iErrorSymbol);
+            if( yyact<=(unsigned int)g->iMaxShiftReduce ) break;
+            yy_pop_parser_stack(p);
+          }
+          if( p->yytos <= p->yystack || yymajor==0 ){
+            g->xDestructor(p, yymajor, pMinor);
+            yy_parse_failed(p);
+            yymajor = g->iNoCode;
+          }else if( yymx!=g->iErrorSymbol ){
+            yy_shift(p, yyact, g->iErrorSymbol, pMinor);
+          }
+        }
+        p->yyerrcnt = 3;
+        yyerrorhit = 1;
+        if( yymajor==g->iNoCode ) break;
+        yyact = yyEntry(p->yytos)->stateno;
+      }else if( g->bNoErrorRecovery ){
+        /* Report the syntax error and carry on as if nothing had
+        ** happened. */
+        g->xSyntaxError(p, yymajor, pMinor);
+        g->xDestructor(p, yymajor, pMinor);
+        break;
+      }else{
+        /* Report an error message, and throw away the input token.  If
+        ** the input token is $, then fail the parse.  Subsequent error
+        ** messages are suppressed until three input tokens have been
+        ** successfully shifted.
+        */
+        if( p->yyerrcnt<=0 ){
+          g->xSyntaxError(p, yymajor, pMinor);
+        }
+        p->yyerrcnt = 3;
+        g->xDestructor(p, yymajor, pMinor);
+        if( yyendofinput ){
+          yy_parse_failed(p);
+        }
+        break;
+      }
+    }
+  }
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    char *i;
+    char cDiv = '[';
+    fprintf(yyTraceFILE,"%sReturn. Stack=",yyTracePrompt);
+    for(i=yyAbove(p->yystack, 1); i<=p->yytos; i=yyAbove(i, 1)){
+      fprintf(yyTraceFILE,"%c%s", cDiv, g->azTokenName[yyEntry(i)->major]);
+      cDiv = ' ';
+    }
+    fprintf(yyTraceFILE,"]\n");
+  }
+#endif
+  return;
+}
@@ -0,0 +1,116 @@
+/*
+** 2026-10-18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** Interface to the shared parser engine of the LEMON parser generator.
+**
+** A parser generated by "lemon -G" has no driver of its own.  It holds
+** the tables of its grammar, the code of its reduce actions and
+** destructors, and a lemonGrammar object that describes them, and its
+** Parse() routines hand their work to the engine in "lemengine.c".  A
+** program with many grammars links one copy of the engine instead of one
+** driver for each of them.
+**
+** None of this is meant to be used directly.  The generated parser fills
+** in the lemonGrammar object, and its yyParser object starts with a
+** lemonParser.
+*/
+#ifndef LEMON_LEMENGINE_H
+#define LEMON_LEMENGINE_H
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct lemonGrammar lemonGrammar;
+typedef struct lemonParser lemonParser;
+
+/*
+** A grammar, as the engine sees it.  The tables are those of the comb
+** encoding, with YYCODETYPE and YYACTIONTYPE both unsigned short.  The
+** stack entries of the grammar start with the state number and the major
+** token, as two unsigned shorts, and hold the minor value iMinorOfst bytes
+** into the entry.
+*/
+struct lemonGrammar {
+  const unsigned short *aAction;     /* yy_action[] */
+  const unsigned short *aLookahead;  /* yy_lookahead[] */
+  const short *aShiftOfst;           /* yy_shift_ofst[] */
+  const short *aReduceOfst;          /* yy_reduce_ofst[] */
+  const unsigned short *aDefault;    /* yy_default[] */
+  const unsigned short *aFallback;   /* yyFallback[], or NULL if not used */
+  const unsigned short *aRuleLhs;    /* yyRuleInfoLhs[] */
+  const signed char *aRuleNRhs;      /* yyRuleInfoNRhs[] */
+  int nActtab;                       /* YY_ACTTAB_COUNT */
+  int iReduceCount;                  /* YY_REDUCE_COUNT */
+  int nRuleWithAction;               /* YYNRULE_WITH_ACTION */
+  int nToken;                        /* YYNTOKEN */
+  int iMaxShift;                     /* YY_MAX_SHIFT */
+  int iMinShiftReduce;               /* YY_MIN_SHIFTREDUCE */
+  int iMaxShiftReduce;               /* YY_MAX_SHIFTREDUCE */
+  int iErrorAction;                  /* YY_ERROR_ACTION */
+  int iAcceptAction;                 /* YY_ACCEPT_ACTION */
+  int iMinReduce;                    /* YY_MIN_REDUCE */
+  int iNoCode;                       /* YYNOCODE */
+  int iWildcard;                     /* YYWILDCARD, or 0 if not used */
+  int iErrorSymbol;                  /* YYERRORSYMBOL, or 0 if none */
+  int bNoErrorRecovery;              /* True if YYNOERRORRECOVERY */
+  size_t szEntry;                    /* Bytes in a stack entry */
+  size_t szToken;                    /* Bytes in a ParseTOKENTYPE */
+  size_t iMinorOfst;                 /* Offset of the minor value in an entry */
+
+  /* The code of the grammar.  pMinor points to a YYMINORTYPE, and pTos
+  ** to the stack entry at the top of the stack. */
+  void (*xReduce)(lemonParser*, unsigned int iRule, void *pTos,
+                  int iLookahead, void *pMinor);
+  void (*xDestructor)(lemonParser*, int iMajor, void *pMinor);
+  void (*xStackOverflow)(lemonParser*);
+  void (*xParseFailed)(lemonParser*);
+  void (*xSyntaxError)(lemonParser*, int iMajor, void *pMinor);
+  void (*xAccept)(lemonParser*);
+  int (*xStackGrowth)(int nStack);   /* YYSTACKGROWTH() */
+  int nStackLimit;                   /* YYSTACKLIMIT, or 0 for no limit */
+
+  /* Tracing.  All NULL if the parser was compiled with NDEBUG */
+  const char *const *azTokenName;    /* yyTokenName[] */
+  const char *const *azRuleName;     /* yyRuleName[] */
+  FILE **ppTraceFILE;                /* Where ParseTrace() keeps its stream */
+  char **pzTracePrompt;              /* And its prompt */
+};
+
+/*
+** The state of a parser.  The stack is an array of entries of
+** pGrammar->szEntry bytes each.
+*/
+struct lemonParser {
+  const lemonGrammar *pGrammar;      /* The grammar being parsed */
+  char *yytos;                       /* Top element of the stack */
+  char *yystack;                     /* The stack */
+  char *yystackEnd;                  /* Last entry of the stack */
+  void *yystk0;                      /* Entries in the yyParser object */
+  int nStk0;                         /* Number of entries in yystk0 */
+  int yystksz;                       /* Number of entries in the stack */
+  int bGrow;                         /* True if the stack can grow */
+  ptrdiff_t yyhwm;                   /* High-water mark of the stack, bytes */
+  int yyerrcnt;                      /* Shifts left before out of the error */
+  void *(*xMem)(void*,void*,size_t,size_t);  /* Allocator, or NULL */
+  void *pMemCtx;                     /* First argument to xMem */
+};
+
+void lemonEngineInit(lemonParser*, const lemonGrammar*, void *aStack,
+                     int nStack, int bGrow,
+                     void *(*xMem)(void*,void*,size_t,size_t),
+                     void *pMemCtx);
+void lemonEngineParse(lemonParser*, int iMajor, void *pMinor);
+void lemonEnginePopAll(lemonParser*);
+int lemonEngineStackPeak(lemonParser*);
+void lemonEngineFinalize(lemonParser*);
+void lemonEngineShrink(lemonParser*);
+size_t lemonEngineMemoryUsed(lemonParser*);
+
+#endif /* LEMON_LEMENGINE_H */
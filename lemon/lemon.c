@@ -6,12 +6,18 @@
 **
 ** The author of this program disclaims copyright.
 */
+#if !defined(_WIN32) && !defined(WIN32) && !defined(__WIN32__) \
+ && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+# define _POSIX_C_SOURCE 200809L   /* For open_memstream() and fmemopen() */
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <setjmp.h>
+#include <time.h>
 
 #define ISSPACE(X) isspace((unsigned char)(X))
 #define ISDIGIT(X) isdigit((unsigned char)(X))
@@ -37,6 +43,24 @@ extern int access(const char *path, int mode);
 #endif
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+/* Watch mode uses inotify to see when files change */
+#if defined(__linux__) && !defined(LEMON_NO_MAIN)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+/* Batch mode uses a pool of threads unless LEMON_NO_THREADS is defined */
+#if !defined(__WIN32__) && !defined(LEMON_NO_THREADS)
+#include <pthread.h>
+#define BATCH_THREADS 1
+#else
+#define BATCH_THREADS 0
 #endif
 
 /* #define PRIVATE static */
@@ -48,8 +72,6 @@ extern int access(const char *path, int mode);
 #define MAXRHS 1000
 #endif
 
-extern void memory_error();
-static int showPrecedenceConflict = 0;
 static char *msort(char*,char**,int(*)(const char*,const char*));
 
 /*
@@ -134,6 +156,7 @@ static int lemon_vsprintf(char *str, const char *zFormat, va_list ap){
       }else if( c=='%' ){
         lemon_addtext(str, &nUsed, "%", 1, 0);
       }else{
+        /* No other formats are used by this program */
         fprintf(stderr, "illegal format\n");
         exit(1);
       }
@@ -164,10 +187,21 @@ static void lemon_strcat(char *dest, const char *src){
 struct rule;
 struct lemon;
 struct action;
+struct memfile;
 
-static struct action *Action_new(void);
+static struct action *Action_new(struct lemon *);
 static struct action *Action_sort(struct action *);
 
+/* Steps of a run of the parser generator, from liblemon.c */
+double lemon_clock(void);
+int lemon_analyze(struct lemon *);
+int lemon_report(struct lemon *);
+int lemon_protect(struct lemon *, int(*)(struct lemon *));
+int lemon_run(struct lemon *);
+
+/********** From the file "batch.h" ************************************/
+int lemon_batch(struct lemon *, char **, int, const char *, int);
+
 /********** From the file "build.h" ************************************/
 void FindRulePrecedences(struct lemon*);
 void FindFirstSets(struct lemon*);
@@ -177,19 +211,119 @@ void FindFollowSets(struct lemon*);
 void FindActions(struct lemon*);
 
 /********* From the file "configlist.h" *********************************/
-void Configlist_init(void);
-struct config *Configlist_add(struct rule *, int);
-struct config *Configlist_addbasis(struct rule *, int);
+void Configlist_init(struct lemon *);
+struct config *Configlist_add(struct lemon *, struct rule *, int);
+struct config *Configlist_addbasis(struct lemon *, struct rule *, int);
 void Configlist_closure(struct lemon *);
-void Configlist_sort(void);
-void Configlist_sortbasis(void);
-struct config *Configlist_return(void);
-struct config *Configlist_basis(void);
-void Configlist_eat(struct config *);
-void Configlist_reset(void);
+void Configlist_sort(struct lemon *);
+void Configlist_sortbasis(struct lemon *);
+struct config *Configlist_return(struct lemon *);
+struct config *Configlist_basis(struct lemon *);
+void Configlist_eat(struct lemon *, struct config *);
+void Configlist_reset(struct lemon *);
 
 /********* From the file "error.h" ***************************************/
-void ErrorMsg(const char *, int,const char *, ...);
+void ErrorMsg(struct lemon *, const char *, int,const char *, ...);
+
+/********* From the file "liblemon.h" ************************************/
+/*
+** Interface to the LEMON parser generator when it is used as a library.
+**
+** Compile lemon.c with -DLEMON_NO_MAIN to leave out main() and link the
+** result into another program.  Each call to lemon_generate() is
+** independent of every other.  No global or static variables are used,
+** exit() is never called, no output files are written, and all memory
+** is released before lemon_generate() returns.  So separate calls may
+** run at the same time on different threads.
+*/
+#ifndef LEMON_LIBLEMON_H
+#define LEMON_LIBLEMON_H
+#include <stddef.h>
+
+/*
+** The inputs to lemon_generate().  Fields that are not needed should
+** be zero.  Most of them correspond to a command-line option, as shown.
+*/
+struct lemon_options {
+  const char *zFilename;     /* Name of the grammar file.  Used in messages,
+                             ** #line directives and to look for "*.lt" */
+  const char *zGrammar;      /* Text of the grammar, or NULL to read the
+                             ** file zFilename instead */
+  size_t nGrammar;           /* Number of bytes in zGrammar[] */
+  const char *zTemplate;     /* Text of the parser template, or NULL */
+  size_t nTemplate;          /* Number of bytes in zTemplate[] */
+  const char *zTemplateFile; /* Template file used if zTemplate is NULL (-T) */
+  const char *const *azDefine; /* Names of %ifdef macros (-D) */
+  int nDefine;               /* Number of entries in azDefine[] */
+  int basisflag;             /* Print only the basis in the report (-b) */
+  int noCompress;            /* Do not compress the action table (-c) */
+  int printPreprocessed;     /* Output only the preprocessed input (-E) */
+  int rpflag;                /* Output the grammar without actions (-g) */
+  int nolinenosflag;         /* Do not emit #line directives (-l) */
+  int mhflag;                /* Output a makeheaders compatible file (-m) */
+  int showPrecedenceConflict;  /* Show conflicts resolved by precedence (-p) */
+  int quiet;                 /* Do not generate the report (-q) */
+  int noResort;              /* Do not sort or renumber states (-r) */
+  int statistics;            /* Output parser statistics (-s) */
+  int sqlFlag;               /* Also describe the tables in SQL (-S) */
+  int jsonReport;            /* Write the report as JSON lines (-J) */
+  int sizeReport;            /* Show what contributes to the table sizes (-z) */
+  const char *zQuery;        /* Query an earlier JSON lines report (-Q) */
+  const char *zEncoding;     /* Table encoding: "comb", "dense", "hash",
+                             ** "code", "pair" or "packed" (-e).  NULL
+                             ** means "comb" */
+  int foldFallback;          /* Fold %fallback and %wildcard into the
+                             ** tables (-F) */
+  const char *zDispatch;     /* Reduce dispatch: "switch", "function" or
+                             ** "goto" (-R).  NULL means "switch" */
+  const char *zProfile;      /* Profile written by ParseProfile(), used to
+                             ** order the states and tables (-P) */
+  int blobTables;            /* Write the tables to a binary file (-B) */
+  int sharedEngine;          /* Leave the driver to lemengine.c (-G) */
+  int stackArrays;           /* Keep states and values of the stack in
+                             ** parallel arrays (-A) */
+  int boxSize;               /* Keep the values of types larger than this
+                             ** many bytes out of the stack (-Z), or 0 */
+};
+
+/*
+** The outputs of lemon_generate().  Each buffer is zero-terminated, or
+** is NULL if that output was not produced.  The stand-alone program
+** would have written the same text into a file or onto the terminal.
+*/
+struct lemon_result {
+  char *zSource;  size_t nSource;   /* The parser, normally "*.c" */
+  char *zHeader;  size_t nHeader;   /* Token codes, normally "*.h" */
+  char *zReport;  size_t nReport;   /* The report, "*.out" or "*.jsonl" */
+  char *zSql;     size_t nSql;      /* The tables in SQL, normally "*.sql" */
+  char *zTables;  size_t nTables;   /* Binary tables of -B, "*.tbl" */
+  char *zOutput;  size_t nOutput;   /* Text normally sent to stdout */
+  char *zErrors;  size_t nErrors;   /* Text normally sent to stderr */
+  int nError;                       /* Number of errors seen */
+  int nConflict;                    /* Number of parsing conflicts */
+};
+
+/*
+** Generate a parser.  The return value is the exit code the stand-alone
+** program would have used: 0 on success, and non-zero if there were
+** errors or conflicts.  -1 means memory ran out before anything could
+** start.  The buffers in *pResult must always be released afterwards
+** using lemon_result_free().
+*/
+int lemon_generate(const struct lemon_options *pOpt,
+                   struct lemon_result *pResult);
+void lemon_result_free(struct lemon_result *pResult);
+
+#endif /* LEMON_LIBLEMON_H */
+/********* From the file "memory.h" **************************************/
+void *lemon_malloc(struct lemon *, size_t);
+void *lemon_calloc(struct lemon *, size_t, size_t);
+void *lemon_realloc(struct lemon *, void *, size_t);
+void lemon_free(struct lemon *, void *);
+char *lemon_strdup(struct lemon *, const char *);
+void lemon_free_all(struct lemon *);
+void memory_error(struct lemon *);
+void lemon_fatal(struct lemon *);
 
 /****** From the file "option.h" ******************************************/
 enum option_type { OPT_FLAG=1,  OPT_INT,  OPT_DBL,  OPT_STR,
@@ -208,27 +342,41 @@ void   OptPrint(void);
 
 /******** From the file "parse.h" *****************************************/
 void Parse(struct lemon *lemp);
+void file_release_input(struct lemon *lemp);
 
 /********* From the file "plink.h" ***************************************/
-struct plink *Plink_new(void);
-void Plink_add(struct plink **, struct config *);
+struct plink *Plink_new(struct lemon *);
+void Plink_add(struct lemon *, struct plink **, struct config *);
 void Plink_copy(struct plink **, struct plink *);
-void Plink_delete(struct plink *);
+void Plink_delete(struct lemon *, struct plink *);
 
 /********** From the file "report.h" *************************************/
 void Reprint(struct lemon *);
 void ReportOutput(struct lemon *);
-void ReportTable(struct lemon *, int, int);
+void ReportJson(struct lemon *);
+int ReportQuery(struct lemon *);
+void ReportTable(struct lemon *);
 void ReportHeader(struct lemon *);
+void ReportSizes(struct lemon *);
+int encoding_find(const char *);
+int dispatch_find(const char *);
+char *tplt_find(struct lemon *);
+char *file_makename(struct lemon *, const char *);
+FILE *memfile_open(struct memfile *);
+void memfile_close(struct memfile *);
+void file_close(struct lemon *, FILE *);
+void file_close_all(struct lemon *);
 void CompressTables(struct lemon *);
+void FoldFallbacks(struct lemon *);
+void ReadProfile(struct lemon *);
 void ResortStates(struct lemon *);
 
 /********** From the file "set.h" ****************************************/
-void  SetSize(int);             /* All sets will be of size N */
-char *SetNew(void);               /* A new set for element 0..N */
-void  SetFree(char*);             /* Deallocate a set */
-int SetAdd(char*,int);            /* Add element to a set */
-int SetUnion(char *,char *);    /* A <- A U B, thru element N */
+void  SetSize(struct lemon*,int);      /* All sets will be of size N */
+char *SetNew(struct lemon*);           /* A new set for element 0..N */
+void  SetFree(struct lemon*,char*);    /* Deallocate a set */
+int SetAdd(struct lemon*,char*,int);   /* Add element to a set */
+int SetUnion(struct lemon*,char *,char *);  /* A <- A U B, thru element N */
 #define SetFind(X,Y) (X[Y])       /* True if Y is in set X */
 
 /********** From the file "struct.h" *************************************/
@@ -266,13 +414,18 @@ struct symbol {
                            ** popped from the stack during error processing */
   int destLineno;          /* Line number for start of destructor.  Set to
                            ** -1 for duplicate destructors. */
+  const char *destFilename;  /* File that holds the destructor */
   char *datatype;          /* The data type of information held by this
                            ** object. Only used if type==NONTERMINAL */
   int dtnum;               /* The data type number.  In the parser, the value
                            ** stack is a union.  The .yy%d element of this
                            ** union is the correct data type for this object */
+  int iBox;                /* With -Z, 1 plus the number of the pool that
+                           ** holds the values, if they are not in the stack */
   int bContent;            /* True if this symbol ever carries content - if
                            ** it is ever more than just syntax */
+  int bArena;              /* True if the %arena holds the values, which
+                           ** then need no destructor */
   /* The following fields are used by MULTITERMINALs only */
   int nsubsym;             /* Number of constituent symbols in the MULTI */
   struct symbol **subsym;  /* Array of constituent symbols */
@@ -285,6 +438,7 @@ struct rule {
   const char *lhsalias;    /* Alias for the LHS (NULL if none) */
   int lhsStart;            /* True if left-hand side is the start symbol */
   int ruleline;            /* Line number for the rule */
+  const char *filename;    /* File in which the rule appears */
   int nrhs;                /* Number of RHS symbols */
   struct symbol **rhs;     /* The RHS symbols */
   const char **rhsalias;   /* An alias for each RHS symbol (NULL if none) */
@@ -301,6 +455,10 @@ struct rule {
   Boolean doesReduce;      /* Reduce actions occur after optimization */
   Boolean neverReduce;     /* Reduce is theoretically possible, but prevented
                            ** by actions or other outside implementation */
+  Boolean lhsMinor;        /* The code uses the yylhsminor variable */
+  int iUnit;               /* Translation unit holding the code (-u) */
+  double nReduce;          /* Reduces counted by the profile (-P) */
+  Boolean isCold;          /* Code is in a cold function, out of line (-P) */
   struct rule *nextlhs;    /* Next rule with the same LHS */
   struct rule *next;       /* Next rule in the global list */
 };
@@ -351,6 +509,7 @@ struct action {
   struct symbol *spOpt;    /* SHIFTREDUCE optimization to this symbol */
   struct action *next;     /* Next action for this state */
   struct action *collide;  /* Next action with the same hash */
+  int iSeq;                /* Order of creation.  Breaks ties in sorting */
 };
 
 /* Each state of the generated parser's finite state machine
@@ -365,6 +524,9 @@ struct state {
   int iDfltReduce;         /* Default action is to REDUCE by this rule */
   struct rule *pDfltReduce;/* The default REDUCE rule. */
   int autoReduce;          /* True if this is an auto-reduce state */
+  int iOrigin;             /* statenum before ResortStates() */
+  double nTknHit, nNtHit;  /* Look-ups of terminals and nonterminals
+                           ** counted by the profile (-P) */
 };
 #define NO_OFFSET (-2147483647)
 
@@ -376,6 +538,57 @@ struct plink {
   struct plink *next;      /* The next propagate link */
 };
 
+/* The phases of a run of the parser generator.  The time spent in each
+** one is recorded in lemp->aPhase[].
+*/
+#define PHASE_PARSE     0  /* Read and parse the grammar */
+#define PHASE_ANALYZE   1  /* Compute the LALR(1) automaton */
+#define PHASE_COMPRESS  2  /* Compress and sort the action tables */
+#define PHASE_REPORT    3  /* Write the report, "*.out" */
+#define PHASE_TABLES    4  /* Write the parser, "*.c" */
+#define PHASE_HEADER    5  /* Write the token codes, "*.h" */
+#define PHASE_COUNT     6
+
+/* Encodings of the parser tables, selected by -e */
+enum e_encoding {
+  ENC_COMB,                /* Row displacement, with a lookahead check */
+  ENC_DENSE,               /* A [state][symbol] matrix */
+  ENC_HASH,                /* A perfect-hashed row for each state */
+  ENC_CODE,                /* C code with a switch for each state */
+  ENC_PAIR,                /* Comb, with look-ahead and action side by side */
+  ENC_PACKED               /* Comb, with entries of the exact bit width */
+};
+
+/* Ways for yy_reduce() to reach the code of a rule, selected by -R */
+enum e_dispatch {
+  DSP_SWITCH,              /* A switch on the rule number */
+  DSP_FUNCTION,            /* A table of one function for each action */
+  DSP_GOTO                 /* A table of labels, for a computed goto */
+};
+
+/* The identity of a file, so that one file reached by two different
+** names is still known to be the same file */
+struct file_id {
+  unsigned long dev;       /* Device that holds the file */
+  unsigned long ino;       /* Inode number of the file on that device */
+  int ok;                  /* True if dev and ino are known */
+};
+
+/* A grammar module, read into the grammar by %import.  Nonterminals of
+** a module are private to it unless they are listed by %export.
+*/
+struct gmodule {
+  char *filename;          /* Name of the module file */
+  struct file_id id;       /* Identity of the module file */
+  char *prefix;            /* Prefix for the private nonterminals */
+  const char **azExport;   /* Nonterminals shared with other files */
+  int nExport;             /* Number of entries in azExport[] */
+  char *pMap;              /* Text of the module, while it is parsed */
+  size_t nMap;             /* Size of pMap[] */
+  int bMapped;             /* True if pMap[] came from mmap() */
+  struct gmodule *next;    /* Next module, in the order they were read */
+};
+
 /* The state vector for the entire parser generator is recorded as
 ** follows.  (LEMON uses no global variables and makes little use of
 ** static variables.  Fields in the following structure can be thought
@@ -421,18 +634,104 @@ struct lemon {
   int nconflict;           /* Number of parsing conflicts */
   int nactiontab;          /* Number of entries in the yy_action[] table */
   int nlookaheadtab;       /* Number of entries in yy_lookahead[] */
+  int ncombtab;            /* yy_action[] entries of the comb encoding */
   int tablesize;           /* Total table size of all tables in bytes */
   int basisflag;           /* Print only basis configurations */
   int printPreprocessed;   /* Show preprocessor output on stdout */
   int has_fallback;        /* True if any %fallback is seen in the grammar */
+  int has_arena;           /* True if %arena is seen in the grammar */
+  int nfolded;             /* Entries added by FoldFallbacks() */
+  int nprofiled;           /* States with look-ups in the profile */
+  double nreduceprofiled;  /* Reduces counted by the profile */
+  int ncold;               /* Rules whose code is in cold functions */
   int nolinenosflag;       /* True if #line statements should not be printed */
   char *argv0;             /* Name of the program */
+
+  /* Options, from the command line or from a struct lemon_options */
+  int rpflag;              /* Print the grammar without actions */
+  int noCompress;          /* Do not compress the action table */
+  int noResort;            /* Do not sort or renumber states */
+  int quiet;               /* Do not write the report file */
+  int mhflag;              /* Output a makeheaders compatible file */
+  int sqlFlag;             /* Generate the *.sql file */
+  int statistics;          /* Print parser statistics */
+  int showPrecedenceConflict; /* Report conflicts resolved by precedence */
+  int jsonReport;          /* Write the report in JSON lines format */
+  int sizeReport;          /* Show what contributes to the table sizes */
+  int foldFallback;        /* Fold %fallback and %wildcard into the tables */
+  int nUnit;               /* Split the parser into this many source files */
+  int encoding;            /* Encoding of the tables, an ENC_* value */
+  int dispatch;            /* Dispatch of the reduce actions, a DSP_* value */
+  const char *zProfile;    /* Profile that orders the states, or NULL */
+  int blobTables;          /* Write the tables to a binary file (-B) */
+  int sharedEngine;        /* Leave the driver to lemengine.c (-G) */
+  int stackArrays;         /* States and values in parallel arrays (-A) */
+  int boxSize;             /* Values over this many bytes in pools (-Z) */
+  int szEntry;             /* Bytes in a stack entry, or -1 if unknown */
+  int szEntryUnboxed;      /* The same without -Z, or -1 if unknown */
+  int nLhsInPlace;         /* LHS values written in place by analysis */
+  int nLhsCopy;            /* LHS values still copied into place */
+  int nTokenNoValue;       /* Tokens whose values are never stored */
+  const char *zQuery;      /* Query the JSON lines report instead of running */
+  int nDefine;             /* Number of %ifdef macros */
+  char **azDefine;         /* Names of the %ifdef macros */
+  char *outputDir;         /* Directory for the output files, or NULL */
+  char *templatename;      /* Name of the template file, or NULL */
+  const char *zTemplate;   /* Text of the template, or NULL */
+  size_t nTemplate;        /* Number of bytes in zTemplate[] */
+  const char *zGrammar;    /* Text of the grammar, or NULL to read filename */
+  size_t nGrammar;         /* Number of bytes in zGrammar[] */
+
+  /* Where the output goes */
+  FILE *outstream;         /* Messages that the CLI writes to stdout */
+  FILE *errstream;         /* Error messages */
+  struct memfile *aMemfile;  /* Output files captured in memory, or NULL */
+  FILE *apOpen[4];         /* Files open for reading or writing */
+  char *pInputMap;         /* The input file, while Parse() has it mapped */
+  size_t nInputMap;        /* Size of pInputMap[] */
+  int bInputMapped;        /* True if pInputMap[] came from mmap() */
+  struct gmodule *pModule; /* Grammar modules read by %import */
+
+  /* Private state of the individual modules */
+  jmp_buf *pAbort;         /* Unwind to here on a fatal error */
+  struct memblock *pMem;   /* All memory allocated on behalf of this object */
+  struct s_x1 *x1a;        /* Table of strings */
+  struct s_x2 *x2a;        /* Table of symbols */
+  struct s_x3 *x3a;        /* Table of states */
+  struct s_x4 *x4a;        /* Table of configurations */
+  struct config *configFreelist;   /* List of free configurations */
+  struct config *configCurrent;    /* Top of list of configurations */
+  struct config **configCurrentend;  /* Last on list of configs */
+  struct config *configBasis;      /* Top of list of basis configs */
+  struct config **configBasisend;  /* End of list of basis configs */
+  struct plink *plinkFreelist;     /* List of free plinks */
+  struct action *actionFreelist;   /* List of free actions */
+  int nActionSeq;          /* Number of actions created */
+  int setSize;             /* Number of elements in every set */
+  char *zAppend;           /* String under construction by append_str() */
+  int nAppendAlloc;        /* Bytes allocated for zAppend[] */
+  int nAppendUsed;         /* Bytes of zAppend[] used */
+  double aPhase[PHASE_COUNT];  /* Milliseconds spent in each phase */
 };
 
-#define MemoryCheck(X) if((X)==0){ \
-  extern void memory_error(); \
-  memory_error(); \
-}
+/* When the parser generator runs as a library, each of its outputs is
+** captured in memory by one of the following, instead of being written
+** to a file or to the terminal.  The MEMFILE_ macros are indexes into
+** the lemp->aMemfile[] array.
+*/
+struct memfile {
+  FILE *fp;                /* Stream being written, or NULL when closed */
+  char *z;                 /* Text written.  Obtained from malloc() */
+  size_t n;                /* Number of bytes in z[] */
+};
+#define MEMFILE_SOURCE  0  /* The parser, "*.c" */
+#define MEMFILE_HEADER  1  /* Token codes, "*.h" */
+#define MEMFILE_REPORT  2  /* The report, "*.out" */
+#define MEMFILE_SQL     3  /* The tables in SQL, "*.sql" */
+#define MEMFILE_OUTPUT  4  /* Text the CLI writes to stdout */
+#define MEMFILE_ERRORS  5  /* Text the CLI writes to stderr */
+#define MEMFILE_TABLES  6  /* The binary tables of -B, "*.tbl" */
+#define MEMFILE_COUNT   7
 
 /**************** From the file "table.h" *********************************/
 /*
@@ -448,38 +747,42 @@ struct lemon {
 */
 /* Routines for handling a strings */
 
-const char *Strsafe(const char *);
+const char *Strsafe(struct lemon *, const char *);
+const char *Strsafe_n(struct lemon *, const char *, int);
 
-void Strsafe_init(void);
-int Strsafe_insert(const char *);
-const char *Strsafe_find(const char *);
+void Strsafe_init(struct lemon *);
+int Strsafe_insert(struct lemon *, const char *);
+const char *Strsafe_find(struct lemon *, const char *);
 
 /* Routines for handling symbols of the grammar */
 
-struct symbol *Symbol_new(const char *);
+struct symbol *Symbol_new(struct lemon *, const char *);
 int Symbolcmpp(const void *, const void *);
-void Symbol_init(void);
-int Symbol_insert(struct symbol *, const char *);
-struct symbol *Symbol_find(const char *);
-struct symbol *Symbol_Nth(int);
-int Symbol_count(void);
-struct symbol **Symbol_arrayof(void);
+void Symbol_init(struct lemon *);
+int Symbol_insert(struct lemon *, struct symbol *, const char *);
+struct symbol *Symbol_find(struct lemon *, const char *);
+struct symbol *Symbol_Nth(struct lemon *, int);
+int Symbol_count(struct lemon *);
+struct symbol **Symbol_arrayof(struct lemon *);
 
 /* Routines to manage the state table */
 
 int Configcmp(const char *, const char *);
-struct state *State_new(void);
-void State_init(void);
-int State_insert(struct state *, struct config *);
-struct state *State_find(struct config *);
-struct state **State_arrayof(void);
+struct state *State_new(struct lemon *);
+void State_init(struct lemon *);
+int State_insert(struct lemon *, struct state *, struct config *);
+struct state *State_find(struct lemon *, struct config *);
+struct state **State_arrayof(struct lemon *);
 
 /* Routines used for efficiency in Configlist_add */
 
-void Configtable_init(void);
-int Configtable_insert(struct config *);
-struct config *Configtable_find(struct config *);
-void Configtable_clear(int(*)(struct config *));
+void Configtable_init(struct lemon *);
+int Configtable_insert(struct lemon *, struct config *);
+struct config *Configtable_find(struct lemon *, struct config *);
+void Configtable_clear(struct lemon *, int(*)(struct config *));
+
+/****************** From the file "watch.h" ********************************/
+int lemon_watch(struct lemon *);
 
 /****************** From the file "action.c" *******************************/
 /*
@@ -487,23 +790,21 @@ void Configtable_clear(int(*)(struct config *));
 */
 
 /* Allocate a new parser action */
-static struct action *Action_new(void){
-  static struct action *actionfreelist = 0;
+static struct action *Action_new(struct lemon *lemp){
   struct action *newaction;
 
-  if( actionfreelist==0 ){
+  if( lemp->actionFreelist==0 ){
     int i;
     int amt = 100;
-    actionfreelist = (struct action *)calloc(amt, sizeof(struct action));
-    if( actionfreelist==0 ){
-      fprintf(stderr,"Unable to allocate memory for a new parser action.");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) actionfreelist[i].next = &actionfreelist[i+1];
-    actionfreelist[amt-1].next = 0;
-  }
-  newaction = actionfreelist;
-  actionfreelist = actionfreelist->next;
+    struct action *a;
+    a = (struct action *)lemon_calloc(lemp, amt, sizeof(struct action));
+    for(i=0; i<amt-1; i++) a[i].next = &a[i+1];
+    a[amt-1].next = 0;
+    lemp->actionFreelist = a;
+  }
+  newaction = lemp->actionFreelist;
+  lemp->actionFreelist = newaction->next;
+  newaction->iSeq = lemp->nActionSeq++;
   return newaction;
 }
 
@@ -524,7 +825,7 @@ static int actioncmp(
     rc = ap1->x.rp->index - ap2->x.rp->index;
   }
   if( rc==0 ){
-    rc = (int) (ap2 - ap1);
+    rc = ap2->iSeq - ap1->iSeq;
   }
   return rc;
 }
@@ -539,13 +840,14 @@ static struct action *Action_sort(
 }
 
 void Action_add(
+  struct lemon *lemp,
   struct action **app,
   enum e_action type,
   struct symbol *sp,
   char *arg
 ){
   struct action *newaction;
-  newaction = Action_new();
+  newaction = Action_new(lemp);
   newaction->next = *app;
   *app = newaction;
   newaction->type = type;
@@ -600,6 +902,7 @@ struct acttab {
   int nLookaheadAlloc;         /* Slots allocated in aLookahead[] */
   int nterminal;               /* Number of terminal symbols */
   int nsymbol;                 /* total number of symbols */
+  struct lemon *lemp;          /* Owner of all memory used by this table */
 };
 
 /* Return the number of entries in the yy_action table */
@@ -613,21 +916,18 @@ struct acttab {
 
 /* Free all memory associated with the given acttab */
 void acttab_free(acttab *p){
-  free( p->aAction );
-  free( p->aLookahead );
-  free( p );
+  struct lemon *lemp = p->lemp;
+  lemon_free(lemp, p->aAction );
+  lemon_free(lemp, p->aLookahead );
+  lemon_free(lemp, p );
 }
 
 /* Allocate a new acttab structure */
-acttab *acttab_alloc(int nsymbol, int nterminal){
-  acttab *p = (acttab *) calloc( 1, sizeof(*p) );
-  if( p==0 ){
-    fprintf(stderr,"Unable to allocate memory for a new acttab.");
-    exit(1);
-  }
-  memset(p, 0, sizeof(*p));
+acttab *acttab_alloc(struct lemon *lemp, int nsymbol, int nterminal){
+  acttab *p = (acttab *) lemon_calloc(lemp, 1, sizeof(*p) );
   p->nsymbol = nsymbol;
   p->nterminal = nterminal;
+  p->lemp = lemp;
   return p;
 }
 
@@ -639,12 +939,8 @@ acttab *acttab_alloc(int nsymbol, int nterminal){
 void acttab_action(acttab *p, int lookahead, int action){
   if( p->nLookahead>=p->nLookaheadAlloc ){
     p->nLookaheadAlloc += 25;
-    p->aLookahead = (struct lookahead_action *) realloc( p->aLookahead,
-                             sizeof(p->aLookahead[0])*p->nLookaheadAlloc );
-    if( p->aLookahead==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
-    }
+    p->aLookahead = (struct lookahead_action *) lemon_realloc(p->lemp,
+             p->aLookahead, sizeof(p->aLookahead[0])*p->nLookaheadAlloc );
   }
   if( p->nLookahead==0 ){
     p->mxLookahead = lookahead;
@@ -689,12 +985,8 @@ int acttab_insert(acttab *p, int makeItSafe){
   if( p->nAction + n >= p->nActionAlloc ){
     int oldAlloc = p->nActionAlloc;
     p->nActionAlloc = p->nAction + n + p->nActionAlloc + 20;
-    p->aAction = (struct lookahead_action *) realloc( p->aAction,
-                          sizeof(p->aAction[0])*p->nActionAlloc);
-    if( p->aAction==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
-    }
+    p->aAction = (struct lookahead_action *) lemon_realloc(p->lemp,
+                          p->aAction, sizeof(p->aAction[0])*p->nActionAlloc);
     for(i=oldAlloc; i<p->nActionAlloc; i++){
       p->aAction[i].lookahead = -1;
       p->aAction[i].action = -1;
@@ -792,6 +1084,290 @@ int acttab_action_size(acttab *p){
   return n;
 }
 
+/********************** From the file "batch.c" *****************************/
+/*
+** Batch mode for the stand-alone program: generate parsers for many
+** grammars in a single invocation.  The grammars are named on the
+** command line or listed in a manifest file (-M), and are processed in
+** parallel by a pool of worker threads (-j).  Each grammar gets its own
+** struct lemon, so the runs share nothing but the command-line options.
+**
+** A manifest holds one grammar per line.  The first word is the name
+** of the grammar file.  It may be followed by -D, -d and -T options
+** that apply to that grammar only.  Blank lines and lines that begin
+** with '#' are ignored.
+*/
+#ifndef LEMON_NO_MAIN
+
+/* One grammar to be processed in batch mode */
+struct batch_job {
+  char *zFilename;         /* Name of the grammar file */
+  char **azDefine;         /* -D macros: the global ones, then our own */
+  int nDefine;             /* Number of entries in azDefine[] */
+  char *outputDir;         /* Output directory, or NULL */
+  char *templatename;      /* Template file, or NULL */
+  int rc;                  /* Exit code of the run */
+  int nError;              /* Number of errors */
+  int nConflict;           /* Number of parsing conflicts */
+  int nRule;               /* Number of rules in the grammar */
+  int nState;              /* Number of states in the parser */
+  int tablesize;           /* Size of the parser tables in bytes */
+  double rElapsed;         /* Milliseconds used to process this grammar */
+  struct memfile out;      /* Text the run wrote to stdout */
+  struct memfile err;      /* Text the run wrote to stderr */
+};
+
+/* The state shared by all worker threads */
+struct batch {
+  struct lemon *pProto;    /* Options common to every grammar */
+  struct batch_job *aJob;  /* All grammars */
+  int nJob;                /* Number of entries in aJob[] */
+  int iNext;               /* Index of the next job to start */
+#if BATCH_THREADS
+  pthread_mutex_t mutex;   /* Protects iNext */
+#endif
+};
+
+/* Report an out-of-memory condition while setting up the batch */
+static void batch_oom(void){
+  fprintf(stderr,"out of memory\n");
+  exit(1);
+}
+
+/* Process a single grammar.  Diagnostics are captured in memory so that
+** the output of concurrent runs is not interleaved.
+*/
+static void batch_run_one(struct batch *p, struct batch_job *pJob){
+  struct lemon lem;
+  double rStart = lemon_clock();
+
+  lem = *p->pProto;
+  lem.filename = pJob->zFilename;
+  lem.azDefine = pJob->azDefine;
+  lem.nDefine = pJob->nDefine;
+  lem.outputDir = pJob->outputDir;
+  lem.templatename = pJob->templatename;
+  lem.outstream = memfile_open(&pJob->out);
+  lem.errstream = memfile_open(&pJob->err);
+  if( lem.outstream==0 || lem.errstream==0 ){
+    pJob->rc = 1;
+    pJob->nError = 1;
+  }else{
+    pJob->rc = lemon_run(&lem);
+    pJob->nError = lem.errorcnt;
+    pJob->nConflict = lem.nconflict;
+    pJob->nRule = lem.nrule;
+    pJob->nState = lem.nxstate;
+    pJob->tablesize = lem.tablesize;
+  }
+  memfile_close(&pJob->out);
+  memfile_close(&pJob->err);
+  lemon_free_all(&lem);
+  pJob->rElapsed = lemon_clock() - rStart;
+}
+
+/* Body of each worker thread.  Keep taking the next unstarted grammar
+** until there are none left.
+*/
+static void *batch_worker(void *pArg){
+  struct batch *p = (struct batch*)pArg;
+  int i;
+  for(;;){
+#if BATCH_THREADS
+    pthread_mutex_lock(&p->mutex);
+#endif
+    i = p->iNext++;
+#if BATCH_THREADS
+    pthread_mutex_unlock(&p->mutex);
+#endif
+    if( i>=p->nJob ) break;
+    batch_run_one(p, &p->aJob[i]);
+  }
+  return 0;
+}
+
+/* Append a new job for grammar zFilename to the batch */
+static struct batch_job *batch_add(struct batch *p, char *zFilename){
+  struct batch_job *pJob;
+  struct lemon *pProto = p->pProto;
+  p->aJob = (struct batch_job*)realloc(p->aJob, sizeof(p->aJob[0])*(p->nJob+1));
+  if( p->aJob==0 ) batch_oom();
+  pJob = &p->aJob[p->nJob++];
+  memset(pJob, 0, sizeof(*pJob));
+  pJob->zFilename = zFilename;
+  pJob->nDefine = pProto->nDefine;
+  pJob->azDefine = (char**)malloc(sizeof(char*)*(pProto->nDefine+1));
+  if( pJob->azDefine==0 ) batch_oom();
+  if( pProto->nDefine ){
+    memcpy(pJob->azDefine, pProto->azDefine, sizeof(char*)*pProto->nDefine);
+  }
+  pJob->outputDir = pProto->outputDir;
+  pJob->templatename = pProto->templatename;
+  return pJob;
+}
+
+/* Read the manifest file zManifest and add a job for every grammar it
+** lists.  Return the number of errors seen.  The text of the manifest
+** is returned in *pzText, since the jobs point into it.
+*/
+static int batch_read_manifest(
+  struct batch *p,             /* Add jobs to this batch */
+  const char *zManifest,       /* Name of the manifest file */
+  char **pzText                /* OUT: Text of the manifest */
+){
+  FILE *in;
+  char *z;
+  long n;
+  int lineno = 0;
+  int nErr = 0;
+
+  in = fopen(zManifest, "rb");
+  if( in==0 ){
+    fprintf(stderr,"Can't open the manifest \"%s\".\n",zManifest);
+    return 1;
+  }
+  fseek(in,0,2);
+  n = ftell(in);
+  rewind(in);
+  z = (char*)malloc( n>0 ? n+1 : 1 );
+  if( z==0 ) batch_oom();
+  n = n>0 ? (long)fread(z, 1, (size_t)n, in) : 0;
+  z[n] = 0;
+  fclose(in);
+  *pzText = z;
+
+  while( *z ){
+    char *zEol = strchr(z, '\n');
+    struct batch_job *pJob = 0;
+    lineno++;
+    if( zEol ) *zEol = 0;
+    while( *z ){
+      char *zWord;
+      while( ISSPACE(*z) ) z++;
+      if( *z==0 || (*z=='#' && pJob==0) ) break;
+      zWord = z;
+      while( *z && !ISSPACE(*z) ) z++;
+      if( *z ) *(z++) = 0;
+      if( pJob==0 ){
+        pJob = batch_add(p, zWord);
+      }else if( zWord[0]=='-' && zWord[1]=='D' && zWord[2] ){
+        char *cp;
+        for(cp=zWord+2; *cp && *cp!='='; cp++){}
+        *cp = 0;
+        pJob->azDefine[pJob->nDefine++] = zWord+2;
+        pJob->azDefine = (char**)realloc(pJob->azDefine,
+                                     sizeof(char*)*(pJob->nDefine+1));
+        if( pJob->azDefine==0 ) batch_oom();
+      }else if( zWord[0]=='-' && zWord[1]=='d' && zWord[2] ){
+        pJob->outputDir = zWord+2;
+      }else if( zWord[0]=='-' && zWord[1]=='T' && zWord[2] ){
+        pJob->templatename = zWord+2;
+      }else{
+        fprintf(stderr,"%s:%d: Unknown option \"%s\".  Only -D, -d and -T "
+                "may be given for each grammar.\n", zManifest, lineno, zWord);
+        nErr++;
+      }
+    }
+    if( zEol==0 ) break;
+    z = zEol+1;
+  }
+  return nErr;
+}
+
+/* Generate parsers for every grammar in azFile[] and in the manifest
+** zManifest, using up to nThread threads.  pProto holds the options
+** given on the command line.  Write all diagnostics, in the order the
+** grammars were given, followed by a summary.  Return the exit code for
+** the program: 0 if every grammar succeeded.
+*/
+int lemon_batch(
+  struct lemon *pProto,        /* Options common to every grammar */
+  char **azFile,               /* Grammars named on the command line */
+  int nFile,                   /* Number of entries in azFile[] */
+  const char *zManifest,       /* Manifest file, or NULL */
+  int nThread                  /* Number of worker threads.  0 for auto */
+){
+  struct batch b;
+  char *zText = 0;
+  double rStart, rElapsed, rWork = 0.0;
+  int nFail = 0;
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  b.pProto = pProto;
+  for(i=0; i<nFile; i++) batch_add(&b, azFile[i]);
+  if( zManifest && batch_read_manifest(&b, zManifest, &zText) ){
+    exit(1);
+  }
+  if( b.nJob==0 ){
+    fprintf(stderr,"No grammars to process.\n");
+    exit(1);
+  }
+  if( nThread<=0 ){
+#if BATCH_THREADS && defined(_SC_NPROCESSORS_ONLN)
+    nThread = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if( nThread<=0 ) nThread = 1;
+  }
+  if( nThread>b.nJob ) nThread = b.nJob;
+
+  rStart = lemon_clock();
+#if BATCH_THREADS
+  if( nThread>1 ){
+    pthread_t *aThread = (pthread_t*)malloc(sizeof(pthread_t)*nThread);
+    int nStarted = 0;
+    if( aThread==0 ) batch_oom();
+    pthread_mutex_init(&b.mutex, 0);
+    for(i=1; i<nThread; i++){
+      if( pthread_create(&aThread[nStarted], 0, batch_worker, &b) ) break;
+      nStarted++;
+    }
+    batch_worker(&b);
+    for(i=0; i<nStarted; i++) pthread_join(aThread[i], 0);
+    pthread_mutex_destroy(&b.mutex);
+    free(aThread);
+    nThread = nStarted+1;
+  }else
+#else
+  nThread = 1;
+#endif
+  {
+    batch_worker(&b);
+  }
+  rElapsed = lemon_clock() - rStart;
+
+  /* Everything is finished.  Now show the results in order. */
+  for(i=0; i<b.nJob; i++){
+    struct batch_job *pJob = &b.aJob[i];
+    if( pJob->out.n ) fwrite(pJob->out.z, 1, pJob->out.n, stdout);
+    if( pJob->err.n ) fwrite(pJob->err.z, 1, pJob->err.n, stderr);
+    if( pJob->rc ){
+      fprintf(stderr,"%s: failed with %d errors and %d conflicts.\n",
+              pJob->zFilename, pJob->nError, pJob->nConflict);
+      nFail++;
+    }
+  }
+  fflush(stderr);
+  printf("Batch summary:\n");
+  printf("  %-30s %8s %6s %6s %9s %8s\n",
+         "grammar", "ms", "rules", "states", "conflicts", "bytes");
+  for(i=0; i<b.nJob; i++){
+    struct batch_job *pJob = &b.aJob[i];
+    printf("  %-30s %8.1f %6d %6d %9d %8d%s\n", pJob->zFilename,
+           pJob->rElapsed, pJob->nRule, pJob->nState, pJob->nConflict,
+           pJob->tablesize, pJob->rc ? "  FAILED" : "");
+    rWork += pJob->rElapsed;
+    free(pJob->azDefine);
+    free(pJob->out.z);
+    free(pJob->err.z);
+  }
+  printf("  %d grammars, %d failed, %d threads, %.1f ms elapsed, "
+         "%.1f ms of work\n", b.nJob, nFail, nThread, rElapsed, rWork);
+  free(b.aJob);
+  free(zText);
+  return nFail>0 ? 1 : 0;
+}
+#endif /* LEMON_NO_MAIN */
 /********************** From the file "build.c" *****************************/
 /*
 ** Routines to construction the finite state machine for the LEMON
@@ -846,7 +1422,7 @@ void FindFirstSets(struct lemon *lemp)
     lemp->symbols[i]->lambda = LEMON_FALSE;
   }
   for(i=lemp->nterminal; i<lemp->nsymbol; i++){
-    lemp->symbols[i]->firstset = SetNew();
+    lemp->symbols[i]->firstset = SetNew(lemp);
   }
 
   /* First compute all lambdas */
@@ -875,17 +1451,17 @@ void FindFirstSets(struct lemon *lemp)
       for(i=0; i<rp->nrhs; i++){
         s2 = rp->rhs[i];
         if( s2->type==TERMINAL ){
-          progress += SetAdd(s1->firstset,s2->index);
+          progress += SetAdd(lemp,s1->firstset,s2->index);
           break;
         }else if( s2->type==MULTITERMINAL ){
           for(j=0; j<s2->nsubsym; j++){
-            progress += SetAdd(s1->firstset,s2->subsym[j]->index);
+            progress += SetAdd(lemp,s1->firstset,s2->subsym[j]->index);
           }
           break;
         }else if( s1==s2 ){
           if( s1->lambda==LEMON_FALSE ) break;
         }else{
-          progress += SetUnion(s1->firstset,s2->firstset);
+          progress += SetUnion(lemp,s1->firstset,s2->firstset);
           if( s2->lambda==LEMON_FALSE ) break;
         }
       }
@@ -904,13 +1480,13 @@ void FindStates(struct lemon *lemp)
   struct symbol *sp;
   struct rule *rp;
 
-  Configlist_init();
+  Configlist_init(lemp);
 
   /* Find the start symbol */
   if( lemp->start ){
-    sp = Symbol_find(lemp->start);
+    sp = Symbol_find(lemp,lemp->start);
     if( sp==0 ){
-      ErrorMsg(lemp->filename,0,
+      ErrorMsg(lemp,lemp->filename,0,
         "The specified start symbol \"%s\" is not "
         "in a nonterminal of the grammar.  \"%s\" will be used as the start "
         "symbol instead.",lemp->start,lemp->startRule->lhs->name);
@@ -920,8 +1496,9 @@ void FindStates(struct lemon *lemp)
   }else if( lemp->startRule ){
     sp = lemp->startRule->lhs;
   }else{
-    ErrorMsg(lemp->filename,0,"Internal error - no start rule\n");
-    exit(1);
+    ErrorMsg(lemp,lemp->filename,0,"Internal error - no start rule\n");
+    lemon_fatal(lemp);
+    return;
   }
 
   /* Make sure the start symbol doesn't occur on the right-hand side of
@@ -931,7 +1508,7 @@ void FindStates(struct lemon *lemp)
     int i;
     for(i=0; i<rp->nrhs; i++){
       if( rp->rhs[i]==sp ){   /* FIX ME:  Deal with multiterminals */
-        ErrorMsg(lemp->filename,0,
+        ErrorMsg(lemp,lemp->filename,0,
           "The start symbol \"%s\" occurs on the "
           "right-hand side of a rule. This will result in a parser which "
           "does not work properly.",sp->name);
@@ -946,8 +1523,8 @@ void FindStates(struct lemon *lemp)
   for(rp=sp->rule; rp; rp=rp->nextlhs){
     struct config *newcfp;
     rp->lhsStart = 1;
-    newcfp = Configlist_addbasis(rp,0);
-    SetAdd(newcfp->fws,0);
+    newcfp = Configlist_addbasis(lemp,rp,0);
+    SetAdd(lemp,newcfp->fws,0);
   }
 
   /* Compute the first state.  All other states will be
@@ -968,11 +1545,11 @@ PRIVATE struct state *getstate(struct lemon *lemp)
 
   /* Extract the sorted basis of the new state.  The basis was constructed
   ** by prior calls to "Configlist_addbasis()". */
-  Configlist_sortbasis();
-  bp = Configlist_basis();
+  Configlist_sortbasis(lemp);
+  bp = Configlist_basis(lemp);
 
   /* Get a state with the same basis */
-  stp = State_find(bp);
+  stp = State_find(lemp,bp);
   if( stp ){
     /* A state with the same basis already exists!  Copy all the follow-set
     ** propagation links from the state under construction into the
@@ -980,23 +1557,23 @@ PRIVATE struct state *getstate(struct lemon *lemp)
     struct config *x, *y;
     for(x=bp, y=stp->bp; x && y; x=x->bp, y=y->bp){
       Plink_copy(&y->bplp,x->bplp);
-      Plink_delete(x->fplp);
+      Plink_delete(lemp,x->fplp);
       x->fplp = x->bplp = 0;
     }
-    cfp = Configlist_return();
-    Configlist_eat(cfp);
+    cfp = Configlist_return(lemp);
+    Configlist_eat(lemp,cfp);
   }else{
     /* This really is a new state.  Construct all the details */
     Configlist_closure(lemp);    /* Compute the configuration closure */
-    Configlist_sort();           /* Sort the configuration closure */
-    cfp = Configlist_return();   /* Get a pointer to the config list */
-    stp = State_new();           /* A new state structure */
-    MemoryCheck(stp);
+    Configlist_sort(lemp);           /* Sort the configuration closure */
+    cfp = Configlist_return(lemp);   /* Get a pointer to the config list */
+    stp = State_new(lemp);       /* A new state structure */
     stp->bp = bp;                /* Remember the configuration basis */
     stp->cfp = cfp;              /* Remember the configuration closure */
     stp->statenum = lemp->nstate++; /* Every state gets a sequence number */
+    stp->iOrigin = stp->statenum;
     stp->ap = 0;                 /* No actions, yet. */
-    State_insert(stp,stp->bp);   /* Add to the state table */
+    State_insert(lemp,stp,stp->bp);   /* Add to the state table */
     buildshifts(lemp,stp);       /* Recursively compute successor states */
   }
   return stp;
@@ -1038,7 +1615,7 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
   for(cfp=stp->cfp; cfp; cfp=cfp->next){
     if( cfp->status==COMPLETE ) continue;    /* Already used by inner loop */
     if( cfp->dot>=cfp->rp->nrhs ) continue;  /* Can't shift this config */
-    Configlist_reset();                      /* Reset the new config set */
+    Configlist_reset(lemp);                      /* Reset the new config set */
     sp = cfp->rp->rhs[cfp->dot];             /* Symbol after the dot */
 
     /* For every configuration in the state "stp" which has the symbol "sp"
@@ -1050,8 +1627,8 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
       bsp = bcfp->rp->rhs[bcfp->dot];           /* Get symbol after dot */
       if( !same_symbol(bsp,sp) ) continue;      /* Must be same as for "cfp" */
       bcfp->status = COMPLETE;                  /* Mark this config as used */
-      newcfg = Configlist_addbasis(bcfp->rp,bcfp->dot+1);
-      Plink_add(&newcfg->bplp,bcfp);
+      newcfg = Configlist_addbasis(lemp,bcfp->rp,bcfp->dot+1);
+      Plink_add(lemp,&newcfg->bplp,bcfp);
     }
 
     /* Get a pointer to the state described by the basis configuration set
@@ -1063,10 +1640,10 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
     if( sp->type==MULTITERMINAL ){
       int i;
       for(i=0; i<sp->nsubsym; i++){
-        Action_add(&stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
+        Action_add(lemp,&stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
       }
     }else{
-      Action_add(&stp->ap,SHIFT,sp,(char *)newstp);
+      Action_add(lemp,&stp->ap,SHIFT,sp,(char *)newstp);
     }
   }
 }
@@ -1098,7 +1675,7 @@ void FindLinks(struct lemon *lemp)
     for(cfp=stp?stp->cfp:0; cfp; cfp=cfp->next){
       for(plp=cfp->bplp; plp; plp=plp->next){
         other = plp->cfp;
-        Plink_add(&other->fplp,cfp);
+        Plink_add(lemp,&other->fplp,cfp);
       }
     }
   }
@@ -1131,7 +1708,7 @@ void FindFollowSets(struct lemon *lemp)
       for(cfp=lemp->sorted[i]->cfp; cfp; cfp=cfp->next){
         if( cfp->status==COMPLETE ) continue;
         for(plp=cfp->fplp; plp; plp=plp->next){
-          change = SetUnion(plp->cfp->fws,cfp->fws);
+          change = SetUnion(lemp,plp->cfp->fws,cfp->fws);
           if( change ){
             plp->cfp->status = INCOMPLETE;
             progress = 1;
@@ -1167,7 +1744,7 @@ void FindActions(struct lemon *lemp)
           if( SetFind(cfp->fws,j) ){
             /* Add a reduce action to the state "stp" which will reduce by the
             ** rule "cfp->rp" if the lookahead symbol is "lemp->symbols[j]" */
-            Action_add(&stp->ap,REDUCE,lemp->symbols[j],(char *)cfp->rp);
+            Action_add(lemp,&stp->ap,REDUCE,lemp->symbols[j],(char *)cfp->rp);
           }
         }
       }
@@ -1176,12 +1753,13 @@ void FindActions(struct lemon *lemp)
 
   /* Add the accepting token */
   if( lemp->start ){
-    sp = Symbol_find(lemp->start);
+    sp = Symbol_find(lemp,lemp->start);
     if( sp==0 ){
       if( lemp->startRule==0 ){
-        fprintf(stderr, "internal error on source line %d: no start rule\n",
+        fprintf(lemp->errstream,
+                "internal error on source line %d: no start rule\n",
                 __LINE__);
-        exit(1);
+        lemon_fatal(lemp);
       }
       sp = lemp->startRule->lhs;
     }
@@ -1191,7 +1769,7 @@ void FindActions(struct lemon *lemp)
   /* Add to the first state (which is always the starting state of the
   ** finite state machine) an action to ACCEPT if the lookahead is the
   ** start nonterminal.  */
-  Action_add(&lemp->sorted[0]->ap,ACCEPT,sp,0);
+  Action_add(lemp,&lemp->sorted[0]->ap,ACCEPT,sp,0);
 
   /* Resolve conflicts */
   for(i=0; i<lemp->nstate; i++){
@@ -1218,7 +1796,8 @@ void FindActions(struct lemon *lemp)
   }
   for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->canReduce ) continue;
-    ErrorMsg(lemp->filename,rp->ruleline,"This rule can not be reduced.\n");
+    ErrorMsg(lemp,rp->filename,rp->ruleline,
+             "This rule can not be reduced.\n");
     lemp->errorcnt++;
   }
 }
@@ -1303,95 +1882,109 @@ static int resolve_conflict(
 ** in the LEMON parser generator.
 */
 
-static struct config *freelist = 0;      /* List of free configurations */
-static struct config *current = 0;       /* Top of list of configurations */
-static struct config **currentend = 0;   /* Last on list of configs */
-static struct config *basis = 0;         /* Top of list of basis configs */
-static struct config **basisend = 0;     /* End of list of basis configs */
+/* The list builder keeps its state in the following fields of
+** struct lemon:
+**
+**    configFreelist      List of free configurations
+**    configCurrent       Top of list of configurations
+**    configCurrentend    Last on list of configs
+**    configBasis         Top of list of basis configs
+**    configBasisend      End of list of basis configs
+*/
 
 /* Return a pointer to a new configuration */
-PRIVATE struct config *newconfig(void){
-  return (struct config*)calloc(1, sizeof(struct config));
+PRIVATE struct config *newconfig(struct lemon *lemp){
+  struct config *cfp = lemp->configFreelist;
+  if( cfp==0 ){
+    return (struct config*)lemon_calloc(lemp, 1, sizeof(struct config));
+  }
+  lemp->configFreelist = cfp->next;
+  memset(cfp, 0, sizeof(*cfp));
+  return cfp;
 }
 
 /* The configuration "old" is no longer used */
-PRIVATE void deleteconfig(struct config *old)
+PRIVATE void deleteconfig(struct lemon *lemp, struct config *old)
 {
-  old->next = freelist;
-  freelist = old;
+  old->next = lemp->configFreelist;
+  lemp->configFreelist = old;
 }
 
 /* Initialized the configuration list builder */
-void Configlist_init(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
-  Configtable_init();
+void Configlist_init(struct lemon *lemp){
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = &lemp->configCurrent;
+  lemp->configBasis = 0;
+  lemp->configBasisend = &lemp->configBasis;
+  Configtable_init(lemp);
   return;
 }
 
 /* Initialized the configuration list builder */
-void Configlist_reset(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
-  Configtable_clear(0);
+void Configlist_reset(struct lemon *lemp){
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = &lemp->configCurrent;
+  lemp->configBasis = 0;
+  lemp->configBasisend = &lemp->configBasis;
+  Configtable_clear(lemp,0);
   return;
 }
 
 /* Add another configuration to the configuration list */
 struct config *Configlist_add(
+  struct lemon *lemp, /* The parser generator */
   struct rule *rp,    /* The rule */
   int dot             /* Index into the RHS of the rule where the dot goes */
 ){
   struct config *cfp, model;
 
-  assert( currentend!=0 );
+  assert( lemp->configCurrentend!=0 );
   model.rp = rp;
   model.dot = dot;
-  cfp = Configtable_find(&model);
+  cfp = Configtable_find(lemp,&model);
   if( cfp==0 ){
-    cfp = newconfig();
+    cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew();
+    cfp->fws = SetNew(lemp);
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
-    Configtable_insert(cfp);
+    *lemp->configCurrentend = cfp;
+    lemp->configCurrentend = &cfp->next;
+    Configtable_insert(lemp,cfp);
   }
   return cfp;
 }
 
 /* Add a basis configuration to the configuration list */
-struct config *Configlist_addbasis(struct rule *rp, int dot)
-{
+struct config *Configlist_addbasis(
+  struct lemon *lemp, /* The parser generator */
+  struct rule *rp,    /* The rule */
+  int dot             /* Index into the RHS of the rule where the dot goes */
+){
   struct config *cfp, model;
 
-  assert( basisend!=0 );
-  assert( currentend!=0 );
+  assert( lemp->configBasisend!=0 );
+  assert( lemp->configCurrentend!=0 );
   model.rp = rp;
   model.dot = dot;
-  cfp = Configtable_find(&model);
+  cfp = Configtable_find(lemp,&model);
   if( cfp==0 ){
-    cfp = newconfig();
+    cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew();
+    cfp->fws = SetNew(lemp);
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
-    *basisend = cfp;
-    basisend = &cfp->bp;
-    Configtable_insert(cfp);
+    *lemp->configCurrentend = cfp;
+    lemp->configCurrentend = &cfp->next;
+    *lemp->configBasisend = cfp;
+    lemp->configBasisend = &cfp->bp;
+    Configtable_insert(lemp,cfp);
   }
   return cfp;
 }
@@ -1404,37 +1997,37 @@ void Configlist_closure(struct lemon *lemp)
   struct symbol *sp, *xsp;
   int i, dot;
 
-  assert( currentend!=0 );
-  for(cfp=current; cfp; cfp=cfp->next){
+  assert( lemp->configCurrentend!=0 );
+  for(cfp=lemp->configCurrent; cfp; cfp=cfp->next){
     rp = cfp->rp;
     dot = cfp->dot;
     if( dot>=rp->nrhs ) continue;
     sp = rp->rhs[dot];
     if( sp->type==NONTERMINAL ){
       if( sp->rule==0 && sp!=lemp->errsym ){
-        ErrorMsg(lemp->filename,rp->line,"Nonterminal \"%s\" has no rules.",
-          sp->name);
+        ErrorMsg(lemp,rp->filename,rp->line,
+          "Nonterminal \"%s\" has no rules.",sp->name);
         lemp->errorcnt++;
       }
       for(newrp=sp->rule; newrp; newrp=newrp->nextlhs){
-        newcfp = Configlist_add(newrp,0);
+        newcfp = Configlist_add(lemp,newrp,0);
         for(i=dot+1; i<rp->nrhs; i++){
           xsp = rp->rhs[i];
           if( xsp->type==TERMINAL ){
-            SetAdd(newcfp->fws,xsp->index);
+            SetAdd(lemp,newcfp->fws,xsp->index);
             break;
           }else if( xsp->type==MULTITERMINAL ){
             int k;
             for(k=0; k<xsp->nsubsym; k++){
-              SetAdd(newcfp->fws, xsp->subsym[k]->index);
+              SetAdd(lemp,newcfp->fws, xsp->subsym[k]->index);
             }
             break;
           }else{
-            SetUnion(newcfp->fws,xsp->firstset);
+            SetUnion(lemp,newcfp->fws,xsp->firstset);
             if( xsp->lambda==LEMON_FALSE ) break;
           }
         }
-        if( i==rp->nrhs ) Plink_add(&cfp->fplp,newcfp);
+        if( i==rp->nrhs ) Plink_add(lemp,&cfp->fplp,newcfp);
       }
     }
   }
@@ -1442,51 +2035,51 @@ void Configlist_closure(struct lemon *lemp)
 }
 
 /* Sort the configuration list */
-void Configlist_sort(void){
-  current = (struct config*)msort((char*)current,(char**)&(current->next),
-                                  Configcmp);
-  currentend = 0;
+void Configlist_sort(struct lemon *lemp){
+  lemp->configCurrent = (struct config*)msort((char*)lemp->configCurrent,
+                          (char**)&(lemp->configCurrent->next), Configcmp);
+  lemp->configCurrentend = 0;
   return;
 }
 
 /* Sort the basis configuration list */
-void Configlist_sortbasis(void){
-  basis = (struct config*)msort((char*)current,(char**)&(current->bp),
-                                Configcmp);
-  basisend = 0;
+void Configlist_sortbasis(struct lemon *lemp){
+  lemp->configBasis = (struct config*)msort((char*)lemp->configCurrent,
+                          (char**)&(lemp->configCurrent->bp), Configcmp);
+  lemp->configBasisend = 0;
   return;
 }
 
 /* Return a pointer to the head of the configuration list and
 ** reset the list */
-struct config *Configlist_return(void){
+struct config *Configlist_return(struct lemon *lemp){
   struct config *old;
-  old = current;
-  current = 0;
-  currentend = 0;
+  old = lemp->configCurrent;
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = 0;
   return old;
 }
 
 /* Return a pointer to the head of the configuration list and
 ** reset the list */
-struct config *Configlist_basis(void){
+struct config *Configlist_basis(struct lemon *lemp){
   struct config *old;
-  old = basis;
-  basis = 0;
-  basisend = 0;
+  old = lemp->configBasis;
+  lemp->configBasis = 0;
+  lemp->configBasisend = 0;
   return old;
 }
 
 /* Free all elements of the given configuration list */
-void Configlist_eat(struct config *cfp)
+void Configlist_eat(struct lemon *lemp, struct config *cfp)
 {
   struct config *nextcfp;
   for(; cfp; cfp=nextcfp){
     nextcfp = cfp->next;
     assert( cfp->fplp==0 );
     assert( cfp->bplp==0 );
-    if( cfp->fws ) SetFree(cfp->fws);
-    deleteconfig(cfp);
+    if( cfp->fws ) SetFree(lemp,cfp->fws);
+    deleteconfig(lemp,cfp);
   }
   return;
 }
@@ -1495,72 +2088,26 @@ void Configlist_eat(struct config *cfp)
 ** Code for printing error message.
 */
 
-void ErrorMsg(const char *filename, int lineno, const char *format, ...){
+void ErrorMsg(
+  struct lemon *lemp,
+  const char *filename,
+  int lineno,
+  const char *format,
+  ...
+){
   va_list ap;
-  fprintf(stderr, "%s:%d: ", filename, lineno);
+  fprintf(lemp->errstream, "%s:%d: ", filename, lineno);
   va_start(ap, format);
-  vfprintf(stderr,format,ap);
+  vfprintf(lemp->errstream,format,ap);
   va_end(ap);
-  fprintf(stderr, "\n");
+  fprintf(lemp->errstream, "\n");
 }
-/**************** From the file "main.c" ************************************/
+/**************** From the file "liblemon.c" ********************************/
 /*
-** Main program file for the LEMON parser generator.
-*/
-
-/* Report an out-of-memory condition and abort.  This function
-** is used mostly by the "MemoryCheck" macro in struct.h
-*/
-void memory_error(void){
-  fprintf(stderr,"Out of memory.  Aborting...\n");
-  exit(1);
-}
-
-static int nDefine = 0;      /* Number of -D options on the command line */
-static char **azDefine = 0;  /* Name of the -D macros */
-
-/* This routine is called with the argument to each -D command-line option.
-** Add the macro defined to the azDefine array.
-*/
-static void handle_D_option(char *z){
-  char **paz;
-  nDefine++;
-  azDefine = (char **) realloc(azDefine, sizeof(azDefine[0])*nDefine);
-  if( azDefine==0 ){
-    fprintf(stderr,"out of memory\n");
-    exit(1);
-  }
-  paz = &azDefine[nDefine-1];
-  *paz = (char *) malloc( lemonStrlen(z)+1 );
-  if( *paz==0 ){
-    fprintf(stderr,"out of memory\n");
-    exit(1);
-  }
-  lemon_strcpy(*paz, z);
-  for(z=*paz; *z && *z!='='; z++){}
-  *z = 0;
-}
-
-/* Rember the name of the output directory
+** The LEMON parser generator as a library.  All state belongs to a
+** single "struct lemon", so independent runs of the generator can
+** proceed at the same time on separate threads.
 */
-static char *outputDir = NULL;
-static void handle_d_option(char *z){
-  outputDir = (char *) malloc( lemonStrlen(z)+1 );
-  if( outputDir==0 ){
-    fprintf(stderr,"out of memory\n");
-    exit(1);
-  }
-  lemon_strcpy(outputDir, z);
-}
-
-static char *user_templatename = NULL;
-static void handle_T_option(char *z){
-  user_templatename = (char *) malloc( lemonStrlen(z)+1 );
-  if( user_templatename==0 ){
-    memory_error();
-  }
-  lemon_strcpy(user_templatename, z);
-}
 
 /* Merge together to lists of rules ordered by rule.iRule */
 static struct rule *Rule_merge(struct rule *pA, struct rule *pB){
@@ -1615,195 +2162,751 @@ static const char *minimum_size_type(int lwr, int upr, int *pnByte);
 
 /* Print a single line of the "Parser Stats" output
 */
-static void stats_line(const char *zLabel, int iValue){
+static void stats_line(struct lemon *lemp, const char *zLabel, int iValue){
   int nLabel = lemonStrlen(zLabel);
-  printf("  %s%.*s %5d\n", zLabel,
+  fprintf(lemp->outstream, "  %s%.*s %5d\n", zLabel,
          35-nLabel, "................................",
          iValue);
 }
 
-/* The main program.  Parse the command line and do it... */
-int main(int argc, char **argv){
-  static int version = 0;
-  static int rpflag = 0;
-  static int basisflag = 0;
-  static int compress = 0;
-  static int quiet = 0;
-  static int statistics = 0;
-  static int mhflag = 0;
-  static int nolinenosflag = 0;
-  static int noResort = 0;
-  static int sqlFlag = 0;
-  static int printPP = 0;
+/* Return the time in milliseconds since some fixed point in the past */
+double lemon_clock(void){
+#if defined(CLOCK_MONOTONIC) && !defined(__WIN32__)
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000.0 + t.tv_nsec/1000000.0;
+#else
+  return clock()*1000.0/CLOCKS_PER_SEC;
+#endif
+}
 
-  static struct s_options options[] = {
-    {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
-    {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
-    {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
-    {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
-    {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
-    {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
-    {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
-    {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
-    {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
-    {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
-    {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
-    {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
-                    "Show conflicts resolved by precedence rules"},
-    {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
-    {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
-    {OPT_FLAG, "s", (char*)&statistics,
-                                   "Print parser stats to standard output."},
-    {OPT_FLAG, "S", (char*)&sqlFlag,
-                    "Generate the *.sql file describing the parser tables."},
-    {OPT_FLAG, "x", (char*)&version, "Print the version number."},
-    {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
-    {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
-    {OPT_FLAG,0,0,0}
-  };
+/* Parse the grammar and compute the parser tables, on a struct lemon
+** whose options, filename and output streams have already been filled
+** in.  Return -1 if the outputs should be generated next by a call to
+** lemon_report().  Otherwise there is nothing more to do, because of
+** errors or because only -E or -g output was requested, and the return
+** value is the exit code for the stand-alone program.
+*/
+int lemon_analyze(struct lemon *lemp){
   int i;
-  int exitcode;
-  struct lemon lem;
   struct rule *rp;
-
-  (void)argc;
-  OptInit(argv,options,stderr);
-  if( version ){
-     printf("Lemon version 1.0\n");
-     exit(0);
-  }
-  if( OptNArgs()!=1 ){
-    fprintf(stderr,"Exactly one filename argument is required.\n");
-    exit(1);
-  }
-  memset(&lem, 0, sizeof(lem));
-  lem.errorcnt = 0;
+  double rStart = lemon_clock();
+  double rNow;
 
   /* Initialize the machine */
-  Strsafe_init();
-  Symbol_init();
-  State_init();
-  lem.argv0 = argv[0];
-  lem.filename = OptArg(0);
-  lem.basisflag = basisflag;
-  lem.nolinenosflag = nolinenosflag;
-  lem.printPreprocessed = printPP;
-  Symbol_new("$");
+  Strsafe_init(lemp);
+  Symbol_init(lemp);
+  State_init(lemp);
+  Symbol_new(lemp,"$");
 
   /* Parse the input file */
-  Parse(&lem);
-  if( lem.printPreprocessed || lem.errorcnt ) exit(lem.errorcnt);
-  if( lem.nrule==0 ){
-    fprintf(stderr,"Empty grammar.\n");
-    exit(1);
+  Parse(lemp);
+  rNow = lemon_clock();
+  lemp->aPhase[PHASE_PARSE] = rNow - rStart;
+  rStart = rNow;
+  if( lemp->printPreprocessed || lemp->errorcnt ) return lemp->errorcnt;
+  if( lemp->nrule==0 ){
+    fprintf(lemp->errstream,"%s: Empty grammar.\n", lemp->filename);
+    lemp->errorcnt++;
+    return 1;
   }
-  lem.errsym = Symbol_find("error");
+  lemp->errsym = Symbol_find(lemp,"error");
 
   /* Count and index the symbols of the grammar */
-  Symbol_new("{default}");
-  lem.nsymbol = Symbol_count();
-  lem.symbols = Symbol_arrayof();
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  qsort(lem.symbols,lem.nsymbol,sizeof(struct symbol*), Symbolcmpp);
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  while( lem.symbols[i-1]->type==MULTITERMINAL ){ i--; }
-  assert( strcmp(lem.symbols[i-1]->name,"{default}")==0 );
-  lem.nsymbol = i - 1;
-  for(i=1; ISUPPER(lem.symbols[i]->name[0]); i++);
-  lem.nterminal = i;
+  Symbol_new(lemp,"{default}");
+  lemp->nsymbol = Symbol_count(lemp);
+  lemp->symbols = Symbol_arrayof(lemp);
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  qsort(lemp->symbols,lemp->nsymbol,sizeof(struct symbol*), Symbolcmpp);
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  while( lemp->symbols[i-1]->type==MULTITERMINAL ){ i--; }
+  assert( strcmp(lemp->symbols[i-1]->name,"{default}")==0 );
+  lemp->nsymbol = i - 1;
+  for(i=1; ISUPPER(lemp->symbols[i]->name[0]); i++);
+  lemp->nterminal = i;
 
   /* Assign sequential rule numbers.  Start with 0.  Put rules that have no
   ** reduce action C-code associated with them last, so that the switch()
   ** statement that selects reduction actions will have a smaller jump table.
   */
-  for(i=0, rp=lem.rule; rp; rp=rp->next){
+  for(i=0, rp=lemp->rule; rp; rp=rp->next){
     rp->iRule = rp->code ? i++ : -1;
   }
-  lem.nruleWithAction = i;
-  for(rp=lem.rule; rp; rp=rp->next){
+  lemp->nruleWithAction = i;
+  for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->iRule<0 ) rp->iRule = i++;
   }
-  lem.startRule = lem.rule;
-  lem.rule = Rule_sort(lem.rule);
+  /* The default start symbol is the left-hand side of the first rule
+  ** of the main grammar file, not of a module that it imports first */
+  if( lemp->startRule==0 ) lemp->startRule = lemp->rule;
+  lemp->rule = Rule_sort(lemp->rule);
 
   /* Generate a reprint of the grammar, if requested on the command line */
-  if( rpflag ){
-    Reprint(&lem);
-  }else{
-    /* Initialize the size for all follow and first sets */
-    SetSize(lem.nterminal+1);
+  if( lemp->rpflag ){
+    Reprint(lemp);
+    return lemon_report(lemp);
+  }
+
+  /* Initialize the size for all follow and first sets */
+  SetSize(lemp,lemp->nterminal+1);
 
-    /* Find the precedence for every production rule (that has one) */
-    FindRulePrecedences(&lem);
+  /* Find the precedence for every production rule (that has one) */
+  FindRulePrecedences(lemp);
 
-    /* Compute the lambda-nonterminals and the first-sets for every
-    ** nonterminal */
-    FindFirstSets(&lem);
+  /* Compute the lambda-nonterminals and the first-sets for every
+  ** nonterminal */
+  FindFirstSets(lemp);
 
-    /* Compute all LR(0) states.  Also record follow-set propagation
-    ** links so that the follow-set can be computed later */
-    lem.nstate = 0;
-    FindStates(&lem);
-    lem.sorted = State_arrayof();
+  /* Compute all LR(0) states.  Also record follow-set propagation
+  ** links so that the follow-set can be computed later */
+  lemp->nstate = 0;
+  FindStates(lemp);
+  lemp->sorted = State_arrayof(lemp);
 
-    /* Tie up loose ends on the propagation links */
-    FindLinks(&lem);
+  /* Tie up loose ends on the propagation links */
+  FindLinks(lemp);
 
-    /* Compute the follow set of every reducible configuration */
-    FindFollowSets(&lem);
+  /* Compute the follow set of every reducible configuration */
+  FindFollowSets(lemp);
 
-    /* Compute the action tables */
-    FindActions(&lem);
+  /* Compute the action tables */
+  FindActions(lemp);
+  rNow = lemon_clock();
+  lemp->aPhase[PHASE_ANALYZE] = rNow - rStart;
+  rStart = rNow;
 
-    /* Compress the action tables */
-    if( compress==0 ) CompressTables(&lem);
+  /* Compress the action tables */
+  if( lemp->noCompress==0 ) CompressTables(lemp);
 
-    /* Reorder and renumber the states so that states with fewer choices
-    ** occur at the end.  This is an optimization that helps make the
-    ** generated parser tables smaller. */
-    if( noResort==0 ) ResortStates(&lem);
+  /* Resolve %fallback and %wildcard in the tables, if asked to */
+  if( lemp->foldFallback ) FoldFallbacks(lemp);
+
+  /* Count the look-ups of each state in a profile of the parser */
+  if( lemp->zProfile ){
+    ReadProfile(lemp);
+    if( lemp->errorcnt ) return 1;
+  }
+
+  /* Reorder and renumber the states so that states with fewer choices
+  ** occur at the end.  This is an optimization that helps make the
+  ** generated parser tables smaller.  With a profile, the states that
+  ** are looked up most come first instead. */
+  if( lemp->noResort==0 ) ResortStates(lemp);
+  lemp->aPhase[PHASE_COMPRESS] = lemon_clock() - rStart;
+  return -1;
+}
+
+/* Generate the outputs of a grammar that lemon_analyze() has processed,
+** and show the statistics.  Return the exit code for the stand-alone
+** program.
+*/
+int lemon_report(struct lemon *lemp){
+  if( !lemp->rpflag ){
+    double rStart = lemon_clock();
+    double rNow;
 
     /* Generate a report of the parser generated.  (the "y.output" file) */
-    if( !quiet ) ReportOutput(&lem);
+    if( lemp->quiet ){
+      /* No report */
+    }else if( lemp->jsonReport ){
+      ReportJson(lemp);
+    }else{
+      ReportOutput(lemp);
+    }
+    rNow = lemon_clock();
+    lemp->aPhase[PHASE_REPORT] = rNow - rStart;
+    rStart = rNow;
 
     /* Generate the source code for the parser */
-    ReportTable(&lem, mhflag, sqlFlag);
+    ReportTable(lemp);
+    if( lemp->sizeReport && lemp->errorcnt==0 ) ReportSizes(lemp);
+    rNow = lemon_clock();
+    lemp->aPhase[PHASE_TABLES] = rNow - rStart;
+    rStart = rNow;
 
     /* Produce a header file for use by the scanner.  (This step is
     ** omitted if the "-m" option is used because makeheaders will
     ** generate the file for us.) */
-    if( !mhflag ) ReportHeader(&lem);
+    if( !lemp->mhflag ) ReportHeader(lemp);
+    lemp->aPhase[PHASE_HEADER] = lemon_clock() - rStart;
   }
-  if( statistics ){
-    printf("Parser statistics:\n");
-    stats_line("terminal symbols", lem.nterminal);
-    stats_line("non-terminal symbols", lem.nsymbol - lem.nterminal);
-    stats_line("total symbols", lem.nsymbol);
-    stats_line("rules", lem.nrule);
-    stats_line("states", lem.nxstate);
-    stats_line("conflicts", lem.nconflict);
-    stats_line("action table entries", lem.nactiontab);
-    stats_line("lookahead table entries", lem.nlookaheadtab);
-    stats_line("total table size (bytes)", lem.tablesize);
+  if( lemp->statistics ){
+    fprintf(lemp->outstream, "Parser statistics:\n");
+    stats_line(lemp, "terminal symbols", lemp->nterminal);
+    stats_line(lemp, "non-terminal symbols", lemp->nsymbol - lemp->nterminal);
+    stats_line(lemp, "total symbols", lemp->nsymbol);
+    stats_line(lemp, "rules", lemp->nrule);
+    stats_line(lemp, "states", lemp->nxstate);
+    stats_line(lemp, "conflicts", lemp->nconflict);
+    if( lemp->zProfile ){
+      stats_line(lemp, "states in the profile", lemp->nprofiled);
+      stats_line(lemp, "rules in cold functions", lemp->ncold);
+    }
+    stats_line(lemp, "action table entries", lemp->nactiontab);
+    stats_line(lemp, "lookahead table entries", lemp->nlookaheadtab);
+    stats_line(lemp, "total table size (bytes)", lemp->tablesize);
+    if( lemp->szEntry>0 ){
+      stats_line(lemp, "stack entry size (bytes)", lemp->szEntry);
+    }
+    if( lemp->boxSize && lemp->szEntryUnboxed>0 ){
+      stats_line(lemp, "stack entry size without -Z", lemp->szEntryUnboxed);
+    }
+    if( !lemp->rpflag ){
+      stats_line(lemp, "tokens shifted without a value", lemp->nTokenNoValue);
+      stats_line(lemp, "LHS values written in place", lemp->nLhsInPlace);
+      stats_line(lemp, "LHS values copied", lemp->nLhsCopy);
+    }
   }
-  if( lem.nconflict > 0 ){
-    fprintf(stderr,"%d parsing conflicts.\n",lem.nconflict);
+  if( lemp->nconflict > 0 ){
+    fprintf(lemp->errstream,"%d parsing conflicts.\n",lemp->nconflict);
   }
 
   /* return 0 on success, 1 on failure. */
-  exitcode = ((lem.errorcnt > 0) || (lem.nconflict > 0)) ? 1 : 0;
-  exit(exitcode);
-  return (exitcode);
+  return ((lemp->errorcnt > 0) || (lemp->nconflict > 0)) ? 1 : 0;
 }
-/******************** From the file "msort.c" *******************************/
-/*
-** A generic merge-sort program.
-**
-** USAGE:
-** Let "ptr" be a pointer to some structure which is at the head of
-** a null-terminated list.  Then to sort the list call:
-**
-**     ptr = msort(ptr,&(ptr->next),cmpfnc);
+
+/* Run every step of the parser generator */
+static int lemon_steps(struct lemon *lemp){
+  int rc;
+  if( lemp->zQuery ) return ReportQuery(lemp);
+  rc = lemon_analyze(lemp);
+  if( rc<0 ) rc = lemon_report(lemp);
+  return rc;
+}
+
+/* Call xStep(lemp).  A fatal error, such as running out of memory,
+** unwinds back to here and the step fails with exit code 1.  Memory is
+** not released.  That is left to lemon_free_all().
+*/
+int lemon_protect(struct lemon *lemp, int (*xStep)(struct lemon*)){
+  jmp_buf env;
+  int rc;
+  lemp->pAbort = &env;
+  if( setjmp(env)==0 ){
+    rc = xStep(lemp);
+  }else{
+    rc = 1;
+  }
+  file_close_all(lemp);
+  lemp->pAbort = 0;
+  return rc;
+}
+
+/* Run the parser generator */
+int lemon_run(struct lemon *lemp){
+  return lemon_protect(lemp, lemon_steps);
+}
+
+/* Generate a parser from the options in *pOpt, capturing every output
+** in memory.  See liblemon.h for details.
+*/
+int lemon_generate(
+  const struct lemon_options *pOpt,    /* What to generate */
+  struct lemon_result *pResult         /* OUT: The generated text */
+){
+  struct lemon lem;
+  struct memfile aFile[MEMFILE_COUNT];
+  int rc;
+  int i;
+
+  memset(pResult, 0, sizeof(*pResult));
+  memset(aFile, 0, sizeof(aFile));
+  memset(&lem, 0, sizeof(lem));
+  lem.filename = (char*)(pOpt->zFilename ? pOpt->zFilename : "grammar.y");
+  lem.zGrammar = pOpt->zGrammar;
+  lem.nGrammar = pOpt->nGrammar;
+  lem.zTemplate = pOpt->zTemplate;
+  lem.nTemplate = pOpt->nTemplate;
+  lem.templatename = (char*)pOpt->zTemplateFile;
+  lem.azDefine = (char**)pOpt->azDefine;
+  lem.nDefine = pOpt->nDefine;
+  lem.basisflag = pOpt->basisflag;
+  lem.noCompress = pOpt->noCompress;
+  lem.printPreprocessed = pOpt->printPreprocessed;
+  lem.rpflag = pOpt->rpflag;
+  lem.nolinenosflag = pOpt->nolinenosflag;
+  lem.mhflag = pOpt->mhflag;
+  lem.showPrecedenceConflict = pOpt->showPrecedenceConflict;
+  lem.quiet = pOpt->quiet;
+  lem.noResort = pOpt->noResort;
+  lem.statistics = pOpt->statistics;
+  lem.sqlFlag = pOpt->sqlFlag;
+  lem.jsonReport = pOpt->jsonReport;
+  lem.sizeReport = pOpt->sizeReport;
+  lem.foldFallback = pOpt->foldFallback;
+  lem.zQuery = pOpt->zQuery;
+  lem.encoding = encoding_find(pOpt->zEncoding ? pOpt->zEncoding : "comb");
+  lem.dispatch = dispatch_find(pOpt->zDispatch ? pOpt->zDispatch : "switch");
+  lem.zProfile = pOpt->zProfile;
+  lem.blobTables = pOpt->blobTables;
+  lem.sharedEngine = pOpt->sharedEngine;
+  lem.stackArrays = pOpt->stackArrays;
+  lem.boxSize = pOpt->boxSize;
+  lem.aMemfile = aFile;
+  lem.outstream = memfile_open(&aFile[MEMFILE_OUTPUT]);
+  lem.errstream = memfile_open(&aFile[MEMFILE_ERRORS]);
+  if( lem.outstream==0 || lem.errstream==0 ){
+    rc = -1;
+  }else if( lem.encoding<0 ){
+    fprintf(lem.errstream,"Unknown table encoding \"%s\".\n",
+            pOpt->zEncoding);
+    lem.errorcnt++;
+    rc = 1;
+  }else if( lem.dispatch<0 ){
+    fprintf(lem.errstream,"Unknown reduce dispatch \"%s\".\n",
+            pOpt->zDispatch);
+    lem.errorcnt++;
+    rc = 1;
+  }else{
+    rc = lemon_run(&lem);
+  }
+  for(i=0; i<MEMFILE_COUNT; i++) memfile_close(&aFile[i]);
+  lemon_free_all(&lem);
+
+  pResult->zSource = aFile[MEMFILE_SOURCE].z;
+  pResult->nSource = aFile[MEMFILE_SOURCE].n;
+  pResult->zHeader = aFile[MEMFILE_HEADER].z;
+  pResult->nHeader = aFile[MEMFILE_HEADER].n;
+  pResult->zReport = aFile[MEMFILE_REPORT].z;
+  pResult->nReport = aFile[MEMFILE_REPORT].n;
+  pResult->zSql = aFile[MEMFILE_SQL].z;
+  pResult->nSql = aFile[MEMFILE_SQL].n;
+  pResult->zTables = aFile[MEMFILE_TABLES].z;
+  pResult->nTables = aFile[MEMFILE_TABLES].n;
+  pResult->zOutput = aFile[MEMFILE_OUTPUT].z;
+  pResult->nOutput = aFile[MEMFILE_OUTPUT].n;
+  pResult->zErrors = aFile[MEMFILE_ERRORS].z;
+  pResult->nErrors = aFile[MEMFILE_ERRORS].n;
+  pResult->nError = lem.errorcnt;
+  pResult->nConflict = lem.nconflict;
+  return rc;
+}
+
+/* Release the buffers of a struct lemon_result */
+void lemon_result_free(struct lemon_result *pResult){
+  free(pResult->zSource);
+  free(pResult->zHeader);
+  free(pResult->zReport);
+  free(pResult->zSql);
+  free(pResult->zTables);
+  free(pResult->zOutput);
+  free(pResult->zErrors);
+  memset(pResult, 0, sizeof(*pResult));
+}
+/**************** From the file "main.c" ************************************/
+/*
+** Main program file for the LEMON parser generator.  Define
+** LEMON_NO_MAIN to omit it and use the library interface instead.
+*/
+#ifndef LEMON_NO_MAIN
+
+static int nDefine = 0;      /* Number of -D options on the command line */
+static char **azDefine = 0;  /* Name of the -D macros */
+
+/* This routine is called with the argument to each -D command-line option.
+** Add the macro defined to the azDefine array.
+*/
+static void handle_D_option(char *z){
+  char **paz;
+  nDefine++;
+  azDefine = (char **) realloc(azDefine, sizeof(azDefine[0])*nDefine);
+  if( azDefine==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  paz = &azDefine[nDefine-1];
+  *paz = (char *) malloc( lemonStrlen(z)+1 );
+  if( *paz==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  lemon_strcpy(*paz, z);
+  for(z=*paz; *z && *z!='='; z++){}
+  *z = 0;
+}
+
+/* Rember the name of the output directory
+*/
+static char *outputDir = NULL;
+static void handle_d_option(char *z){
+  outputDir = (char *) malloc( lemonStrlen(z)+1 );
+  if( outputDir==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  lemon_strcpy(outputDir, z);
+}
+
+/* Remember the name of the manifest of grammars for batch mode
+*/
+static char *zManifest = NULL;
+static void handle_M_option(char *z){
+  zManifest = z;
+}
+
+/* Remember how many threads to use in batch mode
+*/
+static int nThread = 0;
+static void handle_j_option(char *z){
+  nThread = atoi(z);
+  if( nThread<=0 ){
+    fprintf(stderr,"The -j option requires a positive number of threads.\n");
+    exit(1);
+  }
+}
+
+/* Remember the query for the JSON lines report
+*/
+static char *zQuery = NULL;
+static void handle_Q_option(char *z){
+  zQuery = z;
+}
+
+/* Remember the encoding of the parser tables
+*/
+static int encoding = ENC_COMB;
+static void handle_e_option(char *z){
+  encoding = encoding_find(z);
+  if( encoding<0 ){
+    fprintf(stderr,"Unknown table encoding \"%s\".  "
+                   "Use comb, dense, hash, code, pair or packed.\n", z);
+    exit(1);
+  }
+}
+
+/* Remember how yy_reduce() reaches the code of each rule
+*/
+static int dispatch = DSP_SWITCH;
+static void handle_R_option(char *z){
+  dispatch = dispatch_find(z);
+  if( dispatch<0 ){
+    fprintf(stderr,"Unknown reduce dispatch \"%s\".  "
+                   "Use switch, function or goto.\n", z);
+    exit(1);
+  }
+}
+
+/* Remember the profile that orders the states
+*/
+static char *zProfile = NULL;
+static void handle_P_option(char *z){
+  zProfile = z;
+}
+
+/* Remember how many translation units to split the parser into
+*/
+static int nUnit = 0;
+static void handle_u_option(char *z){
+  nUnit = atoi(z);
+  if( nUnit<=0 ){
+    fprintf(stderr,"The -u option requires a positive number of units.\n");
+    exit(1);
+  }
+}
+
+/* Remember the size above which values leave the stack
+*/
+static int boxSize = 0;
+static void handle_Z_option(char *z){
+  boxSize = atoi(z);
+  if( boxSize<=0 ){
+    fprintf(stderr,"The -Z option requires a positive number of bytes.\n");
+    exit(1);
+  }
+}
+
+static char *user_templatename = NULL;
+static void handle_T_option(char *z){
+  user_templatename = (char *) malloc( lemonStrlen(z)+1 );
+  if( user_templatename==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  lemon_strcpy(user_templatename, z);
+}
+
+/* The main program.  Parse the command line and do it... */
+int main(int argc, char **argv){
+  static int version = 0;
+  static int rpflag = 0;
+  static int basisflag = 0;
+  static int compress = 0;
+  static int quiet = 0;
+  static int statistics = 0;
+  static int mhflag = 0;
+  static int nolinenosflag = 0;
+  static int noResort = 0;
+  static int sqlFlag = 0;
+  static int printPP = 0;
+  static int showPrecedenceConflict = 0;
+  static int watch = 0;
+  static int jsonReport = 0;
+  static int sizeReport = 0;
+  static int foldFallback = 0;
+  static int blobTables = 0;
+  static int sharedEngine = 0;
+  static int stackArrays = 0;
+
+  static struct s_options options[] = {
+    {OPT_FLAG, "A", (char*)&stackArrays,
+      "Keep the states and the values of the stack in separate arrays."},
+    {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
+    {OPT_FLAG, "B", (char*)&blobTables,
+                    "Write the tables to a binary file (*.tbl)."},
+    {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
+    {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
+    {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
+    {OPT_FSTR, "e", (char*)handle_e_option,
+                    "Table encoding: comb, dense, hash, code, pair or "
+                    "packed.  Default comb"},
+    {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
+    {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
+    {OPT_FLAG, "F", (char*)&foldFallback,
+                    "Fold %fallback and %wildcard into the tables."},
+    {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
+    {OPT_FLAG, "G", (char*)&sharedEngine,
+                    "Leave the parser driver to the shared lemengine.c."},
+    {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
+    {OPT_FLAG, "J", (char*)&jsonReport,
+                    "Write the report as JSON lines (*.jsonl)."},
+    {OPT_FSTR, "j", (char*)handle_j_option,
+                    "Threads for batch mode.  Default: one per CPU"},
+    {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
+    {OPT_FSTR, "M", (char*)handle_M_option,
+                    "Batch mode: read grammars from a manifest file."},
+    {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
+    {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
+    {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
+                    "Show conflicts resolved by precedence rules"},
+    {OPT_FSTR, "P", (char*)handle_P_option,
+                    "Order states and tables by a ParseProfile() file."},
+    {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
+    {OPT_FSTR, "Q", (char*)handle_Q_option,
+                    "Query the *.jsonl report.  Try -Qstate=N"},
+    {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
+    {OPT_FSTR, "R", (char*)handle_R_option,
+                    "Reduce dispatch: switch, function or goto.  "
+                    "Default switch"},
+    {OPT_FLAG, "s", (char*)&statistics,
+                                   "Print parser stats to standard output."},
+    {OPT_FLAG, "S", (char*)&sqlFlag,
+                    "Generate the *.sql file describing the parser tables."},
+    {OPT_FLAG, "x", (char*)&version, "Print the version number."},
+    {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
+    {OPT_FSTR, "u", (char*)handle_u_option,
+                    "Split the parser into this many source files."},
+    {OPT_FLAG, "w", (char*)&watch, "Watch the input and rebuild on changes."},
+    {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
+    {OPT_FLAG, "z", (char*)&sizeReport,
+                    "Show what contributes to the size of the tables."},
+    {OPT_FSTR, "Z", (char*)handle_Z_option,
+                    "Keep values of types over this many bytes out of "
+                    "the stack."},
+    {OPT_FLAG,0,0,0}
+  };
+  int exitcode;
+  struct lemon lem;
+
+  (void)argc;
+  OptInit(argv,options,stderr);
+  if( version ){
+     printf("Lemon version 1.0\n");
+     exit(0);
+  }
+  memset(&lem, 0, sizeof(lem));
+  lem.errorcnt = 0;
+  lem.argv0 = argv[0];
+  lem.basisflag = basisflag;
+  lem.nolinenosflag = nolinenosflag;
+  lem.printPreprocessed = printPP;
+  lem.rpflag = rpflag;
+  lem.noCompress = compress;
+  lem.noResort = noResort;
+  lem.quiet = quiet;
+  lem.mhflag = mhflag;
+  lem.sqlFlag = sqlFlag;
+  lem.jsonReport = jsonReport;
+  lem.sizeReport = sizeReport;
+  lem.foldFallback = foldFallback;
+  lem.nUnit = nUnit;
+  lem.encoding = encoding;
+  lem.dispatch = dispatch;
+  lem.zProfile = zProfile;
+  lem.blobTables = blobTables;
+  lem.sharedEngine = sharedEngine;
+  lem.stackArrays = stackArrays;
+  lem.boxSize = boxSize;
+  lem.zQuery = zQuery;
+  lem.statistics = statistics;
+  lem.showPrecedenceConflict = showPrecedenceConflict;
+  lem.nDefine = nDefine;
+  lem.azDefine = azDefine;
+  lem.outputDir = outputDir;
+  lem.templatename = user_templatename;
+  lem.outstream = stdout;
+  lem.errstream = stderr;
+
+  if( watch && (zManifest || OptNArgs()!=1) ){
+    fprintf(stderr,"Watch mode requires exactly one filename argument.\n");
+    exit(1);
+  }
+  if( watch && nUnit>1 ){
+    fprintf(stderr,"The -u option cannot be used in watch mode.\n");
+    exit(1);
+  }
+
+  /* Several grammars, or a manifest, select batch mode */
+  if( zManifest || OptNArgs()>1 ){
+    int nFile = OptNArgs();
+    char **azFile = (char**)malloc( sizeof(char*)*(nFile+1) );
+    int i;
+    if( azFile==0 ){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+    for(i=0; i<nFile; i++) azFile[i] = OptArg(i);
+    exit(lemon_batch(&lem, azFile, nFile, zManifest, nThread));
+  }
+  if( OptNArgs()!=1 ){
+    fprintf(stderr,"Exactly one filename argument is required.\n");
+    exit(1);
+  }
+  lem.filename = OptArg(0);
+  if( watch ) exit(lemon_watch(&lem));
+
+  exitcode = lemon_run(&lem);
+
+  /* The process is about to exit, so there is no need to call
+  ** lemon_free_all() */
+  exit(exitcode);
+  return (exitcode);
+}
+#endif /* LEMON_NO_MAIN */
+/****************** From the file "memory.c" ********************************/
+/*
+** Memory allocation for the LEMON parser generator.
+**
+** Every allocation is linked into a list that belongs to a struct lemon,
+** so that lemon_free_all() can release everything used by a run in one
+** go, even after a fatal error.  The allocators never return NULL.
+** Running out of memory is a fatal error instead.
+*/
+
+/* The header in front of every allocation.  The union keeps the memory
+** that follows it aligned for any type. */
+struct memblock {
+  union {
+    struct {
+      struct memblock *pNext;   /* Next allocation */
+      struct memblock *pPrev;   /* Previous allocation */
+    } link;
+    double rAlign;
+    long iAlign;
+    void *pAlign;
+  } u;
+};
+
+/* Link a newly allocated block into the list for lemp */
+static void *memblock_link(struct lemon *lemp, struct memblock *p){
+  p->u.link.pPrev = 0;
+  p->u.link.pNext = lemp->pMem;
+  if( lemp->pMem ) lemp->pMem->u.link.pPrev = p;
+  lemp->pMem = p;
+  return (void*)&p[1];
+}
+
+/* Allocate n bytes of memory */
+void *lemon_malloc(struct lemon *lemp, size_t n){
+  struct memblock *p;
+  p = (struct memblock*)malloc( sizeof(*p) + n );
+  if( p==0 ) memory_error(lemp);
+  return memblock_link(lemp, p);
+}
+
+/* Allocate zeroed memory for an array of nElem elements of sz bytes */
+void *lemon_calloc(struct lemon *lemp, size_t nElem, size_t sz){
+  void *p;
+  if( sz>0 && nElem>((size_t)-1 - sizeof(struct memblock))/sz ){
+    memory_error(lemp);
+  }
+  p = lemon_malloc(lemp, nElem*sz);
+  memset(p, 0, nElem*sz);
+  return p;
+}
+
+/* Resize an allocation.  pOld may be NULL. */
+void *lemon_realloc(struct lemon *lemp, void *pOld, size_t n){
+  struct memblock *p, *pNew;
+  if( pOld==0 ) return lemon_malloc(lemp, n);
+  p = ((struct memblock*)pOld) - 1;
+  pNew = (struct memblock*)realloc(p, sizeof(*p) + n);
+  if( pNew==0 ) memory_error(lemp);
+  if( pNew!=p ){
+    if( pNew->u.link.pPrev ){
+      pNew->u.link.pPrev->u.link.pNext = pNew;
+    }else{
+      lemp->pMem = pNew;
+    }
+    if( pNew->u.link.pNext ) pNew->u.link.pNext->u.link.pPrev = pNew;
+  }
+  return (void*)&pNew[1];
+}
+
+/* Release a single allocation.  p may be NULL. */
+void lemon_free(struct lemon *lemp, void *pOld){
+  struct memblock *p;
+  if( pOld==0 ) return;
+  p = ((struct memblock*)pOld) - 1;
+  if( p->u.link.pPrev ){
+    p->u.link.pPrev->u.link.pNext = p->u.link.pNext;
+  }else{
+    lemp->pMem = p->u.link.pNext;
+  }
+  if( p->u.link.pNext ) p->u.link.pNext->u.link.pPrev = p->u.link.pPrev;
+  free(p);
+}
+
+/* Make a copy of a string */
+char *lemon_strdup(struct lemon *lemp, const char *z){
+  size_t n = strlen(z) + 1;
+  char *zCopy = (char*)lemon_malloc(lemp, n);
+  memcpy(zCopy, z, n);
+  return zCopy;
+}
+
+/* Release every allocation made on behalf of lemp */
+void lemon_free_all(struct lemon *lemp){
+  struct memblock *p, *pNext;
+  for(p=lemp->pMem; p; p=pNext){
+    pNext = p->u.link.pNext;
+    free(p);
+  }
+  lemp->pMem = 0;
+}
+
+/* Give up on the current run of the parser generator.  Control returns
+** to lemon_run(), which reports the failure.
+*/
+void lemon_fatal(struct lemon *lemp){
+  assert( lemp->pAbort!=0 );
+  longjmp(*lemp->pAbort, 1);
+}
+
+/* Report an out-of-memory condition and abort.
+*/
+void memory_error(struct lemon *lemp){
+  fprintf(lemp->errstream,"Out of memory.  Aborting...\n");
+  lemon_fatal(lemp);
+}
+/******************** From the file "msort.c" *******************************/
+/*
+** A generic merge-sort program.
+**
+** USAGE:
+** Let "ptr" be a pointer to some structure which is at the head of
+** a null-terminated list.  Then to sort the list call:
+**
+**     ptr = msort(ptr,&(ptr->next),cmpfnc);
 **
 ** In the above, "cmpfnc" is a pointer to a function which compares
 ** two instances of the structure and returns an integer, as in
@@ -2224,15 +3327,19 @@ enum e_state {
   WAITING_FOR_DATATYPE_SYMBOL,
   WAITING_FOR_FALLBACK_ID,
   WAITING_FOR_WILDCARD_ID,
+  WAITING_FOR_ARENA_SYMBOL,
   WAITING_FOR_CLASS_ID,
   WAITING_FOR_CLASS_TOKEN,
-  WAITING_FOR_TOKEN_NAME
+  WAITING_FOR_TOKEN_NAME,
+  WAITING_FOR_IMPORT_FILE,
+  WAITING_FOR_EXPORT_NAME
 };
 struct pstate {
   char *filename;       /* Name of the input file */
   int tokenlineno;      /* Linenumber at which current token starts */
   int errorcnt;         /* Number of errors so far */
-  char *tokenstart;     /* Text of current token */
+  const char *tokenstart;  /* Text of current token.  Not zero-terminated */
+  int tokenlen;         /* Number of bytes in the current token */
   struct lemon *gp;     /* Global state vector */
   enum e_state state;        /* The state of the parser */
   struct symbol *fallback;   /* The fallback token */
@@ -2244,6 +3351,7 @@ struct pstate {
   const char *alias[MAXRHS]; /* Aliases for each RHS symbol (or NULL) */
   struct rule *prevrule;     /* Previous rule parsed */
   const char *declkeyword;   /* Keyword of a declaration */
+  int ndeclkeyword;          /* Number of bytes in declkeyword */
   char **declargslot;        /* Where the declaration argument should be put */
   int insertLineMacro;       /* Add #line before declaration insert */
   int *decllinenoslot;       /* Where to write declaration line number */
@@ -2251,16 +3359,49 @@ struct pstate {
   int preccounter;           /* Assign this precedence to decl arguments */
   struct rule *firstrule;    /* Pointer to first rule in the grammar */
   struct rule *lastrule;     /* Pointer to the most recently parsed rule */
+  struct gmodule *module;    /* Module being parsed, or NULL */
+  struct rule *mainrule;     /* First rule of the main grammar file */
+  struct file_id mainid;     /* Identity of the main grammar file */
 };
 
+static void parse_import(struct pstate*, const char*, int);
+
+/* Return true if the current token is exactly the text zWord */
+static int tokenIs(const struct pstate *psp, const char *zWord){
+  int n = lemonStrlen(zWord);
+  return psp->tokenlen==n && memcmp(psp->tokenstart, zWord, n)==0;
+}
+
+/* Return the name of the symbol x[0..nx-1] as seen from the file being
+** parsed.  A nonterminal of a module that the module does not export is
+** private to it, so its name is qualified by the prefix of the module.
+*/
+static const char *symbol_name(struct pstate *psp, const char *x, int nx){
+  struct lemon *lemp = psp->gp;
+  struct gmodule *pMod = psp->module;
+  const char *zName = Strsafe_n(lemp,x,nx);
+  char *z;
+  int i;
+  if( pMod==0 || !ISLOWER(x[0]) ) return zName;
+  for(i=0; i<pMod->nExport; i++){
+    if( pMod->azExport[i]==zName ) return zName;
+  }
+  z = (char*)lemon_malloc(lemp, lemonStrlen(pMod->prefix) + nx + 2);
+  lemon_sprintf(z, "%s.%s", pMod->prefix, zName);
+  zName = Strsafe(lemp,z);
+  lemon_free(lemp, z);
+  return zName;
+}
+
 /* Parse a single token */
 static void parseonetoken(struct pstate *psp)
 {
-  const char *x;
-  x = Strsafe(psp->tokenstart);     /* Save the token permanently */
+  struct lemon *lemp = psp->gp;     /* The parser generator */
+  const char *x = psp->tokenstart;  /* Text of the token */
+  int nx = psp->tokenlen;           /* Number of bytes in x[] */
 #if 0
-  printf("%s:%d: Token=[%s] state=%d\n",psp->filename,psp->tokenlineno,
-    x,psp->state);
+  printf("%s:%d: Token=[%.*s] state=%d\n",psp->filename,psp->tokenlineno,
+    nx,x,psp->state);
 #endif
   switch( psp->state ){
     case INITIALIZE:
@@ -2273,71 +3414,71 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='%' ){
         psp->state = WAITING_FOR_DECL_KEYWORD;
       }else if( ISLOWER(x[0]) ){
-        psp->lhs = Symbol_new(x);
+        psp->lhs = Symbol_new(lemp,symbol_name(psp,x,nx));
         psp->nrhs = 0;
         psp->lhsalias = 0;
         psp->state = WAITING_FOR_ARROW;
       }else if( x[0]=='{' ){
         if( psp->prevrule==0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "There is no prior rule upon which to attach the code "
             "fragment which begins on this line.");
           psp->errorcnt++;
         }else if( psp->prevrule->code!=0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Code fragment beginning on this line is not the first "
             "to follow the previous rule.");
           psp->errorcnt++;
-        }else if( strcmp(x, "{NEVER-REDUCE")==0 ){
+        }else if( tokenIs(psp, "{NEVER-REDUCE") ){
           psp->prevrule->neverReduce = 1;
         }else{
           psp->prevrule->line = psp->tokenlineno;
-          psp->prevrule->code = &x[1];
+          psp->prevrule->code = Strsafe_n(lemp,&x[1], nx-1);
           psp->prevrule->noCode = 0;
         }
       }else if( x[0]=='[' ){
         psp->state = PRECEDENCE_MARK_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Token \"%s\" should be either \"%%\" or a nonterminal name.",
-          x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Token \"%.*s\" should be either \"%%\" or a nonterminal name.",
+          nx, x);
         psp->errorcnt++;
       }
       break;
     case PRECEDENCE_MARK_1:
       if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "The precedence symbol must be a terminal.");
         psp->errorcnt++;
       }else if( psp->prevrule==0 ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "There is no prior rule to assign precedence \"[%s]\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "There is no prior rule to assign precedence \"[%.*s]\".",nx,x);
         psp->errorcnt++;
       }else if( psp->prevrule->precsym!=0 ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Precedence mark on this line is not the first "
           "to follow the previous rule.");
         psp->errorcnt++;
       }else{
-        psp->prevrule->precsym = Symbol_new(x);
+        psp->prevrule->precsym = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }
       psp->state = PRECEDENCE_MARK_2;
       break;
     case PRECEDENCE_MARK_2:
       if( x[0]!=']' ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \"]\" on precedence mark.");
         psp->errorcnt++;
       }
       psp->state = WAITING_FOR_DECL_OR_RULE;
       break;
     case WAITING_FOR_ARROW:
-      if( x[0]==':' && x[1]==':' && x[2]=='=' ){
+      if( tokenIs(psp, "::=") ){
         psp->state = IN_RHS;
       }else if( x[0]=='(' ){
         psp->state = LHS_ALIAS_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Expected to see a \":\" following the LHS symbol \"%s\".",
           psp->lhs->name);
         psp->errorcnt++;
@@ -2346,12 +3487,12 @@ static void parseonetoken(struct pstate *psp)
       break;
     case LHS_ALIAS_1:
       if( ISALPHA(x[0]) ){
-        psp->lhsalias = x;
+        psp->lhsalias = Strsafe_n(lemp,x,nx);
         psp->state = LHS_ALIAS_2;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "\"%s\" is not a valid alias for the LHS \"%s\"\n",
-          x,psp->lhs->name);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "\"%.*s\" is not a valid alias for the LHS \"%s\"\n",
+          nx,x,psp->lhs->name);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
@@ -2360,17 +3501,17 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]==')' ){
         psp->state = LHS_ALIAS_3;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \")\" following LHS alias name \"%s\".",psp->lhsalias);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
       break;
     case LHS_ALIAS_3:
-      if( x[0]==':' && x[1]==':' && x[2]=='=' ){
+      if( tokenIs(psp, "::=") ){
         psp->state = IN_RHS;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \"->\" following: \"%s(%s)\".",
            psp->lhs->name,psp->lhsalias);
         psp->errorcnt++;
@@ -2380,16 +3521,17 @@ static void parseonetoken(struct pstate *psp)
     case IN_RHS:
       if( x[0]=='.' ){
         struct rule *rp;
-        rp = (struct rule *)calloc( sizeof(struct rule) +
+        rp = (struct rule *)lemon_calloc(lemp, sizeof(struct rule) +
              sizeof(struct symbol*)*psp->nrhs + sizeof(char*)*psp->nrhs, 1);
         if( rp==0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Can't allocate enough memory for this rule.");
           psp->errorcnt++;
           psp->prevrule = 0;
         }else{
           int i;
           rp->ruleline = psp->tokenlineno;
+          rp->filename = psp->filename;
           rp->rhs = (struct symbol**)&rp[1];
           rp->rhsalias = (const char**)&(rp->rhs[psp->nrhs]);
           for(i=0; i<psp->nrhs; i++){
@@ -2407,6 +3549,7 @@ static void parseonetoken(struct pstate *psp)
           rp->nextlhs = rp->lhs->rule;
           rp->lhs->rule = rp;
           rp->next = 0;
+          if( psp->module==0 && psp->mainrule==0 ) psp->mainrule = rp;
           if( psp->firstrule==0 ){
             psp->firstrule = psp->lastrule = rp;
           }else{
@@ -2418,55 +3561,57 @@ static void parseonetoken(struct pstate *psp)
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( ISALPHA(x[0]) ){
         if( psp->nrhs>=MAXRHS ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Too many symbols on RHS of rule beginning at \"%s\".",
-            x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Too many symbols on RHS of rule beginning at \"%.*s\".",
+            nx, x);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_RULE_ERROR;
         }else{
-          psp->rhs[psp->nrhs] = Symbol_new(x);
+          psp->rhs[psp->nrhs] = Symbol_new(lemp,symbol_name(psp,x,nx));
           psp->alias[psp->nrhs] = 0;
           psp->nrhs++;
         }
-      }else if( (x[0]=='|' || x[0]=='/') && psp->nrhs>0 && ISUPPER(x[1]) ){
+      }else if( (x[0]=='|' || x[0]=='/') && psp->nrhs>0 && nx>1
+             && ISUPPER(x[1]) ){
         struct symbol *msp = psp->rhs[psp->nrhs-1];
         if( msp->type!=MULTITERMINAL ){
           struct symbol *origsp = msp;
-          msp = (struct symbol *) calloc(1,sizeof(*msp));
-          memset(msp, 0, sizeof(*msp));
+          msp = (struct symbol *) lemon_calloc(lemp, 1, sizeof(*msp));
           msp->type = MULTITERMINAL;
           msp->nsubsym = 1;
-          msp->subsym = (struct symbol **) calloc(1,sizeof(struct symbol*));
+          msp->subsym = (struct symbol **) lemon_calloc(lemp, 1,
+                                                   sizeof(struct symbol*));
           msp->subsym[0] = origsp;
           msp->name = origsp->name;
           psp->rhs[psp->nrhs-1] = msp;
         }
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(lemp, msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
-        msp->subsym[msp->nsubsym-1] = Symbol_new(&x[1]);
+        msp->subsym[msp->nsubsym-1] =
+                               Symbol_new(lemp,Strsafe_n(lemp,&x[1],nx-1));
         if( ISLOWER(x[1]) || ISLOWER(msp->subsym[0]->name[0]) ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Cannot form a compound containing a non-terminal");
           psp->errorcnt++;
         }
       }else if( x[0]=='(' && psp->nrhs>0 ){
         psp->state = RHS_ALIAS_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal character on RHS of rule: \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal character on RHS of rule: \"%.*s\".",nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
       break;
     case RHS_ALIAS_1:
       if( ISALPHA(x[0]) ){
-        psp->alias[psp->nrhs-1] = x;
+        psp->alias[psp->nrhs-1] = Strsafe_n(lemp,x,nx);
         psp->state = RHS_ALIAS_2;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "\"%s\" is not a valid alias for the RHS symbol \"%s\"\n",
-          x,psp->rhs[psp->nrhs-1]->name);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "\"%.*s\" is not a valid alias for the RHS symbol \"%s\"\n",
+          nx,x,psp->rhs[psp->nrhs-1]->name);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
@@ -2475,7 +3620,7 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]==')' ){
         psp->state = IN_RHS;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \")\" following LHS alias name \"%s\".",psp->lhsalias);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
@@ -2484,96 +3629,115 @@ static void parseonetoken(struct pstate *psp)
     case WAITING_FOR_DECL_KEYWORD:
       if( ISALPHA(x[0]) ){
         psp->declkeyword = x;
+        psp->ndeclkeyword = nx;
         psp->declargslot = 0;
         psp->decllinenoslot = 0;
         psp->insertLineMacro = 1;
         psp->state = WAITING_FOR_DECL_ARG;
-        if( strcmp(x,"name")==0 ){
+        if( tokenIs(psp,"name") ){
           psp->declargslot = &(psp->gp->name);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"include")==0 ){
+        }else if( tokenIs(psp,"include") ){
           psp->declargslot = &(psp->gp->include);
-        }else if( strcmp(x,"code")==0 ){
+        }else if( tokenIs(psp,"code") ){
           psp->declargslot = &(psp->gp->extracode);
-        }else if( strcmp(x,"token_destructor")==0 ){
+        }else if( tokenIs(psp,"token_destructor") ){
           psp->declargslot = &psp->gp->tokendest;
-        }else if( strcmp(x,"default_destructor")==0 ){
+        }else if( tokenIs(psp,"default_destructor") ){
           psp->declargslot = &psp->gp->vardest;
-        }else if( strcmp(x,"token_prefix")==0 ){
+        }else if( tokenIs(psp,"token_prefix") ){
           psp->declargslot = &psp->gp->tokenprefix;
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"syntax_error")==0 ){
+        }else if( tokenIs(psp,"syntax_error") ){
           psp->declargslot = &(psp->gp->error);
-        }else if( strcmp(x,"parse_accept")==0 ){
+        }else if( tokenIs(psp,"parse_accept") ){
           psp->declargslot = &(psp->gp->accept);
-        }else if( strcmp(x,"parse_failure")==0 ){
+        }else if( tokenIs(psp,"parse_failure") ){
           psp->declargslot = &(psp->gp->failure);
-        }else if( strcmp(x,"stack_overflow")==0 ){
+        }else if( tokenIs(psp,"stack_overflow") ){
           psp->declargslot = &(psp->gp->overflow);
-        }else if( strcmp(x,"extra_argument")==0 ){
+        }else if( tokenIs(psp,"extra_argument") ){
           psp->declargslot = &(psp->gp->arg);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"extra_context")==0 ){
+        }else if( tokenIs(psp,"extra_context") ){
           psp->declargslot = &(psp->gp->ctx);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"token_type")==0 ){
+        }else if( tokenIs(psp,"token_type") ){
           psp->declargslot = &(psp->gp->tokentype);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"default_type")==0 ){
+        }else if( tokenIs(psp,"default_type") ){
           psp->declargslot = &(psp->gp->vartype);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"stack_size")==0 ){
+        }else if( tokenIs(psp,"stack_size") ){
           psp->declargslot = &(psp->gp->stacksize);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"start_symbol")==0 ){
+        }else if( tokenIs(psp,"start_symbol") ){
           psp->declargslot = &(psp->gp->start);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"left")==0 ){
+        }else if( tokenIs(psp,"left") ){
           psp->preccounter++;
           psp->declassoc = LEFT;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"right")==0 ){
+        }else if( tokenIs(psp,"right") ){
           psp->preccounter++;
           psp->declassoc = RIGHT;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"nonassoc")==0 ){
+        }else if( tokenIs(psp,"nonassoc") ){
           psp->preccounter++;
           psp->declassoc = NONE;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"destructor")==0 ){
+        }else if( tokenIs(psp,"destructor") ){
           psp->state = WAITING_FOR_DESTRUCTOR_SYMBOL;
-        }else if( strcmp(x,"type")==0 ){
+        }else if( tokenIs(psp,"type") ){
           psp->state = WAITING_FOR_DATATYPE_SYMBOL;
-        }else if( strcmp(x,"fallback")==0 ){
+        }else if( tokenIs(psp,"fallback") ){
           psp->fallback = 0;
           psp->state = WAITING_FOR_FALLBACK_ID;
-        }else if( strcmp(x,"token")==0 ){
+        }else if( tokenIs(psp,"token") ){
           psp->state = WAITING_FOR_TOKEN_NAME;
-        }else if( strcmp(x,"wildcard")==0 ){
+        }else if( tokenIs(psp,"wildcard") ){
           psp->state = WAITING_FOR_WILDCARD_ID;
-        }else if( strcmp(x,"token_class")==0 ){
+        }else if( tokenIs(psp,"arena") ){
+          psp->gp->has_arena = 1;
+          psp->state = WAITING_FOR_ARENA_SYMBOL;
+        }else if( tokenIs(psp,"token_class") ){
           psp->state = WAITING_FOR_CLASS_ID;
+        }else if( tokenIs(psp,"import") ){
+          psp->state = WAITING_FOR_IMPORT_FILE;
+        }else if( tokenIs(psp,"export") ){
+          psp->state = WAITING_FOR_EXPORT_NAME;
         }else{
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Unknown declaration keyword: \"%%%s\".",x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Unknown declaration keyword: \"%%%.*s\".",nx,x);
+          psp->errorcnt++;
+          psp->state = RESYNC_AFTER_DECL_ERROR;
+        }
+        /* A module may add C code, but the settings of the parser as a
+        ** whole belong to the main grammar file */
+        if( psp->module && psp->declargslot
+         && psp->declargslot!=&psp->gp->include
+         && psp->declargslot!=&psp->gp->extracode ){
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "The %%%.*s directive is not allowed in a module.",nx,x);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_DECL_ERROR;
         }
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal declaration keyword: \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal declaration keyword: \"%.*s\".",nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
       break;
     case WAITING_FOR_DESTRUCTOR_SYMBOL:
       if( !ISALPHA(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Symbol name missing after %%destructor keyword");
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,symbol_name(psp,x,nx));
+        if( sp->destLineno==0 ) sp->destFilename = psp->filename;
         psp->declargslot = &sp->destructor;
         psp->decllinenoslot = &sp->destLineno;
         psp->insertLineMacro = 1;
@@ -2582,20 +3746,21 @@ static void parseonetoken(struct pstate *psp)
       break;
     case WAITING_FOR_DATATYPE_SYMBOL:
       if( !ISALPHA(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Symbol name missing after %%type keyword");
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        struct symbol *sp = Symbol_find(x);
+        const char *zName = symbol_name(psp,x,nx);
+        struct symbol *sp = Symbol_find(lemp,zName);
         if((sp) && (sp->datatype)){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Symbol %%type \"%s\" already defined", x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Symbol %%type \"%s\" already defined", zName);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_DECL_ERROR;
         }else{
           if (!sp){
-            sp = Symbol_new(x);
+            sp = Symbol_new(lemp,zName);
           }
           psp->declargslot = &sp->datatype;
           psp->insertLineMacro = 0;
@@ -2608,18 +3773,18 @@ static void parseonetoken(struct pstate *psp)
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( ISUPPER(x[0]) ){
         struct symbol *sp;
-        sp = Symbol_new(x);
+        sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( sp->prec>=0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Symbol \"%s\" has already be given a precedence.",x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Symbol \"%s\" has already be given a precedence.",sp->name);
           psp->errorcnt++;
         }else{
           sp->prec = psp->preccounter;
           sp->assoc = psp->declassoc;
         }
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Can't assign a precedence to \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Can't assign a precedence to \"%.*s\".",nx,x);
         psp->errorcnt++;
       }
       break;
@@ -2631,8 +3796,8 @@ static void parseonetoken(struct pstate *psp)
         int addLineMacro;
         char zLine[50];
         zNew = x;
-        if( zNew[0]=='"' || zNew[0]=='{' ) zNew++;
-        nNew = lemonStrlen(zNew);
+        nNew = nx;
+        if( zNew[0]=='"' || zNew[0]=='{' ){ zNew++; nNew--; }
         if( *psp->declargslot ){
           zOld = *psp->declargslot;
         }else{
@@ -2652,7 +3817,8 @@ static void parseonetoken(struct pstate *psp)
           nLine = lemonStrlen(zLine);
           n += nLine + lemonStrlen(psp->filename) + nBack;
         }
-        *psp->declargslot = (char *) realloc(*psp->declargslot, n);
+        *psp->declargslot = (char *) lemon_realloc(lemp,
+                                                   *psp->declargslot, n);
         zBuf = *psp->declargslot + nOld;
         if( addLineMacro ){
           if( nOld && zBuf[-1]!='\n' ){
@@ -2678,8 +3844,9 @@ static void parseonetoken(struct pstate *psp)
         *zBuf = 0;
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal argument to %%%s: %s",psp->declkeyword,x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal argument to %%%.*s: %.*s",
+          psp->ndeclkeyword,psp->declkeyword,nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
@@ -2688,16 +3855,16 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%fallback argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%fallback argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( psp->fallback==0 ){
           psp->fallback = sp;
         }else if( sp->fallback ){
-          ErrorMsg(psp->filename, psp->tokenlineno,
-            "More than one fallback assigned to token %s", x);
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "More than one fallback assigned to token %s", sp->name);
           psp->errorcnt++;
         }else{
           sp->fallback = psp->fallback;
@@ -2718,44 +3885,55 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        (void)Symbol_new(x);
+        (void)Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }
       break;
     case WAITING_FOR_WILDCARD_ID:
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%wildcard argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%wildcard argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( psp->gp->wildcard==0 ){
           psp->gp->wildcard = sp;
         }else{
-          ErrorMsg(psp->filename, psp->tokenlineno,
-            "Extra wildcard to token: %s", x);
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "Extra wildcard to token: %s", sp->name);
           psp->errorcnt++;
         }
       }
       break;
+    case WAITING_FOR_ARENA_SYMBOL:
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISLOWER(x[0]) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%arena argument \"%.*s\" should be a nonterminal", nx, x);
+        psp->errorcnt++;
+      }else{
+        Symbol_new(lemp,symbol_name(psp,x,nx))->bArena = 1;
+      }
+      break;
     case WAITING_FOR_CLASS_ID:
       if( !ISLOWER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token_class must be followed by an identifier: %s", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token_class must be followed by an identifier: %.*s", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
-     }else if( Symbol_find(x) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "Symbol \"%s\" already used", x);
+     }else if( Symbol_find(lemp,symbol_name(psp,x,nx)) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "Symbol \"%.*s\" already used", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        psp->tkclass = Symbol_new(x);
+        psp->tkclass = Symbol_new(lemp,symbol_name(psp,x,nx));
         psp->tkclass->type = MULTITERMINAL;
         psp->state = WAITING_FOR_CLASS_TOKEN;
       }
@@ -2763,53 +3941,92 @@ static void parseonetoken(struct pstate *psp)
     case WAITING_FOR_CLASS_TOKEN:
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
-      }else if( ISUPPER(x[0]) || ((x[0]=='|' || x[0]=='/') && ISUPPER(x[1])) ){
+      }else if( ISUPPER(x[0])
+             || ((x[0]=='|' || x[0]=='/') && nx>1 && ISUPPER(x[1])) ){
         struct symbol *msp = psp->tkclass;
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(lemp, msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
-        if( !ISUPPER(x[0]) ) x++;
-        msp->subsym[msp->nsubsym-1] = Symbol_new(x);
+        if( !ISUPPER(x[0]) ){ x++; nx--; }
+        msp->subsym[msp->nsubsym-1] = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }else{
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token_class argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token_class argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
       break;
-    case RESYNC_AFTER_RULE_ERROR:
-/*      if( x[0]=='.' ) psp->state = WAITING_FOR_DECL_OR_RULE;
-**      break; */
-    case RESYNC_AFTER_DECL_ERROR:
-      if( x[0]=='.' ) psp->state = WAITING_FOR_DECL_OR_RULE;
-      if( x[0]=='%' ) psp->state = WAITING_FOR_DECL_KEYWORD;
-      break;
-  }
-}
+    case WAITING_FOR_IMPORT_FILE:
+      if( x[0]!='"' || nx<2 ){
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "%%import must be followed by the name of a file in quotes");
+        psp->errorcnt++;
+        psp->state = RESYNC_AFTER_DECL_ERROR;
+      }else{
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+        parse_import(psp, &x[1], nx-1);
+      }
+      break;
+    case WAITING_FOR_EXPORT_NAME:
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISLOWER(x[0]) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%export argument \"%.*s\" should be a nonterminal", nx, x);
+        psp->errorcnt++;
+      }else if( psp->module ){
+        struct gmodule *pMod = psp->module;
+        const char *zName = Strsafe_n(lemp,x,nx);
+        const char *zPrivate = symbol_name(psp,x,nx);
+        if( zPrivate!=zName && Symbol_find(lemp,zPrivate) ){
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "Nonterminal \"%s\" is used before it is exported", zName);
+          psp->errorcnt++;
+        }
+        pMod->azExport = (const char**)lemon_realloc(lemp, pMod->azExport,
+                                   sizeof(pMod->azExport[0])*(pMod->nExport+1));
+        pMod->azExport[pMod->nExport++] = zName;
+      }
+      break;
+    case RESYNC_AFTER_RULE_ERROR:
+/*      if( x[0]=='.' ) psp->state = WAITING_FOR_DECL_OR_RULE;
+**      break; */
+    case RESYNC_AFTER_DECL_ERROR:
+      if( x[0]=='.' ) psp->state = WAITING_FOR_DECL_OR_RULE;
+      if( x[0]=='%' ) psp->state = WAITING_FOR_DECL_KEYWORD;
+      break;
+  }
+}
 
 /* The text in the input is part of the argument to an %ifdef or %ifndef.
-** Evaluate the text as a boolean expression.  Return true or false.
+** Evaluate the n bytes of text in z[] as a boolean expression.  Return
+** true or false.
 */
-static int eval_preprocessor_boolean(char *z, int lineno){
+static int eval_preprocessor_boolean(
+  struct lemon *lemp,   /* The parser generator */
+  const char *z,        /* Text of the expression */
+  int n,                /* Number of bytes in z[] */
+  int lineno            /* Line number, or -1 for a nested expression */
+){
   int neg = 0;
   int res = 0;
   int okTerm = 1;
   int i;
-  for(i=0; z[i]!=0; i++){
+  for(i=0; i<n; i++){
     if( ISSPACE(z[i]) ) continue;
     if( z[i]=='!' ){
       if( !okTerm ) goto pp_syntax_error;
       neg = !neg;
       continue;
     }
-    if( z[i]=='|' && z[i+1]=='|' ){
+    if( z[i]=='|' && i+1<n && z[i+1]=='|' ){
       if( okTerm ) goto pp_syntax_error;
       if( res ) return 1;
       i++;
       okTerm = 1;
       continue;
     }
-    if( z[i]=='&' && z[i+1]=='&' ){
+    if( z[i]=='&' && i+1<n && z[i+1]=='&' ){
       if( okTerm ) goto pp_syntax_error;
       if( !res ) return 0;
       i++;
@@ -2818,15 +4035,13 @@ static int eval_preprocessor_boolean(char *z, int lineno){
     }
     if( z[i]=='(' ){
       int k;
-      int n = 1;
+      int nParen = 1;
       if( !okTerm ) goto pp_syntax_error;
-      for(k=i+1; z[k]; k++){
+      for(k=i+1; k<n; k++){
         if( z[k]==')' ){
-          n--;
-          if( n==0 ){
-            z[k] = 0;
-            res = eval_preprocessor_boolean(&z[i+1], -1);
-            z[k] = ')';
+          nParen--;
+          if( nParen==0 ){
+            res = eval_preprocessor_boolean(lemp, &z[i+1], k-i-1, -1);
             if( res<0 ){
               i = i-res;
               goto pp_syntax_error;
@@ -2835,10 +4050,7 @@ static int eval_preprocessor_boolean(char *z, int lineno){
             break;
           }
         }else if( z[k]=='(' ){
-          n++;
-        }else if( z[k]==0 ){
-          i = k;
-          goto pp_syntax_error;
+          nParen++;
         }
       }
       if( neg ){
@@ -2849,13 +4061,14 @@ static int eval_preprocessor_boolean(char *z, int lineno){
       continue;
     }
     if( ISALPHA(z[i]) ){
-      int j, k, n;
+      int j, k, nName;
       if( !okTerm ) goto pp_syntax_error;
-      for(k=i+1; ISALNUM(z[k]) || z[k]=='_'; k++){}
-      n = k - i;
+      for(k=i+1; k<n && (ISALNUM(z[k]) || z[k]=='_'); k++){}
+      nName = k - i;
       res = 0;
-      for(j=0; j<nDefine; j++){
-        if( strncmp(azDefine[j],&z[i],n)==0 && azDefine[j][n]==0 ){
+      for(j=0; j<lemp->nDefine; j++){
+        const char *zDef = lemp->azDefine[j];
+        if( strncmp(zDef,&z[i],nName)==0 && zDef[nName]==0 ){
           res = 1;
           break;
         }
@@ -2874,167 +4087,357 @@ static int eval_preprocessor_boolean(char *z, int lineno){
 
 pp_syntax_error:
   if( lineno>0 ){
-    fprintf(stderr, "%%if syntax error on line %d.\n", lineno);
-    fprintf(stderr, "  %.*s <-- syntax error here\n", i+1, z);
-    exit(1);
+    fprintf(lemp->errstream, "%%if syntax error on line %d.\n", lineno);
+    fprintf(lemp->errstream, "  %.*s <-- syntax error here\n", i+1, z);
+    lemon_fatal(lemp);
+    return 0;
   }else{
     return -(i+1);
   }
 }
 
-/* Run the preprocessor over the input file text.  The global variables
-** azDefine[0] through azDefine[nDefine-1] contains the names of all defined
-** macros.  This routine looks for "%ifdef" and "%ifndef" and "%endif" and
-** comments them out.  Text in between is also commented out as appropriate.
+/*
+** A span of input text that the preprocessor has removed.  The
+** text is never modified.  Instead, the scanner treats each span as
+** white space, keeping only the newlines for the sake of line numbers.
 */
-static void preprocess_input(char *z){
-  int i, j, k;
+struct pp_span {
+  size_t iStart;        /* Offset of the first byte removed */
+  size_t iEnd;          /* Offset of the first byte past the span */
+};
+
+/* Sort spans by their starting offset */
+static int pp_span_cmp(const void *a, const void *b){
+  const struct pp_span *p1 = (const struct pp_span*)a;
+  const struct pp_span *p2 = (const struct pp_span*)b;
+  if( p1->iStart<p2->iStart ) return -1;
+  return p1->iStart>p2->iStart;
+}
+
+/* Record text z[iStart..iEnd-1] as removed by the preprocessor */
+static void pp_span_add(
+  struct lemon *lemp,       /* The parser generator */
+  struct pp_span **paSpan,  /* The array of spans */
+  int *pnSpan,              /* Number of entries in *paSpan */
+  size_t iStart,            /* First byte of the removed text */
+  size_t iEnd               /* First byte past the removed text */
+){
+  if( iEnd<=iStart ) return;
+  if( ((*pnSpan) & 31)==0 ){
+    *paSpan = (struct pp_span*)lemon_realloc(lemp, *paSpan,
+                                  sizeof(struct pp_span)*((*pnSpan)+32));
+  }
+  (*paSpan)[*pnSpan].iStart = iStart;
+  (*paSpan)[*pnSpan].iEnd = iEnd;
+  (*pnSpan)++;
+}
+
+/* Return true if z[i..n-1] begins with the directive zDirective */
+static int pp_directive(const char *z, size_t n, size_t i, const char *zDir){
+  size_t nDir = (size_t)lemonStrlen(zDir);
+  return n-i>=nDir && memcmp(&z[i], zDir, nDir)==0;
+}
+
+/* Run the preprocessor over the n bytes of input file text in z[].  The
+** lemp->azDefine[0] through lemp->azDefine[lemp->nDefine-1] contain the
+** names of all defined macros.  This routine looks for "%ifdef" and
+** "%ifndef" and "%endif" and marks them as removed.  Text in between is
+** also removed as appropriate.
+**
+** The input text is not changed.  The removed text is written into
+** *paSpan as an array of non-overlapping spans sorted by offset.  The
+** number of spans is returned.
+*/
+static int preprocess_input(
+  struct lemon *lemp,       /* The parser generator */
+  const char *z,            /* Text of the input file */
+  size_t n,                 /* Number of bytes in z[] */
+  struct pp_span **paSpan   /* OUT: Spans of text removed */
+){
+  size_t i, j;
+  size_t start = 0;
   int exclude = 0;
-  int start = 0;
   int lineno = 1;
   int start_lineno = 1;
-  for(i=0; z[i]; i++){
+  int nSpan = 0;
+  int k;
+  *paSpan = 0;
+  for(i=0; i<n; i++){
     if( z[i]=='\n' ) lineno++;
     if( z[i]!='%' || (i>0 && z[i-1]!='\n') ) continue;
-    if( strncmp(&z[i],"%endif",6)==0 && ISSPACE(z[i+6]) ){
+    if( pp_directive(z,n,i,"%endif") && i+6<n && ISSPACE(z[i+6]) ){
       if( exclude ){
         exclude--;
-        if( exclude==0 ){
-          for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
-        }
+        if( exclude==0 ) pp_span_add(lemp, paSpan, &nSpan, start, i);
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
-    }else if( strncmp(&z[i],"%else",5)==0 && ISSPACE(z[i+5]) ){
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
+    }else if( pp_directive(z,n,i,"%else") && i+5<n && ISSPACE(z[i+5]) ){
       if( exclude==1){
         exclude = 0;
-        for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
+        pp_span_add(lemp, paSpan, &nSpan, start, i);
       }else if( exclude==0 ){
         exclude = 1;
         start = i;
         start_lineno = lineno;
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
-    }else if( strncmp(&z[i],"%ifdef ",7)==0
-          || strncmp(&z[i],"%if ",4)==0
-          || strncmp(&z[i],"%ifndef ",8)==0 ){
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
+    }else if( pp_directive(z,n,i,"%ifdef ")
+          || pp_directive(z,n,i,"%if ")
+          || pp_directive(z,n,i,"%ifndef ") ){
       if( exclude ){
         exclude++;
       }else{
         int isNot;
-        int iBool;
-        for(j=i; z[j] && !ISSPACE(z[j]); j++){}
+        size_t iBool;
+        for(j=i; j<n && !ISSPACE(z[j]); j++){}
         iBool = j;
         isNot = (j==i+7);
-        while( z[j] && z[j]!='\n' ){ j++; }
-        k = z[j];
-        z[j] = 0;
-        exclude = eval_preprocessor_boolean(&z[iBool], lineno);
-        z[j] = k;
+        while( j<n && z[j]!='\n' ){ j++; }
+        exclude = eval_preprocessor_boolean(lemp, &z[iBool], (int)(j-iBool),
+                                            lineno);
         if( !isNot ) exclude = !exclude;
         if( exclude ){
           start = i;
           start_lineno = lineno;
         }
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
     }
   }
   if( exclude ){
-    fprintf(stderr,"unterminated %%ifdef starting on line %d\n", start_lineno);
-    exit(1);
+    fprintf(lemp->errstream,"unterminated %%ifdef starting on line %d\n",
+            start_lineno);
+    lemon_fatal(lemp);
+  }
+
+  /* Directives inside of excluded text produce spans that overlap the
+  ** excluded text itself.  Sort the spans and merge the overlaps. */
+  if( nSpan>1 ){
+    qsort(*paSpan, nSpan, sizeof(struct pp_span), pp_span_cmp);
+    for(i=1, k=0; i<(size_t)nSpan; i++){
+      struct pp_span *pPrev = &(*paSpan)[k];
+      if( (*paSpan)[i].iStart<=pPrev->iEnd ){
+        if( (*paSpan)[i].iEnd>pPrev->iEnd ) pPrev->iEnd = (*paSpan)[i].iEnd;
+      }else{
+        (*paSpan)[++k] = (*paSpan)[i];
+      }
+    }
+    nSpan = k+1;
   }
+  return nSpan;
 }
 
-/* In spite of its name, this function is really a scanner.  It read
-** in the entire input file (all at once) then tokenizes it.  Each
-** token is passed to the function "parseonetoken" which builds all
-** the appropriate data structures in the global state vector "gp".
+/* Make a copy of the n bytes of text in z[] in which every span removed
+** by the preprocessor is overwritten by spaces.  The copy is zero
+** terminated.  This is the slow path, used only when removed text falls
+** in the middle of a token or comment.
 */
-void Parse(struct lemon *gp)
-{
-  struct pstate ps;
-  FILE *fp;
-  char *filebuf;
-  unsigned int filesize;
-  int lineno;
-  int c;
-  char *cp, *nextcp;
-  int startline = 0;
-
-  memset(&ps, '\0', sizeof(ps));
-  ps.gp = gp;
-  ps.filename = gp->filename;
-  ps.errorcnt = 0;
-  ps.state = INITIALIZE;
-
-  /* Begin by reading the input file */
-  fp = fopen(ps.filename,"rb");
-  if( fp==0 ){
-    ErrorMsg(ps.filename,0,"Can't open this file for reading.");
-    gp->errorcnt++;
-    return;
+static char *pp_blank_copy(
+  struct lemon *lemp,
+  const char *z,
+  size_t n,
+  const struct pp_span *aSpan,
+  int nSpan
+){
+  char *zCopy;
+  size_t j;
+  int i;
+  zCopy = (char *)lemon_malloc(lemp, n+1 );
+  memcpy(zCopy, z, n);
+  zCopy[n] = 0;
+  for(i=0; i<nSpan; i++){
+    for(j=aSpan[i].iStart; j<aSpan[i].iEnd; j++){
+      if( zCopy[j]!='\n' ) zCopy[j] = ' ';
+    }
   }
+  return zCopy;
+}
+
+/*
+** Bring the complete text of the file zName into memory for reading.  The
+** size of the file in bytes is written into *pnByte.  The file is memory
+** mapped where the operating system allows it, so that large grammars do
+** not have to be copied into the heap.  Otherwise, or if the mapping
+** fails, the file is read into memory obtained from malloc().  *pbMapped
+** is set to tell file_unmap() which of the two happened.
+**
+** The text returned is read-only and is not zero-terminated.  Return
+** NULL if the file cannot be opened or read.
+*/
+static char *file_map(const char *zName, size_t *pnByte, int *pbMapped){
+  FILE *fp;
+  char *z;
+  size_t n;
+  long sz;
+#ifndef __WIN32__
+  int fd;
+  struct stat st;
+  fd = open(zName, O_RDONLY);
+  if( fd<0 ) return 0;
+  if( fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0 ){
+    z = (char *)mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if( z!=(char *)MAP_FAILED ){
+      close(fd);
+      *pnByte = (size_t)st.st_size;
+      *pbMapped = 1;
+      return z;
+    }
+  }
+  close(fd);
+#endif
+  *pbMapped = 0;
+  fp = fopen(zName,"rb");
+  if( fp==0 ) return 0;
   fseek(fp,0,2);
-  filesize = ftell(fp);
+  sz = ftell(fp);
   rewind(fp);
-  filebuf = (char *)malloc( filesize+1 );
-  if( filesize>100000000 || filebuf==0 ){
-    ErrorMsg(ps.filename,0,"Input file too large.");
-    free(filebuf);
-    gp->errorcnt++;
+  if( sz<0 ){
     fclose(fp);
-    return;
+    return 0;
   }
-  if( fread(filebuf,1,filesize,fp)!=filesize ){
-    ErrorMsg(ps.filename,0,"Can't read in all %d bytes of this file.",
-      filesize);
-    free(filebuf);
-    gp->errorcnt++;
+  n = (size_t)sz;
+  z = (char *)malloc( n+1 );
+  if( z==0 || fread(z,1,n,fp)!=n ){
+    free(z);
     fclose(fp);
-    return;
+    return 0;
   }
   fclose(fp);
-  filebuf[filesize] = 0;
+  *pnByte = n;
+  return z;
+}
 
-  /* Make an initial pass through the file to handle %ifdef and %ifndef */
-  preprocess_input(filebuf);
-  if( gp->printPreprocessed ){
-    printf("%s\n", filebuf);
+/* Find the identity of the file zName.  p->ok is false if the file
+** cannot be found, or if the operating system has no inode numbers.
+*/
+static void file_identify(const char *zName, struct file_id *p){
+#ifndef __WIN32__
+  struct stat st;
+  if( stat(zName, &st)==0 ){
+    p->dev = (unsigned long)st.st_dev;
+    p->ino = (unsigned long)st.st_ino;
+    p->ok = 1;
+    return;
+  }
+#endif
+  (void)zName;
+  p->dev = p->ino = 0;
+  p->ok = 0;
+}
+
+/* True if the files with identities p1 and p2, named z1 and z2, are the
+** same file.  The names are compared when the identities are unknown.
+*/
+static int file_same(const struct file_id *p1, const char *z1,
+                     const struct file_id *p2, const char *z2){
+  if( p1->ok && p2->ok ) return p1->dev==p2->dev && p1->ino==p2->ino;
+  return strcmp(z1, z2)==0;
+}
+
+/* Release the memory obtained from file_map() */
+static void file_unmap(char *z, size_t n, int bMapped){
+#ifndef __WIN32__
+  if( bMapped ){
+    munmap(z, n);
     return;
   }
+#endif
+  (void)n;
+  (void)bMapped;
+  free(z);
+}
+
+/* Release the input file brought into memory by Parse(), if any.  This
+** is also used to clean up after a fatal error.
+*/
+void file_release_input(struct lemon *lemp){
+  struct gmodule *pMod;
+  if( lemp->pInputMap ){
+    file_unmap(lemp->pInputMap, lemp->nInputMap, lemp->bInputMapped);
+    lemp->pInputMap = 0;
+  }
+  for(pMod=lemp->pModule; pMod; pMod=pMod->next){
+    if( pMod->pMap ){
+      file_unmap(pMod->pMap, pMod->nMap, pMod->bMapped);
+      pMod->pMap = 0;
+    }
+  }
+}
+
+/* Break the n bytes of text in zText[] into tokens, skipping the spans
+** in aSpan[] that the preprocessor removed, and hand each token to
+** parseonetoken().  This is the scanner for the grammar file and for
+** every module that it imports.
+*/
+static void parse_text(
+  struct pstate *psp,         /* The parser state */
+  const char *zText,          /* Text to be scanned */
+  size_t n,                   /* Number of bytes in zText[] */
+  struct pp_span *aSpan,      /* Spans removed by the preprocessor */
+  int nSpan                   /* Number of entries in aSpan[] */
+){
+  struct lemon *gp = psp->gp;
+  char *zBlank = 0;           /* Copy of zText[] with removed text blanked */
+  const char *zEnd = &zText[n];  /* One byte past the end of zText[] */
+  const char *zItem;          /* Start of the current token or comment */
+  int iSpan = 0;              /* Next span to be skipped */
+  int isToken;                /* True if zItem is a token, not a comment */
+  int lineno;
+  int itemlineno;
+  int c;
+  const char *cp, *nextcp;
+  int startline = 0;
 
   /* Now scan the text of the input file */
   lineno = 1;
-  for(cp=filebuf; (c= *cp)!=0; ){
+  for(cp=zText; cp<zEnd; ){
+    if( iSpan<nSpan && cp>=&zText[aSpan[iSpan].iStart] ){
+      /* Skip over text removed by the preprocessor */
+      for(; cp<&zText[aSpan[iSpan].iEnd]; cp++){
+        if( *cp=='\n' ) lineno++;
+      }
+      iSpan++;
+      continue;
+    }
+    zItem = cp;
+    itemlineno = lineno;
+    c = *cp;
     if( c=='\n' ) lineno++;              /* Keep track of the line number */
     if( ISSPACE(c) ){ cp++; continue; }  /* Skip all white space */
-    if( c=='/' && cp[1]=='/' ){          /* Skip C++ style comments */
+    if( c=='/' && cp+1<zEnd && cp[1]=='/' ){  /* Skip C++ style comments */
       cp+=2;
-      while( (c= *cp)!=0 && c!='\n' ) cp++;
-      continue;
+      while( cp<zEnd && *cp!='\n' ) cp++;
+      nextcp = cp;
+      isToken = 0;
+      goto check_span;
     }
-    if( c=='/' && cp[1]=='*' ){          /* Skip C style comments */
+    if( c=='/' && cp+1<zEnd && cp[1]=='*' ){  /* Skip C style comments */
       cp+=2;
-      while( (c= *cp)!=0 && (c!='/' || cp[-1]!='*') ){
+      while( cp<zEnd && ((c= *cp)!='/' || cp[-1]!='*') ){
         if( c=='\n' ) lineno++;
         cp++;
       }
-      if( c ) cp++;
-      continue;
+      if( cp<zEnd ) cp++;
+      nextcp = cp;
+      isToken = 0;
+      goto check_span;
     }
-    ps.tokenstart = cp;                /* Mark the beginning of the token */
-    ps.tokenlineno = lineno;           /* Linenumber on which token begins */
+    psp->tokenstart = cp;                /* Mark the beginning of the token */
+    psp->tokenlineno = lineno;           /* Linenumber on which token begins */
     if( c=='\"' ){                     /* String literals */
       cp++;
-      while( (c= *cp)!=0 && c!='\"' ){
+      while( cp<zEnd && (c= *cp)!='\"' ){
         if( c=='\n' ) lineno++;
         cp++;
       }
-      if( c==0 ){
-        ErrorMsg(ps.filename,startline,
+      if( cp>=zEnd ){
+        ErrorMsg(gp,psp->filename,startline,
             "String starting on this line is not terminated before "
             "the end of the file.");
-        ps.errorcnt++;
+        psp->errorcnt++;
         nextcp = cp;
       }else{
         nextcp = cp+1;
@@ -3042,65 +4445,258 @@ void Parse(struct lemon *gp)
     }else if( c=='{' ){               /* A block of C code */
       int level;
       cp++;
-      for(level=1; (c= *cp)!=0 && (level>1 || c!='}'); cp++){
+      for(level=1; cp<zEnd && ((c= *cp)!='}' || level>1); cp++){
         if( c=='\n' ) lineno++;
         else if( c=='{' ) level++;
         else if( c=='}' ) level--;
-        else if( c=='/' && cp[1]=='*' ){  /* Skip comments */
+        else if( c=='/' && cp+1<zEnd && cp[1]=='*' ){  /* Skip comments */
           int prevc;
           cp = &cp[2];
           prevc = 0;
-          while( (c= *cp)!=0 && (c!='/' || prevc!='*') ){
+          while( cp<zEnd && ((c= *cp)!='/' || prevc!='*') ){
             if( c=='\n' ) lineno++;
             prevc = c;
             cp++;
           }
-        }else if( c=='/' && cp[1]=='/' ){  /* Skip C++ style comments too */
+        }else if( c=='/' && cp+1<zEnd && cp[1]=='/' ){  /* C++ comments */
           cp = &cp[2];
-          while( (c= *cp)!=0 && c!='\n' ) cp++;
-          if( c ) lineno++;
+          while( cp<zEnd && *cp!='\n' ) cp++;
+          if( cp<zEnd ) lineno++;
         }else if( c=='\'' || c=='\"' ){    /* String a character literals */
           int startchar, prevc;
           startchar = c;
           prevc = 0;
-          for(cp++; (c= *cp)!=0 && (c!=startchar || prevc=='\\'); cp++){
+          for(cp++; cp<zEnd && ((c= *cp)!=startchar || prevc=='\\'); cp++){
             if( c=='\n' ) lineno++;
             if( prevc=='\\' ) prevc = 0;
             else              prevc = c;
           }
         }
       }
-      if( c==0 ){
-        ErrorMsg(ps.filename,ps.tokenlineno,
+      if( cp>=zEnd ){
+        ErrorMsg(gp,psp->filename,psp->tokenlineno,
           "C code starting on this line is not terminated before "
           "the end of the file.");
-        ps.errorcnt++;
+        psp->errorcnt++;
+        cp = zEnd;
         nextcp = cp;
       }else{
         nextcp = cp+1;
       }
     }else if( ISALNUM(c) ){          /* Identifiers */
-      while( (c= *cp)!=0 && (ISALNUM(c) || c=='_') ) cp++;
+      while( cp<zEnd && (ISALNUM(*cp) || *cp=='_') ) cp++;
       nextcp = cp;
-    }else if( c==':' && cp[1]==':' && cp[2]=='=' ){ /* The operator "::=" */
-      cp += 3;
+    }else if( c==':' && cp+2<zEnd && cp[1]==':' && cp[2]=='=' ){
+      cp += 3;                       /* The operator "::=" */
       nextcp = cp;
-    }else if( (c=='/' || c=='|') && ISALPHA(cp[1]) ){
+    }else if( (c=='/' || c=='|') && cp+1<zEnd && ISALPHA(cp[1]) ){
       cp += 2;
-      while( (c = *cp)!=0 && (ISALNUM(c) || c=='_') ) cp++;
+      while( cp<zEnd && (ISALNUM(*cp) || *cp=='_') ) cp++;
       nextcp = cp;
     }else{                          /* All other (one character) operators */
       cp++;
       nextcp = cp;
     }
-    c = *cp;
-    *cp = 0;                        /* Null terminate the token */
-    parseonetoken(&ps);             /* Parse the token */
-    *cp = (char)c;                  /* Restore the buffer */
+    psp->tokenlen = (int)(cp - psp->tokenstart);
+    isToken = 1;
+
+check_span:
+    if( iSpan<nSpan && nextcp>&zText[aSpan[iSpan].iStart] ){
+      /* Text removed by the preprocessor begins in the middle of this
+      ** token or comment.  Fall back to scanning a copy of the input
+      ** in which all removed text has been blanked out, starting over
+      ** from the beginning of the token or comment. */
+      zBlank = pp_blank_copy(gp, zText, (size_t)(zEnd-zText), aSpan, nSpan);
+      cp = &zBlank[zItem-zText];
+      zEnd = &zBlank[zEnd-zText];
+      zText = zBlank;
+      lineno = itemlineno;
+      iSpan = nSpan;
+      continue;
+    }
+    if( isToken ) parseonetoken(psp);  /* Parse the token */
     cp = nextcp;
   }
-  free(filebuf);                    /* Release the buffer after parsing */
+  lemon_free(gp, zBlank);
+}
+
+/* Read the grammar module named by the n bytes of zName[], for %import.
+** A relative name is taken to be relative to the directory of the file
+** that imports it.  Each module is read only once, however often it is
+** imported and under whatever name, so a module may import another one
+** that imports it back.  Files are told apart by their device and inode
+** numbers, so that "sub/a.y", "./sub/a.y" and "sub/../sub/a.y" are all
+** the same module.
+** The rules and declarations of the module are added to the grammar
+** exactly as if they had been written in place of the %import.
+*/
+static void parse_import(struct pstate *psp, const char *zName, int n){
+  struct lemon *gp = psp->gp;
+  struct gmodule *pMod, **ppLast;
+  struct pstate saved;
+  struct file_id id;
+  const char *zBase, *zEnd;
+  struct pp_span *aSpan;
+  int nSpan, nDir, i, j, nPrefix;
+  char *z;
+
+  /* Work out the name of the module file */
+  nDir = 0;
+  if( zName[0]!='/' ){
+    for(i=0; psp->filename[i]; i++){
+      if( psp->filename[i]=='/' ) nDir = i+1;
+    }
+  }
+  z = (char*)lemon_malloc(gp, nDir + n + 1);
+  memcpy(z, psp->filename, nDir);
+  memcpy(&z[nDir], zName, n);
+  z[nDir+n] = 0;
+  file_identify(z, &id);
+  if( file_same(&id, z, &psp->mainid, gp->filename) ){
+    lemon_free(gp, z);
+    return;
+  }
+  for(ppLast=&gp->pModule; *ppLast; ppLast=&(*ppLast)->next){
+    if( file_same(&id, z, &(*ppLast)->id, (*ppLast)->filename) ){
+      lemon_free(gp, z);
+      return;
+    }
+  }
+  pMod = (struct gmodule*)lemon_calloc(gp, 1, sizeof(*pMod));
+  pMod->filename = z;
+  pMod->id = id;
+  *ppLast = pMod;
+
+  /* The prefix of the private nonterminals is the base name of the file,
+  ** made into a lower-case identifier and made unique */
+  zBase = strrchr(z, '/');
+  zBase = zBase ? zBase+1 : z;
+  for(nPrefix=0; zBase[nPrefix] && zBase[nPrefix]!='.'; nPrefix++){}
+  pMod->prefix = (char*)lemon_malloc(gp, nPrefix + 20);
+  pMod->prefix[0] = 'm';
+  j = ISALPHA(zBase[0]) ? 0 : 1;
+  for(i=0; i<nPrefix; i++){
+    char c = zBase[i];
+    pMod->prefix[j++] = ISALNUM(c) ? (char)tolower(c) : '_';
+  }
+  pMod->prefix[j] = 0;
+  for(i=2; ; i++){
+    struct gmodule *pOther;
+    for(pOther=gp->pModule; pOther!=pMod; pOther=pOther->next){
+      if( strcmp(pOther->prefix, pMod->prefix)==0 ) break;
+    }
+    if( pOther==pMod ) break;
+    lemon_sprintf(&pMod->prefix[j], "%d", i);
+  }
+
+  /* Bring the module into memory and run the preprocessor over it */
+  pMod->pMap = file_map(z, &pMod->nMap, &pMod->bMapped);
+  if( pMod->pMap==0 ){
+    ErrorMsg(gp,psp->filename,psp->tokenlineno,
+      "Can't open module \"%s\" for reading.", z);
+    psp->errorcnt++;
+    return;
+  }
+  zEnd = memchr(pMod->pMap, 0, pMod->nMap);
+  if( zEnd==0 ) zEnd = &pMod->pMap[pMod->nMap];
+  nSpan = preprocess_input(gp, pMod->pMap, (size_t)(zEnd-pMod->pMap), &aSpan);
+
+  /* Parse the module, then carry on with the file that imported it */
+  saved = *psp;
+  psp->filename = z;
+  psp->module = pMod;
+  psp->prevrule = 0;
+  psp->state = WAITING_FOR_DECL_OR_RULE;
+  parse_text(psp, pMod->pMap, (size_t)(zEnd-pMod->pMap), aSpan, nSpan);
+  if( psp->state!=WAITING_FOR_DECL_OR_RULE ){
+    ErrorMsg(gp,z,psp->tokenlineno,
+      "The module ends in the middle of a rule or declaration.");
+    psp->errorcnt++;
+  }
+  psp->filename = saved.filename;
+  psp->module = saved.module;
+  psp->tokenstart = saved.tokenstart;
+  psp->tokenlen = saved.tokenlen;
+  psp->tokenlineno = saved.tokenlineno;
+  psp->prevrule = 0;
+  psp->state = WAITING_FOR_DECL_OR_RULE;
+  lemon_free(gp, aSpan);
+  file_unmap(pMod->pMap, pMod->nMap, pMod->bMapped);
+  pMod->pMap = 0;
+}
+
+/* In spite of its name, this function is really a scanner.  It brings
+** in the entire input file (all at once) then tokenizes it.  Each
+** token is passed to the function "parseonetoken" which builds all
+** the appropriate data structures in the global state vector "gp".
+**
+** The input is never modified.  Tokens are handed to parseonetoken() as
+** a pointer and length into the file text, and text removed by %ifdef
+** is skipped over rather than being blanked out.
+*/
+void Parse(struct lemon *gp)
+{
+  struct pstate ps;
+  char *filebuf;              /* Text of the input file, if read here */
+  size_t filesize;            /* Number of bytes in filebuf[] */
+  int isMapped;               /* True if filebuf[] is memory mapped */
+  const char *zText;          /* Text being scanned */
+  const char *zEnd;           /* One byte past the end of zText[] */
+  struct pp_span *aSpan;      /* Spans removed by the preprocessor */
+  int nSpan;                  /* Number of entries in aSpan[] */
+  int iSpan;
+
+  memset(&ps, '\0', sizeof(ps));
+  ps.gp = gp;
+  ps.filename = gp->filename;
+  ps.errorcnt = 0;
+  ps.state = INITIALIZE;
+
+  /* Begin by bringing the input file into memory, unless the text of
+  ** the grammar has been supplied by the caller */
+  if( gp->zGrammar ){
+    zText = gp->zGrammar;
+    filesize = gp->nGrammar;
+  }else{
+    filebuf = file_map(ps.filename, &filesize, &isMapped);
+    if( filebuf==0 ){
+      ErrorMsg(gp,ps.filename,0,"Can't open this file for reading.");
+      gp->errorcnt++;
+      return;
+    }
+    gp->pInputMap = filebuf;
+    gp->nInputMap = filesize;
+    gp->bInputMapped = isMapped;
+    zText = filebuf;
+  }
+  zEnd = memchr(zText, 0, filesize);  /* Text ends at the first NUL, if any */
+  if( zEnd==0 ) zEnd = &zText[filesize];
+
+  /* Make an initial pass through the file to handle %ifdef and %ifndef */
+  nSpan = preprocess_input(gp, zText, (size_t)(zEnd-zText), &aSpan);
+  if( gp->printPreprocessed ){
+    size_t i = 0;
+    FILE *out = gp->outstream;
+    for(iSpan=0; iSpan<nSpan; iSpan++){
+      fwrite(&zText[i], 1, aSpan[iSpan].iStart-i, out);
+      for(i=aSpan[iSpan].iStart; i<aSpan[iSpan].iEnd; i++){
+        putc(zText[i]=='\n' ? '\n' : ' ', out);
+      }
+    }
+    fwrite(&zText[i], 1, (size_t)(zEnd-zText)-i, out);
+    putc('\n', out);
+    lemon_free(gp, aSpan);
+    file_release_input(gp);
+    return;
+  }
+
+  /* Now scan the text of the input file */
+  if( gp->zGrammar==0 ) file_identify(ps.filename, &ps.mainid);
+  parse_text(&ps, zText, (size_t)(zEnd-zText), aSpan, nSpan);
+  lemon_free(gp, aSpan);
+  file_release_input(gp);           /* Release the input file */
   gp->rule = ps.firstrule;
+  gp->startRule = ps.mainrule;
   gp->errorcnt = ps.errorcnt;
 }
 /*************************** From the file "plink.c" *********************/
@@ -3108,34 +4704,30 @@ void Parse(struct lemon *gp)
 ** Routines processing configuration follow-set propagation links
 ** in the LEMON parser generator.
 */
-static struct plink *plink_freelist = 0;
 
 /* Allocate a new plink */
-struct plink *Plink_new(void){
+struct plink *Plink_new(struct lemon *lemp){
   struct plink *newlink;
 
-  if( plink_freelist==0 ){
+  if( lemp->plinkFreelist==0 ){
     int i;
     int amt = 100;
-    plink_freelist = (struct plink *)calloc( amt, sizeof(struct plink) );
-    if( plink_freelist==0 ){
-      fprintf(stderr,
-      "Unable to allocate memory for a new follow-set propagation link.\n");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) plink_freelist[i].next = &plink_freelist[i+1];
-    plink_freelist[amt-1].next = 0;
-  }
-  newlink = plink_freelist;
-  plink_freelist = plink_freelist->next;
+    struct plink *a;
+    a = (struct plink *)lemon_calloc(lemp, amt, sizeof(struct plink) );
+    for(i=0; i<amt-1; i++) a[i].next = &a[i+1];
+    a[amt-1].next = 0;
+    lemp->plinkFreelist = a;
+  }
+  newlink = lemp->plinkFreelist;
+  lemp->plinkFreelist = newlink->next;
   return newlink;
 }
 
 /* Add a plink to a plink list */
-void Plink_add(struct plink **plpp, struct config *cfp)
+void Plink_add(struct lemon *lemp, struct plink **plpp, struct config *cfp)
 {
   struct plink *newlink;
-  newlink = Plink_new();
+  newlink = Plink_new(lemp);
   newlink->next = *plpp;
   *plpp = newlink;
   newlink->cfp = cfp;
@@ -3154,14 +4746,14 @@ void Plink_copy(struct plink **to, struct plink *from)
 }
 
 /* Delete every plink on the list */
-void Plink_delete(struct plink *plp)
+void Plink_delete(struct lemon *lemp, struct plink *plp)
 {
   struct plink *nextpl;
 
   while( plp ){
     nextpl = plp->next;
-    plp->next = plink_freelist;
-    plink_freelist = plp;
+    plp->next = lemp->plinkFreelist;
+    lemp->plinkFreelist = plp;
     plp = nextpl;
   }
 }
@@ -3171,14 +4763,15 @@ void Plink_delete(struct plink *plp)
 */
 
 /* Generate a filename with the given suffix.  Space to hold the
-** name comes from malloc() and must be freed by the calling
+** name comes from lemon_malloc() and must be freed by the calling
 ** function.
 */
-PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
+char *file_makename(struct lemon *lemp, const char *suffix)
 {
   char *name;
   char *cp;
   char *filename = lemp->filename;
+  char *outputDir = lemp->outputDir;
   int sz;
 
   if( outputDir ){
@@ -3189,11 +4782,7 @@ PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
   sz += lemonStrlen(suffix);
   if( outputDir ) sz += lemonStrlen(outputDir) + 1;
   sz += 5;
-  name = (char*)malloc( sz );
-  if( name==0 ){
-    fprintf(stderr,"Can't allocate space for a filename.\n");
-    exit(1);
-  }
+  name = (char*)lemon_malloc(lemp, sz );
   name[0] = 0;
   if( outputDir ){
     lemon_strcpy(name, outputDir);
@@ -3206,9 +4795,109 @@ PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
   return name;
 }
 
+/* Start capturing output in memory.  Return the stream to write to,
+** or NULL if the stream cannot be created.
+*/
+FILE *memfile_open(struct memfile *p){
+  free(p->z);
+  p->z = 0;
+  p->n = 0;
+#ifdef __WIN32__
+  p->fp = tmpfile();
+#else
+  p->fp = open_memstream(&p->z, &p->n);
+#endif
+  return p->fp;
+}
+
+/* Finish capturing output in memory.  Afterwards, p->z holds the
+** zero-terminated text written to the stream and p->n is its length.
+*/
+void memfile_close(struct memfile *p){
+  if( p->fp==0 ) return;
+#ifdef __WIN32__
+  {
+    long sz;
+    fflush(p->fp);
+    fseek(p->fp,0,2);
+    sz = ftell(p->fp);
+    rewind(p->fp);
+    p->z = (char*)malloc( sz>0 ? sz+1 : 1 );
+    if( p->z ){
+      p->n = sz>0 ? fread(p->z, 1, (size_t)sz, p->fp) : 0;
+      p->z[p->n] = 0;
+    }
+  }
+#endif
+  fclose(p->fp);
+  p->fp = 0;
+}
+
+/* Return the slot in lemp->aMemfile[] for an output file suffix */
+PRIVATE int memfile_slot(const char *suffix){
+  static const char *azSuffix[] = { ".c", ".h", ".out", ".sql" };
+  int i;
+  for(i=0; i<(int)(sizeof(azSuffix)/sizeof(azSuffix[0])); i++){
+    if( strcmp(suffix, azSuffix[i])==0 ) return i;
+  }
+  if( strcmp(suffix, ".jsonl")==0 ) return MEMFILE_REPORT;
+  if( strcmp(suffix, ".tbl")==0 ) return MEMFILE_TABLES;
+  return -1;
+}
+
+/* Remember that the stream fp is open, so that it can be closed if the
+** run is abandoned because of a fatal error.  Return fp.
+*/
+PRIVATE FILE *file_track(struct lemon *lemp, FILE *fp){
+  int i;
+  if( fp==0 ) return 0;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i]==0 ){
+      lemp->apOpen[i] = fp;
+      break;
+    }
+  }
+  assert( lemp->apOpen[i]==fp );
+  return fp;
+}
+
+/* Close a stream obtained from file_open() or tplt_open() */
+void file_close(struct lemon *lemp, FILE *fp){
+  int i;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i]==fp ) lemp->apOpen[i] = 0;
+  }
+  if( lemp->aMemfile ){
+    for(i=0; i<MEMFILE_COUNT; i++){
+      if( lemp->aMemfile[i].fp==fp ){
+        memfile_close(&lemp->aMemfile[i]);
+        return;
+      }
+    }
+  }
+  fclose(fp);
+}
+
+/* Close every stream that is still open and release the input file.
+** Nothing is left open after a run that completes normally, so this
+** only does work after a fatal error.
+*/
+void file_close_all(struct lemon *lemp){
+  int i;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i] ) file_close(lemp, lemp->apOpen[i]);
+  }
+  file_release_input(lemp);
+}
+
 /* Open a file with a name based on the name of the input file,
 ** but with a different (specified) suffix, and return a pointer
-** to the stream */
+** to the stream.
+**
+** If output is being captured in memory, the stream writes into the
+** appropriate lemp->aMemfile[] slot instead, and there is never an
+** existing file to read.
+*/
 PRIVATE FILE *file_open(
   struct lemon *lemp,
   const char *suffix,
@@ -3216,15 +4905,21 @@ PRIVATE FILE *file_open(
 ){
   FILE *fp;
 
-  if( lemp->outname ) free(lemp->outname);
+  if( lemp->outname ) lemon_free(lemp, lemp->outname);
   lemp->outname = file_makename(lemp, suffix);
-  fp = fopen(lemp->outname,mode);
+  if( lemp->aMemfile ){
+    int i = memfile_slot(suffix);
+    if( *mode!='w' || i<0 ) return 0;
+    fp = memfile_open(&lemp->aMemfile[i]);
+  }else{
+    fp = fopen(lemp->outname,mode);
+  }
   if( fp==0 && *mode=='w' ){
-    fprintf(stderr,"Can't open file \"%s\".\n",lemp->outname);
+    fprintf(lemp->errstream,"Can't open file \"%s\".\n",lemp->outname);
     lemp->errorcnt++;
     return 0;
   }
-  return fp;
+  return file_track(lemp, fp);
 }
 
 /* Print the text of a rule
@@ -3255,7 +4950,8 @@ void Reprint(struct lemon *lemp)
   struct rule *rp;
   struct symbol *sp;
   int i, j, maxlen, len, ncolumns, skip;
-  printf("// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
+  FILE *out = lemp->outstream;
+  fprintf(out,"// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
   maxlen = 10;
   for(i=0; i<lemp->nsymbol; i++){
     sp = lemp->symbols[i];
@@ -3266,20 +4962,20 @@ void Reprint(struct lemon *lemp)
   if( ncolumns<1 ) ncolumns = 1;
   skip = (lemp->nsymbol + ncolumns - 1)/ncolumns;
   for(i=0; i<skip; i++){
-    printf("//");
+    fprintf(out,"//");
     for(j=i; j<lemp->nsymbol; j+=skip){
       sp = lemp->symbols[j];
       assert( sp->index==j );
-      printf(" %3d %-*.*s",j,maxlen,maxlen,sp->name);
+      fprintf(out," %3d %-*.*s",j,maxlen,maxlen,sp->name);
     }
-    printf("\n");
+    fprintf(out,"\n");
   }
   for(rp=lemp->rule; rp; rp=rp->next){
-    rule_print(stdout, rp);
-    printf(".");
-    if( rp->precsym ) printf(" [%s]",rp->precsym->name);
+    rule_print(out, rp);
+    fprintf(out,".");
+    if( rp->precsym ) fprintf(out," [%s]",rp->precsym->name);
     /* if( rp->code ) printf("\n    %s",rp->code); */
-    printf("\n");
+    fprintf(out,"\n");
   }
 }
 
@@ -3350,6 +5046,7 @@ char *tag;
 ** nothing was actually printed.
 */
 int PrintAction(
+  struct lemon *lemp,         /* The parser generator */
   struct action *ap,          /* The action to print */
   FILE *fp,                   /* Print the action here */
   int indent                  /* Indent by this amount */
@@ -3389,7 +5086,7 @@ int PrintAction(
         indent,ap->sp->name,ap->x.stp->statenum);
       break;
     case SH_RESOLVED:
-      if( showPrecedenceConflict ){
+      if( lemp->showPrecedenceConflict ){
         fprintf(fp,"%*s shift        %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.stp->statenum);
       }else{
@@ -3397,7 +5094,7 @@ int PrintAction(
       }
       break;
     case RD_RESOLVED:
-      if( showPrecedenceConflict ){
+      if( lemp->showPrecedenceConflict ){
         fprintf(fp,"%*s reduce %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.rp->iRule);
       }else{
@@ -3451,7 +5148,7 @@ void ReportOutput(struct lemon *lemp)
     }
     fprintf(fp,"\n");
     for(ap=stp->ap; ap; ap=ap->next){
-      if( PrintAction(ap,fp,30) ) fprintf(fp,"\n");
+      if( PrintAction(lemp,ap,fp,30) ) fprintf(fp,"\n");
     }
     fprintf(fp,"\n");
   }
@@ -3510,58 +5207,456 @@ void ReportOutput(struct lemon *lemp)
     }
     fprintf(fp,"\n");
   }
-  fclose(fp);
+  file_close(lemp, fp);
   return;
 }
 
-/* Search for the file "name" which is in the same directory as
-** the executable */
-PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
-{
-  const char *pathlist;
-  char *pathbufptr = 0;
-  char *pathbuf = 0;
-  char *path,*cp;
-  char c;
+/* Write zText to fp as a JSON string */
+PRIVATE void json_string(FILE *fp, const char *zText){
+  putc('"', fp);
+  for(; *zText; zText++){
+    unsigned char c = (unsigned char)*zText;
+    if( c=='"' || c=='\\' ){
+      fprintf(fp, "\\%c", c);
+    }else if( c<0x20 ){
+      fprintf(fp, "\\u%04x", c);
+    }else{
+      putc(c, fp);
+    }
+  }
+  putc('"', fp);
+}
 
-#ifdef __WIN32__
-  cp = strrchr(argv0,'\\');
-#else
-  cp = strrchr(argv0,'/');
-#endif
-  if( cp ){
-    c = *cp;
-    *cp = 0;
-    path = (char *)malloc( lemonStrlen(argv0) + lemonStrlen(name) + 2 );
-    if( path ) lemon_sprintf(path,"%s/%s",argv0,name);
-    *cp = c;
-  }else{
-    pathlist = getenv("PATH");
-    if( pathlist==0 ) pathlist = ".:/bin:/usr/bin";
-    pathbuf = (char *) malloc( lemonStrlen(pathlist) + 1 );
-    path = (char *)malloc( lemonStrlen(pathlist)+lemonStrlen(name)+2 );
-    if( (pathbuf != 0) && (path!=0) ){
-      pathbufptr = pathbuf;
-      lemon_strcpy(pathbuf, pathlist);
-      while( *pathbuf ){
-        cp = strchr(pathbuf,':');
-        if( cp==0 ) cp = &pathbuf[lemonStrlen(pathbuf)];
-        c = *cp;
-        *cp = 0;
-        lemon_sprintf(path,"%s/%s",pathbuf,name);
-        *cp = c;
-        if( c==0 ) pathbuf[0] = 0;
-        else pathbuf = &cp[1];
-        if( access(path,modemask)==0 ) break;
+/* Write the right-hand side of a rule as a JSON array of symbol names.
+** The alternatives of a multi-terminal are separated by '|'.
+*/
+PRIVATE void json_rhs(FILE *fp, struct rule *rp){
+  int i, j;
+  putc('[', fp);
+  for(i=0; i<rp->nrhs; i++){
+    struct symbol *sp = rp->rhs[i];
+    if( i>0 ) putc(',', fp);
+    if( sp->type==MULTITERMINAL ){
+      putc('"', fp);
+      for(j=0; j<sp->nsubsym; j++){
+        fprintf(fp, "%s%s", j ? "|" : "", sp->subsym[j]->name);
       }
+      putc('"', fp);
+    }else{
+      fprintf(fp, "\"%s\"", sp->name);
     }
-    free(pathbufptr);
   }
-  return path;
+  putc(']', fp);
 }
 
-/* Given an action, compute the integer value for that action
-** which is to be put in the action table of the generated machine.
+/* Write a list of integers as a JSON array */
+PRIVATE void json_int_array(FILE *fp, const long *a, int n){
+  int i;
+  putc('[', fp);
+  for(i=0; i<n; i++) fprintf(fp, i ? ",%ld" : "%ld", a[i]);
+  putc(']', fp);
+}
+
+/* Generate the report in JSON lines format, "*.jsonl".  This holds the
+** same information as the "*.out" file, as one JSON object per line:
+** the grammar, then every symbol, rule and state.  Next comes an index
+** line, holding the byte offset of every symbol, rule and state line,
+** the states with conflicts, and the states that reduce each rule.
+** The last line is exactly JSON_TRAILER_SIZE bytes long and holds the
+** offset of the index line, so that a reader can find any record
+** without reading the whole file.
+*/
+#define JSON_TRAILER_SIZE 31
+void ReportJson(struct lemon *lemp)
+{
+  static const char *azAssoc[] = { "left", "right", "nonassoc", 0 };
+  FILE *fp;
+  long *aSymOfst, *aRuleOfst, *aStateOfst, *aConflict;
+  long **aaReduce;      /* aaReduce[R] lists the states that reduce rule R */
+  int *anReduce;        /* Number of entries in each aaReduce[] */
+  int nConflict = 0;
+  long iIndex;
+  struct rule *rp;
+  int i, j, n;
+
+  fp = file_open(lemp,".jsonl","wb");
+  if( fp==0 ) return;
+  aSymOfst = (long*)lemon_calloc(lemp, lemp->nsymbol+1, sizeof(long));
+  aRuleOfst = (long*)lemon_calloc(lemp, lemp->nrule+1, sizeof(long));
+  aStateOfst = (long*)lemon_calloc(lemp, lemp->nxstate+1, sizeof(long));
+  aConflict = (long*)lemon_calloc(lemp, lemp->nxstate+1, sizeof(long));
+  aaReduce = (long**)lemon_calloc(lemp, lemp->nrule+1, sizeof(long*));
+  anReduce = (int*)lemon_calloc(lemp, lemp->nrule+1, sizeof(int));
+
+  fprintf(fp, "{\"type\":\"grammar\",\"file\":");
+  json_string(fp, lemp->filename);
+  fprintf(fp, ",\"name\":\"%s\",\"symbols\":%d,\"terminals\":%d,"
+              "\"rules\":%d,\"states\":%d,\"conflicts\":%d}\n",
+          lemp->name ? lemp->name : "Parse", lemp->nsymbol, lemp->nterminal,
+          lemp->nrule, lemp->nxstate, lemp->nconflict);
+
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    aSymOfst[i] = ftell(fp);
+    fprintf(fp, "{\"type\":\"symbol\",\"id\":%d,\"name\":\"%s\","
+                "\"terminal\":%s,\"content\":%s",
+            i, sp->name, i<lemp->nterminal ? "true" : "false",
+            sp->bContent ? "true" : "false");
+    if( sp->prec>=0 ){
+      fprintf(fp, ",\"prec\":%d", sp->prec);
+      if( azAssoc[sp->assoc] ) fprintf(fp, ",\"assoc\":\"%s\"",
+                                       azAssoc[sp->assoc]);
+    }
+    if( i>=lemp->nterminal ){
+      fprintf(fp, ",\"lambda\":%s,\"first\":[", sp->lambda ? "true":"false");
+      for(j=0, n=0; j<lemp->nterminal; j++){
+        if( sp->firstset && SetFind(sp->firstset, j) ){
+          fprintf(fp, "%s\"%s\"", n++ ? "," : "", lemp->symbols[j]->name);
+        }
+      }
+      fprintf(fp, "]");
+    }
+    fprintf(fp, "}\n");
+  }
+
+  for(rp=lemp->rule; rp; rp=rp->next){
+    aRuleOfst[rp->iRule] = ftell(fp);
+    fprintf(fp, "{\"type\":\"rule\",\"id\":%d,\"lhs\":\"%s\",\"rhs\":",
+            rp->iRule, rp->lhs->name);
+    json_rhs(fp, rp);
+    fprintf(fp, ",\"line\":%d", rp->ruleline);
+    if( rp->precsym ) fprintf(fp, ",\"prec\":\"%s\"", rp->precsym->name);
+    fprintf(fp, "}\n");
+  }
+
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    struct config *cfp;
+    struct action *ap;
+    int bConflict = 0;
+    aStateOfst[i] = ftell(fp);
+    fprintf(fp, "{\"type\":\"state\",\"id\":%d,\"configs\":[", stp->statenum);
+    for(cfp = lemp->basisflag ? stp->bp : stp->cfp; cfp;
+        cfp = lemp->basisflag ? cfp->bp : cfp->next){
+      fprintf(fp, "[%d,%d]%s", cfp->rp->iRule, cfp->dot,
+              (lemp->basisflag ? cfp->bp : cfp->next) ? "," : "");
+    }
+    fprintf(fp, "],\"actions\":[");
+    for(j=0, ap=stp->ap; ap; ap=ap->next){
+      const char *zAct;
+      int iArg = -1;
+      const char *zArg = "state";
+      int bDrop = 0;
+      switch( ap->type ){
+        case SHIFT:        zAct = "shift";   iArg = ap->x.stp->statenum; break;
+        case SSCONFLICT:   zAct = "shift";   iArg = ap->x.stp->statenum;
+                           bConflict = 1;                               break;
+        case SH_RESOLVED:  zAct = "shift";   iArg = ap->x.stp->statenum;
+                           bDrop = 1;                                   break;
+        case REDUCE:       zAct = "reduce";  break;
+        case SHIFTREDUCE:  zAct = "shift-reduce";                       break;
+        case SRCONFLICT:
+        case RRCONFLICT:   zAct = "reduce";  bConflict = 1;             break;
+        case RD_RESOLVED:  zAct = "reduce";  bDrop = 1;                 break;
+        case ACCEPT:       zAct = "accept";  break;
+        case ERROR:        zAct = "error";   break;
+        default:           zAct = 0;         break;
+      }
+      if( zAct==0 ) continue;
+      if( ap->type==REDUCE || ap->type==SHIFTREDUCE || ap->type==SRCONFLICT
+       || ap->type==RRCONFLICT || ap->type==RD_RESOLVED ){
+        rp = ap->x.rp;
+        iArg = rp->iRule;
+        zArg = "rule";
+        if( !bDrop ){
+          n = anReduce[iArg];
+          if( n==0 || aaReduce[iArg][n-1]!=stp->statenum ){
+            aaReduce[iArg] = (long*)lemon_realloc(lemp, aaReduce[iArg],
+                                                  (n+1)*sizeof(long));
+            aaReduce[iArg][n] = stp->statenum;
+            anReduce[iArg]++;
+          }
+        }
+      }
+      fprintf(fp, "%s{\"on\":\"%s\",\"do\":\"%s\"", j++ ? "," : "",
+              ap->sp->name, zAct);
+      if( iArg>=0 ) fprintf(fp, ",\"%s\":%d", zArg, iArg);
+      if( ap->spOpt ) fprintf(fp, ",\"because\":\"%s\"", ap->spOpt->name);
+      if( ap->type==SSCONFLICT || ap->type==SRCONFLICT
+       || ap->type==RRCONFLICT ){
+        fprintf(fp, ",\"conflict\":true");
+      }
+      if( bDrop ) fprintf(fp, ",\"dropped\":true");
+      putc('}', fp);
+    }
+    fprintf(fp, "]}\n");
+    if( bConflict ) aConflict[nConflict++] = stp->statenum;
+  }
+
+  iIndex = ftell(fp);
+  fprintf(fp, "{\"type\":\"index\",\"symbols\":");
+  json_int_array(fp, aSymOfst, lemp->nsymbol);
+  fprintf(fp, ",\"rules\":");
+  json_int_array(fp, aRuleOfst, lemp->nrule);
+  fprintf(fp, ",\"states\":");
+  json_int_array(fp, aStateOfst, lemp->nxstate);
+  fprintf(fp, ",\"conflicts\":");
+  json_int_array(fp, aConflict, nConflict);
+  fprintf(fp, ",\"reduces\":[");
+  for(i=0; i<lemp->nrule; i++){
+    if( i>0 ) putc(',', fp);
+    json_int_array(fp, aaReduce[i], anReduce[i]);
+    lemon_free(lemp, aaReduce[i]);
+  }
+  fprintf(fp, "]}\n");
+  fprintf(fp, "{\"index\":%20ld}\n", iIndex);
+  file_close(lemp, fp);
+  lemon_free(lemp, aSymOfst);
+  lemon_free(lemp, aRuleOfst);
+  lemon_free(lemp, aStateOfst);
+  lemon_free(lemp, aConflict);
+  lemon_free(lemp, aaReduce);
+  lemon_free(lemp, anReduce);
+}
+
+/* Read the line of fp that starts at byte offset iOfst, without the
+** newline.  Return NULL if there is no such line.  The result is
+** obtained from lemon_malloc().
+*/
+PRIVATE char *json_read_line(struct lemon *lemp, FILE *fp, long iOfst){
+  size_t n = 0;
+  size_t nAlloc = 1000;
+  char *z;
+  int c;
+  if( iOfst<0 || fseek(fp, iOfst, SEEK_SET)!=0 ) return 0;
+  z = (char*)lemon_malloc(lemp, nAlloc);
+  while( (c = getc(fp))!=EOF && c!='\n' ){
+    if( n+1>=nAlloc ){
+      nAlloc *= 2;
+      z = (char*)lemon_realloc(lemp, z, nAlloc);
+    }
+    z[n++] = (char)c;
+  }
+  z[n] = 0;
+  if( n==0 && c==EOF ){
+    lemon_free(lemp, z);
+    return 0;
+  }
+  return z;
+}
+
+/* Return the first entry of the integer array zKey in the index line
+** zIndex, or NULL if there is no such array.  For "reduces", which is an
+** array of arrays, return the first entry of the iSub-th inner array.
+*/
+PRIVATE const char *json_index_array(
+  const char *zIndex,          /* The index line */
+  const char *zKey,            /* Name of the array */
+  int iSub                     /* Inner array, or -1 */
+){
+  char zPattern[40];
+  const char *z;
+  lemon_sprintf(zPattern, "\"%s\":[", zKey);
+  z = strstr(zIndex, zPattern);
+  if( z==0 ) return 0;
+  z += lemonStrlen(zPattern);
+  for(; iSub>=0; iSub--){
+    while( *z && *z!='[' && *z!=']' ) z++;
+    if( *z!='[' ) return 0;
+    z++;
+    if( iSub>0 ){
+      while( *z && *z!=']' ) z++;
+      if( *z ) z++;
+    }
+  }
+  return z;
+}
+
+/* Store in *piVal the integer at *pz, an element of an array, and
+** advance *pz past it.  Return 0 at the end of the array.
+*/
+PRIVATE int json_next_int(const char **pz, long *piVal){
+  const char *z = *pz;
+  char *zEnd;
+  while( *z==',' || ISSPACE(*z) ) z++;
+  if( !ISDIGIT(*z) ) return 0;
+  *piVal = strtol(z, &zEnd, 10);
+  *pz = zEnd;
+  return 1;
+}
+
+/* Store in *piVal the N-th element of the array that starts at z.
+** Return 0 if the array is shorter than that.
+*/
+PRIVATE int json_nth_int(const char *z, long N, long *piVal){
+  if( z==0 || N<0 ) return 0;
+  while( json_next_int(&z, piVal) ){
+    if( N--==0 ) return 1;
+  }
+  return 0;
+}
+
+/* Copy the line of fp that starts at byte iOfst onto the output */
+PRIVATE int json_show(struct lemon *lemp, FILE *fp, long iOfst){
+  char *z = json_read_line(lemp, fp, iOfst);
+  if( z==0 ) return 0;
+  fprintf(lemp->outstream, "%s\n", z);
+  lemon_free(lemp, z);
+  return 1;
+}
+
+/* Answer a query (-Q) about the automaton, using the "*.jsonl" report
+** written by an earlier run with -J.  Only the index and the lines that
+** are asked for are read.  The queries are:
+**
+**     grammar        Totals for the whole grammar
+**     state=N        State N
+**     rule=N         Rule N
+**     symbol=NAME    The symbol called NAME
+**     reduces=N      Every state that reduces rule N
+**     conflicts      Every state that has a parsing conflict
+**
+** The matching lines of the report are copied onto the output.  Return
+** the exit code for the stand-alone program.
+*/
+int ReportQuery(struct lemon *lemp)
+{
+  const char *zQuery = lemp->zQuery;
+  const char *zArg = strchr(zQuery, '=');
+  int nCmd = zArg ? (int)(zArg-zQuery) : lemonStrlen(zQuery);
+  const char *z;
+  char *zIndex;
+  long iOfst, iArg = -1;
+  int nFound = 0;
+  FILE *fp;
+
+  if( zArg ){
+    zArg++;
+    if( ISDIGIT(zArg[0]) ) iArg = atol(zArg);
+  }
+  lemp->outname = file_makename(lemp, ".jsonl");
+  fp = fopen(lemp->outname, "rb");
+  if( fp==0 ){
+    fprintf(lemp->errstream,
+       "Can't open \"%s\".  Generate it first with the -J option.\n",
+       lemp->outname);
+    return 1;
+  }
+  file_track(lemp, fp);
+  zIndex = 0;
+  if( fseek(fp, -JSON_TRAILER_SIZE, SEEK_END)==0 ){
+    char *zTrailer = json_read_line(lemp, fp, ftell(fp));
+    if( zTrailer && strncmp(zTrailer, "{\"index\":", 9)==0 ){
+      zIndex = json_read_line(lemp, fp, atol(&zTrailer[9]));
+    }
+    lemon_free(lemp, zTrailer);
+  }
+  if( zIndex==0 || strncmp(zIndex, "{\"type\":\"index\"", 15)!=0 ){
+    fprintf(lemp->errstream, "%s: not a JSON lines report.\n",
+            lemp->outname);
+    file_close(lemp, fp);
+    return 1;
+  }
+
+  if( nCmd==7 && strncmp(zQuery, "grammar", 7)==0 ){
+    nFound = json_show(lemp, fp, 0);
+  }else if( nCmd==5 && strncmp(zQuery, "state", 5)==0 ){
+    z = json_index_array(zIndex, "states", -1);
+    if( json_nth_int(z, iArg, &iOfst) ) nFound = json_show(lemp, fp, iOfst);
+  }else if( nCmd==4 && strncmp(zQuery, "rule", 4)==0 ){
+    z = json_index_array(zIndex, "rules", -1);
+    if( json_nth_int(z, iArg, &iOfst) ) nFound = json_show(lemp, fp, iOfst);
+  }else if( nCmd==6 && strncmp(zQuery, "symbol", 6)==0 && zArg ){
+    char *zPattern = (char*)lemon_malloc(lemp, lemonStrlen(zArg)+20);
+    lemon_sprintf(zPattern, ",\"name\":\"%s\",", zArg);
+    z = json_index_array(zIndex, "symbols", -1);
+    while( z && nFound==0 && json_next_int(&z, &iOfst) ){
+      char *zLine = json_read_line(lemp, fp, iOfst);
+      if( zLine && strstr(zLine, zPattern) ){
+        fprintf(lemp->outstream, "%s\n", zLine);
+        nFound = 1;
+      }
+      lemon_free(lemp, zLine);
+    }
+    lemon_free(lemp, zPattern);
+  }else if( (nCmd==7 && strncmp(zQuery, "reduces", 7)==0 && iArg>=0)
+         || (nCmd==9 && strncmp(zQuery, "conflicts", 9)==0) ){
+    /* Any number of states, including none, is a valid answer */
+    const char *zStates = json_index_array(zIndex, "states", -1);
+    long iState;
+    z = nCmd==7 ? json_index_array(zIndex, "reduces", (int)iArg)
+                : json_index_array(zIndex, "conflicts", -1);
+    nFound = z!=0;
+    while( z && json_next_int(&z, &iState) ){
+      if( json_nth_int(zStates, iState, &iOfst) ) json_show(lemp, fp, iOfst);
+    }
+  }else{
+    fprintf(lemp->errstream, "Unknown query \"%s\".  Use grammar, state=N, "
+       "rule=N, symbol=NAME, reduces=N or conflicts.\n", zQuery);
+    file_close(lemp, fp);
+    return 1;
+  }
+  file_close(lemp, fp);
+  if( nFound==0 ){
+    fprintf(lemp->errstream, "No match for \"%s\".\n", zQuery);
+    return 1;
+  }
+  return 0;
+}
+
+/* Search for the file "name" which is in the same directory as
+** the executable */
+PRIVATE char *pathsearch(
+  struct lemon *lemp,
+  char *argv0,
+  char *name,
+  int modemask
+)
+{
+  const char *pathlist;
+  char *pathbufptr = 0;
+  char *pathbuf = 0;
+  char *path,*cp;
+  char c;
+
+#ifdef __WIN32__
+  cp = strrchr(argv0,'\\');
+#else
+  cp = strrchr(argv0,'/');
+#endif
+  if( cp ){
+    c = *cp;
+    *cp = 0;
+    path = (char *)lemon_malloc(lemp, lemonStrlen(argv0)+lemonStrlen(name)+2);
+    lemon_sprintf(path,"%s/%s",argv0,name);
+    *cp = c;
+  }else{
+    pathlist = getenv("PATH");
+    if( pathlist==0 ) pathlist = ".:/bin:/usr/bin";
+    pathbuf = (char *) lemon_malloc(lemp, lemonStrlen(pathlist) + 1 );
+    path = (char *)lemon_malloc(lemp, lemonStrlen(pathlist)+lemonStrlen(name)+2);
+    {
+      pathbufptr = pathbuf;
+      lemon_strcpy(pathbuf, pathlist);
+      while( *pathbuf ){
+        cp = strchr(pathbuf,':');
+        if( cp==0 ) cp = &pathbuf[lemonStrlen(pathbuf)];
+        c = *cp;
+        *cp = 0;
+        lemon_sprintf(path,"%s/%s",pathbuf,name);
+        *cp = c;
+        if( c==0 ) pathbuf[0] = 0;
+        else pathbuf = &cp[1];
+        if( access(path,modemask)==0 ) break;
+      }
+    }
+    lemon_free(lemp, pathbufptr);
+  }
+  return path;
+}
+
+/* Given an action, compute the integer value for that action
+** which is to be put in the action table of the generated machine.
 ** Return negative if no action should be generated.
 */
 PRIVATE int compute_action(struct lemon *lemp, struct action *ap)
@@ -3633,65 +5728,97 @@ PRIVATE void tplt_skip_header(FILE *in, int *lineno)
   }
 }
 
+/* Return the name of the template file that is used if no template is
+** given with -T: a "*.lt" file next to the grammar, or else "lempar.c" in
+** the current directory or next to the lemon program.  Return NULL if
+** there is no such file.  The name is obtained from lemon_malloc().
+*/
+char *tplt_find(struct lemon *lemp)
+{
+  static char templatename[] = "lempar.c";
+  char buf[1000];
+  char *cp;
+
+  cp = strrchr(lemp->filename,'.');
+  if( cp ){
+    lemon_sprintf(buf,"%.*s.lt",(int)(cp-lemp->filename),lemp->filename);
+  }else{
+    lemon_sprintf(buf,"%s.lt",lemp->filename);
+  }
+  if( access(buf,004)==0 ){
+    return lemon_strdup(lemp, buf);
+  }else if( access(templatename,004)==0 ){
+    return lemon_strdup(lemp, templatename);
+  }else if( lemp->argv0 ){
+    return pathsearch(lemp,lemp->argv0,templatename,0);
+  }
+  return 0;
+}
+
 /* The next function finds the template file and opens it, returning
 ** a pointer to the opened file. */
 PRIVATE FILE *tplt_open(struct lemon *lemp)
 {
-  static char templatename[] = "lempar.c";
-  char buf[1000];
   FILE *in;
   char *tpltname;
-  char *toFree = 0;
-  char *cp;
+
+  /* A library caller may supply the text of the template directly */
+  if( lemp->zTemplate ){
+#ifdef __WIN32__
+    in = tmpfile();
+    if( in ){
+      fwrite(lemp->zTemplate, 1, lemp->nTemplate, in);
+      rewind(in);
+    }
+#else
+    in = fmemopen((void*)lemp->zTemplate, lemp->nTemplate, "rb");
+#endif
+    if( in==0 ){
+      fprintf(lemp->errstream,"Can't read the parser driver template.\n");
+      lemp->errorcnt++;
+      return 0;
+    }
+    return file_track(lemp, in);
+  }
 
   /* first, see if user specified a template filename on the command line. */
-  if (user_templatename != 0) {
-    if( access(user_templatename,004)==-1 ){
-      fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
-        user_templatename);
+  if (lemp->templatename != 0) {
+    if( access(lemp->templatename,004)==-1 ){
+      fprintf(lemp->errstream,
+        "Can't find the parser driver template file \"%s\".\n",
+        lemp->templatename);
       lemp->errorcnt++;
       return 0;
     }
-    in = fopen(user_templatename,"rb");
+    in = fopen(lemp->templatename,"rb");
     if( in==0 ){
-      fprintf(stderr,"Can't open the template file \"%s\".\n",
-              user_templatename);
+      fprintf(lemp->errstream,"Can't open the template file \"%s\".\n",
+              lemp->templatename);
       lemp->errorcnt++;
       return 0;
     }
-    return in;
+    return file_track(lemp, in);
   }
 
-  cp = strrchr(lemp->filename,'.');
-  if( cp ){
-    lemon_sprintf(buf,"%.*s.lt",(int)(cp-lemp->filename),lemp->filename);
-  }else{
-    lemon_sprintf(buf,"%s.lt",lemp->filename);
-  }
-  if( access(buf,004)==0 ){
-    tpltname = buf;
-  }else if( access(templatename,004)==0 ){
-    tpltname = templatename;
-  }else{
-    toFree = tpltname = pathsearch(lemp->argv0,templatename,0);
-  }
+  tpltname = tplt_find(lemp);
   if( tpltname==0 ){
-    fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
-    templatename);
+    fprintf(lemp->errstream,
+    "Can't find the parser driver template file \"lempar.c\".\n");
     lemp->errorcnt++;
     return 0;
   }
   in = fopen(tpltname,"rb");
   if( in==0 ){
-    fprintf(stderr,"Can't open the template file \"%s\".\n",tpltname);
+    fprintf(lemp->errstream,"Can't open the template file \"%s\".\n",
+            tpltname);
     lemp->errorcnt++;
   }
-  free(toFree);
-  return in;
+  lemon_free(lemp, tpltname);
+  return file_track(lemp, in);
 }
 
 /* Print a #line directive line to the output file. */
-PRIVATE void tplt_linedir(FILE *out, int lineno, char *filename)
+PRIVATE void tplt_linedir(FILE *out, int lineno, const char *filename)
 {
   fprintf(out,"#line %d \"",lineno);
   while( *filename ){
@@ -3742,7 +5869,7 @@ void emit_destructor_code(
    fprintf(out,"{\n"); (*lineno)++;
    if( !lemp->nolinenosflag ){
      (*lineno)++;
-     tplt_linedir(out,sp->destLineno,lemp->filename);
+     tplt_linedir(out,sp->destLineno,sp->destFilename);
    }
  }else if( lemp->vardest ){
    cp = lemp->vardest;
@@ -3753,7 +5880,8 @@ void emit_destructor_code(
  }
  for(; *cp; cp++){
    if( *cp=='$' && cp[1]=='$' ){
-     fprintf(out,"(yypminor->yy%d)",sp->dtnum);
+     fprintf(out,sp->iBox ? "(*yypminor->yy%d)" : "(yypminor->yy%d)",
+             sp->dtnum);
      cp++;
      continue;
    }
@@ -3769,13 +5897,16 @@ void emit_destructor_code(
 }
 
 /*
-** Return TRUE (non-zero) if the given symbol has a destructor.
+** Return TRUE (non-zero) if the given symbol has a destructor.  The
+** values of the symbols named by %arena need none.
 */
 int has_destructor(struct symbol *sp, struct lemon *lemp)
 {
   int ret;
   if( sp->type==TERMINAL ){
     ret = lemp->tokendest!=0;
+  }else if( sp->bArena ){
+    ret = 0;
   }else{
     ret = lemp->vardest!=0 || sp->destructor!=0;
   }
@@ -3794,16 +5925,20 @@ int has_destructor(struct symbol *sp, struct lemon *lemp)
 **
 ** If n==-1, then the previous character is overwritten.
 */
-PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
-  static char empty[1] = { 0 };
-  static char *z = 0;
-  static int alloced = 0;
-  static int used = 0;
+PRIVATE char *append_str(
+  struct lemon *lemp,
+  const char *zText,
+  int n,
+  int p1,
+  int p2
+){
+  char *z = lemp->zAppend;
+  int used = lemp->nAppendUsed;
   int c;
   char zInt[40];
   if( zText==0 ){
     if( used==0 && z!=0 ) z[0] = 0;
-    used = 0;
+    lemp->nAppendUsed = 0;
     return z;
   }
   if( n<=0 ){
@@ -3813,11 +5948,10 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
     n = lemonStrlen(zText);
   }
-  if( (int) (n+sizeof(zInt)*2+used) >= alloced ){
-    alloced = n + sizeof(zInt)*2 + used + 200;
-    z = (char *) realloc(z,  alloced);
+  if( (int) (n+sizeof(zInt)*2+used) >= lemp->nAppendAlloc ){
+    lemp->nAppendAlloc = n + sizeof(zInt)*2 + used + 200;
+    z = lemp->zAppend = (char *) lemon_realloc(lemp, z, lemp->nAppendAlloc);
   }
-  if( z==0 ) return empty;
   while( n-- > 0 ){
     c = *(zText++);
     if( c=='%' && n>0 && zText[0]=='d' ){
@@ -3832,9 +5966,116 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
   }
   z[used] = 0;
+  lemp->nAppendUsed = used;
   return z;
 }
 
+PRIVATE int type_size(const char*);
+
+/*
+** Return the name of the C datatype of the values of symbol sp.
+*/
+PRIVATE const char *symbol_type(struct lemon *lemp, struct symbol *sp){
+  if( sp->type==MULTITERMINAL ) sp = sp->subsym[0];
+  if( sp==lemp->errsym ) return "int";
+  if( sp->dtnum==0 ) return lemp->tokentype ? lemp->tokentype : "void*";
+  return sp->datatype ? sp->datatype : lemp->vartype;
+}
+
+/*
+** Return the offset of the first character before z[i] that is not a
+** space, or -1 if there is none.
+*/
+PRIVATE int prev_nonspace(const char *z, int i){
+  for(i--; i>=0 && ISSPACE(z[i]); i--){}
+  return i;
+}
+
+/*
+** Return TRUE if the code of rule rp can write the value of its LHS
+** label straight into the stack entry of its left-most RHS label, which
+** has a different name, although the code has no overwrite comment.
+** That entry then holds both values, so this is only so if the RHS
+** value is never read once the LHS is written.  The analysis is textual
+** and gives up easily.  It must find that:
+**
+**   +  The RHS value is a scalar or a pointer, so that no pointer into the
+**      entry can come from it, and its address is never taken.
+**   +  The code has no loops or jumps, so it runs in the order in which
+**      it is written.
+**   +  The first use of the LHS label starts a statement that assigns to
+**      it or to one of its fields, "A = ...;" or "A.x = ...;", and the
+**      right of that assignment is one expression, with no comma operator
+**      and no other use of the LHS label, so nothing in it runs after
+**      the store.
+**   +  The RHS label is only used before that statement, or on the right
+**      of its assignment, which C evaluates before the store.
+*/
+PRIVATE int lhs_overwrite_safe(struct lemon *lemp, struct rule *rp){
+  static const char *azJump[] = { "for", "while", "do", "goto", "switch" };
+  const char *z = rp->code;
+  int i, j, n, k;
+  int iFirstLhs = -1;    /* Offset of the first use of the LHS label */
+  int iAssign = -1;      /* Offset of the "=" of that statement */
+  int iEnd = -1;         /* Offset of the ";" that ends it */
+  int depth;
+
+  if( rp->nrhs==0 || rp->rhs[0]->iBox || rp->lhs->iBox ) return 0;
+  if( type_size(symbol_type(lemp, rp->rhs[0]))<0 ) return 0;
+  for(i=0; z[i]; i++){
+    if( !ISALPHA(z[i]) && z[i]!='_' ) continue;
+    if( i>0 && (ISALNUM(z[i-1]) || z[i-1]=='_') ) continue;
+    for(n=1; ISALNUM(z[i+n]) || z[i+n]=='_'; n++){}
+    for(k=0; k<(int)(sizeof(azJump)/sizeof(azJump[0])); k++){
+      if( lemonStrlen(azJump[k])==n && strncmp(&z[i],azJump[k],n)==0 ){
+        return 0;
+      }
+    }
+    if( lemonStrlen(rp->rhsalias[0])==n
+     && strncmp(&z[i],rp->rhsalias[0],n)==0
+     && (i==0 || z[i-1]!='@') ){
+      j = prev_nonspace(z, i);
+      if( j>=0 && z[j]=='&' && (j==0 || z[j-1]!='&') ) return 0;
+      if( iFirstLhs>=0 && (i<iAssign || i>iEnd) ) return 0;
+    }else if( iFirstLhs<0 && lemonStrlen(rp->lhsalias)==n
+           && strncmp(&z[i],rp->lhsalias,n)==0 ){
+      /* The statement must start here */
+      j = prev_nonspace(z, i);
+      if( j>=0 && strchr(";{})", z[j])==0
+       && !(j>=3 && strncmp(&z[j-3],"else",4)==0
+            && (j==3 || (!ISALNUM(z[j-4]) && z[j-4]!='_'))) ){
+        return 0;
+      }
+      /* Then be an assignment to the label or to its fields */
+      for(j=i+n; ; ){
+        while( ISSPACE(z[j]) ) j++;
+        if( z[j]!='.' ) break;
+        for(j++; ISSPACE(z[j]); j++){}
+        if( !ISALPHA(z[j]) && z[j]!='_' ) return 0;
+        while( ISALNUM(z[j]) || z[j]=='_' ) j++;
+      }
+      if( z[j]!='=' || z[j+1]=='=' ) return 0;
+      iFirstLhs = i;
+      iAssign = j;
+      for(depth=0, j++; z[j] && (depth>0 || z[j]!=';'); j++){
+        if( z[j]=='(' || z[j]=='[' || z[j]=='{' ) depth++;
+        if( z[j]==')' || z[j]==']' || z[j]=='}' ) depth--;
+        if( depth<0 || (depth==0 && z[j]==',') ) return 0;
+        if( (ISALPHA(z[j]) || z[j]=='_')
+         && !ISALNUM(z[j-1]) && z[j-1]!='_'
+         && strncmp(&z[j],rp->lhsalias,n)==0
+         && !ISALNUM(z[j+n]) && z[j+n]!='_' ){
+          return 0;
+        }
+      }
+      if( z[j]!=';' ) return 0;
+      iEnd = j;
+    }
+    i += n-1;
+  }
+  return iFirstLhs>=0;
+}
+
 /*
 ** Write and transform the rp->code string so that symbols are expanded.
 ** Populate the rp->codePrefix and rp->codeSuffix strings, as appropriate.
@@ -3850,10 +6091,17 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
   const char *zSkip = 0; /* The zOvwrt comment within rp->code, or NULL */
   char lhsused = 0;      /* True if the LHS element has been used */
   char lhsdirect;        /* True if LHS writes directly into stack */
+  char lhsproven = 0;    /* True if lhs_overwrite_safe() allowed lhsdirect */
   char used[MAXRHS];     /* True for each RHS element which is used */
   char zLhs[50];         /* Convert the LHS symbol into this string */
   char zOvwrt[900];      /* Comment that to allow LHS to overwrite RHS */
+  char zDtor[80];        /* Destructor call for an unused RHS value */
+  const char *zMinor;    /* The value of a stack entry, given its offset */
+  int boxShared = 0;     /* True if the LHS keeps the box of the RHS[0] */
 
+  /* With -A, the values are in an array of their own, next to yymsp */
+  zMinor = lemp->stackArrays ? "yyvsp[%d]" : "yymsp[%d].minor";
+  lemon_sprintf(zDtor, "  yy_destructor(yypParser,%%d,&%s);\n", zMinor);
   for(i=0; i<rp->nrhs; i++) used[i] = 0;
   lhsused = 0;
 
@@ -3875,10 +6123,9 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     ** we have to call the destructor on the RHS symbol first. */
     lhsdirect = 1;
     if( has_destructor(rp->rhs[0],lemp) ){
-      append_str(0,0,0,0);
-      append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-                 rp->rhs[0]->index,1-rp->nrhs);
-      rp->codePrefix = Strsafe(append_str(0,0,0,0));
+      append_str(lemp,0,0,0,0);
+      append_str(lemp,zDtor,0,rp->rhs[0]->index,1-rp->nrhs);
+      rp->codePrefix = Strsafe(lemp,append_str(lemp,0,0,0,0));
       rp->noCode = 0;
     }
   }else if( rp->lhsalias==0 ){
@@ -3891,7 +6138,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     lhsused = 1;
     used[0] = 1;
     if( rp->lhs->dtnum!=rp->rhs[0]->dtnum ){
-      ErrorMsg(lemp->filename,rp->ruleline,
+      ErrorMsg(lemp,rp->filename,rp->ruleline,
         "%s(%s) and %s(%s) share the same label but have "
         "different datatypes.",
         rp->lhs->name, rp->lhsalias, rp->rhs[0]->name, rp->rhsalias[0]);
@@ -3905,23 +6152,61 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       /* The code contains a special comment that indicates that it is safe
       ** for the LHS label to overwrite left-most RHS label. */
       lhsdirect = 1;
+    }else if( lhs_overwrite_safe(lemp, rp) ){
+      /* The code never reads the RHS value after writing the LHS */
+      lhsdirect = 1;
+      lhsproven = 1;
     }else{
       lhsdirect = 0;
     }
   }
+
+  /* With -Z, a boxed value is reached through the handle in the stack.
+  ** The LHS takes over the box of the left-most RHS symbol when they
+  ** are of the same type and the LHS may overwrite the RHS value.
+  ** Otherwise it gets a box of its own, which is only stored into the
+  ** stack once the RHS boxes have been given back. */
+  if( rp->lhs->iBox ){
+    boxShared = rp->nrhs>0 && rp->rhs[0]->type!=MULTITERMINAL
+             && rp->rhs[0]->dtnum==rp->lhs->dtnum
+             && (rp->rhsalias[0]==0 || rp->lhsalias==0 || zSkip!=0
+                 || strcmp(rp->lhsalias,rp->rhsalias[0])==0);
+    if( !boxShared ){
+      const char *zType = rp->lhs->datatype;
+      if( zType==0 ) zType = lemp->vartype;
+      lhsdirect = 0;
+      append_str(lemp,0,0,0,0);
+      if( rp->codePrefix ) append_str(lemp,rp->codePrefix,0,0,0);
+      append_str(lemp,"  yylhsminor.yy%d = ",0,rp->lhs->dtnum,0);
+      append_str(lemp,"(",0,0,0);
+      append_str(lemp,zType,0,0,0);
+      append_str(lemp,"*)yyBoxTake(yypParser,%d);\n",0,rp->lhs->iBox-1,0);
+      rp->codePrefix = Strsafe(lemp,append_str(lemp,0,0,0,0));
+      rp->noCode = 0;
+    }
+  }else if( lhsdirect && rp->lhsalias && rp->nrhs>0 && rp->rhs[0]->iBox ){
+    /* Writing the LHS would overwrite the handle of the RHS[0] box */
+    lhsdirect = 0;
+  }
   if( lhsdirect ){
-    sprintf(zLhs, "yymsp[%d].minor.yy%d",1-rp->nrhs,rp->lhs->dtnum);
+    sprintf(zLhs, "%s", rp->lhs->iBox ? "(*" : "");
+    sprintf(&zLhs[lemonStrlen(zLhs)], zMinor, 1-rp->nrhs);
+    sprintf(&zLhs[lemonStrlen(zLhs)], ".yy%d%s", rp->lhs->dtnum,
+            rp->lhs->iBox ? ")" : "");
+  }else if( rp->lhs->iBox ){
+    rc = 1;
+    sprintf(zLhs, "(*yylhsminor.yy%d)",rp->lhs->dtnum);
   }else{
     rc = 1;
     sprintf(zLhs, "yylhsminor.yy%d",rp->lhs->dtnum);
   }
 
-  append_str(0,0,0,0);
+  append_str(lemp,0,0,0,0);
 
   /* This const cast is wrong but harmless, if we're careful. */
   for(cp=(char *)rp->code; *cp; cp++){
     if( cp==zSkip ){
-      append_str(zOvwrt,0,0,0);
+      append_str(lemp,zOvwrt,0,0,0);
       cp += lemonStrlen(zOvwrt)-1;
       dontUseRhs0 = 1;
       continue;
@@ -3932,21 +6217,21 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       saved = *xp;
       *xp = 0;
       if( rp->lhsalias && strcmp(cp,rp->lhsalias)==0 ){
-        append_str(zLhs,0,0,0);
+        append_str(lemp,zLhs,0,0,0);
         cp = xp;
         lhsused = 1;
       }else{
         for(i=0; i<rp->nrhs; i++){
           if( rp->rhsalias[i] && strcmp(cp,rp->rhsalias[i])==0 ){
             if( i==0 && dontUseRhs0 ){
-              ErrorMsg(lemp->filename,rp->ruleline,
+              ErrorMsg(lemp,rp->filename,rp->ruleline,
                  "Label %s used after '%s'.",
                  rp->rhsalias[0], zOvwrt);
               lemp->errorcnt++;
             }else if( cp!=rp->code && cp[-1]=='@' ){
               /* If the argument is of the form @X then substituted
               ** the token number of X, not the value of X */
-              append_str("yymsp[%d].major",-1,i-rp->nrhs+1,0);
+              append_str(lemp,"yymsp[%d].major",-1,i-rp->nrhs+1,0);
             }else{
               struct symbol *sp = rp->rhs[i];
               int dtnum;
@@ -3955,7 +6240,10 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
               }else{
                 dtnum = sp->dtnum;
               }
-              append_str("yymsp[%d].minor.yy%d",0,i-rp->nrhs+1, dtnum);
+              if( sp->iBox ) append_str(lemp,"(*",0,0,0);
+              append_str(lemp,zMinor,0,i-rp->nrhs+1,0);
+              append_str(lemp,".yy%d",0,dtnum,0);
+              if( sp->iBox ) append_str(lemp,")",0,0,0);
             }
             cp = xp;
             used[i] = 1;
@@ -3965,17 +6253,17 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       }
       *xp = saved;
     }
-    append_str(cp, 1, 0, 0);
+    append_str(lemp,cp, 1, 0, 0);
   } /* End loop */
 
   /* Main code generation completed */
-  cp = append_str(0,0,0,0);
-  if( cp && cp[0] ) rp->code = Strsafe(cp);
-  append_str(0,0,0,0);
+  cp = append_str(lemp,0,0,0,0);
+  if( cp && cp[0] ) rp->code = Strsafe(lemp,cp);
+  append_str(lemp,0,0,0,0);
 
   /* Check to make sure the LHS has been used */
   if( rp->lhsalias && !lhsused ){
-    ErrorMsg(lemp->filename,rp->ruleline,
+    ErrorMsg(lemp,rp->filename,rp->ruleline,
       "Label \"%s\" for \"%s(%s)\" is never used.",
         rp->lhsalias,rp->lhs->name,rp->lhsalias);
     lemp->errorcnt++;
@@ -3989,7 +6277,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       if( i>0 ){
         int j;
         if( rp->lhsalias && strcmp(rp->lhsalias,rp->rhsalias[i])==0 ){
-          ErrorMsg(lemp->filename,rp->ruleline,
+          ErrorMsg(lemp,rp->filename,rp->ruleline,
             "%s(%s) has the same label as the LHS but is not the left-most "
             "symbol on the RHS.",
             rp->rhs[i]->name, rp->rhsalias[i]);
@@ -3997,7 +6285,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
         }
         for(j=0; j<i; j++){
           if( rp->rhsalias[j] && strcmp(rp->rhsalias[j],rp->rhsalias[i])==0 ){
-            ErrorMsg(lemp->filename,rp->ruleline,
+            ErrorMsg(lemp,rp->filename,rp->ruleline,
               "Label %s used for multiple symbols on the RHS of a rule.",
               rp->rhsalias[i]);
             lemp->errorcnt++;
@@ -4006,32 +6294,51 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
         }
       }
       if( !used[i] ){
-        ErrorMsg(lemp->filename,rp->ruleline,
+        ErrorMsg(lemp,rp->filename,rp->ruleline,
           "Label %s for \"%s(%s)\" is never used.",
           rp->rhsalias[i],rp->rhs[i]->name,rp->rhsalias[i]);
         lemp->errorcnt++;
       }
     }else if( i>0 && has_destructor(rp->rhs[i],lemp) ){
-      append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-         rp->rhs[i]->index,i-rp->nrhs+1);
+      append_str(lemp,zDtor,0,rp->rhs[i]->index,i-rp->nrhs+1);
     }
   }
 
+  /* Give back the boxes of the RHS values */
+  for(i=0; i<rp->nrhs; i++){
+    if( rp->rhs[i]->type==MULTITERMINAL || rp->rhs[i]->iBox==0 ) continue;
+    if( i==0 && boxShared ) continue;
+    append_str(lemp,"  yyBoxFree(yypParser,%d,",0,rp->rhs[i]->iBox-1,0);
+    append_str(lemp,zMinor,0,i-rp->nrhs+1,0);
+    append_str(lemp,".yy%d);\n",0,rp->rhs[i]->dtnum,0);
+  }
+
   /* If unable to write LHS values directly into the stack, write the
   ** saved LHS value now. */
   if( lhsdirect==0 ){
-    append_str("  yymsp[%d].minor.yy%d = ", 0, 1-rp->nrhs, rp->lhs->dtnum);
-    append_str(zLhs, 0, 0, 0);
-    append_str(";\n", 0, 0, 0);
+    append_str(lemp,"  ",0,0,0);
+    append_str(lemp,zMinor,0,1-rp->nrhs,0);
+    append_str(lemp,".yy%d = ",0,rp->lhs->dtnum,0);
+    if( rp->lhs->iBox ){
+      append_str(lemp,"yylhsminor.yy%d;\n",0,rp->lhs->dtnum,0);
+    }else{
+      append_str(lemp,zLhs, 0, 0, 0);
+      append_str(lemp,";\n", 0, 0, 0);
+    }
   }
 
   /* Suffix code generation complete */
-  cp = append_str(0,0,0,0);
+  cp = append_str(lemp,0,0,0,0);
   if( cp && cp[0] ){
-    rp->codeSuffix = Strsafe(cp);
+    rp->codeSuffix = Strsafe(lemp,cp);
     rp->noCode = 0;
   }
 
+  if( lhsdirect ){
+    if( lhsproven ) lemp->nLhsInPlace++;
+  }else{
+    lemp->nLhsCopy++;
+  }
   return rc;
 }
 
@@ -4057,7 +6364,7 @@ PRIVATE void emit_code(
  if( rp->code ){
    if( !lemp->nolinenosflag ){
      (*lineno)++;
-     tplt_linedir(out,rp->line,lemp->filename);
+     tplt_linedir(out,rp->line,rp->filename);
    }
    fprintf(out,"{%s",rp->code);
    for(cp=rp->code; *cp; cp++){ if( *cp=='\n' ) (*lineno)++; }
@@ -4081,21 +6388,128 @@ PRIVATE void emit_code(
  return;
 }
 
+/*
+** Return the estimated number of bytes that one entry of the parser
+** stack takes, given nHead bytes for its state and major token number
+** and a YYMINORTYPE of szUnion bytes aligned to align bytes, or -1 if
+** szUnion is unknown.  With -A the three parts are in arrays of their
+** own and need no padding.
+*/
+PRIVATE int stack_entry_size(
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int nHead,                  /* sizeof(YYACTIONTYPE)+sizeof(YYCODETYPE) */
+  int szUnion,                /* Estimated sizeof(YYMINORTYPE) */
+  int align                   /* Estimated alignment of YYMINORTYPE */
+){
+  if( szUnion<0 ) return -1;
+  if( align>16 ) align = 16;
+  szUnion = (szUnion + align - 1)/align*align;
+  if( lemp->stackArrays ) return nHead + szUnion;
+  return (nHead + align - 1)/align*align + szUnion;
+}
+
+/*
+** Return the number of bytes in a value of the C datatype zType, as
+** this host would lay it out, or -1 if lemon cannot tell.  Only
+** pointers and the arithmetic types of the standard headers are known.
+** Structures, arrays and the names of typedefs are not.
+*/
+PRIVATE int type_size(const char *zType){
+  static const struct {
+    const char *zName;      /* A type name */
+    int sz;                 /* sizeof() that type */
+  } aNamed[] = {
+    { "size_t",    sizeof(size_t)    },
+    { "ssize_t",   sizeof(size_t)    },
+    { "ptrdiff_t", sizeof(ptrdiff_t) },
+    { "intptr_t",  sizeof(void*)     },
+    { "uintptr_t", sizeof(void*)     },
+    { "int8_t",    1 }, { "uint8_t",  1 },
+    { "int16_t",   2 }, { "uint16_t", 2 },
+    { "int32_t",   4 }, { "uint32_t", 4 },
+    { "int64_t",   8 }, { "uint64_t", 8 },
+  };
+  int nLong = 0;            /* Number of "long" keywords */
+  int sz = 0;               /* Size from the base keyword, or 0 */
+  int bAny = 0;             /* True if any keyword was seen */
+  int n, k;
+  const char *z = zType;
+
+  n = lemonStrlen(z);
+  while( n>0 && ISSPACE(z[n-1]) ) n--;
+  if( n>0 && z[n-1]=='*' ) return (int)sizeof(void*);
+  while( *z ){
+    if( ISSPACE(*z) ){ z++; continue; }
+    if( !ISALPHA(*z) && *z!='_' ) return -1;
+    for(n=0; ISALNUM(z[n]) || z[n]=='_'; n++){}
+    bAny = 1;
+    if( n==4 && strncmp(z,"long",4)==0 ){
+      nLong++;
+    }else if( (n==6 && strncmp(z,"signed",6)==0)
+           || (n==8 && strncmp(z,"unsigned",8)==0)
+           || (n==5 && strncmp(z,"const",5)==0)
+           || (n==8 && strncmp(z,"volatile",8)==0) ){
+      /* These do not change the size */
+    }else if( sz ){
+      return -1;
+    }else if( n==4 && strncmp(z,"char",4)==0 ){
+      sz = sizeof(char);
+    }else if( n==5 && strncmp(z,"short",5)==0 ){
+      sz = sizeof(short);
+    }else if( n==3 && strncmp(z,"int",3)==0 ){
+      sz = sizeof(int);
+    }else if( n==5 && strncmp(z,"float",5)==0 ){
+      sz = sizeof(float);
+    }else if( n==6 && strncmp(z,"double",6)==0 ){
+      sz = sizeof(double);
+    }else if( (n==5 && strncmp(z,"_Bool",5)==0)
+           || (n==4 && strncmp(z,"bool",4)==0) ){
+      sz = 1;
+    }else{
+      for(k=0; k<(int)(sizeof(aNamed)/sizeof(aNamed[0])); k++){
+        if( lemonStrlen(aNamed[k].zName)==n
+         && strncmp(z,aNamed[k].zName,n)==0 ) break;
+      }
+      if( k>=(int)(sizeof(aNamed)/sizeof(aNamed[0])) ) return -1;
+      sz = aNamed[k].sz;
+    }
+    z += n;
+  }
+  if( !bAny ) return -1;
+  if( sz==sizeof(double) && nLong==1 ) return (int)sizeof(long double);
+  if( nLong>=2 ) return (int)sizeof(long long);
+  if( nLong==1 ) return (int)sizeof(long);
+  return sz ? sz : (int)sizeof(int);
+}
+
 /*
 ** Print the definition of the union used for the parser's data stack.
 ** This union contains fields for every possible data type for tokens
 ** and nonterminals.  In the process of computing and printing this
 ** union, also set the ".dtnum" field of every terminal and nonterminal
 ** symbol.
+**
+** With -Z, a type that is larger than lemp->boxSize bytes, or whose
+** size lemon cannot work out, is not kept in the union.  Its values live
+** in a pool owned by the parser, the union holds a pointer to them, and
+** the ".iBox" field of each symbol of that type is set to one more than
+** the number of its pool.  The estimated size of a stack entry, with and
+** without -Z, is written into lemp->szEntry and lemp->szEntryUnboxed.
 */
 void print_stack_union(
   FILE *out,                  /* The output stream */
   struct lemon *lemp,         /* The main info structure for this parser */
   int *plineno,               /* Pointer to the line number */
-  int mhflag                  /* True if generating makeheaders output */
+  int mhflag,                 /* True if generating makeheaders output */
+  int nHead                   /* Bytes for the state and major of an entry */
 ){
   int lineno;               /* The line number of the output */
   char **types;             /* A hash table of datatypes */
+  char *boxed;              /* boxed[i] is true if types[i] is boxed */
+  int nBox;                 /* Number of boxed types */
+  int sz;                   /* Size of one member of the union */
+  int szUnion, szUnboxed;   /* Sizes of the union with and without -Z */
+  int align, alignUnboxed;  /* Alignments of the union */
   int arraysize;            /* Size of the "types" array */
   int maxdtlength;          /* Maximum length of any ".datatype" field. */
   char *stddt;              /* Standardized name for a datatype */
@@ -4105,12 +6519,7 @@ void print_stack_union(
 
   /* Allocate and initialize types[] and allocate stddt[] */
   arraysize = lemp->nsymbol * 2;
-  types = (char**)calloc( arraysize, sizeof(char*) );
-  if( types==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
-  }
-  for(i=0; i<arraysize; i++) types[i] = 0;
+  types = (char**)lemon_calloc(lemp, arraysize, sizeof(char*) );
   maxdtlength = 0;
   if( lemp->vartype ){
     maxdtlength = lemonStrlen(lemp->vartype);
@@ -4122,11 +6531,7 @@ void print_stack_union(
     len = lemonStrlen(sp->datatype);
     if( len>maxdtlength ) maxdtlength = len;
   }
-  stddt = (char*)malloc( maxdtlength*2 + 1 );
-  if( stddt==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
-  }
+  stddt = (char*)lemon_malloc(lemp, maxdtlength*2 + 1 );
 
   /* Build a hash table of datatypes. The ".dtnum" field of each symbol
   ** is filled in with the hash index plus 1.  A ".dtnum" value of 0 is
@@ -4171,12 +6576,7 @@ void print_stack_union(
     }
     if( types[hash]==0 ){
       sp->dtnum = hash + 1;
-      types[hash] = (char*)malloc( lemonStrlen(stddt)+1 );
-      if( types[hash]==0 ){
-        fprintf(stderr,"Out of memory.\n");
-        exit(1);
-      }
-      lemon_strcpy(types[hash],stddt);
+      types[hash] = lemon_strdup(lemp, stddt);
     }
   }
 
@@ -4187,20 +6587,90 @@ void print_stack_union(
   fprintf(out,"#define %sTOKENTYPE %s\n",name,
     lemp->tokentype?lemp->tokentype:"void*");  lineno++;
   if( mhflag ){ fprintf(out,"#endif\n"); lineno++; }
+
+  /* Size up the members of the union, and decide which types to box */
+  boxed = (char*)lemon_calloc(lemp, arraysize, 1);
+  nBox = 0;
+  szUnion = szUnboxed = align = alignUnboxed = (int)sizeof(int);
+  sz = lemp->tokentype ? type_size(lemp->tokentype) : (int)sizeof(void*);
+  if( sz<0 ){
+    szUnion = szUnboxed = -1;
+  }else if( sz>szUnion ){
+    szUnion = szUnboxed = align = alignUnboxed = sz;
+  }
+  for(i=0; i<arraysize; i++){
+    if( types[i]==0 ) continue;
+    sz = type_size(types[i]);
+    if( sz>alignUnboxed ) alignUnboxed = sz;
+    if( lemp->boxSize && (sz<0 || sz>lemp->boxSize) ){
+      boxed[i] = (char)(++nBox);
+      if( nBox>255 ){
+        ErrorMsg(lemp,lemp->filename,0,
+          "Too many types for -Z.  At most 255 types can be boxed.");
+        lemp->errorcnt++;
+        boxed[i] = 0;
+      }
+      if( szUnboxed>=0 && (sz<0 || sz>szUnboxed) ) szUnboxed = sz;
+      sz = (int)sizeof(void*);
+    }else if( szUnboxed>=0 && (sz<0 || sz>szUnboxed) ){
+      szUnboxed = sz;
+    }
+    if( szUnion>=0 && (sz<0 || sz>szUnion) ) szUnion = sz;
+    if( sz>align ) align = sz;
+  }
+  if( nBox && szUnion>=0 && (int)sizeof(void*)>szUnion ){
+    szUnion = (int)sizeof(void*);
+  }
+  lemp->szEntry = stack_entry_size(lemp, nHead, szUnion, align);
+  lemp->szEntryUnboxed = stack_entry_size(lemp, nHead, szUnboxed,
+                                          alignUnboxed);
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    sp->iBox = 0;
+    if( sp->dtnum>0 && sp->dtnum<=arraysize ) sp->iBox = boxed[sp->dtnum-1];
+  }
+
   fprintf(out,"typedef union {\n"); lineno++;
   fprintf(out,"  int yyinit;\n"); lineno++;
   fprintf(out,"  %sTOKENTYPE yy0;\n",name); lineno++;
   for(i=0; i<arraysize; i++){
     if( types[i]==0 ) continue;
-    fprintf(out,"  %s yy%d;\n",types[i],i+1); lineno++;
-    free(types[i]);
+    fprintf(out,"  %s %syy%d;\n",types[i],boxed[i]?"*":"",i+1); lineno++;
   }
   if( lemp->errsym && lemp->errsym->useCnt ){
     fprintf(out,"  int yy%d;\n",lemp->errsym->dtnum); lineno++;
   }
-  free(stddt);
-  free(types);
+  if( nBox ){
+    fprintf(out,"  void *yybox;\n"); lineno++;
+  }
   fprintf(out,"} YYMINORTYPE;\n"); lineno++;
+
+  /* The pools for the boxed types.  YYBOXOF gives the pool of each
+  ** symbol, plus one, or 0 for symbols whose values are in the stack. */
+  if( nBox ){
+    fprintf(out,"#define YYBOXTYPES %d\n",nBox); lineno++;
+    fprintf(out,"#define YYBOXSIZES");
+    for(i=j=0; i<arraysize; i++){
+      if( !boxed[i] ) continue;
+      fprintf(out,"%s\\\n  sizeof(%s)", j++ ? "," : " ", types[i]);
+      lineno++;
+    }
+    fprintf(out,"\n"); lineno++;
+    fprintf(out,"#define YYBOXOF \\\n "); lineno++;
+    for(i=0; i<lemp->nsymbol; i++){
+      fprintf(out," %d,",lemp->symbols[i]->iBox);
+      if( (i%20)==19 && i<lemp->nsymbol-1 ){
+        fprintf(out," \\\n "); lineno++;
+      }
+    }
+    fprintf(out,"\n"); lineno++;
+  }
+  for(i=0; i<arraysize; i++){
+    if( types[i] ) lemon_free(lemp, types[i]);
+  }
+  lemon_free(lemp, boxed);
+  lemon_free(lemp, stddt);
+  lemon_free(lemp, types);
   *plineno = lineno;
 }
 
@@ -4245,15 +6715,19 @@ struct axset {
   int isTkn;           /* True to use tokens.  False for non-terminals */
   int nAction;         /* Number of actions */
   int iOrder;          /* Original order of action sets */
+  double nHit;         /* Look-ups counted by the profile (-P) */
 };
 
 /*
-** Compare to axset structures for sorting purposes
+** Compare to axset structures for sorting purposes.  The sets that the
+** profile shows to be busiest come first, so that they are placed
+** together at the start of yy_action[].
 */
 static int axset_compare(const void *a, const void *b){
   struct axset *p1 = (struct axset*)a;
   struct axset *p2 = (struct axset*)b;
   int c;
+  if( p1->nHit!=p2->nHit ) return p1->nHit<p2->nHit ? 1 : -1;
   c = p2->nAction - p1->nAction;
   if( c==0 ){
     c = p1->iOrder - p2->iOrder;
@@ -4283,20 +6757,1655 @@ static void writeRuleText(FILE *out, struct rule *rp){
 }
 
 
-/* Generate C source code for the parser */
-void ReportTable(
-  struct lemon *lemp,
-  int mhflag,     /* Output in makeheaders format if true */
-  int sqlFlag     /* Generate the *.sql file too */
+/*
+** Generate #defines for all tokens.  If mhflag is true the #defines are
+** part of the makeheaders interface.
+*/
+PRIVATE void print_token_defines(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno,               /* Pointer to the line number */
+  int mhflag                  /* True if generating makeheaders output */
 ){
-  FILE *out, *in, *sql;
-  char line[LINESIZE];
-  int  lineno;
-  struct state *stp;
-  struct action *ap;
-  struct rule *rp;
-  struct acttab *pActtab;
-  int i, j, n, sz;
+  int lineno = *plineno;
+  const char *prefix = lemp->tokenprefix ? lemp->tokenprefix : "";
+  int i;
+
+  if( mhflag ){
+    fprintf(out,"#if INTERFACE\n"); lineno++;
+  }else{
+    fprintf(out,"#ifndef %s%s\n", prefix, lemp->symbols[1]->name);
+  }
+  for(i=1; i<lemp->nterminal; i++){
+    fprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
+    lineno++;
+  }
+  fprintf(out,"#endif\n"); lineno++;
+  *plineno = lineno;
+}
+
+/*
+** Work out which tokens ever need their values on the stack.  A token
+** does if it is named by an alias, if it is the first symbol of a rule
+** that passes its value up to a left-hand side that needs one, if a
+** destructor will see it, or if it falls back to, or is matched by the
+** wildcard of, such a token.  aNeed[] gets one entry for each terminal.
+** Return the number of tokens, apart from the end-of-input marker, that
+** never need a value.
+*/
+PRIVATE int token_values(struct lemon *lemp, char *aNeed){
+  char *aSym;
+  struct rule *rp;
+  int i, j, n, progress;
+
+  aSym = (char*)lemon_calloc(lemp, lemp->nsymbol+1, 1);
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    aSym[i] = sp->bContent
+           || (sp->type!=TERMINAL && has_destructor(sp, lemp));
+  }
+  for(rp=lemp->rule; rp; rp=rp->next){
+    for(i=0; i<rp->nrhs; i++){
+      struct symbol *sp = rp->rhs[i];
+      if( sp->type!=MULTITERMINAL || !sp->bContent ) continue;
+      for(j=0; j<sp->nsubsym; j++) aSym[sp->subsym[j]->index] = 1;
+    }
+  }
+  do{
+    progress = 0;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      struct symbol *sp;
+      if( rp->nrhs==0 || rp->lhsalias || !aSym[rp->lhs->index] ) continue;
+      sp = rp->rhs[0];
+      if( sp->type==MULTITERMINAL ){
+        for(j=0; j<sp->nsubsym; j++){
+          if( aSym[sp->subsym[j]->index] ) continue;
+          aSym[sp->subsym[j]->index] = 1;
+          progress = 1;
+        }
+      }else if( !aSym[sp->index] ){
+        aSym[sp->index] = 1;
+        progress = 1;
+      }
+    }
+    for(i=0; i<lemp->nterminal; i++){
+      struct symbol *sp = lemp->symbols[i];
+      if( aSym[i] || sp->fallback==0 || !aSym[sp->fallback->index] ) continue;
+      aSym[i] = 1;
+      progress = 1;
+    }
+  }while( progress );
+  if( lemp->tokendest || (lemp->wildcard && aSym[lemp->wildcard->index]) ){
+    for(i=0; i<lemp->nterminal; i++) aSym[i] = 1;
+  }
+  for(i=n=0; i<lemp->nterminal; i++){
+    aNeed[i] = aSym[i];
+    if( i>0 && !aSym[i] ) n++;
+  }
+  lemon_free(lemp, aSym);
+  return n;
+}
+
+/*
+** Tell yy_shift() which token values it need not store.  YYTOKENVALUES
+** is 0 if no token value is ever used, and 2 if only some of them are,
+** in which case YYTOKENVALUE_LIST initializes a table of flags, one for
+** each token.  The lookup in that table is not worth it for token types
+** no larger than a pointer, which are always stored.  So are the tokens
+** of the shared engine of -G.
+*/
+PRIVATE void print_token_values(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno                /* Pointer to the line number */
+){
+  int lineno = *plineno;
+  char *aNeed;
+  int i, n, sz;
+
+  lemp->nTokenNoValue = 0;
+  if( lemp->sharedEngine ) return;
+  aNeed = (char*)lemon_calloc(lemp, lemp->nterminal+1, 1);
+  n = token_values(lemp, aNeed);
+  sz = type_size(lemp->tokentype ? lemp->tokentype : "void*");
+  if( n==lemp->nterminal-1 ){
+    fprintf(out,"#define YYTOKENVALUES 0\n");  lineno++;
+    lemp->nTokenNoValue = n;
+  }else if( n>0 && (sz<0 || sz>(int)sizeof(void*)) ){
+    fprintf(out,"#define YYTOKENVALUES 2\n");  lineno++;
+    fprintf(out,"#define YYTOKENVALUE_LIST \\\n "); lineno++;
+    for(i=0; i<lemp->nterminal; i++){
+      fprintf(out," %d,",aNeed[i]);
+      if( (i%20)==19 && i<lemp->nterminal-1 ){
+        fprintf(out," \\\n "); lineno++;
+      }
+    }
+    fprintf(out,"\n"); lineno++;
+    lemp->nTokenNoValue = n;
+  }
+  lemon_free(lemp, aNeed);
+  *plineno = lineno;
+}
+
+/*
+** Generate the control #defines that come ahead of the parsing tables:
+** the code and action types, the stack union and the macros for the
+** %extra_argument and %extra_context.  The sizes of YYCODETYPE and
+** YYACTIONTYPE are written into *pszCodeType and *pszActionType.
+*/
+PRIVATE void print_control_defines(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno,               /* Pointer to the line number */
+  int mhflag,                 /* True if generating makeheaders output */
+  int *pszCodeType,           /* OUT: sizeof(YYCODETYPE) */
+  int *pszActionType          /* OUT: sizeof(YYACTIONTYPE) */
+){
+  int lineno = *plineno;
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int i;
+
+  if( lemp->sharedEngine ){
+    /* The types of the shared engine, which lemengine.h fixes */
+    fprintf(out,"#define YYCODETYPE unsigned short\n"); lineno++;
+    fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
+    fprintf(out,"#define YYACTIONTYPE unsigned short\n"); lineno++;
+    *pszCodeType = *pszActionType = 2;
+  }else{
+    fprintf(out,"#define YYCODETYPE %s\n",
+      minimum_size_type(0, lemp->nsymbol, pszCodeType)); lineno++;
+    fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
+    fprintf(out,"#define YYACTIONTYPE %s\n",
+      minimum_size_type(0,lemp->maxAction,pszActionType)); lineno++;
+  }
+  if( lemp->wildcard ){
+    fprintf(out,"#define YYWILDCARD %d\n",
+       lemp->wildcard->index); lineno++;
+  }
+  print_stack_union(out,lemp,&lineno,mhflag,*pszCodeType+*pszActionType);
+  fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
+  if( lemp->stacksize ){
+    fprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
+  }else{
+    fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
+  }
+  fprintf(out, "#endif\n"); lineno++;
+  if( mhflag ){
+    fprintf(out,"#if INTERFACE\n"); lineno++;
+  }
+  if( lemp->arg && lemp->arg[0] ){
+    i = lemonStrlen(lemp->arg);
+    while( i>=1 && ISSPACE(lemp->arg[i-1]) ) i--;
+    while( i>=1 && (ISALNUM(lemp->arg[i-1]) || lemp->arg[i-1]=='_') ) i--;
+    fprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
+    fprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
+    fprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
+    fprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
+                 name,lemp->arg,&lemp->arg[i]);  lineno++;
+    fprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
+                 name,&lemp->arg[i],&lemp->arg[i]);  lineno++;
+  }else{
+    fprintf(out,"#define %sARG_SDECL\n",name); lineno++;
+    fprintf(out,"#define %sARG_PDECL\n",name); lineno++;
+    fprintf(out,"#define %sARG_PARAM\n",name); lineno++;
+    fprintf(out,"#define %sARG_FETCH\n",name); lineno++;
+    fprintf(out,"#define %sARG_STORE\n",name); lineno++;
+  }
+  if( lemp->ctx && lemp->ctx[0] ){
+    i = lemonStrlen(lemp->ctx);
+    while( i>=1 && ISSPACE(lemp->ctx[i-1]) ) i--;
+    while( i>=1 && (ISALNUM(lemp->ctx[i-1]) || lemp->ctx[i-1]=='_') ) i--;
+    fprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
+    fprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
+    fprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
+    fprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
+                 name,lemp->ctx,&lemp->ctx[i]);  lineno++;
+    fprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
+                 name,&lemp->ctx[i],&lemp->ctx[i]);  lineno++;
+  }else{
+    fprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
+    fprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
+    fprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
+    fprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
+    fprintf(out,"#define %sCTX_STORE\n",name); lineno++;
+  }
+  if( mhflag ){
+    fprintf(out,"#endif\n"); lineno++;
+  }
+  if( lemp->errsym && lemp->errsym->useCnt ){
+    fprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
+    fprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
+  }
+  if( lemp->has_fallback ){
+    fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
+  }
+  if( lemp->foldFallback && (lemp->has_fallback || lemp->wildcard) ){
+    fprintf(out,"#define YYFOLDED 1\n");  lineno++;
+  }
+  if( lemp->blobTables ){
+    fprintf(out,"#define YY_LOADED_TABLES 1\n");  lineno++;
+  }
+  if( lemp->sharedEngine ){
+    fprintf(out,"#define YY_SHARED_ENGINE 1\n");  lineno++;
+  }
+  if( lemp->stackArrays ){
+    fprintf(out,"#define YY_STACK_ARRAYS 1\n");  lineno++;
+  }
+  if( lemp->has_arena ){
+    fprintf(out,"#define YYARENA 1\n");  lineno++;
+  }
+  print_token_values(out,lemp,&lineno);
+  *plineno = lineno;
+}
+
+/*
+** The -u option splits the generated parser into several translation
+** units.  Unit 0 is the usual *.c file.  It keeps the tables, the driver
+** and every reduce action that needs something private to it.  The other
+** reduce actions are spread over units 1 through nUnit-1, named *_1.c,
+** *_2.c and so on.  Each of those holds one function that the switch in
+** yy_reduce() calls for the rules assigned to that unit.
+*/
+
+/* Return true if the reduce code for rp can move out of unit 0.  Code
+** that uses yypParser, including calls to yy_destructor() for unused
+** right-hand side values, must stay where the parser is visible.
+*/
+PRIVATE int unit_movable(struct rule *rp){
+  if( rp->noCode ) return 0;
+  if( strstr(rp->code, "yypParser") ) return 0;
+  if( rp->codePrefix && strstr(rp->codePrefix, "yypParser") ) return 0;
+  if( rp->codeSuffix && strstr(rp->codeSuffix, "yypParser") ) return 0;
+  return 1;
+}
+
+/* The number of bytes of reduce code for rp */
+PRIVATE int unit_code_size(struct rule *rp){
+  int n = lemonStrlen(rp->code);
+  if( rp->codePrefix ) n += lemonStrlen(rp->codePrefix);
+  if( rp->codeSuffix ) n += lemonStrlen(rp->codeSuffix);
+  return n;
+}
+
+/* Compare two rules for the order in which unit_assign() places them:
+** the most code first, then in rule order */
+static int unit_rule_cmp(const void *a, const void *b){
+  struct rule *p1 = *(struct rule**)a;
+  struct rule *p2 = *(struct rule**)b;
+  int c = unit_code_size(p2) - unit_code_size(p1);
+  if( c==0 ) c = p1->iRule - p2->iRule;
+  return c;
+}
+
+/* Set the iUnit field of every rule.  Rules that share the same code
+** stay together so that their cases can still be merged.  Each group
+** goes, largest first, to the unit holding the least code so far.  There
+** are never more units than groups, plus unit 0.  Return the number of
+** units used.
+*/
+PRIVATE int unit_assign(struct lemon *lemp, int nUnit){
+  struct rule **aGroup;     /* First rule of each group that can move */
+  int *aLoad;               /* Bytes of code assigned to each unit */
+  int nGroup = 0;
+  struct rule *rp, *rp2;
+  int i, k;
+
+  aGroup = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(aGroup[0]));
+  for(rp=lemp->rule; rp; rp=rp->next) rp->iUnit = 0;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit || !unit_movable(rp) ) continue;
+    aGroup[nGroup++] = rp;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        rp2->iUnit = -1;
+      }
+    }
+  }
+  if( nGroup+1<nUnit ){
+    fprintf(lemp->errstream,
+            "Only %d distinct reduce action%s can move out of the main "
+            "file.  "
+            "Using -u%d instead of -u%d.\n",
+            nGroup, nGroup==1 ? "" : "s", nGroup+1, nUnit);
+    nUnit = nGroup+1;
+  }
+  aLoad = (int*)lemon_calloc(lemp, nUnit, sizeof(aLoad[0]));
+  qsort(aGroup, nGroup, sizeof(aGroup[0]), unit_rule_cmp);
+  for(i=0; i<nGroup; i++){
+    int iBest = 1;
+    for(k=2; k<nUnit; k++){
+      if( aLoad[k]<aLoad[iBest] ) iBest = k;
+    }
+    rp = aGroup[i];
+    aLoad[iBest] += unit_code_size(rp);
+    rp->iUnit = iBest;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        rp2->iUnit = iBest;
+      }
+    }
+  }
+  lemon_free(lemp, aLoad);
+  lemon_free(lemp, aGroup);
+  return nUnit;
+}
+
+/* Show the size of one translation unit */
+PRIVATE void unit_report(
+  struct lemon *lemp,
+  int iUnit,                  /* Which unit */
+  const char *zFile,          /* Name of the file holding the unit */
+  int nAction,                /* Number of reduce actions in the unit */
+  int nLine,                  /* Lines of code */
+  long nByte                  /* Bytes of code */
+){
+  if( iUnit==0 ){
+    fprintf(lemp->outstream, "Translation units:\n");
+    fprintf(lemp->outstream, "  %4s  %-30s %8s %8s %10s\n", "unit", "file",
+            "actions", "lines", "bytes");
+  }
+  fprintf(lemp->outstream, "  %4d  %-30s %8d %8d %10ld\n", iUnit,
+          zFile, nAction, nLine, nByte);
+}
+
+/*
+** Write "(void)X;" for the name X of the parameter declared by zDecl,
+** an %extra_argument or %extra_context, which some code may not use.
+*/
+PRIVATE void print_void_param(FILE *out, const char *zDecl, int *plineno){
+  int i, n;
+  if( zDecl==0 || zDecl[0]==0 ) return;
+  i = lemonStrlen(zDecl);
+  while( i>=1 && ISSPACE(zDecl[i-1]) ) i--;
+  n = i;
+  while( i>=1 && (ISALNUM(zDecl[i-1]) || zDecl[i-1]=='_') ) i--;
+  if( n>i ){
+    fprintf(out, "  (void)%.*s;\n", n-i, &zDecl[i]); (*plineno)++;
+  }
+}
+
+/*
+** Write unit iUnit of a parser that is split nUnit ways, and show
+** its size.
+*/
+PRIVATE void unit_write(struct lemon *lemp, int iUnit, int nUnit){
+  const char *name = lemp->name ? lemp->name : "Parse";
+  char zSuffix[20];
+  FILE *out;
+  int lineno;
+  int szCodeType, szActionType;
+  int nAction = 0;
+  char *aDone;                /* True for rules already written */
+  struct rule *rp, *rp2;
+
+  lemon_sprintf(zSuffix, "_%d.c", iUnit);
+  out = file_open(lemp, zSuffix, "wb");
+  if( out==0 ) return;
+  lineno = 1;
+  fprintf(out,
+     "/* This file is automatically generated by Lemon from input grammar\n"
+     "** source file \"%s\".  It holds reduce actions for unit %d of %d\n"
+     "** of the parser. */\n", lemp->filename, iUnit, nUnit); lineno += 3;
+  /* The %include code can test YY_UNIT to leave out its definitions */
+  fprintf(out, "#define YY_UNIT %d\n", iUnit); lineno++;
+  if( lemp->include[0] ) tplt_print(out,lemp,lemp->include,&lineno);
+  print_token_defines(out,lemp,&lineno,0);
+  print_control_defines(out,lemp,&lineno,0,&szCodeType,&szActionType);
+  fprintf(out,
+     "#ifndef yytestcase\n"
+     "# define yytestcase(X)\n"
+     "#endif\n"
+     "#include <assert.h>\n"
+     "\n"
+     "/* An element of the parser's stack.  This must match the definition\n"
+     "** in the driver template. */\n"
+     "typedef struct yyStackEntry yyStackEntry;\n"
+     "struct yyStackEntry {\n"
+     "  YYACTIONTYPE stateno;\n"
+     "  YYCODETYPE major;\n"); lineno += 11;
+  if( !lemp->stackArrays ){
+    fprintf(out, "  YYMINORTYPE minor;\n"); lineno++;
+  }
+  fprintf(out, "};\n\n"); lineno += 2;
+  fprintf(out,
+     "/* Perform the reduce actions of this unit for yy_reduce() */\n"
+     "void %sReduce%d(\n"
+     "  yyStackEntry *yymsp,             /* The top of the parser's stack */\n",
+     name, iUnit); lineno += 3;
+  if( lemp->stackArrays ){
+    fprintf(out,
+       "  YYMINORTYPE *yyvsp,              /* Values at the top of stack */\n");
+    lineno++;
+  }
+  fprintf(out,
+     "  unsigned int yyruleno,           /* Number of the rule to reduce */\n"
+     "  int yyLookahead,                 /* Lookahead token, or YYNOCODE */\n"
+     "  %sTOKENTYPE yyLookaheadToken  /* Value of the lookahead token */\n"
+     "  %sARG_PDECL                   /* %%extra_argument */\n"
+     "  %sCTX_PDECL                   /* %%extra_context */\n"
+     "){\n"
+     "  (void)yymsp;\n"
+     "%s"
+     "  (void)yyLookahead;\n"
+     "  (void)yyLookaheadToken;\n", name, name, name,
+     lemp->stackArrays ? "  (void)yyvsp;\n" : "");
+  lineno += 9 + lemp->stackArrays;
+  print_void_param(out, lemp->arg, &lineno);
+  print_void_param(out, lemp->ctx, &lineno);
+  fprintf(out, "  switch( yyruleno ){\n"); lineno++;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit==iUnit && rp->lhsMinor ){
+      fprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
+      break;
+    }
+  }
+  aDone = (char*)lemon_calloc(lemp, lemp->nrule, 1);
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit!=iUnit || aDone[rp->iRule] ) continue;
+    fprintf(out,"      case %d: /* ", rp->iRule);
+    writeRuleText(out, rp);
+    fprintf(out, " */\n"); lineno++;
+    nAction++;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        fprintf(out,"      case %d: /* ", rp2->iRule);
+        writeRuleText(out, rp2);
+        fprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
+        aDone[rp2->iRule] = 1;
+        nAction++;
+      }
+    }
+    emit_code(out,rp,lemp,&lineno);
+    fprintf(out,"        break;\n"); lineno++;
+  }
+  lemon_free(lemp, aDone);
+  fprintf(out,"  }\n}\n"); lineno += 2;
+  unit_report(lemp, iUnit, lemp->outname, nAction, lineno-1, ftell(out));
+  file_close(lemp, out);
+}
+
+/* Write the start of the case of rule rp in the switch of yy_reduce(),
+** up to the text of the rule, with the label of the rule for -Rgoto */
+PRIVATE void print_reduce_case(FILE *out, struct lemon *lemp,
+                               struct rule *rp){
+  fprintf(out,"      case %d: ", rp->iRule);
+  if( lemp->dispatch==DSP_GOTO ) fprintf(out, "yy_rule_%d: ", rp->iRule);
+  fprintf(out, "/* ");
+  writeRuleText(out, rp);
+}
+
+/* The share of the reduces in the profile (-P) that the hot rules cover */
+#define HOT_RULE_SHARE 0.99
+
+/* Compare two rules so that the one reduced most often sorts first */
+static int rule_reduce_cmp(const void *a, const void *b){
+  const struct rule *p1 = *(const struct rule**)a;
+  const struct rule *p2 = *(const struct rule**)b;
+  if( p1->nReduce!=p2->nReduce ) return p1->nReduce<p2->nReduce ? 1 : -1;
+  return p1->iRule - p2->iRule;
+}
+
+/*
+** Choose which reduce actions are cold, from the reduces counted by the
+** profile (-P).  The rules of yy_reduce() that are reduced most often,
+** as many as it takes to cover HOT_RULE_SHARE of the reduces, are hot
+** and keep their code in the switch.  The code of the others moves out
+** of line into cold functions.  Rules that share their code are hot if
+** any one of them is.  The hot rules are listed on the standard output.
+*/
+PRIVATE void choose_cold_rules(struct lemon *lemp){
+  struct rule **apRule;       /* Rules with code in yy_reduce() */
+  struct rule *rp, *rp2;
+  double rTotal = 0.0;        /* Reduces by all rules of apRule[] */
+  double rHot = 0.0;          /* Reduces by the hot rules */
+  int n = 0;
+  int i;
+
+  if( lemp->nreduceprofiled<=0.0 ) return;
+  apRule = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(apRule[0]));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->noCode || rp->iUnit ) continue;
+    apRule[n++] = rp;
+    rTotal += rp->nReduce;
+  }
+  qsort(apRule, n, sizeof(apRule[0]), rule_reduce_cmp);
+  for(i=0; i<n && rHot<rTotal*HOT_RULE_SHARE; i++) rHot += apRule[i]->nReduce;
+  for(; i<n; i++) apRule[i]->isCold = 1;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( !rp->isCold ) continue;
+    for(rp2=lemp->rule; rp2; rp2=rp2->next){
+      if( rp2!=rp && !rp2->isCold && !rp2->noCode && rp2->iUnit==0
+       && rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+       && rp2->codeSuffix==rp->codeSuffix ){
+        rp->isCold = 0;
+        break;
+      }
+    }
+  }
+
+  fprintf(lemp->outstream, "Hot rules, kept in yy_reduce() by the profile:\n");
+  for(i=0; i<n; i++){
+    rp = apRule[i];
+    if( rp->isCold ){
+      lemp->ncold++;
+      continue;
+    }
+    fprintf(lemp->outstream, "  %12.0f  (%d) ", rp->nReduce, rp->iRule);
+    writeRuleText(lemp->outstream, rp);
+    fprintf(lemp->outstream, "\n");
+  }
+  fprintf(lemp->outstream,
+          "%d of %d rules with code moved to cold functions.\n",
+          lemp->ncold, n);
+  lemon_free(lemp, apRule);
+}
+
+/*
+** Write the reduce actions as static functions, for -Rfunction.  There
+** is one function for each group of rules that share their code, and
+** one for each unit of a split parser (-u) that calls the function of
+** that unit.  The table yy_reduce_func[] then holds the function of
+** each rule, or NULL for a rule without code.
+**
+** The functions of cold rules (-P) are marked YY_COLD.  With the other
+** dispatches, only those functions are written, and the switch in
+** yy_reduce() calls them.
+*/
+PRIVATE void emit_reduce_functions(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int nUnit
+){
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int *aFunc;                 /* Function of each rule: -1 for none, the
+                              ** first rule of its group, or -2-iUnit */
+  struct rule *rp, *rp2;
+  int allFuncs = lemp->dispatch==DSP_FUNCTION;
+  int nV = lemp->stackArrays;  /* With -A, yyvsp goes along with yymsp */
+  const char *zVType = nV ? "YYMINORTYPE*," : "";
+  const char *zVDecl = nV ? "  YYMINORTYPE *yyvsp,\n" : "";
+  const char *zVArg = nV ? "yyvsp," : "";
+  int i;
+
+  aFunc = (int*)lemon_calloc(lemp, lemp->nrule, sizeof(int));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    aFunc[rp->iRule] = rp->iUnit ? -2-rp->iUnit : -1;
+  }
+  if( lemp->ncold ){
+    fprintf(out, "#if defined(__GNUC__)\n"
+                 "# define YY_COLD __attribute__((cold,noinline))\n"
+                 "#else\n"
+                 "# define YY_COLD\n"
+                 "#endif\n"); (*plineno) += 5;
+  }
+  if( allFuncs ){
+    fprintf(out, "#define YY_REDUCE_FUNCS 1\n"); (*plineno)++;
+    fprintf(out, "typedef void (*yyReduceFunc)(yyParser*,yyStackEntry*,%s"
+                 "unsigned int,int,\n                             "
+                 "%sTOKENTYPE %sCTX_PDECL);\n", zVType, name, name);
+    (*plineno) += 2;
+  }
+
+  /* The functions that call into the other units */
+  for(i=1; i<nUnit && allFuncs; i++){
+    for(rp=lemp->rule; rp && rp->iUnit!=i; rp=rp->next){}
+    if( rp==0 ) continue;
+    fprintf(out,
+       "void %sReduce%d(yyStackEntry*,%sunsigned int,int,"
+       "%sTOKENTYPE %sARG_PDECL %sCTX_PDECL);\n"
+       "static void yy_unit_%d(\n"
+       "  yyParser *yypParser,\n"
+       "  yyStackEntry *yymsp,\n"
+       "%s"
+       "  unsigned int yyruleno,\n"
+       "  int yyLookahead,\n"
+       "  %sTOKENTYPE yyLookaheadToken\n"
+       "  %sCTX_PDECL\n"
+       "){\n"
+       "  %sARG_FETCH\n"
+       "  (void)yypParser;\n"
+       "  %sReduce%d(yymsp,%syyruleno,yyLookahead,yyLookaheadToken"
+       " %sARG_PARAM %sCTX_PARAM);\n"
+       "}\n",
+       name, i, zVType, name, name, name, i, zVDecl, name, name, name,
+       name, i, zVArg, name, name);
+    (*plineno) += 13 + nV;
+  }
+
+  /* One function for each group of rules with the same code */
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->noCode || rp->iUnit || aFunc[rp->iRule]>=0 ) continue;
+    if( !allFuncs && !rp->isCold ) continue;
+    fprintf(out, "/* ");
+    writeRuleText(out, rp);
+    fprintf(out, " */\n"); (*plineno)++;
+    fprintf(out, "static %svoid yy_rule_%d(\n",
+       rp->isCold ? "YY_COLD " : "", rp->iRule);
+    fprintf(out,
+       "  yyParser *yypParser,\n"
+       "  yyStackEntry *yymsp,\n"
+       "%s"
+       "  unsigned int yyruleno,\n"
+       "  int yyLookahead,\n"
+       "  %sTOKENTYPE yyLookaheadToken\n", zVDecl, name);
+    (*plineno) += 6 + nV;
+    if( !allFuncs ){
+      /* Called from the switch, which passes the %extra_argument */
+      fprintf(out, "  %sARG_PDECL\n", name); (*plineno)++;
+    }
+    fprintf(out, "  %sCTX_PDECL\n){\n", name); (*plineno) += 2;
+    if( rp->lhsMinor ){
+      fprintf(out, "  YYMINORTYPE yylhsminor;\n"); (*plineno)++;
+    }
+    if( allFuncs ){
+      fprintf(out, "  %sARG_FETCH\n", name); (*plineno)++;
+    }
+    fprintf(out,
+       "  (void)yypParser;\n"
+       "  (void)yymsp;\n"
+       "%s"
+       "  (void)yyruleno;\n"
+       "  (void)yyLookahead;\n"
+       "  (void)yyLookaheadToken;\n", nV ? "  (void)yyvsp;\n" : "");
+    (*plineno) += 5 + nV;
+    print_void_param(out, lemp->arg, plineno);
+    print_void_param(out, lemp->ctx, plineno);
+    aFunc[rp->iRule] = rp->iRule;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        fprintf(out, "  yytestcase(yyruleno==%d); /* ", rp2->iRule);
+        writeRuleText(out, rp2);
+        fprintf(out, " */\n"); (*plineno)++;
+        aFunc[rp2->iRule] = rp->iRule;
+        if( allFuncs ) rp2->codeEmitted = 1;
+      }
+    }
+    emit_code(out, rp, lemp, plineno);
+    fprintf(out, "}\n"); (*plineno)++;
+    if( allFuncs ) rp->codeEmitted = 1;
+  }
+  if( !allFuncs ){
+    lemon_free(lemp, aFunc);
+    return;
+  }
+
+  /* The function for each rule */
+  fprintf(out, "static const yyReduceFunc yy_reduce_func[] = {\n");
+  (*plineno)++;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    int k = aFunc[rp->iRule];
+    if( k>=0 ){
+      fprintf(out, "  yy_rule_%d,  /* (%d) ", k, rp->iRule);
+    }else if( k==-1 ){
+      fprintf(out, "  0,  /* (%d) ", rp->iRule);
+    }else{
+      fprintf(out, "  yy_unit_%d,  /* (%d) ", -2-k, rp->iRule);
+      rp->codeEmitted = 1;
+    }
+    rule_print(out, rp);
+    fprintf(out, " */\n"); (*plineno)++;
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemon_free(lemp, aFunc);
+}
+
+/*
+** Write the labels of the reduce actions, for -Rgoto.  yy_reduce() jumps
+** through a table of them into the switch, where each case also has the
+** label yy_rule_N.  The rules without code go to the default case.
+** Compilers without labels as values use the switch.
+*/
+PRIVATE void emit_reduce_labels(struct lemon *lemp, FILE *out, int *plineno){
+  struct rule *rp;
+  int j = 0;
+
+  fprintf(out, "#if defined(__GNUC__)\n"
+               "# define YY_REDUCE_GOTO 1\n"
+               "#endif\n"
+               "#define YY_REDUCE_LABELS"); (*plineno) += 3;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( j==0 ){ fprintf(out, " \\\n "); (*plineno)++; }
+    if( rp->noCode ){
+      fprintf(out, " &&yy_reduce_default,");
+    }else{
+      fprintf(out, " &&yy_rule_%d,", rp->iRule);
+    }
+    j = (j+1)%4;
+  }
+  fprintf(out, "\n"); (*plineno)++;
+}
+
+/* The names of the table encodings, in the order of enum e_encoding */
+static const char *const azEncoding[] = {
+  "comb", "dense", "hash", "code", "pair", "packed"
+};
+
+/* Return the ENC_* value for the table encoding named zName, or -1 if
+** there is no such encoding.
+*/
+int encoding_find(const char *zName){
+  int i;
+  for(i=0; i<(int)(sizeof(azEncoding)/sizeof(azEncoding[0])); i++){
+    if( strcmp(zName, azEncoding[i])==0 ) return i;
+  }
+  return -1;
+}
+
+/* The names of the reduce dispatches, in the order of enum e_dispatch */
+static const char *const azDispatch[] = {
+  "switch", "function", "goto"
+};
+
+/* Return the DSP_* value for the reduce dispatch named zName, or -1 if
+** there is no such dispatch.
+*/
+int dispatch_find(const char *zName){
+  int i;
+  for(i=0; i<(int)(sizeof(azDispatch)/sizeof(azDispatch[0])); i++){
+    if( strcmp(zName, azDispatch[i])==0 ) return i;
+  }
+  return -1;
+}
+
+/* Output entry i of an n-entry table of integers, ten to a line */
+PRIVATE void print_entry(FILE *out, int i, int n, int v, int *pj, int *plineno){
+  if( *pj==0 ) fprintf(out," /* %5d */ ", i);
+  fprintf(out, " %4d,", v);
+  if( *pj==9 || i==n-1 ){
+    fprintf(out, "\n"); (*plineno)++;
+    *pj = 0;
+  }else{
+    (*pj)++;
+  }
+}
+
+/* Return the action of state stp for a look-ahead symbol that has no
+** action of its own.
+*/
+PRIVATE int default_action(struct lemon *lemp, struct state *stp){
+  if( stp->iDfltReduce<0 ) return lemp->errAction;
+  return stp->iDfltReduce + lemp->minReduce;
+}
+
+/* Return true if the dense encoding must mark missing terminal entries
+** with YY_NO_ACTION, because %fallback or %wildcard is to be tried before
+** the default action of the state.
+*/
+PRIVATE int dense_needs_check(struct lemon *lemp){
+  if( lemp->foldFallback ) return 0;
+  return lemp->has_fallback || lemp->wildcard!=0;
+}
+
+/* Output the parsing tables in the dense encoding (-edense).  yy_action[]
+** holds the action of every state for every terminal, and yy_goto[] for
+** every non-terminal, so that a look-up is a single load with no check.
+** Entries without an action of their own hold the default action of the
+** state, or YY_NO_ACTION where dense_needs_check() says so.
+*/
+PRIVATE void emit_dense_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType
+){
+  int *aRow = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int nNt = lemp->nsymbol - lemp->nterminal;
+  int i, j, k, n;
+  struct state *stp;
+  struct action *ap;
+
+  fprintf(out, "#define YY_DENSE_TABLES 1\n"); (*plineno)++;
+  n = lemp->nxstate*lemp->nterminal;
+  fprintf(out, "static const YYACTIONTYPE yy_action[] = {\n"); (*plineno)++;
+  for(i=j=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(k=0; k<lemp->nterminal; k++){
+      aRow[k] = dense_needs_check(lemp) ? lemp->noAction
+                                        : default_action(lemp, stp);
+    }
+    for(ap=stp->ap; ap; ap=ap->next){
+      int action;
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      action = compute_action(lemp, ap);
+      if( action>=0 ) aRow[ap->sp->index] = action;
+    }
+    for(k=0; k<lemp->nterminal; k++){
+      print_entry(out, i*lemp->nterminal+k, n, aRow[k], &j, plineno);
+    }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab = n;
+  lemp->tablesize += n*szActionType;
+
+  n = lemp->nxstate*nNt;
+  fprintf(out, "static const YYACTIONTYPE yy_goto[] = {\n"); (*plineno)++;
+  for(i=j=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(k=0; k<nNt; k++) aRow[k] = default_action(lemp, stp);
+    for(ap=stp->ap; ap; ap=ap->next){
+      int action;
+      if( ap->sp->index<lemp->nterminal ) continue;
+      if( ap->sp->index==lemp->nsymbol ) continue;
+      action = compute_action(lemp, ap);
+      if( action>=0 ) aRow[ap->sp->index - lemp->nterminal] = action;
+    }
+    for(k=0; k<nNt; k++){
+      print_entry(out, i*nNt+k, n, aRow[k], &j, plineno);
+    }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab += n;
+  lemp->nlookaheadtab = 0;
+  lemp->tablesize += n*szActionType;
+  lemon_free(lemp, aRow);
+}
+
+/* The hashed encoding (-ehash) gives every state a row of its own in
+** yy_action[] and yy_lookahead[] for its terminals, and another for its
+** non-terminals.  A row has 2**K entries, and symbol X goes into entry
+** ((X*M) & 0xffff) >> (16-K) of the row.  The multiplier M is chosen for
+** each row so that none of its symbols collide, and is stored as (M<<5)|K
+** in yy_shift_hash[] or yy_reduce_hash[].  Entry 0 of the tables is a row
+** with one unused entry, shared by every empty row.
+*/
+#define HASH_ENTRY(P,X) \
+    ((int)((((unsigned)(X)*((unsigned)(P)>>5))&0xffff)>>(16-((P)&31))))
+#define HASH_MAX_MULT  256    /* Odd multipliers tried for each row size */
+
+/* The tables of the hashed encoding */
+struct hash_tables {
+  int nEntry;              /* Entries in aAction[] and aLookahead[] */
+  int nAlloc;              /* Space allocated for aAction[] and aLookahead[] */
+  int *aAction;            /* yy_action[] */
+  int *aLookahead;         /* yy_lookahead[] */
+  int *aTknOfst;           /* yy_shift_ofst[] */
+  int *aTknHash;           /* yy_shift_hash[] */
+  int *aNtOfst;            /* yy_reduce_ofst[] */
+  int *aNtHash;            /* yy_reduce_hash[] */
+  int mxHash;              /* Largest value in aTknHash[] and aNtHash[] */
+};
+
+/* Find the hash parameter for a row holding the n symbols aX[], none of
+** which is larger than mxX.  aUsed[] is scratch space for 65536 ints.
+** A row of 2**K entries with K large enough for every symbol to fit, and
+** M equal to 2**(16-K), places every symbol at its own index, so the
+** search always ends.
+*/
+PRIVATE int hash_param(const int *aX, int n, int mxX, int *aUsed){
+  int k, m, i;
+  for(k=0; (1<<k)<n; k++){}
+  for(;; k++){
+    for(m=1; m<HASH_MAX_MULT; m+=2){
+      int p = (m<<5)|k;
+      memset(aUsed, 0, sizeof(int)<<k);
+      for(i=0; i<n && !aUsed[HASH_ENTRY(p,aX[i])]; i++){
+        aUsed[HASH_ENTRY(p,aX[i])] = 1;
+      }
+      if( i==n ) return p;
+    }
+    if( (1<<k)>mxX ) return ((1<<(16-k))<<5)|k;
+  }
+}
+
+/* Add a row for the n symbols in aX[], with actions aAct[], to the
+** hashed tables.  Write its offset and hash parameter into *pOfst and
+** *pHash.
+*/
+PRIVATE void hash_add_row(
+  struct lemon *lemp,
+  struct hash_tables *p,
+  const int *aX, const int *aAct, int n,
+  int *aUsed,
+  int *pOfst, int *pHash
+){
+  int i, mxX = 0, param, sz;
+  if( n==0 ){
+    *pOfst = 0;
+    *pHash = 0;
+    return;
+  }
+  for(i=0; i<n; i++) if( aX[i]>mxX ) mxX = aX[i];
+  param = hash_param(aX, n, mxX, aUsed);
+  sz = 1<<(param&31);
+  if( p->nEntry+sz>p->nAlloc ){
+    p->nAlloc = (p->nEntry+sz)*2;
+    p->aAction = (int*)lemon_realloc(lemp, p->aAction, sizeof(int)*p->nAlloc);
+    p->aLookahead = (int*)lemon_realloc(lemp, p->aLookahead,
+                                        sizeof(int)*p->nAlloc);
+  }
+  for(i=0; i<sz; i++){
+    p->aAction[p->nEntry+i] = lemp->noAction;
+    p->aLookahead[p->nEntry+i] = lemp->nsymbol;
+  }
+  for(i=0; i<n; i++){
+    int k = p->nEntry + HASH_ENTRY(param, aX[i]);
+    p->aAction[k] = aAct[i];
+    p->aLookahead[k] = aX[i];
+  }
+  *pOfst = p->nEntry;
+  *pHash = param;
+  if( param>p->mxHash ) p->mxHash = param;
+  p->nEntry += sz;
+}
+
+/* Build the tables of the hashed encoding.  The symbols of the grammar
+** must fit in 16 bits.
+*/
+PRIVATE void hash_build(struct lemon *lemp, struct hash_tables *p){
+  int *aX = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aAct = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aUsed = (int*)lemon_malloc(lemp, sizeof(int)*65536);
+  int i, n, isTkn;
+  struct action *ap;
+
+  assert( lemp->nsymbol<65536 );
+  memset(p, 0, sizeof(*p));
+  p->aTknOfst = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aTknHash = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aNtOfst = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aNtHash = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->nAlloc = 1024;
+  p->aAction = (int*)lemon_malloc(lemp, sizeof(int)*p->nAlloc);
+  p->aLookahead = (int*)lemon_malloc(lemp, sizeof(int)*p->nAlloc);
+  p->aAction[0] = lemp->noAction;
+  p->aLookahead[0] = lemp->nsymbol;
+  p->nEntry = 1;
+  for(i=0; i<lemp->nxstate; i++){
+    for(isTkn=1; isTkn>=0; isTkn--){
+      n = 0;
+      for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+        int action, x = ap->sp->index;
+        if( (x<lemp->nterminal)!=isTkn || x==lemp->nsymbol ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 ) continue;
+        aX[n] = x;
+        aAct[n++] = action;
+      }
+      if( isTkn ){
+        hash_add_row(lemp, p, aX, aAct, n, aUsed,
+                     &p->aTknOfst[i], &p->aTknHash[i]);
+      }else{
+        hash_add_row(lemp, p, aX, aAct, n, aUsed,
+                     &p->aNtOfst[i], &p->aNtHash[i]);
+      }
+    }
+  }
+  lemon_free(lemp, aX);
+  lemon_free(lemp, aAct);
+  lemon_free(lemp, aUsed);
+}
+
+/* Release the tables built by hash_build() */
+PRIVATE void hash_free(struct lemon *lemp, struct hash_tables *p){
+  lemon_free(lemp, p->aAction);
+  lemon_free(lemp, p->aLookahead);
+  lemon_free(lemp, p->aTknOfst);
+  lemon_free(lemp, p->aTknHash);
+  lemon_free(lemp, p->aNtOfst);
+  lemon_free(lemp, p->aNtHash);
+}
+
+/* Return the number of bytes in the tables of the hashed encoding, not
+** counting yy_default[].
+*/
+PRIVATE int hash_size(
+  struct lemon *lemp,
+  struct hash_tables *p,
+  int szActionType,
+  int szCodeType
+){
+  int szOfst, szHash;
+  minimum_size_type(0, p->nEntry, &szOfst);
+  minimum_size_type(0, p->mxHash, &szHash);
+  return p->nEntry*(szActionType+szCodeType)
+         + lemp->nxstate*2*(szOfst+szHash);
+}
+
+/* Output the parsing tables in the hashed encoding (-ehash) */
+PRIVATE void emit_hash_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType,
+  int szCodeType
+){
+  struct hash_tables ht;
+  const char *zOfst, *zHash;
+  int i, j, n;
+
+  hash_build(lemp, &ht);
+  zOfst = minimum_size_type(0, ht.nEntry, 0);
+  zHash = minimum_size_type(0, ht.mxHash, 0);
+  fprintf(out, "#define YY_HASHED_TABLES 1\n"); (*plineno)++;
+  n = ht.nEntry;
+  fprintf(out, "static const YYACTIONTYPE yy_action[] = {\n"); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aAction[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const YYCODETYPE yy_lookahead[] = {\n"); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aLookahead[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  n = lemp->nxstate;
+  fprintf(out, "static const %s yy_shift_ofst[] = {\n", zOfst); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aTknOfst[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_shift_hash[] = {\n", zHash); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aTknHash[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_reduce_ofst[] = {\n", zOfst); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aNtOfst[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_reduce_hash[] = {\n", zHash); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aNtHash[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab = lemp->nlookaheadtab = ht.nEntry;
+  lemp->tablesize += hash_size(lemp, &ht, szActionType, szCodeType);
+  hash_free(lemp, &ht);
+}
+
+/* Output one case of a switch statement for each of the n symbols in
+** aX[], that returns the action in aAct[] for that symbol.  Symbols with
+** the same action share a case.  aAct[] is overwritten.
+*/
+PRIVATE void emit_code_cases(
+  FILE *out,
+  int *plineno,
+  const int *aX,
+  int *aAct,
+  int n
+){
+  int i, j, w;
+  for(i=0; i<n; i++){
+    if( aAct[i]<0 ) continue;
+    fprintf(out, "     "); w = 5;
+    for(j=i; j<n; j++){
+      if( aAct[j]!=aAct[i] ) continue;
+      if( w>64 ){
+        fprintf(out, "\n     "); (*plineno)++;
+        w = 5;
+      }
+      w += fprintf(out, " case %d:", aX[j]);
+      if( j>i ) aAct[j] = -1;
+    }
+    fprintf(out, " return %d;\n", aAct[i]); (*plineno)++;
+  }
+}
+
+/* Output the parsing tables of the code encoding (-ecode) as a pair of
+** functions.  yy_shift_code() returns the action of a state for a
+** terminal and yy_goto_code() the action for a non-terminal, each with
+** a switch on the state and then on the symbol, so that the compiler
+** turns the tables into jumps and immediate values.  A terminal with no
+** action of its own gets the default action of the state, or else
+** YY_NO_ACTION where dense_needs_check() says so.
+*/
+PRIVATE void emit_code_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType
+){
+  int *aX = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aAct = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int i, n, isTkn;
+  struct action *ap;
+
+  fprintf(out, "#define YY_CODED_TABLES 1\n"); (*plineno)++;
+  for(isTkn=1; isTkn>=0; isTkn--){
+    fprintf(out, "static YYACTIONTYPE %s(YYACTIONTYPE stateno, "
+                 "YYCODETYPE iLookAhead){\n",
+            isTkn ? "yy_shift_code" : "yy_goto_code"); (*plineno)++;
+    fprintf(out, "  switch( stateno ){\n"); (*plineno)++;
+    for(i=0; i<lemp->nxstate; i++){
+      struct state *stp = lemp->sorted[i];
+      int dflt = default_action(lemp, stp);
+      if( isTkn && dense_needs_check(lemp) ) dflt = lemp->noAction;
+      n = 0;
+      for(ap=stp->ap; ap; ap=ap->next){
+        int action, x = ap->sp->index;
+        if( (x<lemp->nterminal)!=isTkn || x==lemp->nsymbol ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 || action==dflt ) continue;
+        aX[n] = x;
+        aAct[n++] = action;
+      }
+      if( n==0 ){
+        fprintf(out, "    case %d: return %d;\n", i, dflt); (*plineno)++;
+        continue;
+      }
+      fprintf(out, "    case %d: switch( iLookAhead ){\n", i); (*plineno)++;
+      emit_code_cases(out, plineno, aX, aAct, n);
+      fprintf(out, "      default: return %d;\n    }\n", dflt);
+      (*plineno) += 2;
+    }
+    fprintf(out, "  }\n  return YY_NO_ACTION;\n}\n"); (*plineno) += 3;
+  }
+  lemp->nactiontab = lemp->nlookaheadtab = 0;
+  lemp->tablesize += lemp->nxstate*szActionType;
+  lemon_free(lemp, aX);
+  lemon_free(lemp, aAct);
+}
+
+/* Return the size of a struct with fields of nA, nB and nC bytes, each
+** a power of two, in order of decreasing size so that there is padding
+** only at the end.
+*/
+PRIVATE int pair_struct_size(int nA, int nB, int nC){
+  int mx = nA>nB ? nA : nB;
+  if( nC>mx ) mx = nC;
+  return (nA+nB+nC+mx-1)/mx*mx;
+}
+
+/* Output the parsing tables in the pair encoding (-epair).  The entries
+** are placed as for the comb encoding, but the look-ahead and the action
+** of each entry are stored together in yy_pair[], and the offsets and
+** the default action of each state together in yy_state[], so that each
+** probe reads one entry of each.  The fields are ordered largest first.
+*/
+PRIVATE void emit_pair_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int szActionType,
+  int szCodeType
+){
+  const char *zShift, *zReduce;
+  int szShift, szReduce;
+  int i, n;
+
+  fprintf(out, "#define YY_PAIRED_TABLES 1\n"); (*plineno)++;
+  fprintf(out, "static const struct yyActionPair {\n"); (*plineno)++;
+  if( szActionType>=szCodeType ){
+    fprintf(out, "  YYACTIONTYPE action;\n  YYCODETYPE lookahead;\n");
+  }else{
+    fprintf(out, "  YYCODETYPE lookahead;\n  YYACTIONTYPE action;\n");
+  }
+  (*plineno) += 2;
+  fprintf(out, "} yy_pair[] = {\n"); (*plineno)++;
+  lemp->nactiontab = acttab_action_size(pActtab);
+  n = lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  for(i=0; i<n; i++){
+    int action = lemp->noAction, la = lemp->nterminal;
+    if( i<lemp->nactiontab ){
+      action = acttab_yyaction(pActtab, i);
+      la = acttab_yylookahead(pActtab, i);
+      if( action<0 ) action = lemp->noAction;
+      if( la<0 ) la = lemp->nsymbol;
+    }
+    if( i%5==0 ) fprintf(out, " /* %5d */", i);
+    if( szActionType>=szCodeType ){
+      fprintf(out, " {%5d,%4d},", action, la);
+    }else{
+      fprintf(out, " {%4d,%5d},", la, action);
+    }
+    if( i%5==4 || i==n-1 ){ fprintf(out, "\n"); (*plineno)++; }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += n*pair_struct_size(szActionType, szCodeType, 0);
+
+  zShift = minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab,
+                             &szShift);
+  zReduce = minimum_size_type(mnNtOfst-1, mxNtOfst, &szReduce);
+  fprintf(out, "static const struct yyStateInfo {\n"); (*plineno)++;
+  for(i=4; i>0; i/=2){
+    if( szShift==i ){
+      fprintf(out, "  %s shift_ofst;\n", zShift); (*plineno)++;
+    }
+    if( szReduce==i ){
+      fprintf(out, "  %s reduce_ofst;\n", zReduce); (*plineno)++;
+    }
+    if( szActionType==i ){
+      fprintf(out, "  YYACTIONTYPE dflt;\n"); (*plineno)++;
+    }
+  }
+  fprintf(out, "} yy_state[] = {\n"); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    struct state *stp = lemp->sorted[i];
+    int k;
+    int shift = stp->iTknOfst==NO_OFFSET ? lemp->nactiontab : stp->iTknOfst;
+    int reduce = stp->iNtOfst==NO_OFFSET ? mnNtOfst-1 : stp->iNtOfst;
+    const char *zSep = "";
+    if( i%4==0 ) fprintf(out, " /* %5d */", i);
+    fprintf(out, " {");
+    for(k=4; k>0; k/=2){
+      if( szShift==k ){ fprintf(out, "%s%5d", zSep, shift); zSep = ","; }
+      if( szReduce==k ){ fprintf(out, "%s%5d", zSep, reduce); zSep = ","; }
+      if( szActionType==k ){
+        fprintf(out, "%s%5d", zSep, default_action(lemp, stp));
+        zSep = ",";
+      }
+    }
+    fprintf(out, "},");
+    if( i%4==3 || i==n-1 ){ fprintf(out, "\n"); (*plineno)++; }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += n*pair_struct_size(szShift, szReduce, szActionType);
+}
+
+/* The widest entry of the packed encoding, so that an entry starting
+** anywhere in a byte can be read with four byte loads */
+#define PACKED_MAX_BITS  25
+
+/* The instructions that reading a packed entry takes beyond reading an
+** array element: forming the bit offset, and the shift and mask */
+#define PACKED_READ_COST  7
+
+/* Return the number of bits needed for the values from 0 to x */
+PRIVATE int packed_bits(int x){
+  int n = 1;
+  while( n<31 && (1<<n)<=x ) n++;
+  return n;
+}
+
+/* Return the number of bytes taken by n packed entries of nBit bits,
+** counting the three bytes of padding that the parser may read past
+** the last entry.
+*/
+PRIVATE int packed_size(int n, int nBit){
+  return (n*nBit+7)/8 + 3;
+}
+
+/* Write into aBit[] the entry widths of the packed encoding: of the
+** actions, of the look-aheads, and of the shift and reduce offsets,
+** which range from mnTknOfst and from mnNtOfst-1.  Return the largest.
+*/
+PRIVATE int packed_widths(
+  struct lemon *lemp,
+  int mnTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int *aBit
+){
+  int i, mx = 0;
+  aBit[0] = packed_bits(lemp->maxAction);
+  aBit[1] = packed_bits(lemp->nsymbol);
+  aBit[2] = packed_bits(lemp->nterminal + lemp->ncombtab - mnTknOfst);
+  aBit[3] = packed_bits(mxNtOfst - (mnNtOfst-1));
+  for(i=0; i<4; i++){
+    if( aBit[i]>mx ) mx = aBit[i];
+  }
+  return mx;
+}
+
+/* Output the n values of aValue[], less iBias, as a table named zName
+** of the packed encoding.  Each value takes nBit bits, least significant
+** first, so value i starts at bit i*nBit of the array.
+*/
+PRIVATE void emit_packed_array(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  const char *zName,
+  const int *aValue,
+  int n,
+  int iBias,
+  int nBit
+){
+  int nByte = packed_size(n, nBit);
+  unsigned char *a = (unsigned char*)lemon_calloc(lemp, nByte, 1);
+  int i, j, k;
+
+  for(i=0; i<n; i++){
+    unsigned int v = (unsigned int)(aValue[i] - iBias);
+    int b = i*nBit;
+    assert( v < (1u<<nBit) );
+    for(k=0; k<nBit; k++, b++){
+      if( v & (1u<<k) ) a[b>>3] |= (unsigned char)(1<<(b&7));
+    }
+  }
+  fprintf(out, "static const unsigned char %s[] = {\n", zName); (*plineno)++;
+  for(i=j=0; i<nByte; i++){
+    print_entry(out, i, nByte, a[i], &j, plineno);
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += nByte;
+  lemon_free(lemp, a);
+}
+
+/* Output the parsing tables in the packed encoding (-epacked).  These
+** are the tables of the comb encoding, but each is an array of bytes
+** holding its entries at the exact number of bits they need, which the
+** parser takes apart with shifts and masks.  The offsets are stored
+** less the smallest one, so that they are never negative, and there
+** is an offset for every state.
+*/
+PRIVATE void emit_packed_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mxTknOfst,
+  int mnNtOfst,
+  int mxNtOfst
+){
+  int aBit[4];
+  int *aValue;
+  int i, n;
+
+  packed_widths(lemp, mnTknOfst, mnNtOfst, mxNtOfst, aBit);
+  lemp->nactiontab = acttab_action_size(pActtab);
+  lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  n = lemp->nlookaheadtab>lemp->nxstate ? lemp->nlookaheadtab : lemp->nxstate;
+  aValue = (int*)lemon_calloc(lemp, n, sizeof(int));
+  fprintf(out, "#define YY_PACKED_TABLES 1\n"); (*plineno)++;
+
+  /* yy_action[] and yy_lookahead[] */
+  n = lemp->nactiontab;
+  fprintf(out, "#define YY_ACTTAB_COUNT (%d)\n", n); (*plineno)++;
+  fprintf(out, "#define YY_ACTION_BITS    %d\n", aBit[0]); (*plineno)++;
+  fprintf(out, "#define YY_LOOKAHEAD_BITS %d\n", aBit[1]); (*plineno)++;
+  for(i=0; i<n; i++){
+    aValue[i] = acttab_yyaction(pActtab, i);
+    if( aValue[i]<0 ) aValue[i] = lemp->noAction;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_action", aValue, n, 0, aBit[0]);
+  n = lemp->nlookaheadtab;
+  for(i=0; i<n; i++){
+    aValue[i] = i<lemp->nactiontab ? acttab_yylookahead(pActtab, i) : -1;
+    if( aValue[i]<0 ) aValue[i] = i<lemp->nactiontab ? lemp->nsymbol
+                                                     : lemp->nterminal;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_lookahead", aValue, n, 0,
+                    aBit[1]);
+
+  /* yy_shift_ofst[] and yy_reduce_ofst[] */
+  n = lemp->nxstate;
+  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
+  fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_BITS     %d\n", aBit[2]); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    aValue[i] = lemp->sorted[i]->iTknOfst;
+    if( aValue[i]==NO_OFFSET ) aValue[i] = lemp->nactiontab;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_shift_ofst", aValue, n,
+                    mnTknOfst, aBit[2]);
+  while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
+  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_BITS  %d\n", aBit[3]); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    aValue[i] = lemp->sorted[i]->iNtOfst;
+    if( aValue[i]==NO_OFFSET ) aValue[i] = mnNtOfst - 1;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_reduce_ofst", aValue, n,
+                    mnNtOfst-1, aBit[3]);
+
+  /* yy_default[] */
+  for(i=0; i<n; i++) aValue[i] = default_action(lemp, lemp->sorted[i]);
+  emit_packed_array(lemp, out, plineno, "yy_default", aValue, n, 0, aBit[0]);
+  lemon_free(lemp, aValue);
+}
+
+/* The version of the table file format written by -B */
+#define BLOB_VERSION      1
+#define BLOB_HEADER_SIZE  160  /* sizeof(yyTablesHeader) in lempar.c */
+
+/* Store the sz low-order bytes of v at a[], least significant first */
+PRIVATE void blob_put(unsigned char *a, int sz, unsigned int v){
+  int i;
+  for(i=0; i<sz; i++){
+    a[i] = (unsigned char)(v & 0xff);
+    v >>= 8;
+  }
+}
+
+/* Add the n bytes at a[] to the FNV-1a hash h, and return the result */
+PRIVATE unsigned int blob_hash(unsigned int h, const unsigned char *a, int n){
+  int i;
+  for(i=0; i<n; i++) h = (h ^ a[i])*16777619u;
+  return h;
+}
+
+/* Add the integer v to the FNV-1a hash h, as four little-endian bytes */
+PRIVATE unsigned int blob_hash_int(unsigned int h, int v){
+  unsigned char a[4];
+  blob_put(a, 4, (unsigned int)v);
+  return blob_hash(h, a, 4);
+}
+
+/* Return the fingerprint of everything in the generated C code that the
+** tables of the -B file depend upon: the constants, the symbols and the
+** left-hand side and length of each rule.
+*/
+PRIVATE unsigned int blob_fingerprint(
+  struct lemon *lemp,
+  int szActionType,
+  int szCodeType
+){
+  unsigned int h = 2166136261u;
+  struct rule *rp;
+  int i;
+
+  h = blob_hash_int(h, BLOB_VERSION);
+  h = blob_hash_int(h, lemp->nxstate);
+  h = blob_hash_int(h, lemp->nrule);
+  h = blob_hash_int(h, lemp->nterminal);
+  h = blob_hash_int(h, lemp->nsymbol);
+  h = blob_hash_int(h, lemp->minShiftReduce);
+  h = blob_hash_int(h, lemp->errAction);
+  h = blob_hash_int(h, lemp->accAction);
+  h = blob_hash_int(h, lemp->noAction);
+  h = blob_hash_int(h, lemp->minReduce);
+  h = blob_hash_int(h, lemp->has_fallback);
+  h = blob_hash_int(h, lemp->foldFallback
+                       && (lemp->has_fallback || lemp->wildcard));
+  h = blob_hash_int(h, lemp->wildcard ? lemp->wildcard->index : -1);
+  h = blob_hash_int(h, lemp->errsym && lemp->errsym->useCnt);
+  h = blob_hash_int(h, szActionType);
+  h = blob_hash_int(h, szCodeType);
+  for(i=0; i<lemp->nsymbol; i++){
+    const char *z = lemp->symbols[i]->name;
+    h = blob_hash(h, (const unsigned char*)z, lemonStrlen(z)+1);
+  }
+  for(rp=lemp->rule; rp; rp=rp->next){
+    h = blob_hash_int(h, rp->lhs->index);
+    h = blob_hash_int(h, rp->nrhs);
+  }
+  return h;
+}
+
+/* Output the parsing tables for -B.  The tables are those of the comb
+** encoding, but they go into a binary file, "*.tbl", laid out as the
+** yyTablesHeader of lempar.c describes, and the C code only declares
+** pointers that ParseTablesAttach() sets.  Entries are little-endian,
+** which is the only byte order ParseTablesAttach() accepts.
+*/
+PRIVATE void emit_blob_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mxTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int szActionType,
+  int szCodeType
+){
+  int aCount[8];        /* Entries in each table */
+  int aSize[8];         /* Bytes in each entry */
+  int aOfst[8];         /* Offset of each table in the file */
+  int nShift, nReduce;  /* Entries in yy_shift_ofst[] and yy_reduce_ofst[] */
+  const char *zShiftType, *zReduceType;
+  unsigned char *a;     /* The content of the file */
+  unsigned char *p;
+  unsigned int iFingerprint;
+  struct rule *rp;
+  int nByte;
+  int i;
+  char *zOutname;
+  FILE *fp;
+
+  lemp->nactiontab = acttab_action_size(pActtab);
+  lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  nShift = lemp->nxstate;
+  while( nShift>0 && lemp->sorted[nShift-1]->iTknOfst==NO_OFFSET ) nShift--;
+  nReduce = lemp->nxstate;
+  while( nReduce>0 && lemp->sorted[nReduce-1]->iNtOfst==NO_OFFSET ){
+    nReduce--;
+  }
+  zShiftType = minimum_size_type(mnTknOfst,
+                                 lemp->nterminal+lemp->nactiontab, &aSize[2]);
+  zReduceType = minimum_size_type(mnNtOfst-1, mxNtOfst, &aSize[3]);
+  aCount[0] = lemp->nactiontab;      aSize[0] = szActionType;
+  aCount[1] = lemp->nlookaheadtab;   aSize[1] = szCodeType;
+  aCount[2] = nShift;
+  aCount[3] = nReduce;
+  aCount[4] = lemp->nxstate;         aSize[4] = szActionType;
+  aCount[5] = lemp->has_fallback ? lemp->nterminal : 0;
+  aSize[5] = szCodeType;
+  aCount[6] = lemp->nrule;           aSize[6] = szCodeType;
+  aCount[7] = lemp->nrule;           aSize[7] = 1;
+  nByte = BLOB_HEADER_SIZE;
+  for(i=0; i<8; i++){
+    aOfst[i] = nByte;
+    nByte += (aCount[i]*aSize[i] + 7) & ~7;
+  }
+  a = (unsigned char*)lemon_calloc(lemp, nByte, 1);
+
+  /* The tables */
+  p = &a[aOfst[0]];
+  for(i=0; i<aCount[0]; i++, p+=aSize[0]){
+    int action = acttab_yyaction(pActtab, i);
+    if( action<0 ) action = lemp->noAction;
+    blob_put(p, aSize[0], (unsigned int)action);
+  }
+  p = &a[aOfst[1]];
+  for(i=0; i<aCount[1]; i++, p+=aSize[1]){
+    int la = i<lemp->nactiontab ? acttab_yylookahead(pActtab, i) : -1;
+    if( la<0 ) la = i<lemp->nactiontab ? lemp->nsymbol : lemp->nterminal;
+    blob_put(p, aSize[1], (unsigned int)la);
+  }
+  p = &a[aOfst[2]];
+  for(i=0; i<aCount[2]; i++, p+=aSize[2]){
+    int ofst = lemp->sorted[i]->iTknOfst;
+    if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
+    blob_put(p, aSize[2], (unsigned int)ofst);
+  }
+  p = &a[aOfst[3]];
+  for(i=0; i<aCount[3]; i++, p+=aSize[3]){
+    int ofst = lemp->sorted[i]->iNtOfst;
+    if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
+    blob_put(p, aSize[3], (unsigned int)ofst);
+  }
+  p = &a[aOfst[4]];
+  for(i=0; i<aCount[4]; i++, p+=aSize[4]){
+    blob_put(p, aSize[4],
+             (unsigned int)default_action(lemp, lemp->sorted[i]));
+  }
+  p = &a[aOfst[5]];
+  for(i=0; i<aCount[5]; i++, p+=aSize[5]){
+    struct symbol *sp = lemp->symbols[i]->fallback;
+    blob_put(p, aSize[5], sp ? (unsigned int)sp->index : 0);
+  }
+  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+    assert( rp->iRule==i );
+    blob_put(&a[aOfst[6]+i*aSize[6]], aSize[6], (unsigned int)rp->lhs->index);
+    blob_put(&a[aOfst[7]+i], 1, (unsigned int)-rp->nrhs);
+  }
+  lemp->tablesize += nByte - BLOB_HEADER_SIZE;
+
+  /* The header */
+  iFingerprint = blob_fingerprint(lemp, szActionType, szCodeType);
+  memcpy(a, "LEMONTBL", 8);
+  blob_put(&a[8], 4, 0x01020304);
+  blob_put(&a[12], 4, BLOB_VERSION);
+  blob_put(&a[16], 4, iFingerprint);
+  blob_put(&a[24], 4, (unsigned int)nByte);
+  blob_put(&a[28], 4, (unsigned int)aCount[0]);
+  blob_put(&a[32], 4, (unsigned int)aCount[1]);
+  blob_put(&a[36], 4, (unsigned int)(nShift-1));
+  blob_put(&a[40], 4, (unsigned int)mnTknOfst);
+  blob_put(&a[44], 4, (unsigned int)mxTknOfst);
+  blob_put(&a[48], 4, (unsigned int)(nReduce-1));
+  blob_put(&a[52], 4, (unsigned int)mnNtOfst);
+  blob_put(&a[56], 4, (unsigned int)mxNtOfst);
+  for(i=0; i<8; i++){
+    blob_put(&a[60+i*12], 4, (unsigned int)aOfst[i]);
+    blob_put(&a[64+i*12], 4, (unsigned int)aCount[i]);
+    blob_put(&a[68+i*12], 4, (unsigned int)aSize[i]);
+  }
+  blob_put(&a[20], 4, blob_hash(2166136261u, &a[BLOB_HEADER_SIZE],
+                                nByte - BLOB_HEADER_SIZE));
+
+  /* Write the file without disturbing lemp->outname, which names the
+  ** C file in its #line directives */
+  zOutname = lemp->outname;
+  lemp->outname = 0;
+  fp = file_open(lemp, ".tbl", "wb");
+  if( fp ){
+    if( fwrite(a, 1, nByte, fp)!=(size_t)nByte ){
+      fprintf(lemp->errstream, "Can't write file \"%s\".\n", lemp->outname);
+      lemp->errorcnt++;
+    }
+    file_close(lemp, fp);
+  }
+  lemon_free(lemp, lemp->outname);
+  lemp->outname = zOutname;
+  lemon_free(lemp, a);
+
+  /* The C code */
+  fprintf(out, "#define YY_TABLES_FINGERPRINT 0x%08xu\n", iFingerprint);
+  (*plineno)++;
+  fprintf(out, "#define YYSHIFTOFSTTYPE %s\n", zShiftType); (*plineno)++;
+  fprintf(out, "#define YYREDUCEOFSTTYPE %s\n", zReduceType); (*plineno)++;
+  fprintf(out, "#define YY_ACTTAB_COUNT   (yy_tables->nAction)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_COUNT    (yy_tables->iShiftCount)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MIN      (yy_tables->iShiftMin)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MAX      (yy_tables->iShiftMax)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_COUNT   (yy_tables->iReduceCount)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MIN     (yy_tables->iReduceMin)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MAX     (yy_tables->iReduceMax)\n");
+  (*plineno)++;
+  fprintf(out, "static const YYACTIONTYPE *yy_action;\n"); (*plineno)++;
+  fprintf(out, "static const YYCODETYPE *yy_lookahead;\n"); (*plineno)++;
+  fprintf(out, "static const YYSHIFTOFSTTYPE *yy_shift_ofst;\n");
+  (*plineno)++;
+  fprintf(out, "static const YYREDUCEOFSTTYPE *yy_reduce_ofst;\n");
+  (*plineno)++;
+  fprintf(out, "static const YYACTIONTYPE *yy_default;\n"); (*plineno)++;
+  if( lemp->has_fallback ){
+    fprintf(out, "static const YYCODETYPE *yyFallback;\n"); (*plineno)++;
+  }
+  fprintf(out, "static const YYCODETYPE *yyRuleInfoLhs;\n"); (*plineno)++;
+  fprintf(out, "static const signed char *yyRuleInfoNRhs;\n"); (*plineno)++;
+}
+
+/* Generate C source code for the parser */
+void ReportTable(
+  struct lemon *lemp
+){
+  int mhflag = lemp->mhflag;     /* Output in makeheaders format if true */
+  int sqlFlag = lemp->sqlFlag;   /* Generate the *.sql file too */
+  FILE *out, *in, *sql;
+  char line[LINESIZE];
+  int  lineno;
+  struct state *stp;
+  struct action *ap;
+  struct rule *rp;
+  struct acttab *pActtab;
+  int i, j, n, sz;
   int nLookAhead;
   int szActionType;     /* sizeof(YYACTIONTYPE) */
   int szCodeType;       /* sizeof(YYCODETYPE)   */
@@ -4304,7 +8413,8 @@ void ReportTable(
   int mnTknOfst, mxTknOfst;
   int mnNtOfst, mxNtOfst;
   struct axset *ax;
-  char *prefix;
+  int nUnit;            /* Number of translation units (-u) */
+  int aBit[4];          /* Entry widths of the packed encoding */
 
   lemp->minShiftReduce = lemp->nstate;
   lemp->errAction = lemp->minShiftReduce + lemp->nrule;
@@ -4313,11 +8423,31 @@ void ReportTable(
   lemp->minReduce = lemp->noAction + 1;
   lemp->maxAction = lemp->minReduce + lemp->nrule;
 
+  /* Output captured in memory has no place for the extra units */
+  nUnit = lemp->aMemfile ? 1 : lemp->nUnit;
+
+  /* The shared engine of -G reads the tables in place */
+  if( lemp->sharedEngine && lemp->blobTables ){
+    fprintf(lemp->errstream,
+            "The -B option cannot be used with -G.  Ignoring -B.\n");
+    lemp->blobTables = 0;
+  }
+  if( lemp->sharedEngine && lemp->stackArrays ){
+    fprintf(lemp->errstream,
+            "The -A option cannot be used with -G.  Ignoring -A.\n");
+    lemp->stackArrays = 0;
+  }
+  if( lemp->sharedEngine && lemp->boxSize ){
+    fprintf(lemp->errstream,
+            "The -Z option cannot be used with -G.  Ignoring -Z.\n");
+    lemp->boxSize = 0;
+  }
+
   in = tplt_open(lemp);
   if( in==0 ) return;
   out = file_open(lemp,".c","wb");
   if( out==0 ){
-    fclose(in);
+    file_close(lemp, in);
     return;
   }
   if( sqlFlag==0 ){
@@ -4325,8 +8455,8 @@ void ReportTable(
   }else{
     sql = file_open(lemp, ".sql", "wb");
     if( sql==0 ){
-      fclose(in);
-      fclose(out);
+      file_close(lemp, in);
+      file_close(lemp, out);
       return;
     }
     fprintf(sql,
@@ -4419,103 +8549,23 @@ void ReportTable(
   if( mhflag ){
     char *incName = file_makename(lemp, ".h");
     fprintf(out,"#include \"%s\"\n", incName); lineno++;
-    free(incName);
+    lemon_free(lemp, incName);
   }
   tplt_xfer(lemp->name,in,out,&lineno);
 
   /* Generate #defines for all tokens */
-  if( lemp->tokenprefix ) prefix = lemp->tokenprefix;
-  else                    prefix = "";
-  if( mhflag ){
-    fprintf(out,"#if INTERFACE\n"); lineno++;
-  }else{
-    fprintf(out,"#ifndef %s%s\n", prefix, lemp->symbols[1]->name);
-  }
-  for(i=1; i<lemp->nterminal; i++){
-    fprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
-    lineno++;
-  }
-  fprintf(out,"#endif\n"); lineno++;
+  print_token_defines(out,lemp,&lineno,mhflag);
   tplt_xfer(lemp->name,in,out,&lineno);
 
   /* Generate the defines */
-  fprintf(out,"#define YYCODETYPE %s\n",
-    minimum_size_type(0, lemp->nsymbol, &szCodeType)); lineno++;
-  fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
-  fprintf(out,"#define YYACTIONTYPE %s\n",
-    minimum_size_type(0,lemp->maxAction,&szActionType)); lineno++;
-  if( lemp->wildcard ){
-    fprintf(out,"#define YYWILDCARD %d\n",
-       lemp->wildcard->index); lineno++;
-  }
-  print_stack_union(out,lemp,&lineno,mhflag);
-  fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
-  if( lemp->stacksize ){
-    fprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
-  }else{
-    fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
-  }
-  fprintf(out, "#endif\n"); lineno++;
-  if( mhflag ){
-    fprintf(out,"#if INTERFACE\n"); lineno++;
-  }
+  print_control_defines(out,lemp,&lineno,mhflag,&szCodeType,&szActionType);
   name = lemp->name ? lemp->name : "Parse";
-  if( lemp->arg && lemp->arg[0] ){
-    i = lemonStrlen(lemp->arg);
-    while( i>=1 && ISSPACE(lemp->arg[i-1]) ) i--;
-    while( i>=1 && (ISALNUM(lemp->arg[i-1]) || lemp->arg[i-1]=='_') ) i--;
-    fprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
-                 name,lemp->arg,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
-                 name,&lemp->arg[i],&lemp->arg[i]);  lineno++;
-  }else{
-    fprintf(out,"#define %sARG_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sARG_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sARG_STORE\n",name); lineno++;
-  }
-  if( lemp->ctx && lemp->ctx[0] ){
-    i = lemonStrlen(lemp->ctx);
-    while( i>=1 && ISSPACE(lemp->ctx[i-1]) ) i--;
-    while( i>=1 && (ISALNUM(lemp->ctx[i-1]) || lemp->ctx[i-1]=='_') ) i--;
-    fprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
-                 name,lemp->ctx,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
-                 name,&lemp->ctx[i],&lemp->ctx[i]);  lineno++;
-  }else{
-    fprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sCTX_STORE\n",name); lineno++;
-  }
-  if( mhflag ){
-    fprintf(out,"#endif\n"); lineno++;
-  }
-  if( lemp->errsym && lemp->errsym->useCnt ){
-    fprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
-    fprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
-  }
-  if( lemp->has_fallback ){
-    fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
-  }
 
   /* Compute the action table, but do not output it yet.  The action
   ** table must be computed before generating the YYNSTATE macro because
   ** we need to know how many states can be eliminated.
   */
-  ax = (struct axset *) calloc(lemp->nxstate*2, sizeof(ax[0]));
-  if( ax==0 ){
-    fprintf(stderr,"malloc failed\n");
-    exit(1);
-  }
+  ax = (struct axset *) lemon_calloc(lemp, lemp->nxstate*2, sizeof(ax[0]));
   for(i=0; i<lemp->nxstate; i++){
     stp = lemp->sorted[i];
     ax[i*2].stp = stp;
@@ -4524,14 +8574,18 @@ void ReportTable(
     ax[i*2+1].stp = stp;
     ax[i*2+1].isTkn = 0;
     ax[i*2+1].nAction = stp->nNtAct;
+    /* A set without actions takes no place, and must stay at the end */
+    if( stp->nTknAct ) ax[i*2].nHit = stp->nTknHit;
+    if( stp->nNtAct ) ax[i*2+1].nHit = stp->nNtHit;
   }
   mxTknOfst = mnTknOfst = 0;
   mxNtOfst = mnNtOfst = 0;
   /* In an effort to minimize the action table size, use the heuristic
-  ** of placing the largest action sets first */
+  ** of placing the largest action sets first.  With a profile, the sets
+  ** that are looked up go before all others, busiest first */
   for(i=0; i<lemp->nxstate*2; i++) ax[i].iOrder = i;
   qsort(ax, lemp->nxstate*2, sizeof(ax[0]), axset_compare);
-  pActtab = acttab_alloc(lemp->nsymbol, lemp->nterminal);
+  pActtab = acttab_alloc(lemp, lemp->nsymbol, lemp->nterminal);
   for(i=0; i<lemp->nxstate*2 && ax[i].nAction>0; i++){
     stp = ax[i].stp;
     if( ax[i].isTkn ){
@@ -4569,7 +8623,7 @@ void ReportTable(
     }
 #endif
   }
-  free(ax);
+  lemon_free(lemp, ax);
 
   /* Mark rules that are actually used for reduce actions after all
   ** optimizations have been applied
@@ -4589,6 +8643,10 @@ void ReportTable(
   fprintf(out,"#define YYNRULE              %d\n",lemp->nrule);  lineno++;
   fprintf(out,"#define YYNRULE_WITH_ACTION  %d\n",lemp->nruleWithAction);
          lineno++;
+  for(i=1, rp=lemp->rule; rp; rp=rp->next){
+    if( rp->nrhs>i ) i = rp->nrhs;
+  }
+  fprintf(out,"#define YYMAXRHS             %d\n",i); lineno++;
   fprintf(out,"#define YYNTOKEN             %d\n",lemp->nterminal); lineno++;
   fprintf(out,"#define YY_MAX_SHIFT         %d\n",lemp->nxstate-1); lineno++;
   i = lemp->minShiftReduce;
@@ -4615,135 +8673,200 @@ void ReportTable(
   **  yy_default[]       Default action for each state.
   */
 
-  /* Output the yy_action table */
-  lemp->nactiontab = n = acttab_action_size(pActtab);
-  lemp->tablesize += n*szActionType;
-  fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-  fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int action = acttab_yyaction(pActtab, i);
-    if( action<0 ) action = lemp->noAction;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", action);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+  lemp->ncombtab = acttab_action_size(pActtab);
+  if( lemp->encoding==ENC_HASH && lemp->nsymbol>=65536 ){
+    fprintf(lemp->errstream,
+            "Too many symbols for the hash encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->encoding==ENC_PACKED
+   && packed_widths(lemp, mnTknOfst, mnNtOfst, mxNtOfst,
+                    aBit)>PACKED_MAX_BITS ){
+    fprintf(lemp->errstream,
+            "Tables too large for the packed encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->blobTables && lemp->encoding!=ENC_COMB ){
+    fprintf(lemp->errstream,
+            "The -B option writes the comb encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->sharedEngine && lemp->encoding!=ENC_COMB ){
+    fprintf(lemp->errstream,
+            "The shared engine of -G reads the comb encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->sharedEngine
+   && (lemp->maxAction>65535 || lemp->nsymbol>65535
+       || mnTknOfst<-32768 || lemp->nterminal+lemp->ncombtab>32767
+       || mnNtOfst-1<-32768 || mxNtOfst>32767)
+  ){
+    fprintf(lemp->errstream,
+            "The tables are too large for the shared engine of -G.\n");
+    lemp->errorcnt++;
+  }
+  if( lemp->encoding==ENC_DENSE ){
+    emit_dense_tables(lemp, out, &lineno, szActionType);
+  }else if( lemp->encoding==ENC_HASH ){
+    emit_hash_tables(lemp, out, &lineno, szActionType, szCodeType);
+  }else if( lemp->encoding==ENC_CODE ){
+    emit_code_tables(lemp, out, &lineno, szActionType);
+  }else if( lemp->encoding==ENC_PAIR ){
+    emit_pair_tables(lemp, out, &lineno, pActtab, mnTknOfst, mnNtOfst,
+                     mxNtOfst, szActionType, szCodeType);
+  }else if( lemp->encoding==ENC_PACKED ){
+    emit_packed_tables(lemp, out, &lineno, pActtab, mnTknOfst, mxTknOfst,
+                       mnNtOfst, mxNtOfst);
+  }else if( lemp->blobTables ){
+    emit_blob_tables(lemp, out, &lineno, pActtab, mnTknOfst, mxTknOfst,
+                     mnNtOfst, mxNtOfst, szActionType, szCodeType);
+  }else{
+    /* Output the yy_action table */
+    lemp->nactiontab = n = acttab_action_size(pActtab);
+    lemp->tablesize += n*szActionType;
+    fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
+    fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int action = acttab_yyaction(pActtab, i);
+      if( action<0 ) action = lemp->noAction;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", action);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_lookahead table */
+    lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
+    lemp->tablesize += n*szCodeType;
+    fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int la = acttab_yylookahead(pActtab, i);
+      if( la<0 ) la = lemp->nsymbol;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", la);
+      if( j==9 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    /* Add extra entries to the end of the yy_lookahead[] table so that
+    ** yy_shift_ofst[]+iToken will always be a valid index into the array,
+    ** even for the largest possible value of yy_shift_ofst[] and iToken. */
+    nLookAhead = lemp->nterminal + lemp->nactiontab;
+    while( i<nLookAhead ){
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", lemp->nterminal);
+      if( j==9 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+      i++;
     }
-  }
-  fprintf(out, "};\n"); lineno++;
-
-  /* Output the yy_lookahead table */
-  lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
-  lemp->tablesize += n*szCodeType;
-  fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int la = acttab_yylookahead(pActtab, i);
-    if( la<0 ) la = lemp->nsymbol;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", la);
-    if( j==9 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
-    }
-  }
-  /* Add extra entries to the end of the yy_lookahead[] table so that
-  ** yy_shift_ofst[]+iToken will always be a valid index into the array,
-  ** even for the largest possible value of yy_shift_ofst[] and iToken. */
-  nLookAhead = lemp->nterminal + lemp->nactiontab;
-  while( i<nLookAhead ){
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", lemp->nterminal);
-    if( j==9 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
+    if( j>0 ){ fprintf(out, "\n"); lineno++; }
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_shift_ofst[] table */
+    n = lemp->nxstate;
+    while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
+    fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
+    fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
+    if( lemp->sharedEngine ){
+      fprintf(out, "static const short yy_shift_ofst[] = {\n"); lineno++;
+      sz = 2;
     }else{
-      j++;
+      fprintf(out, "static const %s yy_shift_ofst[] = {\n",
+         minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
+         lineno++;
     }
-    i++;
-  }
-  if( j>0 ){ fprintf(out, "\n"); lineno++; }
-  fprintf(out, "};\n"); lineno++;
-
-  /* Output the yy_shift_ofst[] table */
-  n = lemp->nxstate;
-  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
-  fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
-  fprintf(out, "static const %s yy_shift_ofst[] = {\n",
-       minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
-       lineno++;
-  lemp->tablesize += n*sz;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iTknOfst;
-    if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
+    lemp->tablesize += n*sz;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iTknOfst;
+      if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_reduce_ofst[] table */
+    n = lemp->nxstate;
+    while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
+    fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
+    fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
+    if( lemp->sharedEngine ){
+      fprintf(out, "static const short yy_reduce_ofst[] = {\n"); lineno++;
+      sz = 2;
     }else{
-      j++;
+      fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
+              minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
+    }
+    lemp->tablesize += n*sz;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iNtOfst;
+      if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
     }
+    fprintf(out, "};\n"); lineno++;
   }
-  fprintf(out, "};\n"); lineno++;
 
-  /* Output the yy_reduce_ofst[] table */
-  n = lemp->nxstate;
-  while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
-  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
-  fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
-          minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
-  lemp->tablesize += n*sz;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iNtOfst;
-    if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+  /* Output the default action table, unless it is part of yy_state[],
+  ** has been packed or is in the -B file */
+  if( lemp->encoding!=ENC_PAIR && lemp->encoding!=ENC_PACKED
+   && !lemp->blobTables
+  ){
+    fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
+    n = lemp->nxstate;
+    lemp->tablesize += n*szActionType;
+    for(i=j=0; i<n; i++){
+      print_entry(out, i, n, default_action(lemp, lemp->sorted[i]), &j,
+                  &lineno);
     }
+    fprintf(out, "};\n"); lineno++;
   }
-  fprintf(out, "};\n"); lineno++;
 
-  /* Output the default action table */
-  fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
+  /* Output the number that each state had before ResortStates(), which
+  ** ParseProfile() writes out */
+  fprintf(out, "#if defined(YYPROFILE)\n"); lineno++;
+  fprintf(out, "static const %s yy_state_origin[] = {\n",
+          minimum_size_type(0, lemp->nstate, 0)); lineno++;
   n = lemp->nxstate;
-  lemp->tablesize += n*szActionType;
   for(i=j=0; i<n; i++){
-    stp = lemp->sorted[i];
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    if( stp->iDfltReduce<0 ){
-      fprintf(out, " %4d,", lemp->errAction);
-    }else{
-      fprintf(out, " %4d,", stp->iDfltReduce + lemp->minReduce);
-    }
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
-    }
+    print_entry(out, i, n, lemp->sorted[i]->iOrigin, &j, &lineno);
   }
   fprintf(out, "};\n"); lineno++;
+  fprintf(out, "#endif\n"); lineno++;
   tplt_xfer(lemp->name,in,out,&lineno);
 
-  /* Generate the table of fallback tokens.
+  /* Generate the table of fallback tokens, unless it is in the -B file
   */
-  if( lemp->has_fallback ){
+  if( lemp->has_fallback && !lemp->blobTables ){
     int mx = lemp->nterminal - 1;
     /* 2019-08-28:  Generate fallback entries for every token to avoid
     ** having to do a range check on the index */
@@ -4809,7 +8932,7 @@ void ReportTable(
     for(i=0; i<lemp->nsymbol; i++){
       struct symbol *sp = lemp->symbols[i];
       if( sp==0 || sp->type==TERMINAL ||
-          sp->index<=0 || sp->destructor!=0 ) continue;
+          sp->index<=0 || sp->destructor!=0 || sp->bArena ) continue;
       if( once ){
         fprintf(out, "      /* Default NON-TERMINAL Destructor */\n");lineno++;
         once = 0;
@@ -4826,12 +8949,13 @@ void ReportTable(
     struct symbol *sp = lemp->symbols[i];
     if( sp==0 || sp->type==TERMINAL || sp->destructor==0 ) continue;
     if( sp->destLineno<0 ) continue;  /* Already emitted */
+    if( sp->bArena ) continue;        /* Released with the arena */
     fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
     /* Combine duplicate destructors into a single case */
     for(j=i+1; j<lemp->nsymbol; j++){
       struct symbol *sp2 = lemp->symbols[j];
-      if( sp2 && sp2->type!=TERMINAL && sp2->destructor
+      if( sp2 && sp2->type!=TERMINAL && sp2->destructor && !sp2->bArena
           && sp2->dtnum==sp->dtnum
           && strcmp(sp->destructor,sp2->destructor)==0 ){
          fprintf(out,"    case %d: /* %s */\n",
@@ -4853,15 +8977,15 @@ void ReportTable(
   ** yyRuleInfoNRhs[].
   **
   ** Note: This code depends on the fact that rules are number
-  ** sequentially beginning with 0.
+  ** sequentially beginning with 0.  With -B they are in the *.tbl file.
   */
-  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+  for(i=0, rp=lemp->blobTables ? 0 : lemp->rule; rp; rp=rp->next, i++){
     fprintf(out,"  %4d,  /* (%d) ", rp->lhs->index, i);
      rule_print(out, rp);
     fprintf(out," */\n"); lineno++;
   }
   tplt_xfer(lemp->name,in,out,&lineno);
-  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+  for(i=0, rp=lemp->blobTables ? 0 : lemp->rule; rp; rp=rp->next, i++){
     fprintf(out,"  %3d,  /* (%d) ", -rp->nrhs, i);
     rule_print(out, rp);
     fprintf(out," */\n"); lineno++;
@@ -4869,40 +8993,92 @@ void ReportTable(
   tplt_xfer(lemp->name,in,out,&lineno);
 
   /* Generate code which execution during each REDUCE action */
-  i = 0;
+  lemp->nLhsInPlace = lemp->nLhsCopy = 0;
   for(rp=lemp->rule; rp; rp=rp->next){
-    i += translate_code(lemp, rp);
+    rp->lhsMinor = translate_code(lemp, rp);
+  }
+  if( nUnit>1 ) nUnit = unit_assign(lemp, nUnit);
+  choose_cold_rules(lemp);
+
+  /* The reduce actions as functions, or the labels to jump to them */
+  if( lemp->dispatch==DSP_FUNCTION || lemp->ncold ){
+    emit_reduce_functions(lemp, out, &lineno, nUnit);
   }
-  if( i ){
+  if( lemp->dispatch==DSP_GOTO ){
+    emit_reduce_labels(lemp, out, &lineno);
+  }
+  tplt_xfer(lemp->name,in,out,&lineno);
+
+  /* The switch in yy_reduce(), for the actions not written above */
+  for(rp=lemp->rule;
+      rp && (rp->iUnit || !rp->lhsMinor || rp->codeEmitted || rp->isCold);
+      rp=rp->next){}
+  if( rp ){
     fprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
   }
+  for(i=1; i<nUnit && lemp->dispatch!=DSP_FUNCTION; i++){
+    fprintf(out,"        void %sReduce%d(yyStackEntry*,%sunsigned int,int,"
+                "%sTOKENTYPE %sARG_PDECL %sCTX_PDECL);\n",
+                name, i, lemp->stackArrays ? "YYMINORTYPE*," : "",
+                name, name, name); lineno++;
+  }
   /* First output rules other than the default: rule */
   for(rp=lemp->rule; rp; rp=rp->next){
     struct rule *rp2;               /* Other rules with the same action */
-    if( rp->codeEmitted ) continue;
+    if( rp->codeEmitted || rp->iUnit ) continue;
     if( rp->noCode ){
       /* No C code actions, so this will be part of the "default:" rule */
       continue;
     }
-    fprintf(out,"      case %d: /* ", rp->iRule);
-    writeRuleText(out, rp);
+    print_reduce_case(out, lemp, rp);
     fprintf(out, " */\n"); lineno++;
     for(rp2=rp->next; rp2; rp2=rp2->next){
       if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
              && rp2->codeSuffix==rp->codeSuffix ){
-        fprintf(out,"      case %d: /* ", rp2->iRule);
-        writeRuleText(out, rp2);
+        print_reduce_case(out, lemp, rp2);
         fprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
         rp2->codeEmitted = 1;
       }
     }
-    emit_code(out,rp,lemp,&lineno);
+    if( rp->isCold ){
+      fprintf(out,"        yy_rule_%d(yypParser,yymsp,%syyruleno,yyLookahead,"
+                  "yyLookaheadToken %sARG_PARAM %sCTX_PARAM);\n",
+                  rp->iRule, lemp->stackArrays ? "yyvsp," : "", name, name);
+      lineno++;
+    }else{
+      emit_code(out,rp,lemp,&lineno);
+    }
     fprintf(out,"        break;\n"); lineno++;
     rp->codeEmitted = 1;
   }
+  /* Then the rules whose code is in another translation unit */
+  for(i=1; i<nUnit; i++){
+    int once = 1;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      if( rp->iUnit!=i || rp->codeEmitted ) continue;
+      print_reduce_case(out, lemp, rp);
+      if( once ){
+        fprintf(out, " */\n"); lineno++;
+        once = 0;
+      }else{
+        fprintf(out," */ yytestcase(yyruleno==%d);\n", rp->iRule); lineno++;
+      }
+      rp->codeEmitted = 1;
+    }
+    if( once ) continue;
+    fprintf(out,"        %sReduce%d(yymsp,%syyruleno,yyLookahead,"
+                "yyLookaheadToken %sARG_PARAM %sCTX_PARAM);\n", name, i,
+                lemp->stackArrays ? "yyvsp," : "", name, name); lineno++;
+    fprintf(out,"        break;\n"); lineno++;
+  }
   /* Finally, output the default: rule.  We choose as the default: all
   ** empty actions. */
-  fprintf(out,"      default:\n"); lineno++;
+  for(rp=lemp->rule; rp && !rp->noCode; rp=rp->next){}
+  if( lemp->dispatch==DSP_GOTO && rp ){
+    fprintf(out,"      default: yy_reduce_default:\n"); lineno++;
+  }else{
+    fprintf(out,"      default:\n"); lineno++;
+  }
   for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->codeEmitted ) continue;
     assert( rp->noCode );
@@ -4937,12 +9113,333 @@ void ReportTable(
   tplt_print(out,lemp,lemp->extracode,&lineno);
 
   acttab_free(pActtab);
-  fclose(in);
-  fclose(out);
-  if( sql ) fclose(sql);
+  file_close(lemp, in);
+  if( nUnit>1 ){
+    char *zName = file_makename(lemp, ".c");
+    for(i=0, rp=lemp->rule; rp; rp=rp->next){
+      if( rp->iUnit==0 && !rp->noCode ) i++;
+    }
+    unit_report(lemp, 0, zName, i, lineno-1, ftell(out));
+    lemon_free(lemp, zName);
+  }
+  file_close(lemp, out);
+  if( sql ) file_close(lemp, sql);
+  for(i=1; i<nUnit; i++) unit_write(lemp, i, nUnit);
   return;
 }
 
+/* One line of the table size attribution report */
+struct size_line {
+  int id;               /* State number or symbol index */
+  double rSlots;        /* Share of yy_action[] entries */
+  int nExplicit;        /* Number of entries, shared or not */
+  double rProbe;        /* Average yy_lookahead[] probes per token */
+  int mxProbe;          /* Most probes for any token */
+  int nReduce;          /* Tokens that lead to a reduce */
+  double rChain;        /* Average reduce chain for those tokens */
+  int mxChain;          /* Longest reduce chain */
+};
+
+/* Compare two size_line objects so that the largest sorts first */
+static int size_line_cmp(const void *a, const void *b){
+  const struct size_line *p1 = (const struct size_line*)a;
+  const struct size_line *p2 = (const struct size_line*)b;
+  if( p1->rSlots!=p2->rSlots ) return p1->rSlots<p2->rSlots ? 1 : -1;
+  return p1->id - p2->id;
+}
+
+/* Generate the table size attribution report (-z) on the standard
+** output.  ReportTable() must have run first, to place every state in
+** the yy_action[] table.
+**
+** Each entry of yy_action[] and yy_lookahead[] is charged to the states
+** that use it, shared equally when several states were overlaid on the
+** same entries, and to the look-ahead symbol of the entry.  For each
+** state, the lookup cost is estimated as yy_find_shift_action() would
+** see it: the number of yy_lookahead[] probes for each token, counting
+** the %fallback and %wildcard retries, and the number of reductions
+** that the token causes.  The reduce chain is an upper bound that counts
+** the reduction itself plus the longest run of single-symbol rules that
+** can follow it, such as "expr ::= term.  term ::= factor."
+*/
+void ReportSizes(struct lemon *lemp)
+{
+  FILE *out = lemp->outstream;
+  int szActionType, szCodeType, szShift, szReduce;
+  int nSlot = lemp->ncombtab + lemp->nsymbol + 1;
+  int *anUse;                   /* Number of states using each slot */
+  int *aUnit;                   /* Longest unit-rule chain above a symbol */
+  struct action **apAct;        /* Action of the current state per symbol */
+  struct size_line *aState, *aSym;
+  int mnTkn = 0, mxTkn = 0, mnNt = 0, mxNt = 0;
+  int iMnTkn = -1, iMxTkn = -1, iMnNt = -1, iMxNt = -1;
+  int nHole = 0;
+  int nLookahead, nShiftOfst, nReduceOfst;
+  int nProbe = 0, nMiss = 0;    /* Probes and defaults, over every lookup */
+  int nRetry = 0, nFold = 0;    /* Lookups that retry, and that find one */
+  int nLookup, nByte, nComb;
+  int aBit[4];                  /* Entry widths of the packed encoding */
+  struct hash_tables ht;
+  int i, j, k, bChange;
+  struct rule *rp;
+  struct action *ap;
+
+  minimum_size_type(0, lemp->nsymbol, &szCodeType);
+  minimum_size_type(0, lemp->maxAction, &szActionType);
+  anUse = (int*)lemon_calloc(lemp, nSlot, sizeof(int));
+  aUnit = (int*)lemon_calloc(lemp, lemp->nsymbol+1, sizeof(int));
+  apAct = (struct action**)lemon_calloc(lemp, lemp->nsymbol+1,
+                                        sizeof(struct action*));
+  aState = (struct size_line*)lemon_calloc(lemp, lemp->nxstate+1,
+                                           sizeof(aState[0]));
+  aSym = (struct size_line*)lemon_calloc(lemp, lemp->nsymbol+1,
+                                         sizeof(aSym[0]));
+
+  /* Count the users of every yy_action[] entry, and find the states
+  ** that determine the range of the offset tables */
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    for(ap=stp->ap; ap; ap=ap->next){
+      int ofst, x = ap->sp->index;
+      if( x==lemp->nsymbol || compute_action(lemp, ap)<0 ) continue;
+      ofst = x<lemp->nterminal ? stp->iTknOfst : stp->iNtOfst;
+      if( ofst==NO_OFFSET || ofst+x<0 || ofst+x>=nSlot ) continue;
+      anUse[ofst+x]++;
+    }
+    if( stp->iTknOfst!=NO_OFFSET ){
+      if( iMnTkn<0 || stp->iTknOfst<mnTkn ){ mnTkn = stp->iTknOfst; iMnTkn = i; }
+      if( iMxTkn<0 || stp->iTknOfst>mxTkn ){ mxTkn = stp->iTknOfst; iMxTkn = i; }
+    }
+    if( stp->iNtOfst!=NO_OFFSET ){
+      if( iMnNt<0 || stp->iNtOfst<mnNt ){ mnNt = stp->iNtOfst; iMnNt = i; }
+      if( iMxNt<0 || stp->iNtOfst>mxNt ){ mxNt = stp->iNtOfst; iMxNt = i; }
+    }
+  }
+  for(i=0; i<lemp->ncombtab; i++){
+    if( anUse[i]==0 ) nHole++;
+  }
+  minimum_size_type(mnTkn<0 ? mnTkn : 0, lemp->nterminal+lemp->ncombtab,
+                    &szShift);
+  minimum_size_type((mnNt<0 ? mnNt : 0)-1, mxNt>0 ? mxNt : 0, &szReduce);
+  nShiftOfst = nReduceOfst = lemp->nxstate;
+  while( nShiftOfst>0
+      && lemp->sorted[nShiftOfst-1]->iTknOfst==NO_OFFSET ) nShiftOfst--;
+  while( nReduceOfst>0
+      && lemp->sorted[nReduceOfst-1]->iNtOfst==NO_OFFSET ) nReduceOfst--;
+
+  /* aUnit[X] is the length of the longest chain of rules "A ::= X.",
+  ** "B ::= A." and so on.  Stop after nsymbol rounds in case of a cycle */
+  for(k=0, bChange=1; bChange && k<lemp->nsymbol; k++){
+    bChange = 0;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      struct symbol *sp;
+      if( rp->nrhs!=1 ) continue;
+      sp = rp->rhs[0];
+      if( sp->type!=NONTERMINAL ) continue;
+      if( aUnit[sp->index] < aUnit[rp->lhs->index]+1 ){
+        aUnit[sp->index] = aUnit[rp->lhs->index]+1;
+        bChange = 1;
+      }
+    }
+  }
+
+  /* Charge the entries to states and symbols, and estimate the cost of
+  ** finding the action for every token in every state */
+  for(i=0; i<lemp->nsymbol; i++) aSym[i].id = i;
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    struct size_line *p = &aState[i];
+    int nTotal = 0, nChain = 0;
+    p->id = stp->statenum;
+    memset(apAct, 0, sizeof(apAct[0])*(lemp->nsymbol+1));
+    for(ap=stp->ap; ap; ap=ap->next){
+      int ofst, x = ap->sp->index;
+      if( x==lemp->nsymbol || compute_action(lemp, ap)<0 ) continue;
+      ofst = x<lemp->nterminal ? stp->iTknOfst : stp->iNtOfst;
+      if( ofst==NO_OFFSET || ofst+x<0 || ofst+x>=nSlot ) continue;
+      p->rSlots += 1.0/anUse[ofst+x];
+      p->nExplicit++;
+      aSym[x].rSlots += 1.0/anUse[ofst+x];
+      aSym[x].nExplicit++;
+      apAct[x] = ap;
+    }
+    for(j=0; j<lemp->nterminal; j++){
+      struct action *pFound = apAct[j];
+      struct rule *pReduce = 0;
+      int nProbe = 1;
+      struct symbol *pFallback = lemp->symbols[j]->fallback;
+      int bRetry = !lemp->foldFallback;   /* -F leaves nothing to retry */
+      if( pFound==0 && pFallback && bRetry ){
+        nProbe++;
+        pFound = apAct[pFallback->index];
+      }
+      if( pFound==0 && lemp->wildcard && j>0 && bRetry ){
+        nProbe++;
+        pFound = apAct[lemp->wildcard->index];
+      }
+      if( nProbe>1 ){
+        nRetry++;
+        if( pFound ) nFold++;
+      }
+      if( pFound ){
+        if( pFound->type==REDUCE || pFound->type==SHIFTREDUCE ){
+          pReduce = pFound->x.rp;
+        }
+      }else{
+        nMiss++;
+        if( stp->iDfltReduce>=0 ) pReduce = stp->pDfltReduce;
+      }
+      nTotal += nProbe;
+      if( nProbe>p->mxProbe ) p->mxProbe = nProbe;
+      if( pReduce ){
+        int nLen = 1 + aUnit[pReduce->lhs->index];
+        p->nReduce++;
+        nChain += nLen;
+        if( nLen>p->mxChain ) p->mxChain = nLen;
+      }
+    }
+    nProbe += nTotal;
+    p->rProbe = lemp->nterminal ? (double)nTotal/lemp->nterminal : 0.0;
+    p->rChain = p->nReduce ? (double)nChain/p->nReduce : 0.0;
+  }
+
+  /* Show the totals */
+  nLookahead = lemp->nterminal + lemp->ncombtab;
+  if( lemp->ncombtab>nLookahead ) nLookahead = lemp->ncombtab;
+  fprintf(out, "Table size attribution:\n");
+  fprintf(out, "  yy_action[]       %6d entries x %d = %7d bytes"
+               "  (%d unused entries)\n",
+          lemp->ncombtab, szActionType, lemp->ncombtab*szActionType,
+          nHole);
+  fprintf(out, "  yy_lookahead[]    %6d entries x %d = %7d bytes"
+               "  (%d for padding)\n",
+          nLookahead, szCodeType, nLookahead*szCodeType,
+          nLookahead - lemp->ncombtab);
+  fprintf(out, "  yy_shift_ofst[]   %6d entries x %d = %7d bytes",
+          nShiftOfst, szShift, nShiftOfst*szShift);
+  if( iMnTkn>=0 ){
+    fprintf(out, "  (offsets %d in state %d to %d in state %d)",
+            mnTkn, lemp->sorted[iMnTkn]->statenum,
+            mxTkn, lemp->sorted[iMxTkn]->statenum);
+  }
+  fprintf(out, "\n  yy_reduce_ofst[]  %6d entries x %d = %7d bytes",
+          nReduceOfst, szReduce, nReduceOfst*szReduce);
+  if( iMnNt>=0 ){
+    fprintf(out, "  (offsets %d in state %d to %d in state %d)",
+            mnNt, lemp->sorted[iMnNt]->statenum,
+            mxNt, lemp->sorted[iMxNt]->statenum);
+  }
+  fprintf(out, "\n  yy_default[]      %6d entries x %d = %7d bytes\n",
+          lemp->nxstate, szActionType, lemp->nxstate*szActionType);
+  if( lemp->has_fallback ){
+    fprintf(out, "  yyFallback[]      %6d entries x %d = %7d bytes\n",
+            lemp->nterminal, szCodeType, lemp->nterminal*szCodeType);
+  }
+
+  /* Compare the encodings that -e can select.  A probe is one place
+  ** looked at in the tables, a load is one array element read, counting
+  ** yy_default[], and the lines are the distinct memory locations read,
+  ** which is the number of cache misses when the tables are cold */
+  nLookup = lemp->nxstate*lemp->nterminal;
+  if( nLookup==0 ) nLookup = 1;
+  fprintf(out, "\nTable encodings (-e), per terminal look-up:\n");
+  fprintf(out, "  %-8s %9s %8s %8s %8s\n", "", "bytes", "probes", "loads",
+          "lines");
+  nComb = nByte = lemp->ncombtab*szActionType + nLookahead*szCodeType
+          + nShiftOfst*szShift + nReduceOfst*szReduce
+          + lemp->nxstate*szActionType;
+  fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "comb", nByte,
+          (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+          (double)(2*nProbe+nLookup)/nLookup,
+          lemp->encoding==ENC_COMB ? "  (in use)" : "");
+  nByte = lemp->nxstate*(lemp->nsymbol+1)*szActionType;
+  if( dense_needs_check(lemp) ){
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f", "dense", nByte,
+            (double)nProbe/nLookup, (double)(nProbe+nMiss)/nLookup,
+            (double)(nProbe+nMiss)/nLookup);
+  }else{
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f", "dense", nByte,
+            1.0, 1.0, 1.0);
+  }
+  fprintf(out, "%s\n", lemp->encoding==ENC_DENSE ? "  (in use)" : "");
+  if( lemp->nsymbol<65536 ){
+    hash_build(lemp, &ht);
+    nByte = hash_size(lemp, &ht, szActionType, szCodeType)
+            + lemp->nxstate*szActionType;
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "hash", nByte,
+            (double)nProbe/nLookup, (double)(3*nProbe+nLookup)/nLookup,
+            (double)(3*nProbe+nLookup)/nLookup,
+            lemp->encoding==ENC_HASH ? "  (in use)" : "");
+    hash_free(lemp, &ht);
+  }
+  nByte = nLookahead*pair_struct_size(szActionType, szCodeType, 0)
+          + lemp->nxstate*pair_struct_size(szShift, szReduce, szActionType);
+  fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "pair", nByte,
+          (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+          (double)(nProbe+nLookup)/nLookup,
+          lemp->encoding==ENC_PAIR ? "  (in use)" : "");
+  if( packed_widths(lemp, mnTkn<0 ? mnTkn : 0, mnNt<0 ? mnNt : 0,
+                    mxNt>0 ? mxNt : 0, aBit)<=PACKED_MAX_BITS ){
+    nByte = packed_size(lemp->ncombtab, aBit[0])
+            + packed_size(lemp->nterminal+lemp->ncombtab, aBit[1])
+            + packed_size(lemp->nxstate, aBit[2])
+            + packed_size(lemp->nxstate, aBit[3])
+            + packed_size(lemp->nxstate, aBit[0]);
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "packed", nByte,
+            (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+            (double)(2*nProbe+nLookup)/nLookup,
+            lemp->encoding==ENC_PACKED ? "  (in use)" : "");
+    fprintf(out, "  packed: %d bytes %s than comb, about %.1f more "
+            "instructions per look-up\n", nComb>=nByte ? nComb-nByte
+            : nByte-nComb, nComb>=nByte ? "fewer" : "more",
+            (double)(2*nProbe+nLookup)*PACKED_READ_COST/nLookup);
+  }
+
+  /* Show what -F does, or would do, for the look-ups that retry */
+  if( lemp->foldFallback ){
+    fprintf(out, "\n%%fallback and %%wildcard are folded into the tables "
+            "(-F), adding %d entries.\n", lemp->nfolded);
+  }else if( lemp->has_fallback || lemp->wildcard ){
+    fprintf(out, "\n%d of the %d terminal look-ups (%.1f%%) retry with a "
+            "%%fallback or\n%%wildcard token.  Folding them into the tables "
+            "(-F) adds %d entries.\n", nRetry, nLookup,
+            100.0*nRetry/nLookup, nFold);
+  }
+
+  /* Show the states and symbols, largest first */
+  qsort(aState, lemp->nxstate, sizeof(aState[0]), size_line_cmp);
+  fprintf(out, "\nStates by share of yy_action[] and yy_lookahead[]:\n");
+  fprintf(out, "  %6s %8s %8s %8s %7s %6s %8s %6s %6s\n", "state",
+          "entries", "bytes", "explicit", "probes", "max", "reduces",
+          "chain", "max");
+  for(i=0; i<lemp->nxstate; i++){
+    struct size_line *p = &aState[i];
+    fprintf(out, "  %6d %8.1f %8.1f %8d %7.2f %6d %8d %6.2f %6d\n",
+            p->id, p->rSlots, p->rSlots*(szActionType+szCodeType),
+            p->nExplicit, p->rProbe, p->mxProbe, p->nReduce, p->rChain,
+            p->mxChain);
+  }
+  qsort(aSym, lemp->nsymbol, sizeof(aSym[0]), size_line_cmp);
+  fprintf(out, "\nSymbols by share of yy_action[] and yy_lookahead[]:\n");
+  fprintf(out, "  %-30s %8s %8s %8s\n", "symbol", "entries", "bytes",
+          "states");
+  for(i=0; i<lemp->nsymbol; i++){
+    struct size_line *p = &aSym[i];
+    struct symbol *sp = lemp->symbols[p->id];
+    if( p->nExplicit==0 ) continue;
+    fprintf(out, "  %-30s %8.1f %8.1f %8d", sp->name, p->rSlots,
+            p->rSlots*(szActionType+szCodeType), p->nExplicit);
+    if( sp->fallback ) fprintf(out, "  (falls back to %s)", sp->fallback->name);
+    fprintf(out, "\n");
+  }
+  lemon_free(lemp, anUse);
+  lemon_free(lemp, aUnit);
+  lemon_free(lemp, apAct);
+  lemon_free(lemp, aState);
+  lemon_free(lemp, aSym);
+}
+
+
 /* Generate a header file for the parser */
 void ReportHeader(struct lemon *lemp)
 {
@@ -4963,7 +9460,7 @@ void ReportHeader(struct lemon *lemp)
       if( strcmp(line,pattern) ) break;
     }
     nextChar = fgetc(in);
-    fclose(in);
+    file_close(lemp, in);
     if( i==lemp->nterminal && nextChar==EOF ){
       /* No change in the file.  Don't rewrite it. */
       return;
@@ -4974,7 +9471,7 @@ void ReportHeader(struct lemon *lemp)
     for(i=1; i<lemp->nterminal; i++){
       fprintf(out,"#define %s%-30s %3d\n",prefix,lemp->symbols[i]->name,i);
     }
-    fclose(out);
+    file_close(lemp, out);
   }
   return;
 }
@@ -5034,7 +9531,7 @@ void CompressTables(struct lemon *lemp)
       if( ap->type==REDUCE && ap->x.rp==rbest ) break;
     }
     assert( ap );
-    ap->sp = Symbol_new("{default}");
+    ap->sp = Symbol_new(lemp,"{default}");
     for(ap=ap->next; ap; ap=ap->next){
       if( ap->type==REDUCE && ap->x.rp==rbest ) ap->type = NOT_USED;
     }
@@ -5098,18 +9595,153 @@ void CompressTables(struct lemon *lemp)
   }
 }
 
+/*
+** Resolve %fallback and %wildcard when the tables are built, for -F.
+** In every state, a token that has no action of its own is given a copy
+** of the action that the parser would otherwise find at run-time, by
+** retrying with the fallback token of the token and then with the
+** wildcard.  The parser then never has to retry, at the cost of the
+** extra table entries.
+*/
+void FoldFallbacks(struct lemon *lemp)
+{
+  struct action **apAct;   /* The action of the current state per token */
+  struct action *ap, *pFound;
+  struct state *stp;
+  struct symbol *sp;
+  int i, j, nAdd;
+
+  apAct = (struct action**)lemon_calloc(lemp, lemp->nterminal,
+                                        sizeof(struct action*));
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    if( stp->autoReduce ) continue;
+    memset(apAct, 0, sizeof(apAct[0])*lemp->nterminal);
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      if( compute_action(lemp, ap)<0 ) continue;
+      apAct[ap->sp->index] = ap;
+    }
+    nAdd = 0;
+    for(j=1; j<lemp->nterminal; j++){
+      if( apAct[j] ) continue;
+      sp = lemp->symbols[j];
+      pFound = sp->fallback ? apAct[sp->fallback->index] : 0;
+      if( pFound==0 && lemp->wildcard ) pFound = apAct[lemp->wildcard->index];
+      if( pFound==0 ) continue;
+      Action_add(lemp, &stp->ap, pFound->type, sp, 0);
+      stp->ap->x = pFound->x;
+      stp->ap->spOpt = pFound->spOpt;
+      nAdd++;
+    }
+    if( nAdd ){
+      stp->ap = Action_sort(stp->ap);
+      lemp->nfolded += nAdd;
+    }
+  }
+  lemon_free(lemp, apAct);
+}
+
+/*
+** Read the profile named by the -P option, as written by ParseProfile()
+** in a parser compiled with YYPROFILE, and count the look-ups of each
+** state and the reduces by each rule.  Each line of the profile is one
+** of
+**
+**      state N SYMBOL COUNT
+**      rule N COUNT
+**
+** where the N of a state is its number before ResortStates().  The
+** counts of repeated lines add up, so the profiles of several runs can
+** simply be concatenated.  Blank lines and lines starting with "#" are
+** ignored.
+*/
+void ReadProfile(struct lemon *lemp){
+  FILE *in;
+  char line[LINESIZE];
+  char zSymbol[LINESIZE];
+  struct rule **apRule;       /* The rules, by rule number */
+  struct rule *rp;
+  int lineno = 0;
+  int i;
+
+  in = fopen(lemp->zProfile, "rb");
+  if( in==0 ){
+    fprintf(lemp->errstream, "Can't open the profile \"%s\".\n",
+            lemp->zProfile);
+    lemp->errorcnt++;
+    return;
+  }
+  file_track(lemp, in);
+  apRule = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(apRule[0]));
+  for(rp=lemp->rule; rp; rp=rp->next) apRule[rp->iRule] = rp;
+  while( fgets(line, LINESIZE, in) ){
+    int iState, iRule;
+    double rCount;
+    struct symbol *sp;
+    struct state *stp;
+    lineno++;
+    for(i=0; ISSPACE(line[i]); i++){}
+    if( line[i]==0 || line[i]=='#' ) continue;
+    if( sscanf(&line[i], "rule %d %lf", &iRule, &rCount)==2
+     && rCount>=0.0 ){
+      if( iRule<0 || iRule>=lemp->nrule ){
+        ErrorMsg(lemp, lemp->zProfile, lineno,
+           "No rule %d.  Is this a profile of another grammar?", iRule);
+        lemp->errorcnt++;
+        break;
+      }
+      apRule[iRule]->nReduce += rCount;
+      lemp->nreduceprofiled += rCount;
+      continue;
+    }
+    if( sscanf(&line[i], "state %d %s %lf", &iState, zSymbol, &rCount)!=3
+     || rCount<0.0 ){
+      ErrorMsg(lemp, lemp->zProfile, lineno, "Not a profile line.");
+      lemp->errorcnt++;
+      break;
+    }
+    sp = Symbol_find(lemp, zSymbol);
+    if( iState<0 || iState>=lemp->nstate || sp==0
+     || sp->index>=lemp->nsymbol ){
+      ErrorMsg(lemp, lemp->zProfile, lineno,
+         "No state %d with symbol \"%s\".  Is this a profile of "
+         "another grammar?", iState, zSymbol);
+      lemp->errorcnt++;
+      break;
+    }
+    stp = lemp->sorted[iState];
+    assert( stp->iOrigin==iState );
+    if( sp->index<lemp->nterminal ){
+      stp->nTknHit += rCount;
+    }else{
+      stp->nNtHit += rCount;
+    }
+  }
+  file_close(lemp, in);
+  lemon_free(lemp, apRule);
+  for(i=0; i<lemp->nstate; i++){
+    struct state *stp = lemp->sorted[i];
+    if( stp->nTknHit+stp->nNtHit>0.0 ) lemp->nprofiled++;
+  }
+}
 
 /*
 ** Compare two states for sorting purposes.  The smaller state is the
-** one with the most non-terminal actions.  If they have the same number
-** of non-terminal actions, then the smaller is the one with the most
-** token actions.
+** one with the most look-ups in the profile, if there is one, so that
+** the busiest states get the lowest numbers and the first rows of the
+** tables.  Otherwise the smaller state is the one with the most
+** non-terminal actions.  If they have the same number of non-terminal
+** actions, then the smaller is the one with the most token actions.
 */
 static int stateResortCompare(const void *a, const void *b){
   const struct state *pA = *(const struct state**)a;
   const struct state *pB = *(const struct state**)b;
+  double rA = pA->nTknHit + pA->nNtHit;
+  double rB = pB->nTknHit + pB->nNtHit;
   int n;
 
+  if( rA!=rB ) return rA<rB ? 1 : -1;
   n = pB->nNtAct - pA->nNtAct;
   if( n==0 ){
     n = pB->nTknAct - pA->nTknAct;
@@ -5169,45 +9801,39 @@ void ResortStates(struct lemon *lemp)
 ** Set manipulation routines for the LEMON parser generator.
 */
 
-static int size = 0;
-
 /* Set the set size */
-void SetSize(int n)
+void SetSize(struct lemon *lemp, int n)
 {
-  size = n+1;
+  lemp->setSize = n+1;
 }
 
 /* Allocate a new set */
-char *SetNew(void){
-  char *s;
-  s = (char*)calloc( size, 1);
-  if( s==0 ){
-    memory_error();
-  }
-  return s;
+char *SetNew(struct lemon *lemp){
+  return (char*)lemon_calloc(lemp, lemp->setSize, 1);
 }
 
 /* Deallocate a set */
-void SetFree(char *s)
+void SetFree(struct lemon *lemp, char *s)
 {
-  free(s);
+  lemon_free(lemp, s);
 }
 
 /* Add a new element to the set.  Return TRUE if the element was added
 ** and FALSE if it was already there. */
-int SetAdd(char *s, int e)
+int SetAdd(struct lemon *lemp, char *s, int e)
 {
   int rv;
-  assert( e>=0 && e<size );
+  assert( e>=0 && e<lemp->setSize );
   rv = s[e];
   s[e] = 1;
   return !rv;
 }
 
 /* Add every element of s2 to s1.  Return TRUE if s1 changes. */
-int SetUnion(char *s1, char *s2)
+int SetUnion(struct lemon *lemp, char *s1, char *s2)
 {
   int i, progress;
+  int size = lemp->setSize;
   progress = 0;
   for(i=0; i<size; i++){
     if( s2[i]==0 ) continue;
@@ -5242,19 +9868,19 @@ PRIVATE unsigned strhash(const char *x)
 ** keep strings in a table so that the same string is not in more
 ** than one place.
 */
-const char *Strsafe(const char *y)
+const char *Strsafe(struct lemon *lemp, const char *y)
 {
   const char *z;
   char *cpy;
 
   if( y==0 ) return 0;
-  z = Strsafe_find(y);
-  if( z==0 && (cpy=(char *)malloc( lemonStrlen(y)+1 ))!=0 ){
+  z = Strsafe_find(lemp,y);
+  if( z==0 ){
+    cpy = (char *)lemon_malloc(lemp, lemonStrlen(y)+1 );
     lemon_strcpy(cpy,y);
     z = cpy;
-    Strsafe_insert(z);
+    Strsafe_insert(lemp,z);
   }
-  MemoryCheck(z);
   return z;
 }
 
@@ -5279,39 +9905,40 @@ typedef struct s_x1node {
   struct s_x1node **from;  /* Previous link */
 } x1node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x1 *x1a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x1a */
 
 /* Allocate a new associative array */
-void Strsafe_init(void){
-  if( x1a ) return;
-  x1a = (struct s_x1*)malloc( sizeof(struct s_x1) );
-  if( x1a ){
-    x1a->size = 1024;
-    x1a->count = 0;
-    x1a->tbl = (x1node*)calloc(1024, sizeof(x1node) + sizeof(x1node*));
-    if( x1a->tbl==0 ){
-      free(x1a);
-      x1a = 0;
+void Strsafe_init(struct lemon *lemp){
+  if( lemp->x1a ) return;
+  lemp->x1a = (struct s_x1*)lemon_malloc(lemp, sizeof(struct s_x1) );
+  if( lemp->x1a ){
+    lemp->x1a->size = 1024;
+    lemp->x1a->count = 0;
+    lemp->x1a->tbl = (x1node*)lemon_calloc(lemp, 1024,
+                                  sizeof(x1node) + sizeof(x1node*));
+    if( lemp->x1a->tbl==0 ){
+      lemon_free(lemp, lemp->x1a);
+      lemp->x1a = 0;
     }else{
       int i;
-      x1a->ht = (x1node**)&(x1a->tbl[1024]);
-      for(i=0; i<1024; i++) x1a->ht[i] = 0;
+      lemp->x1a->ht = (x1node**)&(lemp->x1a->tbl[1024]);
+      for(i=0; i<1024; i++) lemp->x1a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Strsafe_insert(const char *data)
+int Strsafe_insert(struct lemon *lemp, const char *data)
 {
   x1node *np;
   unsigned h;
   unsigned ph;
 
-  if( x1a==0 ) return 0;
+  if( lemp->x1a==0 ) return 0;
   ph = strhash(data);
-  h = ph & (x1a->size-1);
-  np = x1a->ht[h];
+  h = ph & (lemp->x1a->size-1);
+  np = lemp->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,data)==0 ){
       /* An existing entry with the same key is found. */
@@ -5320,19 +9947,20 @@ int Strsafe_insert(const char *data)
     }
     np = np->next;
   }
-  if( x1a->count>=x1a->size ){
+  if( lemp->x1a->count>=lemp->x1a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x1 array;
-    array.size = arrSize = x1a->size*2;
-    array.count = x1a->count;
-    array.tbl = (x1node*)calloc(arrSize, sizeof(x1node) + sizeof(x1node*));
+    array.size = arrSize = lemp->x1a->size*2;
+    array.count = lemp->x1a->count;
+    array.tbl = (x1node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x1node) + sizeof(x1node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x1node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x1a->count; i++){
+    for(i=0; i<lemp->x1a->count; i++){
       x1node *oldnp, *newnp;
-      oldnp = &(x1a->tbl[i]);
+      oldnp = &(lemp->x1a->tbl[i]);
       h = strhash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5341,31 +9969,30 @@ int Strsafe_insert(const char *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x1a->tbl); // This program was originally for 16-bit machines.
-    ** Don't worry about freeing memory on modern platforms. */
-    *x1a = array;
+    lemon_free(lemp, lemp->x1a->tbl);
+    *lemp->x1a = array;
   }
   /* Insert the new data */
-  h = ph & (x1a->size-1);
-  np = &(x1a->tbl[x1a->count++]);
+  h = ph & (lemp->x1a->size-1);
+  np = &(lemp->x1a->tbl[lemp->x1a->count++]);
   np->data = data;
-  if( x1a->ht[h] ) x1a->ht[h]->from = &(np->next);
-  np->next = x1a->ht[h];
-  x1a->ht[h] = np;
-  np->from = &(x1a->ht[h]);
+  if( lemp->x1a->ht[h] ) lemp->x1a->ht[h]->from = &(np->next);
+  np->next = lemp->x1a->ht[h];
+  lemp->x1a->ht[h] = np;
+  np->from = &(lemp->x1a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-const char *Strsafe_find(const char *key)
+const char *Strsafe_find(struct lemon *lemp, const char *key)
 {
   unsigned h;
   x1node *np;
 
-  if( x1a==0 ) return 0;
-  h = strhash(key) & (x1a->size-1);
-  np = x1a->ht[h];
+  if( lemp->x1a==0 ) return 0;
+  h = strhash(key) & (lemp->x1a->size-1);
+  np = lemp->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,key)==0 ) break;
     np = np->next;
@@ -5373,18 +10000,44 @@ const char *Strsafe_find(const char *key)
   return np ? np->data : 0;
 }
 
+/* Like Strsafe() except that the input is the first n bytes of y, which
+** need not be zero-terminated.  The scanner uses this to intern only the
+** identifiers that become symbols or aliases, straight out of the input
+** buffer.
+*/
+const char *Strsafe_n(struct lemon *lemp, const char *y, int n)
+{
+  unsigned h = 0;
+  int i;
+  x1node *np;
+  char *cpy;
+
+  for(i=0; i<n; i++) h = h*13 + y[i];
+  if( lemp->x1a ){
+    np = lemp->x1a->ht[h & (lemp->x1a->size-1)];
+    while( np ){
+      if( strncmp(np->data,y,n)==0 && np->data[n]==0 ) return np->data;
+      np = np->next;
+    }
+  }
+  cpy = (char *)lemon_malloc(lemp, n+1 );
+  memcpy(cpy, y, n);
+  cpy[n] = 0;
+  Strsafe_insert(lemp,cpy);
+  return cpy;
+}
+
 /* Return a pointer to the (terminal or nonterminal) symbol "x".
 ** Create a new symbol if this is the first time "x" has been seen.
 */
-struct symbol *Symbol_new(const char *x)
+struct symbol *Symbol_new(struct lemon *lemp, const char *x)
 {
   struct symbol *sp;
 
-  sp = Symbol_find(x);
+  sp = Symbol_find(lemp,x);
   if( sp==0 ){
-    sp = (struct symbol *)calloc(1, sizeof(struct symbol) );
-    MemoryCheck(sp);
-    sp->name = Strsafe(x);
+    sp = (struct symbol *)lemon_calloc(lemp, 1, sizeof(struct symbol) );
+    sp->name = Strsafe(lemp,x);
     sp->type = ISUPPER(*x) ? TERMINAL : NONTERMINAL;
     sp->rule = 0;
     sp->fallback = 0;
@@ -5396,7 +10049,7 @@ struct symbol *Symbol_new(const char *x)
     sp->destLineno = 0;
     sp->datatype = 0;
     sp->useCnt = 0;
-    Symbol_insert(sp,sp->name);
+    Symbol_insert(lemp,sp,sp->name);
   }
   sp->useCnt++;
   return sp;
@@ -5447,39 +10100,40 @@ typedef struct s_x2node {
   struct s_x2node **from;  /* Previous link */
 } x2node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x2 *x2a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x2a */
 
 /* Allocate a new associative array */
-void Symbol_init(void){
-  if( x2a ) return;
-  x2a = (struct s_x2*)malloc( sizeof(struct s_x2) );
-  if( x2a ){
-    x2a->size = 128;
-    x2a->count = 0;
-    x2a->tbl = (x2node*)calloc(128, sizeof(x2node) + sizeof(x2node*));
-    if( x2a->tbl==0 ){
-      free(x2a);
-      x2a = 0;
+void Symbol_init(struct lemon *lemp){
+  if( lemp->x2a ) return;
+  lemp->x2a = (struct s_x2*)lemon_malloc(lemp, sizeof(struct s_x2) );
+  if( lemp->x2a ){
+    lemp->x2a->size = 128;
+    lemp->x2a->count = 0;
+    lemp->x2a->tbl = (x2node*)lemon_calloc(lemp, 128,
+                                  sizeof(x2node) + sizeof(x2node*));
+    if( lemp->x2a->tbl==0 ){
+      lemon_free(lemp, lemp->x2a);
+      lemp->x2a = 0;
     }else{
       int i;
-      x2a->ht = (x2node**)&(x2a->tbl[128]);
-      for(i=0; i<128; i++) x2a->ht[i] = 0;
+      lemp->x2a->ht = (x2node**)&(lemp->x2a->tbl[128]);
+      for(i=0; i<128; i++) lemp->x2a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Symbol_insert(struct symbol *data, const char *key)
+int Symbol_insert(struct lemon *lemp, struct symbol *data, const char *key)
 {
   x2node *np;
   unsigned h;
   unsigned ph;
 
-  if( x2a==0 ) return 0;
+  if( lemp->x2a==0 ) return 0;
   ph = strhash(key);
-  h = ph & (x2a->size-1);
-  np = x2a->ht[h];
+  h = ph & (lemp->x2a->size-1);
+  np = lemp->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -5488,19 +10142,20 @@ int Symbol_insert(struct symbol *data, const char *key)
     }
     np = np->next;
   }
-  if( x2a->count>=x2a->size ){
+  if( lemp->x2a->count>=lemp->x2a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x2 array;
-    array.size = arrSize = x2a->size*2;
-    array.count = x2a->count;
-    array.tbl = (x2node*)calloc(arrSize, sizeof(x2node) + sizeof(x2node*));
+    array.size = arrSize = lemp->x2a->size*2;
+    array.count = lemp->x2a->count;
+    array.tbl = (x2node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x2node) + sizeof(x2node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x2node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x2a->count; i++){
+    for(i=0; i<lemp->x2a->count; i++){
       x2node *oldnp, *newnp;
-      oldnp = &(x2a->tbl[i]);
+      oldnp = &(lemp->x2a->tbl[i]);
       h = strhash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5510,33 +10165,31 @@ int Symbol_insert(struct symbol *data, const char *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x2a->tbl); // This program was originally written for 16-bit
-    ** machines.  Don't worry about freeing this trivial amount of memory
-    ** on modern platforms.  Just leak it. */
-    *x2a = array;
+    lemon_free(lemp, lemp->x2a->tbl);
+    *lemp->x2a = array;
   }
   /* Insert the new data */
-  h = ph & (x2a->size-1);
-  np = &(x2a->tbl[x2a->count++]);
+  h = ph & (lemp->x2a->size-1);
+  np = &(lemp->x2a->tbl[lemp->x2a->count++]);
   np->key = key;
   np->data = data;
-  if( x2a->ht[h] ) x2a->ht[h]->from = &(np->next);
-  np->next = x2a->ht[h];
-  x2a->ht[h] = np;
-  np->from = &(x2a->ht[h]);
+  if( lemp->x2a->ht[h] ) lemp->x2a->ht[h]->from = &(np->next);
+  np->next = lemp->x2a->ht[h];
+  lemp->x2a->ht[h] = np;
+  np->from = &(lemp->x2a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct symbol *Symbol_find(const char *key)
+struct symbol *Symbol_find(struct lemon *lemp, const char *key)
 {
   unsigned h;
   x2node *np;
 
-  if( x2a==0 ) return 0;
-  h = strhash(key) & (x2a->size-1);
-  np = x2a->ht[h];
+  if( lemp->x2a==0 ) return 0;
+  h = strhash(key) & (lemp->x2a->size-1);
+  np = lemp->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ) break;
     np = np->next;
@@ -5545,11 +10198,11 @@ struct symbol *Symbol_find(const char *key)
 }
 
 /* Return the n-th data.  Return NULL if n is out of range. */
-struct symbol *Symbol_Nth(int n)
+struct symbol *Symbol_Nth(struct lemon *lemp, int n)
 {
   struct symbol *data;
-  if( x2a && n>0 && n<=x2a->count ){
-    data = x2a->tbl[n-1].data;
+  if( lemp->x2a && n>0 && n<=lemp->x2a->count ){
+    data = lemp->x2a->tbl[n-1].data;
   }else{
     data = 0;
   }
@@ -5557,23 +10210,24 @@ struct symbol *Symbol_Nth(int n)
 }
 
 /* Return the size of the array */
-int Symbol_count()
+int Symbol_count(struct lemon *lemp)
 {
-  return x2a ? x2a->count : 0;
+  return lemp->x2a ? lemp->x2a->count : 0;
 }
 
 /* Return an array of pointers to all data in the table.
 ** The array is obtained from malloc.  Return NULL if memory allocation
 ** problems, or if the array is empty. */
-struct symbol **Symbol_arrayof()
+struct symbol **Symbol_arrayof(struct lemon *lemp)
 {
   struct symbol **array;
   int i,arrSize;
-  if( x2a==0 ) return 0;
-  arrSize = x2a->count;
-  array = (struct symbol **)calloc(arrSize, sizeof(struct symbol *));
+  if( lemp->x2a==0 ) return 0;
+  arrSize = lemp->x2a->count;
+  array = (struct symbol **)lemon_calloc(lemp, arrSize,
+                                         sizeof(struct symbol *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x2a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemp->x2a->tbl[i].data;
   }
   return array;
 }
@@ -5616,11 +10270,10 @@ PRIVATE unsigned statehash(struct config *a)
 }
 
 /* Allocate a new state structure */
-struct state *State_new()
+struct state *State_new(struct lemon *lemp)
 {
   struct state *newstate;
-  newstate = (struct state *)calloc(1, sizeof(struct state) );
-  MemoryCheck(newstate);
+  newstate = (struct state *)lemon_calloc(lemp, 1, sizeof(struct state) );
   return newstate;
 }
 
@@ -5646,39 +10299,40 @@ typedef struct s_x3node {
   struct s_x3node **from;  /* Previous link */
 } x3node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x3 *x3a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x3a */
 
 /* Allocate a new associative array */
-void State_init(void){
-  if( x3a ) return;
-  x3a = (struct s_x3*)malloc( sizeof(struct s_x3) );
-  if( x3a ){
-    x3a->size = 128;
-    x3a->count = 0;
-    x3a->tbl = (x3node*)calloc(128, sizeof(x3node) + sizeof(x3node*));
-    if( x3a->tbl==0 ){
-      free(x3a);
-      x3a = 0;
+void State_init(struct lemon *lemp){
+  if( lemp->x3a ) return;
+  lemp->x3a = (struct s_x3*)lemon_malloc(lemp, sizeof(struct s_x3) );
+  if( lemp->x3a ){
+    lemp->x3a->size = 128;
+    lemp->x3a->count = 0;
+    lemp->x3a->tbl = (x3node*)lemon_calloc(lemp, 128,
+                                  sizeof(x3node) + sizeof(x3node*));
+    if( lemp->x3a->tbl==0 ){
+      lemon_free(lemp, lemp->x3a);
+      lemp->x3a = 0;
     }else{
       int i;
-      x3a->ht = (x3node**)&(x3a->tbl[128]);
-      for(i=0; i<128; i++) x3a->ht[i] = 0;
+      lemp->x3a->ht = (x3node**)&(lemp->x3a->tbl[128]);
+      for(i=0; i<128; i++) lemp->x3a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int State_insert(struct state *data, struct config *key)
+int State_insert(struct lemon *lemp, struct state *data, struct config *key)
 {
   x3node *np;
   unsigned h;
   unsigned ph;
 
-  if( x3a==0 ) return 0;
+  if( lemp->x3a==0 ) return 0;
   ph = statehash(key);
-  h = ph & (x3a->size-1);
-  np = x3a->ht[h];
+  h = ph & (lemp->x3a->size-1);
+  np = lemp->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -5687,19 +10341,20 @@ int State_insert(struct state *data, struct config *key)
     }
     np = np->next;
   }
-  if( x3a->count>=x3a->size ){
+  if( lemp->x3a->count>=lemp->x3a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x3 array;
-    array.size = arrSize = x3a->size*2;
-    array.count = x3a->count;
-    array.tbl = (x3node*)calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
+    array.size = arrSize = lemp->x3a->size*2;
+    array.count = lemp->x3a->count;
+    array.tbl = (x3node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x3node) + sizeof(x3node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x3node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x3a->count; i++){
+    for(i=0; i<lemp->x3a->count; i++){
       x3node *oldnp, *newnp;
-      oldnp = &(x3a->tbl[i]);
+      oldnp = &(lemp->x3a->tbl[i]);
       h = statehash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5709,31 +10364,31 @@ int State_insert(struct state *data, struct config *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x3a->tbl);
-    *x3a = array;
+    lemon_free(lemp, lemp->x3a->tbl);
+    *lemp->x3a = array;
   }
   /* Insert the new data */
-  h = ph & (x3a->size-1);
-  np = &(x3a->tbl[x3a->count++]);
+  h = ph & (lemp->x3a->size-1);
+  np = &(lemp->x3a->tbl[lemp->x3a->count++]);
   np->key = key;
   np->data = data;
-  if( x3a->ht[h] ) x3a->ht[h]->from = &(np->next);
-  np->next = x3a->ht[h];
-  x3a->ht[h] = np;
-  np->from = &(x3a->ht[h]);
+  if( lemp->x3a->ht[h] ) lemp->x3a->ht[h]->from = &(np->next);
+  np->next = lemp->x3a->ht[h];
+  lemp->x3a->ht[h] = np;
+  np->from = &(lemp->x3a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct state *State_find(struct config *key)
+struct state *State_find(struct lemon *lemp, struct config *key)
 {
   unsigned h;
   x3node *np;
 
-  if( x3a==0 ) return 0;
-  h = statehash(key) & (x3a->size-1);
-  np = x3a->ht[h];
+  if( lemp->x3a==0 ) return 0;
+  h = statehash(key) & (lemp->x3a->size-1);
+  np = lemp->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ) break;
     np = np->next;
@@ -5744,15 +10399,15 @@ struct state *State_find(struct config *key)
 /* Return an array of pointers to all data in the table.
 ** The array is obtained from malloc.  Return NULL if memory allocation
 ** problems, or if the array is empty. */
-struct state **State_arrayof(void)
+struct state **State_arrayof(struct lemon *lemp)
 {
   struct state **array;
   int i,arrSize;
-  if( x3a==0 ) return 0;
-  arrSize = x3a->count;
-  array = (struct state **)calloc(arrSize, sizeof(struct state *));
+  if( lemp->x3a==0 ) return 0;
+  arrSize = lemp->x3a->count;
+  array = (struct state **)lemon_calloc(lemp, arrSize, sizeof(struct state *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x3a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemp->x3a->tbl[i].data;
   }
   return array;
 }
@@ -5786,39 +10441,40 @@ typedef struct s_x4node {
   struct s_x4node **from;  /* Previous link */
 } x4node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x4 *x4a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x4a */
 
 /* Allocate a new associative array */
-void Configtable_init(void){
-  if( x4a ) return;
-  x4a = (struct s_x4*)malloc( sizeof(struct s_x4) );
-  if( x4a ){
-    x4a->size = 64;
-    x4a->count = 0;
-    x4a->tbl = (x4node*)calloc(64, sizeof(x4node) + sizeof(x4node*));
-    if( x4a->tbl==0 ){
-      free(x4a);
-      x4a = 0;
+void Configtable_init(struct lemon *lemp){
+  if( lemp->x4a ) return;
+  lemp->x4a = (struct s_x4*)lemon_malloc(lemp, sizeof(struct s_x4) );
+  if( lemp->x4a ){
+    lemp->x4a->size = 64;
+    lemp->x4a->count = 0;
+    lemp->x4a->tbl = (x4node*)lemon_calloc(lemp, 64,
+                                  sizeof(x4node) + sizeof(x4node*));
+    if( lemp->x4a->tbl==0 ){
+      lemon_free(lemp, lemp->x4a);
+      lemp->x4a = 0;
     }else{
       int i;
-      x4a->ht = (x4node**)&(x4a->tbl[64]);
-      for(i=0; i<64; i++) x4a->ht[i] = 0;
+      lemp->x4a->ht = (x4node**)&(lemp->x4a->tbl[64]);
+      for(i=0; i<64; i++) lemp->x4a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Configtable_insert(struct config *data)
+int Configtable_insert(struct lemon *lemp, struct config *data)
 {
   x4node *np;
   unsigned h;
   unsigned ph;
 
-  if( x4a==0 ) return 0;
+  if( lemp->x4a==0 ) return 0;
   ph = confighash(data);
-  h = ph & (x4a->size-1);
-  np = x4a->ht[h];
+  h = ph & (lemp->x4a->size-1);
+  np = lemp->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) data)==0 ){
       /* An existing entry with the same key is found. */
@@ -5827,19 +10483,20 @@ int Configtable_insert(struct config *data)
     }
     np = np->next;
   }
-  if( x4a->count>=x4a->size ){
+  if( lemp->x4a->count>=lemp->x4a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x4 array;
-    array.size = arrSize = x4a->size*2;
-    array.count = x4a->count;
-    array.tbl = (x4node*)calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
+    array.size = arrSize = lemp->x4a->size*2;
+    array.count = lemp->x4a->count;
+    array.tbl = (x4node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x4node) + sizeof(x4node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x4node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x4a->count; i++){
+    for(i=0; i<lemp->x4a->count; i++){
       x4node *oldnp, *newnp;
-      oldnp = &(x4a->tbl[i]);
+      oldnp = &(lemp->x4a->tbl[i]);
       h = confighash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5848,32 +10505,30 @@ int Configtable_insert(struct config *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x4a->tbl); // This code was originall written for 16-bit machines.
-    ** on modern machines, don't worry about freeing this trival amount of
-    ** memory. */
-    *x4a = array;
+    lemon_free(lemp, lemp->x4a->tbl);
+    *lemp->x4a = array;
   }
   /* Insert the new data */
-  h = ph & (x4a->size-1);
-  np = &(x4a->tbl[x4a->count++]);
+  h = ph & (lemp->x4a->size-1);
+  np = &(lemp->x4a->tbl[lemp->x4a->count++]);
   np->data = data;
-  if( x4a->ht[h] ) x4a->ht[h]->from = &(np->next);
-  np->next = x4a->ht[h];
-  x4a->ht[h] = np;
-  np->from = &(x4a->ht[h]);
+  if( lemp->x4a->ht[h] ) lemp->x4a->ht[h]->from = &(np->next);
+  np->next = lemp->x4a->ht[h];
+  lemp->x4a->ht[h] = np;
+  np->from = &(lemp->x4a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct config *Configtable_find(struct config *key)
+struct config *Configtable_find(struct lemon *lemp, struct config *key)
 {
   int h;
   x4node *np;
 
-  if( x4a==0 ) return 0;
-  h = confighash(key) & (x4a->size-1);
-  np = x4a->ht[h];
+  if( lemp->x4a==0 ) return 0;
+  h = confighash(key) & (lemp->x4a->size-1);
+  np = lemp->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) key)==0 ) break;
     np = np->next;
@@ -5883,12 +10538,386 @@ struct config *Configtable_find(struct config *key)
 
 /* Remove all data from the table.  Pass each data to the function "f"
 ** as it is removed.  ("f" may be null to avoid this step.) */
-void Configtable_clear(int(*f)(struct config *))
+void Configtable_clear(struct lemon *lemp, int(*f)(struct config *))
 {
   int i;
-  if( x4a==0 || x4a->count==0 ) return;
-  if( f ) for(i=0; i<x4a->count; i++) (*f)(x4a->tbl[i].data);
-  for(i=0; i<x4a->size; i++) x4a->ht[i] = 0;
-  x4a->count = 0;
+  if( lemp->x4a==0 || lemp->x4a->count==0 ) return;
+  if( f ) for(i=0; i<lemp->x4a->count; i++) (*f)(lemp->x4a->tbl[i].data);
+  for(i=0; i<lemp->x4a->size; i++) lemp->x4a->ht[i] = 0;
+  lemp->x4a->count = 0;
   return;
 }
+/********************** From the file "watch.c" *****************************/
+/*
+** Watch mode (-w) for the stand-alone program.  Lemon stays running and
+** regenerates the parser every time the grammar or the template changes.
+**
+** Between rebuilds the text of the template is cached, and so is the
+** analysis of the grammar.  If only the template changes, the parser
+** tables are not recomputed and only the "*.c" file is generated again.
+** Outputs are produced in memory and a file on disk is only replaced
+** if its content changes, so that build tools do not rebuild more than
+** necessary.
+*/
+#ifndef LEMON_NO_MAIN
+#ifdef __linux__
+
+/* The parts of a rule that ReportTable() changes.  These are saved
+** after the analysis, so that ReportTable() can be run again.
+*/
+struct watch_rule {
+  const char *code;
+  const char *codePrefix;
+  const char *codeSuffix;
+  int line;
+  Boolean noCode;
+  Boolean codeEmitted;
+};
+
+/* The state of watch mode */
+struct watch {
+  struct lemon *pProto;      /* The options from the command line */
+  struct lemon lem;          /* The last successful analysis */
+  int bAnalyzed;             /* True if lem holds an analysis */
+  int errorcnt;              /* lem.errorcnt after the analysis */
+  struct watch_rule *aRule;  /* Rules before ReportTable() */
+  int *aDestLineno;          /* symbol.destLineno before ReportTable() */
+  char *zTemplateFile;       /* Name of the template file */
+  char *zTemplate;           /* Cached text of the template */
+  size_t nTemplate;          /* Number of bytes in zTemplate[] */
+  struct memfile aFile[MEMFILE_COUNT];  /* The outputs */
+  int fd;                    /* The inotify file descriptor */
+  int wdGrammar;             /* Watch on the directory of the grammar */
+  int wdTemplate;            /* Watch on the directory of the template */
+  char **azModule;           /* Grammar modules read by %import */
+  int *aWdModule;            /* Watch on the directory of each module */
+  int nModule;               /* Number of entries in azModule[] */
+};
+
+/* Return the part of a pathname after the last '/' */
+static const char *watch_tail(const char *zPath){
+  const char *z = strrchr(zPath, '/');
+  return z ? z+1 : zPath;
+}
+
+/* Start watching the directory that contains the file zPath.  Editors
+** often replace a file instead of rewriting it, so watching the file
+** itself does not work.
+*/
+static int watch_dir(struct watch *w, const char *zPath){
+  char *zDir;
+  const char *zTail = watch_tail(zPath);
+  int wd;
+  if( zTail==zPath ){
+    return inotify_add_watch(w->fd, ".", IN_CLOSE_WRITE|IN_MOVED_TO);
+  }
+  zDir = (char*)malloc( zTail-zPath+1 );
+  if( zDir==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  memcpy(zDir, zPath, zTail-zPath);
+  zDir[zTail-zPath] = 0;
+  wd = inotify_add_watch(w->fd, zDir, IN_CLOSE_WRITE|IN_MOVED_TO);
+  free(zDir);
+  return wd;
+}
+
+/* Remember the modules imported by the grammar and watch them as well.
+** Called after every build of the grammar, as %import may have been
+** added or removed.
+*/
+static void watch_modules(struct watch *w, struct lemon *lemp){
+  struct gmodule *pMod;
+  int i;
+  for(i=0; i<w->nModule; i++) free(w->azModule[i]);
+  free(w->azModule);
+  free(w->aWdModule);
+  w->azModule = 0;
+  w->aWdModule = 0;
+  w->nModule = 0;
+  for(pMod=lemp->pModule; pMod; pMod=pMod->next) w->nModule++;
+  if( w->nModule==0 ) return;
+  w->azModule = (char**)malloc( w->nModule*sizeof(char*) );
+  w->aWdModule = (int*)malloc( w->nModule*sizeof(int) );
+  if( w->azModule==0 || w->aWdModule==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  for(i=0, pMod=lemp->pModule; pMod; i++, pMod=pMod->next){
+    w->azModule[i] = strdup(pMod->filename);
+    if( w->azModule[i]==0 ){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+    w->aWdModule[i] = watch_dir(w, pMod->filename);
+  }
+}
+
+/* Read the template file into memory.  Return the number of errors */
+static int watch_load_template(struct watch *w){
+  FILE *in = fopen(w->zTemplateFile, "rb");
+  long n;
+  free(w->zTemplate);
+  w->zTemplate = 0;
+  w->nTemplate = 0;
+  if( in==0 ){
+    fprintf(stderr,"Can't open the template file \"%s\".\n",w->zTemplateFile);
+    return 1;
+  }
+  fseek(in,0,2);
+  n = ftell(in);
+  rewind(in);
+  w->zTemplate = (char*)malloc( n>0 ? n+1 : 1 );
+  if( w->zTemplate==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  w->nTemplate = n>0 ? fread(w->zTemplate, 1, (size_t)n, in) : 0;
+  w->zTemplate[w->nTemplate] = 0;
+  fclose(in);
+  return 0;
+}
+
+/* Save the rules and symbols that ReportTable() modifies */
+static void watch_save(struct watch *w){
+  struct lemon *lemp = &w->lem;
+  struct rule *rp;
+  int i;
+  w->aRule = (struct watch_rule*)lemon_calloc(lemp, lemp->nrule,
+                                              sizeof(w->aRule[0]));
+  w->aDestLineno = (int*)lemon_calloc(lemp, lemp->nsymbol, sizeof(int));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    struct watch_rule *p = &w->aRule[rp->iRule];
+    p->code = rp->code;
+    p->codePrefix = rp->codePrefix;
+    p->codeSuffix = rp->codeSuffix;
+    p->line = rp->line;
+    p->noCode = rp->noCode;
+    p->codeEmitted = rp->codeEmitted;
+  }
+  for(i=0; i<lemp->nsymbol; i++){
+    w->aDestLineno[i] = lemp->symbols[i]->destLineno;
+  }
+  w->errorcnt = lemp->errorcnt;
+}
+
+/* Undo the changes that ReportTable() made to the rules and symbols */
+static void watch_restore(struct watch *w){
+  struct lemon *lemp = &w->lem;
+  struct rule *rp;
+  int i;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    struct watch_rule *p = &w->aRule[rp->iRule];
+    rp->code = p->code;
+    rp->codePrefix = p->codePrefix;
+    rp->codeSuffix = p->codeSuffix;
+    rp->line = p->line;
+    rp->noCode = p->noCode;
+    rp->codeEmitted = p->codeEmitted;
+  }
+  for(i=0; i<lemp->nsymbol; i++){
+    lemp->symbols[i]->destLineno = w->aDestLineno[i];
+  }
+  lemp->errorcnt = w->errorcnt;
+}
+
+/* Generate only the "*.c" and "*.sql" files, for a new template */
+static int watch_tables(struct lemon *lemp){
+  double rStart = lemon_clock();
+  ReportTable(lemp);
+  lemp->aPhase[PHASE_TABLES] = lemon_clock() - rStart;
+  if( lemp->nconflict > 0 ){
+    fprintf(lemp->errstream,"%d parsing conflicts.\n",lemp->nconflict);
+  }
+  return ((lemp->errorcnt > 0) || (lemp->nconflict > 0)) ? 1 : 0;
+}
+
+/* Write the output in memory to the file zName, unless the file already
+** holds exactly that text.  Return true if the file was written.
+*/
+static int watch_write(struct memfile *p, const char *zName){
+  FILE *fp;
+  int bSame = 0;
+  fp = fopen(zName, "rb");
+  if( fp ){
+    size_t i;
+    int c = 0;
+    for(i=0; i<p->n && (c = getc(fp))==(unsigned char)p->z[i]; i++){}
+    bSame = i==p->n && getc(fp)==EOF;
+    fclose(fp);
+  }
+  if( bSame ) return 0;
+  fp = fopen(zName, "wb");
+  if( fp==0 ){
+    fprintf(stderr,"Can't open file \"%s\".\n",zName);
+    return 0;
+  }
+  fwrite(p->z, 1, p->n, fp);
+  fclose(fp);
+  return 1;
+}
+
+/* Regenerate the parser.  bGrammar is true if the grammar may have
+** changed and bTemplate is true if the template may have changed.
+*/
+static void watch_build(struct watch *w, int bGrammar, int bTemplate){
+  static const char *azSuffix[] = { ".c", ".h", ".out", ".sql" };
+  static const char *azPhase[] = {
+    "parse", "analyze", "compress", "report", "tables", "header"
+  };
+  struct lemon *lemp = &w->lem;
+  double rStart = lemon_clock();
+  double rWrite;
+  int rc;
+  int i;
+
+  if( bTemplate && watch_load_template(w) ) return;
+  for(i=0; i<PHASE_COUNT; i++) lemp->aPhase[i] = -1.0;
+  if( bGrammar || !w->bAnalyzed ){
+    if( w->bAnalyzed ) lemon_free_all(lemp);
+    w->bAnalyzed = 0;
+    *lemp = *w->pProto;
+    for(i=0; i<PHASE_COUNT; i++) lemp->aPhase[i] = -1.0;
+    lemp->aMemfile = w->aFile;
+    lemp->outstream = stdout;
+    lemp->errstream = stderr;
+    lemp->zTemplate = w->zTemplate;
+    lemp->nTemplate = w->nTemplate;
+    rc = lemon_protect(lemp, lemon_analyze);
+    if( rc<0 ){
+      watch_save(w);
+      w->bAnalyzed = 1;
+      rc = lemon_protect(lemp, lemon_report);
+    }
+  }else{
+    watch_restore(w);
+    lemp->zTemplate = w->zTemplate;
+    lemp->nTemplate = w->nTemplate;
+    rc = lemon_protect(lemp, watch_tables);
+  }
+
+  /* Write the outputs that changed */
+  rWrite = lemon_clock();
+  printf("%s:", lemp->filename);
+  for(i=0; i<(int)(sizeof(azSuffix)/sizeof(azSuffix[0])); i++){
+    struct memfile *p = &w->aFile[i];
+    if( p->z ){
+      char *zName = file_makename(lemp, i==MEMFILE_REPORT && lemp->jsonReport
+                                        ? ".jsonl" : azSuffix[i]);
+      printf(" %s %s", watch_tail(zName),
+             watch_write(p, zName) ? "updated" : "unchanged");
+      lemon_free(lemp, zName);
+      free(p->z);
+      p->z = 0;
+      p->n = 0;
+    }
+  }
+  rWrite = lemon_clock() - rWrite;
+  if( lemp->errorcnt ) printf(" %d errors", lemp->errorcnt);
+  if( bGrammar ) watch_modules(w, lemp);
+  if( !w->bAnalyzed ) lemon_free_all(lemp);
+  printf("\n  %s in %.1f ms:", bGrammar ? "rebuilt" : "new template",
+         lemon_clock() - rStart);
+  for(i=0; i<PHASE_COUNT; i++){
+    if( lemp->aPhase[i]>=0.0 ) printf(" %s %.1f", azPhase[i], lemp->aPhase[i]);
+  }
+  printf(" write %.1f\n", rWrite);
+  fflush(stdout);
+}
+
+/* Watch the grammar and the template, and regenerate the parser every
+** time one of them changes.  This routine only returns on an error.
+*/
+int lemon_watch(struct lemon *pProto){
+  struct watch w;
+  union {
+    struct inotify_event ev;
+    char a[4096];
+  } buf;
+
+  memset(&w, 0, sizeof(w));
+  w.pProto = pProto;
+
+  /* Find the template.  The search is done only once. */
+  w.lem = *pProto;
+  w.zTemplateFile = pProto->templatename ? pProto->templatename
+                                         : tplt_find(&w.lem);
+  if( w.zTemplateFile==0 ){
+    fprintf(stderr,
+      "Can't find the parser driver template file \"lempar.c\".\n");
+    return 1;
+  }
+  w.zTemplateFile = strdup(w.zTemplateFile);
+  lemon_free_all(&w.lem);
+  if( w.zTemplateFile==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+
+  w.fd = inotify_init();
+  if( w.fd<0 ){
+    fprintf(stderr,"Cannot watch for changes to files.\n");
+    return 1;
+  }
+  w.wdGrammar = watch_dir(&w, pProto->filename);
+  w.wdTemplate = watch_dir(&w, w.zTemplateFile);
+  if( w.wdGrammar<0 || w.wdTemplate<0 ){
+    fprintf(stderr,"Cannot watch \"%s\" or \"%s\".\n",
+            pProto->filename, w.zTemplateFile);
+    return 1;
+  }
+  printf("Watching %s and %s.  Press Ctrl-C to stop.\n",
+         pProto->filename, w.zTemplateFile);
+  watch_build(&w, 1, 1);
+
+  for(;;){
+    int bGrammar = 0;
+    int bTemplate = 0;
+    struct pollfd pfd;
+    ssize_t n;
+    int i;
+
+    /* Wait for a change, then collect further changes until 50ms pass
+    ** without one, as editors often save in several steps */
+    pfd.fd = w.fd;
+    pfd.events = POLLIN;
+    do{
+      char *z;
+      n = read(w.fd, buf.a, sizeof(buf.a));
+      if( n<=0 ){
+        fprintf(stderr,"Cannot watch for changes to files.\n");
+        return 1;
+      }
+      for(z=buf.a; z<buf.a+n; z+=sizeof(struct inotify_event)+
+                                   ((struct inotify_event*)z)->len){
+        struct inotify_event *pEv = (struct inotify_event*)z;
+        if( pEv->len==0 ) continue;
+        if( pEv->wd==w.wdGrammar
+         && strcmp(pEv->name, watch_tail(pProto->filename))==0 ){
+          bGrammar = 1;
+        }
+        for(i=0; i<w.nModule; i++){
+          if( pEv->wd==w.aWdModule[i]
+           && strcmp(pEv->name, watch_tail(w.azModule[i]))==0 ){
+            bGrammar = 1;
+          }
+        }
+        if( pEv->wd==w.wdTemplate
+         && strcmp(pEv->name, watch_tail(w.zTemplateFile))==0 ){
+          bTemplate = 1;
+        }
+      }
+    }while( poll(&pfd, 1, 50)>0 );
+    if( bGrammar || bTemplate ) watch_build(&w, bGrammar, bTemplate);
+  }
+}
+
+#else /* !defined(__linux__) */
+int lemon_watch(struct lemon *pProto){
+  (void)pProto;
+  fprintf(stderr,"Watch mode (-w) is only available on Linux.\n");
+  return 1;
+}
+#endif /* __linux__ */
+#endif /* LEMON_NO_MAIN */
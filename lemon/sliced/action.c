@@ -3,23 +3,21 @@
 */
 
 /* Allocate a new parser action */
-static struct action *Action_new(void){
-  static struct action *actionfreelist = 0;
+static struct action *Action_new(struct lemon *lemp){
   struct action *newaction;
 
-  if( actionfreelist==0 ){
+  if( lemp->actionFreelist==0 ){
     int i;
     int amt = 100;
-    actionfreelist = (struct action *)calloc(amt, sizeof(struct action));
-    if( actionfreelist==0 ){
-      fprintf(stderr,"Unable to allocate memory for a new parser action.");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) actionfreelist[i].next = &actionfreelist[i+1];
-    actionfreelist[amt-1].next = 0;
+    struct action *a;
+    a = (struct action *)lemon_calloc(lemp, amt, sizeof(struct action));
+    for(i=0; i<amt-1; i++) a[i].next = &a[i+1];
+    a[amt-1].next = 0;
+    lemp->actionFreelist = a;
   }
-  newaction = actionfreelist;
-  actionfreelist = actionfreelist->next;
+  newaction = lemp->actionFreelist;
+  lemp->actionFreelist = newaction->next;
+  newaction->iSeq = lemp->nActionSeq++;
   return newaction;
 }
 
@@ -40,7 +38,7 @@ static int actioncmp(
     rc = ap1->x.rp->index - ap2->x.rp->index;
   }
   if( rc==0 ){
-    rc = (int) (ap2 - ap1);
+    rc = ap2->iSeq - ap1->iSeq;
   }
   return rc;
 }
@@ -55,13 +53,14 @@ static struct action *Action_sort(
 }
 
 void Action_add(
+  struct lemon *lemp,
   struct action **app,
   enum e_action type,
   struct symbol *sp,
   char *arg
 ){
   struct action *newaction;
-  newaction = Action_new();
+  newaction = Action_new(lemp);
   newaction->next = *app;
   *app = newaction;
   newaction->type = type;
@@ -116,6 +115,7 @@ struct acttab {
   int nLookaheadAlloc;         /* Slots allocated in aLookahead[] */
   int nterminal;               /* Number of terminal symbols */
   int nsymbol;                 /* total number of symbols */
+  struct lemon *lemp;          /* Owner of all memory used by this table */
 };
 
 /* Return the number of entries in the yy_action table */
@@ -129,21 +129,18 @@ struct acttab {
 
 /* Free all memory associated with the given acttab */
 void acttab_free(acttab *p){
-  free( p->aAction );
-  free( p->aLookahead );
-  free( p );
+  struct lemon *lemp = p->lemp;
+  lemon_free(lemp, p->aAction );
+  lemon_free(lemp, p->aLookahead );
+  lemon_free(lemp, p );
 }
 
 /* Allocate a new acttab structure */
-acttab *acttab_alloc(int nsymbol, int nterminal){
-  acttab *p = (acttab *) calloc( 1, sizeof(*p) );
-  if( p==0 ){
-    fprintf(stderr,"Unable to allocate memory for a new acttab.");
-    exit(1);
-  }
-  memset(p, 0, sizeof(*p));
+acttab *acttab_alloc(struct lemon *lemp, int nsymbol, int nterminal){
+  acttab *p = (acttab *) lemon_calloc(lemp, 1, sizeof(*p) );
   p->nsymbol = nsymbol;
   p->nterminal = nterminal;
+  p->lemp = lemp;
   return p;
 }
 
@@ -155,12 +152,8 @@ acttab *acttab_alloc(int nsymbol, int nterminal){
 void acttab_action(acttab *p, int lookahead, int action){
   if( p->nLookahead>=p->nLookaheadAlloc ){
     p->nLookaheadAlloc += 25;
-    p->aLookahead = (struct lookahead_action *) realloc( p->aLookahead,
-                             sizeof(p->aLookahead[0])*p->nLookaheadAlloc );
-    if( p->aLookahead==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
-    }
+    p->aLookahead = (struct lookahead_action *) lemon_realloc(p->lemp,
+             p->aLookahead, sizeof(p->aLookahead[0])*p->nLookaheadAlloc );
   }
   if( p->nLookahead==0 ){
     p->mxLookahead = lookahead;
@@ -205,12 +198,8 @@ int acttab_insert(acttab *p, int makeItSafe){
   if( p->nAction + n >= p->nActionAlloc ){
     int oldAlloc = p->nActionAlloc;
     p->nActionAlloc = p->nAction + n + p->nActionAlloc + 20;
-    p->aAction = (struct lookahead_action *) realloc( p->aAction,
-                          sizeof(p->aAction[0])*p->nActionAlloc);
-    if( p->aAction==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
-    }
+    p->aAction = (struct lookahead_action *) lemon_realloc(p->lemp,
+                          p->aAction, sizeof(p->aAction[0])*p->nActionAlloc);
     for(i=oldAlloc; i<p->nActionAlloc; i++){
       p->aAction[i].lookahead = -1;
       p->aAction[i].action = -1;
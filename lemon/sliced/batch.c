@@ -0,0 +1,283 @@
+/*
+** Batch mode for the stand-alone program: generate parsers for many
+** grammars in a single invocation.  The grammars are named on the
+** command line or listed in a manifest file (-M), and are processed in
+** parallel by a pool of worker threads (-j).  Each grammar gets its own
+** struct lemon, so the runs share nothing but the command-line options.
+**
+** A manifest holds one grammar per line.  The first word is the name
+** of the grammar file.  It may be followed by -D, -d and -T options
+** that apply to that grammar only.  Blank lines and lines that begin
+** with '#' are ignored.
+*/
+#ifndef LEMON_NO_MAIN
+
+/* One grammar to be processed in batch mode */
+struct batch_job {
+  char *zFilename;         /* Name of the grammar file */
+  char **azDefine;         /* -D macros: the global ones, then our own */
+  int nDefine;             /* Number of entries in azDefine[] */
+  char *outputDir;         /* Output directory, or NULL */
+  char *templatename;      /* Template file, or NULL */
+  int rc;                  /* Exit code of the run */
+  int nError;              /* Number of errors */
+  int nConflict;           /* Number of parsing conflicts */
+  int nRule;               /* Number of rules in the grammar */
+  int nState;              /* Number of states in the parser */
+  int tablesize;           /* Size of the parser tables in bytes */
+  double rElapsed;         /* Milliseconds used to process this grammar */
+  struct memfile out;      /* Text the run wrote to stdout */
+  struct memfile err;      /* Text the run wrote to stderr */
+};
+
+/* The state shared by all worker threads */
+struct batch {
+  struct lemon *pProto;    /* Options common to every grammar */
+  struct batch_job *aJob;  /* All grammars */
+  int nJob;                /* Number of entries in aJob[] */
+  int iNext;               /* Index of the next job to start */
+#if BATCH_THREADS
+  pthread_mutex_t mutex;   /* Protects iNext */
+#endif
+};
+
+/* Report an out-of-memory condition while setting up the batch */
+static void batch_oom(void){
+  fprintf(stderr,"out of memory\n");
+  exit(1);
+}
+
+/* Process a single grammar.  Diagnostics are captured in memory so that
+** the output of concurrent runs is not interleaved.
+*/
+static void batch_run_one(struct batch *p, struct batch_job *pJob){
+  struct lemon lem;
+  double rStart = lemon_clock();
+
+  lem = *p->pProto;
+  lem.filename = pJob->zFilename;
+  lem.azDefine = pJob->azDefine;
+  lem.nDefine = pJob->nDefine;
+  lem.outputDir = pJob->outputDir;
+  lem.templatename = pJob->templatename;
+  lem.outstream = memfile_open(&pJob->out);
+  lem.errstream = memfile_open(&pJob->err);
+  if( lem.outstream==0 || lem.errstream==0 ){
+    pJob->rc = 1;
+    pJob->nError = 1;
+  }else{
+    pJob->rc = lemon_run(&lem);
+    pJob->nError = lem.errorcnt;
+    pJob->nConflict = lem.nconflict;
+    pJob->nRule = lem.nrule;
+    pJob->nState = lem.nxstate;
+    pJob->tablesize = lem.tablesize;
+  }
+  memfile_close(&pJob->out);
+  memfile_close(&pJob->err);
+  lemon_free_all(&lem);
+  pJob->rElapsed = lemon_clock() - rStart;
+}
+
+/* Body of each worker thread.  Keep taking the next unstarted grammar
+** until there are none left.
+*/
+static void *batch_worker(void *pArg){
+  struct batch *p = (struct batch*)pArg;
+  int i;
+  for(;;){
+#if BATCH_THREADS
+    pthread_mutex_lock(&p->mutex);
+#endif
+    i = p->iNext++;
+#if BATCH_THREADS
+    pthread_mutex_unlock(&p->mutex);
+#endif
+    if( i>=p->nJob ) break;
+    batch_run_one(p, &p->aJob[i]);
+  }
+  return 0;
+}
+
+/* Append a new job for grammar zFilename to the batch */
+static struct batch_job *batch_add(struct batch *p, char *zFilename){
+  struct batch_job *pJob;
+  struct lemon *pProto = p->pProto;
+  p->aJob = (struct batch_job*)realloc(p->aJob, sizeof(p->aJob[0])*(p->nJob+1));
+  if( p->aJob==0 ) batch_oom();
+  pJob = &p->aJob[p->nJob++];
+  memset(pJob, 0, sizeof(*pJob));
+  pJob->zFilename = zFilename;
+  pJob->nDefine = pProto->nDefine;
+  pJob->azDefine = (char**)malloc(sizeof(char*)*(pProto->nDefine+1));
+  if( pJob->azDefine==0 ) batch_oom();
+  if( pProto->nDefine ){
+    memcpy(pJob->azDefine, pProto->azDefine, sizeof(char*)*pProto->nDefine);
+  }
+  pJob->outputDir = pProto->outputDir;
+  pJob->templatename = pProto->templatename;
+  return pJob;
+}
+
+/* Read the manifest file zManifest and add a job for every grammar it
+** lists.  Return the number of errors seen.  The text of the manifest
+** is returned in *pzText, since the jobs point into it.
+*/
+static int batch_read_manifest(
+  struct batch *p,             /* Add jobs to this batch */
+  const char *zManifest,       /* Name of the manifest file */
+  char **pzText                /* OUT: Text of the manifest */
+){
+  FILE *in;
+  char *z;
+  long n;
+  int lineno = 0;
+  int nErr = 0;
+
+  in = fopen(zManifest, "rb");
+  if( in==0 ){
+    fprintf(stderr,"Can't open the manifest \"%s\".\n",zManifest);
+    return 1;
+  }
+  fseek(in,0,2);
+  n = ftell(in);
+  rewind(in);
+  z = (char*)malloc( n>0 ? n+1 : 1 );
+  if( z==0 ) batch_oom();
+  n = n>0 ? (long)fread(z, 1, (size_t)n, in) : 0;
+  z[n] = 0;
+  fclose(in);
+  *pzText = z;
+
+  while( *z ){
+    char *zEol = strchr(z, '\n');
+    struct batch_job *pJob = 0;
+    lineno++;
+    if( zEol ) *zEol = 0;
+    while( *z ){
+      char *zWord;
+      while( ISSPACE(*z) ) z++;
+      if( *z==0 || (*z=='#' && pJob==0) ) break;
+      zWord = z;
+      while( *z && !ISSPACE(*z) ) z++;
+      if( *z ) *(z++) = 0;
+      if( pJob==0 ){
+        pJob = batch_add(p, zWord);
+      }else if( zWord[0]=='-' && zWord[1]=='D' && zWord[2] ){
+        char *cp;
+        for(cp=zWord+2; *cp && *cp!='='; cp++){}
+        *cp = 0;
+        pJob->azDefine[pJob->nDefine++] = zWord+2;
+        pJob->azDefine = (char**)realloc(pJob->azDefine,
+                                     sizeof(char*)*(pJob->nDefine+1));
+        if( pJob->azDefine==0 ) batch_oom();
+      }else if( zWord[0]=='-' && zWord[1]=='d' && zWord[2] ){
+        pJob->outputDir = zWord+2;
+      }else if( zWord[0]=='-' && zWord[1]=='T' && zWord[2] ){
+        pJob->templatename = zWord+2;
+      }else{
+        fprintf(stderr,"%s:%d: Unknown option \"%s\".  Only -D, -d and -T "
+                "may be given for each grammar.\n", zManifest, lineno, zWord);
+        nErr++;
+      }
+    }
+    if( zEol==0 ) break;
+    z = zEol+1;
+  }
+  return nErr;
+}
+
+/* Generate parsers for every grammar in azFile[] and in the manifest
+** zManifest, using up to nThread threads.  pProto holds the options
+** given on the command line.  Write all diagnostics, in the order the
+** grammars were given, followed by a summary.  Return the exit code for
+** the program: 0 if every grammar succeeded.
+*/
+int lemon_batch(
+  struct lemon *pProto,        /* Options common to every grammar */
+  char **azFile,               /* Grammars named on the command line */
+  int nFile,                   /* Number of entries in azFile[] */
+  const char *zManifest,       /* Manifest file, or NULL */
+  int nThread                  /* Number of worker threads.  0 for auto */
+){
+  struct batch b;
+  char *zText = 0;
+  double rStart, rElapsed, rWork = 0.0;
+  int nFail = 0;
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  b.pProto = pProto;
+  for(i=0; i<nFile; i++) batch_add(&b, azFile[i]);
+  if( zManifest && batch_read_manifest(&b, zManifest, &zText) ){
+    exit(1);
+  }
+  if( b.nJob==0 ){
+    fprintf(stderr,"No grammars to process.\n");
+    exit(1);
+  }
+  if( nThread<=0 ){
+#if BATCH_THREADS && defined(_SC_NPROCESSORS_ONLN)
+    nThread = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if( nThread<=0 ) nThread = 1;
+  }
+  if( nThread>b.nJob ) nThread = b.nJob;
+
+  rStart = lemon_clock();
+#if BATCH_THREADS
+  if( nThread>1 ){
+    pthread_t *aThread = (pthread_t*)malloc(sizeof(pthread_t)*nThread);
+    int nStarted = 0;
+    if( aThread==0 ) batch_oom();
+    pthread_mutex_init(&b.mutex, 0);
+    for(i=1; i<nThread; i++){
+      if( pthread_create(&aThread[nStarted], 0, batch_worker, &b) ) break;
+      nStarted++;
+    }
+    batch_worker(&b);
+    for(i=0; i<nStarted; i++) pthread_join(aThread[i], 0);
+    pthread_mutex_destroy(&b.mutex);
+    free(aThread);
+    nThread = nStarted+1;
+  }else
+#else
+  nThread = 1;
+#endif
+  {
+    batch_worker(&b);
+  }
+  rElapsed = lemon_clock() - rStart;
+
+  /* Everything is finished.  Now show the results in order. */
+  for(i=0; i<b.nJob; i++){
+    struct batch_job *pJob = &b.aJob[i];
+    if( pJob->out.n ) fwrite(pJob->out.z, 1, pJob->out.n, stdout);
+    if( pJob->err.n ) fwrite(pJob->err.z, 1, pJob->err.n, stderr);
+    if( pJob->rc ){
+      fprintf(stderr,"%s: failed with %d errors and %d conflicts.\n",
+              pJob->zFilename, pJob->nError, pJob->nConflict);
+      nFail++;
+    }
+  }
+  fflush(stderr);
+  printf("Batch summary:\n");
+  printf("  %-30s %8s %6s %6s %9s %8s\n",
+         "grammar", "ms", "rules", "states", "conflicts", "bytes");
+  for(i=0; i<b.nJob; i++){
+    struct batch_job *pJob = &b.aJob[i];
+    printf("  %-30s %8.1f %6d %6d %9d %8d%s\n", pJob->zFilename,
+           pJob->rElapsed, pJob->nRule, pJob->nState, pJob->nConflict,
+           pJob->tablesize, pJob->rc ? "  FAILED" : "");
+    rWork += pJob->rElapsed;
+    free(pJob->azDefine);
+    free(pJob->out.z);
+    free(pJob->err.z);
+  }
+  printf("  %d grammars, %d failed, %d threads, %.1f ms elapsed, "
+         "%.1f ms of work\n", b.nJob, nFail, nThread, rElapsed, rWork);
+  free(b.aJob);
+  free(zText);
+  return nFail>0 ? 1 : 0;
+}
+#endif /* LEMON_NO_MAIN */
@@ -0,0 +1,2 @@
+int lemon_batch(struct lemon *, char **, int, const char *, int);
+
@@ -51,7 +51,7 @@ void FindFirstSets(struct lemon *lemp)
     lemp->symbols[i]->lambda = LEMON_FALSE;
   }
   for(i=lemp->nterminal; i<lemp->nsymbol; i++){
-    lemp->symbols[i]->firstset = SetNew();
+    lemp->symbols[i]->firstset = SetNew(lemp);
   }
 
   /* First compute all lambdas */
@@ -80,17 +80,17 @@ void FindFirstSets(struct lemon *lemp)
       for(i=0; i<rp->nrhs; i++){
         s2 = rp->rhs[i];
         if( s2->type==TERMINAL ){
-          progress += SetAdd(s1->firstset,s2->index);
+          progress += SetAdd(lemp,s1->firstset,s2->index);
           break;
         }else if( s2->type==MULTITERMINAL ){
           for(j=0; j<s2->nsubsym; j++){
-            progress += SetAdd(s1->firstset,s2->subsym[j]->index);
+            progress += SetAdd(lemp,s1->firstset,s2->subsym[j]->index);
           }
           break;
         }else if( s1==s2 ){
           if( s1->lambda==LEMON_FALSE ) break;
         }else{
-          progress += SetUnion(s1->firstset,s2->firstset);
+          progress += SetUnion(lemp,s1->firstset,s2->firstset);
           if( s2->lambda==LEMON_FALSE ) break;
         }
       }
@@ -109,13 +109,13 @@ void FindStates(struct lemon *lemp)
   struct symbol *sp;
   struct rule *rp;
 
-  Configlist_init();
+  Configlist_init(lemp);
 
   /* Find the start symbol */
   if( lemp->start ){
-    sp = Symbol_find(lemp->start);
+    sp = Symbol_find(lemp,lemp->start);
     if( sp==0 ){
-      ErrorMsg(lemp->filename,0,
+      ErrorMsg(lemp,lemp->filename,0,
         "The specified start symbol \"%s\" is not "
         "in a nonterminal of the grammar.  \"%s\" will be used as the start "
         "symbol instead.",lemp->start,lemp->startRule->lhs->name);
@@ -125,8 +125,9 @@ void FindStates(struct lemon *lemp)
   }else if( lemp->startRule ){
     sp = lemp->startRule->lhs;
   }else{
-    ErrorMsg(lemp->filename,0,"Internal error - no start rule\n");
-    exit(1);
+    ErrorMsg(lemp,lemp->filename,0,"Internal error - no start rule\n");
+    lemon_fatal(lemp);
+    return;
   }
 
   /* Make sure the start symbol doesn't occur on the right-hand side of
@@ -136,7 +137,7 @@ void FindStates(struct lemon *lemp)
     int i;
     for(i=0; i<rp->nrhs; i++){
       if( rp->rhs[i]==sp ){   /* FIX ME:  Deal with multiterminals */
-        ErrorMsg(lemp->filename,0,
+        ErrorMsg(lemp,lemp->filename,0,
           "The start symbol \"%s\" occurs on the "
           "right-hand side of a rule. This will result in a parser which "
           "does not work properly.",sp->name);
@@ -151,8 +152,8 @@ void FindStates(struct lemon *lemp)
   for(rp=sp->rule; rp; rp=rp->nextlhs){
     struct config *newcfp;
     rp->lhsStart = 1;
-    newcfp = Configlist_addbasis(rp,0);
-    SetAdd(newcfp->fws,0);
+    newcfp = Configlist_addbasis(lemp,rp,0);
+    SetAdd(lemp,newcfp->fws,0);
   }
 
   /* Compute the first state.  All other states will be
@@ -173,11 +174,11 @@ PRIVATE struct state *getstate(struct lemon *lemp)
 
   /* Extract the sorted basis of the new state.  The basis was constructed
   ** by prior calls to "Configlist_addbasis()". */
-  Configlist_sortbasis();
-  bp = Configlist_basis();
+  Configlist_sortbasis(lemp);
+  bp = Configlist_basis(lemp);
 
   /* Get a state with the same basis */
-  stp = State_find(bp);
+  stp = State_find(lemp,bp);
   if( stp ){
     /* A state with the same basis already exists!  Copy all the follow-set
     ** propagation links from the state under construction into the
@@ -185,23 +186,23 @@ PRIVATE struct state *getstate(struct lemon *lemp)
     struct config *x, *y;
     for(x=bp, y=stp->bp; x && y; x=x->bp, y=y->bp){
       Plink_copy(&y->bplp,x->bplp);
-      Plink_delete(x->fplp);
+      Plink_delete(lemp,x->fplp);
       x->fplp = x->bplp = 0;
     }
-    cfp = Configlist_return();
-    Configlist_eat(cfp);
+    cfp = Configlist_return(lemp);
+    Configlist_eat(lemp,cfp);
   }else{
     /* This really is a new state.  Construct all the details */
     Configlist_closure(lemp);    /* Compute the configuration closure */
-    Configlist_sort();           /* Sort the configuration closure */
-    cfp = Configlist_return();   /* Get a pointer to the config list */
-    stp = State_new();           /* A new state structure */
-    MemoryCheck(stp);
+    Configlist_sort(lemp);           /* Sort the configuration closure */
+    cfp = Configlist_return(lemp);   /* Get a pointer to the config list */
+    stp = State_new(lemp);       /* A new state structure */
     stp->bp = bp;                /* Remember the configuration basis */
     stp->cfp = cfp;              /* Remember the configuration closure */
     stp->statenum = lemp->nstate++; /* Every state gets a sequence number */
+    stp->iOrigin = stp->statenum;
     stp->ap = 0;                 /* No actions, yet. */
-    State_insert(stp,stp->bp);   /* Add to the state table */
+    State_insert(lemp,stp,stp->bp);   /* Add to the state table */
     buildshifts(lemp,stp);       /* Recursively compute successor states */
   }
   return stp;
@@ -243,7 +244,7 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
   for(cfp=stp->cfp; cfp; cfp=cfp->next){
     if( cfp->status==COMPLETE ) continue;    /* Already used by inner loop */
     if( cfp->dot>=cfp->rp->nrhs ) continue;  /* Can't shift this config */
-    Configlist_reset();                      /* Reset the new config set */
+    Configlist_reset(lemp);                      /* Reset the new config set */
     sp = cfp->rp->rhs[cfp->dot];             /* Symbol after the dot */
 
     /* For every configuration in the state "stp" which has the symbol "sp"
@@ -255,8 +256,8 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
       bsp = bcfp->rp->rhs[bcfp->dot];           /* Get symbol after dot */
       if( !same_symbol(bsp,sp) ) continue;      /* Must be same as for "cfp" */
       bcfp->status = COMPLETE;                  /* Mark this config as used */
-      newcfg = Configlist_addbasis(bcfp->rp,bcfp->dot+1);
-      Plink_add(&newcfg->bplp,bcfp);
+      newcfg = Configlist_addbasis(lemp,bcfp->rp,bcfp->dot+1);
+      Plink_add(lemp,&newcfg->bplp,bcfp);
     }
 
     /* Get a pointer to the state described by the basis configuration set
@@ -268,10 +269,10 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
     if( sp->type==MULTITERMINAL ){
       int i;
       for(i=0; i<sp->nsubsym; i++){
-        Action_add(&stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
+        Action_add(lemp,&stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
       }
     }else{
-      Action_add(&stp->ap,SHIFT,sp,(char *)newstp);
+      Action_add(lemp,&stp->ap,SHIFT,sp,(char *)newstp);
     }
   }
 }
@@ -303,7 +304,7 @@ void FindLinks(struct lemon *lemp)
     for(cfp=stp?stp->cfp:0; cfp; cfp=cfp->next){
       for(plp=cfp->bplp; plp; plp=plp->next){
         other = plp->cfp;
-        Plink_add(&other->fplp,cfp);
+        Plink_add(lemp,&other->fplp,cfp);
       }
     }
   }
@@ -336,7 +337,7 @@ void FindFollowSets(struct lemon *lemp)
       for(cfp=lemp->sorted[i]->cfp; cfp; cfp=cfp->next){
         if( cfp->status==COMPLETE ) continue;
         for(plp=cfp->fplp; plp; plp=plp->next){
-          change = SetUnion(plp->cfp->fws,cfp->fws);
+          change = SetUnion(lemp,plp->cfp->fws,cfp->fws);
           if( change ){
             plp->cfp->status = INCOMPLETE;
             progress = 1;
@@ -372,7 +373,7 @@ void FindActions(struct lemon *lemp)
           if( SetFind(cfp->fws,j) ){
             /* Add a reduce action to the state "stp" which will reduce by the
             ** rule "cfp->rp" if the lookahead symbol is "lemp->symbols[j]" */
-            Action_add(&stp->ap,REDUCE,lemp->symbols[j],(char *)cfp->rp);
+            Action_add(lemp,&stp->ap,REDUCE,lemp->symbols[j],(char *)cfp->rp);
           }
         }
       }
@@ -381,12 +382,13 @@ void FindActions(struct lemon *lemp)
 
   /* Add the accepting token */
   if( lemp->start ){
-    sp = Symbol_find(lemp->start);
+    sp = Symbol_find(lemp,lemp->start);
     if( sp==0 ){
       if( lemp->startRule==0 ){
-        fprintf(stderr, "internal error on source line %d: no start rule\n",
+        fprintf(lemp->errstream,
+                "internal error on source line %d: no start rule\n",
                 __LINE__);
-        exit(1);
+        lemon_fatal(lemp);
       }
       sp = lemp->startRule->lhs;
     }
@@ -396,7 +398,7 @@ void FindActions(struct lemon *lemp)
   /* Add to the first state (which is always the starting state of the
   ** finite state machine) an action to ACCEPT if the lookahead is the
   ** start nonterminal.  */
-  Action_add(&lemp->sorted[0]->ap,ACCEPT,sp,0);
+  Action_add(lemp,&lemp->sorted[0]->ap,ACCEPT,sp,0);
 
   /* Resolve conflicts */
   for(i=0; i<lemp->nstate; i++){
@@ -423,7 +425,8 @@ void FindActions(struct lemon *lemp)
   }
   for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->canReduce ) continue;
-    ErrorMsg(lemp->filename,rp->ruleline,"This rule can not be reduced.\n");
+    ErrorMsg(lemp,rp->filename,rp->ruleline,
+             "This rule can not be reduced.\n");
     lemp->errorcnt++;
   }
 }
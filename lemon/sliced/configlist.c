@@ -3,95 +3,109 @@
 ** in the LEMON parser generator.
 */
 
-static struct config *freelist = 0;      /* List of free configurations */
-static struct config *current = 0;       /* Top of list of configurations */
-static struct config **currentend = 0;   /* Last on list of configs */
-static struct config *basis = 0;         /* Top of list of basis configs */
-static struct config **basisend = 0;     /* End of list of basis configs */
+/* The list builder keeps its state in the following fields of
+** struct lemon:
+**
+**    configFreelist      List of free configurations
+**    configCurrent       Top of list of configurations
+**    configCurrentend    Last on list of configs
+**    configBasis         Top of list of basis configs
+**    configBasisend      End of list of basis configs
+*/
 
 /* Return a pointer to a new configuration */
-PRIVATE struct config *newconfig(void){
-  return (struct config*)calloc(1, sizeof(struct config));
+PRIVATE struct config *newconfig(struct lemon *lemp){
+  struct config *cfp = lemp->configFreelist;
+  if( cfp==0 ){
+    return (struct config*)lemon_calloc(lemp, 1, sizeof(struct config));
+  }
+  lemp->configFreelist = cfp->next;
+  memset(cfp, 0, sizeof(*cfp));
+  return cfp;
 }
 
 /* The configuration "old" is no longer used */
-PRIVATE void deleteconfig(struct config *old)
+PRIVATE void deleteconfig(struct lemon *lemp, struct config *old)
 {
-  old->next = freelist;
-  freelist = old;
+  old->next = lemp->configFreelist;
+  lemp->configFreelist = old;
 }
 
 /* Initialized the configuration list builder */
-void Configlist_init(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
-  Configtable_init();
+void Configlist_init(struct lemon *lemp){
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = &lemp->configCurrent;
+  lemp->configBasis = 0;
+  lemp->configBasisend = &lemp->configBasis;
+  Configtable_init(lemp);
   return;
 }
 
 /* Initialized the configuration list builder */
-void Configlist_reset(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
-  Configtable_clear(0);
+void Configlist_reset(struct lemon *lemp){
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = &lemp->configCurrent;
+  lemp->configBasis = 0;
+  lemp->configBasisend = &lemp->configBasis;
+  Configtable_clear(lemp,0);
   return;
 }
 
 /* Add another configuration to the configuration list */
 struct config *Configlist_add(
+  struct lemon *lemp, /* The parser generator */
   struct rule *rp,    /* The rule */
   int dot             /* Index into the RHS of the rule where the dot goes */
 ){
   struct config *cfp, model;
 
-  assert( currentend!=0 );
+  assert( lemp->configCurrentend!=0 );
   model.rp = rp;
   model.dot = dot;
-  cfp = Configtable_find(&model);
+  cfp = Configtable_find(lemp,&model);
   if( cfp==0 ){
-    cfp = newconfig();
+    cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew();
+    cfp->fws = SetNew(lemp);
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
-    Configtable_insert(cfp);
+    *lemp->configCurrentend = cfp;
+    lemp->configCurrentend = &cfp->next;
+    Configtable_insert(lemp,cfp);
   }
   return cfp;
 }
 
 /* Add a basis configuration to the configuration list */
-struct config *Configlist_addbasis(struct rule *rp, int dot)
-{
+struct config *Configlist_addbasis(
+  struct lemon *lemp, /* The parser generator */
+  struct rule *rp,    /* The rule */
+  int dot             /* Index into the RHS of the rule where the dot goes */
+){
   struct config *cfp, model;
 
-  assert( basisend!=0 );
-  assert( currentend!=0 );
+  assert( lemp->configBasisend!=0 );
+  assert( lemp->configCurrentend!=0 );
   model.rp = rp;
   model.dot = dot;
-  cfp = Configtable_find(&model);
+  cfp = Configtable_find(lemp,&model);
   if( cfp==0 ){
-    cfp = newconfig();
+    cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew();
+    cfp->fws = SetNew(lemp);
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
-    *basisend = cfp;
-    basisend = &cfp->bp;
-    Configtable_insert(cfp);
+    *lemp->configCurrentend = cfp;
+    lemp->configCurrentend = &cfp->next;
+    *lemp->configBasisend = cfp;
+    lemp->configBasisend = &cfp->bp;
+    Configtable_insert(lemp,cfp);
   }
   return cfp;
 }
@@ -104,37 +118,37 @@ void Configlist_closure(struct lemon *lemp)
   struct symbol *sp, *xsp;
   int i, dot;
 
-  assert( currentend!=0 );
-  for(cfp=current; cfp; cfp=cfp->next){
+  assert( lemp->configCurrentend!=0 );
+  for(cfp=lemp->configCurrent; cfp; cfp=cfp->next){
     rp = cfp->rp;
     dot = cfp->dot;
     if( dot>=rp->nrhs ) continue;
     sp = rp->rhs[dot];
     if( sp->type==NONTERMINAL ){
       if( sp->rule==0 && sp!=lemp->errsym ){
-        ErrorMsg(lemp->filename,rp->line,"Nonterminal \"%s\" has no rules.",
-          sp->name);
+        ErrorMsg(lemp,rp->filename,rp->line,
+          "Nonterminal \"%s\" has no rules.",sp->name);
         lemp->errorcnt++;
       }
       for(newrp=sp->rule; newrp; newrp=newrp->nextlhs){
-        newcfp = Configlist_add(newrp,0);
+        newcfp = Configlist_add(lemp,newrp,0);
         for(i=dot+1; i<rp->nrhs; i++){
           xsp = rp->rhs[i];
           if( xsp->type==TERMINAL ){
-            SetAdd(newcfp->fws,xsp->index);
+            SetAdd(lemp,newcfp->fws,xsp->index);
             break;
           }else if( xsp->type==MULTITERMINAL ){
             int k;
             for(k=0; k<xsp->nsubsym; k++){
-              SetAdd(newcfp->fws, xsp->subsym[k]->index);
+              SetAdd(lemp,newcfp->fws, xsp->subsym[k]->index);
             }
             break;
           }else{
-            SetUnion(newcfp->fws,xsp->firstset);
+            SetUnion(lemp,newcfp->fws,xsp->firstset);
             if( xsp->lambda==LEMON_FALSE ) break;
           }
         }
-        if( i==rp->nrhs ) Plink_add(&cfp->fplp,newcfp);
+        if( i==rp->nrhs ) Plink_add(lemp,&cfp->fplp,newcfp);
       }
     }
   }
@@ -142,51 +156,51 @@ void Configlist_closure(struct lemon *lemp)
 }
 
 /* Sort the configuration list */
-void Configlist_sort(void){
-  current = (struct config*)msort((char*)current,(char**)&(current->next),
-                                  Configcmp);
-  currentend = 0;
+void Configlist_sort(struct lemon *lemp){
+  lemp->configCurrent = (struct config*)msort((char*)lemp->configCurrent,
+                          (char**)&(lemp->configCurrent->next), Configcmp);
+  lemp->configCurrentend = 0;
   return;
 }
 
 /* Sort the basis configuration list */
-void Configlist_sortbasis(void){
-  basis = (struct config*)msort((char*)current,(char**)&(current->bp),
-                                Configcmp);
-  basisend = 0;
+void Configlist_sortbasis(struct lemon *lemp){
+  lemp->configBasis = (struct config*)msort((char*)lemp->configCurrent,
+                          (char**)&(lemp->configCurrent->bp), Configcmp);
+  lemp->configBasisend = 0;
   return;
 }
 
 /* Return a pointer to the head of the configuration list and
 ** reset the list */
-struct config *Configlist_return(void){
+struct config *Configlist_return(struct lemon *lemp){
   struct config *old;
-  old = current;
-  current = 0;
-  currentend = 0;
+  old = lemp->configCurrent;
+  lemp->configCurrent = 0;
+  lemp->configCurrentend = 0;
   return old;
 }
 
 /* Return a pointer to the head of the configuration list and
 ** reset the list */
-struct config *Configlist_basis(void){
+struct config *Configlist_basis(struct lemon *lemp){
   struct config *old;
-  old = basis;
-  basis = 0;
-  basisend = 0;
+  old = lemp->configBasis;
+  lemp->configBasis = 0;
+  lemp->configBasisend = 0;
   return old;
 }
 
 /* Free all elements of the given configuration list */
-void Configlist_eat(struct config *cfp)
+void Configlist_eat(struct lemon *lemp, struct config *cfp)
 {
   struct config *nextcfp;
   for(; cfp; cfp=nextcfp){
     nextcfp = cfp->next;
     assert( cfp->fplp==0 );
     assert( cfp->bplp==0 );
-    if( cfp->fws ) SetFree(cfp->fws);
-    deleteconfig(cfp);
+    if( cfp->fws ) SetFree(lemp,cfp->fws);
+    deleteconfig(lemp,cfp);
   }
   return;
 }
@@ -1,11 +1,11 @@
-void Configlist_init(void);
-struct config *Configlist_add(struct rule *, int);
-struct config *Configlist_addbasis(struct rule *, int);
+void Configlist_init(struct lemon *);
+struct config *Configlist_add(struct lemon *, struct rule *, int);
+struct config *Configlist_addbasis(struct lemon *, struct rule *, int);
 void Configlist_closure(struct lemon *);
-void Configlist_sort(void);
-void Configlist_sortbasis(void);
-struct config *Configlist_return(void);
-struct config *Configlist_basis(void);
-void Configlist_eat(struct config *);
-void Configlist_reset(void);
+void Configlist_sort(struct lemon *);
+void Configlist_sortbasis(struct lemon *);
+struct config *Configlist_return(struct lemon *);
+struct config *Configlist_basis(struct lemon *);
+void Configlist_eat(struct lemon *, struct config *);
+void Configlist_reset(struct lemon *);
 
@@ -2,11 +2,17 @@
 ** Code for printing error message.
 */
 
-void ErrorMsg(const char *filename, int lineno, const char *format, ...){
+void ErrorMsg(
+  struct lemon *lemp,
+  const char *filename,
+  int lineno,
+  const char *format,
+  ...
+){
   va_list ap;
-  fprintf(stderr, "%s:%d: ", filename, lineno);
+  fprintf(lemp->errstream, "%s:%d: ", filename, lineno);
   va_start(ap, format);
-  vfprintf(stderr,format,ap);
+  vfprintf(lemp->errstream,format,ap);
   va_end(ap);
-  fprintf(stderr, "\n");
+  fprintf(lemp->errstream, "\n");
 }
@@ -1,2 +1,2 @@
-void ErrorMsg(const char *, int,const char *, ...);
+void ErrorMsg(struct lemon *, const char *, int,const char *, ...);
 
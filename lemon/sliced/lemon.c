@@ -6,12 +6,18 @@
 **
 ** The author of this program disclaims copyright.
 */
+#if !defined(_WIN32) && !defined(WIN32) && !defined(__WIN32__) \
+ && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+# define _POSIX_C_SOURCE 200809L   /* For open_memstream() and fmemopen() */
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <setjmp.h>
+#include <time.h>
 
 #define ISSPACE(X) isspace((unsigned char)(X))
 #define ISDIGIT(X) isdigit((unsigned char)(X))
@@ -37,6 +43,24 @@ extern int access(const char *path, int mode);
 #endif
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+/* Watch mode uses inotify to see when files change */
+#if defined(__linux__) && !defined(LEMON_NO_MAIN)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+/* Batch mode uses a pool of threads unless LEMON_NO_THREADS is defined */
+#if !defined(__WIN32__) && !defined(LEMON_NO_THREADS)
+#include <pthread.h>
+#define BATCH_THREADS 1
+#else
+#define BATCH_THREADS 0
 #endif
 
 /* #define PRIVATE static */
@@ -48,8 +72,6 @@ extern int access(const char *path, int mode);
 #define MAXRHS 1000
 #endif
 
-extern void memory_error();
-static int showPrecedenceConflict = 0;
 static char *msort(char*,char**,int(*)(const char*,const char*));
 
 /*
@@ -134,6 +156,7 @@ static int lemon_vsprintf(char *str, const char *zFormat, va_list ap){
       }else if( c=='%' ){
         lemon_addtext(str, &nUsed, "%", 1, 0);
       }else{
+        /* No other formats are used by this program */
         fprintf(stderr, "illegal format\n");
         exit(1);
       }
@@ -164,13 +187,24 @@ static void lemon_strcat(char *dest, const char *src){
 struct rule;
 struct lemon;
 struct action;
+struct memfile;
 
-static struct action *Action_new(void);
+static struct action *Action_new(struct lemon *);
 static struct action *Action_sort(struct action *);
 
+/* Steps of a run of the parser generator, from liblemon.c */
+double lemon_clock(void);
+int lemon_analyze(struct lemon *);
+int lemon_report(struct lemon *);
+int lemon_protect(struct lemon *, int(*)(struct lemon *));
+int lemon_run(struct lemon *);
+
+#include "batch.h"
 #include "build.h"
 #include "configlist.h"
 #include "error.h"
+#include "liblemon.h"
+#include "memory.h"
 #include "option.h"
 #include "parse.h"
 #include "plink.h"
@@ -178,11 +212,15 @@ static struct action *Action_sort(struct action *);
 #include "set.h"
 #include "struct.h"
 #include "table.h"
+#include "watch.h"
 #include "action.c"
+#include "batch.c"
 #include "build.c"
 #include "configlist.c"
 #include "error.c"
+#include "liblemon.c"
 #include "main.c"
+#include "memory.c"
 #include "msort.c"
 #include "option.c"
 #include "parse.c"
@@ -190,3 +228,4 @@ static struct action *Action_sort(struct action *);
 #include "report.c"
 #include "set.c"
 #include "table.c"
+#include "watch.c"
@@ -43,6 +43,11 @@
 **                       values which should be used if the original symbol
 **                       would not parse.  This permits keywords to sometimes
 **                       be used as identifiers, for example.
+**    YYFOLDED           If defined, the fall-back tokens and the wildcard
+**                       have been resolved into the tables (lemon -F), so
+**                       a token never has to be retried.
+**    YYTOKENVALUES      0 if the value of no token is ever used, 2 if
+**                       yyTokenValue[] tells which are.  Otherwise all are.
 **    YYACTIONTYPE       is the data type used for "action codes" - numbers
 **                       that indicate what to do in response to the next
 **                       token.
@@ -71,6 +76,7 @@
 **                       defined, then do no error processing.
 **    YYNSTATE           the combined number of states.
 **    YYNRULE            the number of rules in the grammar
+**    YYMAXRHS           the most symbols on the right of any rule, at least 1
 **    YYNTOKEN           Number of terminal symbols
 **    YY_MAX_SHIFT       Maximum value for shift actions
 **    YY_MIN_SHIFTREDUCE Minimum value for shift-reduce actions
@@ -87,7 +93,14 @@
 /************* Begin control #defines *****************************************/
 %%
 /************* End control #defines *******************************************/
-#define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
+#if defined(YY_LOADED_TABLES)
+# define YY_NLOOKAHEAD (yy_tables->nLookahead)
+#else
+# define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
+#endif
+#ifndef YYTOKENVALUES
+# define YYTOKENVALUES 1
+#endif
 
 /* Define the yytestcase() macro to be a no-op if is not already defined
 ** otherwise.
@@ -151,10 +164,279 @@
 **                     shifting non-terminals after a reduce.
 **  yy_default[]       Default action for each state.
 **
+** With YYPROFILE defined, yy_state_origin[] also gives the number that
+** lemon gave each state before it sorted them, for ParseProfile().
+**
+** That is the default encoding of the tables.  The "-e" option of Lemon
+** selects one of the others:
+**
+**  -edense   yy_action[] is a YYNSTATE by YYNTOKEN matrix and yy_goto[]
+**            is the same for non-terminals, so there is no lookahead
+**            check.  YY_DENSE_TABLES is defined.
+**
+**  -ehash    Every state has rows of its own in yy_action[] and
+**            yy_lookahead[], of a power-of-two size.  Symbol X is found
+**            at a place computed from X and the multiplier and size in
+**            yy_shift_hash[] or yy_reduce_hash[], a hash that is perfect
+**            for that row.  YY_HASHED_TABLES is defined.
+**
+**  -ecode    There are no yy_action[] and yy_lookahead[] arrays.  The
+**            functions yy_shift_code() and yy_goto_code() switch on the
+**            state and then on the symbol, and return the action.
+**            YY_CODED_TABLES is defined.
+**
+**  -epair    The same as the default, except that the look-ahead and the
+**            action of each entry are stored side by side in yy_pair[],
+**            and the offsets and default action of each state in
+**            yy_state[], so that a look-up reads one entry of each.
+**            YY_PAIRED_TABLES is defined.
+**
+**  -epacked  The same tables as the default, but each is an array of
+**            bytes holding its entries at the exact number of bits
+**            they need, YY_ACTION_BITS and so on.  The offsets are
+**            stored less their smallest value.  YY_PACKED_TABLES is
+**            defined.
+**
+** With "lemon -B" the default tables, yyFallback[] and the yyRuleInfo
+** arrays are written to a binary file, "*.tbl", instead, and only
+** pointers to them are declared here.  YY_LOADED_TABLES is defined.
+**
 *********** Begin parsing tables **********************************************/
 %%
 /********** End of lemon-generated parsing tables *****************************/
 
+/*
+** With YY_LOADED_TABLES, the tables must be attached before the parser
+** runs, by ParseTablesOpen() or ParseTablesAttach().  The file starts
+** with the header below, in the byte order of the machine that runs the
+** parser, followed by the tables themselves.  Each entry of aTable[] is
+** the byte offset of one table in the file, its number of entries and
+** the size of an entry, for yy_action[], yy_lookahead[], yy_shift_ofst[],
+** yy_reduce_ofst[], yy_default[], yyFallback[], yyRuleInfoLhs[] and
+** yyRuleInfoNRhs[] in that order.
+**
+** The fingerprint covers the symbols, the rules and the constants that
+** are compiled into the parser, so a file written by lemon for another
+** version of the grammar is accepted only if those are all unchanged.
+** The tables themselves can differ, for example after changes to the
+** precedence rules or a new profile (-P).  Processes that map the same
+** file share one copy of it.
+*/
+#if defined(YY_LOADED_TABLES)
+typedef struct yyTablesHeader yyTablesHeader;
+struct yyTablesHeader {
+  char zMagic[8];              /* "LEMONTBL" */
+  unsigned int iByteOrder;     /* 0x01020304 in the native byte order */
+  unsigned int iVersion;       /* Version of this format.  Currently 1 */
+  unsigned int iFingerprint;   /* Must match YY_TABLES_FINGERPRINT */
+  unsigned int iChecksum;      /* FNV-1a hash of the bytes after the header */
+  unsigned int nByte;          /* Size of the whole file */
+  int nAction;                 /* YY_ACTTAB_COUNT */
+  int nLookahead;              /* YY_NLOOKAHEAD */
+  int iShiftCount, iShiftMin, iShiftMax;      /* YY_SHIFT_* */
+  int iReduceCount, iReduceMin, iReduceMax;   /* YY_REDUCE_* */
+  unsigned int aTable[8][3];   /* Offset, entries and entry size */
+  unsigned int iUnused;        /* Pads the header to 160 bytes */
+};
+static const yyTablesHeader *yy_tables = 0;
+
+/* The checksum of the n bytes at a */
+static unsigned int yy_tables_checksum(const unsigned char *a, size_t n){
+  unsigned int h = 2166136261u;
+  size_t i;
+  for(i=0; i<n; i++){
+    h = (h ^ a[i])*16777619u;
+  }
+  return h;
+}
+
+/*
+** Use the tables in the nBlob bytes at pBlob, which must stay in place
+** for as long as the parser uses them.  Return 0 on success.  Otherwise
+** the tables are not used, and the return value says why: 1 if this is
+** not a table file, 2 if it was written for another byte order or
+** version, 3 if it is damaged, or 4 if it is for another grammar.
+** Attach tables only while no parse is in progress.
+*/
+int ParseTablesAttach(const void *pBlob, size_t nBlob){
+  const yyTablesHeader *p = (const yyTablesHeader*)pBlob;
+  const unsigned char *a = (const unsigned char*)pBlob;
+  unsigned int aSize[8];
+  unsigned int aCount[8];
+  int i;
+
+  if( nBlob<sizeof(*p) ) return 1;
+  for(i=0; i<8; i++){
+    if( p->zMagic[i]!="LEMONTBL"[i] ) return 1;
+  }
+  if( p->iByteOrder!=0x01020304 || p->iVersion!=1 ) return 2;
+  if( p->nByte!=nBlob
+   || p->iChecksum!=yy_tables_checksum(&a[sizeof(*p)], nBlob-sizeof(*p))
+  ){
+    return 3;
+  }
+  if( p->iFingerprint!=YY_TABLES_FINGERPRINT ) return 4;
+  aSize[0] = sizeof(yy_action[0]);       aCount[0] = p->nAction;
+  aSize[1] = sizeof(yy_lookahead[0]);    aCount[1] = p->nLookahead;
+  aSize[2] = sizeof(yy_shift_ofst[0]);   aCount[2] = p->iShiftCount+1;
+  aSize[3] = sizeof(yy_reduce_ofst[0]);  aCount[3] = p->iReduceCount+1;
+  aSize[4] = sizeof(yy_default[0]);      aCount[4] = YYNSTATE;
+  aSize[5] = sizeof(YYCODETYPE);         aCount[5] = 0;
+#ifdef YYFALLBACK
+  aCount[5] = YYNTOKEN;
+#endif
+  aSize[6] = sizeof(yyRuleInfoLhs[0]);   aCount[6] = YYNRULE;
+  aSize[7] = sizeof(yyRuleInfoNRhs[0]);  aCount[7] = YYNRULE;
+  for(i=0; i<8; i++){
+    if( p->aTable[i][2]!=aSize[i] ) return 4;
+    if( p->aTable[i][1]!=aCount[i] ) return 3;
+    if( p->aTable[i][0]%aSize[i]!=0
+     || p->aTable[i][0]>nBlob
+     || p->aTable[i][1]>(nBlob-p->aTable[i][0])/aSize[i]
+    ){
+      return 3;
+    }
+  }
+  if( p->iShiftCount>=YYNSTATE || p->iReduceCount>=YYNSTATE
+   || p->nLookahead<YYNTOKEN+p->nAction
+  ){
+    return 3;
+  }
+  yy_tables = p;
+  yy_action = (const YYACTIONTYPE*)&a[p->aTable[0][0]];
+  yy_lookahead = (const YYCODETYPE*)&a[p->aTable[1][0]];
+  yy_shift_ofst = (const YYSHIFTOFSTTYPE*)&a[p->aTable[2][0]];
+  yy_reduce_ofst = (const YYREDUCEOFSTTYPE*)&a[p->aTable[3][0]];
+  yy_default = (const YYACTIONTYPE*)&a[p->aTable[4][0]];
+#ifdef YYFALLBACK
+  yyFallback = (const YYCODETYPE*)&a[p->aTable[5][0]];
+#endif
+  yyRuleInfoLhs = (const YYCODETYPE*)&a[p->aTable[6][0]];
+  yyRuleInfoNRhs = (const signed char*)&a[p->aTable[7][0]];
+  return 0;
+}
+
+/*
+** Map the table file zFile into memory, read-only, and use its tables.
+** Return 0 on success, -1 if the file cannot be read, or the error of
+** ParseTablesAttach().  On success, the tables used before are released
+** if they came from ParseTablesOpen() too.
+*/
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+static void *yy_tables_map = 0;     /* Memory of ParseTablesOpen(), if any */
+static size_t yy_tables_nmap = 0;   /* Size of yy_tables_map */
+int ParseTablesOpen(const char *zFile){
+  void *pMap;
+  size_t nMap;
+  int rc;
+#if !defined(_WIN32)
+  struct stat st;
+  int fd = open(zFile, O_RDONLY);
+  if( fd<0 ) return -1;
+  if( fstat(fd, &st)!=0 || st.st_size<=0 ){
+    close(fd);
+    return -1;
+  }
+  nMap = (size_t)st.st_size;
+  pMap = mmap(0, nMap, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if( pMap==MAP_FAILED ) return -1;
+#else
+  FILE *in = fopen(zFile, "rb");
+  long n;
+  if( in==0 ) return -1;
+  fseek(in, 0, SEEK_END);
+  n = ftell(in);
+  rewind(in);
+  pMap = n>0 ? malloc((size_t)n) : 0;
+  nMap = pMap ? fread(pMap, 1, (size_t)n, in) : 0;
+  fclose(in);
+  if( pMap==0 || nMap!=(size_t)n ){
+    free(pMap);
+    return -1;
+  }
+#endif
+  rc = ParseTablesAttach(pMap, nMap);
+  if( rc ){
+    pMap = 0;
+  }else{
+    void *pOld = yy_tables_map;
+    size_t nOld = yy_tables_nmap;
+    yy_tables_map = pMap;
+    yy_tables_nmap = nMap;
+    pMap = pOld;
+    nMap = nOld;
+  }
+  if( pMap ){
+#if !defined(_WIN32)
+    munmap(pMap, nMap);
+#else
+    free(pMap);
+#endif
+  }
+  return rc;
+}
+#endif /* YY_LOADED_TABLES */
+
+/* YY_SHIFT_ENTRY(S,X) is the index of the entry for terminal X in state S,
+** YY_SHIFT_FOUND(I,X) is true if that entry holds an action for X, and
+** YY_SHIFT_ACTION(I) is that action.  YY_DEFAULT(S) is the default action
+** of state S.
+*/
+#define YY_SHIFT_ACTION(I)  yy_action[I]
+#define YY_DEFAULT(S)       yy_default[S]
+#if defined(YY_DENSE_TABLES)
+# define YY_SHIFT_ENTRY(S,X)  ((S)*YYNTOKEN+(X))
+# define YY_SHIFT_FOUND(I,X)  (yy_action[I]!=YY_NO_ACTION)
+#elif defined(YY_CODED_TABLES)
+# undef YY_SHIFT_ACTION
+# define YY_SHIFT_ACTION(I)   (I)
+# define YY_SHIFT_ENTRY(S,X)  yy_shift_code(S,X)
+# define YY_SHIFT_FOUND(I,X)  ((I)!=YY_NO_ACTION)
+#elif defined(YY_HASHED_TABLES)
+# define YY_HASH(P,X) \
+    ((int)((((unsigned)(X)*((P)>>5))&0xffff)>>(16-((P)&31))))
+# define YY_SHIFT_ENTRY(S,X)  (yy_shift_ofst[S]+YY_HASH(yy_shift_hash[S],X))
+# define YY_SHIFT_FOUND(I,X)  (yy_lookahead[I]==(X))
+#elif defined(YY_PAIRED_TABLES)
+# undef YY_SHIFT_ACTION
+# undef YY_DEFAULT
+# define YY_SHIFT_ACTION(I)   yy_pair[I].action
+# define YY_DEFAULT(S)        yy_state[S].dflt
+# define YY_SHIFT_ENTRY(S,X)  (yy_state[S].shift_ofst+(X))
+# define YY_SHIFT_FOUND(I,X)  (yy_pair[I].lookahead==(X))
+#elif defined(YY_PACKED_TABLES)
+/* Return entry I of the packed table A, whose entries are N bits wide.
+** The table is padded so that the four bytes read are always in it.
+*/
+static int yy_unpack(const unsigned char *A, int N, int I){
+  unsigned long b = (unsigned long)I*N;
+  const unsigned char *p = &A[b>>3];
+  unsigned long v = p[0] | (unsigned long)p[1]<<8
+                  | (unsigned long)p[2]<<16 | (unsigned long)p[3]<<24;
+  return (int)((v>>(b&7)) & ((1UL<<N)-1));
+}
+# undef YY_SHIFT_ACTION
+# undef YY_DEFAULT
+# define YY_SHIFT_ACTION(I)   yy_unpack(yy_action, YY_ACTION_BITS, I)
+# define YY_DEFAULT(S)        yy_unpack(yy_default, YY_ACTION_BITS, S)
+# define YY_SHIFT_ENTRY(S,X) \
+    (yy_unpack(yy_shift_ofst, YY_SHIFT_BITS, S)+YY_SHIFT_MIN+(X))
+# define YY_SHIFT_FOUND(I,X) \
+    (yy_unpack(yy_lookahead, YY_LOOKAHEAD_BITS, I)==(X))
+#else
+# define YY_SHIFT_ENTRY(S,X)  (yy_shift_ofst[S]+(X))
+# define YY_SHIFT_FOUND(I,X)  (yy_lookahead[I]==(X))
+#endif
+
 /* The next table maps tokens (terminal symbols) into fallback tokens.
 ** If a construct like the following:
 **
@@ -169,7 +451,7 @@
 ** to revert to identifiers if they keyword does not apply in the context where
 ** it appears.
 */
-#ifdef YYFALLBACK
+#if defined(YYFALLBACK) && !defined(YY_LOADED_TABLES)
 static const YYCODETYPE yyFallback[] = {
 %%
 };
@@ -190,18 +472,112 @@ static const YYCODETYPE yyFallback[] = {
 ** After the "shift" half of a SHIFTREDUCE action, the stateno field
 ** actually contains the reduce action for the second half of the
 ** SHIFTREDUCE.
+**
+** With "lemon -A", YY_STACK_ARRAYS is defined and the semantic values
+** are not in the entries but in the parallel array yyvstack[] of the
+** parser, so that the state numbers are packed densely however large
+** YYMINORTYPE is.  yyStackMinor() finds the value of an entry either way.
 */
 struct yyStackEntry {
   YYACTIONTYPE stateno;  /* The state-number, or reduce action in SHIFTREDUCE */
   YYCODETYPE major;      /* The major token value.  This is the code
                          ** number for the token at this stack level */
+#if !defined(YY_STACK_ARRAYS)
   YYMINORTYPE minor;     /* The user-supplied minor token value.  This
                          ** is the value of the token  */
+#endif
 };
 typedef struct yyStackEntry yyStackEntry;
 
+/* When YYSTACKDEPTH is zero or negative, the stack starts in the
+** YYSTACKINLINE entries of the parser object, and moves to the heap
+** only when it outgrows them.  ParseShrink() moves it back.  This can
+** be changed by putting an appropriate #define in the %include section
+** of the input grammar.
+*/
+#ifndef YYSTACKINLINE
+# define YYSTACKINLINE 1
+#endif
+
+/* When YYSTACKSEGMENT is positive, a stack that outgrows the entries of
+** the parser object goes on in segments of YYSTACKSEGMENT entries that
+** are linked together, instead of moving to larger and larger arrays.
+** A new segment starts with a copy of the YYMAXRHS+1 entries at the top
+** of the segment below, so that the entries a reduce action reaches are
+** always next to one another, and the stack goes back to the segment
+** below only when it is not deeper than those entries.  The last segment
+** left is kept for the next time that the stack grows.
+*/
+#ifndef YYSTACKSEGMENT
+# define YYSTACKSEGMENT 0
+#endif
+#if YYSTACKSEGMENT>0
+# if YYSTACKDEPTH>0
+#  undef YYSTACKSEGMENT
+#  define YYSTACKSEGMENT 0
+# elif defined(YY_SHARED_ENGINE)
+#  error "YYSTACKSEGMENT needs the driver of lempar.c, not lemon -G"
+# elif YYSTACKSEGMENT<2*YYMAXRHS+1 || YYSTACKSEGMENT<=YYSTACKINLINE
+#  error "YYSTACKSEGMENT must exceed YYSTACKINLINE and be 2*YYMAXRHS+1 or more"
+# endif
+#endif
+#if YYSTACKSEGMENT>0
+typedef struct yyStackSegment yyStackSegment;
+struct yyStackSegment {
+  yyStackEntry a[YYSTACKSEGMENT];      /* The entries */
+#if defined(YY_STACK_ARRAYS)
+  YYMINORTYPE v[YYSTACKSEGMENT];       /* Their values */
+#endif
+  yyStackSegment *pPrev;               /* The segment below, or NULL */
+  yyStackSegment *pNext;               /* The segment above, if kept */
+};
+#endif
+
+#if defined(YYARENA)
+/* With %arena, the parser owns a bump allocator for the reduce actions.
+** Its memory is a list of blocks, newest first, and allocations are cut
+** from the newest block between pFree and pEnd.
+*/
+typedef struct yyArenaBlock yyArenaBlock;
+struct yyArenaBlock {
+  yyArenaBlock *pNext;                 /* The next older block */
+  size_t sz;                           /* Bytes in the block, this included */
+};
+typedef struct yyArena yyArena;
+struct yyArena {
+  yyArenaBlock *pBlock;                /* The newest block, or NULL */
+  char *pFree;                         /* Next free byte of pBlock */
+  char *pEnd;                          /* One past the end of pBlock */
+  size_t nByte;                        /* Bytes in all blocks */
+  int bStale;                          /* Reset before the next token */
+};
+#endif
+
 /* The state of the parser is completely contained in an instance of
-** the following structure */
+** the following structure.  With "lemon -G", YY_SHARED_ENGINE is defined
+** and the driver is the shared engine of "lemengine.c" instead of the
+** routines of this file.  The parser object then starts with the state of
+** the engine, and the engine reaches the grammar through yyGrammar.
+*/
+#if defined(YY_SHARED_ENGINE)
+#include "lemengine.h"
+#if defined(YYCOVERAGE) || defined(YYPROFILE)
+# error "YYCOVERAGE and YYPROFILE need the driver of lempar.c, not lemon -G"
+#endif
+struct yyParser {
+  lemonParser yyengine;         /* The state of the shared engine */
+  ParseARG_SDECL                /* A place to hold %extra_argument */
+  ParseCTX_SDECL                /* A place to hold %extra_context */
+#if YYSTACKDEPTH<=0
+  yyStackEntry yystk0[YYSTACKINLINE];  /* Entries until the stack spills */
+#else
+  yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+#endif
+#if defined(YYARENA)
+  yyArena yyarena;              /* The %arena */
+#endif
+};
+#else
 struct yyParser {
   yyStackEntry *yytos;          /* Pointer to top element of the stack */
 #ifdef YYTRACKMAXSTACKDEPTH
@@ -212,17 +588,54 @@ struct yyParser {
 #endif
   ParseARG_SDECL                /* A place to hold %extra_argument */
   ParseCTX_SDECL                /* A place to hold %extra_context */
+  void *(*yyxMem)(void*,void*,size_t,size_t);  /* Allocator, or NULL */
+  void *yypMemCtx;              /* First argument to yyxMem */
 #if YYSTACKDEPTH<=0
   int yystksz;                  /* Current side of the stack */
   yyStackEntry *yystack;        /* The parser's stack */
-  yyStackEntry yystk0;          /* First stack entry */
+  yyStackEntry yystk0[YYSTACKINLINE];  /* Entries until the stack spills */
+#if defined(YY_STACK_ARRAYS)
+  YYMINORTYPE *yyvstack;        /* Values of the stack entries */
+  YYMINORTYPE yyvstk0[YYSTACKINLINE];  /* Their values */
+#endif
+#if YYSTACKSEGMENT>0
+  yyStackSegment *yyseg;        /* Segment of yystack, or NULL if yystk0 */
+  yyStackEntry *yystackLow;     /* Go back a segment when below this */
+  int yystkbase;                /* Depth of yystack[0] in the whole stack */
+#endif
 #else
   yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
   yyStackEntry *yystackEnd;            /* Last entry in the stack */
+#if defined(YY_STACK_ARRAYS)
+  YYMINORTYPE yyvstack[YYSTACKDEPTH];  /* Values of the stack entries */
+#endif
+#endif
+#if defined(YYBOXTYPES)
+  void *yyboxfree[YYBOXTYPES];  /* Free boxes of each boxed type */
+  int yyboxempty;               /* Number of empty lists in yyboxfree[] */
+  size_t yyboxbytes;            /* Bytes of memory in boxes */
+#endif
+#if defined(YYARENA)
+  yyArena yyarena;              /* The %arena */
 #endif
 };
+#endif /* YY_SHARED_ENGINE */
 typedef struct yyParser yyParser;
 
+/* The semantic value of the stack entry E of parser P */
+#if defined(YY_STACK_ARRAYS)
+# define yyStackMinor(P,E)  (&(P)->yyvstack[(E)-(P)->yystack])
+#else
+# define yyStackMinor(P,E)  (&(E)->minor)
+#endif
+
+/* The depth of the top of the stack of parser P */
+#if YYSTACKSEGMENT>0
+# define yyStackDepth(P)  ((P)->yystkbase + (int)((P)->yytos - (P)->yystack))
+#else
+# define yyStackDepth(P)  ((int)((P)->yytos - (P)->yystack))
+#endif
+
 #include <assert.h>
 #ifndef NDEBUG
 #include <stdio.h>
@@ -256,13 +669,13 @@ void ParseTrace(FILE *TraceFILE, char *zTracePrompt){
 }
 #endif /* NDEBUG */
 
-#if defined(YYCOVERAGE) || !defined(NDEBUG)
+#if defined(YYCOVERAGE) || defined(YYPROFILE) || !defined(NDEBUG)
 /* For tracing shifts, the names of all terminals and nonterminals
 ** are required.  The following table supplies these names */
 static const char *const yyTokenName[] = {
 %%
 };
-#endif /* defined(YYCOVERAGE) || !defined(NDEBUG) */
+#endif /* defined(YYCOVERAGE) || defined(YYPROFILE) || !defined(NDEBUG) */
 
 #ifndef NDEBUG
 /* For tracing reduce actions, the names of all rules are required.
@@ -273,37 +686,396 @@ static const char *const yyRuleName[] = {
 #endif /* NDEBUG */
 
 
-#if YYSTACKDEPTH<=0
+/* The number of entries that a growing stack of N entries grows to,
+** and the most entries that it may have, or 0 for no limit.  When the
+** stack cannot grow, because of the limit or because the allocator has
+** no memory left, the %stack_overflow code runs.  These can be changed
+** by putting an appropriate #define in the %include section of the
+** input grammar.
+*/
+#ifndef YYSTACKGROWTH
+# define YYSTACKGROWTH(N) ((N)*2+100)
+#endif
+#ifndef YYSTACKLIMIT
+# define YYSTACKLIMIT 0
+#endif
+
+#if (YYSTACKDEPTH<=0 && !defined(YY_SHARED_ENGINE)) \
+ || defined(YYBOXTYPES) || defined(YYARENA)
 /*
-** Try to increase the size of the parser stack.  Return the number
-** of errors.  Return 0 on success.
+** Allocate, resize or release memory for the stack of a parser, with
+** its allocator if it has one.  The arguments are those of the
+** allocator: pOld is NULL to allocate, and nNew is zero to release.
+*/
+static void *yyStackMem(yyParser *p, void *pOld, size_t nOld, size_t nNew){
+#if defined(YY_SHARED_ENGINE)
+  if( p->yyengine.xMem ){
+    return p->yyengine.xMem(p->yyengine.pMemCtx, pOld, nOld, nNew);
+  }
+#else
+  if( p->yyxMem ) return p->yyxMem(p->yypMemCtx, pOld, nOld, nNew);
+#endif
+  if( nNew==0 ){
+    free(pOld);
+    return 0;
+  }
+  return realloc(pOld, nNew);
+}
+#endif
+
+#if defined(YYBOXTYPES)
+/* With "lemon -Z", the values of the types that are too large for the
+** stack live in boxes, and the stack holds pointers to them.  Each boxed
+** type has a list of free boxes of its own.  yyBoxSize[] is the size of
+** a box of each type, and yyBoxOf[] is the type of the box of each
+** symbol, plus one, or 0 if the values of the symbol are in the stack.
+**
+** A reduce takes at most one box, and yyBoxReserve() makes sure before
+** each reduce that every list has one, so that yyBoxTake() never fails.
+*/
+static const size_t yyBoxSize[] = { YYBOXSIZES };
+static const unsigned char yyBoxOf[] = { YYBOXOF };
+
+/* Take a free box of type k */
+static void *yyBoxTake(yyParser *p, int k){
+  void *pBox = p->yyboxfree[k];
+  assert( pBox!=0 );
+  p->yyboxfree[k] = *(void**)pBox;
+  if( p->yyboxfree[k]==0 ) p->yyboxempty++;
+  return pBox;
+}
+
+/* Give back the box pBox of type k */
+static void yyBoxFree(yyParser *p, int k, void *pBox){
+  if( p->yyboxfree[k]==0 ) p->yyboxempty--;
+  *(void**)pBox = p->yyboxfree[k];
+  p->yyboxfree[k] = pBox;
+}
+
+/* Give back the box of the value pMinor of symbol yymajor, if it has one */
+static void yyBoxRelease(yyParser *p, int yymajor, YYMINORTYPE *pMinor){
+  if( yyBoxOf[yymajor] ) yyBoxFree(p, yyBoxOf[yymajor]-1, pMinor->yybox);
+}
+
+/* Put a box on every empty list.  Return non-zero if out of memory. */
+static int yyBoxReserve(yyParser *p){
+  int k;
+  for(k=0; k<YYBOXTYPES; k++){
+    size_t n = yyBoxSize[k]<sizeof(void*) ? sizeof(void*) : yyBoxSize[k];
+    void *pBox;
+    if( p->yyboxfree[k] ) continue;
+    pBox = yyStackMem(p, 0, 0, n);
+    if( pBox==0 ) return 1;
+    p->yyboxbytes += n;
+    yyBoxFree(p, k, pBox);
+  }
+  return 0;
+}
+
+/* Release the memory of all free boxes */
+static void yyBoxClear(yyParser *p){
+  int k;
+  for(k=0; k<YYBOXTYPES; k++){
+    size_t n = yyBoxSize[k]<sizeof(void*) ? sizeof(void*) : yyBoxSize[k];
+    while( p->yyboxfree[k] ){
+      void *pBox = yyBoxTake(p, k);
+      yyStackMem(p, pBox, n, 0);
+      p->yyboxbytes -= n;
+    }
+  }
+}
+#endif /* YYBOXTYPES */
+
+#if defined(YYARENA)
+/* The first block of the %arena has YYARENABLOCK bytes, and each new
+** block is twice the size of the one before, or as large as it must be.
+** Allocations are rounded up to YYARENAALIGN bytes, which must be a
+** power of two.
+*/
+#ifndef YYARENABLOCK
+# define YYARENABLOCK 4096
+#endif
+#ifndef YYARENAALIGN
+# define YYARENAALIGN (2*sizeof(void*))
+#endif
+#define yyArenaRound(N)  (((N)+YYARENAALIGN-1) & ~(size_t)(YYARENAALIGN-1))
+
+/* Start a new block of the arena with room for n bytes, and take them */
+static void *yyArenaGrow(yyParser *p, size_t n){
+  yyArena *pA = &p->yyarena;
+  size_t szHdr = yyArenaRound(sizeof(yyArenaBlock));
+  size_t sz = pA->pBlock ? pA->pBlock->sz*2 : YYARENABLOCK;
+  yyArenaBlock *pNew;
+  if( sz<szHdr+n ) sz = szHdr+n;
+  pNew = (yyArenaBlock*)yyStackMem(p, 0, 0, sz);
+  if( pNew==0 ) return 0;
+  pNew->pNext = pA->pBlock;
+  pNew->sz = sz;
+  pA->pBlock = pNew;
+  pA->nByte += sz;
+  pA->pFree = (char*)pNew + szHdr + n;
+  pA->pEnd = (char*)pNew + sz;
+  return (char*)pNew + szHdr;
+}
+
+/* Allocate n bytes from the arena.  Return NULL if out of memory. */
+static void *yyArenaAlloc(yyParser *p, size_t n){
+  yyArena *pA = &p->yyarena;
+  n = yyArenaRound(n);
+  if( (size_t)(pA->pEnd - pA->pFree)<n ) return yyArenaGrow(p, n);
+  pA->pFree += n;
+  return pA->pFree - n;
+}
+
+/* Release the blocks of the arena, all but the newest one if bKeep */
+static void yyArenaClear(yyParser *p, int bKeep){
+  yyArena *pA = &p->yyarena;
+  yyArenaBlock *pBlock = pA->pBlock;
+  yyArenaBlock *pNext;
+  if( pBlock && bKeep ){
+    pA->pFree = (char*)pBlock + yyArenaRound(sizeof(yyArenaBlock));
+    pNext = pBlock->pNext;
+    pBlock->pNext = 0;
+    pBlock = pNext;
+  }else{
+    pA->pBlock = 0;
+    pA->pFree = pA->pEnd = 0;
+  }
+  for(; pBlock; pBlock=pNext){
+    pNext = pBlock->pNext;
+    pA->nByte -= pBlock->sz;
+    yyStackMem(p, pBlock, pBlock->sz, 0);
+  }
+  pA->bStale = 0;
+}
+
+/* The reduce actions allocate with ParseArenaAlloc(yypParser, n) */
+#define ParseArenaAlloc(P,N)  yyArenaAlloc(P,N)
+#endif /* YYARENA */
+
+#if YYSTACKDEPTH<=0 && !defined(YY_SHARED_ENGINE)
+
+#if YYSTACKSEGMENT>0
+/*
+** Move the top of the stack of a parser into the segment above, when the
+** stack is full.  The segment above is a new one, or the one kept from
+** the last time the stack went back.  Return the number of errors, which
+** leave the stack unchanged.  Return 0 on success.
 */
 static int yyGrowStack(yyParser *p){
-  int newSize;
-  int idx;
-  yyStackEntry *pNew;
+  yyStackSegment *pSeg = p->yyseg;
+  yyStackSegment *pNew;
+  int idx = (int)(p->yytos - p->yystack);  /* Index of the top entry */
+  int nKeep;                               /* Entries copied */
+  int iBase;                               /* Depth of pNew->a[0] */
+  int i;
 
-  newSize = p->yystksz*2 + 100;
-  idx = p->yytos ? (int)(p->yytos - p->yystack) : 0;
-  if( p->yystack==&p->yystk0 ){
-    pNew = malloc(newSize*sizeof(pNew[0]));
-    if( pNew ) pNew[0] = p->yystk0;
+  if( pSeg==0 ){
+    nKeep = p->yystksz;
+    iBase = 0;
   }else{
-    pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
+    nKeep = YYMAXRHS+1;
+    iBase = p->yystkbase + YYSTACKSEGMENT - nKeep;
+  }
+#if YYSTACKLIMIT>0
+  if( iBase+YYSTACKSEGMENT>YYSTACKLIMIT ) return 1;
+#endif
+  if( pSeg && pSeg->pNext ){
+    pNew = pSeg->pNext;
+  }else{
+    pNew = yyStackMem(p, 0, 0, sizeof(*pNew));
+    if( pNew==0 ) return 1;
+    pNew->pPrev = pSeg;
+    pNew->pNext = 0;
+    if( pSeg ) pSeg->pNext = pNew;
+  }
+  for(i=0; i<nKeep; i++){
+    pNew->a[i] = p->yystack[p->yystksz-nKeep+i];
+#if defined(YY_STACK_ARRAYS)
+    pNew->v[i] = p->yyvstack[p->yystksz-nKeep+i];
+#endif
   }
-  if( pNew ){
-    p->yystack = pNew;
-    p->yytos = &p->yystack[idx];
 #ifndef NDEBUG
-    if( yyTraceFILE ){
-      fprintf(yyTraceFILE,"%sStack grows from %d to %d entries.\n",
-              yyTracePrompt, p->yystksz, newSize);
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sStack grows into a segment at depth %d.\n",
+            yyTracePrompt, iBase);
+  }
+#endif
+  p->yyseg = pNew;
+  p->yystack = pNew->a;
+#if defined(YY_STACK_ARRAYS)
+  p->yyvstack = pNew->v;
+#endif
+  p->yystackLow = pSeg ? &pNew->a[YYMAXRHS] : pNew->a;
+  p->yytos = &pNew->a[idx - (p->yystksz - nKeep)];
+  p->yystksz = YYSTACKSEGMENT;
+  p->yystkbase = iBase;
+  return 0;
+}
+
+/*
+** Move the top of the stack of a parser back into the segment below,
+** when it is below p->yystackLow.  The segment left is kept for the
+** next time that the stack grows, and any segment above it is released.
+*/
+static void yyStackDescend(yyParser *p){
+  yyStackSegment *pSeg = p->yyseg;
+  yyStackSegment *pPrev = pSeg->pPrev;
+  int idx = (int)(p->yytos - p->yystack);  /* Index of the top entry */
+  int iOfst = YYSTACKSEGMENT - (YYMAXRHS+1);  /* Of pSeg->a[0] in pPrev */
+  int i;
+
+  assert( pPrev!=0 );
+  for(i=0; i<=idx; i++){
+    pPrev->a[iOfst+i] = pSeg->a[i];
+#if defined(YY_STACK_ARRAYS)
+    pPrev->v[iOfst+i] = pSeg->v[i];
+#endif
+  }
+  if( pSeg->pNext ){
+    yyStackMem(p, pSeg->pNext, sizeof(*pSeg), 0);
+    pSeg->pNext = 0;
+  }
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sStack goes back to the segment at depth %d.\n",
+            yyTracePrompt, p->yystkbase - iOfst);
+  }
+#endif
+  p->yyseg = pPrev;
+  p->yystack = pPrev->a;
+#if defined(YY_STACK_ARRAYS)
+  p->yyvstack = pPrev->v;
+#endif
+  p->yystackLow = pPrev->pPrev ? &pPrev->a[YYMAXRHS] : pPrev->a;
+  p->yytos = &pPrev->a[iOfst+idx];
+  p->yystkbase -= iOfst;
+}
+
+/*
+** Release the segments of the stack of a parser above the one in use,
+** and that one too if the stack fits back into the parser object.
+*/
+static void yyStackRelease(yyParser *p){
+  yyStackSegment *pSeg = p->yyseg;
+  yyStackSegment *pNext;
+  int idx = (int)(p->yytos - p->yystack);  /* Index of the top entry */
+  int i;
+
+  if( pSeg==0 ) return;
+  for(pNext=pSeg->pNext; pNext; pNext=pSeg->pNext){
+    pSeg->pNext = pNext->pNext;
+    yyStackMem(p, pNext, sizeof(*pNext), 0);
+  }
+  if( pSeg->pPrev || idx>=YYSTACKINLINE ) return;
+  for(i=0; i<=idx; i++){
+    p->yystk0[i] = pSeg->a[i];
+#if defined(YY_STACK_ARRAYS)
+    p->yyvstk0[i] = pSeg->v[i];
+#endif
+  }
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sStack shrinks from %d to %d entries.\n",
+            yyTracePrompt, YYSTACKSEGMENT, YYSTACKINLINE);
+  }
+#endif
+  yyStackMem(p, pSeg, sizeof(*pSeg), 0);
+  p->yyseg = 0;
+  p->yystack = p->yystk0;
+#if defined(YY_STACK_ARRAYS)
+  p->yyvstack = p->yyvstk0;
+#endif
+  p->yystackLow = p->yystack;
+  p->yytos = &p->yystack[idx];
+  p->yystksz = YYSTACKINLINE;
+}
+#else /* YYSTACKSEGMENT<=0 */
+/*
+** Move the stack of a parser to newSize entries, which hold at least
+** the entries up to the top of the stack: back into the entries of the
+** parser object if they are enough, or to the heap otherwise.  Return
+** the number of errors, which leave the stack unchanged.  Return 0 on
+** success.
+*/
+static int yyResizeStack(yyParser *p, int newSize){
+  int idx = (int)(p->yytos - p->yystack);  /* Index of the top entry */
+  int i;
+  yyStackEntry *pNew;
+#if defined(YY_STACK_ARRAYS)
+  YYMINORTYPE *pNewV;
+#endif
+
+  if( newSize<=YYSTACKINLINE ){
+    newSize = YYSTACKINLINE;
+    pNew = p->yystk0;
+#if defined(YY_STACK_ARRAYS)
+    pNewV = p->yyvstk0;
+#endif
+  }else{
+#if defined(YY_STACK_ARRAYS)
+    /* Both arrays move to new memory, or neither does */
+    pNew = yyStackMem(p, 0, 0, newSize*sizeof(pNew[0]));
+    pNewV = pNew ? yyStackMem(p, 0, 0, newSize*sizeof(pNewV[0])) : 0;
+    if( pNewV==0 ){
+      if( pNew ) yyStackMem(p, pNew, newSize*sizeof(pNew[0]), 0);
+      return 1;
+    }
+#else
+    if( p->yystack!=p->yystk0 ){
+      pNew = yyStackMem(p, p->yystack, p->yystksz*sizeof(pNew[0]),
+                        newSize*sizeof(pNew[0]));
+      if( pNew==0 ) return 1;
+      p->yystack = pNew;
+    }else{
+      pNew = yyStackMem(p, 0, 0, newSize*sizeof(pNew[0]));
+      if( pNew==0 ) return 1;
     }
 #endif
-    p->yystksz = newSize;
   }
-  return pNew==0;
+  if( pNew!=p->yystack ){
+    for(i=0; i<=idx && i<p->yystksz; i++){
+      pNew[i] = p->yystack[i];
+#if defined(YY_STACK_ARRAYS)
+      pNewV[i] = p->yyvstack[i];
+#endif
+    }
+    if( p->yystack!=p->yystk0 ){
+      yyStackMem(p, p->yystack, p->yystksz*sizeof(pNew[0]), 0);
+#if defined(YY_STACK_ARRAYS)
+      yyStackMem(p, p->yyvstack, p->yystksz*sizeof(pNewV[0]), 0);
+#endif
+    }
+  }
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sStack %s from %d to %d entries.\n",
+            yyTracePrompt, newSize>p->yystksz ? "grows" : "shrinks",
+            p->yystksz, newSize);
+  }
+#endif
+  p->yystack = pNew;
+#if defined(YY_STACK_ARRAYS)
+  p->yyvstack = pNewV;
+#endif
+  p->yytos = &pNew[idx];
+  p->yystksz = newSize;
+  return 0;
 }
+
+/*
+** Try to increase the size of the parser stack.  Return the number
+** of errors.  Return 0 on success.
+*/
+static int yyGrowStack(yyParser *p){
+  int newSize = YYSTACKGROWTH(p->yystksz);
+#if YYSTACKLIMIT>0
+  if( newSize>YYSTACKLIMIT ) newSize = YYSTACKLIMIT;
+#endif
+  if( newSize<=p->yystksz ) return 1;
+  return yyResizeStack(p, newSize);
+}
+#endif /* YYSTACKSEGMENT<=0 */
 #endif
 
 /* Datatype of the argument to the memory allocated passed as the
@@ -315,22 +1087,44 @@ static int yyGrowStack(yyParser *p){
 # define YYMALLOCARGTYPE size_t
 #endif
 
-/* Initialize a new parser that has already been allocated.
+#if defined(YY_SHARED_ENGINE)
+static void yy_engine_init(yyParser*, void *(*)(void*,void*,size_t,size_t),
+                           void*);  /* Forward Declaration */
+#endif
+
+/* Initialize a new parser that has already been allocated, with the
+** allocator xMem for its stack.  xMem(pMemCtx, pOld, nOld, nNew) works
+** like realloc(pOld, nNew), and allocates if pOld is NULL, and releases
+** pOld and returns NULL if nNew is zero.  nOld is the size of pOld.  If
+** xMem is NULL, the stack lives on the C library heap.
 */
-void ParseInit(void *yypRawParser ParseCTX_PDECL){
+void ParseInitWith(
+  void *yypRawParser,                          /* The parser */
+  void *(*xMem)(void*,void*,size_t,size_t),    /* Allocator, or NULL */
+  void *pMemCtx                                /* First argument to xMem */
+  ParseCTX_PDECL
+){
   yyParser *yypParser = (yyParser*)yypRawParser;
   ParseCTX_STORE
+#if defined(YY_SHARED_ENGINE)
+  yy_engine_init(yypParser, xMem, pMemCtx);
+#else
+  yypParser->yyxMem = xMem;
+  yypParser->yypMemCtx = pMemCtx;
 #ifdef YYTRACKMAXSTACKDEPTH
   yypParser->yyhwm = 0;
 #endif
 #if YYSTACKDEPTH<=0
-  yypParser->yytos = NULL;
-  yypParser->yystack = NULL;
-  yypParser->yystksz = 0;
-  if( yyGrowStack(yypParser) ){
-    yypParser->yystack = &yypParser->yystk0;
-    yypParser->yystksz = 1;
-  }
+  yypParser->yystack = yypParser->yystk0;
+#if defined(YY_STACK_ARRAYS)
+  yypParser->yyvstack = yypParser->yyvstk0;
+#endif
+  yypParser->yystksz = YYSTACKINLINE;
+#endif
+#if YYSTACKSEGMENT>0
+  yypParser->yyseg = 0;
+  yypParser->yystackLow = yypParser->yystack;
+  yypParser->yystkbase = 0;
 #endif
 #ifndef YYNOERRORRECOVERY
   yypParser->yyerrcnt = -1;
@@ -341,6 +1135,27 @@ void ParseInit(void *yypRawParser ParseCTX_PDECL){
 #if YYSTACKDEPTH>0
   yypParser->yystackEnd = &yypParser->yystack[YYSTACKDEPTH-1];
 #endif
+#if defined(YYBOXTYPES)
+  {
+    int k;
+    for(k=0; k<YYBOXTYPES; k++) yypParser->yyboxfree[k] = 0;
+  }
+  yypParser->yyboxempty = YYBOXTYPES;
+  yypParser->yyboxbytes = 0;
+#endif
+#endif /* YY_SHARED_ENGINE */
+#if defined(YYARENA)
+  yypParser->yyarena.pBlock = 0;
+  yypParser->yyarena.pFree = yypParser->yyarena.pEnd = 0;
+  yypParser->yyarena.nByte = 0;
+  yypParser->yyarena.bStale = 0;
+#endif
+}
+
+/* Initialize a new parser that has already been allocated.
+*/
+void ParseInit(void *yypRawParser ParseCTX_PDECL){
+  ParseInitWith(yypRawParser, 0, 0 ParseCTX_PARAM);
 }
 
 #ifndef Parse_ENGINEALWAYSONSTACK
@@ -365,6 +1180,25 @@ void *ParseAlloc(void *(*mallocProc)(YYMALLOCARGTYPE) ParseCTX_PDECL){
   }
   return (void*)yypParser;
 }
+
+/*
+** Allocate a new parser with the allocator xMem, which then also holds
+** the stack of the parser.  See ParseInitWith() for how xMem works.
+** ParseFree() releases the parser with xMem too, and ignores its
+** freeProc argument.
+*/
+void *ParseAllocWith(
+  void *(*xMem)(void*,void*,size_t,size_t),    /* The allocator */
+  void *pMemCtx                                /* First argument to xMem */
+  ParseCTX_PDECL
+){
+  yyParser *yypParser;
+  yypParser = (yyParser*)xMem(pMemCtx, 0, 0, sizeof(yyParser));
+  if( yypParser ){
+    ParseInitWith(yypParser, xMem, pMemCtx ParseCTX_PARAM);
+  }
+  return (void*)yypParser;
+}
 #endif /* Parse_ENGINEALWAYSONSTACK */
 
 
@@ -406,6 +1240,7 @@ static void yy_destructor(
 ** If there is a destructor routine associated with the token which
 ** is popped from the stack, then call it.
 */
+#if !defined(YY_SHARED_ENGINE)
 static void yy_pop_parser_stack(yyParser *pParser){
   yyStackEntry *yytos;
   assert( pParser->yytos!=0 );
@@ -418,17 +1253,43 @@ static void yy_pop_parser_stack(yyParser *pParser){
       yyTokenName[yytos->major]);
   }
 #endif
-  yy_destructor(pParser, yytos->major, &yytos->minor);
+  yy_destructor(pParser, yytos->major, yyStackMinor(pParser, yytos));
+#if defined(YYBOXTYPES)
+  yyBoxRelease(pParser, yytos->major, yyStackMinor(pParser, yytos));
+#endif
+#if YYSTACKSEGMENT>0
+  if( pParser->yytos<pParser->yystackLow ) yyStackDescend(pParser);
+#endif
 }
+#endif /* !defined(YY_SHARED_ENGINE) */
 
 /*
 ** Clear all secondary memory allocations from the parser
 */
 void ParseFinalize(void *p){
   yyParser *pParser = (yyParser*)p;
+#if defined(YY_SHARED_ENGINE)
+  lemonEngineFinalize(&pParser->yyengine);
+#else
   while( pParser->yytos>pParser->yystack ) yy_pop_parser_stack(pParser);
-#if YYSTACKDEPTH<=0
-  if( pParser->yystack!=&pParser->yystk0 ) free(pParser->yystack);
+#if YYSTACKSEGMENT>0
+  yyStackRelease(pParser);  /* The empty stack fits in the parser object */
+#elif YYSTACKDEPTH<=0
+  if( pParser->yystack!=pParser->yystk0 ){
+    yyStackMem(pParser, pParser->yystack,
+               pParser->yystksz*sizeof(pParser->yystack[0]), 0);
+#if defined(YY_STACK_ARRAYS)
+    yyStackMem(pParser, pParser->yyvstack,
+               pParser->yystksz*sizeof(pParser->yyvstack[0]), 0);
+#endif
+  }
+#endif
+#if defined(YYBOXTYPES)
+  yyBoxClear(pParser);
+#endif
+#endif /* YY_SHARED_ENGINE */
+#if defined(YYARENA)
+  yyArenaClear(pParser, 0);
 #endif
 }
 
@@ -445,11 +1306,25 @@ void ParseFree(
   void *p,                    /* The parser to be deleted */
   void (*freeProc)(void*)     /* Function used to reclaim memory */
 ){
+  yyParser *pParser = (yyParser*)p;
+  void *(*xMem)(void*,void*,size_t,size_t);   /* Allocator of the parser */
+  void *pMemCtx;                               /* First argument to xMem */
 #ifndef YYPARSEFREENEVERNULL
   if( p==0 ) return;
 #endif
   ParseFinalize(p);
-  (*freeProc)(p);
+#if defined(YY_SHARED_ENGINE)
+  xMem = pParser->yyengine.xMem;
+  pMemCtx = pParser->yyengine.pMemCtx;
+#else
+  xMem = pParser->yyxMem;
+  pMemCtx = pParser->yypMemCtx;
+#endif
+  if( xMem ){
+    xMem(pMemCtx, p, sizeof(yyParser), 0);
+  }else{
+    (*freeProc)(p);
+  }
 }
 #endif /* Parse_ENGINEALWAYSONSTACK */
 
@@ -459,7 +1334,87 @@ void ParseFree(
 #ifdef YYTRACKMAXSTACKDEPTH
 int ParseStackPeak(void *p){
   yyParser *pParser = (yyParser*)p;
+#if defined(YY_SHARED_ENGINE)
+  return lemonEngineStackPeak(&pParser->yyengine);
+#else
   return pParser->yyhwm;
+#endif
+}
+#endif
+
+/*
+** Give back the memory of the stack beyond the entries in use, after a
+** parse that went deep.  The stack moves back into the parser object
+** if it fits there.  This does nothing to the stack unless YYSTACKDEPTH
+** is zero or negative.  The free boxes of "lemon -Z" are released too.
+*/
+void ParseShrink(void *p){
+#if YYSTACKDEPTH<=0
+  yyParser *pParser = (yyParser*)p;
+#if defined(YY_SHARED_ENGINE)
+  lemonEngineShrink(&pParser->yyengine);
+#elif YYSTACKSEGMENT>0
+  yyStackRelease(pParser);
+#else
+  int n = (int)(pParser->yytos - pParser->yystack) + 1;
+  if( pParser->yystack!=pParser->yystk0 && n<pParser->yystksz ){
+    yyResizeStack(pParser, n);
+  }
+#endif
+#else
+  (void)p;
+#endif
+#if defined(YYBOXTYPES)
+  yyBoxClear((yyParser*)p);
+#endif
+#if defined(YYARENA)
+  if( ((yyParser*)p)->yyarena.bStale ) yyArenaClear((yyParser*)p, 0);
+#endif
+}
+
+/*
+** Return the number of bytes of memory that a parser uses: the parser
+** object, the stack on the heap, if any, and the boxes of "lemon -Z".
+*/
+size_t ParseMemoryUsed(void *p){
+  yyParser *pParser = (yyParser*)p;
+  size_t n = sizeof(*pParser);
+#if defined(YY_SHARED_ENGINE)
+  n += lemonEngineMemoryUsed(&pParser->yyengine);
+#elif YYSTACKSEGMENT>0
+  yyStackSegment *pSeg;
+  if( pParser->yyseg ){
+    n += sizeof(*pSeg);
+    for(pSeg=pParser->yyseg->pPrev; pSeg; pSeg=pSeg->pPrev) n += sizeof(*pSeg);
+    for(pSeg=pParser->yyseg->pNext; pSeg; pSeg=pSeg->pNext) n += sizeof(*pSeg);
+  }
+#elif YYSTACKDEPTH<=0
+  if( pParser->yystack!=pParser->yystk0 ){
+    n += pParser->yystksz*sizeof(pParser->yystack[0]);
+#if defined(YY_STACK_ARRAYS)
+    n += pParser->yystksz*sizeof(pParser->yyvstack[0]);
+#endif
+  }
+#endif
+#if defined(YYBOXTYPES)
+  n += pParser->yyboxbytes;
+#endif
+#if defined(YYARENA)
+  n += pParser->yyarena.nByte;
+#endif
+  return n;
+}
+
+#if defined(YYARENA)
+/*
+** Reset the %arena of a parser, so that the memory that the reduce
+** actions took from it can be used again.  The parser does this by itself
+** when the next token comes after an accept, a failed parse or a stack
+** overflow.  Only call this between parses, or the values on the stack
+** that are in the arena are lost.
+*/
+void ParseArenaReset(void *p){
+  yyArenaClear((yyParser*)p, 1);
 }
 #endif
 
@@ -485,9 +1440,12 @@ int ParseCoverage(FILE *out){
   int stateno, iLookAhead, i;
   int nMissed = 0;
   for(stateno=0; stateno<YYNSTATE; stateno++){
-    i = yy_shift_ofst[stateno];
     for(iLookAhead=0; iLookAhead<YYNTOKEN; iLookAhead++){
-      if( yy_lookahead[i+iLookAhead]!=iLookAhead ) continue;
+      i = YY_SHIFT_ENTRY(stateno, iLookAhead);
+      if( !YY_SHIFT_FOUND(i, iLookAhead) ) continue;
+#if defined(YY_DENSE_TABLES) || defined(YY_CODED_TABLES)
+      if( YY_SHIFT_ACTION(i)==YY_DEFAULT(stateno) ) continue;
+#endif
       if( yycoverage[stateno][iLookAhead]==0 ) nMissed++;
       if( out ){
         fprintf(out,"State %d lookahead %s %s\n", stateno,
@@ -500,6 +1458,47 @@ int ParseCoverage(FILE *out){
 }
 #endif
 
+/* With YYPROFILE defined, the element yyprofile[X][Y] counts how many
+** times the parser has looked up symbol Y in state X: a terminal to find
+** the action for a lookahead token, or a nonterminal to find the state
+** to go to after a reduce.  yyprofile_rule[R] counts the reduces by
+** rule R.
+*/
+#if defined(YYPROFILE)
+static unsigned long yyprofile[YYNSTATE][YYNOCODE];
+static unsigned long yyprofile_rule[YYNRULE];
+#endif
+
+/*
+** Write the counts of yyprofile[][] and yyprofile_rule[] onto out, in
+** the form that the -P option of lemon reads back, and return the number
+** of lines written.  States are written under the numbers that lemon
+** gave them before it sorted them, so that a profile still applies to a
+** parser that was generated with an earlier profile.
+*/
+#if defined(YYPROFILE)
+int ParseProfile(FILE *out){
+  int stateno, iSymbol, iRule;
+  int nLine = 0;
+  fprintf(out, "# lemon -P profile of %d states\n", YYNSTATE);
+  for(stateno=0; stateno<YYNSTATE; stateno++){
+    for(iSymbol=0; iSymbol<YYNOCODE; iSymbol++){
+      if( yyprofile[stateno][iSymbol]==0 ) continue;
+      fprintf(out, "state %d %s %lu\n", (int)yy_state_origin[stateno],
+              yyTokenName[iSymbol], yyprofile[stateno][iSymbol]);
+      nLine++;
+    }
+  }
+  for(iRule=0; iRule<YYNRULE; iRule++){
+    if( yyprofile_rule[iRule]==0 ) continue;
+    fprintf(out, "rule %d %lu\n", iRule, yyprofile_rule[iRule]);
+    nLine++;
+  }
+  return nLine;
+}
+#endif
+
+#if !defined(YY_SHARED_ENGINE)
 /*
 ** Find the appropriate action for a parser given the terminal
 ** look-ahead token iLookAhead.
@@ -511,23 +1510,26 @@ static YYACTIONTYPE yy_find_shift_action(
   int i;
 
   if( stateno>YY_MAX_SHIFT ) return stateno;
-  assert( stateno <= YY_SHIFT_COUNT );
 #if defined(YYCOVERAGE)
   yycoverage[stateno][iLookAhead] = 1;
+#endif
+#if defined(YYPROFILE)
+  yyprofile[stateno][iLookAhead]++;
 #endif
   do{
-    i = yy_shift_ofst[stateno];
-    assert( i>=0 );
-    assert( i<=YY_ACTTAB_COUNT );
-    assert( i+YYNTOKEN<=(int)YY_NLOOKAHEAD );
     assert( iLookAhead!=YYNOCODE );
     assert( iLookAhead < YYNTOKEN );
-    i += iLookAhead;
-    assert( i<(int)YY_NLOOKAHEAD );
-    if( yy_lookahead[i]!=iLookAhead ){
-#ifdef YYFALLBACK
+#if defined(YY_ACTTAB_COUNT) && !defined(YY_PACKED_TABLES)
+    assert( stateno <= YY_SHIFT_COUNT );
+    assert( yy_shift_ofst[stateno]>=0 );
+    assert( yy_shift_ofst[stateno]<=YY_ACTTAB_COUNT );
+    assert( yy_shift_ofst[stateno]+YYNTOKEN<=(int)YY_NLOOKAHEAD );
+#endif
+    i = YY_SHIFT_ENTRY(stateno, iLookAhead);
+    if( !YY_SHIFT_FOUND(i, iLookAhead) ){
+#if defined(YYFALLBACK) && !defined(YYFOLDED)
       YYCODETYPE iFallback;            /* Fallback token */
-      assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
+      assert( iLookAhead<YYNTOKEN );
       iFallback = yyFallback[iLookAhead];
       if( iFallback!=0 ){
 #ifndef NDEBUG
@@ -541,11 +1543,10 @@ static YYACTIONTYPE yy_find_shift_action(
         continue;
       }
 #endif
-#ifdef YYWILDCARD
+#if defined(YYWILDCARD) && !defined(YYFOLDED)
       {
-        int j = i - iLookAhead + YYWILDCARD;
-        assert( j<(int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])) );
-        if( yy_lookahead[j]==YYWILDCARD && iLookAhead>0 ){
+        int j = YY_SHIFT_ENTRY(stateno, YYWILDCARD);
+        if( YY_SHIFT_FOUND(j, YYWILDCARD) && iLookAhead>0 ){
 #ifndef NDEBUG
           if( yyTraceFILE ){
             fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
@@ -553,14 +1554,18 @@ static YYACTIONTYPE yy_find_shift_action(
                yyTokenName[YYWILDCARD]);
           }
 #endif /* NDEBUG */
-          return yy_action[j];
+          return YY_SHIFT_ACTION(j);
         }
       }
 #endif /* YYWILDCARD */
-      return yy_default[stateno];
+      return YY_DEFAULT(stateno);
     }else{
+#if defined(YY_PACKED_TABLES) || defined(YY_LOADED_TABLES)
+      assert( i>=0 && i<YY_ACTTAB_COUNT );
+#elif !defined(YY_CODED_TABLES) && !defined(YY_PAIRED_TABLES)
       assert( i>=0 && i<(int)(sizeof(yy_action)/sizeof(yy_action[0])) );
-      return yy_action[i];
+#endif
+      return YY_SHIFT_ACTION(i);
     }
   }while(1);
 }
@@ -574,26 +1579,78 @@ static YYACTIONTYPE yy_find_reduce_action(
   YYCODETYPE iLookAhead     /* The look-ahead token */
 ){
   int i;
+  assert( iLookAhead!=YYNOCODE );
+#if defined(YYPROFILE)
+  yyprofile[stateno][iLookAhead]++;
+#endif
+#if defined(YY_CODED_TABLES)
+  (void)i;
+  return yy_goto_code(stateno, iLookAhead);
+#elif defined(YY_DENSE_TABLES)
+  assert( iLookAhead>=YYNTOKEN );
+  i = stateno*(YYNOCODE-YYNTOKEN) + iLookAhead - YYNTOKEN;
+  return yy_goto[i];
+#elif defined(YY_PAIRED_TABLES)
+  i = yy_state[stateno].reduce_ofst + iLookAhead;
+#ifdef YYERRORSYMBOL
+  if( i<0 || i>=(int)(sizeof(yy_pair)/sizeof(yy_pair[0]))
+   || yy_pair[i].lookahead!=iLookAhead ){
+    return YY_DEFAULT(stateno);
+  }
+#else
+  assert( i>=0 && i<(int)(sizeof(yy_pair)/sizeof(yy_pair[0])) );
+  assert( yy_pair[i].lookahead==iLookAhead );
+#endif
+  return yy_pair[i].action;
+#elif defined(YY_PACKED_TABLES)
 #ifdef YYERRORSYMBOL
   if( stateno>YY_REDUCE_COUNT ){
-    return yy_default[stateno];
+    return YY_DEFAULT(stateno);
+  }
+#else
+  assert( stateno<=YY_REDUCE_COUNT );
+#endif
+  i = yy_unpack(yy_reduce_ofst, YY_REDUCE_BITS, stateno) + YY_REDUCE_MIN - 1;
+  i += iLookAhead;
+#ifdef YYERRORSYMBOL
+  if( i<0 || i>=YY_ACTTAB_COUNT || !YY_SHIFT_FOUND(i, iLookAhead) ){
+    return YY_DEFAULT(stateno);
+  }
+#else
+  assert( i>=0 && i<YY_ACTTAB_COUNT );
+  assert( YY_SHIFT_FOUND(i, iLookAhead) );
+#endif
+  return YY_SHIFT_ACTION(i);
+#elif defined(YY_HASHED_TABLES)
+  i = yy_reduce_ofst[stateno] + YY_HASH(yy_reduce_hash[stateno], iLookAhead);
+#ifdef YYERRORSYMBOL
+  if( yy_lookahead[i]!=iLookAhead ) return YY_DEFAULT(stateno);
+#else
+  assert( yy_lookahead[i]==iLookAhead );
+#endif
+  return yy_action[i];
+#else
+#ifdef YYERRORSYMBOL
+  if( stateno>YY_REDUCE_COUNT ){
+    return YY_DEFAULT(stateno);
   }
 #else
   assert( stateno<=YY_REDUCE_COUNT );
 #endif
   i = yy_reduce_ofst[stateno];
-  assert( iLookAhead!=YYNOCODE );
   i += iLookAhead;
 #ifdef YYERRORSYMBOL
   if( i<0 || i>=YY_ACTTAB_COUNT || yy_lookahead[i]!=iLookAhead ){
-    return yy_default[stateno];
+    return YY_DEFAULT(stateno);
   }
 #else
   assert( i>=0 && i<YY_ACTTAB_COUNT );
   assert( yy_lookahead[i]==iLookAhead );
 #endif
   return yy_action[i];
+#endif
 }
+#endif /* !defined(YY_SHARED_ENGINE) */
 
 /*
 ** The following routine is called if the stack overflows.
@@ -606,16 +1663,24 @@ static void yyStackOverflow(yyParser *yypParser){
      fprintf(yyTraceFILE,"%sStack Overflow!\n",yyTracePrompt);
    }
 #endif
+#if defined(YY_SHARED_ENGINE)
+   lemonEnginePopAll(&yypParser->yyengine);
+#else
    while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
+#endif
    /* Here code is inserted which will execute if the parser
    ** stack every overflows */
 /******** Begin %stack_overflow code ******************************************/
 %%
 /******** End %stack_overflow code ********************************************/
+#if defined(YYARENA)
+   yypParser->yyarena.bStale = 1;
+#endif
    ParseARG_STORE /* Suppress warning about unused %extra_argument var */
    ParseCTX_STORE
 }
 
+#if !defined(YY_SHARED_ENGINE)
 /*
 ** Print tracing information for a SHIFT action
 */
@@ -637,8 +1702,14 @@ static void yyTraceShift(yyParser *yypParser, int yyNewState, const char *zTag){
 # define yyTraceShift(X,Y,Z)
 #endif
 
+#if YYTOKENVALUES==2
+/* yyTokenValue[X] is true if the value of token X is ever used */
+static const unsigned char yyTokenValue[] = { YYTOKENVALUE_LIST };
+#endif
+
 /*
-** Perform a shift action.
+** Perform a shift action.  The values of tokens that are never used are
+** not stored.
 */
 static void yy_shift(
   yyParser *yypParser,          /* The parser to be shifted */
@@ -649,9 +1720,9 @@ static void yy_shift(
   yyStackEntry *yytos;
   yypParser->yytos++;
 #ifdef YYTRACKMAXSTACKDEPTH
-  if( (int)(yypParser->yytos - yypParser->yystack)>yypParser->yyhwm ){
+  if( yyStackDepth(yypParser)>yypParser->yyhwm ){
     yypParser->yyhwm++;
-    assert( yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack) );
+    assert( yypParser->yyhwm == yyStackDepth(yypParser) );
   }
 #endif
 #if YYSTACKDEPTH>0
@@ -675,10 +1746,17 @@ static void yy_shift(
   yytos = yypParser->yytos;
   yytos->stateno = yyNewState;
   yytos->major = yyMajor;
-  yytos->minor.yy0 = yyMinor;
+#if YYTOKENVALUES==0
+  if( yyMajor>=YYNTOKEN )
+#elif YYTOKENVALUES==2
+  if( yyMajor>=YYNTOKEN || yyTokenValue[yyMajor] )
+#endif
+  yyStackMinor(yypParser, yytos)->yy0 = yyMinor;
   yyTraceShift(yypParser, yyNewState, "Shift");
 }
+#endif /* !defined(YY_SHARED_ENGINE) */
 
+#if !defined(YY_LOADED_TABLES)
 /* For rule J, yyRuleInfoLhs[J] contains the symbol on the left-hand side
 ** of that rule */
 static const YYCODETYPE yyRuleInfoLhs[] = {
@@ -690,9 +1768,19 @@ static const YYCODETYPE yyRuleInfoLhs[] = {
 static const signed char yyRuleInfoNRhs[] = {
 %%
 };
+#endif /* !defined(YY_LOADED_TABLES) */
 
 static void yy_accept(yyParser*);  /* Forward Declaration */
 
+/* The reduce actions are in the switch of yy_reduce() by default.  With
+** "lemon -Rfunction" they are functions here instead, which yy_reduce()
+** calls through yy_reduce_func[], and YY_REDUCE_FUNCS is defined.  With
+** "lemon -Rgoto" they stay in the switch, but on compilers that have
+** labels as values, yy_reduce() jumps to them through a table of labels,
+** and YY_REDUCE_GOTO is defined.
+*/
+%%
+
 /*
 ** Perform a reduce action and the shift that must immediately
 ** follow the reduce.
@@ -702,7 +1790,23 @@ static void yy_accept(yyParser*);  /* Forward Declaration */
 ** if the lookahead token has already been consumed.  As this procedure is
 ** only called from one place, optimizing compilers will in-line it, which
 ** means that the extra parameters have no performance impact.
+**
+** With YY_SHARED_ENGINE, the engine calls this routine for the code of the
+** rule only, and pops the stack and finds the next state itself.
 */
+#if defined(YY_SHARED_ENGINE)
+static void yy_reduce(
+  lemonParser *yypEngine,      /* The parser */
+  unsigned int yyruleno,       /* Number of the rule by which to reduce */
+  void *yypTos,                /* The top of the parser's stack */
+  int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+  void *yypLookahead           /* Value of the lookahead token */
+){
+  yyParser *yypParser = (yyParser*)yypEngine;
+  yyStackEntry *yymsp = (yyStackEntry*)yypTos;
+  ParseTOKENTYPE yyLookaheadToken = ((YYMINORTYPE*)yypLookahead)->yy0;
+  ParseCTX_FETCH
+#else
 static YYACTIONTYPE yy_reduce(
   yyParser *yypParser,         /* The parser */
   unsigned int yyruleno,       /* Number of the rule by which to reduce */
@@ -713,12 +1817,46 @@ static YYACTIONTYPE yy_reduce(
   int yygoto;                     /* The next state */
   YYACTIONTYPE yyact;             /* The next action */
   yyStackEntry *yymsp;            /* The top of the parser's stack */
+#if defined(YY_STACK_ARRAYS)
+  YYMINORTYPE *yyvsp;             /* Its value */
+#endif
   int yysize;                     /* Amount to pop the stack */
+#endif /* YY_SHARED_ENGINE */
+#if !defined(YY_REDUCE_FUNCS)
   ParseARG_FETCH
+#endif
   (void)yyLookahead;
   (void)yyLookaheadToken;
+#if defined(YY_SHARED_ENGINE)
+  (void)yypParser;
+  (void)yymsp;
+#else
   yymsp = yypParser->yytos;
+#if defined(YY_STACK_ARRAYS)
+  yyvsp = yyStackMinor(yypParser, yymsp);
+  (void)yyvsp;
+#endif
+#endif
+#if defined(YYPROFILE)
+  yyprofile_rule[yyruleno]++;
+#endif
 
+#if defined(YY_REDUCE_FUNCS)
+  if( yy_reduce_func[yyruleno] ){
+#if defined(YY_STACK_ARRAYS)
+    yy_reduce_func[yyruleno](yypParser, yymsp, yyvsp, yyruleno, yyLookahead,
+                             yyLookaheadToken ParseCTX_PARAM);
+#else
+    yy_reduce_func[yyruleno](yypParser, yymsp, yyruleno, yyLookahead,
+                             yyLookaheadToken ParseCTX_PARAM);
+#endif
+  }
+#elif defined(YY_REDUCE_GOTO)
+  {
+    static const void *const yy_reduce_label[] = { YY_REDUCE_LABELS };
+    goto *yy_reduce_label[yyruleno];
+  }
+#endif
   switch( yyruleno ){
   /* Beginning here are the reduction cases.  A typical example
   ** follows:
@@ -732,7 +1870,8 @@ static YYACTIONTYPE yy_reduce(
 %%
 /********** End reduce actions ************************************************/
   };
-  assert( yyruleno<sizeof(yyRuleInfoLhs)/sizeof(yyRuleInfoLhs[0]) );
+#if !defined(YY_SHARED_ENGINE)
+  assert( yyruleno<YYNRULE );
   yygoto = yyRuleInfoLhs[yyruleno];
   yysize = yyRuleInfoNRhs[yyruleno];
   yyact = yy_find_reduce_action(yymsp[yysize].stateno,(YYCODETYPE)yygoto);
@@ -748,8 +1887,14 @@ static YYACTIONTYPE yy_reduce(
   yypParser->yytos = yymsp;
   yymsp->stateno = (YYACTIONTYPE)yyact;
   yymsp->major = (YYCODETYPE)yygoto;
+#if YYSTACKSEGMENT>0
+  if( yymsp<yypParser->yystackLow ) yyStackDescend(yypParser);
+#endif
   yyTraceShift(yypParser, yyact, "... then shift");
   return yyact;
+#else
+  ParseCTX_STORE /* Suppress warning about unused %extra_context variable */
+#endif /* !defined(YY_SHARED_ENGINE) */
 }
 
 /*
@@ -766,12 +1911,19 @@ static void yy_parse_failed(
     fprintf(yyTraceFILE,"%sFail!\n",yyTracePrompt);
   }
 #endif
+#if defined(YY_SHARED_ENGINE)
+  lemonEnginePopAll(&yypParser->yyengine);
+#else
   while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
+#endif
   /* Here code is inserted which will be executed whenever the
   ** parser fails */
 /************ Begin %parse_failure code ***************************************/
 %%
 /************ End %parse_failure code *****************************************/
+#if defined(YYARENA)
+  yypParser->yyarena.bStale = 1;
+#endif
   ParseARG_STORE /* Suppress warning about unused %extra_argument variable */
   ParseCTX_STORE
 }
@@ -808,19 +1960,126 @@ static void yy_accept(
     fprintf(yyTraceFILE,"%sAccept!\n",yyTracePrompt);
   }
 #endif
+#if !defined(YY_SHARED_ENGINE)
 #ifndef YYNOERRORRECOVERY
   yypParser->yyerrcnt = -1;
 #endif
   assert( yypParser->yytos==yypParser->yystack );
+#endif
   /* Here code is inserted which will be executed whenever the
   ** parser accepts */
 /*********** Begin %parse_accept code *****************************************/
 %%
 /*********** End %parse_accept code *******************************************/
+#if defined(YYARENA)
+  yypParser->yyarena.bStale = 1;
+#endif
   ParseARG_STORE /* Suppress warning about unused %extra_argument variable */
   ParseCTX_STORE
 }
 
+#if defined(YY_SHARED_ENGINE)
+/*
+** The routines that the shared engine calls back, through yyGrammar.
+*/
+static void yy_destructor_cb(lemonParser *p, int yymajor, void *pMinor){
+  yy_destructor((yyParser*)p, (YYCODETYPE)yymajor, (YYMINORTYPE*)pMinor);
+}
+static void yy_overflow_cb(lemonParser *p){
+  yyStackOverflow((yyParser*)p);
+}
+#ifndef YYNOERRORRECOVERY
+static void yy_failed_cb(lemonParser *p){
+  yy_parse_failed((yyParser*)p);
+}
+#endif
+static void yy_syntax_error_cb(lemonParser *p, int yymajor, void *pMinor){
+  yy_syntax_error((yyParser*)p, yymajor, ((YYMINORTYPE*)pMinor)->yy0);
+}
+static void yy_accept_cb(lemonParser *p){
+  yy_accept((yyParser*)p);
+}
+static int yy_growth_cb(int N){
+  return YYSTACKGROWTH(N);
+}
+
+/* The grammar, as the shared engine sees it */
+static const lemonGrammar yyGrammar = {
+  yy_action, yy_lookahead, yy_shift_ofst, yy_reduce_ofst, yy_default,
+#if defined(YYFALLBACK) && !defined(YYFOLDED)
+  yyFallback,
+#else
+  0,
+#endif
+  yyRuleInfoLhs, yyRuleInfoNRhs,
+  YY_ACTTAB_COUNT, YY_REDUCE_COUNT, YYNRULE_WITH_ACTION, YYNTOKEN,
+  YY_MAX_SHIFT, YY_MIN_SHIFTREDUCE, YY_MAX_SHIFTREDUCE, YY_ERROR_ACTION,
+  YY_ACCEPT_ACTION, YY_MIN_REDUCE, YYNOCODE,
+#if defined(YYWILDCARD) && !defined(YYFOLDED)
+  YYWILDCARD,
+#else
+  0,
+#endif
+#ifdef YYERRORSYMBOL
+  YYERRORSYMBOL,
+#else
+  0,
+#endif
+#ifdef YYNOERRORRECOVERY
+  1,
+#else
+  0,
+#endif
+  sizeof(yyStackEntry), sizeof(ParseTOKENTYPE), offsetof(yyStackEntry, minor),
+  yy_reduce, yy_destructor_cb, yy_overflow_cb,
+#ifndef YYNOERRORRECOVERY
+  yy_failed_cb,
+#else
+  0,
+#endif
+  yy_syntax_error_cb, yy_accept_cb, yy_growth_cb, YYSTACKLIMIT,
+#ifndef NDEBUG
+  yyTokenName, yyRuleName, &yyTraceFILE, &yyTracePrompt
+#else
+  0, 0, 0, 0
+#endif
+};
+
+/* Start the shared engine on a parser, with the allocator xMem */
+static void yy_engine_init(
+  yyParser *yypParser,
+  void *(*xMem)(void*,void*,size_t,size_t),
+  void *pMemCtx
+){
+#if YYSTACKDEPTH<=0
+  lemonEngineInit(&yypParser->yyengine, &yyGrammar, yypParser->yystk0,
+                  YYSTACKINLINE, 1, xMem, pMemCtx);
+#else
+  lemonEngineInit(&yypParser->yyengine, &yyGrammar, yypParser->yystack,
+                  YYSTACKDEPTH, 0, xMem, pMemCtx);
+#endif
+}
+
+/* The main parser program.  The shared engine does the work, once the
+** %extra_argument is stored where the reduce actions fetch it from.
+*/
+void Parse(
+  void *yyp,                   /* The parser */
+  int yymajor,                 /* The major token code number */
+  ParseTOKENTYPE yyminor       /* The value for the token */
+  ParseARG_PDECL               /* Optional %extra_argument parameter */
+){
+  YYMINORTYPE yyminorunion;
+  yyParser *yypParser = (yyParser*)yyp;  /* The parser */
+  ParseARG_STORE
+#if defined(YYARENA)
+  if( yypParser->yyarena.bStale ) yyArenaClear(yypParser, 1);
+#endif
+  yyminorunion.yy0 = yyminor;
+  lemonEngineParse(&yypParser->yyengine, yymajor, &yyminorunion);
+}
+#else /* !defined(YY_SHARED_ENGINE) */
+
 /* The main parser program.
 ** The first argument is a pointer to a structure obtained from
 ** "ParseAlloc" which describes the current state of the parser.
@@ -857,6 +2116,9 @@ void Parse(
   yyParser *yypParser = (yyParser*)yyp;  /* The parser */
   ParseCTX_FETCH
   ParseARG_STORE
+#if defined(YYARENA)
+  if( yypParser->yyarena.bStale ) yyArenaClear(yypParser, 1);
+#endif
 
   assert( yypParser->yytos!=0 );
 #if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
@@ -905,10 +2167,9 @@ void Parse(
       ** enough on the stack to push the LHS value */
       if( yyRuleInfoNRhs[yyruleno]==0 ){
 #ifdef YYTRACKMAXSTACKDEPTH
-        if( (int)(yypParser->yytos - yypParser->yystack)>yypParser->yyhwm ){
+        if( yyStackDepth(yypParser)>yypParser->yyhwm ){
           yypParser->yyhwm++;
-          assert( yypParser->yyhwm ==
-                  (int)(yypParser->yytos - yypParser->yystack));
+          assert( yypParser->yyhwm == yyStackDepth(yypParser) );
         }
 #endif
 #if YYSTACKDEPTH>0
@@ -925,6 +2186,12 @@ void Parse(
         }
 #endif
       }
+#if defined(YYBOXTYPES)
+      if( yypParser->yyboxempty && yyBoxReserve(yypParser) ){
+        yyStackOverflow(yypParser);
+        break;
+      }
+#endif
       yyact = yy_reduce(yypParser,yyruleno,yymajor,yyminor ParseCTX_PARAM);
     }else if( yyact <= YY_MAX_SHIFTREDUCE ){
       yy_shift(yypParser,yyact,(YYCODETYPE)yymajor,yyminor);
@@ -933,6 +2200,10 @@ void Parse(
 #endif
       break;
     }else if( yyact==YY_ACCEPT_ACTION ){
+#if defined(YYBOXTYPES)
+      yyBoxRelease(yypParser, yypParser->yytos->major,
+                   yyStackMinor(yypParser, yypParser->yytos));
+#endif
       yypParser->yytos--;
       yy_accept(yypParser);
       return;
@@ -1040,10 +2311,26 @@ void Parse(
   }
 #ifndef NDEBUG
   if( yyTraceFILE ){
-    yyStackEntry *i;
+    yyStackEntry *i = &yypParser->yystack[1];
     char cDiv = '[';
+#if YYSTACKSEGMENT>0
+    yyStackSegment *pSeg = yypParser->yyseg;
+#endif
     fprintf(yyTraceFILE,"%sReturn. Stack=",yyTracePrompt);
-    for(i=&yypParser->yystack[1]; i<=yypParser->yytos; i++){
+#if YYSTACKSEGMENT>0
+    /* The top YYMAXRHS+1 entries of each segment below the one in use
+    ** are stale copies of the first entries of the segment above */
+    if( pSeg && pSeg->pPrev ){
+      while( pSeg->pPrev ) pSeg = pSeg->pPrev;
+      for(i=&pSeg->a[1]; pSeg!=yypParser->yyseg; pSeg=pSeg->pNext, i=pSeg->a){
+        for(; i<&pSeg->a[YYSTACKSEGMENT-YYMAXRHS-1]; i++){
+          fprintf(yyTraceFILE,"%c%s", cDiv, yyTokenName[i->major]);
+          cDiv = ' ';
+        }
+      }
+    }
+#endif
+    for(; i<=yypParser->yytos; i++){
       fprintf(yyTraceFILE,"%c%s", cDiv, yyTokenName[i->major]);
       cDiv = ' ';
     }
@@ -1052,6 +2339,7 @@ void Parse(
 #endif
   return;
 }
+#endif /* YY_SHARED_ENGINE */
 
 /*
 ** Return the fallback token corresponding to canonical token iToken, or
@@ -1059,7 +2347,7 @@ void Parse(
 */
 int ParseFallback(int iToken){
 #ifdef YYFALLBACK
-  assert( iToken<(int)(sizeof(yyFallback)/sizeof(yyFallback[0])) );
+  assert( iToken<YYNTOKEN );
   return yyFallback[iToken];
 #else
   (void)iToken;
@@ -0,0 +1,390 @@
+/*
+** The LEMON parser generator as a library.  All state belongs to a
+** single "struct lemon", so independent runs of the generator can
+** proceed at the same time on separate threads.
+*/
+
+/* Merge together to lists of rules ordered by rule.iRule */
+static struct rule *Rule_merge(struct rule *pA, struct rule *pB){
+  struct rule *pFirst = 0;
+  struct rule **ppPrev = &pFirst;
+  while( pA && pB ){
+    if( pA->iRule<pB->iRule ){
+      *ppPrev = pA;
+      ppPrev = &pA->next;
+      pA = pA->next;
+    }else{
+      *ppPrev = pB;
+      ppPrev = &pB->next;
+      pB = pB->next;
+    }
+  }
+  if( pA ){
+    *ppPrev = pA;
+  }else{
+    *ppPrev = pB;
+  }
+  return pFirst;
+}
+
+/*
+** Sort a list of rules in order of increasing iRule value
+*/
+static struct rule *Rule_sort(struct rule *rp){
+  unsigned int i;
+  struct rule *pNext;
+  struct rule *x[32];
+  memset(x, 0, sizeof(x));
+  while( rp ){
+    pNext = rp->next;
+    rp->next = 0;
+    for(i=0; i<sizeof(x)/sizeof(x[0])-1 && x[i]; i++){
+      rp = Rule_merge(x[i], rp);
+      x[i] = 0;
+    }
+    x[i] = rp;
+    rp = pNext;
+  }
+  rp = 0;
+  for(i=0; i<sizeof(x)/sizeof(x[0]); i++){
+    rp = Rule_merge(x[i], rp);
+  }
+  return rp;
+}
+
+/* forward reference */
+static const char *minimum_size_type(int lwr, int upr, int *pnByte);
+
+/* Print a single line of the "Parser Stats" output
+*/
+static void stats_line(struct lemon *lemp, const char *zLabel, int iValue){
+  int nLabel = lemonStrlen(zLabel);
+  fprintf(lemp->outstream, "  %s%.*s %5d\n", zLabel,
+         35-nLabel, "................................",
+         iValue);
+}
+
+/* Return the time in milliseconds since some fixed point in the past */
+double lemon_clock(void){
+#if defined(CLOCK_MONOTONIC) && !defined(__WIN32__)
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000.0 + t.tv_nsec/1000000.0;
+#else
+  return clock()*1000.0/CLOCKS_PER_SEC;
+#endif
+}
+
+/* Parse the grammar and compute the parser tables, on a struct lemon
+** whose options, filename and output streams have already been filled
+** in.  Return -1 if the outputs should be generated next by a call to
+** lemon_report().  Otherwise there is nothing more to do, because of
+** errors or because only -E or -g output was requested, and the return
+** value is the exit code for the stand-alone program.
+*/
+int lemon_analyze(struct lemon *lemp){
+  int i;
+  struct rule *rp;
+  double rStart = lemon_clock();
+  double rNow;
+
+  /* Initialize the machine */
+  Strsafe_init(lemp);
+  Symbol_init(lemp);
+  State_init(lemp);
+  Symbol_new(lemp,"$");
+
+  /* Parse the input file */
+  Parse(lemp);
+  rNow = lemon_clock();
+  lemp->aPhase[PHASE_PARSE] = rNow - rStart;
+  rStart = rNow;
+  if( lemp->printPreprocessed || lemp->errorcnt ) return lemp->errorcnt;
+  if( lemp->nrule==0 ){
+    fprintf(lemp->errstream,"%s: Empty grammar.\n", lemp->filename);
+    lemp->errorcnt++;
+    return 1;
+  }
+  lemp->errsym = Symbol_find(lemp,"error");
+
+  /* Count and index the symbols of the grammar */
+  Symbol_new(lemp,"{default}");
+  lemp->nsymbol = Symbol_count(lemp);
+  lemp->symbols = Symbol_arrayof(lemp);
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  qsort(lemp->symbols,lemp->nsymbol,sizeof(struct symbol*), Symbolcmpp);
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  while( lemp->symbols[i-1]->type==MULTITERMINAL ){ i--; }
+  assert( strcmp(lemp->symbols[i-1]->name,"{default}")==0 );
+  lemp->nsymbol = i - 1;
+  for(i=1; ISUPPER(lemp->symbols[i]->name[0]); i++);
+  lemp->nterminal = i;
+
+  /* Assign sequential rule numbers.  Start with 0.  Put rules that have no
+  ** reduce action C-code associated with them last, so that the switch()
+  ** statement that selects reduction actions will have a smaller jump table.
+  */
+  for(i=0, rp=lemp->rule; rp; rp=rp->next){
+    rp->iRule = rp->code ? i++ : -1;
+  }
+  lemp->nruleWithAction = i;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iRule<0 ) rp->iRule = i++;
+  }
+  /* The default start symbol is the left-hand side of the first rule
+  ** of the main grammar file, not of a module that it imports first */
+  if( lemp->startRule==0 ) lemp->startRule = lemp->rule;
+  lemp->rule = Rule_sort(lemp->rule);
+
+  /* Generate a reprint of the grammar, if requested on the command line */
+  if( lemp->rpflag ){
+    Reprint(lemp);
+    return lemon_report(lemp);
+  }
+
+  /* Initialize the size for all follow and first sets */
+  SetSize(lemp,lemp->nterminal+1);
+
+  /* Find the precedence for every production rule (that has one) */
+  FindRulePrecedences(lemp);
+
+  /* Compute the lambda-nonterminals and the first-sets for every
+  ** nonterminal */
+  FindFirstSets(lemp);
+
+  /* Compute all LR(0) states.  Also record follow-set propagation
+  ** links so that the follow-set can be computed later */
+  lemp->nstate = 0;
+  FindStates(lemp);
+  lemp->sorted = State_arrayof(lemp);
+
+  /* Tie up loose ends on the propagation links */
+  FindLinks(lemp);
+
+  /* Compute the follow set of every reducible configuration */
+  FindFollowSets(lemp);
+
+  /* Compute the action tables */
+  FindActions(lemp);
+  rNow = lemon_clock();
+  lemp->aPhase[PHASE_ANALYZE] = rNow - rStart;
+  rStart = rNow;
+
+  /* Compress the action tables */
+  if( lemp->noCompress==0 ) CompressTables(lemp);
+
+  /* Resolve %fallback and %wildcard in the tables, if asked to */
+  if( lemp->foldFallback ) FoldFallbacks(lemp);
+
+  /* Count the look-ups of each state in a profile of the parser */
+  if( lemp->zProfile ){
+    ReadProfile(lemp);
+    if( lemp->errorcnt ) return 1;
+  }
+
+  /* Reorder and renumber the states so that states with fewer choices
+  ** occur at the end.  This is an optimization that helps make the
+  ** generated parser tables smaller.  With a profile, the states that
+  ** are looked up most come first instead. */
+  if( lemp->noResort==0 ) ResortStates(lemp);
+  lemp->aPhase[PHASE_COMPRESS] = lemon_clock() - rStart;
+  return -1;
+}
+
+/* Generate the outputs of a grammar that lemon_analyze() has processed,
+** and show the statistics.  Return the exit code for the stand-alone
+** program.
+*/
+int lemon_report(struct lemon *lemp){
+  if( !lemp->rpflag ){
+    double rStart = lemon_clock();
+    double rNow;
+
+    /* Generate a report of the parser generated.  (the "y.output" file) */
+    if( lemp->quiet ){
+      /* No report */
+    }else if( lemp->jsonReport ){
+      ReportJson(lemp);
+    }else{
+      ReportOutput(lemp);
+    }
+    rNow = lemon_clock();
+    lemp->aPhase[PHASE_REPORT] = rNow - rStart;
+    rStart = rNow;
+
+    /* Generate the source code for the parser */
+    ReportTable(lemp);
+    if( lemp->sizeReport && lemp->errorcnt==0 ) ReportSizes(lemp);
+    rNow = lemon_clock();
+    lemp->aPhase[PHASE_TABLES] = rNow - rStart;
+    rStart = rNow;
+
+    /* Produce a header file for use by the scanner.  (This step is
+    ** omitted if the "-m" option is used because makeheaders will
+    ** generate the file for us.) */
+    if( !lemp->mhflag ) ReportHeader(lemp);
+    lemp->aPhase[PHASE_HEADER] = lemon_clock() - rStart;
+  }
+  if( lemp->statistics ){
+    fprintf(lemp->outstream, "Parser statistics:\n");
+    stats_line(lemp, "terminal symbols", lemp->nterminal);
+    stats_line(lemp, "non-terminal symbols", lemp->nsymbol - lemp->nterminal);
+    stats_line(lemp, "total symbols", lemp->nsymbol);
+    stats_line(lemp, "rules", lemp->nrule);
+    stats_line(lemp, "states", lemp->nxstate);
+    stats_line(lemp, "conflicts", lemp->nconflict);
+    if( lemp->zProfile ){
+      stats_line(lemp, "states in the profile", lemp->nprofiled);
+      stats_line(lemp, "rules in cold functions", lemp->ncold);
+    }
+    stats_line(lemp, "action table entries", lemp->nactiontab);
+    stats_line(lemp, "lookahead table entries", lemp->nlookaheadtab);
+    stats_line(lemp, "total table size (bytes)", lemp->tablesize);
+    if( lemp->szEntry>0 ){
+      stats_line(lemp, "stack entry size (bytes)", lemp->szEntry);
+    }
+    if( lemp->boxSize && lemp->szEntryUnboxed>0 ){
+      stats_line(lemp, "stack entry size without -Z", lemp->szEntryUnboxed);
+    }
+    if( !lemp->rpflag ){
+      stats_line(lemp, "tokens shifted without a value", lemp->nTokenNoValue);
+      stats_line(lemp, "LHS values written in place", lemp->nLhsInPlace);
+      stats_line(lemp, "LHS values copied", lemp->nLhsCopy);
+    }
+  }
+  if( lemp->nconflict > 0 ){
+    fprintf(lemp->errstream,"%d parsing conflicts.\n",lemp->nconflict);
+  }
+
+  /* return 0 on success, 1 on failure. */
+  return ((lemp->errorcnt > 0) || (lemp->nconflict > 0)) ? 1 : 0;
+}
+
+/* Run every step of the parser generator */
+static int lemon_steps(struct lemon *lemp){
+  int rc;
+  if( lemp->zQuery ) return ReportQuery(lemp);
+  rc = lemon_analyze(lemp);
+  if( rc<0 ) rc = lemon_report(lemp);
+  return rc;
+}
+
+/* Call xStep(lemp).  A fatal error, such as running out of memory,
+** unwinds back to here and the step fails with exit code 1.  Memory is
+** not released.  That is left to lemon_free_all().
+*/
+int lemon_protect(struct lemon *lemp, int (*xStep)(struct lemon*)){
+  jmp_buf env;
+  int rc;
+  lemp->pAbort = &env;
+  if( setjmp(env)==0 ){
+    rc = xStep(lemp);
+  }else{
+    rc = 1;
+  }
+  file_close_all(lemp);
+  lemp->pAbort = 0;
+  return rc;
+}
+
+/* Run the parser generator */
+int lemon_run(struct lemon *lemp){
+  return lemon_protect(lemp, lemon_steps);
+}
+
+/* Generate a parser from the options in *pOpt, capturing every output
+** in memory.  See liblemon.h for details.
+*/
+int lemon_generate(
+  const struct lemon_options *pOpt,    /* What to generate */
+  struct lemon_result *pResult         /* OUT: The generated text */
+){
+  struct lemon lem;
+  struct memfile aFile[MEMFILE_COUNT];
+  int rc;
+  int i;
+
+  memset(pResult, 0, sizeof(*pResult));
+  memset(aFile, 0, sizeof(aFile));
+  memset(&lem, 0, sizeof(lem));
+  lem.filename = (char*)(pOpt->zFilename ? pOpt->zFilename : "grammar.y");
+  lem.zGrammar = pOpt->zGrammar;
+  lem.nGrammar = pOpt->nGrammar;
+  lem.zTemplate = pOpt->zTemplate;
+  lem.nTemplate = pOpt->nTemplate;
+  lem.templatename = (char*)pOpt->zTemplateFile;
+  lem.azDefine = (char**)pOpt->azDefine;
+  lem.nDefine = pOpt->nDefine;
+  lem.basisflag = pOpt->basisflag;
+  lem.noCompress = pOpt->noCompress;
+  lem.printPreprocessed = pOpt->printPreprocessed;
+  lem.rpflag = pOpt->rpflag;
+  lem.nolinenosflag = pOpt->nolinenosflag;
+  lem.mhflag = pOpt->mhflag;
+  lem.showPrecedenceConflict = pOpt->showPrecedenceConflict;
+  lem.quiet = pOpt->quiet;
+  lem.noResort = pOpt->noResort;
+  lem.statistics = pOpt->statistics;
+  lem.sqlFlag = pOpt->sqlFlag;
+  lem.jsonReport = pOpt->jsonReport;
+  lem.sizeReport = pOpt->sizeReport;
+  lem.foldFallback = pOpt->foldFallback;
+  lem.zQuery = pOpt->zQuery;
+  lem.encoding = encoding_find(pOpt->zEncoding ? pOpt->zEncoding : "comb");
+  lem.dispatch = dispatch_find(pOpt->zDispatch ? pOpt->zDispatch : "switch");
+  lem.zProfile = pOpt->zProfile;
+  lem.blobTables = pOpt->blobTables;
+  lem.sharedEngine = pOpt->sharedEngine;
+  lem.stackArrays = pOpt->stackArrays;
+  lem.boxSize = pOpt->boxSize;
+  lem.aMemfile = aFile;
+  lem.outstream = memfile_open(&aFile[MEMFILE_OUTPUT]);
+  lem.errstream = memfile_open(&aFile[MEMFILE_ERRORS]);
+  if( lem.outstream==0 || lem.errstream==0 ){
+    rc = -1;
+  }else if( lem.encoding<0 ){
+    fprintf(lem.errstream,"Unknown table encoding \"%s\".\n",
+            pOpt->zEncoding);
+    lem.errorcnt++;
+    rc = 1;
+  }else if( lem.dispatch<0 ){
+    fprintf(lem.errstream,"Unknown reduce dispatch \"%s\".\n",
+            pOpt->zDispatch);
+    lem.errorcnt++;
+    rc = 1;
+  }else{
+    rc = lemon_run(&lem);
+  }
+  for(i=0; i<MEMFILE_COUNT; i++) memfile_close(&aFile[i]);
+  lemon_free_all(&lem);
+
+  pResult->zSource = aFile[MEMFILE_SOURCE].z;
+  pResult->nSource = aFile[MEMFILE_SOURCE].n;
+  pResult->zHeader = aFile[MEMFILE_HEADER].z;
+  pResult->nHeader = aFile[MEMFILE_HEADER].n;
+  pResult->zReport = aFile[MEMFILE_REPORT].z;
+  pResult->nReport = aFile[MEMFILE_REPORT].n;
+  pResult->zSql = aFile[MEMFILE_SQL].z;
+  pResult->nSql = aFile[MEMFILE_SQL].n;
+  pResult->zTables = aFile[MEMFILE_TABLES].z;
+  pResult->nTables = aFile[MEMFILE_TABLES].n;
+  pResult->zOutput = aFile[MEMFILE_OUTPUT].z;
+  pResult->nOutput = aFile[MEMFILE_OUTPUT].n;
+  pResult->zErrors = aFile[MEMFILE_ERRORS].z;
+  pResult->nErrors = aFile[MEMFILE_ERRORS].n;
+  pResult->nError = lem.errorcnt;
+  pResult->nConflict = lem.nconflict;
+  return rc;
+}
+
+/* Release the buffers of a struct lemon_result */
+void lemon_result_free(struct lemon_result *pResult){
+  free(pResult->zSource);
+  free(pResult->zHeader);
+  free(pResult->zReport);
+  free(pResult->zSql);
+  free(pResult->zTables);
+  free(pResult->zOutput);
+  free(pResult->zErrors);
+  memset(pResult, 0, sizeof(*pResult));
+}
@@ -0,0 +1,89 @@
+/*
+** Interface to the LEMON parser generator when it is used as a library.
+**
+** Compile lemon.c with -DLEMON_NO_MAIN to leave out main() and link the
+** result into another program.  Each call to lemon_generate() is
+** independent of every other.  No global or static variables are used,
+** exit() is never called, no output files are written, and all memory
+** is released before lemon_generate() returns.  So separate calls may
+** run at the same time on different threads.
+*/
+#ifndef LEMON_LIBLEMON_H
+#define LEMON_LIBLEMON_H
+#include <stddef.h>
+
+/*
+** The inputs to lemon_generate().  Fields that are not needed should
+** be zero.  Most of them correspond to a command-line option, as shown.
+*/
+struct lemon_options {
+  const char *zFilename;     /* Name of the grammar file.  Used in messages,
+                             ** #line directives and to look for "*.lt" */
+  const char *zGrammar;      /* Text of the grammar, or NULL to read the
+                             ** file zFilename instead */
+  size_t nGrammar;           /* Number of bytes in zGrammar[] */
+  const char *zTemplate;     /* Text of the parser template, or NULL */
+  size_t nTemplate;          /* Number of bytes in zTemplate[] */
+  const char *zTemplateFile; /* Template file used if zTemplate is NULL (-T) */
+  const char *const *azDefine; /* Names of %ifdef macros (-D) */
+  int nDefine;               /* Number of entries in azDefine[] */
+  int basisflag;             /* Print only the basis in the report (-b) */
+  int noCompress;            /* Do not compress the action table (-c) */
+  int printPreprocessed;     /* Output only the preprocessed input (-E) */
+  int rpflag;                /* Output the grammar without actions (-g) */
+  int nolinenosflag;         /* Do not emit #line directives (-l) */
+  int mhflag;                /* Output a makeheaders compatible file (-m) */
+  int showPrecedenceConflict;  /* Show conflicts resolved by precedence (-p) */
+  int quiet;                 /* Do not generate the report (-q) */
+  int noResort;              /* Do not sort or renumber states (-r) */
+  int statistics;            /* Output parser statistics (-s) */
+  int sqlFlag;               /* Also describe the tables in SQL (-S) */
+  int jsonReport;            /* Write the report as JSON lines (-J) */
+  int sizeReport;            /* Show what contributes to the table sizes (-z) */
+  const char *zQuery;        /* Query an earlier JSON lines report (-Q) */
+  const char *zEncoding;     /* Table encoding: "comb", "dense", "hash",
+                             ** "code", "pair" or "packed" (-e).  NULL
+                             ** means "comb" */
+  int foldFallback;          /* Fold %fallback and %wildcard into the
+                             ** tables (-F) */
+  const char *zDispatch;     /* Reduce dispatch: "switch", "function" or
+                             ** "goto" (-R).  NULL means "switch" */
+  const char *zProfile;      /* Profile written by ParseProfile(), used to
+                             ** order the states and tables (-P) */
+  int blobTables;            /* Write the tables to a binary file (-B) */
+  int sharedEngine;          /* Leave the driver to lemengine.c (-G) */
+  int stackArrays;           /* Keep states and values of the stack in
+                             ** parallel arrays (-A) */
+  int boxSize;               /* Keep the values of types larger than this
+                             ** many bytes out of the stack (-Z), or 0 */
+};
+
+/*
+** The outputs of lemon_generate().  Each buffer is zero-terminated, or
+** is NULL if that output was not produced.  The stand-alone program
+** would have written the same text into a file or onto the terminal.
+*/
+struct lemon_result {
+  char *zSource;  size_t nSource;   /* The parser, normally "*.c" */
+  char *zHeader;  size_t nHeader;   /* Token codes, normally "*.h" */
+  char *zReport;  size_t nReport;   /* The report, "*.out" or "*.jsonl" */
+  char *zSql;     size_t nSql;      /* The tables in SQL, normally "*.sql" */
+  char *zTables;  size_t nTables;   /* Binary tables of -B, "*.tbl" */
+  char *zOutput;  size_t nOutput;   /* Text normally sent to stdout */
+  char *zErrors;  size_t nErrors;   /* Text normally sent to stderr */
+  int nError;                       /* Number of errors seen */
+  int nConflict;                    /* Number of parsing conflicts */
+};
+
+/*
+** Generate a parser.  The return value is the exit code the stand-alone
+** program would have used: 0 on success, and non-zero if there were
+** errors or conflicts.  -1 means memory ran out before anything could
+** start.  The buffers in *pResult must always be released afterwards
+** using lemon_result_free().
+*/
+int lemon_generate(const struct lemon_options *pOpt,
+                   struct lemon_result *pResult);
+void lemon_result_free(struct lemon_result *pResult);
+
+#endif /* LEMON_LIBLEMON_H */
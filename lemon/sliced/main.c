@@ -1,14 +1,8 @@
 /*
-** Main program file for the LEMON parser generator.
+** Main program file for the LEMON parser generator.  Define
+** LEMON_NO_MAIN to omit it and use the library interface instead.
 */
-
-/* Report an out-of-memory condition and abort.  This function
-** is used mostly by the "MemoryCheck" macro in struct.h
-*/
-void memory_error(void){
-  fprintf(stderr,"Out of memory.  Aborting...\n");
-  exit(1);
-}
+#ifndef LEMON_NO_MAIN
 
 static int nDefine = 0;      /* Number of -D options on the command line */
 static char **azDefine = 0;  /* Name of the -D macros */
@@ -47,73 +41,92 @@ static void handle_d_option(char *z){
   lemon_strcpy(outputDir, z);
 }
 
-static char *user_templatename = NULL;
-static void handle_T_option(char *z){
-  user_templatename = (char *) malloc( lemonStrlen(z)+1 );
-  if( user_templatename==0 ){
-    memory_error();
-  }
-  lemon_strcpy(user_templatename, z);
+/* Remember the name of the manifest of grammars for batch mode
+*/
+static char *zManifest = NULL;
+static void handle_M_option(char *z){
+  zManifest = z;
 }
 
-/* Merge together to lists of rules ordered by rule.iRule */
-static struct rule *Rule_merge(struct rule *pA, struct rule *pB){
-  struct rule *pFirst = 0;
-  struct rule **ppPrev = &pFirst;
-  while( pA && pB ){
-    if( pA->iRule<pB->iRule ){
-      *ppPrev = pA;
-      ppPrev = &pA->next;
-      pA = pA->next;
-    }else{
-      *ppPrev = pB;
-      ppPrev = &pB->next;
-      pB = pB->next;
-    }
-  }
-  if( pA ){
-    *ppPrev = pA;
-  }else{
-    *ppPrev = pB;
+/* Remember how many threads to use in batch mode
+*/
+static int nThread = 0;
+static void handle_j_option(char *z){
+  nThread = atoi(z);
+  if( nThread<=0 ){
+    fprintf(stderr,"The -j option requires a positive number of threads.\n");
+    exit(1);
   }
-  return pFirst;
 }
 
-/*
-** Sort a list of rules in order of increasing iRule value
+/* Remember the query for the JSON lines report
 */
-static struct rule *Rule_sort(struct rule *rp){
-  unsigned int i;
-  struct rule *pNext;
-  struct rule *x[32];
-  memset(x, 0, sizeof(x));
-  while( rp ){
-    pNext = rp->next;
-    rp->next = 0;
-    for(i=0; i<sizeof(x)/sizeof(x[0])-1 && x[i]; i++){
-      rp = Rule_merge(x[i], rp);
-      x[i] = 0;
-    }
-    x[i] = rp;
-    rp = pNext;
+static char *zQuery = NULL;
+static void handle_Q_option(char *z){
+  zQuery = z;
+}
+
+/* Remember the encoding of the parser tables
+*/
+static int encoding = ENC_COMB;
+static void handle_e_option(char *z){
+  encoding = encoding_find(z);
+  if( encoding<0 ){
+    fprintf(stderr,"Unknown table encoding \"%s\".  "
+                   "Use comb, dense, hash, code, pair or packed.\n", z);
+    exit(1);
   }
-  rp = 0;
-  for(i=0; i<sizeof(x)/sizeof(x[0]); i++){
-    rp = Rule_merge(x[i], rp);
+}
+
+/* Remember how yy_reduce() reaches the code of each rule
+*/
+static int dispatch = DSP_SWITCH;
+static void handle_R_option(char *z){
+  dispatch = dispatch_find(z);
+  if( dispatch<0 ){
+    fprintf(stderr,"Unknown reduce dispatch \"%s\".  "
+                   "Use switch, function or goto.\n", z);
+    exit(1);
   }
-  return rp;
 }
 
-/* forward reference */
-static const char *minimum_size_type(int lwr, int upr, int *pnByte);
+/* Remember the profile that orders the states
+*/
+static char *zProfile = NULL;
+static void handle_P_option(char *z){
+  zProfile = z;
+}
+
+/* Remember how many translation units to split the parser into
+*/
+static int nUnit = 0;
+static void handle_u_option(char *z){
+  nUnit = atoi(z);
+  if( nUnit<=0 ){
+    fprintf(stderr,"The -u option requires a positive number of units.\n");
+    exit(1);
+  }
+}
 
-/* Print a single line of the "Parser Stats" output
+/* Remember the size above which values leave the stack
 */
-static void stats_line(const char *zLabel, int iValue){
-  int nLabel = lemonStrlen(zLabel);
-  printf("  %s%.*s %5d\n", zLabel,
-         35-nLabel, "................................",
-         iValue);
+static int boxSize = 0;
+static void handle_Z_option(char *z){
+  boxSize = atoi(z);
+  if( boxSize<=0 ){
+    fprintf(stderr,"The -Z option requires a positive number of bytes.\n");
+    exit(1);
+  }
+}
+
+static char *user_templatename = NULL;
+static void handle_T_option(char *z){
+  user_templatename = (char *) malloc( lemonStrlen(z)+1 );
+  if( user_templatename==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  lemon_strcpy(user_templatename, z);
 }
 
 /* The main program.  Parse the command line and do it... */
@@ -129,36 +142,74 @@ int main(int argc, char **argv){
   static int noResort = 0;
   static int sqlFlag = 0;
   static int printPP = 0;
+  static int showPrecedenceConflict = 0;
+  static int watch = 0;
+  static int jsonReport = 0;
+  static int sizeReport = 0;
+  static int foldFallback = 0;
+  static int blobTables = 0;
+  static int sharedEngine = 0;
+  static int stackArrays = 0;
 
   static struct s_options options[] = {
+    {OPT_FLAG, "A", (char*)&stackArrays,
+      "Keep the states and the values of the stack in separate arrays."},
     {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
+    {OPT_FLAG, "B", (char*)&blobTables,
+                    "Write the tables to a binary file (*.tbl)."},
     {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
     {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
     {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
+    {OPT_FSTR, "e", (char*)handle_e_option,
+                    "Table encoding: comb, dense, hash, code, pair or "
+                    "packed.  Default comb"},
     {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
     {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
+    {OPT_FLAG, "F", (char*)&foldFallback,
+                    "Fold %fallback and %wildcard into the tables."},
     {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
+    {OPT_FLAG, "G", (char*)&sharedEngine,
+                    "Leave the parser driver to the shared lemengine.c."},
     {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
+    {OPT_FLAG, "J", (char*)&jsonReport,
+                    "Write the report as JSON lines (*.jsonl)."},
+    {OPT_FSTR, "j", (char*)handle_j_option,
+                    "Threads for batch mode.  Default: one per CPU"},
     {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
+    {OPT_FSTR, "M", (char*)handle_M_option,
+                    "Batch mode: read grammars from a manifest file."},
     {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
     {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
     {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
                     "Show conflicts resolved by precedence rules"},
+    {OPT_FSTR, "P", (char*)handle_P_option,
+                    "Order states and tables by a ParseProfile() file."},
     {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
+    {OPT_FSTR, "Q", (char*)handle_Q_option,
+                    "Query the *.jsonl report.  Try -Qstate=N"},
     {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
+    {OPT_FSTR, "R", (char*)handle_R_option,
+                    "Reduce dispatch: switch, function or goto.  "
+                    "Default switch"},
     {OPT_FLAG, "s", (char*)&statistics,
                                    "Print parser stats to standard output."},
     {OPT_FLAG, "S", (char*)&sqlFlag,
                     "Generate the *.sql file describing the parser tables."},
     {OPT_FLAG, "x", (char*)&version, "Print the version number."},
     {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
+    {OPT_FSTR, "u", (char*)handle_u_option,
+                    "Split the parser into this many source files."},
+    {OPT_FLAG, "w", (char*)&watch, "Watch the input and rebuild on changes."},
     {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
+    {OPT_FLAG, "z", (char*)&sizeReport,
+                    "Show what contributes to the size of the tables."},
+    {OPT_FSTR, "Z", (char*)handle_Z_option,
+                    "Keep values of types over this many bytes out of "
+                    "the stack."},
     {OPT_FLAG,0,0,0}
   };
-  int i;
   int exitcode;
   struct lemon lem;
-  struct rule *rp;
 
   (void)argc;
   OptInit(argv,options,stderr);
@@ -166,126 +217,72 @@ int main(int argc, char **argv){
      printf("Lemon version 1.0\n");
      exit(0);
   }
-  if( OptNArgs()!=1 ){
-    fprintf(stderr,"Exactly one filename argument is required.\n");
-    exit(1);
-  }
   memset(&lem, 0, sizeof(lem));
   lem.errorcnt = 0;
-
-  /* Initialize the machine */
-  Strsafe_init();
-  Symbol_init();
-  State_init();
   lem.argv0 = argv[0];
-  lem.filename = OptArg(0);
   lem.basisflag = basisflag;
   lem.nolinenosflag = nolinenosflag;
   lem.printPreprocessed = printPP;
-  Symbol_new("$");
+  lem.rpflag = rpflag;
+  lem.noCompress = compress;
+  lem.noResort = noResort;
+  lem.quiet = quiet;
+  lem.mhflag = mhflag;
+  lem.sqlFlag = sqlFlag;
+  lem.jsonReport = jsonReport;
+  lem.sizeReport = sizeReport;
+  lem.foldFallback = foldFallback;
+  lem.nUnit = nUnit;
+  lem.encoding = encoding;
+  lem.dispatch = dispatch;
+  lem.zProfile = zProfile;
+  lem.blobTables = blobTables;
+  lem.sharedEngine = sharedEngine;
+  lem.stackArrays = stackArrays;
+  lem.boxSize = boxSize;
+  lem.zQuery = zQuery;
+  lem.statistics = statistics;
+  lem.showPrecedenceConflict = showPrecedenceConflict;
+  lem.nDefine = nDefine;
+  lem.azDefine = azDefine;
+  lem.outputDir = outputDir;
+  lem.templatename = user_templatename;
+  lem.outstream = stdout;
+  lem.errstream = stderr;
 
-  /* Parse the input file */
-  Parse(&lem);
-  if( lem.printPreprocessed || lem.errorcnt ) exit(lem.errorcnt);
-  if( lem.nrule==0 ){
-    fprintf(stderr,"Empty grammar.\n");
+  if( watch && (zManifest || OptNArgs()!=1) ){
+    fprintf(stderr,"Watch mode requires exactly one filename argument.\n");
     exit(1);
   }
-  lem.errsym = Symbol_find("error");
-
-  /* Count and index the symbols of the grammar */
-  Symbol_new("{default}");
-  lem.nsymbol = Symbol_count();
-  lem.symbols = Symbol_arrayof();
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  qsort(lem.symbols,lem.nsymbol,sizeof(struct symbol*), Symbolcmpp);
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  while( lem.symbols[i-1]->type==MULTITERMINAL ){ i--; }
-  assert( strcmp(lem.symbols[i-1]->name,"{default}")==0 );
-  lem.nsymbol = i - 1;
-  for(i=1; ISUPPER(lem.symbols[i]->name[0]); i++);
-  lem.nterminal = i;
-
-  /* Assign sequential rule numbers.  Start with 0.  Put rules that have no
-  ** reduce action C-code associated with them last, so that the switch()
-  ** statement that selects reduction actions will have a smaller jump table.
-  */
-  for(i=0, rp=lem.rule; rp; rp=rp->next){
-    rp->iRule = rp->code ? i++ : -1;
-  }
-  lem.nruleWithAction = i;
-  for(rp=lem.rule; rp; rp=rp->next){
-    if( rp->iRule<0 ) rp->iRule = i++;
+  if( watch && nUnit>1 ){
+    fprintf(stderr,"The -u option cannot be used in watch mode.\n");
+    exit(1);
   }
-  lem.startRule = lem.rule;
-  lem.rule = Rule_sort(lem.rule);
-
-  /* Generate a reprint of the grammar, if requested on the command line */
-  if( rpflag ){
-    Reprint(&lem);
-  }else{
-    /* Initialize the size for all follow and first sets */
-    SetSize(lem.nterminal+1);
 
-    /* Find the precedence for every production rule (that has one) */
-    FindRulePrecedences(&lem);
-
-    /* Compute the lambda-nonterminals and the first-sets for every
-    ** nonterminal */
-    FindFirstSets(&lem);
-
-    /* Compute all LR(0) states.  Also record follow-set propagation
-    ** links so that the follow-set can be computed later */
-    lem.nstate = 0;
-    FindStates(&lem);
-    lem.sorted = State_arrayof();
-
-    /* Tie up loose ends on the propagation links */
-    FindLinks(&lem);
-
-    /* Compute the follow set of every reducible configuration */
-    FindFollowSets(&lem);
-
-    /* Compute the action tables */
-    FindActions(&lem);
-
-    /* Compress the action tables */
-    if( compress==0 ) CompressTables(&lem);
-
-    /* Reorder and renumber the states so that states with fewer choices
-    ** occur at the end.  This is an optimization that helps make the
-    ** generated parser tables smaller. */
-    if( noResort==0 ) ResortStates(&lem);
-
-    /* Generate a report of the parser generated.  (the "y.output" file) */
-    if( !quiet ) ReportOutput(&lem);
-
-    /* Generate the source code for the parser */
-    ReportTable(&lem, mhflag, sqlFlag);
-
-    /* Produce a header file for use by the scanner.  (This step is
-    ** omitted if the "-m" option is used because makeheaders will
-    ** generate the file for us.) */
-    if( !mhflag ) ReportHeader(&lem);
-  }
-  if( statistics ){
-    printf("Parser statistics:\n");
-    stats_line("terminal symbols", lem.nterminal);
-    stats_line("non-terminal symbols", lem.nsymbol - lem.nterminal);
-    stats_line("total symbols", lem.nsymbol);
-    stats_line("rules", lem.nrule);
-    stats_line("states", lem.nxstate);
-    stats_line("conflicts", lem.nconflict);
-    stats_line("action table entries", lem.nactiontab);
-    stats_line("lookahead table entries", lem.nlookaheadtab);
-    stats_line("total table size (bytes)", lem.tablesize);
+  /* Several grammars, or a manifest, select batch mode */
+  if( zManifest || OptNArgs()>1 ){
+    int nFile = OptNArgs();
+    char **azFile = (char**)malloc( sizeof(char*)*(nFile+1) );
+    int i;
+    if( azFile==0 ){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+    for(i=0; i<nFile; i++) azFile[i] = OptArg(i);
+    exit(lemon_batch(&lem, azFile, nFile, zManifest, nThread));
   }
-  if( lem.nconflict > 0 ){
-    fprintf(stderr,"%d parsing conflicts.\n",lem.nconflict);
+  if( OptNArgs()!=1 ){
+    fprintf(stderr,"Exactly one filename argument is required.\n");
+    exit(1);
   }
+  lem.filename = OptArg(0);
+  if( watch ) exit(lemon_watch(&lem));
+
+  exitcode = lemon_run(&lem);
 
-  /* return 0 on success, 1 on failure. */
-  exitcode = ((lem.errorcnt > 0) || (lem.nconflict > 0)) ? 1 : 0;
+  /* The process is about to exit, so there is no need to call
+  ** lemon_free_all() */
   exit(exitcode);
   return (exitcode);
 }
+#endif /* LEMON_NO_MAIN */
@@ -0,0 +1,115 @@
+/*
+** Memory allocation for the LEMON parser generator.
+**
+** Every allocation is linked into a list that belongs to a struct lemon,
+** so that lemon_free_all() can release everything used by a run in one
+** go, even after a fatal error.  The allocators never return NULL.
+** Running out of memory is a fatal error instead.
+*/
+
+/* The header in front of every allocation.  The union keeps the memory
+** that follows it aligned for any type. */
+struct memblock {
+  union {
+    struct {
+      struct memblock *pNext;   /* Next allocation */
+      struct memblock *pPrev;   /* Previous allocation */
+    } link;
+    double rAlign;
+    long iAlign;
+    void *pAlign;
+  } u;
+};
+
+/* Link a newly allocated block into the list for lemp */
+static void *memblock_link(struct lemon *lemp, struct memblock *p){
+  p->u.link.pPrev = 0;
+  p->u.link.pNext = lemp->pMem;
+  if( lemp->pMem ) lemp->pMem->u.link.pPrev = p;
+  lemp->pMem = p;
+  return (void*)&p[1];
+}
+
+/* Allocate n bytes of memory */
+void *lemon_malloc(struct lemon *lemp, size_t n){
+  struct memblock *p;
+  p = (struct memblock*)malloc( sizeof(*p) + n );
+  if( p==0 ) memory_error(lemp);
+  return memblock_link(lemp, p);
+}
+
+/* Allocate zeroed memory for an array of nElem elements of sz bytes */
+void *lemon_calloc(struct lemon *lemp, size_t nElem, size_t sz){
+  void *p;
+  if( sz>0 && nElem>((size_t)-1 - sizeof(struct memblock))/sz ){
+    memory_error(lemp);
+  }
+  p = lemon_malloc(lemp, nElem*sz);
+  memset(p, 0, nElem*sz);
+  return p;
+}
+
+/* Resize an allocation.  pOld may be NULL. */
+void *lemon_realloc(struct lemon *lemp, void *pOld, size_t n){
+  struct memblock *p, *pNew;
+  if( pOld==0 ) return lemon_malloc(lemp, n);
+  p = ((struct memblock*)pOld) - 1;
+  pNew = (struct memblock*)realloc(p, sizeof(*p) + n);
+  if( pNew==0 ) memory_error(lemp);
+  if( pNew!=p ){
+    if( pNew->u.link.pPrev ){
+      pNew->u.link.pPrev->u.link.pNext = pNew;
+    }else{
+      lemp->pMem = pNew;
+    }
+    if( pNew->u.link.pNext ) pNew->u.link.pNext->u.link.pPrev = pNew;
+  }
+  return (void*)&pNew[1];
+}
+
+/* Release a single allocation.  p may be NULL. */
+void lemon_free(struct lemon *lemp, void *pOld){
+  struct memblock *p;
+  if( pOld==0 ) return;
+  p = ((struct memblock*)pOld) - 1;
+  if( p->u.link.pPrev ){
+    p->u.link.pPrev->u.link.pNext = p->u.link.pNext;
+  }else{
+    lemp->pMem = p->u.link.pNext;
+  }
+  if( p->u.link.pNext ) p->u.link.pNext->u.link.pPrev = p->u.link.pPrev;
+  free(p);
+}
+
+/* Make a copy of a string */
+char *lemon_strdup(struct lemon *lemp, const char *z){
+  size_t n = strlen(z) + 1;
+  char *zCopy = (char*)lemon_malloc(lemp, n);
+  memcpy(zCopy, z, n);
+  return zCopy;
+}
+
+/* Release every allocation made on behalf of lemp */
+void lemon_free_all(struct lemon *lemp){
+  struct memblock *p, *pNext;
+  for(p=lemp->pMem; p; p=pNext){
+    pNext = p->u.link.pNext;
+    free(p);
+  }
+  lemp->pMem = 0;
+}
+
+/* Give up on the current run of the parser generator.  Control returns
+** to lemon_run(), which reports the failure.
+*/
+void lemon_fatal(struct lemon *lemp){
+  assert( lemp->pAbort!=0 );
+  longjmp(*lemp->pAbort, 1);
+}
+
+/* Report an out-of-memory condition and abort.
+*/
+void memory_error(struct lemon *lemp){
+  fprintf(lemp->errstream,"Out of memory.  Aborting...\n");
+  lemon_fatal(lemp);
+}
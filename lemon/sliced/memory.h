@@ -0,0 +1,9 @@
+void *lemon_malloc(struct lemon *, size_t);
+void *lemon_calloc(struct lemon *, size_t, size_t);
+void *lemon_realloc(struct lemon *, void *, size_t);
+void lemon_free(struct lemon *, void *);
+char *lemon_strdup(struct lemon *, const char *);
+void lemon_free_all(struct lemon *);
+void memory_error(struct lemon *);
+void lemon_fatal(struct lemon *);
+
@@ -24,15 +24,19 @@ enum e_state {
   WAITING_FOR_DATATYPE_SYMBOL,
   WAITING_FOR_FALLBACK_ID,
   WAITING_FOR_WILDCARD_ID,
+  WAITING_FOR_ARENA_SYMBOL,
   WAITING_FOR_CLASS_ID,
   WAITING_FOR_CLASS_TOKEN,
-  WAITING_FOR_TOKEN_NAME
+  WAITING_FOR_TOKEN_NAME,
+  WAITING_FOR_IMPORT_FILE,
+  WAITING_FOR_EXPORT_NAME
 };
 struct pstate {
   char *filename;       /* Name of the input file */
   int tokenlineno;      /* Linenumber at which current token starts */
   int errorcnt;         /* Number of errors so far */
-  char *tokenstart;     /* Text of current token */
+  const char *tokenstart;  /* Text of current token.  Not zero-terminated */
+  int tokenlen;         /* Number of bytes in the current token */
   struct lemon *gp;     /* Global state vector */
   enum e_state state;        /* The state of the parser */
   struct symbol *fallback;   /* The fallback token */
@@ -44,6 +48,7 @@ struct pstate {
   const char *alias[MAXRHS]; /* Aliases for each RHS symbol (or NULL) */
   struct rule *prevrule;     /* Previous rule parsed */
   const char *declkeyword;   /* Keyword of a declaration */
+  int ndeclkeyword;          /* Number of bytes in declkeyword */
   char **declargslot;        /* Where the declaration argument should be put */
   int insertLineMacro;       /* Add #line before declaration insert */
   int *decllinenoslot;       /* Where to write declaration line number */
@@ -51,16 +56,49 @@ struct pstate {
   int preccounter;           /* Assign this precedence to decl arguments */
   struct rule *firstrule;    /* Pointer to first rule in the grammar */
   struct rule *lastrule;     /* Pointer to the most recently parsed rule */
+  struct gmodule *module;    /* Module being parsed, or NULL */
+  struct rule *mainrule;     /* First rule of the main grammar file */
+  struct file_id mainid;     /* Identity of the main grammar file */
 };
 
+static void parse_import(struct pstate*, const char*, int);
+
+/* Return true if the current token is exactly the text zWord */
+static int tokenIs(const struct pstate *psp, const char *zWord){
+  int n = lemonStrlen(zWord);
+  return psp->tokenlen==n && memcmp(psp->tokenstart, zWord, n)==0;
+}
+
+/* Return the name of the symbol x[0..nx-1] as seen from the file being
+** parsed.  A nonterminal of a module that the module does not export is
+** private to it, so its name is qualified by the prefix of the module.
+*/
+static const char *symbol_name(struct pstate *psp, const char *x, int nx){
+  struct lemon *lemp = psp->gp;
+  struct gmodule *pMod = psp->module;
+  const char *zName = Strsafe_n(lemp,x,nx);
+  char *z;
+  int i;
+  if( pMod==0 || !ISLOWER(x[0]) ) return zName;
+  for(i=0; i<pMod->nExport; i++){
+    if( pMod->azExport[i]==zName ) return zName;
+  }
+  z = (char*)lemon_malloc(lemp, lemonStrlen(pMod->prefix) + nx + 2);
+  lemon_sprintf(z, "%s.%s", pMod->prefix, zName);
+  zName = Strsafe(lemp,z);
+  lemon_free(lemp, z);
+  return zName;
+}
+
 /* Parse a single token */
 static void parseonetoken(struct pstate *psp)
 {
-  const char *x;
-  x = Strsafe(psp->tokenstart);     /* Save the token permanently */
+  struct lemon *lemp = psp->gp;     /* The parser generator */
+  const char *x = psp->tokenstart;  /* Text of the token */
+  int nx = psp->tokenlen;           /* Number of bytes in x[] */
 #if 0
-  printf("%s:%d: Token=[%s] state=%d\n",psp->filename,psp->tokenlineno,
-    x,psp->state);
+  printf("%s:%d: Token=[%.*s] state=%d\n",psp->filename,psp->tokenlineno,
+    nx,x,psp->state);
 #endif
   switch( psp->state ){
     case INITIALIZE:
@@ -73,71 +111,71 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='%' ){
         psp->state = WAITING_FOR_DECL_KEYWORD;
       }else if( ISLOWER(x[0]) ){
-        psp->lhs = Symbol_new(x);
+        psp->lhs = Symbol_new(lemp,symbol_name(psp,x,nx));
         psp->nrhs = 0;
         psp->lhsalias = 0;
         psp->state = WAITING_FOR_ARROW;
       }else if( x[0]=='{' ){
         if( psp->prevrule==0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "There is no prior rule upon which to attach the code "
             "fragment which begins on this line.");
           psp->errorcnt++;
         }else if( psp->prevrule->code!=0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Code fragment beginning on this line is not the first "
             "to follow the previous rule.");
           psp->errorcnt++;
-        }else if( strcmp(x, "{NEVER-REDUCE")==0 ){
+        }else if( tokenIs(psp, "{NEVER-REDUCE") ){
           psp->prevrule->neverReduce = 1;
         }else{
           psp->prevrule->line = psp->tokenlineno;
-          psp->prevrule->code = &x[1];
+          psp->prevrule->code = Strsafe_n(lemp,&x[1], nx-1);
           psp->prevrule->noCode = 0;
         }
       }else if( x[0]=='[' ){
         psp->state = PRECEDENCE_MARK_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Token \"%s\" should be either \"%%\" or a nonterminal name.",
-          x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Token \"%.*s\" should be either \"%%\" or a nonterminal name.",
+          nx, x);
         psp->errorcnt++;
       }
       break;
     case PRECEDENCE_MARK_1:
       if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "The precedence symbol must be a terminal.");
         psp->errorcnt++;
       }else if( psp->prevrule==0 ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "There is no prior rule to assign precedence \"[%s]\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "There is no prior rule to assign precedence \"[%.*s]\".",nx,x);
         psp->errorcnt++;
       }else if( psp->prevrule->precsym!=0 ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Precedence mark on this line is not the first "
           "to follow the previous rule.");
         psp->errorcnt++;
       }else{
-        psp->prevrule->precsym = Symbol_new(x);
+        psp->prevrule->precsym = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }
       psp->state = PRECEDENCE_MARK_2;
       break;
     case PRECEDENCE_MARK_2:
       if( x[0]!=']' ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \"]\" on precedence mark.");
         psp->errorcnt++;
       }
       psp->state = WAITING_FOR_DECL_OR_RULE;
       break;
     case WAITING_FOR_ARROW:
-      if( x[0]==':' && x[1]==':' && x[2]=='=' ){
+      if( tokenIs(psp, "::=") ){
         psp->state = IN_RHS;
       }else if( x[0]=='(' ){
         psp->state = LHS_ALIAS_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Expected to see a \":\" following the LHS symbol \"%s\".",
           psp->lhs->name);
         psp->errorcnt++;
@@ -146,12 +184,12 @@ static void parseonetoken(struct pstate *psp)
       break;
     case LHS_ALIAS_1:
       if( ISALPHA(x[0]) ){
-        psp->lhsalias = x;
+        psp->lhsalias = Strsafe_n(lemp,x,nx);
         psp->state = LHS_ALIAS_2;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "\"%s\" is not a valid alias for the LHS \"%s\"\n",
-          x,psp->lhs->name);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "\"%.*s\" is not a valid alias for the LHS \"%s\"\n",
+          nx,x,psp->lhs->name);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
@@ -160,17 +198,17 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]==')' ){
         psp->state = LHS_ALIAS_3;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \")\" following LHS alias name \"%s\".",psp->lhsalias);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
       break;
     case LHS_ALIAS_3:
-      if( x[0]==':' && x[1]==':' && x[2]=='=' ){
+      if( tokenIs(psp, "::=") ){
         psp->state = IN_RHS;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \"->\" following: \"%s(%s)\".",
            psp->lhs->name,psp->lhsalias);
         psp->errorcnt++;
@@ -180,16 +218,17 @@ static void parseonetoken(struct pstate *psp)
     case IN_RHS:
       if( x[0]=='.' ){
         struct rule *rp;
-        rp = (struct rule *)calloc( sizeof(struct rule) +
+        rp = (struct rule *)lemon_calloc(lemp, sizeof(struct rule) +
              sizeof(struct symbol*)*psp->nrhs + sizeof(char*)*psp->nrhs, 1);
         if( rp==0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Can't allocate enough memory for this rule.");
           psp->errorcnt++;
           psp->prevrule = 0;
         }else{
           int i;
           rp->ruleline = psp->tokenlineno;
+          rp->filename = psp->filename;
           rp->rhs = (struct symbol**)&rp[1];
           rp->rhsalias = (const char**)&(rp->rhs[psp->nrhs]);
           for(i=0; i<psp->nrhs; i++){
@@ -207,6 +246,7 @@ static void parseonetoken(struct pstate *psp)
           rp->nextlhs = rp->lhs->rule;
           rp->lhs->rule = rp;
           rp->next = 0;
+          if( psp->module==0 && psp->mainrule==0 ) psp->mainrule = rp;
           if( psp->firstrule==0 ){
             psp->firstrule = psp->lastrule = rp;
           }else{
@@ -218,55 +258,57 @@ static void parseonetoken(struct pstate *psp)
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( ISALPHA(x[0]) ){
         if( psp->nrhs>=MAXRHS ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Too many symbols on RHS of rule beginning at \"%s\".",
-            x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Too many symbols on RHS of rule beginning at \"%.*s\".",
+            nx, x);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_RULE_ERROR;
         }else{
-          psp->rhs[psp->nrhs] = Symbol_new(x);
+          psp->rhs[psp->nrhs] = Symbol_new(lemp,symbol_name(psp,x,nx));
           psp->alias[psp->nrhs] = 0;
           psp->nrhs++;
         }
-      }else if( (x[0]=='|' || x[0]=='/') && psp->nrhs>0 && ISUPPER(x[1]) ){
+      }else if( (x[0]=='|' || x[0]=='/') && psp->nrhs>0 && nx>1
+             && ISUPPER(x[1]) ){
         struct symbol *msp = psp->rhs[psp->nrhs-1];
         if( msp->type!=MULTITERMINAL ){
           struct symbol *origsp = msp;
-          msp = (struct symbol *) calloc(1,sizeof(*msp));
-          memset(msp, 0, sizeof(*msp));
+          msp = (struct symbol *) lemon_calloc(lemp, 1, sizeof(*msp));
           msp->type = MULTITERMINAL;
           msp->nsubsym = 1;
-          msp->subsym = (struct symbol **) calloc(1,sizeof(struct symbol*));
+          msp->subsym = (struct symbol **) lemon_calloc(lemp, 1,
+                                                   sizeof(struct symbol*));
           msp->subsym[0] = origsp;
           msp->name = origsp->name;
           psp->rhs[psp->nrhs-1] = msp;
         }
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(lemp, msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
-        msp->subsym[msp->nsubsym-1] = Symbol_new(&x[1]);
+        msp->subsym[msp->nsubsym-1] =
+                               Symbol_new(lemp,Strsafe_n(lemp,&x[1],nx-1));
         if( ISLOWER(x[1]) || ISLOWER(msp->subsym[0]->name[0]) ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
             "Cannot form a compound containing a non-terminal");
           psp->errorcnt++;
         }
       }else if( x[0]=='(' && psp->nrhs>0 ){
         psp->state = RHS_ALIAS_1;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal character on RHS of rule: \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal character on RHS of rule: \"%.*s\".",nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
       break;
     case RHS_ALIAS_1:
       if( ISALPHA(x[0]) ){
-        psp->alias[psp->nrhs-1] = x;
+        psp->alias[psp->nrhs-1] = Strsafe_n(lemp,x,nx);
         psp->state = RHS_ALIAS_2;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "\"%s\" is not a valid alias for the RHS symbol \"%s\"\n",
-          x,psp->rhs[psp->nrhs-1]->name);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "\"%.*s\" is not a valid alias for the RHS symbol \"%s\"\n",
+          nx,x,psp->rhs[psp->nrhs-1]->name);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
       }
@@ -275,7 +317,7 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]==')' ){
         psp->state = IN_RHS;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Missing \")\" following LHS alias name \"%s\".",psp->lhsalias);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_RULE_ERROR;
@@ -284,96 +326,115 @@ static void parseonetoken(struct pstate *psp)
     case WAITING_FOR_DECL_KEYWORD:
       if( ISALPHA(x[0]) ){
         psp->declkeyword = x;
+        psp->ndeclkeyword = nx;
         psp->declargslot = 0;
         psp->decllinenoslot = 0;
         psp->insertLineMacro = 1;
         psp->state = WAITING_FOR_DECL_ARG;
-        if( strcmp(x,"name")==0 ){
+        if( tokenIs(psp,"name") ){
           psp->declargslot = &(psp->gp->name);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"include")==0 ){
+        }else if( tokenIs(psp,"include") ){
           psp->declargslot = &(psp->gp->include);
-        }else if( strcmp(x,"code")==0 ){
+        }else if( tokenIs(psp,"code") ){
           psp->declargslot = &(psp->gp->extracode);
-        }else if( strcmp(x,"token_destructor")==0 ){
+        }else if( tokenIs(psp,"token_destructor") ){
           psp->declargslot = &psp->gp->tokendest;
-        }else if( strcmp(x,"default_destructor")==0 ){
+        }else if( tokenIs(psp,"default_destructor") ){
           psp->declargslot = &psp->gp->vardest;
-        }else if( strcmp(x,"token_prefix")==0 ){
+        }else if( tokenIs(psp,"token_prefix") ){
           psp->declargslot = &psp->gp->tokenprefix;
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"syntax_error")==0 ){
+        }else if( tokenIs(psp,"syntax_error") ){
           psp->declargslot = &(psp->gp->error);
-        }else if( strcmp(x,"parse_accept")==0 ){
+        }else if( tokenIs(psp,"parse_accept") ){
           psp->declargslot = &(psp->gp->accept);
-        }else if( strcmp(x,"parse_failure")==0 ){
+        }else if( tokenIs(psp,"parse_failure") ){
           psp->declargslot = &(psp->gp->failure);
-        }else if( strcmp(x,"stack_overflow")==0 ){
+        }else if( tokenIs(psp,"stack_overflow") ){
           psp->declargslot = &(psp->gp->overflow);
-        }else if( strcmp(x,"extra_argument")==0 ){
+        }else if( tokenIs(psp,"extra_argument") ){
           psp->declargslot = &(psp->gp->arg);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"extra_context")==0 ){
+        }else if( tokenIs(psp,"extra_context") ){
           psp->declargslot = &(psp->gp->ctx);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"token_type")==0 ){
+        }else if( tokenIs(psp,"token_type") ){
           psp->declargslot = &(psp->gp->tokentype);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"default_type")==0 ){
+        }else if( tokenIs(psp,"default_type") ){
           psp->declargslot = &(psp->gp->vartype);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"stack_size")==0 ){
+        }else if( tokenIs(psp,"stack_size") ){
           psp->declargslot = &(psp->gp->stacksize);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"start_symbol")==0 ){
+        }else if( tokenIs(psp,"start_symbol") ){
           psp->declargslot = &(psp->gp->start);
           psp->insertLineMacro = 0;
-        }else if( strcmp(x,"left")==0 ){
+        }else if( tokenIs(psp,"left") ){
           psp->preccounter++;
           psp->declassoc = LEFT;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"right")==0 ){
+        }else if( tokenIs(psp,"right") ){
           psp->preccounter++;
           psp->declassoc = RIGHT;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"nonassoc")==0 ){
+        }else if( tokenIs(psp,"nonassoc") ){
           psp->preccounter++;
           psp->declassoc = NONE;
           psp->state = WAITING_FOR_PRECEDENCE_SYMBOL;
-        }else if( strcmp(x,"destructor")==0 ){
+        }else if( tokenIs(psp,"destructor") ){
           psp->state = WAITING_FOR_DESTRUCTOR_SYMBOL;
-        }else if( strcmp(x,"type")==0 ){
+        }else if( tokenIs(psp,"type") ){
           psp->state = WAITING_FOR_DATATYPE_SYMBOL;
-        }else if( strcmp(x,"fallback")==0 ){
+        }else if( tokenIs(psp,"fallback") ){
           psp->fallback = 0;
           psp->state = WAITING_FOR_FALLBACK_ID;
-        }else if( strcmp(x,"token")==0 ){
+        }else if( tokenIs(psp,"token") ){
           psp->state = WAITING_FOR_TOKEN_NAME;
-        }else if( strcmp(x,"wildcard")==0 ){
+        }else if( tokenIs(psp,"wildcard") ){
           psp->state = WAITING_FOR_WILDCARD_ID;
-        }else if( strcmp(x,"token_class")==0 ){
+        }else if( tokenIs(psp,"arena") ){
+          psp->gp->has_arena = 1;
+          psp->state = WAITING_FOR_ARENA_SYMBOL;
+        }else if( tokenIs(psp,"token_class") ){
           psp->state = WAITING_FOR_CLASS_ID;
+        }else if( tokenIs(psp,"import") ){
+          psp->state = WAITING_FOR_IMPORT_FILE;
+        }else if( tokenIs(psp,"export") ){
+          psp->state = WAITING_FOR_EXPORT_NAME;
         }else{
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Unknown declaration keyword: \"%%%s\".",x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Unknown declaration keyword: \"%%%.*s\".",nx,x);
+          psp->errorcnt++;
+          psp->state = RESYNC_AFTER_DECL_ERROR;
+        }
+        /* A module may add C code, but the settings of the parser as a
+        ** whole belong to the main grammar file */
+        if( psp->module && psp->declargslot
+         && psp->declargslot!=&psp->gp->include
+         && psp->declargslot!=&psp->gp->extracode ){
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "The %%%.*s directive is not allowed in a module.",nx,x);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_DECL_ERROR;
         }
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal declaration keyword: \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal declaration keyword: \"%.*s\".",nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
       break;
     case WAITING_FOR_DESTRUCTOR_SYMBOL:
       if( !ISALPHA(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Symbol name missing after %%destructor keyword");
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,symbol_name(psp,x,nx));
+        if( sp->destLineno==0 ) sp->destFilename = psp->filename;
         psp->declargslot = &sp->destructor;
         psp->decllinenoslot = &sp->destLineno;
         psp->insertLineMacro = 1;
@@ -382,20 +443,21 @@ static void parseonetoken(struct pstate *psp)
       break;
     case WAITING_FOR_DATATYPE_SYMBOL:
       if( !ISALPHA(x[0]) ){
-        ErrorMsg(psp->filename,psp->tokenlineno,
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
           "Symbol name missing after %%type keyword");
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        struct symbol *sp = Symbol_find(x);
+        const char *zName = symbol_name(psp,x,nx);
+        struct symbol *sp = Symbol_find(lemp,zName);
         if((sp) && (sp->datatype)){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Symbol %%type \"%s\" already defined", x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Symbol %%type \"%s\" already defined", zName);
           psp->errorcnt++;
           psp->state = RESYNC_AFTER_DECL_ERROR;
         }else{
           if (!sp){
-            sp = Symbol_new(x);
+            sp = Symbol_new(lemp,zName);
           }
           psp->declargslot = &sp->datatype;
           psp->insertLineMacro = 0;
@@ -408,18 +470,18 @@ static void parseonetoken(struct pstate *psp)
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( ISUPPER(x[0]) ){
         struct symbol *sp;
-        sp = Symbol_new(x);
+        sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( sp->prec>=0 ){
-          ErrorMsg(psp->filename,psp->tokenlineno,
-            "Symbol \"%s\" has already be given a precedence.",x);
+          ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+            "Symbol \"%s\" has already be given a precedence.",sp->name);
           psp->errorcnt++;
         }else{
           sp->prec = psp->preccounter;
           sp->assoc = psp->declassoc;
         }
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Can't assign a precedence to \"%s\".",x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Can't assign a precedence to \"%.*s\".",nx,x);
         psp->errorcnt++;
       }
       break;
@@ -431,8 +493,8 @@ static void parseonetoken(struct pstate *psp)
         int addLineMacro;
         char zLine[50];
         zNew = x;
-        if( zNew[0]=='"' || zNew[0]=='{' ) zNew++;
-        nNew = lemonStrlen(zNew);
+        nNew = nx;
+        if( zNew[0]=='"' || zNew[0]=='{' ){ zNew++; nNew--; }
         if( *psp->declargslot ){
           zOld = *psp->declargslot;
         }else{
@@ -452,7 +514,8 @@ static void parseonetoken(struct pstate *psp)
           nLine = lemonStrlen(zLine);
           n += nLine + lemonStrlen(psp->filename) + nBack;
         }
-        *psp->declargslot = (char *) realloc(*psp->declargslot, n);
+        *psp->declargslot = (char *) lemon_realloc(lemp,
+                                                   *psp->declargslot, n);
         zBuf = *psp->declargslot + nOld;
         if( addLineMacro ){
           if( nOld && zBuf[-1]!='\n' ){
@@ -478,8 +541,9 @@ static void parseonetoken(struct pstate *psp)
         *zBuf = 0;
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else{
-        ErrorMsg(psp->filename,psp->tokenlineno,
-          "Illegal argument to %%%s: %s",psp->declkeyword,x);
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "Illegal argument to %%%.*s: %.*s",
+          psp->ndeclkeyword,psp->declkeyword,nx,x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
@@ -488,16 +552,16 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%fallback argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%fallback argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( psp->fallback==0 ){
           psp->fallback = sp;
         }else if( sp->fallback ){
-          ErrorMsg(psp->filename, psp->tokenlineno,
-            "More than one fallback assigned to token %s", x);
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "More than one fallback assigned to token %s", sp->name);
           psp->errorcnt++;
         }else{
           sp->fallback = psp->fallback;
@@ -518,44 +582,55 @@ static void parseonetoken(struct pstate *psp)
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        (void)Symbol_new(x);
+        (void)Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }
       break;
     case WAITING_FOR_WILDCARD_ID:
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
       }else if( !ISUPPER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%wildcard argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%wildcard argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
       }else{
-        struct symbol *sp = Symbol_new(x);
+        struct symbol *sp = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
         if( psp->gp->wildcard==0 ){
           psp->gp->wildcard = sp;
         }else{
-          ErrorMsg(psp->filename, psp->tokenlineno,
-            "Extra wildcard to token: %s", x);
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "Extra wildcard to token: %s", sp->name);
           psp->errorcnt++;
         }
       }
       break;
+    case WAITING_FOR_ARENA_SYMBOL:
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISLOWER(x[0]) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%arena argument \"%.*s\" should be a nonterminal", nx, x);
+        psp->errorcnt++;
+      }else{
+        Symbol_new(lemp,symbol_name(psp,x,nx))->bArena = 1;
+      }
+      break;
     case WAITING_FOR_CLASS_ID:
       if( !ISLOWER(x[0]) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token_class must be followed by an identifier: %s", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token_class must be followed by an identifier: %.*s", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
-     }else if( Symbol_find(x) ){
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "Symbol \"%s\" already used", x);
+     }else if( Symbol_find(lemp,symbol_name(psp,x,nx)) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "Symbol \"%.*s\" already used", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }else{
-        psp->tkclass = Symbol_new(x);
+        psp->tkclass = Symbol_new(lemp,symbol_name(psp,x,nx));
         psp->tkclass->type = MULTITERMINAL;
         psp->state = WAITING_FOR_CLASS_TOKEN;
       }
@@ -563,20 +638,53 @@ static void parseonetoken(struct pstate *psp)
     case WAITING_FOR_CLASS_TOKEN:
       if( x[0]=='.' ){
         psp->state = WAITING_FOR_DECL_OR_RULE;
-      }else if( ISUPPER(x[0]) || ((x[0]=='|' || x[0]=='/') && ISUPPER(x[1])) ){
+      }else if( ISUPPER(x[0])
+             || ((x[0]=='|' || x[0]=='/') && nx>1 && ISUPPER(x[1])) ){
         struct symbol *msp = psp->tkclass;
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(lemp, msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
-        if( !ISUPPER(x[0]) ) x++;
-        msp->subsym[msp->nsubsym-1] = Symbol_new(x);
+        if( !ISUPPER(x[0]) ){ x++; nx--; }
+        msp->subsym[msp->nsubsym-1] = Symbol_new(lemp,Strsafe_n(lemp,x,nx));
       }else{
-        ErrorMsg(psp->filename, psp->tokenlineno,
-          "%%token_class argument \"%s\" should be a token", x);
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%token_class argument \"%.*s\" should be a token", nx, x);
         psp->errorcnt++;
         psp->state = RESYNC_AFTER_DECL_ERROR;
       }
       break;
+    case WAITING_FOR_IMPORT_FILE:
+      if( x[0]!='"' || nx<2 ){
+        ErrorMsg(lemp,psp->filename,psp->tokenlineno,
+          "%%import must be followed by the name of a file in quotes");
+        psp->errorcnt++;
+        psp->state = RESYNC_AFTER_DECL_ERROR;
+      }else{
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+        parse_import(psp, &x[1], nx-1);
+      }
+      break;
+    case WAITING_FOR_EXPORT_NAME:
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISLOWER(x[0]) ){
+        ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+          "%%export argument \"%.*s\" should be a nonterminal", nx, x);
+        psp->errorcnt++;
+      }else if( psp->module ){
+        struct gmodule *pMod = psp->module;
+        const char *zName = Strsafe_n(lemp,x,nx);
+        const char *zPrivate = symbol_name(psp,x,nx);
+        if( zPrivate!=zName && Symbol_find(lemp,zPrivate) ){
+          ErrorMsg(lemp,psp->filename, psp->tokenlineno,
+            "Nonterminal \"%s\" is used before it is exported", zName);
+          psp->errorcnt++;
+        }
+        pMod->azExport = (const char**)lemon_realloc(lemp, pMod->azExport,
+                                   sizeof(pMod->azExport[0])*(pMod->nExport+1));
+        pMod->azExport[pMod->nExport++] = zName;
+      }
+      break;
     case RESYNC_AFTER_RULE_ERROR:
 /*      if( x[0]=='.' ) psp->state = WAITING_FOR_DECL_OR_RULE;
 **      break; */
@@ -588,28 +696,34 @@ static void parseonetoken(struct pstate *psp)
 }
 
 /* The text in the input is part of the argument to an %ifdef or %ifndef.
-** Evaluate the text as a boolean expression.  Return true or false.
+** Evaluate the n bytes of text in z[] as a boolean expression.  Return
+** true or false.
 */
-static int eval_preprocessor_boolean(char *z, int lineno){
+static int eval_preprocessor_boolean(
+  struct lemon *lemp,   /* The parser generator */
+  const char *z,        /* Text of the expression */
+  int n,                /* Number of bytes in z[] */
+  int lineno            /* Line number, or -1 for a nested expression */
+){
   int neg = 0;
   int res = 0;
   int okTerm = 1;
   int i;
-  for(i=0; z[i]!=0; i++){
+  for(i=0; i<n; i++){
     if( ISSPACE(z[i]) ) continue;
     if( z[i]=='!' ){
       if( !okTerm ) goto pp_syntax_error;
       neg = !neg;
       continue;
     }
-    if( z[i]=='|' && z[i+1]=='|' ){
+    if( z[i]=='|' && i+1<n && z[i+1]=='|' ){
       if( okTerm ) goto pp_syntax_error;
       if( res ) return 1;
       i++;
       okTerm = 1;
       continue;
     }
-    if( z[i]=='&' && z[i+1]=='&' ){
+    if( z[i]=='&' && i+1<n && z[i+1]=='&' ){
       if( okTerm ) goto pp_syntax_error;
       if( !res ) return 0;
       i++;
@@ -618,15 +732,13 @@ static int eval_preprocessor_boolean(char *z, int lineno){
     }
     if( z[i]=='(' ){
       int k;
-      int n = 1;
+      int nParen = 1;
       if( !okTerm ) goto pp_syntax_error;
-      for(k=i+1; z[k]; k++){
+      for(k=i+1; k<n; k++){
         if( z[k]==')' ){
-          n--;
-          if( n==0 ){
-            z[k] = 0;
-            res = eval_preprocessor_boolean(&z[i+1], -1);
-            z[k] = ')';
+          nParen--;
+          if( nParen==0 ){
+            res = eval_preprocessor_boolean(lemp, &z[i+1], k-i-1, -1);
             if( res<0 ){
               i = i-res;
               goto pp_syntax_error;
@@ -635,10 +747,7 @@ static int eval_preprocessor_boolean(char *z, int lineno){
             break;
           }
         }else if( z[k]=='(' ){
-          n++;
-        }else if( z[k]==0 ){
-          i = k;
-          goto pp_syntax_error;
+          nParen++;
         }
       }
       if( neg ){
@@ -649,13 +758,14 @@ static int eval_preprocessor_boolean(char *z, int lineno){
       continue;
     }
     if( ISALPHA(z[i]) ){
-      int j, k, n;
+      int j, k, nName;
       if( !okTerm ) goto pp_syntax_error;
-      for(k=i+1; ISALNUM(z[k]) || z[k]=='_'; k++){}
-      n = k - i;
+      for(k=i+1; k<n && (ISALNUM(z[k]) || z[k]=='_'); k++){}
+      nName = k - i;
       res = 0;
-      for(j=0; j<nDefine; j++){
-        if( strncmp(azDefine[j],&z[i],n)==0 && azDefine[j][n]==0 ){
+      for(j=0; j<lemp->nDefine; j++){
+        const char *zDef = lemp->azDefine[j];
+        if( strncmp(zDef,&z[i],nName)==0 && zDef[nName]==0 ){
           res = 1;
           break;
         }
@@ -674,167 +784,357 @@ static int eval_preprocessor_boolean(char *z, int lineno){
 
 pp_syntax_error:
   if( lineno>0 ){
-    fprintf(stderr, "%%if syntax error on line %d.\n", lineno);
-    fprintf(stderr, "  %.*s <-- syntax error here\n", i+1, z);
-    exit(1);
+    fprintf(lemp->errstream, "%%if syntax error on line %d.\n", lineno);
+    fprintf(lemp->errstream, "  %.*s <-- syntax error here\n", i+1, z);
+    lemon_fatal(lemp);
+    return 0;
   }else{
     return -(i+1);
   }
 }
 
-/* Run the preprocessor over the input file text.  The global variables
-** azDefine[0] through azDefine[nDefine-1] contains the names of all defined
-** macros.  This routine looks for "%ifdef" and "%ifndef" and "%endif" and
-** comments them out.  Text in between is also commented out as appropriate.
+/*
+** A span of input text that the preprocessor has removed.  The
+** text is never modified.  Instead, the scanner treats each span as
+** white space, keeping only the newlines for the sake of line numbers.
+*/
+struct pp_span {
+  size_t iStart;        /* Offset of the first byte removed */
+  size_t iEnd;          /* Offset of the first byte past the span */
+};
+
+/* Sort spans by their starting offset */
+static int pp_span_cmp(const void *a, const void *b){
+  const struct pp_span *p1 = (const struct pp_span*)a;
+  const struct pp_span *p2 = (const struct pp_span*)b;
+  if( p1->iStart<p2->iStart ) return -1;
+  return p1->iStart>p2->iStart;
+}
+
+/* Record text z[iStart..iEnd-1] as removed by the preprocessor */
+static void pp_span_add(
+  struct lemon *lemp,       /* The parser generator */
+  struct pp_span **paSpan,  /* The array of spans */
+  int *pnSpan,              /* Number of entries in *paSpan */
+  size_t iStart,            /* First byte of the removed text */
+  size_t iEnd               /* First byte past the removed text */
+){
+  if( iEnd<=iStart ) return;
+  if( ((*pnSpan) & 31)==0 ){
+    *paSpan = (struct pp_span*)lemon_realloc(lemp, *paSpan,
+                                  sizeof(struct pp_span)*((*pnSpan)+32));
+  }
+  (*paSpan)[*pnSpan].iStart = iStart;
+  (*paSpan)[*pnSpan].iEnd = iEnd;
+  (*pnSpan)++;
+}
+
+/* Return true if z[i..n-1] begins with the directive zDirective */
+static int pp_directive(const char *z, size_t n, size_t i, const char *zDir){
+  size_t nDir = (size_t)lemonStrlen(zDir);
+  return n-i>=nDir && memcmp(&z[i], zDir, nDir)==0;
+}
+
+/* Run the preprocessor over the n bytes of input file text in z[].  The
+** lemp->azDefine[0] through lemp->azDefine[lemp->nDefine-1] contain the
+** names of all defined macros.  This routine looks for "%ifdef" and
+** "%ifndef" and "%endif" and marks them as removed.  Text in between is
+** also removed as appropriate.
+**
+** The input text is not changed.  The removed text is written into
+** *paSpan as an array of non-overlapping spans sorted by offset.  The
+** number of spans is returned.
 */
-static void preprocess_input(char *z){
-  int i, j, k;
+static int preprocess_input(
+  struct lemon *lemp,       /* The parser generator */
+  const char *z,            /* Text of the input file */
+  size_t n,                 /* Number of bytes in z[] */
+  struct pp_span **paSpan   /* OUT: Spans of text removed */
+){
+  size_t i, j;
+  size_t start = 0;
   int exclude = 0;
-  int start = 0;
   int lineno = 1;
   int start_lineno = 1;
-  for(i=0; z[i]; i++){
+  int nSpan = 0;
+  int k;
+  *paSpan = 0;
+  for(i=0; i<n; i++){
     if( z[i]=='\n' ) lineno++;
     if( z[i]!='%' || (i>0 && z[i-1]!='\n') ) continue;
-    if( strncmp(&z[i],"%endif",6)==0 && ISSPACE(z[i+6]) ){
+    if( pp_directive(z,n,i,"%endif") && i+6<n && ISSPACE(z[i+6]) ){
       if( exclude ){
         exclude--;
-        if( exclude==0 ){
-          for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
-        }
+        if( exclude==0 ) pp_span_add(lemp, paSpan, &nSpan, start, i);
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
-    }else if( strncmp(&z[i],"%else",5)==0 && ISSPACE(z[i+5]) ){
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
+    }else if( pp_directive(z,n,i,"%else") && i+5<n && ISSPACE(z[i+5]) ){
       if( exclude==1){
         exclude = 0;
-        for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
+        pp_span_add(lemp, paSpan, &nSpan, start, i);
       }else if( exclude==0 ){
         exclude = 1;
         start = i;
         start_lineno = lineno;
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
-    }else if( strncmp(&z[i],"%ifdef ",7)==0
-          || strncmp(&z[i],"%if ",4)==0
-          || strncmp(&z[i],"%ifndef ",8)==0 ){
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
+    }else if( pp_directive(z,n,i,"%ifdef ")
+          || pp_directive(z,n,i,"%if ")
+          || pp_directive(z,n,i,"%ifndef ") ){
       if( exclude ){
         exclude++;
       }else{
         int isNot;
-        int iBool;
-        for(j=i; z[j] && !ISSPACE(z[j]); j++){}
+        size_t iBool;
+        for(j=i; j<n && !ISSPACE(z[j]); j++){}
         iBool = j;
         isNot = (j==i+7);
-        while( z[j] && z[j]!='\n' ){ j++; }
-        k = z[j];
-        z[j] = 0;
-        exclude = eval_preprocessor_boolean(&z[iBool], lineno);
-        z[j] = k;
+        while( j<n && z[j]!='\n' ){ j++; }
+        exclude = eval_preprocessor_boolean(lemp, &z[iBool], (int)(j-iBool),
+                                            lineno);
         if( !isNot ) exclude = !exclude;
         if( exclude ){
           start = i;
           start_lineno = lineno;
         }
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
+      for(j=i; j<n && z[j]!='\n'; j++){}
+      pp_span_add(lemp, paSpan, &nSpan, i, j);
     }
   }
   if( exclude ){
-    fprintf(stderr,"unterminated %%ifdef starting on line %d\n", start_lineno);
-    exit(1);
+    fprintf(lemp->errstream,"unterminated %%ifdef starting on line %d\n",
+            start_lineno);
+    lemon_fatal(lemp);
+  }
+
+  /* Directives inside of excluded text produce spans that overlap the
+  ** excluded text itself.  Sort the spans and merge the overlaps. */
+  if( nSpan>1 ){
+    qsort(*paSpan, nSpan, sizeof(struct pp_span), pp_span_cmp);
+    for(i=1, k=0; i<(size_t)nSpan; i++){
+      struct pp_span *pPrev = &(*paSpan)[k];
+      if( (*paSpan)[i].iStart<=pPrev->iEnd ){
+        if( (*paSpan)[i].iEnd>pPrev->iEnd ) pPrev->iEnd = (*paSpan)[i].iEnd;
+      }else{
+        (*paSpan)[++k] = (*paSpan)[i];
+      }
+    }
+    nSpan = k+1;
   }
+  return nSpan;
 }
 
-/* In spite of its name, this function is really a scanner.  It read
-** in the entire input file (all at once) then tokenizes it.  Each
-** token is passed to the function "parseonetoken" which builds all
-** the appropriate data structures in the global state vector "gp".
+/* Make a copy of the n bytes of text in z[] in which every span removed
+** by the preprocessor is overwritten by spaces.  The copy is zero
+** terminated.  This is the slow path, used only when removed text falls
+** in the middle of a token or comment.
 */
-void Parse(struct lemon *gp)
-{
-  struct pstate ps;
-  FILE *fp;
-  char *filebuf;
-  unsigned int filesize;
-  int lineno;
-  int c;
-  char *cp, *nextcp;
-  int startline = 0;
-
-  memset(&ps, '\0', sizeof(ps));
-  ps.gp = gp;
-  ps.filename = gp->filename;
-  ps.errorcnt = 0;
-  ps.state = INITIALIZE;
+static char *pp_blank_copy(
+  struct lemon *lemp,
+  const char *z,
+  size_t n,
+  const struct pp_span *aSpan,
+  int nSpan
+){
+  char *zCopy;
+  size_t j;
+  int i;
+  zCopy = (char *)lemon_malloc(lemp, n+1 );
+  memcpy(zCopy, z, n);
+  zCopy[n] = 0;
+  for(i=0; i<nSpan; i++){
+    for(j=aSpan[i].iStart; j<aSpan[i].iEnd; j++){
+      if( zCopy[j]!='\n' ) zCopy[j] = ' ';
+    }
+  }
+  return zCopy;
+}
 
-  /* Begin by reading the input file */
-  fp = fopen(ps.filename,"rb");
-  if( fp==0 ){
-    ErrorMsg(ps.filename,0,"Can't open this file for reading.");
-    gp->errorcnt++;
-    return;
+/*
+** Bring the complete text of the file zName into memory for reading.  The
+** size of the file in bytes is written into *pnByte.  The file is memory
+** mapped where the operating system allows it, so that large grammars do
+** not have to be copied into the heap.  Otherwise, or if the mapping
+** fails, the file is read into memory obtained from malloc().  *pbMapped
+** is set to tell file_unmap() which of the two happened.
+**
+** The text returned is read-only and is not zero-terminated.  Return
+** NULL if the file cannot be opened or read.
+*/
+static char *file_map(const char *zName, size_t *pnByte, int *pbMapped){
+  FILE *fp;
+  char *z;
+  size_t n;
+  long sz;
+#ifndef __WIN32__
+  int fd;
+  struct stat st;
+  fd = open(zName, O_RDONLY);
+  if( fd<0 ) return 0;
+  if( fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0 ){
+    z = (char *)mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if( z!=(char *)MAP_FAILED ){
+      close(fd);
+      *pnByte = (size_t)st.st_size;
+      *pbMapped = 1;
+      return z;
+    }
   }
+  close(fd);
+#endif
+  *pbMapped = 0;
+  fp = fopen(zName,"rb");
+  if( fp==0 ) return 0;
   fseek(fp,0,2);
-  filesize = ftell(fp);
+  sz = ftell(fp);
   rewind(fp);
-  filebuf = (char *)malloc( filesize+1 );
-  if( filesize>100000000 || filebuf==0 ){
-    ErrorMsg(ps.filename,0,"Input file too large.");
-    free(filebuf);
-    gp->errorcnt++;
+  if( sz<0 ){
     fclose(fp);
-    return;
+    return 0;
   }
-  if( fread(filebuf,1,filesize,fp)!=filesize ){
-    ErrorMsg(ps.filename,0,"Can't read in all %d bytes of this file.",
-      filesize);
-    free(filebuf);
-    gp->errorcnt++;
+  n = (size_t)sz;
+  z = (char *)malloc( n+1 );
+  if( z==0 || fread(z,1,n,fp)!=n ){
+    free(z);
     fclose(fp);
-    return;
+    return 0;
   }
   fclose(fp);
-  filebuf[filesize] = 0;
+  *pnByte = n;
+  return z;
+}
 
-  /* Make an initial pass through the file to handle %ifdef and %ifndef */
-  preprocess_input(filebuf);
-  if( gp->printPreprocessed ){
-    printf("%s\n", filebuf);
+/* Find the identity of the file zName.  p->ok is false if the file
+** cannot be found, or if the operating system has no inode numbers.
+*/
+static void file_identify(const char *zName, struct file_id *p){
+#ifndef __WIN32__
+  struct stat st;
+  if( stat(zName, &st)==0 ){
+    p->dev = (unsigned long)st.st_dev;
+    p->ino = (unsigned long)st.st_ino;
+    p->ok = 1;
     return;
   }
+#endif
+  (void)zName;
+  p->dev = p->ino = 0;
+  p->ok = 0;
+}
+
+/* True if the files with identities p1 and p2, named z1 and z2, are the
+** same file.  The names are compared when the identities are unknown.
+*/
+static int file_same(const struct file_id *p1, const char *z1,
+                     const struct file_id *p2, const char *z2){
+  if( p1->ok && p2->ok ) return p1->dev==p2->dev && p1->ino==p2->ino;
+  return strcmp(z1, z2)==0;
+}
+
+/* Release the memory obtained from file_map() */
+static void file_unmap(char *z, size_t n, int bMapped){
+#ifndef __WIN32__
+  if( bMapped ){
+    munmap(z, n);
+    return;
+  }
+#endif
+  (void)n;
+  (void)bMapped;
+  free(z);
+}
+
+/* Release the input file brought into memory by Parse(), if any.  This
+** is also used to clean up after a fatal error.
+*/
+void file_release_input(struct lemon *lemp){
+  struct gmodule *pMod;
+  if( lemp->pInputMap ){
+    file_unmap(lemp->pInputMap, lemp->nInputMap, lemp->bInputMapped);
+    lemp->pInputMap = 0;
+  }
+  for(pMod=lemp->pModule; pMod; pMod=pMod->next){
+    if( pMod->pMap ){
+      file_unmap(pMod->pMap, pMod->nMap, pMod->bMapped);
+      pMod->pMap = 0;
+    }
+  }
+}
+
+/* Break the n bytes of text in zText[] into tokens, skipping the spans
+** in aSpan[] that the preprocessor removed, and hand each token to
+** parseonetoken().  This is the scanner for the grammar file and for
+** every module that it imports.
+*/
+static void parse_text(
+  struct pstate *psp,         /* The parser state */
+  const char *zText,          /* Text to be scanned */
+  size_t n,                   /* Number of bytes in zText[] */
+  struct pp_span *aSpan,      /* Spans removed by the preprocessor */
+  int nSpan                   /* Number of entries in aSpan[] */
+){
+  struct lemon *gp = psp->gp;
+  char *zBlank = 0;           /* Copy of zText[] with removed text blanked */
+  const char *zEnd = &zText[n];  /* One byte past the end of zText[] */
+  const char *zItem;          /* Start of the current token or comment */
+  int iSpan = 0;              /* Next span to be skipped */
+  int isToken;                /* True if zItem is a token, not a comment */
+  int lineno;
+  int itemlineno;
+  int c;
+  const char *cp, *nextcp;
+  int startline = 0;
 
   /* Now scan the text of the input file */
   lineno = 1;
-  for(cp=filebuf; (c= *cp)!=0; ){
+  for(cp=zText; cp<zEnd; ){
+    if( iSpan<nSpan && cp>=&zText[aSpan[iSpan].iStart] ){
+      /* Skip over text removed by the preprocessor */
+      for(; cp<&zText[aSpan[iSpan].iEnd]; cp++){
+        if( *cp=='\n' ) lineno++;
+      }
+      iSpan++;
+      continue;
+    }
+    zItem = cp;
+    itemlineno = lineno;
+    c = *cp;
     if( c=='\n' ) lineno++;              /* Keep track of the line number */
     if( ISSPACE(c) ){ cp++; continue; }  /* Skip all white space */
-    if( c=='/' && cp[1]=='/' ){          /* Skip C++ style comments */
+    if( c=='/' && cp+1<zEnd && cp[1]=='/' ){  /* Skip C++ style comments */
       cp+=2;
-      while( (c= *cp)!=0 && c!='\n' ) cp++;
-      continue;
+      while( cp<zEnd && *cp!='\n' ) cp++;
+      nextcp = cp;
+      isToken = 0;
+      goto check_span;
     }
-    if( c=='/' && cp[1]=='*' ){          /* Skip C style comments */
+    if( c=='/' && cp+1<zEnd && cp[1]=='*' ){  /* Skip C style comments */
       cp+=2;
-      while( (c= *cp)!=0 && (c!='/' || cp[-1]!='*') ){
+      while( cp<zEnd && ((c= *cp)!='/' || cp[-1]!='*') ){
         if( c=='\n' ) lineno++;
         cp++;
       }
-      if( c ) cp++;
-      continue;
+      if( cp<zEnd ) cp++;
+      nextcp = cp;
+      isToken = 0;
+      goto check_span;
     }
-    ps.tokenstart = cp;                /* Mark the beginning of the token */
-    ps.tokenlineno = lineno;           /* Linenumber on which token begins */
+    psp->tokenstart = cp;                /* Mark the beginning of the token */
+    psp->tokenlineno = lineno;           /* Linenumber on which token begins */
     if( c=='\"' ){                     /* String literals */
       cp++;
-      while( (c= *cp)!=0 && c!='\"' ){
+      while( cp<zEnd && (c= *cp)!='\"' ){
         if( c=='\n' ) lineno++;
         cp++;
       }
-      if( c==0 ){
-        ErrorMsg(ps.filename,startline,
+      if( cp>=zEnd ){
+        ErrorMsg(gp,psp->filename,startline,
             "String starting on this line is not terminated before "
             "the end of the file.");
-        ps.errorcnt++;
+        psp->errorcnt++;
         nextcp = cp;
       }else{
         nextcp = cp+1;
@@ -842,64 +1142,257 @@ void Parse(struct lemon *gp)
     }else if( c=='{' ){               /* A block of C code */
       int level;
       cp++;
-      for(level=1; (c= *cp)!=0 && (level>1 || c!='}'); cp++){
+      for(level=1; cp<zEnd && ((c= *cp)!='}' || level>1); cp++){
         if( c=='\n' ) lineno++;
         else if( c=='{' ) level++;
         else if( c=='}' ) level--;
-        else if( c=='/' && cp[1]=='*' ){  /* Skip comments */
+        else if( c=='/' && cp+1<zEnd && cp[1]=='*' ){  /* Skip comments */
           int prevc;
           cp = &cp[2];
           prevc = 0;
-          while( (c= *cp)!=0 && (c!='/' || prevc!='*') ){
+          while( cp<zEnd && ((c= *cp)!='/' || prevc!='*') ){
             if( c=='\n' ) lineno++;
             prevc = c;
             cp++;
           }
-        }else if( c=='/' && cp[1]=='/' ){  /* Skip C++ style comments too */
+        }else if( c=='/' && cp+1<zEnd && cp[1]=='/' ){  /* C++ comments */
           cp = &cp[2];
-          while( (c= *cp)!=0 && c!='\n' ) cp++;
-          if( c ) lineno++;
+          while( cp<zEnd && *cp!='\n' ) cp++;
+          if( cp<zEnd ) lineno++;
         }else if( c=='\'' || c=='\"' ){    /* String a character literals */
           int startchar, prevc;
           startchar = c;
           prevc = 0;
-          for(cp++; (c= *cp)!=0 && (c!=startchar || prevc=='\\'); cp++){
+          for(cp++; cp<zEnd && ((c= *cp)!=startchar || prevc=='\\'); cp++){
             if( c=='\n' ) lineno++;
             if( prevc=='\\' ) prevc = 0;
             else              prevc = c;
           }
         }
       }
-      if( c==0 ){
-        ErrorMsg(ps.filename,ps.tokenlineno,
+      if( cp>=zEnd ){
+        ErrorMsg(gp,psp->filename,psp->tokenlineno,
           "C code starting on this line is not terminated before "
           "the end of the file.");
-        ps.errorcnt++;
+        psp->errorcnt++;
+        cp = zEnd;
         nextcp = cp;
       }else{
         nextcp = cp+1;
       }
     }else if( ISALNUM(c) ){          /* Identifiers */
-      while( (c= *cp)!=0 && (ISALNUM(c) || c=='_') ) cp++;
+      while( cp<zEnd && (ISALNUM(*cp) || *cp=='_') ) cp++;
       nextcp = cp;
-    }else if( c==':' && cp[1]==':' && cp[2]=='=' ){ /* The operator "::=" */
-      cp += 3;
+    }else if( c==':' && cp+2<zEnd && cp[1]==':' && cp[2]=='=' ){
+      cp += 3;                       /* The operator "::=" */
       nextcp = cp;
-    }else if( (c=='/' || c=='|') && ISALPHA(cp[1]) ){
+    }else if( (c=='/' || c=='|') && cp+1<zEnd && ISALPHA(cp[1]) ){
       cp += 2;
-      while( (c = *cp)!=0 && (ISALNUM(c) || c=='_') ) cp++;
+      while( cp<zEnd && (ISALNUM(*cp) || *cp=='_') ) cp++;
       nextcp = cp;
     }else{                          /* All other (one character) operators */
       cp++;
       nextcp = cp;
     }
-    c = *cp;
-    *cp = 0;                        /* Null terminate the token */
-    parseonetoken(&ps);             /* Parse the token */
-    *cp = (char)c;                  /* Restore the buffer */
+    psp->tokenlen = (int)(cp - psp->tokenstart);
+    isToken = 1;
+
+check_span:
+    if( iSpan<nSpan && nextcp>&zText[aSpan[iSpan].iStart] ){
+      /* Text removed by the preprocessor begins in the middle of this
+      ** token or comment.  Fall back to scanning a copy of the input
+      ** in which all removed text has been blanked out, starting over
+      ** from the beginning of the token or comment. */
+      zBlank = pp_blank_copy(gp, zText, (size_t)(zEnd-zText), aSpan, nSpan);
+      cp = &zBlank[zItem-zText];
+      zEnd = &zBlank[zEnd-zText];
+      zText = zBlank;
+      lineno = itemlineno;
+      iSpan = nSpan;
+      continue;
+    }
+    if( isToken ) parseonetoken(psp);  /* Parse the token */
     cp = nextcp;
   }
-  free(filebuf);                    /* Release the buffer after parsing */
+  lemon_free(gp, zBlank);
+}
+
+/* Read the grammar module named by the n bytes of zName[], for %import.
+** A relative name is taken to be relative to the directory of the file
+** that imports it.  Each module is read only once, however often it is
+** imported and under whatever name, so a module may import another one
+** that imports it back.  Files are told apart by their device and inode
+** numbers, so that "sub/a.y", "./sub/a.y" and "sub/../sub/a.y" are all
+** the same module.
+** The rules and declarations of the module are added to the grammar
+** exactly as if they had been written in place of the %import.
+*/
+static void parse_import(struct pstate *psp, const char *zName, int n){
+  struct lemon *gp = psp->gp;
+  struct gmodule *pMod, **ppLast;
+  struct pstate saved;
+  struct file_id id;
+  const char *zBase, *zEnd;
+  struct pp_span *aSpan;
+  int nSpan, nDir, i, j, nPrefix;
+  char *z;
+
+  /* Work out the name of the module file */
+  nDir = 0;
+  if( zName[0]!='/' ){
+    for(i=0; psp->filename[i]; i++){
+      if( psp->filename[i]=='/' ) nDir = i+1;
+    }
+  }
+  z = (char*)lemon_malloc(gp, nDir + n + 1);
+  memcpy(z, psp->filename, nDir);
+  memcpy(&z[nDir], zName, n);
+  z[nDir+n] = 0;
+  file_identify(z, &id);
+  if( file_same(&id, z, &psp->mainid, gp->filename) ){
+    lemon_free(gp, z);
+    return;
+  }
+  for(ppLast=&gp->pModule; *ppLast; ppLast=&(*ppLast)->next){
+    if( file_same(&id, z, &(*ppLast)->id, (*ppLast)->filename) ){
+      lemon_free(gp, z);
+      return;
+    }
+  }
+  pMod = (struct gmodule*)lemon_calloc(gp, 1, sizeof(*pMod));
+  pMod->filename = z;
+  pMod->id = id;
+  *ppLast = pMod;
+
+  /* The prefix of the private nonterminals is the base name of the file,
+  ** made into a lower-case identifier and made unique */
+  zBase = strrchr(z, '/');
+  zBase = zBase ? zBase+1 : z;
+  for(nPrefix=0; zBase[nPrefix] && zBase[nPrefix]!='.'; nPrefix++){}
+  pMod->prefix = (char*)lemon_malloc(gp, nPrefix + 20);
+  pMod->prefix[0] = 'm';
+  j = ISALPHA(zBase[0]) ? 0 : 1;
+  for(i=0; i<nPrefix; i++){
+    char c = zBase[i];
+    pMod->prefix[j++] = ISALNUM(c) ? (char)tolower(c) : '_';
+  }
+  pMod->prefix[j] = 0;
+  for(i=2; ; i++){
+    struct gmodule *pOther;
+    for(pOther=gp->pModule; pOther!=pMod; pOther=pOther->next){
+      if( strcmp(pOther->prefix, pMod->prefix)==0 ) break;
+    }
+    if( pOther==pMod ) break;
+    lemon_sprintf(&pMod->prefix[j], "%d", i);
+  }
+
+  /* Bring the module into memory and run the preprocessor over it */
+  pMod->pMap = file_map(z, &pMod->nMap, &pMod->bMapped);
+  if( pMod->pMap==0 ){
+    ErrorMsg(gp,psp->filename,psp->tokenlineno,
+      "Can't open module \"%s\" for reading.", z);
+    psp->errorcnt++;
+    return;
+  }
+  zEnd = memchr(pMod->pMap, 0, pMod->nMap);
+  if( zEnd==0 ) zEnd = &pMod->pMap[pMod->nMap];
+  nSpan = preprocess_input(gp, pMod->pMap, (size_t)(zEnd-pMod->pMap), &aSpan);
+
+  /* Parse the module, then carry on with the file that imported it */
+  saved = *psp;
+  psp->filename = z;
+  psp->module = pMod;
+  psp->prevrule = 0;
+  psp->state = WAITING_FOR_DECL_OR_RULE;
+  parse_text(psp, pMod->pMap, (size_t)(zEnd-pMod->pMap), aSpan, nSpan);
+  if( psp->state!=WAITING_FOR_DECL_OR_RULE ){
+    ErrorMsg(gp,z,psp->tokenlineno,
+      "The module ends in the middle of a rule or declaration.");
+    psp->errorcnt++;
+  }
+  psp->filename = saved.filename;
+  psp->module = saved.module;
+  psp->tokenstart = saved.tokenstart;
+  psp->tokenlen = saved.tokenlen;
+  psp->tokenlineno = saved.tokenlineno;
+  psp->prevrule = 0;
+  psp->state = WAITING_FOR_DECL_OR_RULE;
+  lemon_free(gp, aSpan);
+  file_unmap(pMod->pMap, pMod->nMap, pMod->bMapped);
+  pMod->pMap = 0;
+}
+
+/* In spite of its name, this function is really a scanner.  It brings
+** in the entire input file (all at once) then tokenizes it.  Each
+** token is passed to the function "parseonetoken" which builds all
+** the appropriate data structures in the global state vector "gp".
+**
+** The input is never modified.  Tokens are handed to parseonetoken() as
+** a pointer and length into the file text, and text removed by %ifdef
+** is skipped over rather than being blanked out.
+*/
+void Parse(struct lemon *gp)
+{
+  struct pstate ps;
+  char *filebuf;              /* Text of the input file, if read here */
+  size_t filesize;            /* Number of bytes in filebuf[] */
+  int isMapped;               /* True if filebuf[] is memory mapped */
+  const char *zText;          /* Text being scanned */
+  const char *zEnd;           /* One byte past the end of zText[] */
+  struct pp_span *aSpan;      /* Spans removed by the preprocessor */
+  int nSpan;                  /* Number of entries in aSpan[] */
+  int iSpan;
+
+  memset(&ps, '\0', sizeof(ps));
+  ps.gp = gp;
+  ps.filename = gp->filename;
+  ps.errorcnt = 0;
+  ps.state = INITIALIZE;
+
+  /* Begin by bringing the input file into memory, unless the text of
+  ** the grammar has been supplied by the caller */
+  if( gp->zGrammar ){
+    zText = gp->zGrammar;
+    filesize = gp->nGrammar;
+  }else{
+    filebuf = file_map(ps.filename, &filesize, &isMapped);
+    if( filebuf==0 ){
+      ErrorMsg(gp,ps.filename,0,"Can't open this file for reading.");
+      gp->errorcnt++;
+      return;
+    }
+    gp->pInputMap = filebuf;
+    gp->nInputMap = filesize;
+    gp->bInputMapped = isMapped;
+    zText = filebuf;
+  }
+  zEnd = memchr(zText, 0, filesize);  /* Text ends at the first NUL, if any */
+  if( zEnd==0 ) zEnd = &zText[filesize];
+
+  /* Make an initial pass through the file to handle %ifdef and %ifndef */
+  nSpan = preprocess_input(gp, zText, (size_t)(zEnd-zText), &aSpan);
+  if( gp->printPreprocessed ){
+    size_t i = 0;
+    FILE *out = gp->outstream;
+    for(iSpan=0; iSpan<nSpan; iSpan++){
+      fwrite(&zText[i], 1, aSpan[iSpan].iStart-i, out);
+      for(i=aSpan[iSpan].iStart; i<aSpan[iSpan].iEnd; i++){
+        putc(zText[i]=='\n' ? '\n' : ' ', out);
+      }
+    }
+    fwrite(&zText[i], 1, (size_t)(zEnd-zText)-i, out);
+    putc('\n', out);
+    lemon_free(gp, aSpan);
+    file_release_input(gp);
+    return;
+  }
+
+  /* Now scan the text of the input file */
+  if( gp->zGrammar==0 ) file_identify(ps.filename, &ps.mainid);
+  parse_text(&ps, zText, (size_t)(zEnd-zText), aSpan, nSpan);
+  lemon_free(gp, aSpan);
+  file_release_input(gp);           /* Release the input file */
   gp->rule = ps.firstrule;
+  gp->startRule = ps.mainrule;
   gp->errorcnt = ps.errorcnt;
 }
@@ -1,2 +1,3 @@
 void Parse(struct lemon *lemp);
+void file_release_input(struct lemon *lemp);
 
@@ -2,34 +2,30 @@
 ** Routines processing configuration follow-set propagation links
 ** in the LEMON parser generator.
 */
-static struct plink *plink_freelist = 0;
 
 /* Allocate a new plink */
-struct plink *Plink_new(void){
+struct plink *Plink_new(struct lemon *lemp){
   struct plink *newlink;
 
-  if( plink_freelist==0 ){
+  if( lemp->plinkFreelist==0 ){
     int i;
     int amt = 100;
-    plink_freelist = (struct plink *)calloc( amt, sizeof(struct plink) );
-    if( plink_freelist==0 ){
-      fprintf(stderr,
-      "Unable to allocate memory for a new follow-set propagation link.\n");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) plink_freelist[i].next = &plink_freelist[i+1];
-    plink_freelist[amt-1].next = 0;
+    struct plink *a;
+    a = (struct plink *)lemon_calloc(lemp, amt, sizeof(struct plink) );
+    for(i=0; i<amt-1; i++) a[i].next = &a[i+1];
+    a[amt-1].next = 0;
+    lemp->plinkFreelist = a;
   }
-  newlink = plink_freelist;
-  plink_freelist = plink_freelist->next;
+  newlink = lemp->plinkFreelist;
+  lemp->plinkFreelist = newlink->next;
   return newlink;
 }
 
 /* Add a plink to a plink list */
-void Plink_add(struct plink **plpp, struct config *cfp)
+void Plink_add(struct lemon *lemp, struct plink **plpp, struct config *cfp)
 {
   struct plink *newlink;
-  newlink = Plink_new();
+  newlink = Plink_new(lemp);
   newlink->next = *plpp;
   *plpp = newlink;
   newlink->cfp = cfp;
@@ -48,14 +44,14 @@ void Plink_copy(struct plink **to, struct plink *from)
 }
 
 /* Delete every plink on the list */
-void Plink_delete(struct plink *plp)
+void Plink_delete(struct lemon *lemp, struct plink *plp)
 {
   struct plink *nextpl;
 
   while( plp ){
     nextpl = plp->next;
-    plp->next = plink_freelist;
-    plink_freelist = plp;
+    plp->next = lemp->plinkFreelist;
+    lemp->plinkFreelist = plp;
     plp = nextpl;
   }
 }
@@ -1,5 +1,5 @@
-struct plink *Plink_new(void);
-void Plink_add(struct plink **, struct config *);
+struct plink *Plink_new(struct lemon *);
+void Plink_add(struct lemon *, struct plink **, struct config *);
 void Plink_copy(struct plink **, struct plink *);
-void Plink_delete(struct plink *);
+void Plink_delete(struct lemon *, struct plink *);
 
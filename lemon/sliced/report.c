@@ -3,14 +3,15 @@
 */
 
 /* Generate a filename with the given suffix.  Space to hold the
-** name comes from malloc() and must be freed by the calling
+** name comes from lemon_malloc() and must be freed by the calling
 ** function.
 */
-PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
+char *file_makename(struct lemon *lemp, const char *suffix)
 {
   char *name;
   char *cp;
   char *filename = lemp->filename;
+  char *outputDir = lemp->outputDir;
   int sz;
 
   if( outputDir ){
@@ -21,11 +22,7 @@ PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
   sz += lemonStrlen(suffix);
   if( outputDir ) sz += lemonStrlen(outputDir) + 1;
   sz += 5;
-  name = (char*)malloc( sz );
-  if( name==0 ){
-    fprintf(stderr,"Can't allocate space for a filename.\n");
-    exit(1);
-  }
+  name = (char*)lemon_malloc(lemp, sz );
   name[0] = 0;
   if( outputDir ){
     lemon_strcpy(name, outputDir);
@@ -38,9 +35,109 @@ PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
   return name;
 }
 
+/* Start capturing output in memory.  Return the stream to write to,
+** or NULL if the stream cannot be created.
+*/
+FILE *memfile_open(struct memfile *p){
+  free(p->z);
+  p->z = 0;
+  p->n = 0;
+#ifdef __WIN32__
+  p->fp = tmpfile();
+#else
+  p->fp = open_memstream(&p->z, &p->n);
+#endif
+  return p->fp;
+}
+
+/* Finish capturing output in memory.  Afterwards, p->z holds the
+** zero-terminated text written to the stream and p->n is its length.
+*/
+void memfile_close(struct memfile *p){
+  if( p->fp==0 ) return;
+#ifdef __WIN32__
+  {
+    long sz;
+    fflush(p->fp);
+    fseek(p->fp,0,2);
+    sz = ftell(p->fp);
+    rewind(p->fp);
+    p->z = (char*)malloc( sz>0 ? sz+1 : 1 );
+    if( p->z ){
+      p->n = sz>0 ? fread(p->z, 1, (size_t)sz, p->fp) : 0;
+      p->z[p->n] = 0;
+    }
+  }
+#endif
+  fclose(p->fp);
+  p->fp = 0;
+}
+
+/* Return the slot in lemp->aMemfile[] for an output file suffix */
+PRIVATE int memfile_slot(const char *suffix){
+  static const char *azSuffix[] = { ".c", ".h", ".out", ".sql" };
+  int i;
+  for(i=0; i<(int)(sizeof(azSuffix)/sizeof(azSuffix[0])); i++){
+    if( strcmp(suffix, azSuffix[i])==0 ) return i;
+  }
+  if( strcmp(suffix, ".jsonl")==0 ) return MEMFILE_REPORT;
+  if( strcmp(suffix, ".tbl")==0 ) return MEMFILE_TABLES;
+  return -1;
+}
+
+/* Remember that the stream fp is open, so that it can be closed if the
+** run is abandoned because of a fatal error.  Return fp.
+*/
+PRIVATE FILE *file_track(struct lemon *lemp, FILE *fp){
+  int i;
+  if( fp==0 ) return 0;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i]==0 ){
+      lemp->apOpen[i] = fp;
+      break;
+    }
+  }
+  assert( lemp->apOpen[i]==fp );
+  return fp;
+}
+
+/* Close a stream obtained from file_open() or tplt_open() */
+void file_close(struct lemon *lemp, FILE *fp){
+  int i;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i]==fp ) lemp->apOpen[i] = 0;
+  }
+  if( lemp->aMemfile ){
+    for(i=0; i<MEMFILE_COUNT; i++){
+      if( lemp->aMemfile[i].fp==fp ){
+        memfile_close(&lemp->aMemfile[i]);
+        return;
+      }
+    }
+  }
+  fclose(fp);
+}
+
+/* Close every stream that is still open and release the input file.
+** Nothing is left open after a run that completes normally, so this
+** only does work after a fatal error.
+*/
+void file_close_all(struct lemon *lemp){
+  int i;
+  for(i=0; i<(int)(sizeof(lemp->apOpen)/sizeof(lemp->apOpen[0])); i++){
+    if( lemp->apOpen[i] ) file_close(lemp, lemp->apOpen[i]);
+  }
+  file_release_input(lemp);
+}
+
 /* Open a file with a name based on the name of the input file,
 ** but with a different (specified) suffix, and return a pointer
-** to the stream */
+** to the stream.
+**
+** If output is being captured in memory, the stream writes into the
+** appropriate lemp->aMemfile[] slot instead, and there is never an
+** existing file to read.
+*/
 PRIVATE FILE *file_open(
   struct lemon *lemp,
   const char *suffix,
@@ -48,15 +145,21 @@ PRIVATE FILE *file_open(
 ){
   FILE *fp;
 
-  if( lemp->outname ) free(lemp->outname);
+  if( lemp->outname ) lemon_free(lemp, lemp->outname);
   lemp->outname = file_makename(lemp, suffix);
-  fp = fopen(lemp->outname,mode);
+  if( lemp->aMemfile ){
+    int i = memfile_slot(suffix);
+    if( *mode!='w' || i<0 ) return 0;
+    fp = memfile_open(&lemp->aMemfile[i]);
+  }else{
+    fp = fopen(lemp->outname,mode);
+  }
   if( fp==0 && *mode=='w' ){
-    fprintf(stderr,"Can't open file \"%s\".\n",lemp->outname);
+    fprintf(lemp->errstream,"Can't open file \"%s\".\n",lemp->outname);
     lemp->errorcnt++;
     return 0;
   }
-  return fp;
+  return file_track(lemp, fp);
 }
 
 /* Print the text of a rule
@@ -87,7 +190,8 @@ void Reprint(struct lemon *lemp)
   struct rule *rp;
   struct symbol *sp;
   int i, j, maxlen, len, ncolumns, skip;
-  printf("// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
+  FILE *out = lemp->outstream;
+  fprintf(out,"// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
   maxlen = 10;
   for(i=0; i<lemp->nsymbol; i++){
     sp = lemp->symbols[i];
@@ -98,20 +202,20 @@ void Reprint(struct lemon *lemp)
   if( ncolumns<1 ) ncolumns = 1;
   skip = (lemp->nsymbol + ncolumns - 1)/ncolumns;
   for(i=0; i<skip; i++){
-    printf("//");
+    fprintf(out,"//");
     for(j=i; j<lemp->nsymbol; j+=skip){
       sp = lemp->symbols[j];
       assert( sp->index==j );
-      printf(" %3d %-*.*s",j,maxlen,maxlen,sp->name);
+      fprintf(out," %3d %-*.*s",j,maxlen,maxlen,sp->name);
     }
-    printf("\n");
+    fprintf(out,"\n");
   }
   for(rp=lemp->rule; rp; rp=rp->next){
-    rule_print(stdout, rp);
-    printf(".");
-    if( rp->precsym ) printf(" [%s]",rp->precsym->name);
+    rule_print(out, rp);
+    fprintf(out,".");
+    if( rp->precsym ) fprintf(out," [%s]",rp->precsym->name);
     /* if( rp->code ) printf("\n    %s",rp->code); */
-    printf("\n");
+    fprintf(out,"\n");
   }
 }
 
@@ -182,6 +286,7 @@ char *tag;
 ** nothing was actually printed.
 */
 int PrintAction(
+  struct lemon *lemp,         /* The parser generator */
   struct action *ap,          /* The action to print */
   FILE *fp,                   /* Print the action here */
   int indent                  /* Indent by this amount */
@@ -221,7 +326,7 @@ int PrintAction(
         indent,ap->sp->name,ap->x.stp->statenum);
       break;
     case SH_RESOLVED:
-      if( showPrecedenceConflict ){
+      if( lemp->showPrecedenceConflict ){
         fprintf(fp,"%*s shift        %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.stp->statenum);
       }else{
@@ -229,7 +334,7 @@ int PrintAction(
       }
       break;
     case RD_RESOLVED:
-      if( showPrecedenceConflict ){
+      if( lemp->showPrecedenceConflict ){
         fprintf(fp,"%*s reduce %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.rp->iRule);
       }else{
@@ -283,7 +388,7 @@ void ReportOutput(struct lemon *lemp)
     }
     fprintf(fp,"\n");
     for(ap=stp->ap; ap; ap=ap->next){
-      if( PrintAction(ap,fp,30) ) fprintf(fp,"\n");
+      if( PrintAction(lemp,ap,fp,30) ) fprintf(fp,"\n");
     }
     fprintf(fp,"\n");
   }
@@ -342,13 +447,411 @@ void ReportOutput(struct lemon *lemp)
     }
     fprintf(fp,"\n");
   }
-  fclose(fp);
+  file_close(lemp, fp);
   return;
 }
 
+/* Write zText to fp as a JSON string */
+PRIVATE void json_string(FILE *fp, const char *zText){
+  putc('"', fp);
+  for(; *zText; zText++){
+    unsigned char c = (unsigned char)*zText;
+    if( c=='"' || c=='\\' ){
+      fprintf(fp, "\\%c", c);
+    }else if( c<0x20 ){
+      fprintf(fp, "\\u%04x", c);
+    }else{
+      putc(c, fp);
+    }
+  }
+  putc('"', fp);
+}
+
+/* Write the right-hand side of a rule as a JSON array of symbol names.
+** The alternatives of a multi-terminal are separated by '|'.
+*/
+PRIVATE void json_rhs(FILE *fp, struct rule *rp){
+  int i, j;
+  putc('[', fp);
+  for(i=0; i<rp->nrhs; i++){
+    struct symbol *sp = rp->rhs[i];
+    if( i>0 ) putc(',', fp);
+    if( sp->type==MULTITERMINAL ){
+      putc('"', fp);
+      for(j=0; j<sp->nsubsym; j++){
+        fprintf(fp, "%s%s", j ? "|" : "", sp->subsym[j]->name);
+      }
+      putc('"', fp);
+    }else{
+      fprintf(fp, "\"%s\"", sp->name);
+    }
+  }
+  putc(']', fp);
+}
+
+/* Write a list of integers as a JSON array */
+PRIVATE void json_int_array(FILE *fp, const long *a, int n){
+  int i;
+  putc('[', fp);
+  for(i=0; i<n; i++) fprintf(fp, i ? ",%ld" : "%ld", a[i]);
+  putc(']', fp);
+}
+
+/* Generate the report in JSON lines format, "*.jsonl".  This holds the
+** same information as the "*.out" file, as one JSON object per line:
+** the grammar, then every symbol, rule and state.  Next comes an index
+** line, holding the byte offset of every symbol, rule and state line,
+** the states with conflicts, and the states that reduce each rule.
+** The last line is exactly JSON_TRAILER_SIZE bytes long and holds the
+** offset of the index line, so that a reader can find any record
+** without reading the whole file.
+*/
+#define JSON_TRAILER_SIZE 31
+void ReportJson(struct lemon *lemp)
+{
+  static const char *azAssoc[] = { "left", "right", "nonassoc", 0 };
+  FILE *fp;
+  long *aSymOfst, *aRuleOfst, *aStateOfst, *aConflict;
+  long **aaReduce;      /* aaReduce[R] lists the states that reduce rule R */
+  int *anReduce;        /* Number of entries in each aaReduce[] */
+  int nConflict = 0;
+  long iIndex;
+  struct rule *rp;
+  int i, j, n;
+
+  fp = file_open(lemp,".jsonl","wb");
+  if( fp==0 ) return;
+  aSymOfst = (long*)lemon_calloc(lemp, lemp->nsymbol+1, sizeof(long));
+  aRuleOfst = (long*)lemon_calloc(lemp, lemp->nrule+1, sizeof(long));
+  aStateOfst = (long*)lemon_calloc(lemp, lemp->nxstate+1, sizeof(long));
+  aConflict = (long*)lemon_calloc(lemp, lemp->nxstate+1, sizeof(long));
+  aaReduce = (long**)lemon_calloc(lemp, lemp->nrule+1, sizeof(long*));
+  anReduce = (int*)lemon_calloc(lemp, lemp->nrule+1, sizeof(int));
+
+  fprintf(fp, "{\"type\":\"grammar\",\"file\":");
+  json_string(fp, lemp->filename);
+  fprintf(fp, ",\"name\":\"%s\",\"symbols\":%d,\"terminals\":%d,"
+              "\"rules\":%d,\"states\":%d,\"conflicts\":%d}\n",
+          lemp->name ? lemp->name : "Parse", lemp->nsymbol, lemp->nterminal,
+          lemp->nrule, lemp->nxstate, lemp->nconflict);
+
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    aSymOfst[i] = ftell(fp);
+    fprintf(fp, "{\"type\":\"symbol\",\"id\":%d,\"name\":\"%s\","
+                "\"terminal\":%s,\"content\":%s",
+            i, sp->name, i<lemp->nterminal ? "true" : "false",
+            sp->bContent ? "true" : "false");
+    if( sp->prec>=0 ){
+      fprintf(fp, ",\"prec\":%d", sp->prec);
+      if( azAssoc[sp->assoc] ) fprintf(fp, ",\"assoc\":\"%s\"",
+                                       azAssoc[sp->assoc]);
+    }
+    if( i>=lemp->nterminal ){
+      fprintf(fp, ",\"lambda\":%s,\"first\":[", sp->lambda ? "true":"false");
+      for(j=0, n=0; j<lemp->nterminal; j++){
+        if( sp->firstset && SetFind(sp->firstset, j) ){
+          fprintf(fp, "%s\"%s\"", n++ ? "," : "", lemp->symbols[j]->name);
+        }
+      }
+      fprintf(fp, "]");
+    }
+    fprintf(fp, "}\n");
+  }
+
+  for(rp=lemp->rule; rp; rp=rp->next){
+    aRuleOfst[rp->iRule] = ftell(fp);
+    fprintf(fp, "{\"type\":\"rule\",\"id\":%d,\"lhs\":\"%s\",\"rhs\":",
+            rp->iRule, rp->lhs->name);
+    json_rhs(fp, rp);
+    fprintf(fp, ",\"line\":%d", rp->ruleline);
+    if( rp->precsym ) fprintf(fp, ",\"prec\":\"%s\"", rp->precsym->name);
+    fprintf(fp, "}\n");
+  }
+
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    struct config *cfp;
+    struct action *ap;
+    int bConflict = 0;
+    aStateOfst[i] = ftell(fp);
+    fprintf(fp, "{\"type\":\"state\",\"id\":%d,\"configs\":[", stp->statenum);
+    for(cfp = lemp->basisflag ? stp->bp : stp->cfp; cfp;
+        cfp = lemp->basisflag ? cfp->bp : cfp->next){
+      fprintf(fp, "[%d,%d]%s", cfp->rp->iRule, cfp->dot,
+              (lemp->basisflag ? cfp->bp : cfp->next) ? "," : "");
+    }
+    fprintf(fp, "],\"actions\":[");
+    for(j=0, ap=stp->ap; ap; ap=ap->next){
+      const char *zAct;
+      int iArg = -1;
+      const char *zArg = "state";
+      int bDrop = 0;
+      switch( ap->type ){
+        case SHIFT:        zAct = "shift";   iArg = ap->x.stp->statenum; break;
+        case SSCONFLICT:   zAct = "shift";   iArg = ap->x.stp->statenum;
+                           bConflict = 1;                               break;
+        case SH_RESOLVED:  zAct = "shift";   iArg = ap->x.stp->statenum;
+                           bDrop = 1;                                   break;
+        case REDUCE:       zAct = "reduce";  break;
+        case SHIFTREDUCE:  zAct = "shift-reduce";                       break;
+        case SRCONFLICT:
+        case RRCONFLICT:   zAct = "reduce";  bConflict = 1;             break;
+        case RD_RESOLVED:  zAct = "reduce";  bDrop = 1;                 break;
+        case ACCEPT:       zAct = "accept";  break;
+        case ERROR:        zAct = "error";   break;
+        default:           zAct = 0;         break;
+      }
+      if( zAct==0 ) continue;
+      if( ap->type==REDUCE || ap->type==SHIFTREDUCE || ap->type==SRCONFLICT
+       || ap->type==RRCONFLICT || ap->type==RD_RESOLVED ){
+        rp = ap->x.rp;
+        iArg = rp->iRule;
+        zArg = "rule";
+        if( !bDrop ){
+          n = anReduce[iArg];
+          if( n==0 || aaReduce[iArg][n-1]!=stp->statenum ){
+            aaReduce[iArg] = (long*)lemon_realloc(lemp, aaReduce[iArg],
+                                                  (n+1)*sizeof(long));
+            aaReduce[iArg][n] = stp->statenum;
+            anReduce[iArg]++;
+          }
+        }
+      }
+      fprintf(fp, "%s{\"on\":\"%s\",\"do\":\"%s\"", j++ ? "," : "",
+              ap->sp->name, zAct);
+      if( iArg>=0 ) fprintf(fp, ",\"%s\":%d", zArg, iArg);
+      if( ap->spOpt ) fprintf(fp, ",\"because\":\"%s\"", ap->spOpt->name);
+      if( ap->type==SSCONFLICT || ap->type==SRCONFLICT
+       || ap->type==RRCONFLICT ){
+        fprintf(fp, ",\"conflict\":true");
+      }
+      if( bDrop ) fprintf(fp, ",\"dropped\":true");
+      putc('}', fp);
+    }
+    fprintf(fp, "]}\n");
+    if( bConflict ) aConflict[nConflict++] = stp->statenum;
+  }
+
+  iIndex = ftell(fp);
+  fprintf(fp, "{\"type\":\"index\",\"symbols\":");
+  json_int_array(fp, aSymOfst, lemp->nsymbol);
+  fprintf(fp, ",\"rules\":");
+  json_int_array(fp, aRuleOfst, lemp->nrule);
+  fprintf(fp, ",\"states\":");
+  json_int_array(fp, aStateOfst, lemp->nxstate);
+  fprintf(fp, ",\"conflicts\":");
+  json_int_array(fp, aConflict, nConflict);
+  fprintf(fp, ",\"reduces\":[");
+  for(i=0; i<lemp->nrule; i++){
+    if( i>0 ) putc(',', fp);
+    json_int_array(fp, aaReduce[i], anReduce[i]);
+    lemon_free(lemp, aaReduce[i]);
+  }
+  fprintf(fp, "]}\n");
+  fprintf(fp, "{\"index\":%20ld}\n", iIndex);
+  file_close(lemp, fp);
+  lemon_free(lemp, aSymOfst);
+  lemon_free(lemp, aRuleOfst);
+  lemon_free(lemp, aStateOfst);
+  lemon_free(lemp, aConflict);
+  lemon_free(lemp, aaReduce);
+  lemon_free(lemp, anReduce);
+}
+
+/* Read the line of fp that starts at byte offset iOfst, without the
+** newline.  Return NULL if there is no such line.  The result is
+** obtained from lemon_malloc().
+*/
+PRIVATE char *json_read_line(struct lemon *lemp, FILE *fp, long iOfst){
+  size_t n = 0;
+  size_t nAlloc = 1000;
+  char *z;
+  int c;
+  if( iOfst<0 || fseek(fp, iOfst, SEEK_SET)!=0 ) return 0;
+  z = (char*)lemon_malloc(lemp, nAlloc);
+  while( (c = getc(fp))!=EOF && c!='\n' ){
+    if( n+1>=nAlloc ){
+      nAlloc *= 2;
+      z = (char*)lemon_realloc(lemp, z, nAlloc);
+    }
+    z[n++] = (char)c;
+  }
+  z[n] = 0;
+  if( n==0 && c==EOF ){
+    lemon_free(lemp, z);
+    return 0;
+  }
+  return z;
+}
+
+/* Return the first entry of the integer array zKey in the index line
+** zIndex, or NULL if there is no such array.  For "reduces", which is an
+** array of arrays, return the first entry of the iSub-th inner array.
+*/
+PRIVATE const char *json_index_array(
+  const char *zIndex,          /* The index line */
+  const char *zKey,            /* Name of the array */
+  int iSub                     /* Inner array, or -1 */
+){
+  char zPattern[40];
+  const char *z;
+  lemon_sprintf(zPattern, "\"%s\":[", zKey);
+  z = strstr(zIndex, zPattern);
+  if( z==0 ) return 0;
+  z += lemonStrlen(zPattern);
+  for(; iSub>=0; iSub--){
+    while( *z && *z!='[' && *z!=']' ) z++;
+    if( *z!='[' ) return 0;
+    z++;
+    if( iSub>0 ){
+      while( *z && *z!=']' ) z++;
+      if( *z ) z++;
+    }
+  }
+  return z;
+}
+
+/* Store in *piVal the integer at *pz, an element of an array, and
+** advance *pz past it.  Return 0 at the end of the array.
+*/
+PRIVATE int json_next_int(const char **pz, long *piVal){
+  const char *z = *pz;
+  char *zEnd;
+  while( *z==',' || ISSPACE(*z) ) z++;
+  if( !ISDIGIT(*z) ) return 0;
+  *piVal = strtol(z, &zEnd, 10);
+  *pz = zEnd;
+  return 1;
+}
+
+/* Store in *piVal the N-th element of the array that starts at z.
+** Return 0 if the array is shorter than that.
+*/
+PRIVATE int json_nth_int(const char *z, long N, long *piVal){
+  if( z==0 || N<0 ) return 0;
+  while( json_next_int(&z, piVal) ){
+    if( N--==0 ) return 1;
+  }
+  return 0;
+}
+
+/* Copy the line of fp that starts at byte iOfst onto the output */
+PRIVATE int json_show(struct lemon *lemp, FILE *fp, long iOfst){
+  char *z = json_read_line(lemp, fp, iOfst);
+  if( z==0 ) return 0;
+  fprintf(lemp->outstream, "%s\n", z);
+  lemon_free(lemp, z);
+  return 1;
+}
+
+/* Answer a query (-Q) about the automaton, using the "*.jsonl" report
+** written by an earlier run with -J.  Only the index and the lines that
+** are asked for are read.  The queries are:
+**
+**     grammar        Totals for the whole grammar
+**     state=N        State N
+**     rule=N         Rule N
+**     symbol=NAME    The symbol called NAME
+**     reduces=N      Every state that reduces rule N
+**     conflicts      Every state that has a parsing conflict
+**
+** The matching lines of the report are copied onto the output.  Return
+** the exit code for the stand-alone program.
+*/
+int ReportQuery(struct lemon *lemp)
+{
+  const char *zQuery = lemp->zQuery;
+  const char *zArg = strchr(zQuery, '=');
+  int nCmd = zArg ? (int)(zArg-zQuery) : lemonStrlen(zQuery);
+  const char *z;
+  char *zIndex;
+  long iOfst, iArg = -1;
+  int nFound = 0;
+  FILE *fp;
+
+  if( zArg ){
+    zArg++;
+    if( ISDIGIT(zArg[0]) ) iArg = atol(zArg);
+  }
+  lemp->outname = file_makename(lemp, ".jsonl");
+  fp = fopen(lemp->outname, "rb");
+  if( fp==0 ){
+    fprintf(lemp->errstream,
+       "Can't open \"%s\".  Generate it first with the -J option.\n",
+       lemp->outname);
+    return 1;
+  }
+  file_track(lemp, fp);
+  zIndex = 0;
+  if( fseek(fp, -JSON_TRAILER_SIZE, SEEK_END)==0 ){
+    char *zTrailer = json_read_line(lemp, fp, ftell(fp));
+    if( zTrailer && strncmp(zTrailer, "{\"index\":", 9)==0 ){
+      zIndex = json_read_line(lemp, fp, atol(&zTrailer[9]));
+    }
+    lemon_free(lemp, zTrailer);
+  }
+  if( zIndex==0 || strncmp(zIndex, "{\"type\":\"index\"", 15)!=0 ){
+    fprintf(lemp->errstream, "%s: not a JSON lines report.\n",
+            lemp->outname);
+    file_close(lemp, fp);
+    return 1;
+  }
+
+  if( nCmd==7 && strncmp(zQuery, "grammar", 7)==0 ){
+    nFound = json_show(lemp, fp, 0);
+  }else if( nCmd==5 && strncmp(zQuery, "state", 5)==0 ){
+    z = json_index_array(zIndex, "states", -1);
+    if( json_nth_int(z, iArg, &iOfst) ) nFound = json_show(lemp, fp, iOfst);
+  }else if( nCmd==4 && strncmp(zQuery, "rule", 4)==0 ){
+    z = json_index_array(zIndex, "rules", -1);
+    if( json_nth_int(z, iArg, &iOfst) ) nFound = json_show(lemp, fp, iOfst);
+  }else if( nCmd==6 && strncmp(zQuery, "symbol", 6)==0 && zArg ){
+    char *zPattern = (char*)lemon_malloc(lemp, lemonStrlen(zArg)+20);
+    lemon_sprintf(zPattern, ",\"name\":\"%s\",", zArg);
+    z = json_index_array(zIndex, "symbols", -1);
+    while( z && nFound==0 && json_next_int(&z, &iOfst) ){
+      char *zLine = json_read_line(lemp, fp, iOfst);
+      if( zLine && strstr(zLine, zPattern) ){
+        fprintf(lemp->outstream, "%s\n", zLine);
+        nFound = 1;
+      }
+      lemon_free(lemp, zLine);
+    }
+    lemon_free(lemp, zPattern);
+  }else if( (nCmd==7 && strncmp(zQuery, "reduces", 7)==0 && iArg>=0)
+         || (nCmd==9 && strncmp(zQuery, "conflicts", 9)==0) ){
+    /* Any number of states, including none, is a valid answer */
+    const char *zStates = json_index_array(zIndex, "states", -1);
+    long iState;
+    z = nCmd==7 ? json_index_array(zIndex, "reduces", (int)iArg)
+                : json_index_array(zIndex, "conflicts", -1);
+    nFound = z!=0;
+    while( z && json_next_int(&z, &iState) ){
+      if( json_nth_int(zStates, iState, &iOfst) ) json_show(lemp, fp, iOfst);
+    }
+  }else{
+    fprintf(lemp->errstream, "Unknown query \"%s\".  Use grammar, state=N, "
+       "rule=N, symbol=NAME, reduces=N or conflicts.\n", zQuery);
+    file_close(lemp, fp);
+    return 1;
+  }
+  file_close(lemp, fp);
+  if( nFound==0 ){
+    fprintf(lemp->errstream, "No match for \"%s\".\n", zQuery);
+    return 1;
+  }
+  return 0;
+}
+
 /* Search for the file "name" which is in the same directory as
 ** the executable */
-PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
+PRIVATE char *pathsearch(
+  struct lemon *lemp,
+  char *argv0,
+  char *name,
+  int modemask
+)
 {
   const char *pathlist;
   char *pathbufptr = 0;
@@ -364,15 +867,15 @@ PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
   if( cp ){
     c = *cp;
     *cp = 0;
-    path = (char *)malloc( lemonStrlen(argv0) + lemonStrlen(name) + 2 );
-    if( path ) lemon_sprintf(path,"%s/%s",argv0,name);
+    path = (char *)lemon_malloc(lemp, lemonStrlen(argv0)+lemonStrlen(name)+2);
+    lemon_sprintf(path,"%s/%s",argv0,name);
     *cp = c;
   }else{
     pathlist = getenv("PATH");
     if( pathlist==0 ) pathlist = ".:/bin:/usr/bin";
-    pathbuf = (char *) malloc( lemonStrlen(pathlist) + 1 );
-    path = (char *)malloc( lemonStrlen(pathlist)+lemonStrlen(name)+2 );
-    if( (pathbuf != 0) && (path!=0) ){
+    pathbuf = (char *) lemon_malloc(lemp, lemonStrlen(pathlist) + 1 );
+    path = (char *)lemon_malloc(lemp, lemonStrlen(pathlist)+lemonStrlen(name)+2);
+    {
       pathbufptr = pathbuf;
       lemon_strcpy(pathbuf, pathlist);
       while( *pathbuf ){
@@ -387,7 +890,7 @@ PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
         if( access(path,modemask)==0 ) break;
       }
     }
-    free(pathbufptr);
+    lemon_free(lemp, pathbufptr);
   }
   return path;
 }
@@ -465,65 +968,97 @@ PRIVATE void tplt_skip_header(FILE *in, int *lineno)
   }
 }
 
+/* Return the name of the template file that is used if no template is
+** given with -T: a "*.lt" file next to the grammar, or else "lempar.c" in
+** the current directory or next to the lemon program.  Return NULL if
+** there is no such file.  The name is obtained from lemon_malloc().
+*/
+char *tplt_find(struct lemon *lemp)
+{
+  static char templatename[] = "lempar.c";
+  char buf[1000];
+  char *cp;
+
+  cp = strrchr(lemp->filename,'.');
+  if( cp ){
+    lemon_sprintf(buf,"%.*s.lt",(int)(cp-lemp->filename),lemp->filename);
+  }else{
+    lemon_sprintf(buf,"%s.lt",lemp->filename);
+  }
+  if( access(buf,004)==0 ){
+    return lemon_strdup(lemp, buf);
+  }else if( access(templatename,004)==0 ){
+    return lemon_strdup(lemp, templatename);
+  }else if( lemp->argv0 ){
+    return pathsearch(lemp,lemp->argv0,templatename,0);
+  }
+  return 0;
+}
+
 /* The next function finds the template file and opens it, returning
 ** a pointer to the opened file. */
 PRIVATE FILE *tplt_open(struct lemon *lemp)
 {
-  static char templatename[] = "lempar.c";
-  char buf[1000];
   FILE *in;
   char *tpltname;
-  char *toFree = 0;
-  char *cp;
+
+  /* A library caller may supply the text of the template directly */
+  if( lemp->zTemplate ){
+#ifdef __WIN32__
+    in = tmpfile();
+    if( in ){
+      fwrite(lemp->zTemplate, 1, lemp->nTemplate, in);
+      rewind(in);
+    }
+#else
+    in = fmemopen((void*)lemp->zTemplate, lemp->nTemplate, "rb");
+#endif
+    if( in==0 ){
+      fprintf(lemp->errstream,"Can't read the parser driver template.\n");
+      lemp->errorcnt++;
+      return 0;
+    }
+    return file_track(lemp, in);
+  }
 
   /* first, see if user specified a template filename on the command line. */
-  if (user_templatename != 0) {
-    if( access(user_templatename,004)==-1 ){
-      fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
-        user_templatename);
+  if (lemp->templatename != 0) {
+    if( access(lemp->templatename,004)==-1 ){
+      fprintf(lemp->errstream,
+        "Can't find the parser driver template file \"%s\".\n",
+        lemp->templatename);
       lemp->errorcnt++;
       return 0;
     }
-    in = fopen(user_templatename,"rb");
+    in = fopen(lemp->templatename,"rb");
     if( in==0 ){
-      fprintf(stderr,"Can't open the template file \"%s\".\n",
-              user_templatename);
+      fprintf(lemp->errstream,"Can't open the template file \"%s\".\n",
+              lemp->templatename);
       lemp->errorcnt++;
       return 0;
     }
-    return in;
+    return file_track(lemp, in);
   }
 
-  cp = strrchr(lemp->filename,'.');
-  if( cp ){
-    lemon_sprintf(buf,"%.*s.lt",(int)(cp-lemp->filename),lemp->filename);
-  }else{
-    lemon_sprintf(buf,"%s.lt",lemp->filename);
-  }
-  if( access(buf,004)==0 ){
-    tpltname = buf;
-  }else if( access(templatename,004)==0 ){
-    tpltname = templatename;
-  }else{
-    toFree = tpltname = pathsearch(lemp->argv0,templatename,0);
-  }
+  tpltname = tplt_find(lemp);
   if( tpltname==0 ){
-    fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
-    templatename);
+    fprintf(lemp->errstream,
+    "Can't find the parser driver template file \"lempar.c\".\n");
     lemp->errorcnt++;
     return 0;
   }
   in = fopen(tpltname,"rb");
   if( in==0 ){
-    fprintf(stderr,"Can't open the template file \"%s\".\n",tpltname);
+    fprintf(lemp->errstream,"Can't open the template file \"%s\".\n",
+            tpltname);
     lemp->errorcnt++;
   }
-  free(toFree);
-  return in;
+  lemon_free(lemp, tpltname);
+  return file_track(lemp, in);
 }
 
 /* Print a #line directive line to the output file. */
-PRIVATE void tplt_linedir(FILE *out, int lineno, char *filename)
+PRIVATE void tplt_linedir(FILE *out, int lineno, const char *filename)
 {
   fprintf(out,"#line %d \"",lineno);
   while( *filename ){
@@ -574,7 +1109,7 @@ void emit_destructor_code(
    fprintf(out,"{\n"); (*lineno)++;
    if( !lemp->nolinenosflag ){
      (*lineno)++;
-     tplt_linedir(out,sp->destLineno,lemp->filename);
+     tplt_linedir(out,sp->destLineno,sp->destFilename);
    }
  }else if( lemp->vardest ){
    cp = lemp->vardest;
@@ -585,7 +1120,8 @@ void emit_destructor_code(
  }
  for(; *cp; cp++){
    if( *cp=='$' && cp[1]=='$' ){
-     fprintf(out,"(yypminor->yy%d)",sp->dtnum);
+     fprintf(out,sp->iBox ? "(*yypminor->yy%d)" : "(yypminor->yy%d)",
+             sp->dtnum);
      cp++;
      continue;
    }
@@ -601,13 +1137,16 @@ void emit_destructor_code(
 }
 
 /*
-** Return TRUE (non-zero) if the given symbol has a destructor.
+** Return TRUE (non-zero) if the given symbol has a destructor.  The
+** values of the symbols named by %arena need none.
 */
 int has_destructor(struct symbol *sp, struct lemon *lemp)
 {
   int ret;
   if( sp->type==TERMINAL ){
     ret = lemp->tokendest!=0;
+  }else if( sp->bArena ){
+    ret = 0;
   }else{
     ret = lemp->vardest!=0 || sp->destructor!=0;
   }
@@ -626,16 +1165,20 @@ int has_destructor(struct symbol *sp, struct lemon *lemp)
 **
 ** If n==-1, then the previous character is overwritten.
 */
-PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
-  static char empty[1] = { 0 };
-  static char *z = 0;
-  static int alloced = 0;
-  static int used = 0;
+PRIVATE char *append_str(
+  struct lemon *lemp,
+  const char *zText,
+  int n,
+  int p1,
+  int p2
+){
+  char *z = lemp->zAppend;
+  int used = lemp->nAppendUsed;
   int c;
   char zInt[40];
   if( zText==0 ){
     if( used==0 && z!=0 ) z[0] = 0;
-    used = 0;
+    lemp->nAppendUsed = 0;
     return z;
   }
   if( n<=0 ){
@@ -645,11 +1188,10 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
     n = lemonStrlen(zText);
   }
-  if( (int) (n+sizeof(zInt)*2+used) >= alloced ){
-    alloced = n + sizeof(zInt)*2 + used + 200;
-    z = (char *) realloc(z,  alloced);
+  if( (int) (n+sizeof(zInt)*2+used) >= lemp->nAppendAlloc ){
+    lemp->nAppendAlloc = n + sizeof(zInt)*2 + used + 200;
+    z = lemp->zAppend = (char *) lemon_realloc(lemp, z, lemp->nAppendAlloc);
   }
-  if( z==0 ) return empty;
   while( n-- > 0 ){
     c = *(zText++);
     if( c=='%' && n>0 && zText[0]=='d' ){
@@ -664,9 +1206,116 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
   }
   z[used] = 0;
+  lemp->nAppendUsed = used;
   return z;
 }
 
+PRIVATE int type_size(const char*);
+
+/*
+** Return the name of the C datatype of the values of symbol sp.
+*/
+PRIVATE const char *symbol_type(struct lemon *lemp, struct symbol *sp){
+  if( sp->type==MULTITERMINAL ) sp = sp->subsym[0];
+  if( sp==lemp->errsym ) return "int";
+  if( sp->dtnum==0 ) return lemp->tokentype ? lemp->tokentype : "void*";
+  return sp->datatype ? sp->datatype : lemp->vartype;
+}
+
+/*
+** Return the offset of the first character before z[i] that is not a
+** space, or -1 if there is none.
+*/
+PRIVATE int prev_nonspace(const char *z, int i){
+  for(i--; i>=0 && ISSPACE(z[i]); i--){}
+  return i;
+}
+
+/*
+** Return TRUE if the code of rule rp can write the value of its LHS
+** label straight into the stack entry of its left-most RHS label, which
+** has a different name, although the code has no overwrite comment.
+** That entry then holds both values, so this is only so if the RHS
+** value is never read once the LHS is written.  The analysis is textual
+** and gives up easily.  It must find that:
+**
+**   +  The RHS value is a scalar or a pointer, so that no pointer into the
+**      entry can come from it, and its address is never taken.
+**   +  The code has no loops or jumps, so it runs in the order in which
+**      it is written.
+**   +  The first use of the LHS label starts a statement that assigns to
+**      it or to one of its fields, "A = ...;" or "A.x = ...;", and the
+**      right of that assignment is one expression, with no comma operator
+**      and no other use of the LHS label, so nothing in it runs after
+**      the store.
+**   +  The RHS label is only used before that statement, or on the right
+**      of its assignment, which C evaluates before the store.
+*/
+PRIVATE int lhs_overwrite_safe(struct lemon *lemp, struct rule *rp){
+  static const char *azJump[] = { "for", "while", "do", "goto", "switch" };
+  const char *z = rp->code;
+  int i, j, n, k;
+  int iFirstLhs = -1;    /* Offset of the first use of the LHS label */
+  int iAssign = -1;      /* Offset of the "=" of that statement */
+  int iEnd = -1;         /* Offset of the ";" that ends it */
+  int depth;
+
+  if( rp->nrhs==0 || rp->rhs[0]->iBox || rp->lhs->iBox ) return 0;
+  if( type_size(symbol_type(lemp, rp->rhs[0]))<0 ) return 0;
+  for(i=0; z[i]; i++){
+    if( !ISALPHA(z[i]) && z[i]!='_' ) continue;
+    if( i>0 && (ISALNUM(z[i-1]) || z[i-1]=='_') ) continue;
+    for(n=1; ISALNUM(z[i+n]) || z[i+n]=='_'; n++){}
+    for(k=0; k<(int)(sizeof(azJump)/sizeof(azJump[0])); k++){
+      if( lemonStrlen(azJump[k])==n && strncmp(&z[i],azJump[k],n)==0 ){
+        return 0;
+      }
+    }
+    if( lemonStrlen(rp->rhsalias[0])==n
+     && strncmp(&z[i],rp->rhsalias[0],n)==0
+     && (i==0 || z[i-1]!='@') ){
+      j = prev_nonspace(z, i);
+      if( j>=0 && z[j]=='&' && (j==0 || z[j-1]!='&') ) return 0;
+      if( iFirstLhs>=0 && (i<iAssign || i>iEnd) ) return 0;
+    }else if( iFirstLhs<0 && lemonStrlen(rp->lhsalias)==n
+           && strncmp(&z[i],rp->lhsalias,n)==0 ){
+      /* The statement must start here */
+      j = prev_nonspace(z, i);
+      if( j>=0 && strchr(";{})", z[j])==0
+       && !(j>=3 && strncmp(&z[j-3],"else",4)==0
+            && (j==3 || (!ISALNUM(z[j-4]) && z[j-4]!='_'))) ){
+        return 0;
+      }
+      /* Then be an assignment to the label or to its fields */
+      for(j=i+n; ; ){
+        while( ISSPACE(z[j]) ) j++;
+        if( z[j]!='.' ) break;
+        for(j++; ISSPACE(z[j]); j++){}
+        if( !ISALPHA(z[j]) && z[j]!='_' ) return 0;
+        while( ISALNUM(z[j]) || z[j]=='_' ) j++;
+      }
+      if( z[j]!='=' || z[j+1]=='=' ) return 0;
+      iFirstLhs = i;
+      iAssign = j;
+      for(depth=0, j++; z[j] && (depth>0 || z[j]!=';'); j++){
+        if( z[j]=='(' || z[j]=='[' || z[j]=='{' ) depth++;
+        if( z[j]==')' || z[j]==']' || z[j]=='}' ) depth--;
+        if( depth<0 || (depth==0 && z[j]==',') ) return 0;
+        if( (ISALPHA(z[j]) || z[j]=='_')
+         && !ISALNUM(z[j-1]) && z[j-1]!='_'
+         && strncmp(&z[j],rp->lhsalias,n)==0
+         && !ISALNUM(z[j+n]) && z[j+n]!='_' ){
+          return 0;
+        }
+      }
+      if( z[j]!=';' ) return 0;
+      iEnd = j;
+    }
+    i += n-1;
+  }
+  return iFirstLhs>=0;
+}
+
 /*
 ** Write and transform the rp->code string so that symbols are expanded.
 ** Populate the rp->codePrefix and rp->codeSuffix strings, as appropriate.
@@ -682,10 +1331,17 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
   const char *zSkip = 0; /* The zOvwrt comment within rp->code, or NULL */
   char lhsused = 0;      /* True if the LHS element has been used */
   char lhsdirect;        /* True if LHS writes directly into stack */
+  char lhsproven = 0;    /* True if lhs_overwrite_safe() allowed lhsdirect */
   char used[MAXRHS];     /* True for each RHS element which is used */
   char zLhs[50];         /* Convert the LHS symbol into this string */
   char zOvwrt[900];      /* Comment that to allow LHS to overwrite RHS */
+  char zDtor[80];        /* Destructor call for an unused RHS value */
+  const char *zMinor;    /* The value of a stack entry, given its offset */
+  int boxShared = 0;     /* True if the LHS keeps the box of the RHS[0] */
 
+  /* With -A, the values are in an array of their own, next to yymsp */
+  zMinor = lemp->stackArrays ? "yyvsp[%d]" : "yymsp[%d].minor";
+  lemon_sprintf(zDtor, "  yy_destructor(yypParser,%%d,&%s);\n", zMinor);
   for(i=0; i<rp->nrhs; i++) used[i] = 0;
   lhsused = 0;
 
@@ -707,10 +1363,9 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     ** we have to call the destructor on the RHS symbol first. */
     lhsdirect = 1;
     if( has_destructor(rp->rhs[0],lemp) ){
-      append_str(0,0,0,0);
-      append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-                 rp->rhs[0]->index,1-rp->nrhs);
-      rp->codePrefix = Strsafe(append_str(0,0,0,0));
+      append_str(lemp,0,0,0,0);
+      append_str(lemp,zDtor,0,rp->rhs[0]->index,1-rp->nrhs);
+      rp->codePrefix = Strsafe(lemp,append_str(lemp,0,0,0,0));
       rp->noCode = 0;
     }
   }else if( rp->lhsalias==0 ){
@@ -723,7 +1378,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     lhsused = 1;
     used[0] = 1;
     if( rp->lhs->dtnum!=rp->rhs[0]->dtnum ){
-      ErrorMsg(lemp->filename,rp->ruleline,
+      ErrorMsg(lemp,rp->filename,rp->ruleline,
         "%s(%s) and %s(%s) share the same label but have "
         "different datatypes.",
         rp->lhs->name, rp->lhsalias, rp->rhs[0]->name, rp->rhsalias[0]);
@@ -737,23 +1392,61 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       /* The code contains a special comment that indicates that it is safe
       ** for the LHS label to overwrite left-most RHS label. */
       lhsdirect = 1;
+    }else if( lhs_overwrite_safe(lemp, rp) ){
+      /* The code never reads the RHS value after writing the LHS */
+      lhsdirect = 1;
+      lhsproven = 1;
     }else{
       lhsdirect = 0;
     }
   }
+
+  /* With -Z, a boxed value is reached through the handle in the stack.
+  ** The LHS takes over the box of the left-most RHS symbol when they
+  ** are of the same type and the LHS may overwrite the RHS value.
+  ** Otherwise it gets a box of its own, which is only stored into the
+  ** stack once the RHS boxes have been given back. */
+  if( rp->lhs->iBox ){
+    boxShared = rp->nrhs>0 && rp->rhs[0]->type!=MULTITERMINAL
+             && rp->rhs[0]->dtnum==rp->lhs->dtnum
+             && (rp->rhsalias[0]==0 || rp->lhsalias==0 || zSkip!=0
+                 || strcmp(rp->lhsalias,rp->rhsalias[0])==0);
+    if( !boxShared ){
+      const char *zType = rp->lhs->datatype;
+      if( zType==0 ) zType = lemp->vartype;
+      lhsdirect = 0;
+      append_str(lemp,0,0,0,0);
+      if( rp->codePrefix ) append_str(lemp,rp->codePrefix,0,0,0);
+      append_str(lemp,"  yylhsminor.yy%d = ",0,rp->lhs->dtnum,0);
+      append_str(lemp,"(",0,0,0);
+      append_str(lemp,zType,0,0,0);
+      append_str(lemp,"*)yyBoxTake(yypParser,%d);\n",0,rp->lhs->iBox-1,0);
+      rp->codePrefix = Strsafe(lemp,append_str(lemp,0,0,0,0));
+      rp->noCode = 0;
+    }
+  }else if( lhsdirect && rp->lhsalias && rp->nrhs>0 && rp->rhs[0]->iBox ){
+    /* Writing the LHS would overwrite the handle of the RHS[0] box */
+    lhsdirect = 0;
+  }
   if( lhsdirect ){
-    sprintf(zLhs, "yymsp[%d].minor.yy%d",1-rp->nrhs,rp->lhs->dtnum);
+    sprintf(zLhs, "%s", rp->lhs->iBox ? "(*" : "");
+    sprintf(&zLhs[lemonStrlen(zLhs)], zMinor, 1-rp->nrhs);
+    sprintf(&zLhs[lemonStrlen(zLhs)], ".yy%d%s", rp->lhs->dtnum,
+            rp->lhs->iBox ? ")" : "");
+  }else if( rp->lhs->iBox ){
+    rc = 1;
+    sprintf(zLhs, "(*yylhsminor.yy%d)",rp->lhs->dtnum);
   }else{
     rc = 1;
     sprintf(zLhs, "yylhsminor.yy%d",rp->lhs->dtnum);
   }
 
-  append_str(0,0,0,0);
+  append_str(lemp,0,0,0,0);
 
   /* This const cast is wrong but harmless, if we're careful. */
   for(cp=(char *)rp->code; *cp; cp++){
     if( cp==zSkip ){
-      append_str(zOvwrt,0,0,0);
+      append_str(lemp,zOvwrt,0,0,0);
       cp += lemonStrlen(zOvwrt)-1;
       dontUseRhs0 = 1;
       continue;
@@ -764,21 +1457,21 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       saved = *xp;
       *xp = 0;
       if( rp->lhsalias && strcmp(cp,rp->lhsalias)==0 ){
-        append_str(zLhs,0,0,0);
+        append_str(lemp,zLhs,0,0,0);
         cp = xp;
         lhsused = 1;
       }else{
         for(i=0; i<rp->nrhs; i++){
           if( rp->rhsalias[i] && strcmp(cp,rp->rhsalias[i])==0 ){
             if( i==0 && dontUseRhs0 ){
-              ErrorMsg(lemp->filename,rp->ruleline,
+              ErrorMsg(lemp,rp->filename,rp->ruleline,
                  "Label %s used after '%s'.",
                  rp->rhsalias[0], zOvwrt);
               lemp->errorcnt++;
             }else if( cp!=rp->code && cp[-1]=='@' ){
               /* If the argument is of the form @X then substituted
               ** the token number of X, not the value of X */
-              append_str("yymsp[%d].major",-1,i-rp->nrhs+1,0);
+              append_str(lemp,"yymsp[%d].major",-1,i-rp->nrhs+1,0);
             }else{
               struct symbol *sp = rp->rhs[i];
               int dtnum;
@@ -787,7 +1480,10 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
               }else{
                 dtnum = sp->dtnum;
               }
-              append_str("yymsp[%d].minor.yy%d",0,i-rp->nrhs+1, dtnum);
+              if( sp->iBox ) append_str(lemp,"(*",0,0,0);
+              append_str(lemp,zMinor,0,i-rp->nrhs+1,0);
+              append_str(lemp,".yy%d",0,dtnum,0);
+              if( sp->iBox ) append_str(lemp,")",0,0,0);
             }
             cp = xp;
             used[i] = 1;
@@ -797,17 +1493,17 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       }
       *xp = saved;
     }
-    append_str(cp, 1, 0, 0);
+    append_str(lemp,cp, 1, 0, 0);
   } /* End loop */
 
   /* Main code generation completed */
-  cp = append_str(0,0,0,0);
-  if( cp && cp[0] ) rp->code = Strsafe(cp);
-  append_str(0,0,0,0);
+  cp = append_str(lemp,0,0,0,0);
+  if( cp && cp[0] ) rp->code = Strsafe(lemp,cp);
+  append_str(lemp,0,0,0,0);
 
   /* Check to make sure the LHS has been used */
   if( rp->lhsalias && !lhsused ){
-    ErrorMsg(lemp->filename,rp->ruleline,
+    ErrorMsg(lemp,rp->filename,rp->ruleline,
       "Label \"%s\" for \"%s(%s)\" is never used.",
         rp->lhsalias,rp->lhs->name,rp->lhsalias);
     lemp->errorcnt++;
@@ -821,7 +1517,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
       if( i>0 ){
         int j;
         if( rp->lhsalias && strcmp(rp->lhsalias,rp->rhsalias[i])==0 ){
-          ErrorMsg(lemp->filename,rp->ruleline,
+          ErrorMsg(lemp,rp->filename,rp->ruleline,
             "%s(%s) has the same label as the LHS but is not the left-most "
             "symbol on the RHS.",
             rp->rhs[i]->name, rp->rhsalias[i]);
@@ -829,7 +1525,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
         }
         for(j=0; j<i; j++){
           if( rp->rhsalias[j] && strcmp(rp->rhsalias[j],rp->rhsalias[i])==0 ){
-            ErrorMsg(lemp->filename,rp->ruleline,
+            ErrorMsg(lemp,rp->filename,rp->ruleline,
               "Label %s used for multiple symbols on the RHS of a rule.",
               rp->rhsalias[i]);
             lemp->errorcnt++;
@@ -838,32 +1534,51 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
         }
       }
       if( !used[i] ){
-        ErrorMsg(lemp->filename,rp->ruleline,
+        ErrorMsg(lemp,rp->filename,rp->ruleline,
           "Label %s for \"%s(%s)\" is never used.",
           rp->rhsalias[i],rp->rhs[i]->name,rp->rhsalias[i]);
         lemp->errorcnt++;
       }
     }else if( i>0 && has_destructor(rp->rhs[i],lemp) ){
-      append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-         rp->rhs[i]->index,i-rp->nrhs+1);
+      append_str(lemp,zDtor,0,rp->rhs[i]->index,i-rp->nrhs+1);
     }
   }
 
+  /* Give back the boxes of the RHS values */
+  for(i=0; i<rp->nrhs; i++){
+    if( rp->rhs[i]->type==MULTITERMINAL || rp->rhs[i]->iBox==0 ) continue;
+    if( i==0 && boxShared ) continue;
+    append_str(lemp,"  yyBoxFree(yypParser,%d,",0,rp->rhs[i]->iBox-1,0);
+    append_str(lemp,zMinor,0,i-rp->nrhs+1,0);
+    append_str(lemp,".yy%d);\n",0,rp->rhs[i]->dtnum,0);
+  }
+
   /* If unable to write LHS values directly into the stack, write the
   ** saved LHS value now. */
   if( lhsdirect==0 ){
-    append_str("  yymsp[%d].minor.yy%d = ", 0, 1-rp->nrhs, rp->lhs->dtnum);
-    append_str(zLhs, 0, 0, 0);
-    append_str(";\n", 0, 0, 0);
+    append_str(lemp,"  ",0,0,0);
+    append_str(lemp,zMinor,0,1-rp->nrhs,0);
+    append_str(lemp,".yy%d = ",0,rp->lhs->dtnum,0);
+    if( rp->lhs->iBox ){
+      append_str(lemp,"yylhsminor.yy%d;\n",0,rp->lhs->dtnum,0);
+    }else{
+      append_str(lemp,zLhs, 0, 0, 0);
+      append_str(lemp,";\n", 0, 0, 0);
+    }
   }
 
   /* Suffix code generation complete */
-  cp = append_str(0,0,0,0);
+  cp = append_str(lemp,0,0,0,0);
   if( cp && cp[0] ){
-    rp->codeSuffix = Strsafe(cp);
+    rp->codeSuffix = Strsafe(lemp,cp);
     rp->noCode = 0;
   }
 
+  if( lhsdirect ){
+    if( lhsproven ) lemp->nLhsInPlace++;
+  }else{
+    lemp->nLhsCopy++;
+  }
   return rc;
 }
 
@@ -889,7 +1604,7 @@ PRIVATE void emit_code(
  if( rp->code ){
    if( !lemp->nolinenosflag ){
      (*lineno)++;
-     tplt_linedir(out,rp->line,lemp->filename);
+     tplt_linedir(out,rp->line,rp->filename);
    }
    fprintf(out,"{%s",rp->code);
    for(cp=rp->code; *cp; cp++){ if( *cp=='\n' ) (*lineno)++; }
@@ -913,21 +1628,128 @@ PRIVATE void emit_code(
  return;
 }
 
+/*
+** Return the estimated number of bytes that one entry of the parser
+** stack takes, given nHead bytes for its state and major token number
+** and a YYMINORTYPE of szUnion bytes aligned to align bytes, or -1 if
+** szUnion is unknown.  With -A the three parts are in arrays of their
+** own and need no padding.
+*/
+PRIVATE int stack_entry_size(
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int nHead,                  /* sizeof(YYACTIONTYPE)+sizeof(YYCODETYPE) */
+  int szUnion,                /* Estimated sizeof(YYMINORTYPE) */
+  int align                   /* Estimated alignment of YYMINORTYPE */
+){
+  if( szUnion<0 ) return -1;
+  if( align>16 ) align = 16;
+  szUnion = (szUnion + align - 1)/align*align;
+  if( lemp->stackArrays ) return nHead + szUnion;
+  return (nHead + align - 1)/align*align + szUnion;
+}
+
+/*
+** Return the number of bytes in a value of the C datatype zType, as
+** this host would lay it out, or -1 if lemon cannot tell.  Only
+** pointers and the arithmetic types of the standard headers are known.
+** Structures, arrays and the names of typedefs are not.
+*/
+PRIVATE int type_size(const char *zType){
+  static const struct {
+    const char *zName;      /* A type name */
+    int sz;                 /* sizeof() that type */
+  } aNamed[] = {
+    { "size_t",    sizeof(size_t)    },
+    { "ssize_t",   sizeof(size_t)    },
+    { "ptrdiff_t", sizeof(ptrdiff_t) },
+    { "intptr_t",  sizeof(void*)     },
+    { "uintptr_t", sizeof(void*)     },
+    { "int8_t",    1 }, { "uint8_t",  1 },
+    { "int16_t",   2 }, { "uint16_t", 2 },
+    { "int32_t",   4 }, { "uint32_t", 4 },
+    { "int64_t",   8 }, { "uint64_t", 8 },
+  };
+  int nLong = 0;            /* Number of "long" keywords */
+  int sz = 0;               /* Size from the base keyword, or 0 */
+  int bAny = 0;             /* True if any keyword was seen */
+  int n, k;
+  const char *z = zType;
+
+  n = lemonStrlen(z);
+  while( n>0 && ISSPACE(z[n-1]) ) n--;
+  if( n>0 && z[n-1]=='*' ) return (int)sizeof(void*);
+  while( *z ){
+    if( ISSPACE(*z) ){ z++; continue; }
+    if( !ISALPHA(*z) && *z!='_' ) return -1;
+    for(n=0; ISALNUM(z[n]) || z[n]=='_'; n++){}
+    bAny = 1;
+    if( n==4 && strncmp(z,"long",4)==0 ){
+      nLong++;
+    }else if( (n==6 && strncmp(z,"signed",6)==0)
+           || (n==8 && strncmp(z,"unsigned",8)==0)
+           || (n==5 && strncmp(z,"const",5)==0)
+           || (n==8 && strncmp(z,"volatile",8)==0) ){
+      /* These do not change the size */
+    }else if( sz ){
+      return -1;
+    }else if( n==4 && strncmp(z,"char",4)==0 ){
+      sz = sizeof(char);
+    }else if( n==5 && strncmp(z,"short",5)==0 ){
+      sz = sizeof(short);
+    }else if( n==3 && strncmp(z,"int",3)==0 ){
+      sz = sizeof(int);
+    }else if( n==5 && strncmp(z,"float",5)==0 ){
+      sz = sizeof(float);
+    }else if( n==6 && strncmp(z,"double",6)==0 ){
+      sz = sizeof(double);
+    }else if( (n==5 && strncmp(z,"_Bool",5)==0)
+           || (n==4 && strncmp(z,"bool",4)==0) ){
+      sz = 1;
+    }else{
+      for(k=0; k<(int)(sizeof(aNamed)/sizeof(aNamed[0])); k++){
+        if( lemonStrlen(aNamed[k].zName)==n
+         && strncmp(z,aNamed[k].zName,n)==0 ) break;
+      }
+      if( k>=(int)(sizeof(aNamed)/sizeof(aNamed[0])) ) return -1;
+      sz = aNamed[k].sz;
+    }
+    z += n;
+  }
+  if( !bAny ) return -1;
+  if( sz==sizeof(double) && nLong==1 ) return (int)sizeof(long double);
+  if( nLong>=2 ) return (int)sizeof(long long);
+  if( nLong==1 ) return (int)sizeof(long);
+  return sz ? sz : (int)sizeof(int);
+}
+
 /*
 ** Print the definition of the union used for the parser's data stack.
 ** This union contains fields for every possible data type for tokens
 ** and nonterminals.  In the process of computing and printing this
 ** union, also set the ".dtnum" field of every terminal and nonterminal
 ** symbol.
+**
+** With -Z, a type that is larger than lemp->boxSize bytes, or whose
+** size lemon cannot work out, is not kept in the union.  Its values live
+** in a pool owned by the parser, the union holds a pointer to them, and
+** the ".iBox" field of each symbol of that type is set to one more than
+** the number of its pool.  The estimated size of a stack entry, with and
+** without -Z, is written into lemp->szEntry and lemp->szEntryUnboxed.
 */
 void print_stack_union(
   FILE *out,                  /* The output stream */
   struct lemon *lemp,         /* The main info structure for this parser */
   int *plineno,               /* Pointer to the line number */
-  int mhflag                  /* True if generating makeheaders output */
+  int mhflag,                 /* True if generating makeheaders output */
+  int nHead                   /* Bytes for the state and major of an entry */
 ){
   int lineno;               /* The line number of the output */
   char **types;             /* A hash table of datatypes */
+  char *boxed;              /* boxed[i] is true if types[i] is boxed */
+  int nBox;                 /* Number of boxed types */
+  int sz;                   /* Size of one member of the union */
+  int szUnion, szUnboxed;   /* Sizes of the union with and without -Z */
+  int align, alignUnboxed;  /* Alignments of the union */
   int arraysize;            /* Size of the "types" array */
   int maxdtlength;          /* Maximum length of any ".datatype" field. */
   char *stddt;              /* Standardized name for a datatype */
@@ -937,12 +1759,7 @@ void print_stack_union(
 
   /* Allocate and initialize types[] and allocate stddt[] */
   arraysize = lemp->nsymbol * 2;
-  types = (char**)calloc( arraysize, sizeof(char*) );
-  if( types==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
-  }
-  for(i=0; i<arraysize; i++) types[i] = 0;
+  types = (char**)lemon_calloc(lemp, arraysize, sizeof(char*) );
   maxdtlength = 0;
   if( lemp->vartype ){
     maxdtlength = lemonStrlen(lemp->vartype);
@@ -954,11 +1771,7 @@ void print_stack_union(
     len = lemonStrlen(sp->datatype);
     if( len>maxdtlength ) maxdtlength = len;
   }
-  stddt = (char*)malloc( maxdtlength*2 + 1 );
-  if( stddt==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
-  }
+  stddt = (char*)lemon_malloc(lemp, maxdtlength*2 + 1 );
 
   /* Build a hash table of datatypes. The ".dtnum" field of each symbol
   ** is filled in with the hash index plus 1.  A ".dtnum" value of 0 is
@@ -1003,12 +1816,7 @@ void print_stack_union(
     }
     if( types[hash]==0 ){
       sp->dtnum = hash + 1;
-      types[hash] = (char*)malloc( lemonStrlen(stddt)+1 );
-      if( types[hash]==0 ){
-        fprintf(stderr,"Out of memory.\n");
-        exit(1);
-      }
-      lemon_strcpy(types[hash],stddt);
+      types[hash] = lemon_strdup(lemp, stddt);
     }
   }
 
@@ -1019,108 +1827,1817 @@ void print_stack_union(
   fprintf(out,"#define %sTOKENTYPE %s\n",name,
     lemp->tokentype?lemp->tokentype:"void*");  lineno++;
   if( mhflag ){ fprintf(out,"#endif\n"); lineno++; }
-  fprintf(out,"typedef union {\n"); lineno++;
-  fprintf(out,"  int yyinit;\n"); lineno++;
-  fprintf(out,"  %sTOKENTYPE yy0;\n",name); lineno++;
+
+  /* Size up the members of the union, and decide which types to box */
+  boxed = (char*)lemon_calloc(lemp, arraysize, 1);
+  nBox = 0;
+  szUnion = szUnboxed = align = alignUnboxed = (int)sizeof(int);
+  sz = lemp->tokentype ? type_size(lemp->tokentype) : (int)sizeof(void*);
+  if( sz<0 ){
+    szUnion = szUnboxed = -1;
+  }else if( sz>szUnion ){
+    szUnion = szUnboxed = align = alignUnboxed = sz;
+  }
   for(i=0; i<arraysize; i++){
     if( types[i]==0 ) continue;
-    fprintf(out,"  %s yy%d;\n",types[i],i+1); lineno++;
-    free(types[i]);
+    sz = type_size(types[i]);
+    if( sz>alignUnboxed ) alignUnboxed = sz;
+    if( lemp->boxSize && (sz<0 || sz>lemp->boxSize) ){
+      boxed[i] = (char)(++nBox);
+      if( nBox>255 ){
+        ErrorMsg(lemp,lemp->filename,0,
+          "Too many types for -Z.  At most 255 types can be boxed.");
+        lemp->errorcnt++;
+        boxed[i] = 0;
+      }
+      if( szUnboxed>=0 && (sz<0 || sz>szUnboxed) ) szUnboxed = sz;
+      sz = (int)sizeof(void*);
+    }else if( szUnboxed>=0 && (sz<0 || sz>szUnboxed) ){
+      szUnboxed = sz;
+    }
+    if( szUnion>=0 && (sz<0 || sz>szUnion) ) szUnion = sz;
+    if( sz>align ) align = sz;
   }
-  if( lemp->errsym && lemp->errsym->useCnt ){
-    fprintf(out,"  int yy%d;\n",lemp->errsym->dtnum); lineno++;
+  if( nBox && szUnion>=0 && (int)sizeof(void*)>szUnion ){
+    szUnion = (int)sizeof(void*);
+  }
+  lemp->szEntry = stack_entry_size(lemp, nHead, szUnion, align);
+  lemp->szEntryUnboxed = stack_entry_size(lemp, nHead, szUnboxed,
+                                          alignUnboxed);
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    sp->iBox = 0;
+    if( sp->dtnum>0 && sp->dtnum<=arraysize ) sp->iBox = boxed[sp->dtnum-1];
+  }
+
+  fprintf(out,"typedef union {\n"); lineno++;
+  fprintf(out,"  int yyinit;\n"); lineno++;
+  fprintf(out,"  %sTOKENTYPE yy0;\n",name); lineno++;
+  for(i=0; i<arraysize; i++){
+    if( types[i]==0 ) continue;
+    fprintf(out,"  %s %syy%d;\n",types[i],boxed[i]?"*":"",i+1); lineno++;
+  }
+  if( lemp->errsym && lemp->errsym->useCnt ){
+    fprintf(out,"  int yy%d;\n",lemp->errsym->dtnum); lineno++;
+  }
+  if( nBox ){
+    fprintf(out,"  void *yybox;\n"); lineno++;
   }
-  free(stddt);
-  free(types);
   fprintf(out,"} YYMINORTYPE;\n"); lineno++;
+
+  /* The pools for the boxed types.  YYBOXOF gives the pool of each
+  ** symbol, plus one, or 0 for symbols whose values are in the stack. */
+  if( nBox ){
+    fprintf(out,"#define YYBOXTYPES %d\n",nBox); lineno++;
+    fprintf(out,"#define YYBOXSIZES");
+    for(i=j=0; i<arraysize; i++){
+      if( !boxed[i] ) continue;
+      fprintf(out,"%s\\\n  sizeof(%s)", j++ ? "," : " ", types[i]);
+      lineno++;
+    }
+    fprintf(out,"\n"); lineno++;
+    fprintf(out,"#define YYBOXOF \\\n "); lineno++;
+    for(i=0; i<lemp->nsymbol; i++){
+      fprintf(out," %d,",lemp->symbols[i]->iBox);
+      if( (i%20)==19 && i<lemp->nsymbol-1 ){
+        fprintf(out," \\\n "); lineno++;
+      }
+    }
+    fprintf(out,"\n"); lineno++;
+  }
+  for(i=0; i<arraysize; i++){
+    if( types[i] ) lemon_free(lemp, types[i]);
+  }
+  lemon_free(lemp, boxed);
+  lemon_free(lemp, stddt);
+  lemon_free(lemp, types);
+  *plineno = lineno;
+}
+
+/*
+** Return the name of a C datatype able to represent values between
+** lwr and upr, inclusive.  If pnByte!=NULL then also write the sizeof
+** for that type (1, 2, or 4) into *pnByte.
+*/
+static const char *minimum_size_type(int lwr, int upr, int *pnByte){
+  const char *zType = "int";
+  int nByte = 4;
+  if( lwr>=0 ){
+    if( upr<=255 ){
+      zType = "unsigned char";
+      nByte = 1;
+    }else if( upr<65535 ){
+      zType = "unsigned short int";
+      nByte = 2;
+    }else{
+      zType = "unsigned int";
+      nByte = 4;
+    }
+  }else if( lwr>=-127 && upr<=127 ){
+    zType = "signed char";
+    nByte = 1;
+  }else if( lwr>=-32767 && upr<32767 ){
+    zType = "short";
+    nByte = 2;
+  }
+  if( pnByte ) *pnByte = nByte;
+  return zType;
+}
+
+/*
+** Each state contains a set of token transaction and a set of
+** nonterminal transactions.  Each of these sets makes an instance
+** of the following structure.  An array of these structures is used
+** to order the creation of entries in the yy_action[] table.
+*/
+struct axset {
+  struct state *stp;   /* A pointer to a state */
+  int isTkn;           /* True to use tokens.  False for non-terminals */
+  int nAction;         /* Number of actions */
+  int iOrder;          /* Original order of action sets */
+  double nHit;         /* Look-ups counted by the profile (-P) */
+};
+
+/*
+** Compare to axset structures for sorting purposes.  The sets that the
+** profile shows to be busiest come first, so that they are placed
+** together at the start of yy_action[].
+*/
+static int axset_compare(const void *a, const void *b){
+  struct axset *p1 = (struct axset*)a;
+  struct axset *p2 = (struct axset*)b;
+  int c;
+  if( p1->nHit!=p2->nHit ) return p1->nHit<p2->nHit ? 1 : -1;
+  c = p2->nAction - p1->nAction;
+  if( c==0 ){
+    c = p1->iOrder - p2->iOrder;
+  }
+  assert( c!=0 || p1==p2 );
+  return c;
+}
+
+/*
+** Write text on "out" that describes the rule "rp".
+*/
+static void writeRuleText(FILE *out, struct rule *rp){
+  int j;
+  fprintf(out,"%s ::=", rp->lhs->name);
+  for(j=0; j<rp->nrhs; j++){
+    struct symbol *sp = rp->rhs[j];
+    if( sp->type!=MULTITERMINAL ){
+      fprintf(out," %s", sp->name);
+    }else{
+      int k;
+      fprintf(out," %s", sp->subsym[0]->name);
+      for(k=1; k<sp->nsubsym; k++){
+        fprintf(out,"|%s",sp->subsym[k]->name);
+      }
+    }
+  }
+}
+
+
+/*
+** Generate #defines for all tokens.  If mhflag is true the #defines are
+** part of the makeheaders interface.
+*/
+PRIVATE void print_token_defines(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno,               /* Pointer to the line number */
+  int mhflag                  /* True if generating makeheaders output */
+){
+  int lineno = *plineno;
+  const char *prefix = lemp->tokenprefix ? lemp->tokenprefix : "";
+  int i;
+
+  if( mhflag ){
+    fprintf(out,"#if INTERFACE\n"); lineno++;
+  }else{
+    fprintf(out,"#ifndef %s%s\n", prefix, lemp->symbols[1]->name);
+  }
+  for(i=1; i<lemp->nterminal; i++){
+    fprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
+    lineno++;
+  }
+  fprintf(out,"#endif\n"); lineno++;
   *plineno = lineno;
 }
 
-/*
-** Return the name of a C datatype able to represent values between
-** lwr and upr, inclusive.  If pnByte!=NULL then also write the sizeof
-** for that type (1, 2, or 4) into *pnByte.
+/*
+** Work out which tokens ever need their values on the stack.  A token
+** does if it is named by an alias, if it is the first symbol of a rule
+** that passes its value up to a left-hand side that needs one, if a
+** destructor will see it, or if it falls back to, or is matched by the
+** wildcard of, such a token.  aNeed[] gets one entry for each terminal.
+** Return the number of tokens, apart from the end-of-input marker, that
+** never need a value.
+*/
+PRIVATE int token_values(struct lemon *lemp, char *aNeed){
+  char *aSym;
+  struct rule *rp;
+  int i, j, n, progress;
+
+  aSym = (char*)lemon_calloc(lemp, lemp->nsymbol+1, 1);
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    aSym[i] = sp->bContent
+           || (sp->type!=TERMINAL && has_destructor(sp, lemp));
+  }
+  for(rp=lemp->rule; rp; rp=rp->next){
+    for(i=0; i<rp->nrhs; i++){
+      struct symbol *sp = rp->rhs[i];
+      if( sp->type!=MULTITERMINAL || !sp->bContent ) continue;
+      for(j=0; j<sp->nsubsym; j++) aSym[sp->subsym[j]->index] = 1;
+    }
+  }
+  do{
+    progress = 0;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      struct symbol *sp;
+      if( rp->nrhs==0 || rp->lhsalias || !aSym[rp->lhs->index] ) continue;
+      sp = rp->rhs[0];
+      if( sp->type==MULTITERMINAL ){
+        for(j=0; j<sp->nsubsym; j++){
+          if( aSym[sp->subsym[j]->index] ) continue;
+          aSym[sp->subsym[j]->index] = 1;
+          progress = 1;
+        }
+      }else if( !aSym[sp->index] ){
+        aSym[sp->index] = 1;
+        progress = 1;
+      }
+    }
+    for(i=0; i<lemp->nterminal; i++){
+      struct symbol *sp = lemp->symbols[i];
+      if( aSym[i] || sp->fallback==0 || !aSym[sp->fallback->index] ) continue;
+      aSym[i] = 1;
+      progress = 1;
+    }
+  }while( progress );
+  if( lemp->tokendest || (lemp->wildcard && aSym[lemp->wildcard->index]) ){
+    for(i=0; i<lemp->nterminal; i++) aSym[i] = 1;
+  }
+  for(i=n=0; i<lemp->nterminal; i++){
+    aNeed[i] = aSym[i];
+    if( i>0 && !aSym[i] ) n++;
+  }
+  lemon_free(lemp, aSym);
+  return n;
+}
+
+/*
+** Tell yy_shift() which token values it need not store.  YYTOKENVALUES
+** is 0 if no token value is ever used, and 2 if only some of them are,
+** in which case YYTOKENVALUE_LIST initializes a table of flags, one for
+** each token.  The lookup in that table is not worth it for token types
+** no larger than a pointer, which are always stored.  So are the tokens
+** of the shared engine of -G.
+*/
+PRIVATE void print_token_values(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno                /* Pointer to the line number */
+){
+  int lineno = *plineno;
+  char *aNeed;
+  int i, n, sz;
+
+  lemp->nTokenNoValue = 0;
+  if( lemp->sharedEngine ) return;
+  aNeed = (char*)lemon_calloc(lemp, lemp->nterminal+1, 1);
+  n = token_values(lemp, aNeed);
+  sz = type_size(lemp->tokentype ? lemp->tokentype : "void*");
+  if( n==lemp->nterminal-1 ){
+    fprintf(out,"#define YYTOKENVALUES 0\n");  lineno++;
+    lemp->nTokenNoValue = n;
+  }else if( n>0 && (sz<0 || sz>(int)sizeof(void*)) ){
+    fprintf(out,"#define YYTOKENVALUES 2\n");  lineno++;
+    fprintf(out,"#define YYTOKENVALUE_LIST \\\n "); lineno++;
+    for(i=0; i<lemp->nterminal; i++){
+      fprintf(out," %d,",aNeed[i]);
+      if( (i%20)==19 && i<lemp->nterminal-1 ){
+        fprintf(out," \\\n "); lineno++;
+      }
+    }
+    fprintf(out,"\n"); lineno++;
+    lemp->nTokenNoValue = n;
+  }
+  lemon_free(lemp, aNeed);
+  *plineno = lineno;
+}
+
+/*
+** Generate the control #defines that come ahead of the parsing tables:
+** the code and action types, the stack union and the macros for the
+** %extra_argument and %extra_context.  The sizes of YYCODETYPE and
+** YYACTIONTYPE are written into *pszCodeType and *pszActionType.
+*/
+PRIVATE void print_control_defines(
+  FILE *out,                  /* The output stream */
+  struct lemon *lemp,         /* The main info structure for this parser */
+  int *plineno,               /* Pointer to the line number */
+  int mhflag,                 /* True if generating makeheaders output */
+  int *pszCodeType,           /* OUT: sizeof(YYCODETYPE) */
+  int *pszActionType          /* OUT: sizeof(YYACTIONTYPE) */
+){
+  int lineno = *plineno;
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int i;
+
+  if( lemp->sharedEngine ){
+    /* The types of the shared engine, which lemengine.h fixes */
+    fprintf(out,"#define YYCODETYPE unsigned short\n"); lineno++;
+    fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
+    fprintf(out,"#define YYACTIONTYPE unsigned short\n"); lineno++;
+    *pszCodeType = *pszActionType = 2;
+  }else{
+    fprintf(out,"#define YYCODETYPE %s\n",
+      minimum_size_type(0, lemp->nsymbol, pszCodeType)); lineno++;
+    fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
+    fprintf(out,"#define YYACTIONTYPE %s\n",
+      minimum_size_type(0,lemp->maxAction,pszActionType)); lineno++;
+  }
+  if( lemp->wildcard ){
+    fprintf(out,"#define YYWILDCARD %d\n",
+       lemp->wildcard->index); lineno++;
+  }
+  print_stack_union(out,lemp,&lineno,mhflag,*pszCodeType+*pszActionType);
+  fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
+  if( lemp->stacksize ){
+    fprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
+  }else{
+    fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
+  }
+  fprintf(out, "#endif\n"); lineno++;
+  if( mhflag ){
+    fprintf(out,"#if INTERFACE\n"); lineno++;
+  }
+  if( lemp->arg && lemp->arg[0] ){
+    i = lemonStrlen(lemp->arg);
+    while( i>=1 && ISSPACE(lemp->arg[i-1]) ) i--;
+    while( i>=1 && (ISALNUM(lemp->arg[i-1]) || lemp->arg[i-1]=='_') ) i--;
+    fprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
+    fprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
+    fprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
+    fprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
+                 name,lemp->arg,&lemp->arg[i]);  lineno++;
+    fprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
+                 name,&lemp->arg[i],&lemp->arg[i]);  lineno++;
+  }else{
+    fprintf(out,"#define %sARG_SDECL\n",name); lineno++;
+    fprintf(out,"#define %sARG_PDECL\n",name); lineno++;
+    fprintf(out,"#define %sARG_PARAM\n",name); lineno++;
+    fprintf(out,"#define %sARG_FETCH\n",name); lineno++;
+    fprintf(out,"#define %sARG_STORE\n",name); lineno++;
+  }
+  if( lemp->ctx && lemp->ctx[0] ){
+    i = lemonStrlen(lemp->ctx);
+    while( i>=1 && ISSPACE(lemp->ctx[i-1]) ) i--;
+    while( i>=1 && (ISALNUM(lemp->ctx[i-1]) || lemp->ctx[i-1]=='_') ) i--;
+    fprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
+    fprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
+    fprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
+    fprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
+                 name,lemp->ctx,&lemp->ctx[i]);  lineno++;
+    fprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
+                 name,&lemp->ctx[i],&lemp->ctx[i]);  lineno++;
+  }else{
+    fprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
+    fprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
+    fprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
+    fprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
+    fprintf(out,"#define %sCTX_STORE\n",name); lineno++;
+  }
+  if( mhflag ){
+    fprintf(out,"#endif\n"); lineno++;
+  }
+  if( lemp->errsym && lemp->errsym->useCnt ){
+    fprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
+    fprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
+  }
+  if( lemp->has_fallback ){
+    fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
+  }
+  if( lemp->foldFallback && (lemp->has_fallback || lemp->wildcard) ){
+    fprintf(out,"#define YYFOLDED 1\n");  lineno++;
+  }
+  if( lemp->blobTables ){
+    fprintf(out,"#define YY_LOADED_TABLES 1\n");  lineno++;
+  }
+  if( lemp->sharedEngine ){
+    fprintf(out,"#define YY_SHARED_ENGINE 1\n");  lineno++;
+  }
+  if( lemp->stackArrays ){
+    fprintf(out,"#define YY_STACK_ARRAYS 1\n");  lineno++;
+  }
+  if( lemp->has_arena ){
+    fprintf(out,"#define YYARENA 1\n");  lineno++;
+  }
+  print_token_values(out,lemp,&lineno);
+  *plineno = lineno;
+}
+
+/*
+** The -u option splits the generated parser into several translation
+** units.  Unit 0 is the usual *.c file.  It keeps the tables, the driver
+** and every reduce action that needs something private to it.  The other
+** reduce actions are spread over units 1 through nUnit-1, named *_1.c,
+** *_2.c and so on.  Each of those holds one function that the switch in
+** yy_reduce() calls for the rules assigned to that unit.
+*/
+
+/* Return true if the reduce code for rp can move out of unit 0.  Code
+** that uses yypParser, including calls to yy_destructor() for unused
+** right-hand side values, must stay where the parser is visible.
+*/
+PRIVATE int unit_movable(struct rule *rp){
+  if( rp->noCode ) return 0;
+  if( strstr(rp->code, "yypParser") ) return 0;
+  if( rp->codePrefix && strstr(rp->codePrefix, "yypParser") ) return 0;
+  if( rp->codeSuffix && strstr(rp->codeSuffix, "yypParser") ) return 0;
+  return 1;
+}
+
+/* The number of bytes of reduce code for rp */
+PRIVATE int unit_code_size(struct rule *rp){
+  int n = lemonStrlen(rp->code);
+  if( rp->codePrefix ) n += lemonStrlen(rp->codePrefix);
+  if( rp->codeSuffix ) n += lemonStrlen(rp->codeSuffix);
+  return n;
+}
+
+/* Compare two rules for the order in which unit_assign() places them:
+** the most code first, then in rule order */
+static int unit_rule_cmp(const void *a, const void *b){
+  struct rule *p1 = *(struct rule**)a;
+  struct rule *p2 = *(struct rule**)b;
+  int c = unit_code_size(p2) - unit_code_size(p1);
+  if( c==0 ) c = p1->iRule - p2->iRule;
+  return c;
+}
+
+/* Set the iUnit field of every rule.  Rules that share the same code
+** stay together so that their cases can still be merged.  Each group
+** goes, largest first, to the unit holding the least code so far.  There
+** are never more units than groups, plus unit 0.  Return the number of
+** units used.
+*/
+PRIVATE int unit_assign(struct lemon *lemp, int nUnit){
+  struct rule **aGroup;     /* First rule of each group that can move */
+  int *aLoad;               /* Bytes of code assigned to each unit */
+  int nGroup = 0;
+  struct rule *rp, *rp2;
+  int i, k;
+
+  aGroup = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(aGroup[0]));
+  for(rp=lemp->rule; rp; rp=rp->next) rp->iUnit = 0;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit || !unit_movable(rp) ) continue;
+    aGroup[nGroup++] = rp;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        rp2->iUnit = -1;
+      }
+    }
+  }
+  if( nGroup+1<nUnit ){
+    fprintf(lemp->errstream,
+            "Only %d distinct reduce action%s can move out of the main "
+            "file.  "
+            "Using -u%d instead of -u%d.\n",
+            nGroup, nGroup==1 ? "" : "s", nGroup+1, nUnit);
+    nUnit = nGroup+1;
+  }
+  aLoad = (int*)lemon_calloc(lemp, nUnit, sizeof(aLoad[0]));
+  qsort(aGroup, nGroup, sizeof(aGroup[0]), unit_rule_cmp);
+  for(i=0; i<nGroup; i++){
+    int iBest = 1;
+    for(k=2; k<nUnit; k++){
+      if( aLoad[k]<aLoad[iBest] ) iBest = k;
+    }
+    rp = aGroup[i];
+    aLoad[iBest] += unit_code_size(rp);
+    rp->iUnit = iBest;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        rp2->iUnit = iBest;
+      }
+    }
+  }
+  lemon_free(lemp, aLoad);
+  lemon_free(lemp, aGroup);
+  return nUnit;
+}
+
+/* Show the size of one translation unit */
+PRIVATE void unit_report(
+  struct lemon *lemp,
+  int iUnit,                  /* Which unit */
+  const char *zFile,          /* Name of the file holding the unit */
+  int nAction,                /* Number of reduce actions in the unit */
+  int nLine,                  /* Lines of code */
+  long nByte                  /* Bytes of code */
+){
+  if( iUnit==0 ){
+    fprintf(lemp->outstream, "Translation units:\n");
+    fprintf(lemp->outstream, "  %4s  %-30s %8s %8s %10s\n", "unit", "file",
+            "actions", "lines", "bytes");
+  }
+  fprintf(lemp->outstream, "  %4d  %-30s %8d %8d %10ld\n", iUnit,
+          zFile, nAction, nLine, nByte);
+}
+
+/*
+** Write "(void)X;" for the name X of the parameter declared by zDecl,
+** an %extra_argument or %extra_context, which some code may not use.
+*/
+PRIVATE void print_void_param(FILE *out, const char *zDecl, int *plineno){
+  int i, n;
+  if( zDecl==0 || zDecl[0]==0 ) return;
+  i = lemonStrlen(zDecl);
+  while( i>=1 && ISSPACE(zDecl[i-1]) ) i--;
+  n = i;
+  while( i>=1 && (ISALNUM(zDecl[i-1]) || zDecl[i-1]=='_') ) i--;
+  if( n>i ){
+    fprintf(out, "  (void)%.*s;\n", n-i, &zDecl[i]); (*plineno)++;
+  }
+}
+
+/*
+** Write unit iUnit of a parser that is split nUnit ways, and show
+** its size.
+*/
+PRIVATE void unit_write(struct lemon *lemp, int iUnit, int nUnit){
+  const char *name = lemp->name ? lemp->name : "Parse";
+  char zSuffix[20];
+  FILE *out;
+  int lineno;
+  int szCodeType, szActionType;
+  int nAction = 0;
+  char *aDone;                /* True for rules already written */
+  struct rule *rp, *rp2;
+
+  lemon_sprintf(zSuffix, "_%d.c", iUnit);
+  out = file_open(lemp, zSuffix, "wb");
+  if( out==0 ) return;
+  lineno = 1;
+  fprintf(out,
+     "/* This file is automatically generated by Lemon from input grammar\n"
+     "** source file \"%s\".  It holds reduce actions for unit %d of %d\n"
+     "** of the parser. */\n", lemp->filename, iUnit, nUnit); lineno += 3;
+  /* The %include code can test YY_UNIT to leave out its definitions */
+  fprintf(out, "#define YY_UNIT %d\n", iUnit); lineno++;
+  if( lemp->include[0] ) tplt_print(out,lemp,lemp->include,&lineno);
+  print_token_defines(out,lemp,&lineno,0);
+  print_control_defines(out,lemp,&lineno,0,&szCodeType,&szActionType);
+  fprintf(out,
+     "#ifndef yytestcase\n"
+     "# define yytestcase(X)\n"
+     "#endif\n"
+     "#include <assert.h>\n"
+     "\n"
+     "/* An element of the parser's stack.  This must match the definition\n"
+     "** in the driver template. */\n"
+     "typedef struct yyStackEntry yyStackEntry;\n"
+     "struct yyStackEntry {\n"
+     "  YYACTIONTYPE stateno;\n"
+     "  YYCODETYPE major;\n"); lineno += 11;
+  if( !lemp->stackArrays ){
+    fprintf(out, "  YYMINORTYPE minor;\n"); lineno++;
+  }
+  fprintf(out, "};\n\n"); lineno += 2;
+  fprintf(out,
+     "/* Perform the reduce actions of this unit for yy_reduce() */\n"
+     "void %sReduce%d(\n"
+     "  yyStackEntry *yymsp,             /* The top of the parser's stack */\n",
+     name, iUnit); lineno += 3;
+  if( lemp->stackArrays ){
+    fprintf(out,
+       "  YYMINORTYPE *yyvsp,              /* Values at the top of stack */\n");
+    lineno++;
+  }
+  fprintf(out,
+     "  unsigned int yyruleno,           /* Number of the rule to reduce */\n"
+     "  int yyLookahead,                 /* Lookahead token, or YYNOCODE */\n"
+     "  %sTOKENTYPE yyLookaheadToken  /* Value of the lookahead token */\n"
+     "  %sARG_PDECL                   /* %%extra_argument */\n"
+     "  %sCTX_PDECL                   /* %%extra_context */\n"
+     "){\n"
+     "  (void)yymsp;\n"
+     "%s"
+     "  (void)yyLookahead;\n"
+     "  (void)yyLookaheadToken;\n", name, name, name,
+     lemp->stackArrays ? "  (void)yyvsp;\n" : "");
+  lineno += 9 + lemp->stackArrays;
+  print_void_param(out, lemp->arg, &lineno);
+  print_void_param(out, lemp->ctx, &lineno);
+  fprintf(out, "  switch( yyruleno ){\n"); lineno++;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit==iUnit && rp->lhsMinor ){
+      fprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
+      break;
+    }
+  }
+  aDone = (char*)lemon_calloc(lemp, lemp->nrule, 1);
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iUnit!=iUnit || aDone[rp->iRule] ) continue;
+    fprintf(out,"      case %d: /* ", rp->iRule);
+    writeRuleText(out, rp);
+    fprintf(out, " */\n"); lineno++;
+    nAction++;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        fprintf(out,"      case %d: /* ", rp2->iRule);
+        writeRuleText(out, rp2);
+        fprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
+        aDone[rp2->iRule] = 1;
+        nAction++;
+      }
+    }
+    emit_code(out,rp,lemp,&lineno);
+    fprintf(out,"        break;\n"); lineno++;
+  }
+  lemon_free(lemp, aDone);
+  fprintf(out,"  }\n}\n"); lineno += 2;
+  unit_report(lemp, iUnit, lemp->outname, nAction, lineno-1, ftell(out));
+  file_close(lemp, out);
+}
+
+/* Write the start of the case of rule rp in the switch of yy_reduce(),
+** up to the text of the rule, with the label of the rule for -Rgoto */
+PRIVATE void print_reduce_case(FILE *out, struct lemon *lemp,
+                               struct rule *rp){
+  fprintf(out,"      case %d: ", rp->iRule);
+  if( lemp->dispatch==DSP_GOTO ) fprintf(out, "yy_rule_%d: ", rp->iRule);
+  fprintf(out, "/* ");
+  writeRuleText(out, rp);
+}
+
+/* The share of the reduces in the profile (-P) that the hot rules cover */
+#define HOT_RULE_SHARE 0.99
+
+/* Compare two rules so that the one reduced most often sorts first */
+static int rule_reduce_cmp(const void *a, const void *b){
+  const struct rule *p1 = *(const struct rule**)a;
+  const struct rule *p2 = *(const struct rule**)b;
+  if( p1->nReduce!=p2->nReduce ) return p1->nReduce<p2->nReduce ? 1 : -1;
+  return p1->iRule - p2->iRule;
+}
+
+/*
+** Choose which reduce actions are cold, from the reduces counted by the
+** profile (-P).  The rules of yy_reduce() that are reduced most often,
+** as many as it takes to cover HOT_RULE_SHARE of the reduces, are hot
+** and keep their code in the switch.  The code of the others moves out
+** of line into cold functions.  Rules that share their code are hot if
+** any one of them is.  The hot rules are listed on the standard output.
+*/
+PRIVATE void choose_cold_rules(struct lemon *lemp){
+  struct rule **apRule;       /* Rules with code in yy_reduce() */
+  struct rule *rp, *rp2;
+  double rTotal = 0.0;        /* Reduces by all rules of apRule[] */
+  double rHot = 0.0;          /* Reduces by the hot rules */
+  int n = 0;
+  int i;
+
+  if( lemp->nreduceprofiled<=0.0 ) return;
+  apRule = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(apRule[0]));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->noCode || rp->iUnit ) continue;
+    apRule[n++] = rp;
+    rTotal += rp->nReduce;
+  }
+  qsort(apRule, n, sizeof(apRule[0]), rule_reduce_cmp);
+  for(i=0; i<n && rHot<rTotal*HOT_RULE_SHARE; i++) rHot += apRule[i]->nReduce;
+  for(; i<n; i++) apRule[i]->isCold = 1;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( !rp->isCold ) continue;
+    for(rp2=lemp->rule; rp2; rp2=rp2->next){
+      if( rp2!=rp && !rp2->isCold && !rp2->noCode && rp2->iUnit==0
+       && rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+       && rp2->codeSuffix==rp->codeSuffix ){
+        rp->isCold = 0;
+        break;
+      }
+    }
+  }
+
+  fprintf(lemp->outstream, "Hot rules, kept in yy_reduce() by the profile:\n");
+  for(i=0; i<n; i++){
+    rp = apRule[i];
+    if( rp->isCold ){
+      lemp->ncold++;
+      continue;
+    }
+    fprintf(lemp->outstream, "  %12.0f  (%d) ", rp->nReduce, rp->iRule);
+    writeRuleText(lemp->outstream, rp);
+    fprintf(lemp->outstream, "\n");
+  }
+  fprintf(lemp->outstream,
+          "%d of %d rules with code moved to cold functions.\n",
+          lemp->ncold, n);
+  lemon_free(lemp, apRule);
+}
+
+/*
+** Write the reduce actions as static functions, for -Rfunction.  There
+** is one function for each group of rules that share their code, and
+** one for each unit of a split parser (-u) that calls the function of
+** that unit.  The table yy_reduce_func[] then holds the function of
+** each rule, or NULL for a rule without code.
+**
+** The functions of cold rules (-P) are marked YY_COLD.  With the other
+** dispatches, only those functions are written, and the switch in
+** yy_reduce() calls them.
+*/
+PRIVATE void emit_reduce_functions(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int nUnit
+){
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int *aFunc;                 /* Function of each rule: -1 for none, the
+                              ** first rule of its group, or -2-iUnit */
+  struct rule *rp, *rp2;
+  int allFuncs = lemp->dispatch==DSP_FUNCTION;
+  int nV = lemp->stackArrays;  /* With -A, yyvsp goes along with yymsp */
+  const char *zVType = nV ? "YYMINORTYPE*," : "";
+  const char *zVDecl = nV ? "  YYMINORTYPE *yyvsp,\n" : "";
+  const char *zVArg = nV ? "yyvsp," : "";
+  int i;
+
+  aFunc = (int*)lemon_calloc(lemp, lemp->nrule, sizeof(int));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    aFunc[rp->iRule] = rp->iUnit ? -2-rp->iUnit : -1;
+  }
+  if( lemp->ncold ){
+    fprintf(out, "#if defined(__GNUC__)\n"
+                 "# define YY_COLD __attribute__((cold,noinline))\n"
+                 "#else\n"
+                 "# define YY_COLD\n"
+                 "#endif\n"); (*plineno) += 5;
+  }
+  if( allFuncs ){
+    fprintf(out, "#define YY_REDUCE_FUNCS 1\n"); (*plineno)++;
+    fprintf(out, "typedef void (*yyReduceFunc)(yyParser*,yyStackEntry*,%s"
+                 "unsigned int,int,\n                             "
+                 "%sTOKENTYPE %sCTX_PDECL);\n", zVType, name, name);
+    (*plineno) += 2;
+  }
+
+  /* The functions that call into the other units */
+  for(i=1; i<nUnit && allFuncs; i++){
+    for(rp=lemp->rule; rp && rp->iUnit!=i; rp=rp->next){}
+    if( rp==0 ) continue;
+    fprintf(out,
+       "void %sReduce%d(yyStackEntry*,%sunsigned int,int,"
+       "%sTOKENTYPE %sARG_PDECL %sCTX_PDECL);\n"
+       "static void yy_unit_%d(\n"
+       "  yyParser *yypParser,\n"
+       "  yyStackEntry *yymsp,\n"
+       "%s"
+       "  unsigned int yyruleno,\n"
+       "  int yyLookahead,\n"
+       "  %sTOKENTYPE yyLookaheadToken\n"
+       "  %sCTX_PDECL\n"
+       "){\n"
+       "  %sARG_FETCH\n"
+       "  (void)yypParser;\n"
+       "  %sReduce%d(yymsp,%syyruleno,yyLookahead,yyLookaheadToken"
+       " %sARG_PARAM %sCTX_PARAM);\n"
+       "}\n",
+       name, i, zVType, name, name, name, i, zVDecl, name, name, name,
+       name, i, zVArg, name, name);
+    (*plineno) += 13 + nV;
+  }
+
+  /* One function for each group of rules with the same code */
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->noCode || rp->iUnit || aFunc[rp->iRule]>=0 ) continue;
+    if( !allFuncs && !rp->isCold ) continue;
+    fprintf(out, "/* ");
+    writeRuleText(out, rp);
+    fprintf(out, " */\n"); (*plineno)++;
+    fprintf(out, "static %svoid yy_rule_%d(\n",
+       rp->isCold ? "YY_COLD " : "", rp->iRule);
+    fprintf(out,
+       "  yyParser *yypParser,\n"
+       "  yyStackEntry *yymsp,\n"
+       "%s"
+       "  unsigned int yyruleno,\n"
+       "  int yyLookahead,\n"
+       "  %sTOKENTYPE yyLookaheadToken\n", zVDecl, name);
+    (*plineno) += 6 + nV;
+    if( !allFuncs ){
+      /* Called from the switch, which passes the %extra_argument */
+      fprintf(out, "  %sARG_PDECL\n", name); (*plineno)++;
+    }
+    fprintf(out, "  %sCTX_PDECL\n){\n", name); (*plineno) += 2;
+    if( rp->lhsMinor ){
+      fprintf(out, "  YYMINORTYPE yylhsminor;\n"); (*plineno)++;
+    }
+    if( allFuncs ){
+      fprintf(out, "  %sARG_FETCH\n", name); (*plineno)++;
+    }
+    fprintf(out,
+       "  (void)yypParser;\n"
+       "  (void)yymsp;\n"
+       "%s"
+       "  (void)yyruleno;\n"
+       "  (void)yyLookahead;\n"
+       "  (void)yyLookaheadToken;\n", nV ? "  (void)yyvsp;\n" : "");
+    (*plineno) += 5 + nV;
+    print_void_param(out, lemp->arg, plineno);
+    print_void_param(out, lemp->ctx, plineno);
+    aFunc[rp->iRule] = rp->iRule;
+    for(rp2=rp->next; rp2; rp2=rp2->next){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        fprintf(out, "  yytestcase(yyruleno==%d); /* ", rp2->iRule);
+        writeRuleText(out, rp2);
+        fprintf(out, " */\n"); (*plineno)++;
+        aFunc[rp2->iRule] = rp->iRule;
+        if( allFuncs ) rp2->codeEmitted = 1;
+      }
+    }
+    emit_code(out, rp, lemp, plineno);
+    fprintf(out, "}\n"); (*plineno)++;
+    if( allFuncs ) rp->codeEmitted = 1;
+  }
+  if( !allFuncs ){
+    lemon_free(lemp, aFunc);
+    return;
+  }
+
+  /* The function for each rule */
+  fprintf(out, "static const yyReduceFunc yy_reduce_func[] = {\n");
+  (*plineno)++;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    int k = aFunc[rp->iRule];
+    if( k>=0 ){
+      fprintf(out, "  yy_rule_%d,  /* (%d) ", k, rp->iRule);
+    }else if( k==-1 ){
+      fprintf(out, "  0,  /* (%d) ", rp->iRule);
+    }else{
+      fprintf(out, "  yy_unit_%d,  /* (%d) ", -2-k, rp->iRule);
+      rp->codeEmitted = 1;
+    }
+    rule_print(out, rp);
+    fprintf(out, " */\n"); (*plineno)++;
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemon_free(lemp, aFunc);
+}
+
+/*
+** Write the labels of the reduce actions, for -Rgoto.  yy_reduce() jumps
+** through a table of them into the switch, where each case also has the
+** label yy_rule_N.  The rules without code go to the default case.
+** Compilers without labels as values use the switch.
+*/
+PRIVATE void emit_reduce_labels(struct lemon *lemp, FILE *out, int *plineno){
+  struct rule *rp;
+  int j = 0;
+
+  fprintf(out, "#if defined(__GNUC__)\n"
+               "# define YY_REDUCE_GOTO 1\n"
+               "#endif\n"
+               "#define YY_REDUCE_LABELS"); (*plineno) += 3;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( j==0 ){ fprintf(out, " \\\n "); (*plineno)++; }
+    if( rp->noCode ){
+      fprintf(out, " &&yy_reduce_default,");
+    }else{
+      fprintf(out, " &&yy_rule_%d,", rp->iRule);
+    }
+    j = (j+1)%4;
+  }
+  fprintf(out, "\n"); (*plineno)++;
+}
+
+/* The names of the table encodings, in the order of enum e_encoding */
+static const char *const azEncoding[] = {
+  "comb", "dense", "hash", "code", "pair", "packed"
+};
+
+/* Return the ENC_* value for the table encoding named zName, or -1 if
+** there is no such encoding.
+*/
+int encoding_find(const char *zName){
+  int i;
+  for(i=0; i<(int)(sizeof(azEncoding)/sizeof(azEncoding[0])); i++){
+    if( strcmp(zName, azEncoding[i])==0 ) return i;
+  }
+  return -1;
+}
+
+/* The names of the reduce dispatches, in the order of enum e_dispatch */
+static const char *const azDispatch[] = {
+  "switch", "function", "goto"
+};
+
+/* Return the DSP_* value for the reduce dispatch named zName, or -1 if
+** there is no such dispatch.
+*/
+int dispatch_find(const char *zName){
+  int i;
+  for(i=0; i<(int)(sizeof(azDispatch)/sizeof(azDispatch[0])); i++){
+    if( strcmp(zName, azDispatch[i])==0 ) return i;
+  }
+  return -1;
+}
+
+/* Output entry i of an n-entry table of integers, ten to a line */
+PRIVATE void print_entry(FILE *out, int i, int n, int v, int *pj, int *plineno){
+  if( *pj==0 ) fprintf(out," /* %5d */ ", i);
+  fprintf(out, " %4d,", v);
+  if( *pj==9 || i==n-1 ){
+    fprintf(out, "\n"); (*plineno)++;
+    *pj = 0;
+  }else{
+    (*pj)++;
+  }
+}
+
+/* Return the action of state stp for a look-ahead symbol that has no
+** action of its own.
+*/
+PRIVATE int default_action(struct lemon *lemp, struct state *stp){
+  if( stp->iDfltReduce<0 ) return lemp->errAction;
+  return stp->iDfltReduce + lemp->minReduce;
+}
+
+/* Return true if the dense encoding must mark missing terminal entries
+** with YY_NO_ACTION, because %fallback or %wildcard is to be tried before
+** the default action of the state.
+*/
+PRIVATE int dense_needs_check(struct lemon *lemp){
+  if( lemp->foldFallback ) return 0;
+  return lemp->has_fallback || lemp->wildcard!=0;
+}
+
+/* Output the parsing tables in the dense encoding (-edense).  yy_action[]
+** holds the action of every state for every terminal, and yy_goto[] for
+** every non-terminal, so that a look-up is a single load with no check.
+** Entries without an action of their own hold the default action of the
+** state, or YY_NO_ACTION where dense_needs_check() says so.
+*/
+PRIVATE void emit_dense_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType
+){
+  int *aRow = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int nNt = lemp->nsymbol - lemp->nterminal;
+  int i, j, k, n;
+  struct state *stp;
+  struct action *ap;
+
+  fprintf(out, "#define YY_DENSE_TABLES 1\n"); (*plineno)++;
+  n = lemp->nxstate*lemp->nterminal;
+  fprintf(out, "static const YYACTIONTYPE yy_action[] = {\n"); (*plineno)++;
+  for(i=j=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(k=0; k<lemp->nterminal; k++){
+      aRow[k] = dense_needs_check(lemp) ? lemp->noAction
+                                        : default_action(lemp, stp);
+    }
+    for(ap=stp->ap; ap; ap=ap->next){
+      int action;
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      action = compute_action(lemp, ap);
+      if( action>=0 ) aRow[ap->sp->index] = action;
+    }
+    for(k=0; k<lemp->nterminal; k++){
+      print_entry(out, i*lemp->nterminal+k, n, aRow[k], &j, plineno);
+    }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab = n;
+  lemp->tablesize += n*szActionType;
+
+  n = lemp->nxstate*nNt;
+  fprintf(out, "static const YYACTIONTYPE yy_goto[] = {\n"); (*plineno)++;
+  for(i=j=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(k=0; k<nNt; k++) aRow[k] = default_action(lemp, stp);
+    for(ap=stp->ap; ap; ap=ap->next){
+      int action;
+      if( ap->sp->index<lemp->nterminal ) continue;
+      if( ap->sp->index==lemp->nsymbol ) continue;
+      action = compute_action(lemp, ap);
+      if( action>=0 ) aRow[ap->sp->index - lemp->nterminal] = action;
+    }
+    for(k=0; k<nNt; k++){
+      print_entry(out, i*nNt+k, n, aRow[k], &j, plineno);
+    }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab += n;
+  lemp->nlookaheadtab = 0;
+  lemp->tablesize += n*szActionType;
+  lemon_free(lemp, aRow);
+}
+
+/* The hashed encoding (-ehash) gives every state a row of its own in
+** yy_action[] and yy_lookahead[] for its terminals, and another for its
+** non-terminals.  A row has 2**K entries, and symbol X goes into entry
+** ((X*M) & 0xffff) >> (16-K) of the row.  The multiplier M is chosen for
+** each row so that none of its symbols collide, and is stored as (M<<5)|K
+** in yy_shift_hash[] or yy_reduce_hash[].  Entry 0 of the tables is a row
+** with one unused entry, shared by every empty row.
+*/
+#define HASH_ENTRY(P,X) \
+    ((int)((((unsigned)(X)*((unsigned)(P)>>5))&0xffff)>>(16-((P)&31))))
+#define HASH_MAX_MULT  256    /* Odd multipliers tried for each row size */
+
+/* The tables of the hashed encoding */
+struct hash_tables {
+  int nEntry;              /* Entries in aAction[] and aLookahead[] */
+  int nAlloc;              /* Space allocated for aAction[] and aLookahead[] */
+  int *aAction;            /* yy_action[] */
+  int *aLookahead;         /* yy_lookahead[] */
+  int *aTknOfst;           /* yy_shift_ofst[] */
+  int *aTknHash;           /* yy_shift_hash[] */
+  int *aNtOfst;            /* yy_reduce_ofst[] */
+  int *aNtHash;            /* yy_reduce_hash[] */
+  int mxHash;              /* Largest value in aTknHash[] and aNtHash[] */
+};
+
+/* Find the hash parameter for a row holding the n symbols aX[], none of
+** which is larger than mxX.  aUsed[] is scratch space for 65536 ints.
+** A row of 2**K entries with K large enough for every symbol to fit, and
+** M equal to 2**(16-K), places every symbol at its own index, so the
+** search always ends.
+*/
+PRIVATE int hash_param(const int *aX, int n, int mxX, int *aUsed){
+  int k, m, i;
+  for(k=0; (1<<k)<n; k++){}
+  for(;; k++){
+    for(m=1; m<HASH_MAX_MULT; m+=2){
+      int p = (m<<5)|k;
+      memset(aUsed, 0, sizeof(int)<<k);
+      for(i=0; i<n && !aUsed[HASH_ENTRY(p,aX[i])]; i++){
+        aUsed[HASH_ENTRY(p,aX[i])] = 1;
+      }
+      if( i==n ) return p;
+    }
+    if( (1<<k)>mxX ) return ((1<<(16-k))<<5)|k;
+  }
+}
+
+/* Add a row for the n symbols in aX[], with actions aAct[], to the
+** hashed tables.  Write its offset and hash parameter into *pOfst and
+** *pHash.
+*/
+PRIVATE void hash_add_row(
+  struct lemon *lemp,
+  struct hash_tables *p,
+  const int *aX, const int *aAct, int n,
+  int *aUsed,
+  int *pOfst, int *pHash
+){
+  int i, mxX = 0, param, sz;
+  if( n==0 ){
+    *pOfst = 0;
+    *pHash = 0;
+    return;
+  }
+  for(i=0; i<n; i++) if( aX[i]>mxX ) mxX = aX[i];
+  param = hash_param(aX, n, mxX, aUsed);
+  sz = 1<<(param&31);
+  if( p->nEntry+sz>p->nAlloc ){
+    p->nAlloc = (p->nEntry+sz)*2;
+    p->aAction = (int*)lemon_realloc(lemp, p->aAction, sizeof(int)*p->nAlloc);
+    p->aLookahead = (int*)lemon_realloc(lemp, p->aLookahead,
+                                        sizeof(int)*p->nAlloc);
+  }
+  for(i=0; i<sz; i++){
+    p->aAction[p->nEntry+i] = lemp->noAction;
+    p->aLookahead[p->nEntry+i] = lemp->nsymbol;
+  }
+  for(i=0; i<n; i++){
+    int k = p->nEntry + HASH_ENTRY(param, aX[i]);
+    p->aAction[k] = aAct[i];
+    p->aLookahead[k] = aX[i];
+  }
+  *pOfst = p->nEntry;
+  *pHash = param;
+  if( param>p->mxHash ) p->mxHash = param;
+  p->nEntry += sz;
+}
+
+/* Build the tables of the hashed encoding.  The symbols of the grammar
+** must fit in 16 bits.
+*/
+PRIVATE void hash_build(struct lemon *lemp, struct hash_tables *p){
+  int *aX = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aAct = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aUsed = (int*)lemon_malloc(lemp, sizeof(int)*65536);
+  int i, n, isTkn;
+  struct action *ap;
+
+  assert( lemp->nsymbol<65536 );
+  memset(p, 0, sizeof(*p));
+  p->aTknOfst = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aTknHash = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aNtOfst = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->aNtHash = (int*)lemon_calloc(lemp, lemp->nxstate, sizeof(int));
+  p->nAlloc = 1024;
+  p->aAction = (int*)lemon_malloc(lemp, sizeof(int)*p->nAlloc);
+  p->aLookahead = (int*)lemon_malloc(lemp, sizeof(int)*p->nAlloc);
+  p->aAction[0] = lemp->noAction;
+  p->aLookahead[0] = lemp->nsymbol;
+  p->nEntry = 1;
+  for(i=0; i<lemp->nxstate; i++){
+    for(isTkn=1; isTkn>=0; isTkn--){
+      n = 0;
+      for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+        int action, x = ap->sp->index;
+        if( (x<lemp->nterminal)!=isTkn || x==lemp->nsymbol ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 ) continue;
+        aX[n] = x;
+        aAct[n++] = action;
+      }
+      if( isTkn ){
+        hash_add_row(lemp, p, aX, aAct, n, aUsed,
+                     &p->aTknOfst[i], &p->aTknHash[i]);
+      }else{
+        hash_add_row(lemp, p, aX, aAct, n, aUsed,
+                     &p->aNtOfst[i], &p->aNtHash[i]);
+      }
+    }
+  }
+  lemon_free(lemp, aX);
+  lemon_free(lemp, aAct);
+  lemon_free(lemp, aUsed);
+}
+
+/* Release the tables built by hash_build() */
+PRIVATE void hash_free(struct lemon *lemp, struct hash_tables *p){
+  lemon_free(lemp, p->aAction);
+  lemon_free(lemp, p->aLookahead);
+  lemon_free(lemp, p->aTknOfst);
+  lemon_free(lemp, p->aTknHash);
+  lemon_free(lemp, p->aNtOfst);
+  lemon_free(lemp, p->aNtHash);
+}
+
+/* Return the number of bytes in the tables of the hashed encoding, not
+** counting yy_default[].
 */
-static const char *minimum_size_type(int lwr, int upr, int *pnByte){
-  const char *zType = "int";
-  int nByte = 4;
-  if( lwr>=0 ){
-    if( upr<=255 ){
-      zType = "unsigned char";
-      nByte = 1;
-    }else if( upr<65535 ){
-      zType = "unsigned short int";
-      nByte = 2;
-    }else{
-      zType = "unsigned int";
-      nByte = 4;
+PRIVATE int hash_size(
+  struct lemon *lemp,
+  struct hash_tables *p,
+  int szActionType,
+  int szCodeType
+){
+  int szOfst, szHash;
+  minimum_size_type(0, p->nEntry, &szOfst);
+  minimum_size_type(0, p->mxHash, &szHash);
+  return p->nEntry*(szActionType+szCodeType)
+         + lemp->nxstate*2*(szOfst+szHash);
+}
+
+/* Output the parsing tables in the hashed encoding (-ehash) */
+PRIVATE void emit_hash_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType,
+  int szCodeType
+){
+  struct hash_tables ht;
+  const char *zOfst, *zHash;
+  int i, j, n;
+
+  hash_build(lemp, &ht);
+  zOfst = minimum_size_type(0, ht.nEntry, 0);
+  zHash = minimum_size_type(0, ht.mxHash, 0);
+  fprintf(out, "#define YY_HASHED_TABLES 1\n"); (*plineno)++;
+  n = ht.nEntry;
+  fprintf(out, "static const YYACTIONTYPE yy_action[] = {\n"); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aAction[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const YYCODETYPE yy_lookahead[] = {\n"); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aLookahead[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  n = lemp->nxstate;
+  fprintf(out, "static const %s yy_shift_ofst[] = {\n", zOfst); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aTknOfst[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_shift_hash[] = {\n", zHash); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aTknHash[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_reduce_ofst[] = {\n", zOfst); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aNtOfst[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  fprintf(out, "static const %s yy_reduce_hash[] = {\n", zHash); (*plineno)++;
+  for(i=j=0; i<n; i++) print_entry(out, i, n, ht.aNtHash[i], &j, plineno);
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->nactiontab = lemp->nlookaheadtab = ht.nEntry;
+  lemp->tablesize += hash_size(lemp, &ht, szActionType, szCodeType);
+  hash_free(lemp, &ht);
+}
+
+/* Output one case of a switch statement for each of the n symbols in
+** aX[], that returns the action in aAct[] for that symbol.  Symbols with
+** the same action share a case.  aAct[] is overwritten.
+*/
+PRIVATE void emit_code_cases(
+  FILE *out,
+  int *plineno,
+  const int *aX,
+  int *aAct,
+  int n
+){
+  int i, j, w;
+  for(i=0; i<n; i++){
+    if( aAct[i]<0 ) continue;
+    fprintf(out, "     "); w = 5;
+    for(j=i; j<n; j++){
+      if( aAct[j]!=aAct[i] ) continue;
+      if( w>64 ){
+        fprintf(out, "\n     "); (*plineno)++;
+        w = 5;
+      }
+      w += fprintf(out, " case %d:", aX[j]);
+      if( j>i ) aAct[j] = -1;
     }
-  }else if( lwr>=-127 && upr<=127 ){
-    zType = "signed char";
-    nByte = 1;
-  }else if( lwr>=-32767 && upr<32767 ){
-    zType = "short";
-    nByte = 2;
+    fprintf(out, " return %d;\n", aAct[i]); (*plineno)++;
   }
-  if( pnByte ) *pnByte = nByte;
-  return zType;
 }
 
-/*
-** Each state contains a set of token transaction and a set of
-** nonterminal transactions.  Each of these sets makes an instance
-** of the following structure.  An array of these structures is used
-** to order the creation of entries in the yy_action[] table.
+/* Output the parsing tables of the code encoding (-ecode) as a pair of
+** functions.  yy_shift_code() returns the action of a state for a
+** terminal and yy_goto_code() the action for a non-terminal, each with
+** a switch on the state and then on the symbol, so that the compiler
+** turns the tables into jumps and immediate values.  A terminal with no
+** action of its own gets the default action of the state, or else
+** YY_NO_ACTION where dense_needs_check() says so.
 */
-struct axset {
-  struct state *stp;   /* A pointer to a state */
-  int isTkn;           /* True to use tokens.  False for non-terminals */
-  int nAction;         /* Number of actions */
-  int iOrder;          /* Original order of action sets */
-};
+PRIVATE void emit_code_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  int szActionType
+){
+  int *aX = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int *aAct = (int*)lemon_malloc(lemp, sizeof(int)*(lemp->nsymbol+1));
+  int i, n, isTkn;
+  struct action *ap;
 
-/*
-** Compare to axset structures for sorting purposes
-*/
-static int axset_compare(const void *a, const void *b){
-  struct axset *p1 = (struct axset*)a;
-  struct axset *p2 = (struct axset*)b;
-  int c;
-  c = p2->nAction - p1->nAction;
-  if( c==0 ){
-    c = p1->iOrder - p2->iOrder;
+  fprintf(out, "#define YY_CODED_TABLES 1\n"); (*plineno)++;
+  for(isTkn=1; isTkn>=0; isTkn--){
+    fprintf(out, "static YYACTIONTYPE %s(YYACTIONTYPE stateno, "
+                 "YYCODETYPE iLookAhead){\n",
+            isTkn ? "yy_shift_code" : "yy_goto_code"); (*plineno)++;
+    fprintf(out, "  switch( stateno ){\n"); (*plineno)++;
+    for(i=0; i<lemp->nxstate; i++){
+      struct state *stp = lemp->sorted[i];
+      int dflt = default_action(lemp, stp);
+      if( isTkn && dense_needs_check(lemp) ) dflt = lemp->noAction;
+      n = 0;
+      for(ap=stp->ap; ap; ap=ap->next){
+        int action, x = ap->sp->index;
+        if( (x<lemp->nterminal)!=isTkn || x==lemp->nsymbol ) continue;
+        action = compute_action(lemp, ap);
+        if( action<0 || action==dflt ) continue;
+        aX[n] = x;
+        aAct[n++] = action;
+      }
+      if( n==0 ){
+        fprintf(out, "    case %d: return %d;\n", i, dflt); (*plineno)++;
+        continue;
+      }
+      fprintf(out, "    case %d: switch( iLookAhead ){\n", i); (*plineno)++;
+      emit_code_cases(out, plineno, aX, aAct, n);
+      fprintf(out, "      default: return %d;\n    }\n", dflt);
+      (*plineno) += 2;
+    }
+    fprintf(out, "  }\n  return YY_NO_ACTION;\n}\n"); (*plineno) += 3;
   }
-  assert( c!=0 || p1==p2 );
-  return c;
+  lemp->nactiontab = lemp->nlookaheadtab = 0;
+  lemp->tablesize += lemp->nxstate*szActionType;
+  lemon_free(lemp, aX);
+  lemon_free(lemp, aAct);
 }
 
-/*
-** Write text on "out" that describes the rule "rp".
+/* Return the size of a struct with fields of nA, nB and nC bytes, each
+** a power of two, in order of decreasing size so that there is padding
+** only at the end.
 */
-static void writeRuleText(FILE *out, struct rule *rp){
-  int j;
-  fprintf(out,"%s ::=", rp->lhs->name);
-  for(j=0; j<rp->nrhs; j++){
-    struct symbol *sp = rp->rhs[j];
-    if( sp->type!=MULTITERMINAL ){
-      fprintf(out," %s", sp->name);
+PRIVATE int pair_struct_size(int nA, int nB, int nC){
+  int mx = nA>nB ? nA : nB;
+  if( nC>mx ) mx = nC;
+  return (nA+nB+nC+mx-1)/mx*mx;
+}
+
+/* Output the parsing tables in the pair encoding (-epair).  The entries
+** are placed as for the comb encoding, but the look-ahead and the action
+** of each entry are stored together in yy_pair[], and the offsets and
+** the default action of each state together in yy_state[], so that each
+** probe reads one entry of each.  The fields are ordered largest first.
+*/
+PRIVATE void emit_pair_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int szActionType,
+  int szCodeType
+){
+  const char *zShift, *zReduce;
+  int szShift, szReduce;
+  int i, n;
+
+  fprintf(out, "#define YY_PAIRED_TABLES 1\n"); (*plineno)++;
+  fprintf(out, "static const struct yyActionPair {\n"); (*plineno)++;
+  if( szActionType>=szCodeType ){
+    fprintf(out, "  YYACTIONTYPE action;\n  YYCODETYPE lookahead;\n");
+  }else{
+    fprintf(out, "  YYCODETYPE lookahead;\n  YYACTIONTYPE action;\n");
+  }
+  (*plineno) += 2;
+  fprintf(out, "} yy_pair[] = {\n"); (*plineno)++;
+  lemp->nactiontab = acttab_action_size(pActtab);
+  n = lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  for(i=0; i<n; i++){
+    int action = lemp->noAction, la = lemp->nterminal;
+    if( i<lemp->nactiontab ){
+      action = acttab_yyaction(pActtab, i);
+      la = acttab_yylookahead(pActtab, i);
+      if( action<0 ) action = lemp->noAction;
+      if( la<0 ) la = lemp->nsymbol;
+    }
+    if( i%5==0 ) fprintf(out, " /* %5d */", i);
+    if( szActionType>=szCodeType ){
+      fprintf(out, " {%5d,%4d},", action, la);
     }else{
-      int k;
-      fprintf(out," %s", sp->subsym[0]->name);
-      for(k=1; k<sp->nsubsym; k++){
-        fprintf(out,"|%s",sp->subsym[k]->name);
+      fprintf(out, " {%4d,%5d},", la, action);
+    }
+    if( i%5==4 || i==n-1 ){ fprintf(out, "\n"); (*plineno)++; }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += n*pair_struct_size(szActionType, szCodeType, 0);
+
+  zShift = minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab,
+                             &szShift);
+  zReduce = minimum_size_type(mnNtOfst-1, mxNtOfst, &szReduce);
+  fprintf(out, "static const struct yyStateInfo {\n"); (*plineno)++;
+  for(i=4; i>0; i/=2){
+    if( szShift==i ){
+      fprintf(out, "  %s shift_ofst;\n", zShift); (*plineno)++;
+    }
+    if( szReduce==i ){
+      fprintf(out, "  %s reduce_ofst;\n", zReduce); (*plineno)++;
+    }
+    if( szActionType==i ){
+      fprintf(out, "  YYACTIONTYPE dflt;\n"); (*plineno)++;
+    }
+  }
+  fprintf(out, "} yy_state[] = {\n"); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    struct state *stp = lemp->sorted[i];
+    int k;
+    int shift = stp->iTknOfst==NO_OFFSET ? lemp->nactiontab : stp->iTknOfst;
+    int reduce = stp->iNtOfst==NO_OFFSET ? mnNtOfst-1 : stp->iNtOfst;
+    const char *zSep = "";
+    if( i%4==0 ) fprintf(out, " /* %5d */", i);
+    fprintf(out, " {");
+    for(k=4; k>0; k/=2){
+      if( szShift==k ){ fprintf(out, "%s%5d", zSep, shift); zSep = ","; }
+      if( szReduce==k ){ fprintf(out, "%s%5d", zSep, reduce); zSep = ","; }
+      if( szActionType==k ){
+        fprintf(out, "%s%5d", zSep, default_action(lemp, stp));
+        zSep = ",";
       }
     }
+    fprintf(out, "},");
+    if( i%4==3 || i==n-1 ){ fprintf(out, "\n"); (*plineno)++; }
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += n*pair_struct_size(szShift, szReduce, szActionType);
+}
+
+/* The widest entry of the packed encoding, so that an entry starting
+** anywhere in a byte can be read with four byte loads */
+#define PACKED_MAX_BITS  25
+
+/* The instructions that reading a packed entry takes beyond reading an
+** array element: forming the bit offset, and the shift and mask */
+#define PACKED_READ_COST  7
+
+/* Return the number of bits needed for the values from 0 to x */
+PRIVATE int packed_bits(int x){
+  int n = 1;
+  while( n<31 && (1<<n)<=x ) n++;
+  return n;
+}
+
+/* Return the number of bytes taken by n packed entries of nBit bits,
+** counting the three bytes of padding that the parser may read past
+** the last entry.
+*/
+PRIVATE int packed_size(int n, int nBit){
+  return (n*nBit+7)/8 + 3;
+}
+
+/* Write into aBit[] the entry widths of the packed encoding: of the
+** actions, of the look-aheads, and of the shift and reduce offsets,
+** which range from mnTknOfst and from mnNtOfst-1.  Return the largest.
+*/
+PRIVATE int packed_widths(
+  struct lemon *lemp,
+  int mnTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int *aBit
+){
+  int i, mx = 0;
+  aBit[0] = packed_bits(lemp->maxAction);
+  aBit[1] = packed_bits(lemp->nsymbol);
+  aBit[2] = packed_bits(lemp->nterminal + lemp->ncombtab - mnTknOfst);
+  aBit[3] = packed_bits(mxNtOfst - (mnNtOfst-1));
+  for(i=0; i<4; i++){
+    if( aBit[i]>mx ) mx = aBit[i];
+  }
+  return mx;
+}
+
+/* Output the n values of aValue[], less iBias, as a table named zName
+** of the packed encoding.  Each value takes nBit bits, least significant
+** first, so value i starts at bit i*nBit of the array.
+*/
+PRIVATE void emit_packed_array(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  const char *zName,
+  const int *aValue,
+  int n,
+  int iBias,
+  int nBit
+){
+  int nByte = packed_size(n, nBit);
+  unsigned char *a = (unsigned char*)lemon_calloc(lemp, nByte, 1);
+  int i, j, k;
+
+  for(i=0; i<n; i++){
+    unsigned int v = (unsigned int)(aValue[i] - iBias);
+    int b = i*nBit;
+    assert( v < (1u<<nBit) );
+    for(k=0; k<nBit; k++, b++){
+      if( v & (1u<<k) ) a[b>>3] |= (unsigned char)(1<<(b&7));
+    }
+  }
+  fprintf(out, "static const unsigned char %s[] = {\n", zName); (*plineno)++;
+  for(i=j=0; i<nByte; i++){
+    print_entry(out, i, nByte, a[i], &j, plineno);
+  }
+  fprintf(out, "};\n"); (*plineno)++;
+  lemp->tablesize += nByte;
+  lemon_free(lemp, a);
+}
+
+/* Output the parsing tables in the packed encoding (-epacked).  These
+** are the tables of the comb encoding, but each is an array of bytes
+** holding its entries at the exact number of bits they need, which the
+** parser takes apart with shifts and masks.  The offsets are stored
+** less the smallest one, so that they are never negative, and there
+** is an offset for every state.
+*/
+PRIVATE void emit_packed_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mxTknOfst,
+  int mnNtOfst,
+  int mxNtOfst
+){
+  int aBit[4];
+  int *aValue;
+  int i, n;
+
+  packed_widths(lemp, mnTknOfst, mnNtOfst, mxNtOfst, aBit);
+  lemp->nactiontab = acttab_action_size(pActtab);
+  lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  n = lemp->nlookaheadtab>lemp->nxstate ? lemp->nlookaheadtab : lemp->nxstate;
+  aValue = (int*)lemon_calloc(lemp, n, sizeof(int));
+  fprintf(out, "#define YY_PACKED_TABLES 1\n"); (*plineno)++;
+
+  /* yy_action[] and yy_lookahead[] */
+  n = lemp->nactiontab;
+  fprintf(out, "#define YY_ACTTAB_COUNT (%d)\n", n); (*plineno)++;
+  fprintf(out, "#define YY_ACTION_BITS    %d\n", aBit[0]); (*plineno)++;
+  fprintf(out, "#define YY_LOOKAHEAD_BITS %d\n", aBit[1]); (*plineno)++;
+  for(i=0; i<n; i++){
+    aValue[i] = acttab_yyaction(pActtab, i);
+    if( aValue[i]<0 ) aValue[i] = lemp->noAction;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_action", aValue, n, 0, aBit[0]);
+  n = lemp->nlookaheadtab;
+  for(i=0; i<n; i++){
+    aValue[i] = i<lemp->nactiontab ? acttab_yylookahead(pActtab, i) : -1;
+    if( aValue[i]<0 ) aValue[i] = i<lemp->nactiontab ? lemp->nsymbol
+                                                     : lemp->nterminal;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_lookahead", aValue, n, 0,
+                    aBit[1]);
+
+  /* yy_shift_ofst[] and yy_reduce_ofst[] */
+  n = lemp->nxstate;
+  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
+  fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_BITS     %d\n", aBit[2]); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    aValue[i] = lemp->sorted[i]->iTknOfst;
+    if( aValue[i]==NO_OFFSET ) aValue[i] = lemp->nactiontab;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_shift_ofst", aValue, n,
+                    mnTknOfst, aBit[2]);
+  while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
+  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_BITS  %d\n", aBit[3]); (*plineno)++;
+  n = lemp->nxstate;
+  for(i=0; i<n; i++){
+    aValue[i] = lemp->sorted[i]->iNtOfst;
+    if( aValue[i]==NO_OFFSET ) aValue[i] = mnNtOfst - 1;
+  }
+  emit_packed_array(lemp, out, plineno, "yy_reduce_ofst", aValue, n,
+                    mnNtOfst-1, aBit[3]);
+
+  /* yy_default[] */
+  for(i=0; i<n; i++) aValue[i] = default_action(lemp, lemp->sorted[i]);
+  emit_packed_array(lemp, out, plineno, "yy_default", aValue, n, 0, aBit[0]);
+  lemon_free(lemp, aValue);
+}
+
+/* The version of the table file format written by -B */
+#define BLOB_VERSION      1
+#define BLOB_HEADER_SIZE  160  /* sizeof(yyTablesHeader) in lempar.c */
+
+/* Store the sz low-order bytes of v at a[], least significant first */
+PRIVATE void blob_put(unsigned char *a, int sz, unsigned int v){
+  int i;
+  for(i=0; i<sz; i++){
+    a[i] = (unsigned char)(v & 0xff);
+    v >>= 8;
+  }
+}
+
+/* Add the n bytes at a[] to the FNV-1a hash h, and return the result */
+PRIVATE unsigned int blob_hash(unsigned int h, const unsigned char *a, int n){
+  int i;
+  for(i=0; i<n; i++) h = (h ^ a[i])*16777619u;
+  return h;
+}
+
+/* Add the integer v to the FNV-1a hash h, as four little-endian bytes */
+PRIVATE unsigned int blob_hash_int(unsigned int h, int v){
+  unsigned char a[4];
+  blob_put(a, 4, (unsigned int)v);
+  return blob_hash(h, a, 4);
+}
+
+/* Return the fingerprint of everything in the generated C code that the
+** tables of the -B file depend upon: the constants, the symbols and the
+** left-hand side and length of each rule.
+*/
+PRIVATE unsigned int blob_fingerprint(
+  struct lemon *lemp,
+  int szActionType,
+  int szCodeType
+){
+  unsigned int h = 2166136261u;
+  struct rule *rp;
+  int i;
+
+  h = blob_hash_int(h, BLOB_VERSION);
+  h = blob_hash_int(h, lemp->nxstate);
+  h = blob_hash_int(h, lemp->nrule);
+  h = blob_hash_int(h, lemp->nterminal);
+  h = blob_hash_int(h, lemp->nsymbol);
+  h = blob_hash_int(h, lemp->minShiftReduce);
+  h = blob_hash_int(h, lemp->errAction);
+  h = blob_hash_int(h, lemp->accAction);
+  h = blob_hash_int(h, lemp->noAction);
+  h = blob_hash_int(h, lemp->minReduce);
+  h = blob_hash_int(h, lemp->has_fallback);
+  h = blob_hash_int(h, lemp->foldFallback
+                       && (lemp->has_fallback || lemp->wildcard));
+  h = blob_hash_int(h, lemp->wildcard ? lemp->wildcard->index : -1);
+  h = blob_hash_int(h, lemp->errsym && lemp->errsym->useCnt);
+  h = blob_hash_int(h, szActionType);
+  h = blob_hash_int(h, szCodeType);
+  for(i=0; i<lemp->nsymbol; i++){
+    const char *z = lemp->symbols[i]->name;
+    h = blob_hash(h, (const unsigned char*)z, lemonStrlen(z)+1);
   }
+  for(rp=lemp->rule; rp; rp=rp->next){
+    h = blob_hash_int(h, rp->lhs->index);
+    h = blob_hash_int(h, rp->nrhs);
+  }
+  return h;
 }
 
+/* Output the parsing tables for -B.  The tables are those of the comb
+** encoding, but they go into a binary file, "*.tbl", laid out as the
+** yyTablesHeader of lempar.c describes, and the C code only declares
+** pointers that ParseTablesAttach() sets.  Entries are little-endian,
+** which is the only byte order ParseTablesAttach() accepts.
+*/
+PRIVATE void emit_blob_tables(
+  struct lemon *lemp,
+  FILE *out,
+  int *plineno,
+  struct acttab *pActtab,
+  int mnTknOfst,
+  int mxTknOfst,
+  int mnNtOfst,
+  int mxNtOfst,
+  int szActionType,
+  int szCodeType
+){
+  int aCount[8];        /* Entries in each table */
+  int aSize[8];         /* Bytes in each entry */
+  int aOfst[8];         /* Offset of each table in the file */
+  int nShift, nReduce;  /* Entries in yy_shift_ofst[] and yy_reduce_ofst[] */
+  const char *zShiftType, *zReduceType;
+  unsigned char *a;     /* The content of the file */
+  unsigned char *p;
+  unsigned int iFingerprint;
+  struct rule *rp;
+  int nByte;
+  int i;
+  char *zOutname;
+  FILE *fp;
+
+  lemp->nactiontab = acttab_action_size(pActtab);
+  lemp->nlookaheadtab = lemp->nterminal + lemp->nactiontab;
+  nShift = lemp->nxstate;
+  while( nShift>0 && lemp->sorted[nShift-1]->iTknOfst==NO_OFFSET ) nShift--;
+  nReduce = lemp->nxstate;
+  while( nReduce>0 && lemp->sorted[nReduce-1]->iNtOfst==NO_OFFSET ){
+    nReduce--;
+  }
+  zShiftType = minimum_size_type(mnTknOfst,
+                                 lemp->nterminal+lemp->nactiontab, &aSize[2]);
+  zReduceType = minimum_size_type(mnNtOfst-1, mxNtOfst, &aSize[3]);
+  aCount[0] = lemp->nactiontab;      aSize[0] = szActionType;
+  aCount[1] = lemp->nlookaheadtab;   aSize[1] = szCodeType;
+  aCount[2] = nShift;
+  aCount[3] = nReduce;
+  aCount[4] = lemp->nxstate;         aSize[4] = szActionType;
+  aCount[5] = lemp->has_fallback ? lemp->nterminal : 0;
+  aSize[5] = szCodeType;
+  aCount[6] = lemp->nrule;           aSize[6] = szCodeType;
+  aCount[7] = lemp->nrule;           aSize[7] = 1;
+  nByte = BLOB_HEADER_SIZE;
+  for(i=0; i<8; i++){
+    aOfst[i] = nByte;
+    nByte += (aCount[i]*aSize[i] + 7) & ~7;
+  }
+  a = (unsigned char*)lemon_calloc(lemp, nByte, 1);
+
+  /* The tables */
+  p = &a[aOfst[0]];
+  for(i=0; i<aCount[0]; i++, p+=aSize[0]){
+    int action = acttab_yyaction(pActtab, i);
+    if( action<0 ) action = lemp->noAction;
+    blob_put(p, aSize[0], (unsigned int)action);
+  }
+  p = &a[aOfst[1]];
+  for(i=0; i<aCount[1]; i++, p+=aSize[1]){
+    int la = i<lemp->nactiontab ? acttab_yylookahead(pActtab, i) : -1;
+    if( la<0 ) la = i<lemp->nactiontab ? lemp->nsymbol : lemp->nterminal;
+    blob_put(p, aSize[1], (unsigned int)la);
+  }
+  p = &a[aOfst[2]];
+  for(i=0; i<aCount[2]; i++, p+=aSize[2]){
+    int ofst = lemp->sorted[i]->iTknOfst;
+    if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
+    blob_put(p, aSize[2], (unsigned int)ofst);
+  }
+  p = &a[aOfst[3]];
+  for(i=0; i<aCount[3]; i++, p+=aSize[3]){
+    int ofst = lemp->sorted[i]->iNtOfst;
+    if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
+    blob_put(p, aSize[3], (unsigned int)ofst);
+  }
+  p = &a[aOfst[4]];
+  for(i=0; i<aCount[4]; i++, p+=aSize[4]){
+    blob_put(p, aSize[4],
+             (unsigned int)default_action(lemp, lemp->sorted[i]));
+  }
+  p = &a[aOfst[5]];
+  for(i=0; i<aCount[5]; i++, p+=aSize[5]){
+    struct symbol *sp = lemp->symbols[i]->fallback;
+    blob_put(p, aSize[5], sp ? (unsigned int)sp->index : 0);
+  }
+  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+    assert( rp->iRule==i );
+    blob_put(&a[aOfst[6]+i*aSize[6]], aSize[6], (unsigned int)rp->lhs->index);
+    blob_put(&a[aOfst[7]+i], 1, (unsigned int)-rp->nrhs);
+  }
+  lemp->tablesize += nByte - BLOB_HEADER_SIZE;
+
+  /* The header */
+  iFingerprint = blob_fingerprint(lemp, szActionType, szCodeType);
+  memcpy(a, "LEMONTBL", 8);
+  blob_put(&a[8], 4, 0x01020304);
+  blob_put(&a[12], 4, BLOB_VERSION);
+  blob_put(&a[16], 4, iFingerprint);
+  blob_put(&a[24], 4, (unsigned int)nByte);
+  blob_put(&a[28], 4, (unsigned int)aCount[0]);
+  blob_put(&a[32], 4, (unsigned int)aCount[1]);
+  blob_put(&a[36], 4, (unsigned int)(nShift-1));
+  blob_put(&a[40], 4, (unsigned int)mnTknOfst);
+  blob_put(&a[44], 4, (unsigned int)mxTknOfst);
+  blob_put(&a[48], 4, (unsigned int)(nReduce-1));
+  blob_put(&a[52], 4, (unsigned int)mnNtOfst);
+  blob_put(&a[56], 4, (unsigned int)mxNtOfst);
+  for(i=0; i<8; i++){
+    blob_put(&a[60+i*12], 4, (unsigned int)aOfst[i]);
+    blob_put(&a[64+i*12], 4, (unsigned int)aCount[i]);
+    blob_put(&a[68+i*12], 4, (unsigned int)aSize[i]);
+  }
+  blob_put(&a[20], 4, blob_hash(2166136261u, &a[BLOB_HEADER_SIZE],
+                                nByte - BLOB_HEADER_SIZE));
+
+  /* Write the file without disturbing lemp->outname, which names the
+  ** C file in its #line directives */
+  zOutname = lemp->outname;
+  lemp->outname = 0;
+  fp = file_open(lemp, ".tbl", "wb");
+  if( fp ){
+    if( fwrite(a, 1, nByte, fp)!=(size_t)nByte ){
+      fprintf(lemp->errstream, "Can't write file \"%s\".\n", lemp->outname);
+      lemp->errorcnt++;
+    }
+    file_close(lemp, fp);
+  }
+  lemon_free(lemp, lemp->outname);
+  lemp->outname = zOutname;
+  lemon_free(lemp, a);
+
+  /* The C code */
+  fprintf(out, "#define YY_TABLES_FINGERPRINT 0x%08xu\n", iFingerprint);
+  (*plineno)++;
+  fprintf(out, "#define YYSHIFTOFSTTYPE %s\n", zShiftType); (*plineno)++;
+  fprintf(out, "#define YYREDUCEOFSTTYPE %s\n", zReduceType); (*plineno)++;
+  fprintf(out, "#define YY_ACTTAB_COUNT   (yy_tables->nAction)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_COUNT    (yy_tables->iShiftCount)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MIN      (yy_tables->iShiftMin)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_SHIFT_MAX      (yy_tables->iShiftMax)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_COUNT   (yy_tables->iReduceCount)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MIN     (yy_tables->iReduceMin)\n");
+  (*plineno)++;
+  fprintf(out, "#define YY_REDUCE_MAX     (yy_tables->iReduceMax)\n");
+  (*plineno)++;
+  fprintf(out, "static const YYACTIONTYPE *yy_action;\n"); (*plineno)++;
+  fprintf(out, "static const YYCODETYPE *yy_lookahead;\n"); (*plineno)++;
+  fprintf(out, "static const YYSHIFTOFSTTYPE *yy_shift_ofst;\n");
+  (*plineno)++;
+  fprintf(out, "static const YYREDUCEOFSTTYPE *yy_reduce_ofst;\n");
+  (*plineno)++;
+  fprintf(out, "static const YYACTIONTYPE *yy_default;\n"); (*plineno)++;
+  if( lemp->has_fallback ){
+    fprintf(out, "static const YYCODETYPE *yyFallback;\n"); (*plineno)++;
+  }
+  fprintf(out, "static const YYCODETYPE *yyRuleInfoLhs;\n"); (*plineno)++;
+  fprintf(out, "static const signed char *yyRuleInfoNRhs;\n"); (*plineno)++;
+}
 
 /* Generate C source code for the parser */
 void ReportTable(
-  struct lemon *lemp,
-  int mhflag,     /* Output in makeheaders format if true */
-  int sqlFlag     /* Generate the *.sql file too */
+  struct lemon *lemp
 ){
+  int mhflag = lemp->mhflag;     /* Output in makeheaders format if true */
+  int sqlFlag = lemp->sqlFlag;   /* Generate the *.sql file too */
   FILE *out, *in, *sql;
   char line[LINESIZE];
   int  lineno;
@@ -1136,7 +3653,8 @@ void ReportTable(
   int mnTknOfst, mxTknOfst;
   int mnNtOfst, mxNtOfst;
   struct axset *ax;
-  char *prefix;
+  int nUnit;            /* Number of translation units (-u) */
+  int aBit[4];          /* Entry widths of the packed encoding */
 
   lemp->minShiftReduce = lemp->nstate;
   lemp->errAction = lemp->minShiftReduce + lemp->nrule;
@@ -1145,11 +3663,31 @@ void ReportTable(
   lemp->minReduce = lemp->noAction + 1;
   lemp->maxAction = lemp->minReduce + lemp->nrule;
 
+  /* Output captured in memory has no place for the extra units */
+  nUnit = lemp->aMemfile ? 1 : lemp->nUnit;
+
+  /* The shared engine of -G reads the tables in place */
+  if( lemp->sharedEngine && lemp->blobTables ){
+    fprintf(lemp->errstream,
+            "The -B option cannot be used with -G.  Ignoring -B.\n");
+    lemp->blobTables = 0;
+  }
+  if( lemp->sharedEngine && lemp->stackArrays ){
+    fprintf(lemp->errstream,
+            "The -A option cannot be used with -G.  Ignoring -A.\n");
+    lemp->stackArrays = 0;
+  }
+  if( lemp->sharedEngine && lemp->boxSize ){
+    fprintf(lemp->errstream,
+            "The -Z option cannot be used with -G.  Ignoring -Z.\n");
+    lemp->boxSize = 0;
+  }
+
   in = tplt_open(lemp);
   if( in==0 ) return;
   out = file_open(lemp,".c","wb");
   if( out==0 ){
-    fclose(in);
+    file_close(lemp, in);
     return;
   }
   if( sqlFlag==0 ){
@@ -1157,8 +3695,8 @@ void ReportTable(
   }else{
     sql = file_open(lemp, ".sql", "wb");
     if( sql==0 ){
-      fclose(in);
-      fclose(out);
+      file_close(lemp, in);
+      file_close(lemp, out);
       return;
     }
     fprintf(sql,
@@ -1240,114 +3778,34 @@ void ReportTable(
       i = -1;
     }
   }
-  if( lemp->include[0]=='/' ){
-    tplt_skip_header(in,&lineno);
-  }else{
-    tplt_xfer(lemp->name,in,out,&lineno);
-  }
-
-  /* Generate the include code, if any */
-  tplt_print(out,lemp,lemp->include,&lineno);
-  if( mhflag ){
-    char *incName = file_makename(lemp, ".h");
-    fprintf(out,"#include \"%s\"\n", incName); lineno++;
-    free(incName);
-  }
-  tplt_xfer(lemp->name,in,out,&lineno);
-
-  /* Generate #defines for all tokens */
-  if( lemp->tokenprefix ) prefix = lemp->tokenprefix;
-  else                    prefix = "";
-  if( mhflag ){
-    fprintf(out,"#if INTERFACE\n"); lineno++;
-  }else{
-    fprintf(out,"#ifndef %s%s\n", prefix, lemp->symbols[1]->name);
-  }
-  for(i=1; i<lemp->nterminal; i++){
-    fprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
-    lineno++;
-  }
-  fprintf(out,"#endif\n"); lineno++;
-  tplt_xfer(lemp->name,in,out,&lineno);
-
-  /* Generate the defines */
-  fprintf(out,"#define YYCODETYPE %s\n",
-    minimum_size_type(0, lemp->nsymbol, &szCodeType)); lineno++;
-  fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
-  fprintf(out,"#define YYACTIONTYPE %s\n",
-    minimum_size_type(0,lemp->maxAction,&szActionType)); lineno++;
-  if( lemp->wildcard ){
-    fprintf(out,"#define YYWILDCARD %d\n",
-       lemp->wildcard->index); lineno++;
-  }
-  print_stack_union(out,lemp,&lineno,mhflag);
-  fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
-  if( lemp->stacksize ){
-    fprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
+  if( lemp->include[0]=='/' ){
+    tplt_skip_header(in,&lineno);
   }else{
-    fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
+    tplt_xfer(lemp->name,in,out,&lineno);
   }
-  fprintf(out, "#endif\n"); lineno++;
+
+  /* Generate the include code, if any */
+  tplt_print(out,lemp,lemp->include,&lineno);
   if( mhflag ){
-    fprintf(out,"#if INTERFACE\n"); lineno++;
+    char *incName = file_makename(lemp, ".h");
+    fprintf(out,"#include \"%s\"\n", incName); lineno++;
+    lemon_free(lemp, incName);
   }
+  tplt_xfer(lemp->name,in,out,&lineno);
+
+  /* Generate #defines for all tokens */
+  print_token_defines(out,lemp,&lineno,mhflag);
+  tplt_xfer(lemp->name,in,out,&lineno);
+
+  /* Generate the defines */
+  print_control_defines(out,lemp,&lineno,mhflag,&szCodeType,&szActionType);
   name = lemp->name ? lemp->name : "Parse";
-  if( lemp->arg && lemp->arg[0] ){
-    i = lemonStrlen(lemp->arg);
-    while( i>=1 && ISSPACE(lemp->arg[i-1]) ) i--;
-    while( i>=1 && (ISALNUM(lemp->arg[i-1]) || lemp->arg[i-1]=='_') ) i--;
-    fprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
-                 name,lemp->arg,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
-                 name,&lemp->arg[i],&lemp->arg[i]);  lineno++;
-  }else{
-    fprintf(out,"#define %sARG_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sARG_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sARG_STORE\n",name); lineno++;
-  }
-  if( lemp->ctx && lemp->ctx[0] ){
-    i = lemonStrlen(lemp->ctx);
-    while( i>=1 && ISSPACE(lemp->ctx[i-1]) ) i--;
-    while( i>=1 && (ISALNUM(lemp->ctx[i-1]) || lemp->ctx[i-1]=='_') ) i--;
-    fprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
-                 name,lemp->ctx,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
-                 name,&lemp->ctx[i],&lemp->ctx[i]);  lineno++;
-  }else{
-    fprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sCTX_STORE\n",name); lineno++;
-  }
-  if( mhflag ){
-    fprintf(out,"#endif\n"); lineno++;
-  }
-  if( lemp->errsym && lemp->errsym->useCnt ){
-    fprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
-    fprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
-  }
-  if( lemp->has_fallback ){
-    fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
-  }
 
   /* Compute the action table, but do not output it yet.  The action
   ** table must be computed before generating the YYNSTATE macro because
   ** we need to know how many states can be eliminated.
   */
-  ax = (struct axset *) calloc(lemp->nxstate*2, sizeof(ax[0]));
-  if( ax==0 ){
-    fprintf(stderr,"malloc failed\n");
-    exit(1);
-  }
+  ax = (struct axset *) lemon_calloc(lemp, lemp->nxstate*2, sizeof(ax[0]));
   for(i=0; i<lemp->nxstate; i++){
     stp = lemp->sorted[i];
     ax[i*2].stp = stp;
@@ -1356,14 +3814,18 @@ void ReportTable(
     ax[i*2+1].stp = stp;
     ax[i*2+1].isTkn = 0;
     ax[i*2+1].nAction = stp->nNtAct;
+    /* A set without actions takes no place, and must stay at the end */
+    if( stp->nTknAct ) ax[i*2].nHit = stp->nTknHit;
+    if( stp->nNtAct ) ax[i*2+1].nHit = stp->nNtHit;
   }
   mxTknOfst = mnTknOfst = 0;
   mxNtOfst = mnNtOfst = 0;
   /* In an effort to minimize the action table size, use the heuristic
-  ** of placing the largest action sets first */
+  ** of placing the largest action sets first.  With a profile, the sets
+  ** that are looked up go before all others, busiest first */
   for(i=0; i<lemp->nxstate*2; i++) ax[i].iOrder = i;
   qsort(ax, lemp->nxstate*2, sizeof(ax[0]), axset_compare);
-  pActtab = acttab_alloc(lemp->nsymbol, lemp->nterminal);
+  pActtab = acttab_alloc(lemp, lemp->nsymbol, lemp->nterminal);
   for(i=0; i<lemp->nxstate*2 && ax[i].nAction>0; i++){
     stp = ax[i].stp;
     if( ax[i].isTkn ){
@@ -1401,7 +3863,7 @@ void ReportTable(
     }
 #endif
   }
-  free(ax);
+  lemon_free(lemp, ax);
 
   /* Mark rules that are actually used for reduce actions after all
   ** optimizations have been applied
@@ -1421,6 +3883,10 @@ void ReportTable(
   fprintf(out,"#define YYNRULE              %d\n",lemp->nrule);  lineno++;
   fprintf(out,"#define YYNRULE_WITH_ACTION  %d\n",lemp->nruleWithAction);
          lineno++;
+  for(i=1, rp=lemp->rule; rp; rp=rp->next){
+    if( rp->nrhs>i ) i = rp->nrhs;
+  }
+  fprintf(out,"#define YYMAXRHS             %d\n",i); lineno++;
   fprintf(out,"#define YYNTOKEN             %d\n",lemp->nterminal); lineno++;
   fprintf(out,"#define YY_MAX_SHIFT         %d\n",lemp->nxstate-1); lineno++;
   i = lemp->minShiftReduce;
@@ -1447,135 +3913,200 @@ void ReportTable(
   **  yy_default[]       Default action for each state.
   */
 
-  /* Output the yy_action table */
-  lemp->nactiontab = n = acttab_action_size(pActtab);
-  lemp->tablesize += n*szActionType;
-  fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-  fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int action = acttab_yyaction(pActtab, i);
-    if( action<0 ) action = lemp->noAction;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", action);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
-    }
+  lemp->ncombtab = acttab_action_size(pActtab);
+  if( lemp->encoding==ENC_HASH && lemp->nsymbol>=65536 ){
+    fprintf(lemp->errstream,
+            "Too many symbols for the hash encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
   }
-  fprintf(out, "};\n"); lineno++;
+  if( lemp->encoding==ENC_PACKED
+   && packed_widths(lemp, mnTknOfst, mnNtOfst, mxNtOfst,
+                    aBit)>PACKED_MAX_BITS ){
+    fprintf(lemp->errstream,
+            "Tables too large for the packed encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->blobTables && lemp->encoding!=ENC_COMB ){
+    fprintf(lemp->errstream,
+            "The -B option writes the comb encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->sharedEngine && lemp->encoding!=ENC_COMB ){
+    fprintf(lemp->errstream,
+            "The shared engine of -G reads the comb encoding.  Using comb.\n");
+    lemp->encoding = ENC_COMB;
+  }
+  if( lemp->sharedEngine
+   && (lemp->maxAction>65535 || lemp->nsymbol>65535
+       || mnTknOfst<-32768 || lemp->nterminal+lemp->ncombtab>32767
+       || mnNtOfst-1<-32768 || mxNtOfst>32767)
+  ){
+    fprintf(lemp->errstream,
+            "The tables are too large for the shared engine of -G.\n");
+    lemp->errorcnt++;
+  }
+  if( lemp->encoding==ENC_DENSE ){
+    emit_dense_tables(lemp, out, &lineno, szActionType);
+  }else if( lemp->encoding==ENC_HASH ){
+    emit_hash_tables(lemp, out, &lineno, szActionType, szCodeType);
+  }else if( lemp->encoding==ENC_CODE ){
+    emit_code_tables(lemp, out, &lineno, szActionType);
+  }else if( lemp->encoding==ENC_PAIR ){
+    emit_pair_tables(lemp, out, &lineno, pActtab, mnTknOfst, mnNtOfst,
+                     mxNtOfst, szActionType, szCodeType);
+  }else if( lemp->encoding==ENC_PACKED ){
+    emit_packed_tables(lemp, out, &lineno, pActtab, mnTknOfst, mxTknOfst,
+                       mnNtOfst, mxNtOfst);
+  }else if( lemp->blobTables ){
+    emit_blob_tables(lemp, out, &lineno, pActtab, mnTknOfst, mxTknOfst,
+                     mnNtOfst, mxNtOfst, szActionType, szCodeType);
+  }else{
+    /* Output the yy_action table */
+    lemp->nactiontab = n = acttab_action_size(pActtab);
+    lemp->tablesize += n*szActionType;
+    fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
+    fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int action = acttab_yyaction(pActtab, i);
+      if( action<0 ) action = lemp->noAction;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", action);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
 
-  /* Output the yy_lookahead table */
-  lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
-  lemp->tablesize += n*szCodeType;
-  fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
-  for(i=j=0; i<n; i++){
-    int la = acttab_yylookahead(pActtab, i);
-    if( la<0 ) la = lemp->nsymbol;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", la);
-    if( j==9 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
-    }
-  }
-  /* Add extra entries to the end of the yy_lookahead[] table so that
-  ** yy_shift_ofst[]+iToken will always be a valid index into the array,
-  ** even for the largest possible value of yy_shift_ofst[] and iToken. */
-  nLookAhead = lemp->nterminal + lemp->nactiontab;
-  while( i<nLookAhead ){
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", lemp->nterminal);
-    if( j==9 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
+    /* Output the yy_lookahead table */
+    lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
+    lemp->tablesize += n*szCodeType;
+    fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
+    for(i=j=0; i<n; i++){
+      int la = acttab_yylookahead(pActtab, i);
+      if( la<0 ) la = lemp->nsymbol;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", la);
+      if( j==9 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    /* Add extra entries to the end of the yy_lookahead[] table so that
+    ** yy_shift_ofst[]+iToken will always be a valid index into the array,
+    ** even for the largest possible value of yy_shift_ofst[] and iToken. */
+    nLookAhead = lemp->nterminal + lemp->nactiontab;
+    while( i<nLookAhead ){
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", lemp->nterminal);
+      if( j==9 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+      i++;
+    }
+    if( j>0 ){ fprintf(out, "\n"); lineno++; }
+    fprintf(out, "};\n"); lineno++;
+
+    /* Output the yy_shift_ofst[] table */
+    n = lemp->nxstate;
+    while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
+    fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
+    fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
+    if( lemp->sharedEngine ){
+      fprintf(out, "static const short yy_shift_ofst[] = {\n"); lineno++;
+      sz = 2;
     }else{
-      j++;
+      fprintf(out, "static const %s yy_shift_ofst[] = {\n",
+         minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
+         lineno++;
     }
-    i++;
-  }
-  if( j>0 ){ fprintf(out, "\n"); lineno++; }
-  fprintf(out, "};\n"); lineno++;
+    lemp->tablesize += n*sz;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iTknOfst;
+      if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
 
-  /* Output the yy_shift_ofst[] table */
-  n = lemp->nxstate;
-  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
-  fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
-  fprintf(out, "static const %s yy_shift_ofst[] = {\n",
-       minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
-       lineno++;
-  lemp->tablesize += n*sz;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iTknOfst;
-    if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
+    /* Output the yy_reduce_ofst[] table */
+    n = lemp->nxstate;
+    while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
+    fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
+    fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
+    fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
+    if( lemp->sharedEngine ){
+      fprintf(out, "static const short yy_reduce_ofst[] = {\n"); lineno++;
+      sz = 2;
     }else{
-      j++;
+      fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
+              minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
     }
+    lemp->tablesize += n*sz;
+    for(i=j=0; i<n; i++){
+      int ofst;
+      stp = lemp->sorted[i];
+      ofst = stp->iNtOfst;
+      if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %4d,", ofst);
+      if( j==9 || i==n-1 ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
   }
-  fprintf(out, "};\n"); lineno++;
 
-  /* Output the yy_reduce_ofst[] table */
-  n = lemp->nxstate;
-  while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
-  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
-  fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
-          minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
-  lemp->tablesize += n*sz;
-  for(i=j=0; i<n; i++){
-    int ofst;
-    stp = lemp->sorted[i];
-    ofst = stp->iNtOfst;
-    if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
+  /* Output the default action table, unless it is part of yy_state[],
+  ** has been packed or is in the -B file */
+  if( lemp->encoding!=ENC_PAIR && lemp->encoding!=ENC_PACKED
+   && !lemp->blobTables
+  ){
+    fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
+    n = lemp->nxstate;
+    lemp->tablesize += n*szActionType;
+    for(i=j=0; i<n; i++){
+      print_entry(out, i, n, default_action(lemp, lemp->sorted[i]), &j,
+                  &lineno);
     }
+    fprintf(out, "};\n"); lineno++;
   }
-  fprintf(out, "};\n"); lineno++;
 
-  /* Output the default action table */
-  fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
+  /* Output the number that each state had before ResortStates(), which
+  ** ParseProfile() writes out */
+  fprintf(out, "#if defined(YYPROFILE)\n"); lineno++;
+  fprintf(out, "static const %s yy_state_origin[] = {\n",
+          minimum_size_type(0, lemp->nstate, 0)); lineno++;
   n = lemp->nxstate;
-  lemp->tablesize += n*szActionType;
   for(i=j=0; i<n; i++){
-    stp = lemp->sorted[i];
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    if( stp->iDfltReduce<0 ){
-      fprintf(out, " %4d,", lemp->errAction);
-    }else{
-      fprintf(out, " %4d,", stp->iDfltReduce + lemp->minReduce);
-    }
-    if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
-      j = 0;
-    }else{
-      j++;
-    }
+    print_entry(out, i, n, lemp->sorted[i]->iOrigin, &j, &lineno);
   }
   fprintf(out, "};\n"); lineno++;
+  fprintf(out, "#endif\n"); lineno++;
   tplt_xfer(lemp->name,in,out,&lineno);
 
-  /* Generate the table of fallback tokens.
+  /* Generate the table of fallback tokens, unless it is in the -B file
   */
-  if( lemp->has_fallback ){
+  if( lemp->has_fallback && !lemp->blobTables ){
     int mx = lemp->nterminal - 1;
     /* 2019-08-28:  Generate fallback entries for every token to avoid
     ** having to do a range check on the index */
@@ -1641,7 +4172,7 @@ void ReportTable(
     for(i=0; i<lemp->nsymbol; i++){
       struct symbol *sp = lemp->symbols[i];
       if( sp==0 || sp->type==TERMINAL ||
-          sp->index<=0 || sp->destructor!=0 ) continue;
+          sp->index<=0 || sp->destructor!=0 || sp->bArena ) continue;
       if( once ){
         fprintf(out, "      /* Default NON-TERMINAL Destructor */\n");lineno++;
         once = 0;
@@ -1658,12 +4189,13 @@ void ReportTable(
     struct symbol *sp = lemp->symbols[i];
     if( sp==0 || sp->type==TERMINAL || sp->destructor==0 ) continue;
     if( sp->destLineno<0 ) continue;  /* Already emitted */
+    if( sp->bArena ) continue;        /* Released with the arena */
     fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
     /* Combine duplicate destructors into a single case */
     for(j=i+1; j<lemp->nsymbol; j++){
       struct symbol *sp2 = lemp->symbols[j];
-      if( sp2 && sp2->type!=TERMINAL && sp2->destructor
+      if( sp2 && sp2->type!=TERMINAL && sp2->destructor && !sp2->bArena
           && sp2->dtnum==sp->dtnum
           && strcmp(sp->destructor,sp2->destructor)==0 ){
          fprintf(out,"    case %d: /* %s */\n",
@@ -1685,15 +4217,15 @@ void ReportTable(
   ** yyRuleInfoNRhs[].
   **
   ** Note: This code depends on the fact that rules are number
-  ** sequentially beginning with 0.
+  ** sequentially beginning with 0.  With -B they are in the *.tbl file.
   */
-  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+  for(i=0, rp=lemp->blobTables ? 0 : lemp->rule; rp; rp=rp->next, i++){
     fprintf(out,"  %4d,  /* (%d) ", rp->lhs->index, i);
      rule_print(out, rp);
     fprintf(out," */\n"); lineno++;
   }
   tplt_xfer(lemp->name,in,out,&lineno);
-  for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+  for(i=0, rp=lemp->blobTables ? 0 : lemp->rule; rp; rp=rp->next, i++){
     fprintf(out,"  %3d,  /* (%d) ", -rp->nrhs, i);
     rule_print(out, rp);
     fprintf(out," */\n"); lineno++;
@@ -1701,40 +4233,92 @@ void ReportTable(
   tplt_xfer(lemp->name,in,out,&lineno);
 
   /* Generate code which execution during each REDUCE action */
-  i = 0;
+  lemp->nLhsInPlace = lemp->nLhsCopy = 0;
   for(rp=lemp->rule; rp; rp=rp->next){
-    i += translate_code(lemp, rp);
+    rp->lhsMinor = translate_code(lemp, rp);
+  }
+  if( nUnit>1 ) nUnit = unit_assign(lemp, nUnit);
+  choose_cold_rules(lemp);
+
+  /* The reduce actions as functions, or the labels to jump to them */
+  if( lemp->dispatch==DSP_FUNCTION || lemp->ncold ){
+    emit_reduce_functions(lemp, out, &lineno, nUnit);
+  }
+  if( lemp->dispatch==DSP_GOTO ){
+    emit_reduce_labels(lemp, out, &lineno);
   }
-  if( i ){
+  tplt_xfer(lemp->name,in,out,&lineno);
+
+  /* The switch in yy_reduce(), for the actions not written above */
+  for(rp=lemp->rule;
+      rp && (rp->iUnit || !rp->lhsMinor || rp->codeEmitted || rp->isCold);
+      rp=rp->next){}
+  if( rp ){
     fprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
   }
+  for(i=1; i<nUnit && lemp->dispatch!=DSP_FUNCTION; i++){
+    fprintf(out,"        void %sReduce%d(yyStackEntry*,%sunsigned int,int,"
+                "%sTOKENTYPE %sARG_PDECL %sCTX_PDECL);\n",
+                name, i, lemp->stackArrays ? "YYMINORTYPE*," : "",
+                name, name, name); lineno++;
+  }
   /* First output rules other than the default: rule */
   for(rp=lemp->rule; rp; rp=rp->next){
     struct rule *rp2;               /* Other rules with the same action */
-    if( rp->codeEmitted ) continue;
+    if( rp->codeEmitted || rp->iUnit ) continue;
     if( rp->noCode ){
       /* No C code actions, so this will be part of the "default:" rule */
       continue;
     }
-    fprintf(out,"      case %d: /* ", rp->iRule);
-    writeRuleText(out, rp);
+    print_reduce_case(out, lemp, rp);
     fprintf(out, " */\n"); lineno++;
     for(rp2=rp->next; rp2; rp2=rp2->next){
       if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
              && rp2->codeSuffix==rp->codeSuffix ){
-        fprintf(out,"      case %d: /* ", rp2->iRule);
-        writeRuleText(out, rp2);
+        print_reduce_case(out, lemp, rp2);
         fprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
         rp2->codeEmitted = 1;
       }
     }
-    emit_code(out,rp,lemp,&lineno);
+    if( rp->isCold ){
+      fprintf(out,"        yy_rule_%d(yypParser,yymsp,%syyruleno,yyLookahead,"
+                  "yyLookaheadToken %sARG_PARAM %sCTX_PARAM);\n",
+                  rp->iRule, lemp->stackArrays ? "yyvsp," : "", name, name);
+      lineno++;
+    }else{
+      emit_code(out,rp,lemp,&lineno);
+    }
     fprintf(out,"        break;\n"); lineno++;
     rp->codeEmitted = 1;
   }
+  /* Then the rules whose code is in another translation unit */
+  for(i=1; i<nUnit; i++){
+    int once = 1;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      if( rp->iUnit!=i || rp->codeEmitted ) continue;
+      print_reduce_case(out, lemp, rp);
+      if( once ){
+        fprintf(out, " */\n"); lineno++;
+        once = 0;
+      }else{
+        fprintf(out," */ yytestcase(yyruleno==%d);\n", rp->iRule); lineno++;
+      }
+      rp->codeEmitted = 1;
+    }
+    if( once ) continue;
+    fprintf(out,"        %sReduce%d(yymsp,%syyruleno,yyLookahead,"
+                "yyLookaheadToken %sARG_PARAM %sCTX_PARAM);\n", name, i,
+                lemp->stackArrays ? "yyvsp," : "", name, name); lineno++;
+    fprintf(out,"        break;\n"); lineno++;
+  }
   /* Finally, output the default: rule.  We choose as the default: all
   ** empty actions. */
-  fprintf(out,"      default:\n"); lineno++;
+  for(rp=lemp->rule; rp && !rp->noCode; rp=rp->next){}
+  if( lemp->dispatch==DSP_GOTO && rp ){
+    fprintf(out,"      default: yy_reduce_default:\n"); lineno++;
+  }else{
+    fprintf(out,"      default:\n"); lineno++;
+  }
   for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->codeEmitted ) continue;
     assert( rp->noCode );
@@ -1769,12 +4353,333 @@ void ReportTable(
   tplt_print(out,lemp,lemp->extracode,&lineno);
 
   acttab_free(pActtab);
-  fclose(in);
-  fclose(out);
-  if( sql ) fclose(sql);
+  file_close(lemp, in);
+  if( nUnit>1 ){
+    char *zName = file_makename(lemp, ".c");
+    for(i=0, rp=lemp->rule; rp; rp=rp->next){
+      if( rp->iUnit==0 && !rp->noCode ) i++;
+    }
+    unit_report(lemp, 0, zName, i, lineno-1, ftell(out));
+    lemon_free(lemp, zName);
+  }
+  file_close(lemp, out);
+  if( sql ) file_close(lemp, sql);
+  for(i=1; i<nUnit; i++) unit_write(lemp, i, nUnit);
   return;
 }
 
+/* One line of the table size attribution report */
+struct size_line {
+  int id;               /* State number or symbol index */
+  double rSlots;        /* Share of yy_action[] entries */
+  int nExplicit;        /* Number of entries, shared or not */
+  double rProbe;        /* Average yy_lookahead[] probes per token */
+  int mxProbe;          /* Most probes for any token */
+  int nReduce;          /* Tokens that lead to a reduce */
+  double rChain;        /* Average reduce chain for those tokens */
+  int mxChain;          /* Longest reduce chain */
+};
+
+/* Compare two size_line objects so that the largest sorts first */
+static int size_line_cmp(const void *a, const void *b){
+  const struct size_line *p1 = (const struct size_line*)a;
+  const struct size_line *p2 = (const struct size_line*)b;
+  if( p1->rSlots!=p2->rSlots ) return p1->rSlots<p2->rSlots ? 1 : -1;
+  return p1->id - p2->id;
+}
+
+/* Generate the table size attribution report (-z) on the standard
+** output.  ReportTable() must have run first, to place every state in
+** the yy_action[] table.
+**
+** Each entry of yy_action[] and yy_lookahead[] is charged to the states
+** that use it, shared equally when several states were overlaid on the
+** same entries, and to the look-ahead symbol of the entry.  For each
+** state, the lookup cost is estimated as yy_find_shift_action() would
+** see it: the number of yy_lookahead[] probes for each token, counting
+** the %fallback and %wildcard retries, and the number of reductions
+** that the token causes.  The reduce chain is an upper bound that counts
+** the reduction itself plus the longest run of single-symbol rules that
+** can follow it, such as "expr ::= term.  term ::= factor."
+*/
+void ReportSizes(struct lemon *lemp)
+{
+  FILE *out = lemp->outstream;
+  int szActionType, szCodeType, szShift, szReduce;
+  int nSlot = lemp->ncombtab + lemp->nsymbol + 1;
+  int *anUse;                   /* Number of states using each slot */
+  int *aUnit;                   /* Longest unit-rule chain above a symbol */
+  struct action **apAct;        /* Action of the current state per symbol */
+  struct size_line *aState, *aSym;
+  int mnTkn = 0, mxTkn = 0, mnNt = 0, mxNt = 0;
+  int iMnTkn = -1, iMxTkn = -1, iMnNt = -1, iMxNt = -1;
+  int nHole = 0;
+  int nLookahead, nShiftOfst, nReduceOfst;
+  int nProbe = 0, nMiss = 0;    /* Probes and defaults, over every lookup */
+  int nRetry = 0, nFold = 0;    /* Lookups that retry, and that find one */
+  int nLookup, nByte, nComb;
+  int aBit[4];                  /* Entry widths of the packed encoding */
+  struct hash_tables ht;
+  int i, j, k, bChange;
+  struct rule *rp;
+  struct action *ap;
+
+  minimum_size_type(0, lemp->nsymbol, &szCodeType);
+  minimum_size_type(0, lemp->maxAction, &szActionType);
+  anUse = (int*)lemon_calloc(lemp, nSlot, sizeof(int));
+  aUnit = (int*)lemon_calloc(lemp, lemp->nsymbol+1, sizeof(int));
+  apAct = (struct action**)lemon_calloc(lemp, lemp->nsymbol+1,
+                                        sizeof(struct action*));
+  aState = (struct size_line*)lemon_calloc(lemp, lemp->nxstate+1,
+                                           sizeof(aState[0]));
+  aSym = (struct size_line*)lemon_calloc(lemp, lemp->nsymbol+1,
+                                         sizeof(aSym[0]));
+
+  /* Count the users of every yy_action[] entry, and find the states
+  ** that determine the range of the offset tables */
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    for(ap=stp->ap; ap; ap=ap->next){
+      int ofst, x = ap->sp->index;
+      if( x==lemp->nsymbol || compute_action(lemp, ap)<0 ) continue;
+      ofst = x<lemp->nterminal ? stp->iTknOfst : stp->iNtOfst;
+      if( ofst==NO_OFFSET || ofst+x<0 || ofst+x>=nSlot ) continue;
+      anUse[ofst+x]++;
+    }
+    if( stp->iTknOfst!=NO_OFFSET ){
+      if( iMnTkn<0 || stp->iTknOfst<mnTkn ){ mnTkn = stp->iTknOfst; iMnTkn = i; }
+      if( iMxTkn<0 || stp->iTknOfst>mxTkn ){ mxTkn = stp->iTknOfst; iMxTkn = i; }
+    }
+    if( stp->iNtOfst!=NO_OFFSET ){
+      if( iMnNt<0 || stp->iNtOfst<mnNt ){ mnNt = stp->iNtOfst; iMnNt = i; }
+      if( iMxNt<0 || stp->iNtOfst>mxNt ){ mxNt = stp->iNtOfst; iMxNt = i; }
+    }
+  }
+  for(i=0; i<lemp->ncombtab; i++){
+    if( anUse[i]==0 ) nHole++;
+  }
+  minimum_size_type(mnTkn<0 ? mnTkn : 0, lemp->nterminal+lemp->ncombtab,
+                    &szShift);
+  minimum_size_type((mnNt<0 ? mnNt : 0)-1, mxNt>0 ? mxNt : 0, &szReduce);
+  nShiftOfst = nReduceOfst = lemp->nxstate;
+  while( nShiftOfst>0
+      && lemp->sorted[nShiftOfst-1]->iTknOfst==NO_OFFSET ) nShiftOfst--;
+  while( nReduceOfst>0
+      && lemp->sorted[nReduceOfst-1]->iNtOfst==NO_OFFSET ) nReduceOfst--;
+
+  /* aUnit[X] is the length of the longest chain of rules "A ::= X.",
+  ** "B ::= A." and so on.  Stop after nsymbol rounds in case of a cycle */
+  for(k=0, bChange=1; bChange && k<lemp->nsymbol; k++){
+    bChange = 0;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      struct symbol *sp;
+      if( rp->nrhs!=1 ) continue;
+      sp = rp->rhs[0];
+      if( sp->type!=NONTERMINAL ) continue;
+      if( aUnit[sp->index] < aUnit[rp->lhs->index]+1 ){
+        aUnit[sp->index] = aUnit[rp->lhs->index]+1;
+        bChange = 1;
+      }
+    }
+  }
+
+  /* Charge the entries to states and symbols, and estimate the cost of
+  ** finding the action for every token in every state */
+  for(i=0; i<lemp->nsymbol; i++) aSym[i].id = i;
+  for(i=0; i<lemp->nxstate; i++){
+    struct state *stp = lemp->sorted[i];
+    struct size_line *p = &aState[i];
+    int nTotal = 0, nChain = 0;
+    p->id = stp->statenum;
+    memset(apAct, 0, sizeof(apAct[0])*(lemp->nsymbol+1));
+    for(ap=stp->ap; ap; ap=ap->next){
+      int ofst, x = ap->sp->index;
+      if( x==lemp->nsymbol || compute_action(lemp, ap)<0 ) continue;
+      ofst = x<lemp->nterminal ? stp->iTknOfst : stp->iNtOfst;
+      if( ofst==NO_OFFSET || ofst+x<0 || ofst+x>=nSlot ) continue;
+      p->rSlots += 1.0/anUse[ofst+x];
+      p->nExplicit++;
+      aSym[x].rSlots += 1.0/anUse[ofst+x];
+      aSym[x].nExplicit++;
+      apAct[x] = ap;
+    }
+    for(j=0; j<lemp->nterminal; j++){
+      struct action *pFound = apAct[j];
+      struct rule *pReduce = 0;
+      int nProbe = 1;
+      struct symbol *pFallback = lemp->symbols[j]->fallback;
+      int bRetry = !lemp->foldFallback;   /* -F leaves nothing to retry */
+      if( pFound==0 && pFallback && bRetry ){
+        nProbe++;
+        pFound = apAct[pFallback->index];
+      }
+      if( pFound==0 && lemp->wildcard && j>0 && bRetry ){
+        nProbe++;
+        pFound = apAct[lemp->wildcard->index];
+      }
+      if( nProbe>1 ){
+        nRetry++;
+        if( pFound ) nFold++;
+      }
+      if( pFound ){
+        if( pFound->type==REDUCE || pFound->type==SHIFTREDUCE ){
+          pReduce = pFound->x.rp;
+        }
+      }else{
+        nMiss++;
+        if( stp->iDfltReduce>=0 ) pReduce = stp->pDfltReduce;
+      }
+      nTotal += nProbe;
+      if( nProbe>p->mxProbe ) p->mxProbe = nProbe;
+      if( pReduce ){
+        int nLen = 1 + aUnit[pReduce->lhs->index];
+        p->nReduce++;
+        nChain += nLen;
+        if( nLen>p->mxChain ) p->mxChain = nLen;
+      }
+    }
+    nProbe += nTotal;
+    p->rProbe = lemp->nterminal ? (double)nTotal/lemp->nterminal : 0.0;
+    p->rChain = p->nReduce ? (double)nChain/p->nReduce : 0.0;
+  }
+
+  /* Show the totals */
+  nLookahead = lemp->nterminal + lemp->ncombtab;
+  if( lemp->ncombtab>nLookahead ) nLookahead = lemp->ncombtab;
+  fprintf(out, "Table size attribution:\n");
+  fprintf(out, "  yy_action[]       %6d entries x %d = %7d bytes"
+               "  (%d unused entries)\n",
+          lemp->ncombtab, szActionType, lemp->ncombtab*szActionType,
+          nHole);
+  fprintf(out, "  yy_lookahead[]    %6d entries x %d = %7d bytes"
+               "  (%d for padding)\n",
+          nLookahead, szCodeType, nLookahead*szCodeType,
+          nLookahead - lemp->ncombtab);
+  fprintf(out, "  yy_shift_ofst[]   %6d entries x %d = %7d bytes",
+          nShiftOfst, szShift, nShiftOfst*szShift);
+  if( iMnTkn>=0 ){
+    fprintf(out, "  (offsets %d in state %d to %d in state %d)",
+            mnTkn, lemp->sorted[iMnTkn]->statenum,
+            mxTkn, lemp->sorted[iMxTkn]->statenum);
+  }
+  fprintf(out, "\n  yy_reduce_ofst[]  %6d entries x %d = %7d bytes",
+          nReduceOfst, szReduce, nReduceOfst*szReduce);
+  if( iMnNt>=0 ){
+    fprintf(out, "  (offsets %d in state %d to %d in state %d)",
+            mnNt, lemp->sorted[iMnNt]->statenum,
+            mxNt, lemp->sorted[iMxNt]->statenum);
+  }
+  fprintf(out, "\n  yy_default[]      %6d entries x %d = %7d bytes\n",
+          lemp->nxstate, szActionType, lemp->nxstate*szActionType);
+  if( lemp->has_fallback ){
+    fprintf(out, "  yyFallback[]      %6d entries x %d = %7d bytes\n",
+            lemp->nterminal, szCodeType, lemp->nterminal*szCodeType);
+  }
+
+  /* Compare the encodings that -e can select.  A probe is one place
+  ** looked at in the tables, a load is one array element read, counting
+  ** yy_default[], and the lines are the distinct memory locations read,
+  ** which is the number of cache misses when the tables are cold */
+  nLookup = lemp->nxstate*lemp->nterminal;
+  if( nLookup==0 ) nLookup = 1;
+  fprintf(out, "\nTable encodings (-e), per terminal look-up:\n");
+  fprintf(out, "  %-8s %9s %8s %8s %8s\n", "", "bytes", "probes", "loads",
+          "lines");
+  nComb = nByte = lemp->ncombtab*szActionType + nLookahead*szCodeType
+          + nShiftOfst*szShift + nReduceOfst*szReduce
+          + lemp->nxstate*szActionType;
+  fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "comb", nByte,
+          (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+          (double)(2*nProbe+nLookup)/nLookup,
+          lemp->encoding==ENC_COMB ? "  (in use)" : "");
+  nByte = lemp->nxstate*(lemp->nsymbol+1)*szActionType;
+  if( dense_needs_check(lemp) ){
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f", "dense", nByte,
+            (double)nProbe/nLookup, (double)(nProbe+nMiss)/nLookup,
+            (double)(nProbe+nMiss)/nLookup);
+  }else{
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f", "dense", nByte,
+            1.0, 1.0, 1.0);
+  }
+  fprintf(out, "%s\n", lemp->encoding==ENC_DENSE ? "  (in use)" : "");
+  if( lemp->nsymbol<65536 ){
+    hash_build(lemp, &ht);
+    nByte = hash_size(lemp, &ht, szActionType, szCodeType)
+            + lemp->nxstate*szActionType;
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "hash", nByte,
+            (double)nProbe/nLookup, (double)(3*nProbe+nLookup)/nLookup,
+            (double)(3*nProbe+nLookup)/nLookup,
+            lemp->encoding==ENC_HASH ? "  (in use)" : "");
+    hash_free(lemp, &ht);
+  }
+  nByte = nLookahead*pair_struct_size(szActionType, szCodeType, 0)
+          + lemp->nxstate*pair_struct_size(szShift, szReduce, szActionType);
+  fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "pair", nByte,
+          (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+          (double)(nProbe+nLookup)/nLookup,
+          lemp->encoding==ENC_PAIR ? "  (in use)" : "");
+  if( packed_widths(lemp, mnTkn<0 ? mnTkn : 0, mnNt<0 ? mnNt : 0,
+                    mxNt>0 ? mxNt : 0, aBit)<=PACKED_MAX_BITS ){
+    nByte = packed_size(lemp->ncombtab, aBit[0])
+            + packed_size(lemp->nterminal+lemp->ncombtab, aBit[1])
+            + packed_size(lemp->nxstate, aBit[2])
+            + packed_size(lemp->nxstate, aBit[3])
+            + packed_size(lemp->nxstate, aBit[0]);
+    fprintf(out, "  %-8s %9d %8.2f %8.2f %8.2f%s\n", "packed", nByte,
+            (double)nProbe/nLookup, (double)(2*nProbe+nLookup)/nLookup,
+            (double)(2*nProbe+nLookup)/nLookup,
+            lemp->encoding==ENC_PACKED ? "  (in use)" : "");
+    fprintf(out, "  packed: %d bytes %s than comb, about %.1f more "
+            "instructions per look-up\n", nComb>=nByte ? nComb-nByte
+            : nByte-nComb, nComb>=nByte ? "fewer" : "more",
+            (double)(2*nProbe+nLookup)*PACKED_READ_COST/nLookup);
+  }
+
+  /* Show what -F does, or would do, for the look-ups that retry */
+  if( lemp->foldFallback ){
+    fprintf(out, "\n%%fallback and %%wildcard are folded into the tables "
+            "(-F), adding %d entries.\n", lemp->nfolded);
+  }else if( lemp->has_fallback || lemp->wildcard ){
+    fprintf(out, "\n%d of the %d terminal look-ups (%.1f%%) retry with a "
+            "%%fallback or\n%%wildcard token.  Folding them into the tables "
+            "(-F) adds %d entries.\n", nRetry, nLookup,
+            100.0*nRetry/nLookup, nFold);
+  }
+
+  /* Show the states and symbols, largest first */
+  qsort(aState, lemp->nxstate, sizeof(aState[0]), size_line_cmp);
+  fprintf(out, "\nStates by share of yy_action[] and yy_lookahead[]:\n");
+  fprintf(out, "  %6s %8s %8s %8s %7s %6s %8s %6s %6s\n", "state",
+          "entries", "bytes", "explicit", "probes", "max", "reduces",
+          "chain", "max");
+  for(i=0; i<lemp->nxstate; i++){
+    struct size_line *p = &aState[i];
+    fprintf(out, "  %6d %8.1f %8.1f %8d %7.2f %6d %8d %6.2f %6d\n",
+            p->id, p->rSlots, p->rSlots*(szActionType+szCodeType),
+            p->nExplicit, p->rProbe, p->mxProbe, p->nReduce, p->rChain,
+            p->mxChain);
+  }
+  qsort(aSym, lemp->nsymbol, sizeof(aSym[0]), size_line_cmp);
+  fprintf(out, "\nSymbols by share of yy_action[] and yy_lookahead[]:\n");
+  fprintf(out, "  %-30s %8s %8s %8s\n", "symbol", "entries", "bytes",
+          "states");
+  for(i=0; i<lemp->nsymbol; i++){
+    struct size_line *p = &aSym[i];
+    struct symbol *sp = lemp->symbols[p->id];
+    if( p->nExplicit==0 ) continue;
+    fprintf(out, "  %-30s %8.1f %8.1f %8d", sp->name, p->rSlots,
+            p->rSlots*(szActionType+szCodeType), p->nExplicit);
+    if( sp->fallback ) fprintf(out, "  (falls back to %s)", sp->fallback->name);
+    fprintf(out, "\n");
+  }
+  lemon_free(lemp, anUse);
+  lemon_free(lemp, aUnit);
+  lemon_free(lemp, apAct);
+  lemon_free(lemp, aState);
+  lemon_free(lemp, aSym);
+}
+
+
 /* Generate a header file for the parser */
 void ReportHeader(struct lemon *lemp)
 {
@@ -1795,7 +4700,7 @@ void ReportHeader(struct lemon *lemp)
       if( strcmp(line,pattern) ) break;
     }
     nextChar = fgetc(in);
-    fclose(in);
+    file_close(lemp, in);
     if( i==lemp->nterminal && nextChar==EOF ){
       /* No change in the file.  Don't rewrite it. */
       return;
@@ -1806,7 +4711,7 @@ void ReportHeader(struct lemon *lemp)
     for(i=1; i<lemp->nterminal; i++){
       fprintf(out,"#define %s%-30s %3d\n",prefix,lemp->symbols[i]->name,i);
     }
-    fclose(out);
+    file_close(lemp, out);
   }
   return;
 }
@@ -1866,7 +4771,7 @@ void CompressTables(struct lemon *lemp)
       if( ap->type==REDUCE && ap->x.rp==rbest ) break;
     }
     assert( ap );
-    ap->sp = Symbol_new("{default}");
+    ap->sp = Symbol_new(lemp,"{default}");
     for(ap=ap->next; ap; ap=ap->next){
       if( ap->type==REDUCE && ap->x.rp==rbest ) ap->type = NOT_USED;
     }
@@ -1930,18 +4835,153 @@ void CompressTables(struct lemon *lemp)
   }
 }
 
+/*
+** Resolve %fallback and %wildcard when the tables are built, for -F.
+** In every state, a token that has no action of its own is given a copy
+** of the action that the parser would otherwise find at run-time, by
+** retrying with the fallback token of the token and then with the
+** wildcard.  The parser then never has to retry, at the cost of the
+** extra table entries.
+*/
+void FoldFallbacks(struct lemon *lemp)
+{
+  struct action **apAct;   /* The action of the current state per token */
+  struct action *ap, *pFound;
+  struct state *stp;
+  struct symbol *sp;
+  int i, j, nAdd;
+
+  apAct = (struct action**)lemon_calloc(lemp, lemp->nterminal,
+                                        sizeof(struct action*));
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    if( stp->autoReduce ) continue;
+    memset(apAct, 0, sizeof(apAct[0])*lemp->nterminal);
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      if( compute_action(lemp, ap)<0 ) continue;
+      apAct[ap->sp->index] = ap;
+    }
+    nAdd = 0;
+    for(j=1; j<lemp->nterminal; j++){
+      if( apAct[j] ) continue;
+      sp = lemp->symbols[j];
+      pFound = sp->fallback ? apAct[sp->fallback->index] : 0;
+      if( pFound==0 && lemp->wildcard ) pFound = apAct[lemp->wildcard->index];
+      if( pFound==0 ) continue;
+      Action_add(lemp, &stp->ap, pFound->type, sp, 0);
+      stp->ap->x = pFound->x;
+      stp->ap->spOpt = pFound->spOpt;
+      nAdd++;
+    }
+    if( nAdd ){
+      stp->ap = Action_sort(stp->ap);
+      lemp->nfolded += nAdd;
+    }
+  }
+  lemon_free(lemp, apAct);
+}
+
+/*
+** Read the profile named by the -P option, as written by ParseProfile()
+** in a parser compiled with YYPROFILE, and count the look-ups of each
+** state and the reduces by each rule.  Each line of the profile is one
+** of
+**
+**      state N SYMBOL COUNT
+**      rule N COUNT
+**
+** where the N of a state is its number before ResortStates().  The
+** counts of repeated lines add up, so the profiles of several runs can
+** simply be concatenated.  Blank lines and lines starting with "#" are
+** ignored.
+*/
+void ReadProfile(struct lemon *lemp){
+  FILE *in;
+  char line[LINESIZE];
+  char zSymbol[LINESIZE];
+  struct rule **apRule;       /* The rules, by rule number */
+  struct rule *rp;
+  int lineno = 0;
+  int i;
+
+  in = fopen(lemp->zProfile, "rb");
+  if( in==0 ){
+    fprintf(lemp->errstream, "Can't open the profile \"%s\".\n",
+            lemp->zProfile);
+    lemp->errorcnt++;
+    return;
+  }
+  file_track(lemp, in);
+  apRule = (struct rule**)lemon_calloc(lemp, lemp->nrule, sizeof(apRule[0]));
+  for(rp=lemp->rule; rp; rp=rp->next) apRule[rp->iRule] = rp;
+  while( fgets(line, LINESIZE, in) ){
+    int iState, iRule;
+    double rCount;
+    struct symbol *sp;
+    struct state *stp;
+    lineno++;
+    for(i=0; ISSPACE(line[i]); i++){}
+    if( line[i]==0 || line[i]=='#' ) continue;
+    if( sscanf(&line[i], "rule %d %lf", &iRule, &rCount)==2
+     && rCount>=0.0 ){
+      if( iRule<0 || iRule>=lemp->nrule ){
+        ErrorMsg(lemp, lemp->zProfile, lineno,
+           "No rule %d.  Is this a profile of another grammar?", iRule);
+        lemp->errorcnt++;
+        break;
+      }
+      apRule[iRule]->nReduce += rCount;
+      lemp->nreduceprofiled += rCount;
+      continue;
+    }
+    if( sscanf(&line[i], "state %d %s %lf", &iState, zSymbol, &rCount)!=3
+     || rCount<0.0 ){
+      ErrorMsg(lemp, lemp->zProfile, lineno, "Not a profile line.");
+      lemp->errorcnt++;
+      break;
+    }
+    sp = Symbol_find(lemp, zSymbol);
+    if( iState<0 || iState>=lemp->nstate || sp==0
+     || sp->index>=lemp->nsymbol ){
+      ErrorMsg(lemp, lemp->zProfile, lineno,
+         "No state %d with symbol \"%s\".  Is this a profile of "
+         "another grammar?", iState, zSymbol);
+      lemp->errorcnt++;
+      break;
+    }
+    stp = lemp->sorted[iState];
+    assert( stp->iOrigin==iState );
+    if( sp->index<lemp->nterminal ){
+      stp->nTknHit += rCount;
+    }else{
+      stp->nNtHit += rCount;
+    }
+  }
+  file_close(lemp, in);
+  lemon_free(lemp, apRule);
+  for(i=0; i<lemp->nstate; i++){
+    struct state *stp = lemp->sorted[i];
+    if( stp->nTknHit+stp->nNtHit>0.0 ) lemp->nprofiled++;
+  }
+}
 
 /*
 ** Compare two states for sorting purposes.  The smaller state is the
-** one with the most non-terminal actions.  If they have the same number
-** of non-terminal actions, then the smaller is the one with the most
-** token actions.
+** one with the most look-ups in the profile, if there is one, so that
+** the busiest states get the lowest numbers and the first rows of the
+** tables.  Otherwise the smaller state is the one with the most
+** non-terminal actions.  If they have the same number of non-terminal
+** actions, then the smaller is the one with the most token actions.
 */
 static int stateResortCompare(const void *a, const void *b){
   const struct state *pA = *(const struct state**)a;
   const struct state *pB = *(const struct state**)b;
+  double rA = pA->nTknHit + pA->nNtHit;
+  double rB = pB->nTknHit + pB->nNtHit;
   int n;
 
+  if( rA!=rB ) return rA<rB ? 1 : -1;
   n = pB->nNtAct - pA->nNtAct;
   if( n==0 ){
     n = pB->nTknAct - pA->nTknAct;
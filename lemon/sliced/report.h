@@ -1,7 +1,20 @@
 void Reprint(struct lemon *);
 void ReportOutput(struct lemon *);
-void ReportTable(struct lemon *, int, int);
+void ReportJson(struct lemon *);
+int ReportQuery(struct lemon *);
+void ReportTable(struct lemon *);
 void ReportHeader(struct lemon *);
+void ReportSizes(struct lemon *);
+int encoding_find(const char *);
+int dispatch_find(const char *);
+char *tplt_find(struct lemon *);
+char *file_makename(struct lemon *, const char *);
+FILE *memfile_open(struct memfile *);
+void memfile_close(struct memfile *);
+void file_close(struct lemon *, FILE *);
+void file_close_all(struct lemon *);
 void CompressTables(struct lemon *);
+void FoldFallbacks(struct lemon *);
+void ReadProfile(struct lemon *);
 void ResortStates(struct lemon *);
 
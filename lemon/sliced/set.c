@@ -2,45 +2,39 @@
 ** Set manipulation routines for the LEMON parser generator.
 */
 
-static int size = 0;
-
 /* Set the set size */
-void SetSize(int n)
+void SetSize(struct lemon *lemp, int n)
 {
-  size = n+1;
+  lemp->setSize = n+1;
 }
 
 /* Allocate a new set */
-char *SetNew(void){
-  char *s;
-  s = (char*)calloc( size, 1);
-  if( s==0 ){
-    memory_error();
-  }
-  return s;
+char *SetNew(struct lemon *lemp){
+  return (char*)lemon_calloc(lemp, lemp->setSize, 1);
 }
 
 /* Deallocate a set */
-void SetFree(char *s)
+void SetFree(struct lemon *lemp, char *s)
 {
-  free(s);
+  lemon_free(lemp, s);
 }
 
 /* Add a new element to the set.  Return TRUE if the element was added
 ** and FALSE if it was already there. */
-int SetAdd(char *s, int e)
+int SetAdd(struct lemon *lemp, char *s, int e)
 {
   int rv;
-  assert( e>=0 && e<size );
+  assert( e>=0 && e<lemp->setSize );
   rv = s[e];
   s[e] = 1;
   return !rv;
 }
 
 /* Add every element of s2 to s1.  Return TRUE if s1 changes. */
-int SetUnion(char *s1, char *s2)
+int SetUnion(struct lemon *lemp, char *s1, char *s2)
 {
   int i, progress;
+  int size = lemp->setSize;
   progress = 0;
   for(i=0; i<size; i++){
     if( s2[i]==0 ) continue;
@@ -1,7 +1,7 @@
-void  SetSize(int);             /* All sets will be of size N */
-char *SetNew(void);               /* A new set for element 0..N */
-void  SetFree(char*);             /* Deallocate a set */
-int SetAdd(char*,int);            /* Add element to a set */
-int SetUnion(char *,char *);    /* A <- A U B, thru element N */
+void  SetSize(struct lemon*,int);      /* All sets will be of size N */
+char *SetNew(struct lemon*);           /* A new set for element 0..N */
+void  SetFree(struct lemon*,char*);    /* Deallocate a set */
+int SetAdd(struct lemon*,char*,int);   /* Add element to a set */
+int SetUnion(struct lemon*,char *,char *);  /* A <- A U B, thru element N */
 #define SetFind(X,Y) (X[Y])       /* True if Y is in set X */
 
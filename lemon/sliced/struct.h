@@ -32,13 +32,18 @@ struct symbol {
                            ** popped from the stack during error processing */
   int destLineno;          /* Line number for start of destructor.  Set to
                            ** -1 for duplicate destructors. */
+  const char *destFilename;  /* File that holds the destructor */
   char *datatype;          /* The data type of information held by this
                            ** object. Only used if type==NONTERMINAL */
   int dtnum;               /* The data type number.  In the parser, the value
                            ** stack is a union.  The .yy%d element of this
                            ** union is the correct data type for this object */
+  int iBox;                /* With -Z, 1 plus the number of the pool that
+                           ** holds the values, if they are not in the stack */
   int bContent;            /* True if this symbol ever carries content - if
                            ** it is ever more than just syntax */
+  int bArena;              /* True if the %arena holds the values, which
+                           ** then need no destructor */
   /* The following fields are used by MULTITERMINALs only */
   int nsubsym;             /* Number of constituent symbols in the MULTI */
   struct symbol **subsym;  /* Array of constituent symbols */
@@ -51,6 +56,7 @@ struct rule {
   const char *lhsalias;    /* Alias for the LHS (NULL if none) */
   int lhsStart;            /* True if left-hand side is the start symbol */
   int ruleline;            /* Line number for the rule */
+  const char *filename;    /* File in which the rule appears */
   int nrhs;                /* Number of RHS symbols */
   struct symbol **rhs;     /* The RHS symbols */
   const char **rhsalias;   /* An alias for each RHS symbol (NULL if none) */
@@ -67,6 +73,10 @@ struct rule {
   Boolean doesReduce;      /* Reduce actions occur after optimization */
   Boolean neverReduce;     /* Reduce is theoretically possible, but prevented
                            ** by actions or other outside implementation */
+  Boolean lhsMinor;        /* The code uses the yylhsminor variable */
+  int iUnit;               /* Translation unit holding the code (-u) */
+  double nReduce;          /* Reduces counted by the profile (-P) */
+  Boolean isCold;          /* Code is in a cold function, out of line (-P) */
   struct rule *nextlhs;    /* Next rule with the same LHS */
   struct rule *next;       /* Next rule in the global list */
 };
@@ -117,6 +127,7 @@ struct action {
   struct symbol *spOpt;    /* SHIFTREDUCE optimization to this symbol */
   struct action *next;     /* Next action for this state */
   struct action *collide;  /* Next action with the same hash */
+  int iSeq;                /* Order of creation.  Breaks ties in sorting */
 };
 
 /* Each state of the generated parser's finite state machine
@@ -131,6 +142,9 @@ struct state {
   int iDfltReduce;         /* Default action is to REDUCE by this rule */
   struct rule *pDfltReduce;/* The default REDUCE rule. */
   int autoReduce;          /* True if this is an auto-reduce state */
+  int iOrigin;             /* statenum before ResortStates() */
+  double nTknHit, nNtHit;  /* Look-ups of terminals and nonterminals
+                           ** counted by the profile (-P) */
 };
 #define NO_OFFSET (-2147483647)
 
@@ -142,6 +156,57 @@ struct plink {
   struct plink *next;      /* The next propagate link */
 };
 
+/* The phases of a run of the parser generator.  The time spent in each
+** one is recorded in lemp->aPhase[].
+*/
+#define PHASE_PARSE     0  /* Read and parse the grammar */
+#define PHASE_ANALYZE   1  /* Compute the LALR(1) automaton */
+#define PHASE_COMPRESS  2  /* Compress and sort the action tables */
+#define PHASE_REPORT    3  /* Write the report, "*.out" */
+#define PHASE_TABLES    4  /* Write the parser, "*.c" */
+#define PHASE_HEADER    5  /* Write the token codes, "*.h" */
+#define PHASE_COUNT     6
+
+/* Encodings of the parser tables, selected by -e */
+enum e_encoding {
+  ENC_COMB,                /* Row displacement, with a lookahead check */
+  ENC_DENSE,               /* A [state][symbol] matrix */
+  ENC_HASH,                /* A perfect-hashed row for each state */
+  ENC_CODE,                /* C code with a switch for each state */
+  ENC_PAIR,                /* Comb, with look-ahead and action side by side */
+  ENC_PACKED               /* Comb, with entries of the exact bit width */
+};
+
+/* Ways for yy_reduce() to reach the code of a rule, selected by -R */
+enum e_dispatch {
+  DSP_SWITCH,              /* A switch on the rule number */
+  DSP_FUNCTION,            /* A table of one function for each action */
+  DSP_GOTO                 /* A table of labels, for a computed goto */
+};
+
+/* The identity of a file, so that one file reached by two different
+** names is still known to be the same file */
+struct file_id {
+  unsigned long dev;       /* Device that holds the file */
+  unsigned long ino;       /* Inode number of the file on that device */
+  int ok;                  /* True if dev and ino are known */
+};
+
+/* A grammar module, read into the grammar by %import.  Nonterminals of
+** a module are private to it unless they are listed by %export.
+*/
+struct gmodule {
+  char *filename;          /* Name of the module file */
+  struct file_id id;       /* Identity of the module file */
+  char *prefix;            /* Prefix for the private nonterminals */
+  const char **azExport;   /* Nonterminals shared with other files */
+  int nExport;             /* Number of entries in azExport[] */
+  char *pMap;              /* Text of the module, while it is parsed */
+  size_t nMap;             /* Size of pMap[] */
+  int bMapped;             /* True if pMap[] came from mmap() */
+  struct gmodule *next;    /* Next module, in the order they were read */
+};
+
 /* The state vector for the entire parser generator is recorded as
 ** follows.  (LEMON uses no global variables and makes little use of
 ** static variables.  Fields in the following structure can be thought
@@ -187,16 +252,102 @@ struct lemon {
   int nconflict;           /* Number of parsing conflicts */
   int nactiontab;          /* Number of entries in the yy_action[] table */
   int nlookaheadtab;       /* Number of entries in yy_lookahead[] */
+  int ncombtab;            /* yy_action[] entries of the comb encoding */
   int tablesize;           /* Total table size of all tables in bytes */
   int basisflag;           /* Print only basis configurations */
   int printPreprocessed;   /* Show preprocessor output on stdout */
   int has_fallback;        /* True if any %fallback is seen in the grammar */
+  int has_arena;           /* True if %arena is seen in the grammar */
+  int nfolded;             /* Entries added by FoldFallbacks() */
+  int nprofiled;           /* States with look-ups in the profile */
+  double nreduceprofiled;  /* Reduces counted by the profile */
+  int ncold;               /* Rules whose code is in cold functions */
   int nolinenosflag;       /* True if #line statements should not be printed */
   char *argv0;             /* Name of the program */
+
+  /* Options, from the command line or from a struct lemon_options */
+  int rpflag;              /* Print the grammar without actions */
+  int noCompress;          /* Do not compress the action table */
+  int noResort;            /* Do not sort or renumber states */
+  int quiet;               /* Do not write the report file */
+  int mhflag;              /* Output a makeheaders compatible file */
+  int sqlFlag;             /* Generate the *.sql file */
+  int statistics;          /* Print parser statistics */
+  int showPrecedenceConflict; /* Report conflicts resolved by precedence */
+  int jsonReport;          /* Write the report in JSON lines format */
+  int sizeReport;          /* Show what contributes to the table sizes */
+  int foldFallback;        /* Fold %fallback and %wildcard into the tables */
+  int nUnit;               /* Split the parser into this many source files */
+  int encoding;            /* Encoding of the tables, an ENC_* value */
+  int dispatch;            /* Dispatch of the reduce actions, a DSP_* value */
+  const char *zProfile;    /* Profile that orders the states, or NULL */
+  int blobTables;          /* Write the tables to a binary file (-B) */
+  int sharedEngine;        /* Leave the driver to lemengine.c (-G) */
+  int stackArrays;         /* States and values in parallel arrays (-A) */
+  int boxSize;             /* Values over this many bytes in pools (-Z) */
+  int szEntry;             /* Bytes in a stack entry, or -1 if unknown */
+  int szEntryUnboxed;      /* The same without -Z, or -1 if unknown */
+  int nLhsInPlace;         /* LHS values written in place by analysis */
+  int nLhsCopy;            /* LHS values still copied into place */
+  int nTokenNoValue;       /* Tokens whose values are never stored */
+  const char *zQuery;      /* Query the JSON lines report instead of running */
+  int nDefine;             /* Number of %ifdef macros */
+  char **azDefine;         /* Names of the %ifdef macros */
+  char *outputDir;         /* Directory for the output files, or NULL */
+  char *templatename;      /* Name of the template file, or NULL */
+  const char *zTemplate;   /* Text of the template, or NULL */
+  size_t nTemplate;        /* Number of bytes in zTemplate[] */
+  const char *zGrammar;    /* Text of the grammar, or NULL to read filename */
+  size_t nGrammar;         /* Number of bytes in zGrammar[] */
+
+  /* Where the output goes */
+  FILE *outstream;         /* Messages that the CLI writes to stdout */
+  FILE *errstream;         /* Error messages */
+  struct memfile *aMemfile;  /* Output files captured in memory, or NULL */
+  FILE *apOpen[4];         /* Files open for reading or writing */
+  char *pInputMap;         /* The input file, while Parse() has it mapped */
+  size_t nInputMap;        /* Size of pInputMap[] */
+  int bInputMapped;        /* True if pInputMap[] came from mmap() */
+  struct gmodule *pModule; /* Grammar modules read by %import */
+
+  /* Private state of the individual modules */
+  jmp_buf *pAbort;         /* Unwind to here on a fatal error */
+  struct memblock *pMem;   /* All memory allocated on behalf of this object */
+  struct s_x1 *x1a;        /* Table of strings */
+  struct s_x2 *x2a;        /* Table of symbols */
+  struct s_x3 *x3a;        /* Table of states */
+  struct s_x4 *x4a;        /* Table of configurations */
+  struct config *configFreelist;   /* List of free configurations */
+  struct config *configCurrent;    /* Top of list of configurations */
+  struct config **configCurrentend;  /* Last on list of configs */
+  struct config *configBasis;      /* Top of list of basis configs */
+  struct config **configBasisend;  /* End of list of basis configs */
+  struct plink *plinkFreelist;     /* List of free plinks */
+  struct action *actionFreelist;   /* List of free actions */
+  int nActionSeq;          /* Number of actions created */
+  int setSize;             /* Number of elements in every set */
+  char *zAppend;           /* String under construction by append_str() */
+  int nAppendAlloc;        /* Bytes allocated for zAppend[] */
+  int nAppendUsed;         /* Bytes of zAppend[] used */
+  double aPhase[PHASE_COUNT];  /* Milliseconds spent in each phase */
 };
 
-#define MemoryCheck(X) if((X)==0){ \
-  extern void memory_error(); \
-  memory_error(); \
-}
+/* When the parser generator runs as a library, each of its outputs is
+** captured in memory by one of the following, instead of being written
+** to a file or to the terminal.  The MEMFILE_ macros are indexes into
+** the lemp->aMemfile[] array.
+*/
+struct memfile {
+  FILE *fp;                /* Stream being written, or NULL when closed */
+  char *z;                 /* Text written.  Obtained from malloc() */
+  size_t n;                /* Number of bytes in z[] */
+};
+#define MEMFILE_SOURCE  0  /* The parser, "*.c" */
+#define MEMFILE_HEADER  1  /* Token codes, "*.h" */
+#define MEMFILE_REPORT  2  /* The report, "*.out" */
+#define MEMFILE_SQL     3  /* The tables in SQL, "*.sql" */
+#define MEMFILE_OUTPUT  4  /* Text the CLI writes to stdout */
+#define MEMFILE_ERRORS  5  /* Text the CLI writes to stderr */
+#define MEMFILE_TABLES  6  /* The binary tables of -B, "*.tbl" */
+#define MEMFILE_COUNT   7
 
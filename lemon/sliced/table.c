@@ -21,19 +21,19 @@ PRIVATE unsigned strhash(const char *x)
 ** keep strings in a table so that the same string is not in more
 ** than one place.
 */
-const char *Strsafe(const char *y)
+const char *Strsafe(struct lemon *lemp, const char *y)
 {
   const char *z;
   char *cpy;
 
   if( y==0 ) return 0;
-  z = Strsafe_find(y);
-  if( z==0 && (cpy=(char *)malloc( lemonStrlen(y)+1 ))!=0 ){
+  z = Strsafe_find(lemp,y);
+  if( z==0 ){
+    cpy = (char *)lemon_malloc(lemp, lemonStrlen(y)+1 );
     lemon_strcpy(cpy,y);
     z = cpy;
-    Strsafe_insert(z);
+    Strsafe_insert(lemp,z);
   }
-  MemoryCheck(z);
   return z;
 }
 
@@ -58,39 +58,40 @@ typedef struct s_x1node {
   struct s_x1node **from;  /* Previous link */
 } x1node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x1 *x1a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x1a */
 
 /* Allocate a new associative array */
-void Strsafe_init(void){
-  if( x1a ) return;
-  x1a = (struct s_x1*)malloc( sizeof(struct s_x1) );
-  if( x1a ){
-    x1a->size = 1024;
-    x1a->count = 0;
-    x1a->tbl = (x1node*)calloc(1024, sizeof(x1node) + sizeof(x1node*));
-    if( x1a->tbl==0 ){
-      free(x1a);
-      x1a = 0;
+void Strsafe_init(struct lemon *lemp){
+  if( lemp->x1a ) return;
+  lemp->x1a = (struct s_x1*)lemon_malloc(lemp, sizeof(struct s_x1) );
+  if( lemp->x1a ){
+    lemp->x1a->size = 1024;
+    lemp->x1a->count = 0;
+    lemp->x1a->tbl = (x1node*)lemon_calloc(lemp, 1024,
+                                  sizeof(x1node) + sizeof(x1node*));
+    if( lemp->x1a->tbl==0 ){
+      lemon_free(lemp, lemp->x1a);
+      lemp->x1a = 0;
     }else{
       int i;
-      x1a->ht = (x1node**)&(x1a->tbl[1024]);
-      for(i=0; i<1024; i++) x1a->ht[i] = 0;
+      lemp->x1a->ht = (x1node**)&(lemp->x1a->tbl[1024]);
+      for(i=0; i<1024; i++) lemp->x1a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Strsafe_insert(const char *data)
+int Strsafe_insert(struct lemon *lemp, const char *data)
 {
   x1node *np;
   unsigned h;
   unsigned ph;
 
-  if( x1a==0 ) return 0;
+  if( lemp->x1a==0 ) return 0;
   ph = strhash(data);
-  h = ph & (x1a->size-1);
-  np = x1a->ht[h];
+  h = ph & (lemp->x1a->size-1);
+  np = lemp->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,data)==0 ){
       /* An existing entry with the same key is found. */
@@ -99,19 +100,20 @@ int Strsafe_insert(const char *data)
     }
     np = np->next;
   }
-  if( x1a->count>=x1a->size ){
+  if( lemp->x1a->count>=lemp->x1a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x1 array;
-    array.size = arrSize = x1a->size*2;
-    array.count = x1a->count;
-    array.tbl = (x1node*)calloc(arrSize, sizeof(x1node) + sizeof(x1node*));
+    array.size = arrSize = lemp->x1a->size*2;
+    array.count = lemp->x1a->count;
+    array.tbl = (x1node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x1node) + sizeof(x1node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x1node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x1a->count; i++){
+    for(i=0; i<lemp->x1a->count; i++){
       x1node *oldnp, *newnp;
-      oldnp = &(x1a->tbl[i]);
+      oldnp = &(lemp->x1a->tbl[i]);
       h = strhash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -120,31 +122,30 @@ int Strsafe_insert(const char *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x1a->tbl); // This program was originally for 16-bit machines.
-    ** Don't worry about freeing memory on modern platforms. */
-    *x1a = array;
+    lemon_free(lemp, lemp->x1a->tbl);
+    *lemp->x1a = array;
   }
   /* Insert the new data */
-  h = ph & (x1a->size-1);
-  np = &(x1a->tbl[x1a->count++]);
+  h = ph & (lemp->x1a->size-1);
+  np = &(lemp->x1a->tbl[lemp->x1a->count++]);
   np->data = data;
-  if( x1a->ht[h] ) x1a->ht[h]->from = &(np->next);
-  np->next = x1a->ht[h];
-  x1a->ht[h] = np;
-  np->from = &(x1a->ht[h]);
+  if( lemp->x1a->ht[h] ) lemp->x1a->ht[h]->from = &(np->next);
+  np->next = lemp->x1a->ht[h];
+  lemp->x1a->ht[h] = np;
+  np->from = &(lemp->x1a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-const char *Strsafe_find(const char *key)
+const char *Strsafe_find(struct lemon *lemp, const char *key)
 {
   unsigned h;
   x1node *np;
 
-  if( x1a==0 ) return 0;
-  h = strhash(key) & (x1a->size-1);
-  np = x1a->ht[h];
+  if( lemp->x1a==0 ) return 0;
+  h = strhash(key) & (lemp->x1a->size-1);
+  np = lemp->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,key)==0 ) break;
     np = np->next;
@@ -152,18 +153,44 @@ const char *Strsafe_find(const char *key)
   return np ? np->data : 0;
 }
 
+/* Like Strsafe() except that the input is the first n bytes of y, which
+** need not be zero-terminated.  The scanner uses this to intern only the
+** identifiers that become symbols or aliases, straight out of the input
+** buffer.
+*/
+const char *Strsafe_n(struct lemon *lemp, const char *y, int n)
+{
+  unsigned h = 0;
+  int i;
+  x1node *np;
+  char *cpy;
+
+  for(i=0; i<n; i++) h = h*13 + y[i];
+  if( lemp->x1a ){
+    np = lemp->x1a->ht[h & (lemp->x1a->size-1)];
+    while( np ){
+      if( strncmp(np->data,y,n)==0 && np->data[n]==0 ) return np->data;
+      np = np->next;
+    }
+  }
+  cpy = (char *)lemon_malloc(lemp, n+1 );
+  memcpy(cpy, y, n);
+  cpy[n] = 0;
+  Strsafe_insert(lemp,cpy);
+  return cpy;
+}
+
 /* Return a pointer to the (terminal or nonterminal) symbol "x".
 ** Create a new symbol if this is the first time "x" has been seen.
 */
-struct symbol *Symbol_new(const char *x)
+struct symbol *Symbol_new(struct lemon *lemp, const char *x)
 {
   struct symbol *sp;
 
-  sp = Symbol_find(x);
+  sp = Symbol_find(lemp,x);
   if( sp==0 ){
-    sp = (struct symbol *)calloc(1, sizeof(struct symbol) );
-    MemoryCheck(sp);
-    sp->name = Strsafe(x);
+    sp = (struct symbol *)lemon_calloc(lemp, 1, sizeof(struct symbol) );
+    sp->name = Strsafe(lemp,x);
     sp->type = ISUPPER(*x) ? TERMINAL : NONTERMINAL;
     sp->rule = 0;
     sp->fallback = 0;
@@ -175,7 +202,7 @@ struct symbol *Symbol_new(const char *x)
     sp->destLineno = 0;
     sp->datatype = 0;
     sp->useCnt = 0;
-    Symbol_insert(sp,sp->name);
+    Symbol_insert(lemp,sp,sp->name);
   }
   sp->useCnt++;
   return sp;
@@ -226,39 +253,40 @@ typedef struct s_x2node {
   struct s_x2node **from;  /* Previous link */
 } x2node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x2 *x2a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x2a */
 
 /* Allocate a new associative array */
-void Symbol_init(void){
-  if( x2a ) return;
-  x2a = (struct s_x2*)malloc( sizeof(struct s_x2) );
-  if( x2a ){
-    x2a->size = 128;
-    x2a->count = 0;
-    x2a->tbl = (x2node*)calloc(128, sizeof(x2node) + sizeof(x2node*));
-    if( x2a->tbl==0 ){
-      free(x2a);
-      x2a = 0;
+void Symbol_init(struct lemon *lemp){
+  if( lemp->x2a ) return;
+  lemp->x2a = (struct s_x2*)lemon_malloc(lemp, sizeof(struct s_x2) );
+  if( lemp->x2a ){
+    lemp->x2a->size = 128;
+    lemp->x2a->count = 0;
+    lemp->x2a->tbl = (x2node*)lemon_calloc(lemp, 128,
+                                  sizeof(x2node) + sizeof(x2node*));
+    if( lemp->x2a->tbl==0 ){
+      lemon_free(lemp, lemp->x2a);
+      lemp->x2a = 0;
     }else{
       int i;
-      x2a->ht = (x2node**)&(x2a->tbl[128]);
-      for(i=0; i<128; i++) x2a->ht[i] = 0;
+      lemp->x2a->ht = (x2node**)&(lemp->x2a->tbl[128]);
+      for(i=0; i<128; i++) lemp->x2a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Symbol_insert(struct symbol *data, const char *key)
+int Symbol_insert(struct lemon *lemp, struct symbol *data, const char *key)
 {
   x2node *np;
   unsigned h;
   unsigned ph;
 
-  if( x2a==0 ) return 0;
+  if( lemp->x2a==0 ) return 0;
   ph = strhash(key);
-  h = ph & (x2a->size-1);
-  np = x2a->ht[h];
+  h = ph & (lemp->x2a->size-1);
+  np = lemp->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -267,19 +295,20 @@ int Symbol_insert(struct symbol *data, const char *key)
     }
     np = np->next;
   }
-  if( x2a->count>=x2a->size ){
+  if( lemp->x2a->count>=lemp->x2a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x2 array;
-    array.size = arrSize = x2a->size*2;
-    array.count = x2a->count;
-    array.tbl = (x2node*)calloc(arrSize, sizeof(x2node) + sizeof(x2node*));
+    array.size = arrSize = lemp->x2a->size*2;
+    array.count = lemp->x2a->count;
+    array.tbl = (x2node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x2node) + sizeof(x2node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x2node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x2a->count; i++){
+    for(i=0; i<lemp->x2a->count; i++){
       x2node *oldnp, *newnp;
-      oldnp = &(x2a->tbl[i]);
+      oldnp = &(lemp->x2a->tbl[i]);
       h = strhash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -289,33 +318,31 @@ int Symbol_insert(struct symbol *data, const char *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x2a->tbl); // This program was originally written for 16-bit
-    ** machines.  Don't worry about freeing this trivial amount of memory
-    ** on modern platforms.  Just leak it. */
-    *x2a = array;
+    lemon_free(lemp, lemp->x2a->tbl);
+    *lemp->x2a = array;
   }
   /* Insert the new data */
-  h = ph & (x2a->size-1);
-  np = &(x2a->tbl[x2a->count++]);
+  h = ph & (lemp->x2a->size-1);
+  np = &(lemp->x2a->tbl[lemp->x2a->count++]);
   np->key = key;
   np->data = data;
-  if( x2a->ht[h] ) x2a->ht[h]->from = &(np->next);
-  np->next = x2a->ht[h];
-  x2a->ht[h] = np;
-  np->from = &(x2a->ht[h]);
+  if( lemp->x2a->ht[h] ) lemp->x2a->ht[h]->from = &(np->next);
+  np->next = lemp->x2a->ht[h];
+  lemp->x2a->ht[h] = np;
+  np->from = &(lemp->x2a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct symbol *Symbol_find(const char *key)
+struct symbol *Symbol_find(struct lemon *lemp, const char *key)
 {
   unsigned h;
   x2node *np;
 
-  if( x2a==0 ) return 0;
-  h = strhash(key) & (x2a->size-1);
-  np = x2a->ht[h];
+  if( lemp->x2a==0 ) return 0;
+  h = strhash(key) & (lemp->x2a->size-1);
+  np = lemp->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ) break;
     np = np->next;
@@ -324,11 +351,11 @@ struct symbol *Symbol_find(const char *key)
 }
 
 /* Return the n-th data.  Return NULL if n is out of range. */
-struct symbol *Symbol_Nth(int n)
+struct symbol *Symbol_Nth(struct lemon *lemp, int n)
 {
   struct symbol *data;
-  if( x2a && n>0 && n<=x2a->count ){
-    data = x2a->tbl[n-1].data;
+  if( lemp->x2a && n>0 && n<=lemp->x2a->count ){
+    data = lemp->x2a->tbl[n-1].data;
   }else{
     data = 0;
   }
@@ -336,23 +363,24 @@ struct symbol *Symbol_Nth(int n)
 }
 
 /* Return the size of the array */
-int Symbol_count()
+int Symbol_count(struct lemon *lemp)
 {
-  return x2a ? x2a->count : 0;
+  return lemp->x2a ? lemp->x2a->count : 0;
 }
 
 /* Return an array of pointers to all data in the table.
 ** The array is obtained from malloc.  Return NULL if memory allocation
 ** problems, or if the array is empty. */
-struct symbol **Symbol_arrayof()
+struct symbol **Symbol_arrayof(struct lemon *lemp)
 {
   struct symbol **array;
   int i,arrSize;
-  if( x2a==0 ) return 0;
-  arrSize = x2a->count;
-  array = (struct symbol **)calloc(arrSize, sizeof(struct symbol *));
+  if( lemp->x2a==0 ) return 0;
+  arrSize = lemp->x2a->count;
+  array = (struct symbol **)lemon_calloc(lemp, arrSize,
+                                         sizeof(struct symbol *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x2a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemp->x2a->tbl[i].data;
   }
   return array;
 }
@@ -395,11 +423,10 @@ PRIVATE unsigned statehash(struct config *a)
 }
 
 /* Allocate a new state structure */
-struct state *State_new()
+struct state *State_new(struct lemon *lemp)
 {
   struct state *newstate;
-  newstate = (struct state *)calloc(1, sizeof(struct state) );
-  MemoryCheck(newstate);
+  newstate = (struct state *)lemon_calloc(lemp, 1, sizeof(struct state) );
   return newstate;
 }
 
@@ -425,39 +452,40 @@ typedef struct s_x3node {
   struct s_x3node **from;  /* Previous link */
 } x3node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x3 *x3a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x3a */
 
 /* Allocate a new associative array */
-void State_init(void){
-  if( x3a ) return;
-  x3a = (struct s_x3*)malloc( sizeof(struct s_x3) );
-  if( x3a ){
-    x3a->size = 128;
-    x3a->count = 0;
-    x3a->tbl = (x3node*)calloc(128, sizeof(x3node) + sizeof(x3node*));
-    if( x3a->tbl==0 ){
-      free(x3a);
-      x3a = 0;
+void State_init(struct lemon *lemp){
+  if( lemp->x3a ) return;
+  lemp->x3a = (struct s_x3*)lemon_malloc(lemp, sizeof(struct s_x3) );
+  if( lemp->x3a ){
+    lemp->x3a->size = 128;
+    lemp->x3a->count = 0;
+    lemp->x3a->tbl = (x3node*)lemon_calloc(lemp, 128,
+                                  sizeof(x3node) + sizeof(x3node*));
+    if( lemp->x3a->tbl==0 ){
+      lemon_free(lemp, lemp->x3a);
+      lemp->x3a = 0;
     }else{
       int i;
-      x3a->ht = (x3node**)&(x3a->tbl[128]);
-      for(i=0; i<128; i++) x3a->ht[i] = 0;
+      lemp->x3a->ht = (x3node**)&(lemp->x3a->tbl[128]);
+      for(i=0; i<128; i++) lemp->x3a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int State_insert(struct state *data, struct config *key)
+int State_insert(struct lemon *lemp, struct state *data, struct config *key)
 {
   x3node *np;
   unsigned h;
   unsigned ph;
 
-  if( x3a==0 ) return 0;
+  if( lemp->x3a==0 ) return 0;
   ph = statehash(key);
-  h = ph & (x3a->size-1);
-  np = x3a->ht[h];
+  h = ph & (lemp->x3a->size-1);
+  np = lemp->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -466,19 +494,20 @@ int State_insert(struct state *data, struct config *key)
     }
     np = np->next;
   }
-  if( x3a->count>=x3a->size ){
+  if( lemp->x3a->count>=lemp->x3a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x3 array;
-    array.size = arrSize = x3a->size*2;
-    array.count = x3a->count;
-    array.tbl = (x3node*)calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
+    array.size = arrSize = lemp->x3a->size*2;
+    array.count = lemp->x3a->count;
+    array.tbl = (x3node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x3node) + sizeof(x3node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x3node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x3a->count; i++){
+    for(i=0; i<lemp->x3a->count; i++){
       x3node *oldnp, *newnp;
-      oldnp = &(x3a->tbl[i]);
+      oldnp = &(lemp->x3a->tbl[i]);
       h = statehash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -488,31 +517,31 @@ int State_insert(struct state *data, struct config *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x3a->tbl);
-    *x3a = array;
+    lemon_free(lemp, lemp->x3a->tbl);
+    *lemp->x3a = array;
   }
   /* Insert the new data */
-  h = ph & (x3a->size-1);
-  np = &(x3a->tbl[x3a->count++]);
+  h = ph & (lemp->x3a->size-1);
+  np = &(lemp->x3a->tbl[lemp->x3a->count++]);
   np->key = key;
   np->data = data;
-  if( x3a->ht[h] ) x3a->ht[h]->from = &(np->next);
-  np->next = x3a->ht[h];
-  x3a->ht[h] = np;
-  np->from = &(x3a->ht[h]);
+  if( lemp->x3a->ht[h] ) lemp->x3a->ht[h]->from = &(np->next);
+  np->next = lemp->x3a->ht[h];
+  lemp->x3a->ht[h] = np;
+  np->from = &(lemp->x3a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct state *State_find(struct config *key)
+struct state *State_find(struct lemon *lemp, struct config *key)
 {
   unsigned h;
   x3node *np;
 
-  if( x3a==0 ) return 0;
-  h = statehash(key) & (x3a->size-1);
-  np = x3a->ht[h];
+  if( lemp->x3a==0 ) return 0;
+  h = statehash(key) & (lemp->x3a->size-1);
+  np = lemp->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ) break;
     np = np->next;
@@ -523,15 +552,15 @@ struct state *State_find(struct config *key)
 /* Return an array of pointers to all data in the table.
 ** The array is obtained from malloc.  Return NULL if memory allocation
 ** problems, or if the array is empty. */
-struct state **State_arrayof(void)
+struct state **State_arrayof(struct lemon *lemp)
 {
   struct state **array;
   int i,arrSize;
-  if( x3a==0 ) return 0;
-  arrSize = x3a->count;
-  array = (struct state **)calloc(arrSize, sizeof(struct state *));
+  if( lemp->x3a==0 ) return 0;
+  arrSize = lemp->x3a->count;
+  array = (struct state **)lemon_calloc(lemp, arrSize, sizeof(struct state *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x3a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemp->x3a->tbl[i].data;
   }
   return array;
 }
@@ -565,39 +594,40 @@ typedef struct s_x4node {
   struct s_x4node **from;  /* Previous link */
 } x4node;
 
-/* There is only one instance of the array, which is the following */
-static struct s_x4 *x4a;
+/* Each instance of the parser generator has its own instance of the
+** array, which is lemp->x4a */
 
 /* Allocate a new associative array */
-void Configtable_init(void){
-  if( x4a ) return;
-  x4a = (struct s_x4*)malloc( sizeof(struct s_x4) );
-  if( x4a ){
-    x4a->size = 64;
-    x4a->count = 0;
-    x4a->tbl = (x4node*)calloc(64, sizeof(x4node) + sizeof(x4node*));
-    if( x4a->tbl==0 ){
-      free(x4a);
-      x4a = 0;
+void Configtable_init(struct lemon *lemp){
+  if( lemp->x4a ) return;
+  lemp->x4a = (struct s_x4*)lemon_malloc(lemp, sizeof(struct s_x4) );
+  if( lemp->x4a ){
+    lemp->x4a->size = 64;
+    lemp->x4a->count = 0;
+    lemp->x4a->tbl = (x4node*)lemon_calloc(lemp, 64,
+                                  sizeof(x4node) + sizeof(x4node*));
+    if( lemp->x4a->tbl==0 ){
+      lemon_free(lemp, lemp->x4a);
+      lemp->x4a = 0;
     }else{
       int i;
-      x4a->ht = (x4node**)&(x4a->tbl[64]);
-      for(i=0; i<64; i++) x4a->ht[i] = 0;
+      lemp->x4a->ht = (x4node**)&(lemp->x4a->tbl[64]);
+      for(i=0; i<64; i++) lemp->x4a->ht[i] = 0;
     }
   }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
-int Configtable_insert(struct config *data)
+int Configtable_insert(struct lemon *lemp, struct config *data)
 {
   x4node *np;
   unsigned h;
   unsigned ph;
 
-  if( x4a==0 ) return 0;
+  if( lemp->x4a==0 ) return 0;
   ph = confighash(data);
-  h = ph & (x4a->size-1);
-  np = x4a->ht[h];
+  h = ph & (lemp->x4a->size-1);
+  np = lemp->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) data)==0 ){
       /* An existing entry with the same key is found. */
@@ -606,19 +636,20 @@ int Configtable_insert(struct config *data)
     }
     np = np->next;
   }
-  if( x4a->count>=x4a->size ){
+  if( lemp->x4a->count>=lemp->x4a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x4 array;
-    array.size = arrSize = x4a->size*2;
-    array.count = x4a->count;
-    array.tbl = (x4node*)calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
+    array.size = arrSize = lemp->x4a->size*2;
+    array.count = lemp->x4a->count;
+    array.tbl = (x4node*)lemon_calloc(lemp, arrSize,
+                                  sizeof(x4node) + sizeof(x4node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x4node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x4a->count; i++){
+    for(i=0; i<lemp->x4a->count; i++){
       x4node *oldnp, *newnp;
-      oldnp = &(x4a->tbl[i]);
+      oldnp = &(lemp->x4a->tbl[i]);
       h = confighash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -627,32 +658,30 @@ int Configtable_insert(struct config *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    /* free(x4a->tbl); // This code was originall written for 16-bit machines.
-    ** on modern machines, don't worry about freeing this trival amount of
-    ** memory. */
-    *x4a = array;
+    lemon_free(lemp, lemp->x4a->tbl);
+    *lemp->x4a = array;
   }
   /* Insert the new data */
-  h = ph & (x4a->size-1);
-  np = &(x4a->tbl[x4a->count++]);
+  h = ph & (lemp->x4a->size-1);
+  np = &(lemp->x4a->tbl[lemp->x4a->count++]);
   np->data = data;
-  if( x4a->ht[h] ) x4a->ht[h]->from = &(np->next);
-  np->next = x4a->ht[h];
-  x4a->ht[h] = np;
-  np->from = &(x4a->ht[h]);
+  if( lemp->x4a->ht[h] ) lemp->x4a->ht[h]->from = &(np->next);
+  np->next = lemp->x4a->ht[h];
+  lemp->x4a->ht[h] = np;
+  np->from = &(lemp->x4a->ht[h]);
   return 1;
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
-struct config *Configtable_find(struct config *key)
+struct config *Configtable_find(struct lemon *lemp, struct config *key)
 {
   int h;
   x4node *np;
 
-  if( x4a==0 ) return 0;
-  h = confighash(key) & (x4a->size-1);
-  np = x4a->ht[h];
+  if( lemp->x4a==0 ) return 0;
+  h = confighash(key) & (lemp->x4a->size-1);
+  np = lemp->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) key)==0 ) break;
     np = np->next;
@@ -662,12 +691,12 @@ struct config *Configtable_find(struct config *key)
 
 /* Remove all data from the table.  Pass each data to the function "f"
 ** as it is removed.  ("f" may be null to avoid this step.) */
-void Configtable_clear(int(*f)(struct config *))
+void Configtable_clear(struct lemon *lemp, int(*f)(struct config *))
 {
   int i;
-  if( x4a==0 || x4a->count==0 ) return;
-  if( f ) for(i=0; i<x4a->count; i++) (*f)(x4a->tbl[i].data);
-  for(i=0; i<x4a->size; i++) x4a->ht[i] = 0;
-  x4a->count = 0;
+  if( lemp->x4a==0 || lemp->x4a->count==0 ) return;
+  if( f ) for(i=0; i<lemp->x4a->count; i++) (*f)(lemp->x4a->tbl[i].data);
+  for(i=0; i<lemp->x4a->size; i++) lemp->x4a->ht[i] = 0;
+  lemp->x4a->count = 0;
   return;
 }
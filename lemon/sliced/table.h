@@ -11,36 +11,37 @@
 */
 /* Routines for handling a strings */
 
-const char *Strsafe(const char *);
+const char *Strsafe(struct lemon *, const char *);
+const char *Strsafe_n(struct lemon *, const char *, int);
 
-void Strsafe_init(void);
-int Strsafe_insert(const char *);
-const char *Strsafe_find(const char *);
+void Strsafe_init(struct lemon *);
+int Strsafe_insert(struct lemon *, const char *);
+const char *Strsafe_find(struct lemon *, const char *);
 
 /* Routines for handling symbols of the grammar */
 
-struct symbol *Symbol_new(const char *);
+struct symbol *Symbol_new(struct lemon *, const char *);
 int Symbolcmpp(const void *, const void *);
-void Symbol_init(void);
-int Symbol_insert(struct symbol *, const char *);
-struct symbol *Symbol_find(const char *);
-struct symbol *Symbol_Nth(int);
-int Symbol_count(void);
-struct symbol **Symbol_arrayof(void);
+void Symbol_init(struct lemon *);
+int Symbol_insert(struct lemon *, struct symbol *, const char *);
+struct symbol *Symbol_find(struct lemon *, const char *);
+struct symbol *Symbol_Nth(struct lemon *, int);
+int Symbol_count(struct lemon *);
+struct symbol **Symbol_arrayof(struct lemon *);
 
 /* Routines to manage the state table */
 
 int Configcmp(const char *, const char *);
-struct state *State_new(void);
-void State_init(void);
-int State_insert(struct state *, struct config *);
-struct state *State_find(struct config *);
-struct state **State_arrayof(void);
+struct state *State_new(struct lemon *);
+void State_init(struct lemon *);
+int State_insert(struct lemon *, struct state *, struct config *);
+struct state *State_find(struct lemon *, struct config *);
+struct state **State_arrayof(struct lemon *);
 
 /* Routines used for efficiency in Configlist_add */
 
-void Configtable_init(void);
-int Configtable_insert(struct config *);
-struct config *Configtable_find(struct config *);
-void Configtable_clear(int(*)(struct config *));
+void Configtable_init(struct lemon *);
+int Configtable_insert(struct lemon *, struct config *);
+struct config *Configtable_find(struct lemon *, struct config *);
+void Configtable_clear(struct lemon *, int(*)(struct config *));
 
@@ -0,0 +1,373 @@
+/*
+** Watch mode (-w) for the stand-alone program.  Lemon stays running and
+** regenerates the parser every time the grammar or the template changes.
+**
+** Between rebuilds the text of the template is cached, and so is the
+** analysis of the grammar.  If only the template changes, the parser
+** tables are not recomputed and only the "*.c" file is generated again.
+** Outputs are produced in memory and a file on disk is only replaced
+** if its content changes, so that build tools do not rebuild more than
+** necessary.
+*/
+#ifndef LEMON_NO_MAIN
+#ifdef __linux__
+
+/* The parts of a rule that ReportTable() changes.  These are saved
+** after the analysis, so that ReportTable() can be run again.
+*/
+struct watch_rule {
+  const char *code;
+  const char *codePrefix;
+  const char *codeSuffix;
+  int line;
+  Boolean noCode;
+  Boolean codeEmitted;
+};
+
+/* The state of watch mode */
+struct watch {
+  struct lemon *pProto;      /* The options from the command line */
+  struct lemon lem;          /* The last successful analysis */
+  int bAnalyzed;             /* True if lem holds an analysis */
+  int errorcnt;              /* lem.errorcnt after the analysis */
+  struct watch_rule *aRule;  /* Rules before ReportTable() */
+  int *aDestLineno;          /* symbol.destLineno before ReportTable() */
+  char *zTemplateFile;       /* Name of the template file */
+  char *zTemplate;           /* Cached text of the template */
+  size_t nTemplate;          /* Number of bytes in zTemplate[] */
+  struct memfile aFile[MEMFILE_COUNT];  /* The outputs */
+  int fd;                    /* The inotify file descriptor */
+  int wdGrammar;             /* Watch on the directory of the grammar */
+  int wdTemplate;            /* Watch on the directory of the template */
+  char **azModule;           /* Grammar modules read by %import */
+  int *aWdModule;            /* Watch on the directory of each module */
+  int nModule;               /* Number of entries in azModule[] */
+};
+
+/* Return the part of a pathname after the last '/' */
+static const char *watch_tail(const char *zPath){
+  const char *z = strrchr(zPath, '/');
+  return z ? z+1 : zPath;
+}
+
+/* Start watching the directory that contains the file zPath.  Editors
+** often replace a file instead of rewriting it, so watching the file
+** itself does not work.
+*/
+static int watch_dir(struct watch *w, const char *zPath){
+  char *zDir;
+  const char *zTail = watch_tail(zPath);
+  int wd;
+  if( zTail==zPath ){
+    return inotify_add_watch(w->fd, ".", IN_CLOSE_WRITE|IN_MOVED_TO);
+  }
+  zDir = (char*)malloc( zTail-zPath+1 );
+  if( zDir==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  memcpy(zDir, zPath, zTail-zPath);
+  zDir[zTail-zPath] = 0;
+  wd = inotify_add_watch(w->fd, zDir, IN_CLOSE_WRITE|IN_MOVED_TO);
+  free(zDir);
+  return wd;
+}
+
+/* Remember the modules imported by the grammar and watch them as well.
+** Called after every build of the grammar, as %import may have been
+** added or removed.
+*/
+static void watch_modules(struct watch *w, struct lemon *lemp){
+  struct gmodule *pMod;
+  int i;
+  for(i=0; i<w->nModule; i++) free(w->azModule[i]);
+  free(w->azModule);
+  free(w->aWdModule);
+  w->azModule = 0;
+  w->aWdModule = 0;
+  w->nModule = 0;
+  for(pMod=lemp->pModule; pMod; pMod=pMod->next) w->nModule++;
+  if( w->nModule==0 ) return;
+  w->azModule = (char**)malloc( w->nModule*sizeof(char*) );
+  w->aWdModule = (int*)malloc( w->nModule*sizeof(int) );
+  if( w->azModule==0 || w->aWdModule==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  for(i=0, pMod=lemp->pModule; pMod; i++, pMod=pMod->next){
+    w->azModule[i] = strdup(pMod->filename);
+    if( w->azModule[i]==0 ){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+    w->aWdModule[i] = watch_dir(w, pMod->filename);
+  }
+}
+
+/* Read the template file into memory.  Return the number of errors */
+static int watch_load_template(struct watch *w){
+  FILE *in = fopen(w->zTemplateFile, "rb");
+  long n;
+  free(w->zTemplate);
+  w->zTemplate = 0;
+  w->nTemplate = 0;
+  if( in==0 ){
+    fprintf(stderr,"Can't open the template file \"%s\".\n",w->zTemplateFile);
+    return 1;
+  }
+  fseek(in,0,2);
+  n = ftell(in);
+  rewind(in);
+  w->zTemplate = (char*)malloc( n>0 ? n+1 : 1 );
+  if( w->zTemplate==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  w->nTemplate = n>0 ? fread(w->zTemplate, 1, (size_t)n, in) : 0;
+  w->zTemplate[w->nTemplate] = 0;
+  fclose(in);
+  return 0;
+}
+
+/* Save the rules and symbols that ReportTable() modifies */
+static void watch_save(struct watch *w){
+  struct lemon *lemp = &w->lem;
+  struct rule *rp;
+  int i;
+  w->aRule = (struct watch_rule*)lemon_calloc(lemp, lemp->nrule,
+                                              sizeof(w->aRule[0]));
+  w->aDestLineno = (int*)lemon_calloc(lemp, lemp->nsymbol, sizeof(int));
+  for(rp=lemp->rule; rp; rp=rp->next){
+    struct watch_rule *p = &w->aRule[rp->iRule];
+    p->code = rp->code;
+    p->codePrefix = rp->codePrefix;
+    p->codeSuffix = rp->codeSuffix;
+    p->line = rp->line;
+    p->noCode = rp->noCode;
+    p->codeEmitted = rp->codeEmitted;
+  }
+  for(i=0; i<lemp->nsymbol; i++){
+    w->aDestLineno[i] = lemp->symbols[i]->destLineno;
+  }
+  w->errorcnt = lemp->errorcnt;
+}
+
+/* Undo the changes that ReportTable() made to the rules and symbols */
+static void watch_restore(struct watch *w){
+  struct lemon *lemp = &w->lem;
+  struct rule *rp;
+  int i;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    struct watch_rule *p = &w->aRule[rp->iRule];
+    rp->code = p->code;
+    rp->codePrefix = p->codePrefix;
+    rp->codeSuffix = p->codeSuffix;
+    rp->line = p->line;
+    rp->noCode = p->noCode;
+    rp->codeEmitted = p->codeEmitted;
+  }
+  for(i=0; i<lemp->nsymbol; i++){
+    lemp->symbols[i]->destLineno = w->aDestLineno[i];
+  }
+  lemp->errorcnt = w->errorcnt;
+}
+
+/* Generate only the "*.c" and "*.sql" files, for a new template */
+static int watch_tables(struct lemon *lemp){
+  double rStart = lemon_clock();
+  ReportTable(lemp);
+  lemp->aPhase[PHASE_TABLES] = lemon_clock() - rStart;
+  if( lemp->nconflict > 0 ){
+    fprintf(lemp->errstream,"%d parsing conflicts.\n",lemp->nconflict);
+  }
+  return ((lemp->errorcnt > 0) || (lemp->nconflict > 0)) ? 1 : 0;
+}
+
+/* Write the output in memory to the file zName, unless the file already
+** holds exactly that text.  Return true if the file was written.
+*/
+static int watch_write(struct memfile *p, const char *zName){
+  FILE *fp;
+  int bSame = 0;
+  fp = fopen(zName, "rb");
+  if( fp ){
+    size_t i;
+    int c = 0;
+    for(i=0; i<p->n && (c = getc(fp))==(unsigned char)p->z[i]; i++){}
+    bSame = i==p->n && getc(fp)==EOF;
+    fclose(fp);
+  }
+  if( bSame ) return 0;
+  fp = fopen(zName, "wb");
+  if( fp==0 ){
+    fprintf(stderr,"Can't open file \"%s\".\n",zName);
+    return 0;
+  }
+  fwrite(p->z, 1, p->n, fp);
+  fclose(fp);
+  return 1;
+}
+
+/* Regenerate the parser.  bGrammar is true if the grammar may have
+** changed and bTemplate is true if the template may have changed.
+*/
+static void watch_build(struct watch *w, int bGrammar, int bTemplate){
+  static const char *azSuffix[] = { ".c", ".h", ".out", ".sql" };
+  static const char *azPhase[] = {
+    "parse", "analyze", "compress", "report", "tables", "header"
+  };
+  struct lemon *lemp = &w->lem;
+  double rStart = lemon_clock();
+  double rWrite;
+  int rc;
+  int i;
+
+  if( bTemplate && watch_load_template(w) ) return;
+  for(i=0; i<PHASE_COUNT; i++) lemp->aPhase[i] = -1.0;
+  if( bGrammar || !w->bAnalyzed ){
+    if( w->bAnalyzed ) lemon_free_all(lemp);
+    w->bAnalyzed = 0;
+    *lemp = *w->pProto;
+    for(i=0; i<PHASE_COUNT; i++) lemp->aPhase[i] = -1.0;
+    lemp->aMemfile = w->aFile;
+    lemp->outstream = stdout;
+    lemp->errstream = stderr;
+    lemp->zTemplate = w->zTemplate;
+    lemp->nTemplate = w->nTemplate;
+    rc = lemon_protect(lemp, lemon_analyze);
+    if( rc<0 ){
+      watch_save(w);
+      w->bAnalyzed = 1;
+      rc = lemon_protect(lemp, lemon_report);
+    }
+  }else{
+    watch_restore(w);
+    lemp->zTemplate = w->zTemplate;
+    lemp->nTemplate = w->nTemplate;
+    rc = lemon_protect(lemp, watch_tables);
+  }
+
+  /* Write the outputs that changed */
+  rWrite = lemon_clock();
+  printf("%s:", lemp->filename);
+  for(i=0; i<(int)(sizeof(azSuffix)/sizeof(azSuffix[0])); i++){
+    struct memfile *p = &w->aFile[i];
+    if( p->z ){
+      char *zName = file_makename(lemp, i==MEMFILE_REPORT && lemp->jsonReport
+                                        ? ".jsonl" : azSuffix[i]);
+      printf(" %s %s", watch_tail(zName),
+             watch_write(p, zName) ? "updated" : "unchanged");
+      lemon_free(lemp, zName);
+      free(p->z);
+      p->z = 0;
+      p->n = 0;
+    }
+  }
+  rWrite = lemon_clock() - rWrite;
+  if( lemp->errorcnt ) printf(" %d errors", lemp->errorcnt);
+  if( bGrammar ) watch_modules(w, lemp);
+  if( !w->bAnalyzed ) lemon_free_all(lemp);
+  printf("\n  %s in %.1f ms:", bGrammar ? "rebuilt" : "new template",
+         lemon_clock() - rStart);
+  for(i=0; i<PHASE_COUNT; i++){
+    if( lemp->aPhase[i]>=0.0 ) printf(" %s %.1f", azPhase[i], lemp->aPhase[i]);
+  }
+  printf(" write %.1f\n", rWrite);
+  fflush(stdout);
+}
+
+/* Watch the grammar and the template, and regenerate the parser every
+** time one of them changes.  This routine only returns on an error.
+*/
+int lemon_watch(struct lemon *pProto){
+  struct watch w;
+  union {
+    struct inotify_event ev;
+    char a[4096];
+  } buf;
+
+  memset(&w, 0, sizeof(w));
+  w.pProto = pProto;
+
+  /* Find the template.  The search is done only once. */
+  w.lem = *pProto;
+  w.zTemplateFile = pProto->templatename ? pProto->templatename
+                                         : tplt_find(&w.lem);
+  if( w.zTemplateFile==0 ){
+    fprintf(stderr,
+      "Can't find the parser driver template file \"lempar.c\".\n");
+    return 1;
+  }
+  w.zTemplateFile = strdup(w.zTemplateFile);
+  lemon_free_all(&w.lem);
+  if( w.zTemplateFile==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+
+  w.fd = inotify_init();
+  if( w.fd<0 ){
+    fprintf(stderr,"Cannot watch for changes to files.\n");
+    return 1;
+  }
+  w.wdGrammar = watch_dir(&w, pProto->filename);
+  w.wdTemplate = watch_dir(&w, w.zTemplateFile);
+  if( w.wdGrammar<0 || w.wdTemplate<0 ){
+    fprintf(stderr,"Cannot watch \"%s\" or \"%s\".\n",
+            pProto->filename, w.zTemplateFile);
+    return 1;
+  }
+  printf("Watching %s and %s.  Press Ctrl-C to stop.\n",
+         pProto->filename, w.zTemplateFile);
+  watch_build(&w, 1, 1);
+
+  for(;;){
+    int bGrammar = 0;
+    int bTemplate = 0;
+    struct pollfd pfd;
+    ssize_t n;
+    int i;
+
+    /* Wait for a change, then collect further changes until 50ms pass
+    ** without one, as editors often save in several steps */
+    pfd.fd = w.fd;
+    pfd.events = POLLIN;
+    do{
+      char *z;
+      n = read(w.fd, buf.a, sizeof(buf.a));
+      if( n<=0 ){
+        fprintf(stderr,"Cannot watch for changes to files.\n");
+        return 1;
+      }
+      for(z=buf.a; z<buf.a+n; z+=sizeof(struct inotify_event)+
+                                   ((struct inotify_event*)z)->len){
+        struct inotify_event *pEv = (struct inotify_event*)z;
+        if( pEv->len==0 ) continue;
+        if( pEv->wd==w.wdGrammar
+         && strcmp(pEv->name, watch_tail(pProto->filename))==0 ){
+          bGrammar = 1;
+        }
+        for(i=0; i<w.nModule; i++){
+          if( pEv->wd==w.aWdModule[i]
+           && strcmp(pEv->name, watch_tail(w.azModule[i]))==0 ){
+            bGrammar = 1;
+          }
+        }
+        if( pEv->wd==w.wdTemplate
+         && strcmp(pEv->name, watch_tail(w.zTemplateFile))==0 ){
+          bTemplate = 1;
+        }
+      }
+    }while( poll(&pfd, 1, 50)>0 );
+    if( bGrammar || bTemplate ) watch_build(&w, bGrammar, bTemplate);
+  }
+}
+
+#else /* !defined(__linux__) */
+int lemon_watch(struct lemon *pProto){
+  (void)pProto;
+  fprintf(stderr,"Watch mode (-w) is only available on Linux.\n");
+  return 1;
+}
+#endif /* __linux__ */
+#endif /* LEMON_NO_MAIN */
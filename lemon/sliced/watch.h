@@ -0,0 +1,2 @@
+int lemon_watch(struct lemon *);
+